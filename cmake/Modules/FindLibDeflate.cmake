@@ -0,0 +1,37 @@
+# - Try to find libdeflate
+#
+# Defines the following variables:
+#
+# LIBDEFLATE_FOUND - system has libdeflate
+# LIBDEFLATE_INCLUDE_DIR - the libdeflate include directory
+# LIBDEFLATE_LIBRARIES - Link these to use libdeflate
+# LIBDEFLATE_VERSION_STRING - the version of libdeflate found
+
+# Find the header and library
+FIND_PATH(LIBDEFLATE_INCLUDE_DIR NAMES libdeflate.h)
+FIND_LIBRARY(LIBDEFLATE_LIBRARY NAMES deflate libdeflate)
+
+# Found the header, read version
+IF (LIBDEFLATE_INCLUDE_DIR AND EXISTS "${LIBDEFLATE_INCLUDE_DIR}/libdeflate.h")
+	FILE(READ "${LIBDEFLATE_INCLUDE_DIR}/libdeflate.h" LIBDEFLATE_H)
+	IF (LIBDEFLATE_H)
+		STRING(REGEX REPLACE ".*#define[\t ]+LIBDEFLATE_VERSION_STRING[\t ]+\"([^\"]*)\".*" "\\1" LIBDEFLATE_VERSION_STRING "${LIBDEFLATE_H}")
+	ENDIF()
+	UNSET(LIBDEFLATE_H)
+ENDIF()
+
+# Handle the QUIETLY and REQUIRED arguments and set LIBDEFLATE_FOUND
+# to TRUE if all listed variables are TRUE
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LibDeflate
+	REQUIRED_VARS LIBDEFLATE_LIBRARY LIBDEFLATE_INCLUDE_DIR
+	VERSION_VAR LIBDEFLATE_VERSION_STRING)
+
+# Hide advanced variables
+MARK_AS_ADVANCED(LIBDEFLATE_INCLUDE_DIR LIBDEFLATE_LIBRARY)
+
+# Set standard variables
+IF (LIBDEFLATE_FOUND)
+	SET(LIBDEFLATE_LIBRARIES ${LIBDEFLATE_LIBRARY})
+	SET(LIBDEFLATE_INCLUDE_DIRS ${LIBDEFLATE_INCLUDE_DIR})
+ENDIF()
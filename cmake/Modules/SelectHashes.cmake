@@ -1,5 +1,7 @@
 # Select a hash backend
 
+INCLUDE(CheckCSourceCompiles)
+
 # USE_SHA1=CollisionDetection(ON)/HTTPS/Generic/OFF
 
 IF(USE_SHA1 STREQUAL ON OR USE_SHA1 STREQUAL "CollisionDetection")
@@ -30,7 +32,34 @@ IF(SHA1_BACKEND STREQUAL "CollisionDetection")
 	ADD_DEFINITIONS(-DSHA1DC_NO_STANDARD_INCLUDES=1)
 	ADD_DEFINITIONS(-DSHA1DC_CUSTOM_INCLUDE_SHA1_C=\"common.h\")
 	ADD_DEFINITIONS(-DSHA1DC_CUSTOM_INCLUDE_UBC_CHECK_C=\"common.h\")
-	FILE(GLOB SRC_SHA1 hash/sha1/collisiondetect.* hash/sha1/sha1dc/*)
+	FILE(GLOB SRC_SHA1 hash/sha1/collisiondetect.* hash/sha1/accelerated.* hash/sha1/sha1dc/*)
+
+	# Blocks that cannot be part of a collision attack are hashed with the
+	# CPU's SHA-1 instructions, or several inputs at once with its vector
+	# instructions, when they are available at runtime.
+	CHECK_C_SOURCE_COMPILES("
+		#include <immintrin.h>
+		#include <cpuid.h>
+		__attribute__((target(\"sha,ssse3,sse4.1\")))
+		static __m128i rounds(__m128i a, __m128i b) { return _mm_sha1rnds4_epu32(a, b, 0); }
+		int main(void) { unsigned int a, b, c, d; __m128i x = _mm_setzero_si128(); __get_cpuid_count(7, 0, &a, &b, &c, &d); x = rounds(x, x); return 0; }"
+		GIT_SHA1_SHANI)
+	CHECK_C_SOURCE_COMPILES("
+		#include <immintrin.h>
+		#include <cpuid.h>
+		__attribute__((target(\"avx2\")))
+		static void add(int *v) { __m256i x = _mm256_loadu_si256((const __m256i *)v); _mm256_storeu_si256((__m256i *)v, _mm256_add_epi32(x, x)); }
+		int main(void) { unsigned int a, b, c, d; int v[8] = { 0 }; __get_cpuid_count(7, 0, &a, &b, &c, &d); add(v); return 0; }"
+		GIT_SHA1_AVX2)
+	IF(NOT GIT_SHA1_SHANI)
+		CHECK_C_SOURCE_COMPILES("
+			#include <arm_neon.h>
+			#include <sys/auxv.h>
+			__attribute__((target(\"+crypto\")))
+			static uint32x4_t rounds(uint32x4_t a, uint32_t e, uint32x4_t w) { return vsha1cq_u32(a, e, w); }
+			int main(void) { uint32x4_t x = vdupq_n_u32(0); x = rounds(x, (uint32_t)getauxval(AT_HWCAP), x); return 0; }"
+			GIT_SHA1_ARMV8)
+	ENDIF()
 ELSEIF(SHA1_BACKEND STREQUAL "OpenSSL")
 	# OPENSSL_FOUND should already be set, we're checking HTTPS_BACKEND
 
@@ -63,4 +92,10 @@ ELSE()
 	MESSAGE(FATAL_ERROR "Asked for unknown SHA1 backend: ${SHA1_BACKEND}")
 ENDIF()
 
-ADD_FEATURE_INFO(SHA ON "using ${SHA1_BACKEND}")
+IF(GIT_SHA1_SHANI)
+	ADD_FEATURE_INFO(SHA ON "using ${SHA1_BACKEND} with SHA-NI")
+ELSEIF(GIT_SHA1_ARMV8)
+	ADD_FEATURE_INFO(SHA ON "using ${SHA1_BACKEND} with ARMv8 crypto extensions")
+ELSE()
+	ADD_FEATURE_INFO(SHA ON "using ${SHA1_BACKEND}")
+ENDIF()
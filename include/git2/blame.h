@@ -49,6 +49,66 @@ typedef enum {
 	GIT_BLAME_USE_MAILMAP = (1<<5),
 } git_blame_flag_t;
 
+/**
+ * Structure that represents a blame hunk.
+ *
+ * - `lines_in_hunk` is the number of lines in this hunk
+ * - `final_commit_id` is the OID of the commit where this line was last
+ *   changed.
+ * - `final_start_line_number` is the 1-based line number where this hunk
+ *   begins, in the final version of the file
+ * - `final_signature` is the author of `final_commit_id`. If
+ *   `GIT_BLAME_USE_MAILMAP` has been specified, it will contain the canonical
+ *    real name and email address.
+ * - `orig_commit_id` is the OID of the commit where this hunk was found.  This
+ *   will usually be the same as `final_commit_id`, except when
+ *   `GIT_BLAME_TRACK_COPIES_ANY_COMMIT_COPIES` has been specified.
+ * - `orig_path` is the path to the file where this hunk originated, as of the
+ *   commit specified by `orig_commit_id`.
+ * - `orig_start_line_number` is the 1-based line number where this hunk begins
+ *   in the file named by `orig_path` in the commit specified by
+ *   `orig_commit_id`.
+ * - `orig_signature` is the author of `orig_commit_id`. If
+ *   `GIT_BLAME_USE_MAILMAP` has been specified, it will contain the canonical
+ *    real name and email address.
+ * - `boundary` is 1 iff the hunk has been tracked to a boundary commit (the
+ *   root, or the commit specified in git_blame_options.oldest_commit)
+ */
+typedef struct git_blame_hunk {
+	size_t lines_in_hunk;
+
+	git_oid final_commit_id;
+	size_t final_start_line_number;
+	git_signature *final_signature;
+
+	git_oid orig_commit_id;
+	const char *orig_path;
+	size_t orig_start_line_number;
+	git_signature *orig_signature;
+
+	char boundary;
+} git_blame_hunk;
+
+/**
+ * Blame progress callback.
+ *
+ * Called during `git_blame_file` as soon as the attribution of a group
+ * of lines becomes final.  Hunks are reported most recent commit first;
+ * adjacent hunks from the same commit may be reported separately and
+ * are coalesced in the final blame result.
+ *
+ * The hunk is only valid for the duration of the callback.  Return a
+ * non-zero value to cancel the blame; that value is then returned from
+ * `git_blame_file`.
+ *
+ * @param hunk the hunk whose attribution became final
+ * @param payload the payload given in the blame options
+ * @return 0 to continue, or non-zero to abort
+ */
+typedef int GIT_CALLBACK(git_blame_hunk_cb)(
+	const git_blame_hunk *hunk,
+	void *payload);
+
 /**
  * Blame options structure
  *
@@ -85,6 +145,17 @@ typedef struct git_blame_options {
 	 * The default is the last line of the file.
 	 */
 	size_t max_line;
+
+	/**
+	 * Optional callback to receive hunks as soon as they are final,
+	 * before the whole file has been blamed.  Together with `min_line`
+	 * and `max_line` this allows rendering a part of a large file
+	 * progressively.
+	 */
+	git_blame_hunk_cb hunk_cb;
+
+	/** Payload passed to `hunk_cb`. */
+	void *hunk_cb_payload;
 } git_blame_options;
 
 #define GIT_BLAME_OPTIONS_VERSION 1
@@ -104,47 +175,6 @@ GIT_EXTERN(int) git_blame_options_init(
 	git_blame_options *opts,
 	unsigned int version);
 
-/**
- * Structure that represents a blame hunk.
- *
- * - `lines_in_hunk` is the number of lines in this hunk
- * - `final_commit_id` is the OID of the commit where this line was last
- *   changed.
- * - `final_start_line_number` is the 1-based line number where this hunk
- *   begins, in the final version of the file
- * - `final_signature` is the author of `final_commit_id`. If
- *   `GIT_BLAME_USE_MAILMAP` has been specified, it will contain the canonical
- *    real name and email address.
- * - `orig_commit_id` is the OID of the commit where this hunk was found.  This
- *   will usually be the same as `final_commit_id`, except when
- *   `GIT_BLAME_TRACK_COPIES_ANY_COMMIT_COPIES` has been specified.
- * - `orig_path` is the path to the file where this hunk originated, as of the
- *   commit specified by `orig_commit_id`.
- * - `orig_start_line_number` is the 1-based line number where this hunk begins
- *   in the file named by `orig_path` in the commit specified by
- *   `orig_commit_id`.
- * - `orig_signature` is the author of `orig_commit_id`. If
- *   `GIT_BLAME_USE_MAILMAP` has been specified, it will contain the canonical
- *    real name and email address.
- * - `boundary` is 1 iff the hunk has been tracked to a boundary commit (the
- *   root, or the commit specified in git_blame_options.oldest_commit)
- */
-typedef struct git_blame_hunk {
-	size_t lines_in_hunk;
-
-	git_oid final_commit_id;
-	size_t final_start_line_number;
-	git_signature *final_signature;
-
-	git_oid orig_commit_id;
-	const char *orig_path;
-	size_t orig_start_line_number;
-	git_signature *orig_signature;
-
-	char boundary;
-} git_blame_hunk;
-
-
 /** Opaque structure to hold blame results */
 typedef struct git_blame git_blame;
 
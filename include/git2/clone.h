@@ -29,6 +29,10 @@ GIT_BEGIN_DECL
  * it means that instead of a fetch, libgit2 will copy the object
  * database directory instead of figuring out what it needs, which is
  * faster. If possible, it will hardlink the files to save space.
+ *
+ * The git-aware transport is always used for partial clones, whose
+ * fetch options have a filter, and for shallow clones, whose fetch
+ * options have a depth or a shallow date.
  */
 typedef enum {
 	/**
@@ -115,6 +119,9 @@ typedef struct git_clone_options {
 	 *
 	 * The callbacks are used for reporting fetch progress, and for acquiring
 	 * credentials in the event they are needed.
+	 *
+	 * All the tags of the remote are fetched, unless the clone is shallow:
+	 * then only the tags which point into the fetched history are.
 	 */
 	git_fetch_options fetch_opts;
 
@@ -27,6 +27,10 @@ GIT_BEGIN_DECL
  * The returned object should be released with `git_commit_free` when no
  * longer needed.
  *
+ * A malformed commit fails to be looked up.  Its author, committer and
+ * message are only parsed when one of them is first asked for, so the
+ * accessors return NULL if there is not enough memory at that point.
+ *
  * @param commit pointer to the looked up commit
  * @param repo the repo to use when locating the commit.
  * @param id identity of the commit to locate. If the object is
@@ -104,7 +108,7 @@ GIT_EXTERN(const char *) git_commit_message_encoding(const git_commit *commit);
  * potential leading newlines.
  *
  * @param commit a previously loaded commit.
- * @return the message of a commit
+ * @return the message of a commit, or NULL if it could not be loaded
  */
 GIT_EXTERN(const char *) git_commit_message(const git_commit *commit);
 
@@ -112,7 +116,7 @@ GIT_EXTERN(const char *) git_commit_message(const git_commit *commit);
  * Get the full raw message of a commit.
  *
  * @param commit a previously loaded commit.
- * @return the raw message of a commit
+ * @return the raw message of a commit, or NULL if it could not be loaded
  */
 GIT_EXTERN(const char *) git_commit_message_raw(const git_commit *commit);
 
@@ -144,7 +148,7 @@ GIT_EXTERN(const char *) git_commit_body(git_commit *commit);
  * Get the commit time (i.e. committer time) of a commit.
  *
  * @param commit a previously loaded commit.
- * @return the time of a commit
+ * @return the time of a commit, or 0 if it could not be loaded
  */
 GIT_EXTERN(git_time_t) git_commit_time(const git_commit *commit);
 
@@ -152,7 +156,8 @@ GIT_EXTERN(git_time_t) git_commit_time(const git_commit *commit);
  * Get the commit timezone offset (i.e. committer's preferred timezone) of a commit.
  *
  * @param commit a previously loaded commit.
- * @return positive or negative timezone offset, in minutes from UTC
+ * @return positive or negative timezone offset, in minutes from UTC,
+ *  or 0 if it could not be loaded
  */
 GIT_EXTERN(int) git_commit_time_offset(const git_commit *commit);
 
@@ -160,7 +165,7 @@ GIT_EXTERN(int) git_commit_time_offset(const git_commit *commit);
  * Get the committer of a commit.
  *
  * @param commit a previously loaded commit.
- * @return the committer of a commit
+ * @return the committer of a commit, or NULL if it could not be loaded
  */
 GIT_EXTERN(const git_signature *) git_commit_committer(const git_commit *commit);
 
@@ -168,7 +173,7 @@ GIT_EXTERN(const git_signature *) git_commit_committer(const git_commit *commit)
  * Get the author of a commit.
  *
  * @param commit a previously loaded commit.
- * @return the author of a commit
+ * @return the author of a commit, or NULL if it could not be loaded
  */
 GIT_EXTERN(const git_signature *) git_commit_author(const git_commit *commit);
 
@@ -204,7 +209,7 @@ GIT_EXTERN(int) git_commit_author_with_mailmap(
  * Get the full raw text of the commit header.
  *
  * @param commit a previously loaded commit
- * @return the header text of the commit
+ * @return the header text of the commit, or NULL if it could not be loaded
  */
 GIT_EXTERN(const char *) git_commit_raw_header(const git_commit *commit);
 
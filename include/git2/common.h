@@ -205,7 +205,14 @@ typedef enum {
 	GIT_OPT_GET_PACK_MAX_OBJECTS,
 	GIT_OPT_SET_PACK_MAX_OBJECTS,
 	GIT_OPT_DISABLE_PACK_KEEP_FILE_CHECKS,
-	GIT_OPT_ENABLE_HTTP_EXPECT_CONTINUE
+	GIT_OPT_ENABLE_HTTP_EXPECT_CONTINUE,
+	GIT_OPT_ENABLE_STRICT_TREE_PARSING,
+	GIT_OPT_ENABLE_LIBDEFLATE,
+	GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE,
+	GIT_OPT_ENABLE_PROTOCOL_V2,
+	GIT_OPT_SET_HTTP_POOL_MAX_IDLE,
+	GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT,
+	GIT_OPT_SET_ODB_READ_MANY_THREADS
 } git_libgit2_opt_t;
 
 /**
@@ -404,6 +411,59 @@ typedef enum {
  *		> authentication, use expect/continue when POSTing data.
  *		> This option is not available on Windows.
  *
+ *	 opts(GIT_OPT_ENABLE_STRICT_TREE_PARSING, int enabled)
+ *		> Validate every entry of a tree when it is read from the object
+ *		> database.  Trees are only indexed when their entries are first
+ *		> needed; disabling this option trusts the object database and
+ *		> skips validation entirely, so that looking up a single path in
+ *		> a large tree does not require reading all of its entries.
+ *		> Malformed entries are then silently ignored.  This defaults to
+ *		> enabled.
+ *
+ *	 opts(GIT_OPT_ENABLE_LIBDEFLATE, int enabled)
+ *		> Use libdeflate to inflate objects whose size is known in a
+ *		> single call, which is much faster than inflating them with
+ *		> zlib, falling back to zlib for anything it cannot handle.
+ *		> This defaults to enabled, and has no effect unless libgit2
+ *		> was built with libdeflate.
+ *
+ *	 opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, int enabled)
+ *		> Keep the listing of each loose object directory in memory, so
+ *		> that checking whether objects exist and resolving short ids
+ *		> do not need to hit the filesystem each time.  A listing is
+ *		> read again when its directory changes, but objects that are
+ *		> removed from the object database by other processes may
+ *		> still be reported as existing.  This only applies to object
+ *		> databases opened after it is set, and defaults to disabled.
+ *
+ *	 opts(GIT_OPT_ENABLE_PROTOCOL_V2, int enabled)
+ *		> Ask servers to speak version 2 of the wire protocol when
+ *		> fetching over http, ssh and git.  References are then only
+ *		> listed on demand, and a fetch only lists the references that
+ *		> its refspecs can match.  Servers that do not support it use
+ *		> the original protocol.  This defaults to enabled.
+ *
+ *	 opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, size_t connections)
+ *		> Keep up to this many http connections open once the remotes
+ *		> that used them are disconnected or freed, so that the next
+ *		> requests to the same servers, from any remote of the process,
+ *		> do not need new TCP and TLS handshakes.  Connections through
+ *		> a proxy or authenticated with NTLM or Negotiate are not kept.
+ *		> Setting it to 0 closes the idle connections and keeps none.
+ *		> This defaults to 8.
+ *
+ *	 opts(GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT, int seconds)
+ *		> Close the http connections kept open after they were idle for
+ *		> this many seconds.  A request on a connection that the server
+ *		> closed meanwhile is sent again on a new one.  This defaults
+ *		> to 15.
+ *
+ *	 opts(GIT_OPT_SET_ODB_READ_MANY_THREADS, unsigned int threads)
+ *		> Inflate the objects that `git_odb_read_many` reads from
+ *		> packfiles on this many threads; 0 uses one thread per CPU.
+ *		> The callback is still called on the caller's thread.  This
+ *		> defaults to 1, which inflates them on the caller's thread.
+ *
  * @param option Option key
  * @param ... value to set the option
  * @return 0 on success, <0 on failure
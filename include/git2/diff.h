@@ -1214,6 +1214,37 @@ GIT_EXTERN(int) git_diff_blob_to_buffer(
 	git_diff_line_cb line_cb,
 	void *payload);
 
+/**
+ * Directly run a name-status diff between two trees.
+ *
+ * This is a lightweight alternative to `git_diff_tree_to_tree` for callers
+ * that only need to know which paths changed.  Both trees are walked in
+ * lockstep on their raw object data, subtrees that are identical on both
+ * sides are skipped by id without being read, and no `git_diff` is built.
+ *
+ * The callback is invoked once for each added, deleted or modified file,
+ * recursing into subtrees, in the order of the paths in the trees.  Only
+ * the `status`, `nfiles` and the `id`, `path`, `mode` and `flags` fields
+ * of the delta's files are filled in; no rename detection is performed and
+ * no content is examined.  A path that changed between a tree and a
+ * non-tree is reported as the deletion of one and the addition of the
+ * other; other changes of the file type are reported as
+ * `GIT_DELTA_TYPECHANGE`.
+ *
+ * @param repo The repository containing the trees.
+ * @param old_tree A git_tree object to diff from, or NULL for empty tree.
+ * @param new_tree A git_tree object to diff to, or NULL for empty tree.
+ * @param file_cb Callback for each changed file
+ * @param payload Payload passed to the callback
+ * @return 0 on success, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_diff_trees(
+	git_repository *repo,
+	const git_tree *old_tree,
+	const git_tree *new_tree,
+	git_diff_file_cb file_cb,
+	void *payload);
+
 /**
  * Directly run a diff between two buffers.
  *
@@ -108,6 +108,10 @@ GIT_EXTERN(int) git_indexer_new(
 /**
  * Add data to the indexer
  *
+ * The deltas whose base has already been received are resolved as
+ * they arrive, so `total_deltas` counts the deltas received so far
+ * until the pack is committed.
+ *
  * @param idx the indexer
  * @param data the data to add
  * @param size the size of the data in bytes
@@ -100,6 +100,71 @@ GIT_EXTERN(void) git_odb_free(git_odb *db);
  */
 GIT_EXTERN(int) git_odb_read(git_odb_object **out, git_odb *db, const git_oid *id);
 
+/**
+ * Function type for callbacks from git_odb_read_many.
+ *
+ * The object is owned by the object database and is only valid for the
+ * duration of the callback; use `git_odb_object_dup` to keep it.
+ *
+ * @param obj the object that was read
+ * @param idx the index of the object's id in the array that was given
+ *        to `git_odb_read_many`
+ * @param payload the payload given to `git_odb_read_many`
+ * @return 0 to continue reading, non-zero to stop
+ */
+typedef int GIT_CALLBACK(git_odb_read_many_cb)(
+	git_odb_object *obj, size_t idx, void *payload);
+
+/**
+ * Read a batch of objects from the database.
+ *
+ * This behaves like calling `git_odb_read` for each of the given ids,
+ * but lets the backends read the objects in the order that is most
+ * efficient for them.  The packfile backend, for instance, reads objects
+ * in the order they are stored in each pack, so that delta bases that are
+ * shared between several of the requested objects are only inflated once.
+ *
+ * The callback is thus invoked exactly once for each id, but not
+ * necessarily in the order of the `ids` array; the `idx` argument tells
+ * which id the object belongs to.  Objects that are already in the
+ * object cache are reported first.
+ *
+ * @param db database to search for the objects in.
+ * @param ids the ids of the objects to read
+ * @param count the number of ids in the array
+ * @param cb the callback to call for each object
+ * @param payload payload to pass to the callback
+ * @return 0 on success, GIT_ENOTFOUND if one of the objects is not in
+ *         the database, non-zero callback return value, or error code
+ */
+GIT_EXTERN(int) git_odb_read_many(
+	git_odb *db,
+	const git_oid *ids,
+	size_t count,
+	git_odb_read_many_cb cb,
+	void *payload);
+
+/**
+ * Read a batch of objects from the database into an array.
+ *
+ * This is like `git_odb_read_many`, but stores the objects in the given
+ * array, at the same index as their id.  On failure, no objects are
+ * returned and all entries of `out` are set to NULL.
+ *
+ * @param out array of at least `count` elements where to store the
+ *        read objects; each of them must be freed with `git_odb_object_free`
+ * @param db database to search for the objects in.
+ * @param ids the ids of the objects to read
+ * @param count the number of ids in the array
+ * @return 0 on success, GIT_ENOTFOUND if one of the objects is not in
+ *         the database, or an error code
+ */
+GIT_EXTERN(int) git_odb_read_many_array(
+	git_odb_object **out,
+	git_odb *db,
+	const git_oid *ids,
+	size_t count);
+
 /**
  * Read an object from the database, given a prefix
  * of its identifier.
@@ -238,6 +303,46 @@ GIT_EXTERN(int) git_odb_expand_ids(
  */
 GIT_EXTERN(int) git_odb_refresh(struct git_odb *db);
 
+/**
+ * Function type for callbacks from git_odb_set_missing_callback.
+ *
+ * The callback should make the given objects available in the database,
+ * for instance by fetching them from a remote.  Objects that are needed
+ * together (like the blobs of a checkout) are passed in a single call.
+ *
+ * @param db the database the objects are missing from
+ * @param ids the ids of the missing objects
+ * @param count the number of ids in the array
+ * @param payload the payload given to `git_odb_set_missing_callback`
+ * @return 0 if the objects may now be in the database,
+ *         GIT_PASSTHROUGH to leave them missing, or an error code
+ */
+typedef int GIT_CALLBACK(git_odb_missing_cb)(
+	git_odb *db, const git_oid *ids, size_t count, void *payload);
+
+/**
+ * Set the callback to call when objects are missing from the database
+ *
+ * The callback is called when an object cannot be found by
+ * `git_odb_read`, `git_odb_read_header` or `git_odb_read_many`, after
+ * the backends have been refreshed, and the read is retried if it
+ * succeeds.  Existence checks like `git_odb_exists` never call it, and
+ * neither do reads that happen while it runs.
+ *
+ * The databases of partial clones (whose configuration has an
+ * `extensions.partialclone` remote) get a callback that fetches the
+ * missing objects from that remote, with the default fetch options.
+ * Set your own callback, calling `git_remote_fetch_objects`, to use
+ * credentials or other options.
+ *
+ * @param db database to set the callback of
+ * @param cb the callback, or NULL to remove it
+ * @param payload payload to pass to the callback
+ * @return 0 on success, error code otherwise
+ */
+GIT_EXTERN(int) git_odb_set_missing_callback(
+	git_odb *db, git_odb_missing_cb cb, void *payload);
+
 /**
  * List all objects available in the database
  *
@@ -273,6 +378,41 @@ GIT_EXTERN(int) git_odb_foreach(git_odb *db, git_odb_foreach_cb cb, void *payloa
  */
 GIT_EXTERN(int) git_odb_write(git_oid *out, git_odb *odb, const void *data, size_t len, git_object_t type);
 
+/**
+ * Start a batch of object writes
+ *
+ * The objects that are written to the ODB until the batch is ended are
+ * not made durable one by one.  The loose object backend writes them to
+ * a temporary directory without syncing them, and only moves them into
+ * place when the batch ends.  They can be read through this ODB in the
+ * meantime.
+ *
+ * Batches cannot be nested.  The ODB should not be used from other
+ * threads while its batch is being ended.
+ *
+ * @param odb object database to batch the writes of
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_odb_begin_batch(git_odb *odb);
+
+/**
+ * End a batch of object writes
+ *
+ * If `success` is true, the objects written since `git_odb_begin_batch`
+ * are made durable together and moved into place, with the same
+ * guarantees as when they are written one by one.  The loose object
+ * backend syncs them with a single `syncfs` where it is available (and
+ * syncing is enabled, see `GIT_OPT_ENABLE_FSYNC_GITDIR`), or streams
+ * them into a new packfile when there are many of them.
+ *
+ * If `success` is false, the objects are discarded.
+ *
+ * @param odb object database whose batch to end
+ * @param success whether to keep the objects written in the batch
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_odb_end_batch(git_odb *odb, int success);
+
 /**
  * Open a stream to write an object into the ODB
  *
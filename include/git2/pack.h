@@ -71,6 +71,15 @@ GIT_EXTERN(int) git_packbuilder_new(git_packbuilder **out, git_repository *repo)
  * when set to 0, libgit2 will autodetect the number of
  * CPUs.
  *
+ * With more than one thread, the packfile is also streamed:
+ * the objects which are not delta candidates are written
+ * while the deltas are searched, and the threads compress
+ * the other objects.  The objects may then come in another
+ * order than with a single thread.  The threads share the
+ * search for deltas, so the deltas that are found, and thus
+ * the bytes of the packfile, may differ from one run to the
+ * next.
+ *
  * @param pb The packbuilder
  * @param n Number of threads to spawn
  * @return number of actual threads to be used
@@ -37,6 +37,45 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_reflog_read(git_reflog **out, git_repository *repo,  const char *name);
 
+/**
+ * Create an iterator over the reflog for the given reference
+ *
+ * The entries are returned newest first.  Unlike `git_reflog_read`,
+ * the reflog is read and parsed incrementally from its end, so that
+ * looking at the most recent entries of a long reflog is cheap.
+ *
+ * If there is no reflog file for the given reference, the iterator
+ * returns no entries.
+ *
+ * @param out pointer in which to store the iterator
+ * @param repo the repository
+ * @param name reference whose reflog to iterate
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_reflog_iterator_new(
+	git_reflog_iterator **out,
+	git_repository *repo,
+	const char *name);
+
+/**
+ * Get the next (older) entry from the reflog iterator
+ *
+ * The entry is owned by the iterator and remains valid until the next
+ * call to this function or until the iterator is freed.
+ *
+ * @param out pointer in which to store the entry
+ * @param iter the iterator
+ * @return 0, GIT_ITEROVER if there are no more entries or an error code
+ */
+GIT_EXTERN(int) git_reflog_next(const git_reflog_entry **out, git_reflog_iterator *iter);
+
+/**
+ * Free the reflog iterator and its associated resources
+ *
+ * @param iter the iterator to free
+ */
+GIT_EXTERN(void) git_reflog_iterator_free(git_reflog_iterator *iter);
+
 /**
  * Write an existing in-memory reflog object back to disk
  * using an atomic file lock.
@@ -83,6 +122,23 @@ GIT_EXTERN(int) git_reflog_rename(git_repository *repo, const char *old_name, co
  */
 GIT_EXTERN(int) git_reflog_delete(git_repository *repo, const char *name);
 
+/**
+ * Expire all but the newest entries of the reflog for the given reference
+ *
+ * Only the `keep` most recent entries are retained.  The reflog is
+ * scanned from its end up to the oldest retained entry; the entries
+ * before it are dropped without being parsed.  The reflog is written
+ * back to disk using an atomic file lock.
+ *
+ * It is not an error if the reference has no reflog.
+ *
+ * @param repo the repository
+ * @param name the reflog to truncate
+ * @param keep the number of entries to keep
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_reflog_truncate(git_repository *repo, const char *name, size_t keep);
+
 /**
  * Get the number of log entries in a reflog
  *
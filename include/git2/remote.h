@@ -618,6 +618,35 @@ typedef enum {
 	GIT_FETCH_NO_PRUNE,
 } git_fetch_prune_t;
 
+/**
+ * How a fetch chooses the commits that it tells the remote it has, so
+ * that the remote only sends what is missing.
+ */
+typedef enum {
+	/**
+	 * Use the setting from the configuration, `fetch.negotiationAlgorithm`
+	 */
+	GIT_FETCH_NEGOTIATION_UNSPECIFIED = 0,
+
+	/**
+	 * Tell the remote about every commit, from the newest ones
+	 */
+	GIT_FETCH_NEGOTIATION_CONSECUTIVE,
+
+	/**
+	 * Skip more and more ancestors between the commits told to the
+	 * remote, like git's "skipping" algorithm.  A common commit is
+	 * found in fewer round trips, but the remote may send commits
+	 * that we have.
+	 */
+	GIT_FETCH_NEGOTIATION_SKIPPING,
+
+	/**
+	 * Do not tell the remote about any commit
+	 */
+	GIT_FETCH_NEGOTIATION_NOOP,
+} git_fetch_negotiation_t;
+
 /**
  * Automatic tag following option
  *
@@ -688,8 +717,77 @@ typedef struct {
 	 * Extra headers for this fetch operation
 	 */
 	git_strarray custom_headers;
+
+	/**
+	 * Object filter to make a partial clone or fetch, like git's
+	 * `--filter`: "blob:none" to leave out all blobs,
+	 * "blob:limit=<n>[kmg]" for the blobs of at least that size, or
+	 * "tree:<depth>" for the trees and blobs at least that deep.
+	 *
+	 * The filtered objects are fetched from the remote when they are
+	 * needed.  The remote is recorded as the repository's promisor
+	 * remote (`remote.<name>.promisor`, with the filter in
+	 * `remote.<name>.partialclonefilter`), whose filter later fetches
+	 * use by default.  Only named remotes can be promisor remotes, and
+	 * remotes which do not support filters send all objects.
+	 */
+	const char *filter;
+
+	/**
+	 * Depth of the history to fetch, like git's `--depth`: the number
+	 * of commits to fetch from the tip of each fetched reference, or
+	 * `GIT_FETCH_DEPTH_FULL` for their whole history.  The commits
+	 * whose parents were left out become the shallow roots of the
+	 * repository, in its `shallow` file.
+	 *
+	 * In a shallow repository, `GIT_FETCH_DEPTH_UNSHALLOW` fetches
+	 * the rest of the history and makes the repository complete.
+	 */
+	int depth;
+
+	/**
+	 * Only fetch the commits made after this time, like git's
+	 * `--shallow-since`, or 0 to fetch the commits of any age.
+	 * Cannot be combined with `depth` or `deepen`.
+	 */
+	git_time_t shallow_since;
+
+	/**
+	 * Deepen the history of a shallow repository by this many
+	 * commits from its current shallow roots, like git's `--deepen`.
+	 * Cannot be combined with `depth` or `shallow_since`.
+	 */
+	int deepen;
+
+	/**
+	 * How to choose the commits to tell the remote that we have.
+	 */
+	git_fetch_negotiation_t negotiation;
+
+	/**
+	 * The references whose commits we tell the remote that we have,
+	 * like git's `--negotiation-tip`: the names of references, or
+	 * globs like "refs/tags/v1.*".  By default, the commits
+	 * of all references are told.
+	 */
+	git_strarray negotiation_tips;
+
+	/**
+	 * Only tell the remote about the commits of the references that
+	 * the fetch refspecs update, usually the remote-tracking branches
+	 * of the remote, in addition to `negotiation_tips`.  Fetches into
+	 * repositories with many unrelated references need fewer round
+	 * trips this way.
+	 */
+	int negotiate_fetched_refs;
 } git_fetch_options;
 
+/** Fetch the whole history of the fetched references */
+#define GIT_FETCH_DEPTH_FULL 0
+
+/** Fetch the history that a shallow repository is missing */
+#define GIT_FETCH_DEPTH_UNSHALLOW 2147483647
+
 #define GIT_FETCH_OPTIONS_VERSION 1
 #define GIT_FETCH_OPTIONS_INIT { GIT_FETCH_OPTIONS_VERSION, GIT_REMOTE_CALLBACKS_INIT, GIT_FETCH_PRUNE_UNSPECIFIED, 1, \
 				 GIT_REMOTE_DOWNLOAD_TAGS_UNSPECIFIED, GIT_PROXY_OPTIONS_INIT }
@@ -831,6 +929,29 @@ GIT_EXTERN(int) git_remote_fetch(
 		const git_fetch_options *opts,
 		const char *reflog_message);
 
+/**
+ * Fetch objects by id
+ *
+ * Connect to the remote, download the given objects and disconnect,
+ * without negotiating or updating any reference.  This is how the
+ * objects that were filtered out of a partial clone are fetched; the
+ * remote must allow fetching objects which are not advertised.
+ *
+ * Unless the options give a filter, "blob:none" is used so that
+ * fetching commits or trees does not bring in their blobs.
+ *
+ * @param remote the remote to fetch from
+ * @param ids the ids of the objects to fetch
+ * @param count the number of ids in the array
+ * @param opts options to use for this fetch, or NULL
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_remote_fetch_objects(
+		git_remote *remote,
+		const git_oid *ids,
+		size_t count,
+		const git_fetch_options *opts);
+
 /**
  * Prune tracking refs that are no longer present on remote
  *
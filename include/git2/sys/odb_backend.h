@@ -21,6 +21,15 @@
  */
 GIT_BEGIN_DECL
 
+/**
+ * Callback used by a backend's `read_many` function to hand an object
+ * back to libgit2.  `idx` is the index of the object's id in the array
+ * that was given to `read_many`; `data` must be allocated as it would be
+ * for the backend's `read` function.
+ */
+typedef int GIT_CALLBACK(git_odb_backend_read_cb)(
+	size_t idx, void *data, size_t len, git_object_t type, void *payload);
+
 /**
  * An instance for a custom backend
  */
@@ -100,6 +109,45 @@ struct git_odb_backend {
 	 * itself). An odb backend implementation must provide this function.
 	 */
 	void GIT_CALLBACK(free)(git_odb_backend *);
+
+	/**
+	 * Reads several objects at once, in whichever order is most
+	 * efficient for the backend.  This is optional; backends that do
+	 * not implement it are asked for the objects one by one.
+	 *
+	 * The backend should call `cb` for each of the `ids` that it
+	 * finds, passing the index of the id and the object's data,
+	 * length and type, exactly as `read` returns them.  Ownership of
+	 * the data passes to the callback.  Ids that are not found must
+	 * be skipped.  If the callback returns non-zero, the backend
+	 * should stop and return that value.
+	 */
+	int GIT_CALLBACK(read_many)(
+		git_odb_backend *, const git_oid *ids, size_t count,
+		git_odb_backend_read_cb cb, void *payload);
+
+	/**
+	 * Start a batch of writes.
+	 *
+	 * Until the batch is ended, the backend may put the objects that
+	 * are written to it in a temporary location without making each
+	 * of them durable on its own, as long as they can already be read
+	 * back from it.
+	 *
+	 * A backend may provide this function; if it is not provided,
+	 * objects are written one by one.
+	 */
+	int GIT_CALLBACK(begin_batch)(git_odb_backend *);
+
+	/**
+	 * End a batch of writes, making all of its objects durable and
+	 * moving them into place if `success` is true, or discarding them
+	 * otherwise.
+	 *
+	 * A backend must provide this function if a `begin_batch`
+	 * implementation is provided.
+	 */
+	int GIT_CALLBACK(end_batch)(git_odb_backend *, int success);
 };
 
 #define GIT_ODB_BACKEND_VERSION 1
@@ -56,6 +56,27 @@ struct git_reference_iterator {
 		git_reference_iterator *iter);
 };
 
+/**
+ * Every backend's reflog iterator must have a pointer to itself as the
+ * first element, so the API can talk to it, like for
+ * `git_reference_iterator`.
+ */
+struct git_reflog_iterator {
+	/**
+	 * Return the next (older) reflog entry and advance the iterator.
+	 * The entry is owned by the iterator.
+	 */
+	int GIT_CALLBACK(next)(
+		const git_reflog_entry **entry,
+		git_reflog_iterator *iter);
+
+	/**
+	 * Free the iterator
+	 */
+	void GIT_CALLBACK(free)(
+		git_reflog_iterator *iter);
+};
+
 /** An instance for a custom backend */
 struct git_refdb_backend {
 	unsigned int version; /**< The backend API version */
@@ -184,7 +205,10 @@ struct git_refdb_backend {
 	/**
 	 * Lock a reference.
 	 *
-	 * The opaque parameter will be passed to the unlock function.
+	 * The opaque parameter will be passed to the unlock function.  On
+	 * input, it is the payload of a lock that the caller holds already,
+	 * or NULL; a backend that locks more than one reference at once can
+	 * use it to tell the locks of a transaction from those of another.
 	 *
 	 * A refdb implementation may provide this function; if it is not
 	 * provided, the transaction API will fail to work.
@@ -203,6 +227,54 @@ struct git_refdb_backend {
 	 */
 	int GIT_CALLBACK(unlock)(git_refdb_backend *backend, void *payload, int success, int update_reflog,
 		      const git_reference *ref, const git_signature *sig, const char *message);
+
+	/**
+	 * Start a batch of reference updates.
+	 *
+	 * Until the batch is ended, successful `unlock` calls only record
+	 * their update and keep the reference locked; all of the recorded
+	 * updates are written together by `end_batch`.  The batch belongs
+	 * to the thread that began it, and takes only the updates of one
+	 * transaction, whose locks are told apart by their payload.
+	 *
+	 * A refdb implementation may provide this function; if it is not
+	 * provided, the references are written one by one.
+	 */
+	int GIT_CALLBACK(begin_batch)(git_refdb_backend *backend);
+
+	/**
+	 * End a batch of reference updates, writing all of its updates if
+	 * `success` is true or discarding them otherwise, and release the
+	 * locks of the references in it.
+	 *
+	 * A refdb implementation must provide this function if a
+	 * `begin_batch` implementation is provided.
+	 */
+	int GIT_CALLBACK(end_batch)(git_refdb_backend *backend, int success);
+
+	/**
+	 * Create an iterator over a reflog, returning its newest entries
+	 * first.  A missing reflog has no entries.
+	 *
+	 * A refdb implementation may provide this function; if it is not
+	 * provided, the whole reflog is read with `reflog_read`.
+	 */
+	int GIT_CALLBACK(reflog_iterator)(
+		git_reflog_iterator **out,
+		git_refdb_backend *backend,
+		const char *name);
+
+	/**
+	 * Drop all but the `keep` newest entries of a reflog.  A missing
+	 * reflog is left alone.
+	 *
+	 * A refdb implementation may provide this function; if it is not
+	 * provided, the reflog is read, trimmed and written back.
+	 */
+	int GIT_CALLBACK(reflog_truncate)(
+		git_refdb_backend *backend,
+		const char *name,
+		size_t keep);
 };
 
 #define GIT_REFDB_BACKEND_VERSION 1
@@ -235,6 +307,27 @@ GIT_EXTERN(int) git_refdb_backend_fs(
 	git_refdb_backend **backend_out,
 	git_repository *repo);
 
+/**
+ * Constructor for a reftable-based refdb backend
+ *
+ * References and their logs are stored in a stack of sorted, immutable
+ * tables in the repository's `reftable` directory.  Each update adds a
+ * new table and small tables are merged as the stack grows, so that
+ * lookups, prefix iteration and multi-reference updates stay cheap
+ * with large numbers of references.  All references updated while a
+ * transaction is locked are written together, atomically.
+ *
+ * This backend is never selected automatically; use
+ * `git_refdb_set_backend` to install it on a repository's refdb.
+ *
+ * @param backend_out Output pointer to the git_refdb_backend object
+ * @param repo Git repository to access
+ * @return 0 on success, <0 error code on failure
+ */
+GIT_EXTERN(int) git_refdb_backend_reftable(
+	git_refdb_backend **backend_out,
+	git_repository *repo);
+
 /**
  * Sets the custom backend to an existing reference DB
  *
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_sys_git_server_h__
+#define INCLUDE_sys_git_server_h__
+
+#include "git2/common.h"
+#include "git2/types.h"
+#include "git2/oid.h"
+
+/**
+ * @file git2/sys/server.h
+ * @brief Git server side of the fetch and push protocols
+ * @defgroup git_server Git server side of the transfer protocols
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * A connection to a client, like a socket, a pair of pipes or the
+ * body of an HTTP request and its response.
+ */
+typedef struct git_server_stream git_server_stream;
+
+struct git_server_stream {
+	/**
+	 * Read at most `len` bytes that the client sent into `buffer`,
+	 * setting `bytes_read` to 0 at the end of the stream.
+	 */
+	int GIT_CALLBACK(read)(
+		git_server_stream *stream,
+		char *buffer,
+		size_t len,
+		size_t *bytes_read);
+
+	/** Send the `len` bytes of `buffer` to the client. */
+	int GIT_CALLBACK(write)(
+		git_server_stream *stream,
+		const char *buffer,
+		size_t len);
+};
+
+/**
+ * Options for serving a fetch with `git_upload_pack`.
+ *
+ * Initialize with `GIT_UPLOAD_PACK_OPTIONS_INIT`. Alternatively, you
+ * can use `git_upload_pack_options_init`.
+ */
+typedef struct {
+	unsigned int version;
+
+	/**
+	 * The version of the protocol that the client asked for, like
+	 * with "version=2" in the `GIT_PROTOCOL` environment variable of
+	 * `git upload-pack`.  Versions 0 and 1 are the original protocol.
+	 */
+	int protocol_version;
+
+	/**
+	 * Serve one request of a stateless transport like smart HTTP,
+	 * where the client sends every request in its own connection.
+	 */
+	int stateless_rpc;
+
+	/**
+	 * Only send the advertisement of the references, or of the
+	 * capabilities for protocol v2, which a stateless client asks
+	 * for first.
+	 */
+	int advertise_refs;
+
+	/**
+	 * The number of threads that build the pack.  When set to 0,
+	 * there are as many as there are CPUs.
+	 */
+	unsigned int pack_threads;
+} git_upload_pack_options;
+
+#define GIT_UPLOAD_PACK_OPTIONS_VERSION 1
+#define GIT_UPLOAD_PACK_OPTIONS_INIT {GIT_UPLOAD_PACK_OPTIONS_VERSION}
+
+/**
+ * Initialize git_upload_pack_options structure
+ *
+ * Initializes a `git_upload_pack_options` with default values.
+ * Equivalent to creating an instance with
+ * `GIT_UPLOAD_PACK_OPTIONS_INIT`.
+ *
+ * @param opts The `git_upload_pack_options` struct to initialize.
+ * @param version The struct version; pass `GIT_UPLOAD_PACK_OPTIONS_VERSION`.
+ * @return Zero on success; -1 on failure.
+ */
+GIT_EXTERN(int) git_upload_pack_options_init(
+	git_upload_pack_options *opts,
+	unsigned int version);
+
+/**
+ * How long `git_upload_pack` spent in each phase of a fetch, in
+ * seconds, and what it sent.  The times of several requests of a
+ * connection add up.
+ */
+typedef struct {
+	double advertise_time; /**< advertising the references or capabilities */
+	double negotiate_time; /**< reading the wants and acknowledging the haves */
+	double count_time;     /**< finding the objects to send */
+	double pack_time;      /**< building and sending the pack */
+
+	size_t sent_objects;   /**< objects in the pack */
+	size_t reused_deltas;  /**< deltas taken as they are from our packs */
+	size_t sent_bytes;     /**< bytes of the pack */
+} git_upload_pack_stats;
+
+/**
+ * Serve a fetch or a clone of the repository, like `git upload-pack`.
+ *
+ * This advertises the references of the repository, negotiates with
+ * the client which objects it needs and sends them in a pack, which
+ * the delta search and the compression are streamed from.
+ *
+ * It serves the requests of a stateful connection until the client
+ * closes it, or one request if `stateless_rpc` is set.  Like `git
+ * upload-pack`, the client may only ask for the objects that the
+ * references point to, unless `uploadpack.allowAnySHA1InWant` or
+ * `uploadpack.allowReachableSHA1InWant` allow other ones.
+ *
+ * @param repo The repository to serve
+ * @param stream The connection to the client
+ * @param opts The options, or NULL for the defaults
+ * @param stats Where to report what was done, or NULL
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_upload_pack(
+	git_repository *repo,
+	git_server_stream *stream,
+	const git_upload_pack_options *opts,
+	git_upload_pack_stats *stats);
+
+/**
+ * A reference update that a client pushes.
+ */
+typedef struct {
+	const char *refname; /**< the reference to update */
+	git_oid old_id;      /**< its value for the client, zero to create it */
+	git_oid new_id;      /**< its new value, zero to delete it */
+} git_receive_pack_command;
+
+/**
+ * Decide whether to update a reference, like the `update` hook of git.
+ *
+ * The repository sees the objects that the client sent, which stay in
+ * quarantine until the references are updated.  The command was checked
+ * for the configuration, like `receive.denyNonFastForwards`, and the
+ * objects it needs are there.
+ *
+ * @param quarantine The repository, with the received objects
+ * @param command The update
+ * @param payload The payload of the options
+ * @return 0 to update the reference, a positive value to decline this
+ *         update or a negative value to decline the whole push.  The
+ *         client is told the message of the error set with
+ *         `git_error_set_str`, if any.
+ */
+typedef int GIT_CALLBACK(git_receive_pack_update_cb)(
+	git_repository *quarantine,
+	const git_receive_pack_command *command,
+	void *payload);
+
+/**
+ * Options for serving a push with `git_receive_pack`.
+ *
+ * Initialize with `GIT_RECEIVE_PACK_OPTIONS_INIT`. Alternatively, you
+ * can use `git_receive_pack_options_init`.
+ */
+typedef struct {
+	unsigned int version;
+
+	/**
+	 * Serve the request of a stateless transport like smart HTTP,
+	 * where the client sends it in its own connection.
+	 */
+	int stateless_rpc;
+
+	/**
+	 * Only send the advertisement of the references, which a
+	 * stateless client asks for first.
+	 */
+	int advertise_refs;
+
+	/** Called for each reference update; NULL accepts all of them */
+	git_receive_pack_update_cb update_cb;
+
+	/** The payload of the callback */
+	void *payload;
+} git_receive_pack_options;
+
+#define GIT_RECEIVE_PACK_OPTIONS_VERSION 1
+#define GIT_RECEIVE_PACK_OPTIONS_INIT {GIT_RECEIVE_PACK_OPTIONS_VERSION}
+
+/**
+ * Initialize git_receive_pack_options structure
+ *
+ * Initializes a `git_receive_pack_options` with default values.
+ * Equivalent to creating an instance with
+ * `GIT_RECEIVE_PACK_OPTIONS_INIT`.
+ *
+ * @param opts The `git_receive_pack_options` struct to initialize.
+ * @param version The struct version; pass `GIT_RECEIVE_PACK_OPTIONS_VERSION`.
+ * @return Zero on success; -1 on failure.
+ */
+GIT_EXTERN(int) git_receive_pack_options_init(
+	git_receive_pack_options *opts,
+	unsigned int version);
+
+/**
+ * Serve a push to the repository, like `git receive-pack`.
+ *
+ * This advertises the references of the repository and reads the
+ * updates that the client asks for, along with the pack of their
+ * objects.  The pack is indexed as it is received into a quarantine
+ * directory of the object database, so that the objects are not
+ * visible until they are checked: the updates must be allowed by the
+ * configuration (`receive.denyDeletes`, `receive.denyNonFastForwards`
+ * and `receive.denyCurrentBranch`) and by the callback of the options,
+ * and the objects they need must be there.  The pack is then moved
+ * into the object database and the references are updated in a
+ * transaction, all of them or none if the client asked for an atomic
+ * push.
+ *
+ * The repository must be on disk.  A declined update is not an error:
+ * the client is told why, if it asked for the status of the updates.
+ *
+ * @param repo The repository to serve
+ * @param stream The connection to the client
+ * @param opts The options, or NULL for the defaults
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_receive_pack(
+	git_repository *repo,
+	git_server_stream *stream,
+	const git_receive_pack_options *opts);
+
+/** @} */
+GIT_END_DECL
+#endif
@@ -31,6 +31,70 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_transaction_new(git_transaction **out, git_repository *repo);
 
+/**
+ * Flags to control how a transaction is committed
+ */
+typedef enum {
+	GIT_TRANSACTION_DEFAULT = 0,
+
+	/**
+	 * Write all reference updates together when the transaction is
+	 * committed, instead of one by one.  The filesystem backend
+	 * writes the updated references into a single new packed-refs
+	 * file and replaces the old one with one rename, so that either
+	 * all of them or none are updated.  Their reflogs are appended
+	 * before the packed-refs file is replaced, without syncing each
+	 * one individually.
+	 *
+	 * Symbolic and per-worktree references cannot be packed and are
+	 * still written individually, after the packed-refs file.
+	 */
+	GIT_TRANSACTION_PACKED = (1u << 0),
+} git_transaction_flag_t;
+
+/**
+ * Transaction options
+ *
+ * Initialize with `GIT_TRANSACTION_OPTIONS_INIT`. Alternatively, you
+ * can use `git_transaction_options_init`.
+ */
+typedef struct {
+	unsigned int version;
+
+	/** Combination of `git_transaction_flag_t` values */
+	unsigned int flags;
+} git_transaction_options;
+
+#define GIT_TRANSACTION_OPTIONS_VERSION 1
+#define GIT_TRANSACTION_OPTIONS_INIT {GIT_TRANSACTION_OPTIONS_VERSION}
+
+/**
+ * Initialize git_transaction_options structure
+ *
+ * Initializes a `git_transaction_options` with default values. Equivalent
+ * to creating an instance with `GIT_TRANSACTION_OPTIONS_INIT`.
+ *
+ * @param opts The `git_transaction_options` struct to initialize.
+ * @param version The struct version; pass `GIT_TRANSACTION_OPTIONS_VERSION`.
+ * @return Zero on success; -1 on failure.
+ */
+GIT_EXTERN(int) git_transaction_options_init(
+	git_transaction_options *opts,
+	unsigned int version);
+
+/**
+ * Create a new transaction object with the given options
+ *
+ * @param out the resulting transaction
+ * @param repo the repository in which to lock
+ * @param opts the options for the transaction, or NULL for the defaults
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_transaction_new_ext(
+	git_transaction **out,
+	git_repository *repo,
+	const git_transaction_options *opts);
+
 /**
  * Lock a reference
  *
@@ -99,7 +163,8 @@ GIT_EXTERN(int) git_transaction_remove(git_transaction *tx, const char *refname)
  * Commit the changes from the transaction
  *
  * Perform the changes that have been queued. The updates will be made
- * one by one, and the first failure will stop the processing.
+ * one by one, and the first failure will stop the processing, unless
+ * the transaction was created with `GIT_TRANSACTION_PACKED`.
  *
  * @param tx the transaction
  * @return 0 or an error code
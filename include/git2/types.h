@@ -156,6 +156,9 @@ typedef struct git_reflog_entry git_reflog_entry;
 /** Representation of a reference log */
 typedef struct git_reflog git_reflog;
 
+/** Iterator over the entries of a reference log */
+typedef struct git_reflog_iterator git_reflog_iterator;
+
 /** Representation of a git note */
 typedef struct git_note git_note;
 
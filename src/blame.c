@@ -310,6 +310,23 @@ static git_blame_hunk* hunk_from_entry(git_blame__entry *e, git_blame *blame)
 	return h;
 }
 
+int git_blame__report_entry(git_blame *blame, git_blame__entry *ent)
+{
+	git_blame_hunk *h;
+	int error;
+
+	if (!blame->options.hunk_cb)
+		return 0;
+
+	h = hunk_from_entry(ent, blame);
+	GIT_ERROR_CHECK_ALLOC(h);
+
+	error = blame->options.hunk_cb(h, blame->options.hunk_cb_payload);
+	free_hunk(h);
+
+	return git_error_set_after_callback_function(error, "git_blame_file");
+}
+
 static int load_blob(git_blame *blame)
 {
 	int error;
@@ -398,7 +415,8 @@ int git_blame_file(
 	if ((error = load_blob(blame)) < 0)
 		goto on_error;
 
-	if ((error = blame_internal(blame)) < 0)
+	/* a positive value is the hunk callback cancelling the blame */
+	if ((error = blame_internal(blame)) != 0)
 		goto on_error;
 
 	*out = blame;
@@ -92,4 +92,11 @@ git_blame *git_blame__alloc(
 	git_blame_options opts,
 	const char *path);
 
+/*
+ * Report an entry whose attribution has become final to the caller's
+ * hunk callback, if any.  Returns the callback's non-zero return value
+ * to abort the blame.
+ */
+int git_blame__report_entry(git_blame *blame, git_blame__entry *ent);
+
 #endif
@@ -643,10 +643,18 @@ int git_blame__like_git(git_blame *blame, uint32_t opt)
 		git_blame__entry *ent;
 		git_blame__origin *suspect = NULL;
 
-		/* Find a suspect to break down */
-		for (ent = blame->ent; !suspect && ent; ent = ent->next)
-			if (!ent->guilty)
+		/*
+		 * Find a suspect to break down; like git, prefer the most
+		 * recent commit so that the newest hunks become final first.
+		 */
+		for (ent = blame->ent; ent; ent = ent->next) {
+			if (ent->guilty)
+				continue;
+			if (!suspect ||
+			    git_commit_time(ent->suspect->commit) >
+			    git_commit_time(suspect->commit))
 				suspect = ent->suspect;
+		}
 		if (!suspect)
 			break;
 
@@ -659,13 +667,22 @@ int git_blame__like_git(git_blame *blame, uint32_t opt)
 		/* Take responsibility for the remaining entries */
 		for (ent = blame->ent; ent; ent = ent->next) {
 			if (same_suspect(ent->suspect, suspect)) {
+				bool was_guilty = ent->guilty;
+
 				ent->guilty = true;
 				ent->is_boundary = !git_oid_cmp(
 						git_commit_id(suspect->commit),
 						&blame->options.oldest_commit);
+
+				if (!was_guilty &&
+				    (error = git_blame__report_entry(blame, ent)) != 0)
+					break;
 			}
 		}
 		origin_decref(suspect);
+
+		if (error)
+			break;
 	}
 
 	if (!error)
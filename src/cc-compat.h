@@ -52,6 +52,9 @@
 #	ifndef PRId64
 #		define PRId64 "I64d"
 #	endif
+#	ifndef PRIx64
+#		define PRIx64 "I64x"
+#	endif
 
 /* The first block is needed to avoid warnings on MingW amd64 */
 #	if (SIZE_MAX == ULLONG_MAX)
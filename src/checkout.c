@@ -20,6 +20,7 @@
 
 #include "refs.h"
 #include "repository.h"
+#include "odb.h"
 #include "index.h"
 #include "filter.h"
 #include "blob.h"
@@ -1873,6 +1874,42 @@ static int checkout_deferred_remove(git_repository *repo, const char *path)
 #endif
 }
 
+/*
+ * Fetch the blobs that a partial clone does not have in one batch,
+ * rather than one by one as they are written out.
+ */
+static int checkout_fetch_missing(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	git_array_t(git_oid) ids = GIT_ARRAY_INIT;
+	git_diff_delta *delta;
+	git_odb *odb;
+	git_oid *id;
+	size_t i;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, data->repo)) < 0)
+		return error;
+
+	if (!odb->missing_cb)
+		return 0;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		if ((actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) == 0)
+			continue;
+
+		id = git_array_alloc(ids);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &delta->new_file.id);
+	}
+
+	error = git_odb__fetch_missing(odb, ids.ptr, ids.size);
+
+	git_array_clear(ids);
+	return error;
+}
+
 static int checkout_create_the_new(
 	unsigned int *actions,
 	checkout_data *data)
@@ -1881,6 +1918,9 @@ static int checkout_create_the_new(
 	git_diff_delta *delta;
 	size_t i;
 
+	if ((error = checkout_fetch_missing(actions, data)) < 0)
+		return error;
+
 	git_vector_foreach(&data->diff->deltas, i, delta) {
 		if (actions[i] & CHECKOUT_ACTION__DEFER_REMOVE) {
 			/* this had a blocker directory that should only be removed iff
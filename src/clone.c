@@ -339,7 +339,13 @@ static int clone_into(git_repository *repo, git_remote *_remote, const git_fetch
 
 	memcpy(&fetch_opts, opts, sizeof(git_fetch_options));
 	fetch_opts.update_fetchhead = 0;
-	fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_ALL;
+
+	/* A shallow clone only follows the tags of the history it gets */
+	if (opts->depth || opts->shallow_since)
+		fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_AUTO;
+	else
+		fetch_opts.download_tags = GIT_REMOTE_DOWNLOAD_TAGS_ALL;
+
 	git_buf_printf(&reflog_message, "clone: from %s", git_remote_url(remote));
 
 	if ((error = git_remote_fetch(remote, NULL, &fetch_opts, git_buf_cstr(&reflog_message))) != 0)
@@ -421,7 +427,14 @@ static int git__clone(
 		return error;
 
 	if (!(error = create_and_configure_origin(&origin, repo, url, &options))) {
-		int clone_local = git_clone__should_clone_local(url, options.local);
+		/*
+		 * Copying the objects would defeat the filter of a partial
+		 * clone or the depth of a shallow one
+		 */
+		int clone_local = (options.fetch_opts.filter ||
+		                   options.fetch_opts.depth ||
+		                   options.fetch_opts.shallow_since) ? 0 :
+			git_clone__should_clone_local(url, options.local);
 		int link = options.local != GIT_CLONE_LOCAL_NO_LINKS;
 
 		if (clone_local == 1)
@@ -23,18 +23,30 @@
 #include "array.h"
 #include "oidarray.h"
 
+static void commit_details_free(git_commit_details *details)
+{
+	if (!details)
+		return;
+
+	git_signature_free(details->author);
+	git_signature_free(details->committer);
+
+	git__free(details->raw_header);
+	git__free(details->raw_message);
+	git__free(details->message_encoding);
+
+	git__free(details);
+}
+
 void git_commit__free(void *_commit)
 {
 	git_commit *commit = _commit;
 
 	git_array_clear(commit->parent_ids);
 
-	git_signature_free(commit->author);
-	git_signature_free(commit->committer);
+	git_odb_object_free(commit->odb_obj);
+	commit_details_free(commit->details);
 
-	git__free(commit->raw_header);
-	git__free(commit->raw_message);
-	git__free(commit->message_encoding);
 	git__free(commit->summary);
 	git__free(commit->body);
 
@@ -384,49 +396,23 @@ int git_commit_amend(
 	return error;
 }
 
-static int commit_parse(git_commit *commit, const char *data, size_t size, unsigned int flags)
+static int commit_parse_details(
+	git_commit_details *details,
+	const char *data,
+	size_t size,
+	size_t offset,
+	unsigned int flags)
 {
-	const char *buffer_start = data, *buffer;
+	const char *buffer_start = data, *buffer = data + offset;
 	const char *buffer_end = buffer_start + size;
-	git_oid parent_id;
 	size_t header_len;
 	git_signature dummy_sig;
 
-	assert(commit && data);
-
-	buffer = buffer_start;
-
-	/* Allocate for one, which will allow not to realloc 90% of the time  */
-	git_array_init_to_size(commit->parent_ids, 1);
-	GIT_ERROR_CHECK_ARRAY(commit->parent_ids);
-
-	/* The tree is always the first field */
 	if (!(flags & GIT_COMMIT_PARSE_QUICK)) {
-	    if (git_oid__parse(&commit->tree_id, &buffer, buffer_end, "tree ") < 0)
-			goto bad_buffer;
-	} else {
-		size_t tree_len = strlen("tree ") + GIT_OID_HEXSZ + 1;
-		if (buffer + tree_len > buffer_end)
-			goto bad_buffer;
-		buffer += tree_len;
-	}
-
-	/*
-	 * TODO: commit grafts!
-	 */
+		details->author = git__malloc(sizeof(git_signature));
+		GIT_ERROR_CHECK_ALLOC(details->author);
 
-	while (git_oid__parse(&parent_id, &buffer, buffer_end, "parent ") == 0) {
-		git_oid *new_id = git_array_alloc(commit->parent_ids);
-		GIT_ERROR_CHECK_ALLOC(new_id);
-
-		git_oid_cpy(new_id, &parent_id);
-	}
-
-	if (!(flags & GIT_COMMIT_PARSE_QUICK)) {
-		commit->author = git__malloc(sizeof(git_signature));
-		GIT_ERROR_CHECK_ALLOC(commit->author);
-
-		if (git_signature__parse(commit->author, &buffer, buffer_end, "author ", '\n') < 0)
+		if (git_signature__parse(details->author, &buffer, buffer_end, "author ", '\n') < 0)
 			return -1;
 	}
 
@@ -440,10 +426,10 @@ static int commit_parse(git_commit *commit, const char *data, size_t size, unsig
 	}
 
 	/* Always parse the committer; we need the commit time */
-	commit->committer = git__malloc(sizeof(git_signature));
-	GIT_ERROR_CHECK_ALLOC(commit->committer);
+	details->committer = git__malloc(sizeof(git_signature));
+	GIT_ERROR_CHECK_ALLOC(details->committer);
 
-	if (git_signature__parse(commit->committer, &buffer, buffer_end, "committer ", '\n') < 0)
+	if (git_signature__parse(details->committer, &buffer, buffer_end, "committer ", '\n') < 0)
 		return -1;
 
 	if (flags & GIT_COMMIT_PARSE_QUICK)
@@ -461,8 +447,8 @@ static int commit_parse(git_commit *commit, const char *data, size_t size, unsig
 		if (git__prefixncmp(buffer, buffer_end - buffer, "encoding ") == 0) {
 			buffer += strlen("encoding ");
 
-			commit->message_encoding = git__strndup(buffer, eoln - buffer);
-			GIT_ERROR_CHECK_ALLOC(commit->message_encoding);
+			details->message_encoding = git__strndup(buffer, eoln - buffer);
+			GIT_ERROR_CHECK_ALLOC(details->message_encoding);
 		}
 
 		if (eoln < buffer_end && *eoln == '\n')
@@ -471,26 +457,121 @@ static int commit_parse(git_commit *commit, const char *data, size_t size, unsig
 	}
 
 	header_len = buffer - buffer_start;
-	commit->raw_header = git__strndup(buffer_start, header_len);
-	GIT_ERROR_CHECK_ALLOC(commit->raw_header);
+	details->raw_header = git__strndup(buffer_start, header_len);
+	GIT_ERROR_CHECK_ALLOC(details->raw_header);
 
 	/* point "buffer" to data after header, +1 for the final LF */
 	buffer = buffer_start + header_len + 1;
 
 	/* extract commit message */
 	if (buffer <= buffer_end)
-		commit->raw_message = git__strndup(buffer, buffer_end - buffer);
+		details->raw_message = git__strndup(buffer, buffer_end - buffer);
 	else
-		commit->raw_message = git__strdup("");
-	GIT_ERROR_CHECK_ALLOC(commit->raw_message);
+		details->raw_message = git__strdup("");
+	GIT_ERROR_CHECK_ALLOC(details->raw_message);
 
 	return 0;
+}
+
+static int commit_validate_details(const char *buffer, const char *buffer_end)
+{
+	if (git_signature__validate(&buffer, buffer_end, "author ", '\n') < 0)
+		return -1;
+
+	/* Some tools create multiple author fields, ignore the extra ones */
+	while (!git__prefixncmp(buffer, buffer_end - buffer, "author ")) {
+		if (git_signature__validate(&buffer, buffer_end, "author ", '\n') < 0)
+			return -1;
+	}
+
+	return git_signature__validate(&buffer, buffer_end, "committer ", '\n');
+}
+
+static int commit_parse(git_commit *commit, const char *data, size_t size, unsigned int flags)
+{
+	const char *buffer_start = data, *buffer;
+	const char *buffer_end = buffer_start + size;
+	git_oid parent_id;
+
+	assert(commit && data);
+
+	buffer = buffer_start;
+
+	/* Allocate for one, which will allow not to realloc 90% of the time  */
+	git_array_init_to_size(commit->parent_ids, 1);
+	GIT_ERROR_CHECK_ARRAY(commit->parent_ids);
+
+	/* The tree is always the first field */
+	if (!(flags & GIT_COMMIT_PARSE_QUICK)) {
+	    if (git_oid__parse(&commit->tree_id, &buffer, buffer_end, "tree ") < 0)
+			goto bad_buffer;
+	} else {
+		size_t tree_len = strlen("tree ") + GIT_OID_HEXSZ + 1;
+		if (buffer + tree_len > buffer_end)
+			goto bad_buffer;
+		buffer += tree_len;
+	}
+
+	/*
+	 * TODO: commit grafts!
+	 */
+
+	while (git_oid__parse(&parent_id, &buffer, buffer_end, "parent ") == 0) {
+		git_oid *new_id = git_array_alloc(commit->parent_ids);
+		GIT_ERROR_CHECK_ALLOC(new_id);
+
+		git_oid_cpy(new_id, &parent_id);
+	}
+
+	commit->details_offset = buffer - buffer_start;
+
+	/*
+	 * Check the author and committer lines now, so that a commit that
+	 * parses fails the same way as when it is parsed eagerly; only an
+	 * allocation can fail when its details are parsed later.
+	 */
+	if (flags & GIT_COMMIT_PARSE_LAZY)
+		return commit_validate_details(buffer, buffer_end);
+
+	commit->details = git__calloc(1, sizeof(git_commit_details));
+	GIT_ERROR_CHECK_ALLOC(commit->details);
+
+	return commit_parse_details(commit->details,
+		data, size, commit->details_offset, flags);
 
 bad_buffer:
 	git_error_set(GIT_ERROR_OBJECT, "failed to parse bad commit object");
 	return -1;
 }
 
+git_commit_details *git_commit__details(const git_commit *_commit)
+{
+	git_commit *commit = (git_commit *)_commit;
+	git_commit_details *details;
+
+	if (commit->details != NULL)
+		return commit->details;
+
+	assert(commit->odb_obj);
+
+	if ((details = git__calloc(1, sizeof(git_commit_details))) == NULL)
+		return NULL;
+
+	if (commit_parse_details(details,
+			git_odb_object_data(commit->odb_obj),
+			git_odb_object_size(commit->odb_obj),
+			commit->details_offset, 0) < 0) {
+		commit_details_free(details);
+		return NULL;
+	}
+
+	/* another thread may have parsed the commit concurrently */
+	details = git__compare_and_swap(&commit->details, NULL, details);
+	commit_details_free(details);
+
+	return commit->details;
+}
+
 int git_commit__parse_raw(void *commit, const char *data, size_t size)
 {
 	return commit_parse(commit, data, size, 0);
@@ -498,12 +579,22 @@ int git_commit__parse_raw(void *commit, const char *data, size_t size)
 
 int git_commit__parse_ext(git_commit *commit, git_odb_object *odb_obj, unsigned int flags)
 {
-	return commit_parse(commit, git_odb_object_data(odb_obj), git_odb_object_size(odb_obj), flags);
+	int error;
+
+	if ((error = commit_parse(commit, git_odb_object_data(odb_obj),
+			git_odb_object_size(odb_obj), flags)) < 0)
+		return error;
+
+	if ((flags & GIT_COMMIT_PARSE_LAZY) &&
+	    (error = git_odb_object_dup(&commit->odb_obj, odb_obj)) < 0)
+		return error;
+
+	return 0;
 }
 
 int git_commit__parse(void *_commit, git_odb_object *odb_obj)
 {
-	return git_commit__parse_ext(_commit, odb_obj, 0);
+	return git_commit__parse_ext(_commit, odb_obj, GIT_COMMIT_PARSE_LAZY);
 }
 
 #define GIT_COMMIT_GETTER(_rvalue, _name, _return) \
@@ -513,13 +604,22 @@ int git_commit__parse(void *_commit, git_odb_object *odb_obj)
 		return _return; \
 	}
 
-GIT_COMMIT_GETTER(const git_signature *, author, commit->author)
-GIT_COMMIT_GETTER(const git_signature *, committer, commit->committer)
-GIT_COMMIT_GETTER(const char *, message_raw, commit->raw_message)
-GIT_COMMIT_GETTER(const char *, message_encoding, commit->message_encoding)
-GIT_COMMIT_GETTER(const char *, raw_header, commit->raw_header)
-GIT_COMMIT_GETTER(git_time_t, time, commit->committer->when.time)
-GIT_COMMIT_GETTER(int, time_offset, commit->committer->when.offset)
+#define GIT_COMMIT_DETAILS_GETTER(_rvalue, _name, _field, _default) \
+	_rvalue git_commit_##_name(const git_commit *commit) \
+	{\
+		git_commit_details *details; \
+		assert(commit); \
+		details = git_commit__details(commit); \
+		return details ? _field : _default; \
+	}
+
+GIT_COMMIT_DETAILS_GETTER(const git_signature *, author, details->author, NULL)
+GIT_COMMIT_DETAILS_GETTER(const git_signature *, committer, details->committer, NULL)
+GIT_COMMIT_DETAILS_GETTER(const char *, message_raw, details->raw_message, NULL)
+GIT_COMMIT_DETAILS_GETTER(const char *, message_encoding, details->message_encoding, NULL)
+GIT_COMMIT_DETAILS_GETTER(const char *, raw_header, details->raw_header, NULL)
+GIT_COMMIT_DETAILS_GETTER(git_time_t, time, details->committer->when.time, 0)
+GIT_COMMIT_DETAILS_GETTER(int, time_offset, details->committer->when.offset, 0)
 GIT_COMMIT_GETTER(unsigned int, parentcount, (unsigned int)git_array_size(commit->parent_ids))
 GIT_COMMIT_GETTER(const git_oid *, tree_id, &commit->tree_id)
 
@@ -529,7 +629,8 @@ const char *git_commit_message(const git_commit *commit)
 
 	assert(commit);
 
-	message = commit->raw_message;
+	if ((message = git_commit_message_raw(commit)) == NULL)
+		return NULL;
 
 	/* trim leading newlines from raw message */
 	while (*message && *message == '\n')
@@ -547,7 +648,10 @@ const char *git_commit_summary(git_commit *commit)
 	assert(commit);
 
 	if (!commit->summary) {
-		for (msg = git_commit_message(commit), space = NULL; *msg; ++msg) {
+		if ((msg = git_commit_message(commit)) == NULL)
+			return NULL;
+
+		for (space = NULL; *msg; ++msg) {
 			char next_character = msg[0];
 			/* stop processing at the end of the first paragraph */
 			if (next_character == '\n' && (!msg[1] || msg[1] == '\n'))
@@ -590,8 +694,11 @@ const char *git_commit_body(git_commit *commit)
 	assert(commit);
 
 	if (!commit->body) {
+		if ((msg = git_commit_message(commit)) == NULL)
+			return NULL;
+
 		/* search for end of summary */
-		for (msg = git_commit_message(commit); *msg; ++msg)
+		for (; *msg; ++msg)
 			if (msg[0] == '\n' && (!msg[1] || msg[1] == '\n'))
 				break;
 
@@ -674,10 +781,13 @@ int git_commit_nth_gen_ancestor(
 
 int git_commit_header_field(git_buf *out, const git_commit *commit, const char *field)
 {
-	const char *eol, *buf = commit->raw_header;
+	const char *eol, *buf = git_commit_raw_header(commit);
 
 	git_buf_clear(out);
 
+	if (!buf)
+		return -1;
+
 	while ((eol = strchr(buf, '\n'))) {
 		/* We can skip continuations here */
 		if (buf[0] == ' ') {
@@ -949,11 +1059,21 @@ cleanup:
 int git_commit_committer_with_mailmap(
 	git_signature **out, const git_commit *commit, const git_mailmap *mailmap)
 {
-	return git_mailmap_resolve_signature(out, mailmap, commit->committer);
+	const git_signature *committer = git_commit_committer(commit);
+
+	if (!committer)
+		return -1;
+
+	return git_mailmap_resolve_signature(out, mailmap, committer);
 }
 
 int git_commit_author_with_mailmap(
 	git_signature **out, const git_commit *commit, const git_mailmap *mailmap)
 {
-	return git_mailmap_resolve_signature(out, mailmap, commit->author);
+	const git_signature *author = git_commit_author(commit);
+
+	if (!author)
+		return -1;
+
+	return git_mailmap_resolve_signature(out, mailmap, author);
 }
@@ -16,18 +16,29 @@
 
 #include <time.h>
 
-struct git_commit {
-	git_object object;
-
-	git_array_t(git_oid) parent_ids;
-	git_oid tree_id;
-
+typedef struct {
 	git_signature *author;
 	git_signature *committer;
 
 	char *message_encoding;
 	char *raw_message;
 	char *raw_header;
+} git_commit_details;
+
+struct git_commit {
+	git_object object;
+
+	git_array_t(git_oid) parent_ids;
+	git_oid tree_id;
+
+	/*
+	 * Commits read from the object database only parse their tree and
+	 * parents up front; the remaining fields are parsed from the raw
+	 * data on first use by `git_commit__details`.
+	 */
+	git_odb_object *odb_obj;
+	size_t details_offset;
+	git_commit_details *details;
 
 	char *summary;
 	char *body;
@@ -37,8 +48,16 @@ void git_commit__free(void *commit);
 int git_commit__parse(void *commit, git_odb_object *obj);
 int git_commit__parse_raw(void *commit, const char *data, size_t size);
 
+/**
+ * Get the author, committer, header and message of a commit, parsing
+ * them on first use.  This is safe to call on a commit that is shared
+ * between threads.  Returns NULL if the commit could not be parsed.
+ */
+git_commit_details *git_commit__details(const git_commit *commit);
+
 typedef enum {
 	GIT_COMMIT_PARSE_QUICK = (1 << 0), /**< Only parse parents and committer info */
+	GIT_COMMIT_PARSE_LAZY = (1 << 1), /**< Defer everything but tree and parents */
 } git_commit__parse_flags;
 
 int git_commit__parse_ext(git_commit *commit, git_odb_object *odb_obj, unsigned int flags);
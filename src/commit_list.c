@@ -124,7 +124,12 @@ static int commit_quick_parse(
 		return -1;
 	}
 
-	node->time = commit->committer->when.time;
+	node->time = commit->details->committer->when.time;
+
+	/* The history of a shallow repository ends at its shallow roots */
+	if (git_revwalk__is_shallow(walk, &node->oid))
+		git_array_clear(commit->parent_ids);
+
 	node->out_degree = (uint16_t) git_array_size(commit->parent_ids);
 	node->parents = alloc_parents(walk, node, node->out_degree);
 	GIT_ERROR_CHECK_ALLOC(node->parents);
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+
+#include "git2/diff.h"
+
+#include "buffer.h"
+#include "odb.h"
+#include "repository.h"
+#include "tree.h"
+
+/*
+ * A lightweight tree-to-tree diff that only looks at entry names, modes
+ * and object ids.  Both trees are walked in lockstep straight from their
+ * raw object data: no entries are allocated, and subtrees with identical
+ * ids on both sides are skipped without ever being read.
+ */
+
+typedef struct {
+	git_odb *odb;
+	git_diff_file_cb cb;
+	void *payload;
+	git_buf path;
+	float progress;
+} diff_trees_info;
+
+typedef struct {
+	git_odb_object *obj;
+	const char *buf;
+	const char *end;
+	git_tree_entry entry;
+	bool valid;
+} tree_cursor;
+
+static int cursor_init(tree_cursor *cur, diff_trees_info *info, const git_oid *id)
+{
+	int error;
+
+	memset(cur, 0, sizeof(*cur));
+
+	if (!id)
+		return 0;
+
+	if ((error = git_odb_read(&cur->obj, info->odb, id)) < 0)
+		return error;
+
+	if (git_odb_object_type(cur->obj) != GIT_OBJECT_TREE) {
+		git_error_set(GIT_ERROR_INVALID, "object %s is not a tree",
+			git_oid_tostr_s(id));
+		return -1;
+	}
+
+	cur->buf = git_odb_object_data(cur->obj);
+	cur->end = cur->buf + git_odb_object_size(cur->obj);
+	return 0;
+}
+
+static int cursor_next(tree_cursor *cur)
+{
+	if (cur->buf >= cur->end) {
+		cur->valid = false;
+		return 0;
+	}
+
+	cur->valid = true;
+	return git_tree__parse_entry(&cur->entry, &cur->buf, cur->end);
+}
+
+static void cursor_dispose(tree_cursor *cur)
+{
+	git_odb_object_free(cur->obj);
+}
+
+static void fill_file(git_diff_file *file, const git_tree_entry *entry)
+{
+	git_oid_cpy(&file->id, entry->oid);
+	file->flags = GIT_DIFF_FLAG_VALID_ID | GIT_DIFF_FLAG_EXISTS;
+	file->mode = entry->attr;
+	file->id_abbrev = GIT_OID_HEXSZ;
+}
+
+static int emit_delta(
+	diff_trees_info *info,
+	git_delta_t status,
+	const git_tree_entry *old_entry,
+	const git_tree_entry *new_entry)
+{
+	const git_tree_entry *entry = old_entry ? old_entry : new_entry;
+	git_diff_delta delta = {0};
+	size_t dirlen = git_buf_len(&info->path);
+	int error;
+
+	if (git_buf_put(&info->path, entry->filename, entry->filename_len) < 0)
+		return -1;
+
+	delta.status = status;
+	delta.nfiles = (old_entry && new_entry) ? 2 : 1;
+	delta.old_file.path = delta.new_file.path = git_buf_cstr(&info->path);
+
+	if (old_entry)
+		fill_file(&delta.old_file, old_entry);
+	if (new_entry)
+		fill_file(&delta.new_file, new_entry);
+
+	error = info->cb(&delta, info->progress, info->payload);
+	git_buf_truncate(&info->path, dirlen);
+
+	return git_error_set_after_callback_function(error, "git_diff_trees");
+}
+
+static int diff_trees(
+	diff_trees_info *info,
+	const git_oid *old_id,
+	const git_oid *new_id,
+	bool toplevel);
+
+static int diff_subtrees(
+	diff_trees_info *info,
+	const git_tree_entry *old_entry,
+	const git_tree_entry *new_entry)
+{
+	const git_tree_entry *entry = old_entry ? old_entry : new_entry;
+	size_t dirlen = git_buf_len(&info->path);
+	int error;
+
+	if (git_buf_put(&info->path, entry->filename, entry->filename_len) < 0 ||
+	    git_buf_putc(&info->path, '/') < 0)
+		return -1;
+
+	error = diff_trees(info,
+		old_entry ? old_entry->oid : NULL,
+		new_entry ? new_entry->oid : NULL,
+		false);
+
+	git_buf_truncate(&info->path, dirlen);
+	return error;
+}
+
+static int diff_entry_only(
+	diff_trees_info *info,
+	git_delta_t status,
+	const git_tree_entry *entry)
+{
+	bool deleted = (status == GIT_DELTA_DELETED);
+
+	if (git_tree_entry__is_tree(entry))
+		return diff_subtrees(info,
+			deleted ? entry : NULL, deleted ? NULL : entry);
+
+	return emit_delta(info, status,
+		deleted ? entry : NULL, deleted ? NULL : entry);
+}
+
+static int diff_entry_pair(
+	diff_trees_info *info,
+	const git_tree_entry *old_entry,
+	const git_tree_entry *new_entry)
+{
+	bool same_id = git_oid_equal(old_entry->oid, new_entry->oid);
+
+	/*
+	 * Entries only compare equal when both or neither of them are
+	 * trees, as directories sort as if they had a trailing slash.
+	 */
+	if (git_tree_entry__is_tree(old_entry))
+		return same_id ? 0 : diff_subtrees(info, old_entry, new_entry);
+
+	if (same_id && old_entry->attr == new_entry->attr)
+		return 0;
+
+	return emit_delta(info,
+		GIT_MODE_TYPE(old_entry->attr) == GIT_MODE_TYPE(new_entry->attr) ?
+			GIT_DELTA_MODIFIED : GIT_DELTA_TYPECHANGE,
+		old_entry, new_entry);
+}
+
+static void update_progress(
+	diff_trees_info *info, tree_cursor *old_cur, tree_cursor *new_cur)
+{
+	size_t total = 0, done = 0;
+
+	if (old_cur->obj) {
+		total += git_odb_object_size(old_cur->obj);
+		done += old_cur->buf - (const char *)git_odb_object_data(old_cur->obj);
+	}
+
+	if (new_cur->obj) {
+		total += git_odb_object_size(new_cur->obj);
+		done += new_cur->buf - (const char *)git_odb_object_data(new_cur->obj);
+	}
+
+	info->progress = total ? (float)done / total : 1.0f;
+}
+
+static int diff_trees(
+	diff_trees_info *info,
+	const git_oid *old_id,
+	const git_oid *new_id,
+	bool toplevel)
+{
+	tree_cursor old_cur = {0}, new_cur = {0};
+	int cmp, error;
+
+	if ((error = cursor_init(&old_cur, info, old_id)) < 0 ||
+	    (error = cursor_init(&new_cur, info, new_id)) < 0 ||
+	    (error = cursor_next(&old_cur)) < 0 ||
+	    (error = cursor_next(&new_cur)) < 0)
+		goto done;
+
+	while (old_cur.valid || new_cur.valid) {
+		if (toplevel)
+			update_progress(info, &old_cur, &new_cur);
+
+		if (!new_cur.valid)
+			cmp = -1;
+		else if (!old_cur.valid)
+			cmp = 1;
+		else
+			cmp = git_tree_entry_cmp(&old_cur.entry, &new_cur.entry);
+
+		if (cmp < 0)
+			error = diff_entry_only(info, GIT_DELTA_DELETED, &old_cur.entry);
+		else if (cmp > 0)
+			error = diff_entry_only(info, GIT_DELTA_ADDED, &new_cur.entry);
+		else
+			error = diff_entry_pair(info, &old_cur.entry, &new_cur.entry);
+
+		if (error)
+			goto done;
+
+		if ((cmp <= 0 && (error = cursor_next(&old_cur)) < 0) ||
+		    (cmp >= 0 && (error = cursor_next(&new_cur)) < 0))
+			goto done;
+	}
+
+done:
+	cursor_dispose(&old_cur);
+	cursor_dispose(&new_cur);
+	return error;
+}
+
+int git_diff_trees(
+	git_repository *repo,
+	const git_tree *old_tree,
+	const git_tree *new_tree,
+	git_diff_file_cb file_cb,
+	void *payload)
+{
+	diff_trees_info info = {0};
+	const git_oid *old_id = old_tree ? git_tree_id(old_tree) : NULL;
+	const git_oid *new_id = new_tree ? git_tree_id(new_tree) : NULL;
+	int error;
+
+	assert(repo && file_cb);
+
+	if (old_id && new_id && git_oid_equal(old_id, new_id))
+		return 0;
+
+	if ((error = git_repository_odb__weakptr(&info.odb, repo)) < 0)
+		return error;
+
+	info.cb = file_cb;
+	info.payload = payload;
+
+	error = diff_trees(&info, old_id, new_id, true);
+
+	git_buf_dispose(&info.path);
+	return error;
+}
@@ -18,6 +18,10 @@
 #include "netops.h"
 #include "repository.h"
 #include "refs.h"
+#include "config.h"
+#include "odb.h"
+#include "pack-objects.h"
+#include "shallow.h"
 
 static int maybe_want(git_remote *remote, git_remote_head *head, git_odb *odb, git_refspec *tagspec, git_remote_autotag_option_t tagopt)
 {
@@ -41,8 +45,11 @@ static int maybe_want(git_remote *remote, git_remote_head *head, git_odb *odb, g
 	if (!match)
 		return 0;
 
-	/* If we have the object, mark it so we don't ask for it */
-	if (git_odb_exists(odb, &head->oid)) {
+	/*
+	 * If we have the object, mark it so we don't ask for it, unless
+	 * we want more of its history.
+	 */
+	if (!git_shallow_deepening(&remote->deepen) && git_odb_exists(odb, &head->oid)) {
 		head->local = 1;
 	}
 	else
@@ -148,6 +155,227 @@ int git_fetch_download_pack(git_remote *remote, const git_remote_callbacks *call
 	return t->download_pack(t, remote->repo, &remote->stats, progress, payload);
 }
 
+int git_fetch__set_filter(git_remote *remote, const char *filter)
+{
+	git_packbuilder_filter parsed;
+	git_config *cfg;
+	git_buf var = GIT_BUF_INIT;
+	char *promisor_filter = NULL;
+	int error = 0;
+
+	git__free(remote->filter);
+	remote->filter = NULL;
+
+	/* Fetches from a promisor remote keep using its filter */
+	if (!filter && remote->name && remote->repo) {
+		if ((error = git_repository_config__weakptr(&cfg, remote->repo)) < 0 ||
+		    (error = git_buf_printf(&var, "remote.%s.promisor", remote->name)) < 0)
+			goto done;
+
+		if (git_config__get_bool_force(cfg, var.ptr, 0)) {
+			git_buf_clear(&var);
+
+			if ((error = git_buf_printf(&var, "remote.%s.partialclonefilter", remote->name)) < 0)
+				goto done;
+
+			filter = promisor_filter = git_config__get_string_force(cfg, var.ptr, NULL);
+		}
+	}
+
+	if (!filter)
+		goto done;
+
+	if ((error = git_packbuilder__parse_filter(&parsed, filter)) < 0)
+		goto done;
+
+	remote->filter = git__strdup(filter);
+	GIT_ERROR_CHECK_ALLOC(remote->filter);
+
+done:
+	git__free(promisor_filter);
+	git_buf_dispose(&var);
+	return error;
+}
+
+/*
+ * Record the remote as a promisor of the objects that its filter left
+ * out, and as the one to fetch them from if there is none yet.
+ */
+int git_fetch__record_promisor(git_remote *remote)
+{
+	git_config *cfg;
+	git_odb *odb;
+	git_buf var = GIT_BUF_INIT;
+	char *partialclone = NULL;
+	int error;
+
+	assert(remote && remote->filter);
+
+	if (!remote->name)
+		return 0;
+
+	if ((error = git_repository_config__weakptr(&cfg, remote->repo)) < 0 ||
+	    (error = git_buf_printf(&var, "remote.%s.promisor", remote->name)) < 0 ||
+	    (error = git_config_set_bool(cfg, var.ptr, true)) < 0)
+		goto done;
+
+	git_buf_clear(&var);
+
+	if ((error = git_buf_printf(&var, "remote.%s.partialclonefilter", remote->name)) < 0 ||
+	    (error = git_config_set_string(cfg, var.ptr, remote->filter)) < 0)
+		goto done;
+
+	if ((partialclone = git_config__get_string_force(cfg, GIT_FETCH_PARTIALCLONE_CONFIG, NULL)) == NULL &&
+	    ((error = git_config_set_int32(cfg, "core.repositoryformatversion", 1)) < 0 ||
+	     (error = git_config_set_string(cfg, GIT_FETCH_PARTIALCLONE_CONFIG, remote->name)) < 0))
+		goto done;
+
+	if ((error = git_repository_odb__weakptr(&odb, remote->repo)) == 0)
+		error = git_fetch__set_promisor_callback(remote->repo, odb);
+
+done:
+	git__free(partialclone);
+	git_buf_dispose(&var);
+	return error;
+}
+
+int git_fetch__set_shallow(git_remote *remote, const git_fetch_options *opts)
+{
+	git_shallow_deepen *deepen = &remote->deepen;
+	int error;
+
+	git_fetch__clear_shallow(remote);
+
+	if (opts) {
+		if (opts->depth < 0 || opts->deepen < 0) {
+			git_error_set(GIT_ERROR_INVALID, "the fetch depth cannot be negative");
+			return -1;
+		}
+
+		if ((opts->depth != 0) + (opts->shallow_since != 0) + (opts->deepen != 0) > 1) {
+			git_error_set(GIT_ERROR_INVALID,
+				"only one of the fetch depth, shallow date and deepening can be given");
+			return -1;
+		}
+
+		deepen->depth = opts->depth ? opts->depth : opts->deepen;
+		deepen->relative = (opts->deepen != 0);
+		deepen->since = opts->shallow_since;
+	}
+
+	if ((error = git_shallow__read(&remote->shallow_roots, remote->repo)) < 0)
+		return error;
+
+	/* A complete repository has nothing to deepen */
+	if (!git_array_size(remote->shallow_roots) &&
+	    (deepen->relative || deepen->depth == GIT_FETCH_DEPTH_UNSHALLOW))
+		memset(deepen, 0, sizeof(*deepen));
+
+	return 0;
+}
+
+static int oid_search_cmp(const void *key, const void *entry)
+{
+	return git_oid__cmp(key, entry);
+}
+
+static int append_root(git_array_oid_t *roots, const git_oid *id)
+{
+	git_oid *root = git_array_alloc(*roots);
+	GIT_ERROR_CHECK_ALLOC(root);
+
+	git_oid_cpy(root, id);
+	return 0;
+}
+
+int git_fetch__update_shallow(git_remote *remote)
+{
+	git_array_oid_t roots = GIT_ARRAY_INIT;
+	git_oid *id;
+	size_t i;
+	int error = 0;
+
+	if (!git_array_size(remote->shallow_added) && !git_array_size(remote->shallow_removed))
+		return 0;
+
+	git_shallow__sort(&remote->shallow_removed);
+
+	git_array_foreach(remote->shallow_roots, i, id) {
+		if (git_array_search(NULL, remote->shallow_removed, oid_search_cmp, id) == 0)
+			continue;
+
+		if ((error = append_root(&roots, id)) < 0)
+			goto done;
+	}
+
+	git_array_foreach(remote->shallow_added, i, id) {
+		if ((error = append_root(&roots, id)) < 0)
+			goto done;
+	}
+
+	error = git_shallow__write(remote->repo, &roots);
+
+done:
+	git_array_clear(roots);
+	return error;
+}
+
+void git_fetch__clear_shallow(git_remote *remote)
+{
+	memset(&remote->deepen, 0, sizeof(remote->deepen));
+	git_array_clear(remote->shallow_roots);
+	git_array_clear(remote->shallow_added);
+	git_array_clear(remote->shallow_removed);
+}
+
+static int fetch_from_promisor(git_odb *odb, const git_oid *ids, size_t count, void *payload)
+{
+	git_repository *repo = GIT_REFCOUNT_OWNER(odb);
+	git_remote *remote = NULL;
+	git_config *cfg;
+	char *name = NULL;
+	int error;
+
+	GIT_UNUSED(payload);
+
+	/* The odb has outlived its repository */
+	if (!repo)
+		return GIT_PASSTHROUGH;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0)
+		return error;
+
+	if ((name = git_config__get_string_force(cfg, GIT_FETCH_PARTIALCLONE_CONFIG, NULL)) == NULL)
+		return GIT_PASSTHROUGH;
+
+	if ((error = git_remote_lookup(&remote, repo, name)) == 0)
+		error = git_remote_fetch_objects(remote, ids, count, NULL);
+
+	git_remote_free(remote);
+	git__free(name);
+	return error;
+}
+
+int git_fetch__set_promisor_callback(git_repository *repo, git_odb *odb)
+{
+	git_config *cfg;
+	char *name;
+	int error;
+
+	/* Leave the callback that the user may have set alone */
+	if (odb->missing_cb)
+		return 0;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0)
+		return error;
+
+	if ((name = git_config__get_string_force(cfg, GIT_FETCH_PARTIALCLONE_CONFIG, NULL)) == NULL)
+		return 0;
+
+	git__free(name);
+	return git_odb_set_missing_callback(odb, fetch_from_promisor, NULL);
+}
+
 int git_fetch_options_init(git_fetch_options *opts, unsigned int version)
 {
 	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
@@ -159,3 +387,119 @@ int git_fetch_init_options(git_fetch_options *opts, unsigned int version)
 {
 	return git_fetch_options_init(opts, version);
 }
+
+static int negotiation_config(git_fetch_negotiation_t *out, git_repository *repo)
+{
+	git_config *cfg;
+	char *algorithm;
+	int error;
+
+	*out = GIT_FETCH_NEGOTIATION_CONSECUTIVE;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0)
+		return error;
+
+	/* Like git, fall back to the default for the unknown algorithms */
+	if ((algorithm = git_config__get_string_force(cfg, "fetch.negotiationalgorithm", NULL)) == NULL)
+		return 0;
+
+	if (!strcmp(algorithm, "skipping"))
+		*out = GIT_FETCH_NEGOTIATION_SKIPPING;
+	else if (!strcmp(algorithm, "noop"))
+		*out = GIT_FETCH_NEGOTIATION_NOOP;
+
+	git__free(algorithm);
+	return 0;
+}
+
+static int add_negotiation_tip(git_remote *remote, const char *glob)
+{
+	char *tip = git__strdup(glob);
+	GIT_ERROR_CHECK_ALLOC(tip);
+
+	if (git_vector_insert(&remote->negotiation_tips, tip) < 0) {
+		git__free(tip);
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_fetch__set_negotiation(git_remote *remote, const git_fetch_options *opts)
+{
+	git_refspec *spec;
+	size_t i;
+	int error;
+
+	git_fetch__clear_negotiation(remote);
+
+	remote->negotiation = opts ? opts->negotiation : GIT_FETCH_NEGOTIATION_UNSPECIFIED;
+
+	if (remote->negotiation == GIT_FETCH_NEGOTIATION_UNSPECIFIED &&
+	    (error = negotiation_config(&remote->negotiation, remote->repo)) < 0)
+		return error;
+
+	if (!opts || (!opts->negotiation_tips.count && !opts->negotiate_fetched_refs))
+		return 0;
+
+	for (i = 0; i < opts->negotiation_tips.count; i++) {
+		if ((error = add_negotiation_tip(remote, opts->negotiation_tips.strings[i])) < 0)
+			return error;
+	}
+
+	if (opts->negotiate_fetched_refs) {
+		git_vector_foreach(&remote->active_refspecs, i, spec) {
+			if (spec->dst && (error = add_negotiation_tip(remote, spec->dst)) < 0)
+				return error;
+		}
+	}
+
+	/* We were asked to restrict the tips to none */
+	if (!remote->negotiation_tips.length)
+		remote->negotiation = GIT_FETCH_NEGOTIATION_NOOP;
+
+	return 0;
+}
+
+void git_fetch__clear_negotiation(git_remote *remote)
+{
+	remote->negotiation = GIT_FETCH_NEGOTIATION_UNSPECIFIED;
+	git_vector_free_deep(&remote->negotiation_tips);
+}
+
+int git_fetch__negotiator_new(git_negotiator **out, git_repository *repo, git_remote *remote)
+{
+	git_fetch_negotiation_t algorithm = GIT_FETCH_NEGOTIATION_CONSECUTIVE;
+	git_negotiator *negotiator;
+	const char *tip;
+	size_t i;
+	int error = 0;
+
+	if (remote && remote->negotiation != GIT_FETCH_NEGOTIATION_UNSPECIFIED)
+		algorithm = remote->negotiation;
+
+	if ((error = git_negotiator_new(&negotiator, repo, algorithm)) < 0)
+		return error;
+
+	if (algorithm == GIT_FETCH_NEGOTIATION_NOOP)
+		goto done;
+
+	if (!remote || !remote->negotiation_tips.length) {
+		error = git_negotiator_add_tips(negotiator, "refs/*");
+		goto done;
+	}
+
+	git_vector_foreach(&remote->negotiation_tips, i, tip) {
+		if ((error = git_negotiator_add_tips(negotiator, tip)) < 0)
+			break;
+	}
+
+done:
+	if (error < 0) {
+		git_negotiator_free(negotiator);
+		return error;
+	}
+
+	*out = negotiator;
+	return 0;
+}
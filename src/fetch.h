@@ -12,6 +12,7 @@
 #include "git2/remote.h"
 
 #include "netops.h"
+#include "negotiator.h"
 
 int git_fetch_negotiate(git_remote *remote, const git_fetch_options *opts);
 
@@ -19,4 +20,45 @@ int git_fetch_download_pack(git_remote *remote, const git_remote_callbacks *call
 
 int git_fetch_setup_walk(git_revwalk **out, git_repository *repo);
 
+#define GIT_FETCH_PARTIALCLONE_CONFIG "extensions.partialclone"
+
+/*
+ * Set the object filter of the next fetch from the remote, which is
+ * its promisor filter if `filter` is NULL.
+ */
+int git_fetch__set_filter(git_remote *remote, const char *filter);
+
+int git_fetch__record_promisor(git_remote *remote);
+
+/*
+ * Set how the next fetch from the remote deepens the history, and
+ * read the shallow roots of the repository to send along.
+ */
+int git_fetch__set_shallow(git_remote *remote, const git_fetch_options *opts);
+
+/* Apply the shallow roots that the remote sent to the repository */
+int git_fetch__update_shallow(git_remote *remote);
+
+void git_fetch__clear_shallow(git_remote *remote);
+
+/*
+ * Set how the next fetch from the remote chooses the commits that it
+ * tells the remote it has, and from which references.
+ */
+int git_fetch__set_negotiation(git_remote *remote, const git_fetch_options *opts);
+
+void git_fetch__clear_negotiation(git_remote *remote);
+
+/*
+ * Create the negotiator of a fetch from the remote, which may be NULL
+ * to negotiate from all the references with the default algorithm.
+ */
+int git_fetch__negotiator_new(git_negotiator **out, git_repository *repo, git_remote *remote);
+
+/*
+ * Make the odb of a partial clone fetch its missing objects from the
+ * repository's promisor remote.
+ */
+int git_fetch__set_promisor_callback(git_repository *repo, git_odb *odb);
+
 #endif
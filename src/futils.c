@@ -1186,3 +1186,24 @@ int git_futils_fsync_parent(const char *path)
 	git__free(parent);
 	return error;
 }
+
+int git_futils_syncfs(const char *path)
+{
+#ifdef GIT_USE_SYNCFS
+	int fd, error;
+
+	if ((fd = p_open(path, O_RDONLY)) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to open '%s' for syncfs", path);
+		return -1;
+	}
+
+	if ((error = p_syncfs(fd)) < 0)
+		git_error_set(GIT_ERROR_OS, "failed to sync the filesystem of '%s'", path);
+
+	p_close(fd);
+	return error;
+#else
+	GIT_UNUSED(path);
+	return GIT_PASSTHROUGH;
+#endif
+}
@@ -387,4 +387,15 @@ extern int git_futils_fsync_dir(const char *path);
  */
 extern int git_futils_fsync_parent(const char *path);
 
+/**
+ * Flush all of the pending writes to the filesystem that contains the
+ * given path to stable storage with a single call, if the platform
+ * supports that.
+ *
+ * @param path Path of any file or directory on the filesystem.
+ * @return 0 on success, -1 on error, or GIT_PASSTHROUGH if the files
+ *         that should be durable have to be `fsync`ed one by one.
+ */
+extern int git_futils_syncfs(const char *path);
+
 #endif
@@ -18,6 +18,8 @@
 #include "thread-utils.h"
 #include "git2/global.h"
 #include "transports/ssh.h"
+#include "transports/httpclient.h"
+#include "zstream.h"
 
 #if defined(GIT_MSVC_CRTDBG)
 #include "win32/w32_stack.h"
@@ -38,6 +40,7 @@ static git_global_init_fn git__init_callbacks[] = {
 	git_stream_registry_global_init,
 	git_openssl_stream_global_init,
 	git_mbedtls_stream_global_init,
+	git_http_client_global_init,
 	git_mwindow_global_init
 };
 
@@ -60,8 +63,12 @@ static void git__global_state_cleanup(git_global_st *st)
 	if (!st)
 		return;
 
-	git__free(st->error_t.message);
+	/* The message is the error buffer, which may have been detached */
+	git_buf_dispose(&st->error_buf);
 	st->error_t.message = NULL;
+
+	git_zstream__free_decompressor(st->decompressor);
+	st->decompressor = NULL;
 }
 
 static int init_common(void)
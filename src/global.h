@@ -23,6 +23,16 @@ typedef struct {
 	 * when terminated by `git_thread_exit`.  It is unused on POSIX.
 	 */
 	git_thread *current_thread;
+
+	/* The object database whose missing object callback this thread
+	 * is running, so that the callback does not call itself.
+	 */
+	git_odb *missing_cb_odb;
+
+	/* The one-shot inflater of this thread, which is kept between
+	 * objects since setting it up costs more than a small object.
+	 */
+	void *decompressor;
 } git_global_st;
 
 git_global_st *git__global_state(void);
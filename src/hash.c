@@ -105,3 +105,21 @@ done:
 
 	return error;
 }
+
+int git_hash_many(git_oid *out, const git_hash_input *in, size_t n)
+{
+	size_t i;
+	int error;
+
+#ifdef GIT_SHA1_COLLISIONDETECT
+	if ((error = git_hash_sha1_many(out, in, n)) != GIT_PASSTHROUGH)
+		return error;
+#endif
+
+	for (i = 0; i < n; i++) {
+		if ((error = git_hash_vec(&out[i], in[i].vec, in[i].len)) < 0)
+			return error;
+	}
+
+	return 0;
+}
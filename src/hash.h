@@ -17,6 +17,12 @@ typedef struct {
 	size_t len;
 } git_buf_vec;
 
+/* An input to `git_hash_many`: the concatenation of `len` buffers */
+typedef struct {
+	git_buf_vec *vec;
+	size_t len;
+} git_hash_input;
+
 typedef enum {
 	GIT_HASH_ALGO_UNKNOWN = 0,
 	GIT_HASH_ALGO_SHA1,
@@ -43,4 +49,11 @@ int git_hash_final(git_oid *out, git_hash_ctx *c);
 int git_hash_buf(git_oid *out, const void *data, size_t len);
 int git_hash_vec(git_oid *out, git_buf_vec *vec, size_t n);
 
+/*
+ * Hash `n` independent inputs, writing the hash of `in[i]` to `out[i]`.
+ * Backends that can hash several inputs in parallel do so; this is much
+ * faster than hashing them one by one when there are many small inputs.
+ */
+int git_hash_many(git_oid *out, const git_hash_input *in, size_t n);
+
 #endif
@@ -35,4 +35,20 @@ int git_hash_sha1_init(git_hash_sha1_ctx *c);
 int git_hash_sha1_update(git_hash_sha1_ctx *c, const void *data, size_t len);
 int git_hash_sha1_final(git_oid *out, git_hash_sha1_ctx *c);
 
+#if defined(GIT_SHA1_COLLISIONDETECT)
+/*
+ * Hash many inputs in parallel; returns GIT_PASSTHROUGH when they
+ * should be hashed one by one instead.
+ */
+int git_hash_sha1_many(git_oid *out, const git_hash_input *in, size_t n);
+
+/*
+ * Choose the kernels to hash with, instead of the fastest ones for this
+ * CPU that `git_hash_sha1_global_init` picks; this lets the tests check
+ * the kernels against each other.  Without either, only sha1dc is used.
+ * Returns GIT_ENOTFOUND if the CPU cannot run one of them.
+ */
+int git_hash_sha1__set_kernels(bool accelerated, bool lanes);
+#endif
+
 #endif
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "accelerated.h"
+
+#if defined(GIT_SHA1_SHANI) || defined(GIT_SHA1_AVX2)
+# include <immintrin.h>
+# include <cpuid.h>
+#endif
+
+#define SHA1_K0 0x5a827999
+#define SHA1_K1 0x6ed9eba1
+#define SHA1_K2 0x8f1bbcdc
+#define SHA1_K3 0xca62c1d6
+
+#if defined(GIT_SHA1_SHANI)
+
+#define SHA1_SHANI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+
+/* The message words are kept in reverse order in the registers */
+#define SHA1_SHANI_STORE(g, m) \
+	_mm_storeu_si128((__m128i *)(W + (g) * 4), _mm_shuffle_epi32(m, 0x1b))
+
+/*
+ * Four rounds, for every group of four message words from the fourth
+ * on: `m0` holds the words for these rounds, which are added into the
+ * next `e`, while the schedule of the following words is advanced.
+ */
+#define SHA1_SHANI_ROUNDS(g, e_in, e_out, m0, m1, m2, m3, f) \
+	SHA1_SHANI_STORE(g, m0); \
+	e_in = _mm_sha1nexte_epu32(e_in, m0); \
+	e_out = abcd; \
+	m1 = _mm_sha1msg2_epu32(m1, m0); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e_in, f); \
+	m3 = _mm_sha1msg1_epu32(m3, m0); \
+	m2 = _mm_xor_si128(m2, m0);
+
+SHA1_SHANI_TARGET
+static void sha1_compress_shani(
+	uint32_t ihv[5], const unsigned char *block, uint32_t W[80])
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1;
+	__m128i msg0, msg1, msg2, msg3;
+
+	abcd = _mm_loadu_si128((const __m128i *)ihv);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32(ihv[4], 0, 0, 0);
+
+	abcd_save = abcd;
+	e0_save = e0;
+
+	/* Rounds 0-11 load the message as they go */
+	msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 0)), bswap);
+	SHA1_SHANI_STORE(0, msg0);
+	e0 = _mm_add_epi32(e0, msg0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 16)), bswap);
+	SHA1_SHANI_STORE(1, msg1);
+	e1 = _mm_sha1nexte_epu32(e1, msg1);
+	e0 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+	msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 32)), bswap);
+	SHA1_SHANI_STORE(2, msg2);
+	e0 = _mm_sha1nexte_epu32(e0, msg2);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+	msg0 = _mm_xor_si128(msg0, msg2);
+
+	msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(block + 48)), bswap);
+	SHA1_SHANI_ROUNDS(3, e1, e0, msg3, msg0, msg1, msg2, 0);
+
+	SHA1_SHANI_ROUNDS(4, e0, e1, msg0, msg1, msg2, msg3, 0);
+	SHA1_SHANI_ROUNDS(5, e1, e0, msg1, msg2, msg3, msg0, 1);
+	SHA1_SHANI_ROUNDS(6, e0, e1, msg2, msg3, msg0, msg1, 1);
+	SHA1_SHANI_ROUNDS(7, e1, e0, msg3, msg0, msg1, msg2, 1);
+	SHA1_SHANI_ROUNDS(8, e0, e1, msg0, msg1, msg2, msg3, 1);
+	SHA1_SHANI_ROUNDS(9, e1, e0, msg1, msg2, msg3, msg0, 1);
+	SHA1_SHANI_ROUNDS(10, e0, e1, msg2, msg3, msg0, msg1, 2);
+	SHA1_SHANI_ROUNDS(11, e1, e0, msg3, msg0, msg1, msg2, 2);
+	SHA1_SHANI_ROUNDS(12, e0, e1, msg0, msg1, msg2, msg3, 2);
+	SHA1_SHANI_ROUNDS(13, e1, e0, msg1, msg2, msg3, msg0, 2);
+	SHA1_SHANI_ROUNDS(14, e0, e1, msg2, msg3, msg0, msg1, 2);
+	SHA1_SHANI_ROUNDS(15, e1, e0, msg3, msg0, msg1, msg2, 3);
+	SHA1_SHANI_ROUNDS(16, e0, e1, msg0, msg1, msg2, msg3, 3);
+	SHA1_SHANI_ROUNDS(17, e1, e0, msg1, msg2, msg3, msg0, 3);
+	SHA1_SHANI_ROUNDS(18, e0, e1, msg2, msg3, msg0, msg1, 3);
+	SHA1_SHANI_ROUNDS(19, e1, e0, msg3, msg0, msg1, msg2, 3);
+
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *)ihv, abcd);
+	ihv[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+git_hash_sha1_compress_fn git_hash_sha1_accelerated(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return NULL;
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ||
+	    !(ebx & bit_SHA))
+		return NULL;
+
+	return sha1_compress_shani;
+}
+
+#elif defined(GIT_SHA1_ARMV8)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_SHA1
+# define HWCAP_SHA1 (1 << 5)
+#endif
+
+#define SHA1_ARMV8_TARGET __attribute__((target("+crypto")))
+
+/*
+ * Four rounds, for every group of four message words from the second
+ * on: `tmp` holds the words for these rounds with their constant added,
+ * and is refilled from `m2`, the words of the rounds after the next
+ * ones, while the schedule of the following words is advanced.
+ */
+#define SHA1_ARMV8_ROUNDS(g, op, e_in, e_out, tmp, m0, m1, m2, m3, k) \
+	vst1q_u32(W + ((g) + 2) * 4, m2); \
+	e_out = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = op(abcd, e_in, tmp); \
+	tmp = vaddq_u32(m2, vdupq_n_u32(k)); \
+	m3 = vsha1su1q_u32(m3, m2); \
+	m0 = vsha1su0q_u32(m0, m1, m2);
+
+#define SHA1_ARMV8_LOAD(p) \
+	vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)))
+
+SHA1_ARMV8_TARGET
+static void sha1_compress_armv8(
+	uint32_t ihv[5], const unsigned char *block, uint32_t W[80])
+{
+	uint32x4_t abcd, abcd_save, tmp0, tmp1;
+	uint32x4_t msg0, msg1, msg2, msg3;
+	uint32_t e0, e0_save, e1;
+
+	abcd = vld1q_u32(ihv);
+	e0 = ihv[4];
+
+	abcd_save = abcd;
+	e0_save = e0;
+
+	msg0 = SHA1_ARMV8_LOAD(block + 0);
+	msg1 = SHA1_ARMV8_LOAD(block + 16);
+	msg2 = SHA1_ARMV8_LOAD(block + 32);
+	msg3 = SHA1_ARMV8_LOAD(block + 48);
+
+	vst1q_u32(W + 0, msg0);
+	vst1q_u32(W + 4, msg1);
+
+	tmp0 = vaddq_u32(msg0, vdupq_n_u32(SHA1_K0));
+	tmp1 = vaddq_u32(msg1, vdupq_n_u32(SHA1_K0));
+
+	e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+	abcd = vsha1cq_u32(abcd, e0, tmp0);
+	tmp0 = vaddq_u32(msg2, vdupq_n_u32(SHA1_K0));
+	vst1q_u32(W + 8, msg2);
+	msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+	SHA1_ARMV8_ROUNDS(1, vsha1cq_u32, e1, e0, tmp1, msg1, msg2, msg3, msg0, SHA1_K0);
+	SHA1_ARMV8_ROUNDS(2, vsha1cq_u32, e0, e1, tmp0, msg2, msg3, msg0, msg1, SHA1_K0);
+	SHA1_ARMV8_ROUNDS(3, vsha1cq_u32, e1, e0, tmp1, msg3, msg0, msg1, msg2, SHA1_K1);
+	SHA1_ARMV8_ROUNDS(4, vsha1cq_u32, e0, e1, tmp0, msg0, msg1, msg2, msg3, SHA1_K1);
+	SHA1_ARMV8_ROUNDS(5, vsha1pq_u32, e1, e0, tmp1, msg1, msg2, msg3, msg0, SHA1_K1);
+	SHA1_ARMV8_ROUNDS(6, vsha1pq_u32, e0, e1, tmp0, msg2, msg3, msg0, msg1, SHA1_K1);
+	SHA1_ARMV8_ROUNDS(7, vsha1pq_u32, e1, e0, tmp1, msg3, msg0, msg1, msg2, SHA1_K1);
+	SHA1_ARMV8_ROUNDS(8, vsha1pq_u32, e0, e1, tmp0, msg0, msg1, msg2, msg3, SHA1_K2);
+	SHA1_ARMV8_ROUNDS(9, vsha1pq_u32, e1, e0, tmp1, msg1, msg2, msg3, msg0, SHA1_K2);
+	SHA1_ARMV8_ROUNDS(10, vsha1mq_u32, e0, e1, tmp0, msg2, msg3, msg0, msg1, SHA1_K2);
+	SHA1_ARMV8_ROUNDS(11, vsha1mq_u32, e1, e0, tmp1, msg3, msg0, msg1, msg2, SHA1_K2);
+	SHA1_ARMV8_ROUNDS(12, vsha1mq_u32, e0, e1, tmp0, msg0, msg1, msg2, msg3, SHA1_K2);
+	SHA1_ARMV8_ROUNDS(13, vsha1mq_u32, e1, e0, tmp1, msg1, msg2, msg3, msg0, SHA1_K3);
+	SHA1_ARMV8_ROUNDS(14, vsha1mq_u32, e0, e1, tmp0, msg2, msg3, msg0, msg1, SHA1_K3);
+	SHA1_ARMV8_ROUNDS(15, vsha1pq_u32, e1, e0, tmp1, msg3, msg0, msg1, msg2, SHA1_K3);
+	SHA1_ARMV8_ROUNDS(16, vsha1pq_u32, e0, e1, tmp0, msg0, msg1, msg2, msg3, SHA1_K3);
+	SHA1_ARMV8_ROUNDS(17, vsha1pq_u32, e1, e0, tmp1, msg1, msg2, msg3, msg0, SHA1_K3);
+
+	e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+	abcd = vsha1pq_u32(abcd, e0, tmp0);
+
+	e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+	abcd = vsha1pq_u32(abcd, e1, tmp1);
+
+	vst1q_u32(ihv, vaddq_u32(abcd, abcd_save));
+	ihv[4] = e0 + e0_save;
+}
+
+git_hash_sha1_compress_fn git_hash_sha1_accelerated(void)
+{
+	if (!(getauxval(AT_HWCAP) & HWCAP_SHA1))
+		return NULL;
+
+	return sha1_compress_armv8;
+}
+
+#else
+
+git_hash_sha1_compress_fn git_hash_sha1_accelerated(void)
+{
+	return NULL;
+}
+
+#endif
+
+#if defined(GIT_SHA1_AVX2)
+
+#define SHA1_AVX2_TARGET __attribute__((target("avx2")))
+
+#define SHA1_AVX2_ROL(x, n) \
+	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+#define SHA1_AVX2_LOAD(blocks, i) _mm256_set_epi32( \
+	sha1_be32_load(blocks[7] + (i) * 4), sha1_be32_load(blocks[6] + (i) * 4), \
+	sha1_be32_load(blocks[5] + (i) * 4), sha1_be32_load(blocks[4] + (i) * 4), \
+	sha1_be32_load(blocks[3] + (i) * 4), sha1_be32_load(blocks[2] + (i) * 4), \
+	sha1_be32_load(blocks[1] + (i) * 4), sha1_be32_load(blocks[0] + (i) * 4))
+
+GIT_INLINE(int) sha1_be32_load(const unsigned char *p)
+{
+	return (int)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	             ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+}
+
+/*
+ * Plain SHA-1, one lane of the vectors for each block: the lanes are
+ * independent, so every step is done for all of them at once.
+ */
+SHA1_AVX2_TARGET
+static void sha1_compress_avx2(
+	uint32_t ihv[5][GIT_HASH_SHA1_LANES],
+	const unsigned char *blocks[GIT_HASH_SHA1_LANES],
+	uint32_t W[80][GIT_HASH_SHA1_LANES])
+{
+	__m256i a, b, c, d, e, f, k, t, w[80];
+	size_t i;
+
+	a = _mm256_loadu_si256((const __m256i *)ihv[0]);
+	b = _mm256_loadu_si256((const __m256i *)ihv[1]);
+	c = _mm256_loadu_si256((const __m256i *)ihv[2]);
+	d = _mm256_loadu_si256((const __m256i *)ihv[3]);
+	e = _mm256_loadu_si256((const __m256i *)ihv[4]);
+
+	for (i = 0; i < 16; i++)
+		w[i] = SHA1_AVX2_LOAD(blocks, i);
+
+	for (i = 16; i < 80; i++)
+		w[i] = SHA1_AVX2_ROL(_mm256_xor_si256(
+			_mm256_xor_si256(w[i - 3], w[i - 8]),
+			_mm256_xor_si256(w[i - 14], w[i - 16])), 1);
+
+	for (i = 0; i < 80; i++) {
+		_mm256_storeu_si256((__m256i *)W[i], w[i]);
+
+		if (i < 20) {
+			/* (b & c) | (~b & d) */
+			f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d));
+			k = _mm256_set1_epi32(SHA1_K0);
+		} else if (i < 40) {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32(SHA1_K1);
+		} else if (i < 60) {
+			/* (b & c) | (d & (b | c)) */
+			f = _mm256_or_si256(_mm256_and_si256(b, c),
+				_mm256_and_si256(d, _mm256_or_si256(b, c)));
+			k = _mm256_set1_epi32((int)SHA1_K2);
+		} else {
+			f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			k = _mm256_set1_epi32((int)SHA1_K3);
+		}
+
+		t = _mm256_add_epi32(_mm256_add_epi32(SHA1_AVX2_ROL(a, 5), f),
+			_mm256_add_epi32(_mm256_add_epi32(e, k), w[i]));
+
+		e = d;
+		d = c;
+		c = SHA1_AVX2_ROL(b, 30);
+		b = a;
+		a = t;
+	}
+
+	_mm256_storeu_si256((__m256i *)ihv[0], _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i *)ihv[0])));
+	_mm256_storeu_si256((__m256i *)ihv[1], _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i *)ihv[1])));
+	_mm256_storeu_si256((__m256i *)ihv[2], _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i *)ihv[2])));
+	_mm256_storeu_si256((__m256i *)ihv[3], _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i *)ihv[3])));
+	_mm256_storeu_si256((__m256i *)ihv[4], _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i *)ihv[4])));
+}
+
+git_hash_sha1_compress_lanes_fn git_hash_sha1_accelerated_lanes(void)
+{
+	unsigned int eax, ebx, ecx, edx, xcr0;
+
+	/* The OS must save the vector registers for us to use them */
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+		return NULL;
+
+	__asm__ ("xgetbv" : "=a" (xcr0), "=d" (edx) : "c" (0));
+
+	if ((xcr0 & 0x6) != 0x6)
+		return NULL;
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ||
+	    !(ebx & bit_AVX2))
+		return NULL;
+
+	return sha1_compress_avx2;
+}
+
+#else
+
+git_hash_sha1_compress_lanes_fn git_hash_sha1_accelerated_lanes(void)
+{
+	return NULL;
+}
+
+#endif
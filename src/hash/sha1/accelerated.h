@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#ifndef INCLUDE_hash_sha1_accelerated_h__
+#define INCLUDE_hash_sha1_accelerated_h__
+
+#include "common.h"
+
+/*
+ * Run the SHA-1 compression function over the 64-byte `block`, updating
+ * the chaining value `ihv`.  This is plain SHA-1; the expanded message
+ * is stored in `W` so that the caller can look for collision attacks.
+ */
+typedef void (*git_hash_sha1_compress_fn)(
+	uint32_t ihv[5], const unsigned char *block, uint32_t W[80]);
+
+/*
+ * Return a compression function that uses the SHA-1 instructions of the
+ * CPU we are running on, or NULL if it has none that we support.
+ */
+extern git_hash_sha1_compress_fn git_hash_sha1_accelerated(void);
+
+#define GIT_HASH_SHA1_LANES 8
+
+/*
+ * Run the SHA-1 compression function over one block for each of
+ * `GIT_HASH_SHA1_LANES` independent hashes at once.  The chaining values
+ * and the expanded messages are stored by word, then by lane.
+ */
+typedef void (*git_hash_sha1_compress_lanes_fn)(
+	uint32_t ihv[5][GIT_HASH_SHA1_LANES],
+	const unsigned char *blocks[GIT_HASH_SHA1_LANES],
+	uint32_t W[80][GIT_HASH_SHA1_LANES]);
+
+/*
+ * Return a compression function for many hashes that uses the vector
+ * instructions of the CPU we are running on, or NULL if there are none
+ * that we support.
+ */
+extern git_hash_sha1_compress_lanes_fn git_hash_sha1_accelerated_lanes(void);
+
+#endif
@@ -5,13 +5,129 @@
  * a Linking Exception. For full terms see the included COPYING file.
  */
 
+#include "hash.h"
 #include "collisiondetect.h"
 
+#include "accelerated.h"
+#include "sha1dc/ubc_check.h"
+
+static git_hash_sha1_compress_fn sha1_compress;
+static git_hash_sha1_compress_lanes_fn sha1_compress_lanes;
+
 int git_hash_sha1_global_init(void)
 {
+	sha1_compress = git_hash_sha1_accelerated();
+
+	/*
+	 * Every lane's block needs its own scalar check for collisions, so
+	 * hashing lanes in parallel does not beat the dedicated SHA-1
+	 * instructions; only use lanes when there are none.
+	 */
+	if (!sha1_compress)
+		sha1_compress_lanes = git_hash_sha1_accelerated_lanes();
 	return 0;
 }
 
+int git_hash_sha1__set_kernels(bool accelerated, bool lanes)
+{
+	git_hash_sha1_compress_fn compress = NULL;
+	git_hash_sha1_compress_lanes_fn compress_lanes = NULL;
+
+	if ((accelerated && !(compress = git_hash_sha1_accelerated())) ||
+	    (lanes && !(compress_lanes = git_hash_sha1_accelerated_lanes())))
+		return GIT_ENOTFOUND;
+
+	sha1_compress = compress;
+	sha1_compress_lanes = compress_lanes;
+	return 0;
+}
+
+/* Hash a block with the full collision detection */
+static void sha1_block_detect(SHA1_CTX *ctx, const unsigned char *block)
+{
+	unsigned char buf[64];
+	uint64_t total = ctx->total;
+
+	/* sha1dc hashes the block straight away when nothing is buffered */
+	memcpy(buf, block, 64);
+	ctx->total = 0;
+	SHA1DCUpdate(ctx, (const char *)buf, 64);
+	ctx->total = total;
+}
+
+/*
+ * Hash the blocks with the CPU's SHA-1 instructions and run only the
+ * unavoidable bitcondition check of the collision detection on them.
+ * That check rules out all but a small fraction of the blocks; those
+ * that could be part of a collision attack are hashed again, with the
+ * full collision detection.
+ */
+static void sha1_accelerated_blocks(
+	SHA1_CTX *ctx, const unsigned char *data, size_t blocks)
+{
+	uint32_t ihv[5], W[80], dvmask[DVMASKSIZE];
+
+	for (; blocks; blocks--, data += 64) {
+		memcpy(ihv, ctx->ihv, sizeof(ihv));
+		sha1_compress(ctx->ihv, data, W);
+
+		ubc_check(W, dvmask);
+
+		if (CHECK_DVMASK(dvmask)) {
+			memcpy(ctx->ihv, ihv, sizeof(ihv));
+			sha1_block_detect(ctx, data);
+		}
+	}
+}
+
+static void sha1_accelerated_update(
+	SHA1_CTX *ctx, const unsigned char *data, size_t len)
+{
+	size_t left = ctx->total & 63, fill = 64 - left;
+
+	ctx->total += len;
+
+	if (left) {
+		if (len < fill) {
+			memcpy(ctx->buffer + left, data, len);
+			return;
+		}
+
+		memcpy(ctx->buffer + left, data, fill);
+		sha1_accelerated_blocks(ctx, ctx->buffer, 1);
+
+		data += fill;
+		len -= fill;
+	}
+
+	sha1_accelerated_blocks(ctx, data, len / 64);
+
+	data += len - (len & 63);
+	len &= 63;
+
+	memcpy(ctx->buffer, data, len);
+}
+
+static int sha1_accelerated_final(unsigned char out[20], SHA1_CTX *ctx)
+{
+	static const unsigned char padding[64] = { 0x80 };
+	unsigned char length[8];
+	uint64_t bits = ctx->total << 3;
+	size_t last = ctx->total & 63, i;
+
+	sha1_accelerated_update(ctx, padding, (last < 56) ? (56 - last) : (120 - last));
+
+	for (i = 0; i < 8; i++)
+		length[i] = (unsigned char)(bits >> (56 - i * 8));
+
+	sha1_accelerated_update(ctx, length, 8);
+
+	for (i = 0; i < 20; i++)
+		out[i] = (unsigned char)(ctx->ihv[i / 4] >> (24 - (i % 4) * 8));
+
+	return ctx->found_collision;
+}
+
 int git_hash_sha1_ctx_init(git_hash_sha1_ctx *ctx)
 {
 	return git_hash_sha1_init(ctx);
@@ -32,17 +148,194 @@ int git_hash_sha1_init(git_hash_sha1_ctx *ctx)
 int git_hash_sha1_update(git_hash_sha1_ctx *ctx, const void *data, size_t len)
 {
 	assert(ctx);
-	SHA1DCUpdate(&ctx->c, data, len);
+
+	if (sha1_compress)
+		sha1_accelerated_update(&ctx->c, data, len);
+	else
+		SHA1DCUpdate(&ctx->c, data, len);
+
 	return 0;
 }
 
 int git_hash_sha1_final(git_oid *out, git_hash_sha1_ctx *ctx)
 {
+	int collision;
+
 	assert(ctx);
-	if (SHA1DCFinal(out->id, &ctx->c)) {
+
+	if (sha1_compress)
+		collision = sha1_accelerated_final(out->id, &ctx->c);
+	else
+		collision = SHA1DCFinal(out->id, &ctx->c);
+
+	if (collision) {
 		git_error_set(GIT_ERROR_SHA1, "SHA1 collision attack detected");
 		return -1;
 	}
 
 	return 0;
 }
+
+/* The state of one input of `git_hash_sha1_many` */
+typedef struct {
+	const git_hash_input *in;
+	git_oid *out;
+	size_t vec;
+	size_t off;
+	uint64_t bits;
+	bool padded;
+	bool done;
+	unsigned char buf[64];
+} sha1_lane;
+
+static void sha1_lane_start(sha1_lane *lane, const git_hash_input *in, git_oid *out)
+{
+	size_t i;
+
+	lane->in = in;
+	lane->out = out;
+	lane->vec = 0;
+	lane->off = 0;
+	lane->bits = 0;
+	lane->padded = false;
+	lane->done = false;
+
+	for (i = 0; i < in->len; i++)
+		lane->bits += (uint64_t)in->vec[i].len << 3;
+}
+
+/*
+ * Return the next block of the padded message of a lane.  Blocks that
+ * lie within one of the input buffers are hashed in place; the others
+ * are put together in the lane's buffer.
+ */
+static const unsigned char *sha1_lane_block(sha1_lane *lane)
+{
+	const git_buf_vec *vec;
+	size_t filled = 0, len, i;
+
+	if (lane->vec < lane->in->len) {
+		vec = &lane->in->vec[lane->vec];
+
+		if (vec->len - lane->off >= 64) {
+			const unsigned char *block = (const unsigned char *)vec->data + lane->off;
+			lane->off += 64;
+			return block;
+		}
+	}
+
+	while (filled < 64 && lane->vec < lane->in->len) {
+		vec = &lane->in->vec[lane->vec];
+		len = min(64 - filled, vec->len - lane->off);
+
+		memcpy(lane->buf + filled, (const unsigned char *)vec->data + lane->off, len);
+		filled += len;
+
+		if ((lane->off += len) == vec->len) {
+			lane->vec++;
+			lane->off = 0;
+		}
+	}
+
+	if (filled < 64 && !lane->padded) {
+		lane->buf[filled++] = 0x80;
+		lane->padded = true;
+	}
+
+	memset(lane->buf + filled, 0, 64 - filled);
+
+	if (lane->padded && filled <= 56) {
+		for (i = 0; i < 8; i++)
+			lane->buf[56 + i] = (unsigned char)(lane->bits >> (56 - i * 8));
+
+		lane->done = true;
+	}
+
+	return lane->buf;
+}
+
+int git_hash_sha1_many(git_oid *out, const git_hash_input *in, size_t n)
+{
+	static const unsigned char idle[64];
+	sha1_lane lanes[GIT_HASH_SHA1_LANES];
+	const unsigned char *blocks[GIT_HASH_SHA1_LANES];
+	uint32_t ihv[5][GIT_HASH_SHA1_LANES], prev[5][GIT_HASH_SHA1_LANES];
+	uint32_t W[80][GIT_HASH_SHA1_LANES], lane_W[80], dvmask[DVMASKSIZE];
+	SHA1_CTX detect;
+	size_t next = 0, active = 0, i, j, l;
+
+	if (!sha1_compress_lanes || n < 2)
+		return GIT_PASSTHROUGH;
+
+	SHA1DCInit(&detect);
+
+	for (l = 0; l < GIT_HASH_SHA1_LANES; l++) {
+		lanes[l].in = NULL;
+
+		if (next < n) {
+			sha1_lane_start(&lanes[l], &in[next], &out[next]);
+			next++;
+			active++;
+		}
+
+		for (j = 0; j < 5; j++)
+			ihv[j][l] = detect.ihv[j];
+	}
+
+	while (active) {
+		for (l = 0; l < GIT_HASH_SHA1_LANES; l++)
+			blocks[l] = lanes[l].in ? sha1_lane_block(&lanes[l]) : idle;
+
+		memcpy(prev, ihv, sizeof(ihv));
+		sha1_compress_lanes(ihv, blocks, W);
+
+		for (l = 0; l < GIT_HASH_SHA1_LANES; l++) {
+			sha1_lane *lane = &lanes[l];
+
+			if (!lane->in)
+				continue;
+
+			for (i = 0; i < 80; i++)
+				lane_W[i] = W[i][l];
+
+			ubc_check(lane_W, dvmask);
+
+			/* Hash the block again with the full collision detection */
+			if (CHECK_DVMASK(dvmask)) {
+				for (j = 0; j < 5; j++)
+					detect.ihv[j] = prev[j][l];
+
+				sha1_block_detect(&detect, blocks[l]);
+
+				if (detect.found_collision) {
+					git_error_set(GIT_ERROR_SHA1, "SHA1 collision attack detected");
+					return -1;
+				}
+
+				for (j = 0; j < 5; j++)
+					ihv[j][l] = detect.ihv[j];
+			}
+
+			if (!lane->done)
+				continue;
+
+			for (i = 0; i < 20; i++)
+				lane->out->id[i] = (unsigned char)(ihv[i / 4][l] >> (24 - (i % 4) * 8));
+
+			SHA1DCInit(&detect);
+
+			for (j = 0; j < 5; j++)
+				ihv[j][l] = detect.ihv[j];
+
+			if (next < n) {
+				sha1_lane_start(lane, &in[next], &out[next]);
+				next++;
+			} else {
+				lane->in = NULL;
+				active--;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -20,6 +20,8 @@
 #include "idxmap.h"
 #include "diff.h"
 #include "varint.h"
+#include "filter.h"
+#include "odb.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -3389,14 +3391,145 @@ cleanup:
 	return error;
 }
 
+/*
+ * Small regular files that need no filtering are added in batches, so
+ * that their blobs can be hashed together with `git_odb__hashobj_many`.
+ */
+#define INDEX_ADD_BATCH 32
+#define INDEX_ADD_BATCH_MAX_SIZE (64 * 1024)
+
+typedef struct {
+	char *path;
+	struct stat st;
+} index_add_pending;
+
 struct foreach_diff_data {
 	git_index *index;
 	const git_pathspec *pathspec;
 	unsigned int flags;
 	git_index_matched_path_cb cb;
 	void *payload;
+	index_add_pending batch[INDEX_ADD_BATCH];
+	size_t batch_len;
 };
 
+static int index_add_hashed(
+	git_index *index, index_add_pending *pending, const git_oid *id)
+{
+	git_index_entry *entry = NULL;
+	int error;
+
+	if (index_entry_create(&entry, INDEX_OWNER(index), pending->path, &pending->st, true) < 0)
+		return -1;
+
+	entry->id = *id;
+	git_index_entry__init_from_stat(entry, &pending->st, !index->distrust_filemode);
+
+	if ((error = index_insert(index, &entry, 1, false, false, true)) < 0)
+		return error;
+
+	/* Adding implies conflict was resolved, move conflict entries to REUC */
+	if ((error = index_conflict_to_reuc(index, pending->path)) < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	git_tree_cache_invalidate_path(index->tree, pending->path);
+	return 0;
+}
+
+static int index_add_flush(struct foreach_diff_data *data)
+{
+	git_repository *repo = INDEX_OWNER(data->index);
+	git_buf contents[INDEX_ADD_BATCH], path = GIT_BUF_INIT;
+	git_rawobj objs[INDEX_ADD_BATCH];
+	git_oid ids[INDEX_ADD_BATCH];
+	git_odb *odb;
+	size_t i, n = data->batch_len;
+	int error = 0;
+
+	data->batch_len = 0;
+
+	for (i = 0; i < n; i++)
+		git_buf_init(&contents[i], 0);
+
+	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0)
+		goto done;
+
+	for (i = 0; i < n; i++) {
+		if ((error = git_buf_joinpath(&path, git_repository_workdir(repo), data->batch[i].path)) < 0 ||
+		    (error = git_futils_readbuffer(&contents[i], path.ptr)) < 0)
+			goto done;
+
+		objs[i].data = contents[i].ptr;
+		objs[i].len = contents[i].size;
+		objs[i].type = GIT_OBJECT_BLOB;
+	}
+
+	if ((error = git_odb__hashobj_many(ids, objs, n)) < 0)
+		goto done;
+
+	for (i = 0; i < n; i++) {
+		/* The file has changed since we looked at it; start over */
+		if ((git_object_size_t)contents[i].size != (git_object_size_t)data->batch[i].st.st_size)
+			error = git_index_add_bypath(data->index, data->batch[i].path);
+		else if ((error = git_odb__write_hashed(odb, &ids[i],
+				contents[i].ptr, contents[i].size, GIT_OBJECT_BLOB)) == 0)
+			error = index_add_hashed(data->index, &data->batch[i], &ids[i]);
+
+		if (error < 0)
+			goto done;
+	}
+
+done:
+	for (i = 0; i < n; i++) {
+		git_buf_dispose(&contents[i]);
+		git__free(data->batch[i].path);
+	}
+
+	git_buf_dispose(&path);
+	return error;
+}
+
+static int index_add_batched(struct foreach_diff_data *data, const char *rel_path)
+{
+	git_repository *repo = INDEX_OWNER(data->index);
+	git_filter_list *fl = NULL;
+	git_buf path = GIT_BUF_INIT;
+	index_add_pending *pending;
+	struct stat st;
+	int error;
+
+	if ((error = git_buf_joinpath(&path, git_repository_workdir(repo), rel_path)) < 0)
+		return error;
+
+	error = git_path_lstat(path.ptr, &st);
+	git_buf_dispose(&path);
+
+	if (error < 0)
+		return error;
+
+	if (!S_ISREG(st.st_mode) || st.st_size > INDEX_ADD_BATCH_MAX_SIZE)
+		return git_index_add_bypath(data->index, rel_path);
+
+	if ((error = git_filter_list_load(&fl, repo, NULL, rel_path,
+			GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT)) < 0)
+		return error;
+
+	if (fl) {
+		git_filter_list_free(fl);
+		return git_index_add_bypath(data->index, rel_path);
+	}
+
+	pending = &data->batch[data->batch_len];
+	pending->path = git__strdup(rel_path);
+	GIT_ERROR_CHECK_ALLOC(pending->path);
+	memcpy(&pending->st, &st, sizeof(st));
+
+	if (++data->batch_len == INDEX_ADD_BATCH)
+		return index_add_flush(data);
+
+	return 0;
+}
+
 static int apply_each_file(const git_diff_delta *delta, float progress, void *payload)
 {
 	struct foreach_diff_data *data = payload;
@@ -3425,7 +3558,7 @@ static int apply_each_file(const git_diff_delta *delta, float progress, void *pa
 	if ((delta->new_file.flags & GIT_DIFF_FLAG_EXISTS) == 0)
 		error = git_index_remove_bypath(data->index, path);
 	else
-		error = git_index_add_bypath(data->index, delta->new_file.path);
+		error = index_add_batched(data, delta->new_file.path);
 
 	return error;
 }
@@ -3434,7 +3567,7 @@ static int index_apply_to_wd_diff(git_index *index, int action, const git_strarr
 				  unsigned int flags,
 				  git_index_matched_path_cb cb, void *payload)
 {
-	int error;
+	int error, flush_error;
 	git_diff *diff;
 	git_pathspec ps;
 	git_repository *repo;
@@ -3481,6 +3614,10 @@ static int index_apply_to_wd_diff(git_index *index, int action, const git_strarr
 	error = git_diff_foreach(diff, apply_each_file, NULL, NULL, NULL, &data);
 	git_diff_free(diff);
 
+	/* Files queued before the callback stopped us are still added */
+	if ((flush_error = index_add_flush(&data)) < 0 && !error)
+		error = flush_error;
+
 	if (error) /* make sure error is set if callback stopped iteration */
 		git_error_set_after_callback(error);
 
@@ -55,6 +55,7 @@ struct git_indexer {
 	size_t nr_objects;
 	git_vector objects;
 	git_vector deltas;
+	size_t deltas_tried;
 	unsigned int fanout[256];
 	git_hash_ctx hash_ctx;
 	git_oid hash;
@@ -205,6 +206,13 @@ void git_indexer__set_fsync(git_indexer *idx, int do_fsync)
 	idx->do_fsync = !!do_fsync;
 }
 
+bool git_indexer__complete(git_indexer *idx, const git_indexer_progress *stats)
+{
+	return idx->parsed_header &&
+		stats->received_objects == idx->nr_objects &&
+		idx->pack->mwf.size >= idx->off + GIT_OID_RAWSZ;
+}
+
 /* Try to store the delta so we can try to resolve it later */
 static int store_delta(git_indexer *idx)
 {
@@ -365,10 +373,16 @@ static int check_object_connectivity(git_indexer *idx, const git_rawobj *obj)
 		case GIT_OBJECT_TREE:
 		{
 			git_tree *tree = (git_tree *) object;
+			git_tree_entries *entries;
 			git_tree_entry *entry;
 			size_t i;
 
-			git_array_foreach(tree->entries, i, entry)
+			if ((entries = git_tree__entries(tree)) == NULL) {
+				error = -1;
+				goto out;
+			}
+
+			git_array_foreach(*entries, i, entry)
 				if (add_expected_oid(idx, entry->oid) < 0)
 					goto out;
 
@@ -515,9 +529,9 @@ static int save_entry(git_indexer *idx, struct entry *entry, struct git_pack_ent
 	return 0;
 }
 
-static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
+static int save_resolved(
+	git_indexer *idx, const git_oid *oid, off64_t entry_start, off64_t entry_end)
 {
-	git_oid oid;
 	size_t entry_size;
 	struct entry *entry;
 	struct git_pack_entry *pentry = NULL;
@@ -525,19 +539,14 @@ static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
 	entry = git__calloc(1, sizeof(*entry));
 	GIT_ERROR_CHECK_ALLOC(entry);
 
-	if (git_odb__hashobj(&oid, obj) < 0) {
-		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
-		goto on_error;
-	}
-
 	pentry = git__calloc(1, sizeof(struct git_pack_entry));
 	GIT_ERROR_CHECK_ALLOC(pentry);
 
-	git_oid_cpy(&pentry->sha1, &oid);
-	git_oid_cpy(&entry->oid, &oid);
+	git_oid_cpy(&pentry->sha1, oid);
+	git_oid_cpy(&entry->oid, oid);
 	entry->crc = crc32(0L, Z_NULL, 0);
 
-	entry_size = (size_t)(idx->off - entry_start);
+	entry_size = (size_t)(entry_end - entry_start);
 	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
 		goto on_error;
 
@@ -546,7 +555,6 @@ static int hash_and_save(git_indexer *idx, git_rawobj *obj, off64_t entry_start)
 on_error:
 	git__free(pentry);
 	git__free(entry);
-	git__free(obj->data);
 	return -1;
 }
 
@@ -736,9 +744,11 @@ static int read_stream_object(git_indexer *idx, git_indexer_progress *stats)
 	if (error < 0)
 		return error;
 
-	if (!idx->have_delta) {
+	if (idx->have_delta)
+		stats->total_deltas++;
+	else
 		stats->indexed_objects++;
-	}
+
 	stats->received_objects++;
 
 	if ((error = do_progress_callback(idx, stats)) != 0)
@@ -747,6 +757,8 @@ static int read_stream_object(git_indexer *idx, git_indexer_progress *stats)
 	return 0;
 }
 
+static int resolve_received_deltas(git_indexer *idx, git_indexer_progress *stats);
+
 int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_indexer_progress *stats)
 {
 	int error = -1;
@@ -818,6 +830,9 @@ int git_indexer_append(git_indexer *idx, const void *data, size_t size, git_inde
 		}
 	}
 
+	if ((error = resolve_received_deltas(idx, stats)) < 0)
+		goto on_error;
+
 	return 0;
 
 on_error:
@@ -993,51 +1008,166 @@ static int fix_thin_pack(git_indexer *idx, git_indexer_progress *stats)
 	return 0;
 }
 
-static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
+/*
+ * Resolved deltas are hashed in batches, so that several of them can be
+ * hashed at once; large objects are hashed as soon as they are resolved
+ * to keep the batch small.
+ */
+#define RESOLVE_BATCH 16
+#define RESOLVE_BATCH_MAX_SIZE (64 * 1024)
+
+struct resolved_delta {
+	size_t pos;
+	off64_t start;
+	off64_t end;
+	git_rawobj obj;
+};
+
+static int save_resolved_batch(
+	git_indexer *idx,
+	git_indexer_progress *stats,
+	struct resolved_delta *batch,
+	size_t n,
+	int *progressed)
 {
-	unsigned int i;
-	int error;
+	git_rawobj objs[RESOLVE_BATCH];
+	git_oid ids[RESOLVE_BATCH];
 	struct delta_info *delta;
-	int progressed = 0, non_null = 0, progress_cb_result;
+	size_t i;
+	int error = 0;
 
-	while (idx->deltas.length > 0) {
-		progressed = 0;
-		non_null = 0;
-		git_vector_foreach(&idx->deltas, i, delta) {
-			git_rawobj obj = {0};
+	for (i = 0; i < n; i++)
+		objs[i] = batch[i].obj;
 
-			if (!delta)
-				continue;
+	if (git_odb__hashobj_many(ids, objs, n) < 0) {
+		git_error_set(GIT_ERROR_INDEXER, "failed to hash object");
+		goto done;
+	}
 
-			non_null = 1;
-			idx->off = delta->delta_off;
-			if ((error = git_packfile_unpack(&obj, idx->pack, &idx->off)) < 0) {
-				if (error == GIT_PASSTHROUGH) {
-					/* We have not seen the base object, we'll try again later. */
-					continue;
-				}
-				return -1;
-			}
+	for (i = 0; i < n; i++) {
+		if (save_resolved(idx, &ids[i], batch[i].start, batch[i].end) < 0)
+			continue;
 
-			if (idx->do_verify && check_object_connectivity(idx, &obj) < 0)
-				/* TODO: error? continue? */
-				continue;
+		stats->indexed_objects++;
+		stats->indexed_deltas++;
+		*progressed = 1;
 
-			if (hash_and_save(idx, &obj, delta->delta_off) < 0)
-				continue;
+		/* remove from the list */
+		delta = git_vector_get(&idx->deltas, batch[i].pos);
+		git_vector_set(NULL, &idx->deltas, batch[i].pos, NULL);
+		git__free(delta);
+
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			goto done;
+	}
 
-			git__free(obj.data);
-			stats->indexed_objects++;
-			stats->indexed_deltas++;
-			progressed = 1;
-			if ((progress_cb_result = do_progress_callback(idx, stats)) < 0)
-				return progress_cb_result;
+done:
+	for (i = 0; i < n; i++)
+		git__free(batch[i].obj.data);
 
-			/* remove from the list */
-			git_vector_set(NULL, &idx->deltas, i, NULL);
-			git__free(delta);
+	return error;
+}
+
+/*
+ * Try to resolve the deltas from the given position onwards, leaving
+ * the ones whose base we have not seen yet in the list.  With `defer`,
+ * failures to unpack a delta leave it in the list as well, as its data
+ * may still be too close to the end of what we received.
+ */
+static int resolve_delta_range(
+	git_indexer *idx,
+	git_indexer_progress *stats,
+	size_t start,
+	int defer,
+	int *progressed,
+	int *non_null)
+{
+	struct resolved_delta batch[RESOLVE_BATCH];
+	struct delta_info *delta;
+	size_t batch_len = 0, i;
+	int error;
+
+	for (i = start; i < git_vector_length(&idx->deltas); i++) {
+		git_rawobj obj = {0};
+
+		if ((delta = git_vector_get(&idx->deltas, i)) == NULL)
+			continue;
+
+		*non_null = 1;
+		idx->off = delta->delta_off;
+		if ((error = git_packfile_unpack(&obj, idx->pack, &idx->off)) < 0) {
+			if (error == GIT_PASSTHROUGH || defer) {
+				/* We have not seen the base object, we'll try again later. */
+				git_error_clear();
+				continue;
+			}
+			error = -1;
+			goto on_error;
 		}
 
+		if (idx->do_verify && check_object_connectivity(idx, &obj) < 0)
+			/* TODO: error? continue? */
+			continue;
+
+		batch[batch_len].pos = i;
+		batch[batch_len].start = delta->delta_off;
+		batch[batch_len].end = idx->off;
+		batch[batch_len].obj = obj;
+
+		if (++batch_len < RESOLVE_BATCH && obj.len <= RESOLVE_BATCH_MAX_SIZE)
+			continue;
+
+		error = save_resolved_batch(idx, stats, batch, batch_len, progressed);
+		batch_len = 0;
+
+		if (error < 0)
+			return error;
+	}
+
+	return save_resolved_batch(idx, stats, batch, batch_len, progressed);
+
+on_error:
+	while (batch_len)
+		git__free(batch[--batch_len].obj.data);
+
+	return error;
+}
+
+/*
+ * Resolve the deltas we received since the last call whose bases we
+ * already have, so that little is left to do once the pack is complete.
+ * Each delta is only tried once here: the ones which still miss their
+ * base are resolved by git_indexer_commit().
+ */
+static int resolve_received_deltas(git_indexer *idx, git_indexer_progress *stats)
+{
+	off64_t off = idx->off;
+	int progressed = 0, non_null = 0, error;
+
+	if (idx->deltas_tried == git_vector_length(&idx->deltas))
+		return 0;
+
+	error = resolve_delta_range(idx, stats, idx->deltas_tried, 1,
+		&progressed, &non_null);
+
+	idx->deltas_tried = git_vector_length(&idx->deltas);
+	idx->off = off;
+
+	return error;
+}
+
+static int resolve_deltas(git_indexer *idx, git_indexer_progress *stats)
+{
+	int progressed, non_null, error;
+
+	while (idx->deltas.length > 0) {
+		progressed = 0;
+		non_null = 0;
+
+		if ((error = resolve_delta_range(idx, stats, 0, 0,
+				&progressed, &non_null)) < 0)
+			return error;
+
 		/* if none were actually set, we're done */
 		if (!non_null)
 			break;
@@ -1134,8 +1264,9 @@ int git_indexer_commit(git_indexer *idx, git_indexer_progress *stats)
 		return -1;
 	}
 
-	/* Freeze the number of deltas */
-	stats->total_deltas = stats->total_objects - stats->indexed_objects;
+	/* Freeze the number of deltas, some of which we already resolved */
+	stats->total_deltas = stats->total_objects - stats->indexed_objects +
+		stats->indexed_deltas;
 
 	if ((error = resolve_deltas(idx, stats)) < 0)
 		return error;
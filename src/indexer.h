@@ -13,4 +13,10 @@
 
 extern void git_indexer__set_fsync(git_indexer *idx, int do_fsync);
 
+/*
+ * Whether the data appended so far holds the whole pack, up to its
+ * trailer, for a pack that is streamed without its size.
+ */
+extern bool git_indexer__complete(git_indexer *idx, const git_indexer_progress *stats);
+
 #endif
@@ -535,6 +535,7 @@ static int tree_iterator_frame_init(
 	tree_iterator_frame *new_frame = NULL;
 	tree_iterator_entry *new_entry;
 	git_tree *dup = NULL;
+	git_tree_entries *tree_entries;
 	git_tree_entry *tree_entry;
 	git_vector_cmp cmp;
 	size_t i;
@@ -556,11 +557,16 @@ static int tree_iterator_frame_init(
 	cmp = iterator__ignore_case(&iter->base) ?
 		tree_iterator_entry_sort_icase : NULL;
 
+	if ((tree_entries = git_tree__entries(dup)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
 	if ((error = git_vector_init(&new_frame->entries,
-				     dup->entries.size, cmp)) < 0)
+				     tree_entries->size, cmp)) < 0)
 		goto done;
 
-	git_array_foreach(dup->entries, i, tree_entry) {
+	git_array_foreach(*tree_entries, i, tree_entry) {
 		if ((new_entry = git_pool_malloc(&iter->entry_pool, 1)) == NULL) {
 			git_error_set_oom();
 			error = -1;
@@ -600,6 +606,7 @@ GIT_INLINE(int) tree_iterator_frame_push_neighbors(
 {
 	tree_iterator_entry *entry, *new_entry;
 	git_tree *tree = NULL;
+	git_tree_entries *tree_entries;
 	git_tree_entry *tree_entry;
 	git_buf *path;
 	size_t new_size, i;
@@ -626,11 +633,14 @@ GIT_INLINE(int) tree_iterator_frame_push_neighbors(
 		if ((error = tree_iterator_compute_path(path, entry)) < 0)
 			break;
 
+		tree_entries = git_tree__entries(tree);
+		GIT_ERROR_CHECK_ALLOC(tree_entries);
+
 		GIT_ERROR_CHECK_ALLOC_ADD(&new_size,
-			frame->entries.length, tree->entries.size);
+			frame->entries.length, tree_entries->size);
 		git_vector_size_hint(&frame->entries, new_size);
 
-		git_array_foreach(tree->entries, i, tree_entry) {
+		git_array_foreach(*tree_entries, i, tree_entry) {
 			new_entry = git_pool_malloc(&iter->entry_pool, 1);
 			GIT_ERROR_CHECK_ALLOC(new_entry);
 
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "negotiator.h"
+
+#include "git2/refs.h"
+
+#include "commit_list.h"
+#include "pool.h"
+#include "pqueue.h"
+#include "revwalk.h"
+
+typedef struct {
+	git_commit_list_node *commit;
+
+	/* The ancestors to skip before sending one, and how many were skipped last */
+	unsigned int ttl;
+	unsigned int original_ttl;
+} negotiation_entry;
+
+struct git_negotiator {
+	git_repository *repo;
+
+	/* Parses the commits and keeps their nodes */
+	git_revwalk *walk;
+
+	git_pqueue queue; /* newest commit first */
+	git_pool entries;
+
+	unsigned int skipping : 1;
+};
+
+static int entry_time_cmp(const void *a, const void *b)
+{
+	const negotiation_entry *entry_a = a, *entry_b = b;
+
+	return git_commit_list_time_cmp(entry_a->commit, entry_b->commit);
+}
+
+int git_negotiator_new(
+	git_negotiator **out,
+	git_repository *repo,
+	git_fetch_negotiation_t algorithm)
+{
+	git_negotiator *negotiator;
+
+	assert(out && repo);
+
+	negotiator = git__calloc(1, sizeof(git_negotiator));
+	GIT_ERROR_CHECK_ALLOC(negotiator);
+
+	negotiator->repo = repo;
+	negotiator->skipping = (algorithm == GIT_FETCH_NEGOTIATION_SKIPPING);
+
+	git_pool_init(&negotiator->entries, sizeof(negotiation_entry));
+
+	if (git_pqueue_init(&negotiator->queue, 0, 8, entry_time_cmp) < 0 ||
+	    git_revwalk_new(&negotiator->walk, repo) < 0) {
+		git_negotiator_free(negotiator);
+		return -1;
+	}
+
+	*out = negotiator;
+	return 0;
+}
+
+/* Queue a commit which is not queued yet */
+static int enqueue(
+	git_negotiator *negotiator,
+	git_commit_list_node *commit,
+	unsigned int ttl,
+	unsigned int original_ttl)
+{
+	negotiation_entry *entry;
+	int error;
+
+	if (commit->seen)
+		return 0;
+
+	/* The queue is sorted by date, which the commit tells */
+	if ((error = git_commit_list_parse(negotiator->walk, commit)) < 0)
+		return error;
+
+	entry = git_pool_mallocz(&negotiator->entries, 1);
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	entry->commit = commit;
+	entry->ttl = ttl;
+	entry->original_ttl = original_ttl;
+
+	commit->seen = 1;
+	return git_pqueue_insert(&negotiator->queue, entry);
+}
+
+static int add_tip(git_negotiator *negotiator, const char *refname)
+{
+	git_object *obj = NULL, *commit = NULL;
+	git_commit_list_node *node;
+	git_oid id;
+	int error;
+
+	if ((error = git_reference_name_to_id(&id, negotiator->repo, refname)) < 0 ||
+	    (error = git_object_lookup(&obj, negotiator->repo, &id, GIT_OBJECT_ANY)) < 0 ||
+	    (error = git_object_peel(&commit, obj, GIT_OBJECT_COMMIT)) < 0)
+		goto done;
+
+	if ((node = git_revwalk__commit_lookup(negotiator->walk, git_object_id(commit))) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	error = enqueue(negotiator, node, 0, 0);
+
+done:
+	/* Like a revwalk's globs, ignore what is not a commit */
+	if (error == GIT_ENOTFOUND || error == GIT_EINVALIDSPEC || error == GIT_EPEEL) {
+		git_error_clear();
+		error = 0;
+	}
+
+	git_object_free(commit);
+	git_object_free(obj);
+	return error;
+}
+
+int git_negotiator_add_tips(git_negotiator *negotiator, const char *glob)
+{
+	git_reference_iterator *iter;
+	const char *refname;
+	int error;
+
+	assert(negotiator && glob);
+
+	if ((error = git_reference_iterator_glob_new(&iter, negotiator->repo, glob)) < 0)
+		return error;
+
+	while ((error = git_reference_next_name(&refname, iter)) == 0) {
+		if ((error = add_tip(negotiator, refname)) < 0)
+			break;
+	}
+
+	git_reference_iterator_free(iter);
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	return error;
+}
+
+int git_negotiator_next(git_oid *out, git_negotiator *negotiator)
+{
+	negotiation_entry *entry;
+	unsigned int ttl, original_ttl;
+	bool send;
+	uint16_t i;
+	int error;
+
+	assert(out && negotiator);
+
+	while ((entry = git_pqueue_pop(&negotiator->queue)) != NULL) {
+		send = (entry->ttl == 0);
+
+		if (!send) {
+			ttl = entry->ttl - 1;
+			original_ttl = entry->original_ttl;
+		} else if (negotiator->skipping) {
+			/* Skip half as many ancestors again after each one we send */
+			original_ttl = entry->original_ttl * 3 / 2 + 1;
+			ttl = original_ttl;
+		} else {
+			original_ttl = ttl = 0;
+		}
+
+		for (i = 0; i < entry->commit->out_degree; i++) {
+			if ((error = enqueue(negotiator, entry->commit->parents[i], ttl, original_ttl)) < 0)
+				return error;
+		}
+
+		if (send) {
+			git_oid_cpy(out, &entry->commit->oid);
+			return 0;
+		}
+	}
+
+	return GIT_ITEROVER;
+}
+
+void git_negotiator_free(git_negotiator *negotiator)
+{
+	if (!negotiator)
+		return;
+
+	git_revwalk_free(negotiator->walk);
+	git_pqueue_free(&negotiator->queue);
+	git_pool_clear(&negotiator->entries);
+	git__free(negotiator);
+}
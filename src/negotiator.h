@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_negotiator_h__
+#define INCLUDE_negotiator_h__
+
+#include "common.h"
+
+#include "git2/remote.h"
+
+/*
+ * Chooses the commits that a fetch tells the remote it has, walking
+ * back from the tips that it is given, from the newest commit.
+ *
+ * The consecutive algorithm names every commit that it walks.  The
+ * skipping one names a tip and then skips more and more ancestors
+ * between the commits it names, so that a common commit deep in the
+ * history is found in a few rounds, at the price of maybe missing a
+ * newer one.
+ */
+typedef struct git_negotiator git_negotiator;
+
+int git_negotiator_new(
+	git_negotiator **out,
+	git_repository *repo,
+	git_fetch_negotiation_t algorithm);
+
+/*
+ * Walk from the commits of the references whose names match the glob,
+ * like "refs/tags/v1.*".  References which do not point to a commit,
+ * like the tags of trees, are ignored.
+ */
+int git_negotiator_add_tips(git_negotiator *negotiator, const char *glob);
+
+/* Get the next commit to send, or GIT_ITEROVER when there is none */
+int git_negotiator_next(git_oid *out, git_negotiator *negotiator);
+
+void git_negotiator_free(git_negotiator *negotiator);
+
+#endif
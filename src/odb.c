@@ -16,6 +16,8 @@
 #include "filter.h"
 #include "repository.h"
 #include "blob.h"
+#include "array.h"
+#include "global.h"
 
 #include "git2/odb_backend.h"
 #include "git2/oid.h"
@@ -39,6 +41,7 @@ typedef struct
 	git_odb_backend *backend;
 	int priority;
 	bool is_alternate;
+	bool in_batch;
 	ino_t disk_inode;
 } backend_internal;
 
@@ -55,6 +58,7 @@ static git_cache *odb_cache(git_odb *odb)
 static int odb_otype_fast(git_object_t *type_p, git_odb *db, const git_oid *id);
 static int load_alternates(git_odb *odb, const char *objects_dir, int alternate_depth);
 static int error_null_oid(int error, const char *message);
+static int odb_missing(git_odb *db, const git_oid *ids, size_t count);
 
 static git_object_t odb_hardcoded_type(const git_oid *id)
 {
@@ -138,6 +142,53 @@ int git_odb__hashobj(git_oid *id, git_rawobj *obj)
 	return git_hash_vec(id, vec, 2);
 }
 
+/* The headers of the objects hashed by one `git_hash_many` call */
+#define HASHOBJ_MANY_BATCH 32
+
+int git_odb__hashobj_many(git_oid *ids, git_rawobj *objs, size_t n)
+{
+	char headers[HASHOBJ_MANY_BATCH][64];
+	git_buf_vec vecs[HASHOBJ_MANY_BATCH][2];
+	git_hash_input in[HASHOBJ_MANY_BATCH];
+	size_t hdrlen, batch, i;
+	int error;
+
+	assert(ids && (objs || !n));
+
+	for (; n; ids += batch, objs += batch, n -= batch) {
+		batch = min(n, HASHOBJ_MANY_BATCH);
+
+		for (i = 0; i < batch; i++) {
+			if (!git_object_typeisloose(objs[i].type)) {
+				git_error_set(GIT_ERROR_INVALID, "invalid object type");
+				return -1;
+			}
+
+			if (!objs[i].data && objs[i].len != 0) {
+				git_error_set(GIT_ERROR_INVALID, "invalid object");
+				return -1;
+			}
+
+			if ((error = git_odb__format_object_header(&hdrlen,
+				headers[i], sizeof(headers[i]), objs[i].len, objs[i].type)) < 0)
+				return error;
+
+			vecs[i][0].data = headers[i];
+			vecs[i][0].len = hdrlen;
+			vecs[i][1].data = objs[i].data;
+			vecs[i][1].len = objs[i].len;
+
+			in[i].vec = vecs[i];
+			in[i].len = 2;
+		}
+
+		if ((error = git_hash_many(ids, in, batch)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
 
 static git_odb_object *odb_object__alloc(const git_oid *oid, git_rawobj *source)
 {
@@ -477,12 +528,18 @@ static int add_backend_internal(
 	/* Check if the backend is already owned by another ODB */
 	assert(!backend->odb || backend->odb == odb);
 
+	if (backend->begin_batch && !backend->end_batch) {
+		git_error_set(GIT_ERROR_ODB, "incomplete odb backend implementation");
+		return GIT_EINVALID;
+	}
+
 	internal = git__malloc(sizeof(backend_internal));
 	GIT_ERROR_CHECK_ALLOC(internal);
 
 	internal->backend = backend;
 	internal->priority = priority;
 	internal->is_alternate = is_alternate;
+	internal->in_batch = false;
 	internal->disk_inode = disk_inode;
 
 	if (git_vector_insert(&odb->backends, internal) < 0) {
@@ -687,6 +744,10 @@ static void odb_free(git_odb *db)
 		backend_internal *internal = git_vector_get(&db->backends, i);
 		git_odb_backend *backend = internal->backend;
 
+		/* discard the objects of an unfinished batch */
+		if (internal->in_batch)
+			backend->end_batch(backend, false);
+
 		backend->free(backend);
 
 		git__free(internal);
@@ -1016,6 +1077,9 @@ int git_odb__read_header_or_object(
 	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
 		error = odb_read_header_1(len_p, type_p, db, id, true);
 
+	if (error == GIT_ENOTFOUND && (error = odb_missing(db, id, 1)) == 0)
+		error = odb_read_header_1(len_p, type_p, db, id, false);
+
 	if (error == GIT_ENOTFOUND)
 		return git_odb__error_notfound("cannot read header for", id, GIT_OID_HEXSZ);
 
@@ -1118,12 +1182,201 @@ int git_odb_read(git_odb_object **out, git_odb *db, const git_oid *id)
 	if (error == GIT_ENOTFOUND && !git_odb_refresh(db))
 		error = odb_read_1(out, db, id, true);
 
+	if (error == GIT_ENOTFOUND && (error = odb_missing(db, id, 1)) == 0)
+		error = odb_read_1(out, db, id, false);
+
 	if (error == GIT_ENOTFOUND)
 		return git_odb__error_notfound("no match for id", id, GIT_OID_HEXSZ);
 
 	return error;
 }
 
+typedef struct {
+	git_odb *db;
+	const git_oid *ids;
+	size_t *pending;
+	bool *done;
+	git_odb_read_many_cb cb;
+	void *payload;
+} read_many_data;
+
+static int read_many_deliver(
+	read_many_data *data, git_odb_object *object, size_t idx)
+{
+	int error = data->cb(object, idx, data->payload);
+
+	data->done[idx] = true;
+	git_odb_object_free(object);
+
+	return git_error_set_after_callback_function(error, "git_odb_read_many");
+}
+
+static int read_many_backend_cb(
+	size_t pos, void *buf, size_t len, git_object_t type, void *payload)
+{
+	read_many_data *data = payload;
+	size_t idx = data->pending[pos];
+	const git_oid *id = &data->ids[idx];
+	git_rawobj raw;
+	git_odb_object *object;
+	git_oid hashed;
+	int error;
+
+	raw.data = buf;
+	raw.len = len;
+	raw.type = type;
+
+	if (git_odb__strict_hash_verification) {
+		if ((error = git_odb_hash(&hashed, raw.data, raw.len, raw.type)) < 0)
+			goto on_error;
+
+		if (!git_oid_equal(id, &hashed)) {
+			error = git_odb__error_mismatch(id, &hashed);
+			goto on_error;
+		}
+	}
+
+	if ((object = odb_object__alloc(id, &raw)) == NULL) {
+		error = -1;
+		goto on_error;
+	}
+
+	object = git_cache_store_raw(odb_cache(data->db), object);
+	return read_many_deliver(data, object, idx);
+
+on_error:
+	git__free(buf);
+	return error;
+}
+
+int git_odb_read_many(
+	git_odb *db,
+	const git_oid *ids,
+	size_t count,
+	git_odb_read_many_cb cb,
+	void *payload)
+{
+	read_many_data data = {0};
+	git_oid *pending_ids = NULL;
+	git_odb_object *object;
+	size_t i, j, pending = 0;
+	int error = 0;
+
+	assert(db && (ids || !count) && cb);
+
+	if (!count)
+		return 0;
+
+	data.db = db;
+	data.ids = ids;
+	data.cb = cb;
+	data.payload = payload;
+
+	pending_ids = git__calloc(count, sizeof(git_oid));
+	data.pending = git__calloc(count, sizeof(size_t));
+	data.done = git__calloc(count, sizeof(bool));
+	if (!pending_ids || !data.pending || !data.done) {
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (git_oid_is_zero(&ids[i])) {
+			error = error_null_oid(GIT_ENOTFOUND, "cannot read object");
+			goto done;
+		}
+
+		if ((object = git_cache_get_raw(odb_cache(db), &ids[i])) != NULL) {
+			if ((error = read_many_deliver(&data, object, i)) != 0)
+				goto done;
+			continue;
+		}
+
+		git_oid_cpy(&pending_ids[pending], &ids[i]);
+		data.pending[pending++] = i;
+	}
+
+	for (i = 0; i < db->backends.length && pending; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+		size_t remaining = 0;
+
+		if (!b->read_many)
+			continue;
+
+		error = b->read_many(b, pending_ids, pending,
+			read_many_backend_cb, &data);
+
+		if (error == GIT_PASSTHROUGH)
+			error = 0;
+		else if (error)
+			goto done;
+
+		/* Drop the objects that this backend has found */
+		for (j = 0; j < pending; j++) {
+			if (data.done[data.pending[j]])
+				continue;
+
+			git_oid_cpy(&pending_ids[remaining], &pending_ids[j]);
+			data.pending[remaining++] = data.pending[j];
+		}
+
+		pending = remaining;
+	}
+
+	/*
+	 * Whatever is left is either stored in a backend that cannot read
+	 * objects in bulk or missing; fetch the missing objects together,
+	 * then read it one by one, which will also refresh the backends if
+	 * necessary.
+	 */
+	if (pending && (error = git_odb__fetch_missing(db, pending_ids, pending)) < 0)
+		goto done;
+
+	for (j = 0; j < pending; j++) {
+		if ((error = git_odb_read(&object, db, &pending_ids[j])) < 0 ||
+		    (error = read_many_deliver(&data, object, data.pending[j])) != 0)
+			goto done;
+	}
+
+	git_error_clear();
+
+done:
+	git__free(pending_ids);
+	git__free(data.pending);
+	git__free(data.done);
+	return error;
+}
+
+static int read_many_array_cb(git_odb_object *object, size_t idx, void *payload)
+{
+	git_odb_object **out = payload;
+	return git_odb_object_dup(&out[idx], object);
+}
+
+int git_odb_read_many_array(
+	git_odb_object **out,
+	git_odb *db,
+	const git_oid *ids,
+	size_t count)
+{
+	size_t i;
+	int error;
+
+	assert(out);
+
+	memset(out, 0, count * sizeof(*out));
+
+	if ((error = git_odb_read_many(db, ids, count, read_many_array_cb, out)) < 0) {
+		for (i = 0; i < count; i++) {
+			git_odb_object_free(out[i]);
+			out[i] = NULL;
+		}
+	}
+
+	return error;
+}
+
 static int odb_otype_fast(git_object_t *type_p, git_odb *db, const git_oid *id)
 {
 	git_odb_object *object;
@@ -1281,6 +1534,16 @@ int git_odb_foreach(git_odb *db, git_odb_foreach_cb cb, void *payload)
 
 int git_odb_write(
 	git_oid *oid, git_odb *db, const void *data, size_t len, git_object_t type)
+{
+	assert(oid && db);
+
+	git_odb_hash(oid, data, len, type);
+
+	return git_odb__write_hashed(db, oid, data, len, type);
+}
+
+int git_odb__write_hashed(
+	git_odb *db, const git_oid *oid, const void *data, size_t len, git_object_t type)
 {
 	size_t i;
 	int error = GIT_ERROR;
@@ -1288,8 +1551,6 @@ int git_odb_write(
 
 	assert(oid && db);
 
-	git_odb_hash(oid, data, len, type);
-
 	if (git_oid_is_zero(oid))
 		return error_null_oid(GIT_EINVALID, "cannot write object");
 
@@ -1325,6 +1586,74 @@ int git_odb_write(
 	return error;
 }
 
+static int end_batch(git_odb *db, int success)
+{
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+		int backend_error;
+
+		if (!internal->in_batch)
+			continue;
+
+		internal->in_batch = false;
+
+		if ((backend_error = b->end_batch(b, success)) < 0 && !error)
+			error = backend_error;
+	}
+
+	db->in_batch = 0;
+	return error;
+}
+
+int git_odb_begin_batch(git_odb *db)
+{
+	size_t i;
+	int error;
+
+	assert(db);
+
+	if (db->in_batch) {
+		git_error_set(GIT_ERROR_ODB, "a batch of writes is already in progress");
+		return -1;
+	}
+
+	db->in_batch = 1;
+
+	for (i = 0; i < db->backends.length; ++i) {
+		backend_internal *internal = git_vector_get(&db->backends, i);
+		git_odb_backend *b = internal->backend;
+
+		/* we don't write in alternates! */
+		if (internal->is_alternate || !b->begin_batch)
+			continue;
+
+		if ((error = b->begin_batch(b)) < 0) {
+			end_batch(db, false);
+			return error;
+		}
+
+		internal->in_batch = true;
+	}
+
+	return 0;
+}
+
+int git_odb_end_batch(git_odb *db, int success)
+{
+	assert(db);
+
+	if (!db->in_batch) {
+		git_error_set(GIT_ERROR_ODB, "no batch of writes is in progress");
+		return -1;
+	}
+
+	return end_batch(db, success);
+}
+
 static int hash_header(git_hash_ctx *ctx, git_object_size_t size, git_object_t type)
 {
 	char header[64];
@@ -1540,6 +1869,86 @@ int git_odb_refresh(struct git_odb *db)
 	return 0;
 }
 
+int git_odb_set_missing_callback(
+	git_odb *db, git_odb_missing_cb cb, void *payload)
+{
+	assert(db);
+
+	db->missing_cb = cb;
+	db->missing_payload = payload;
+	return 0;
+}
+
+/* Whether this thread is running the missing object callback of the database */
+static bool odb_in_missing_cb(git_odb *db)
+{
+	git_global_st *global = GIT_GLOBAL;
+
+	/* Without our thread's state, we cannot tell; don't recurse */
+	return !global || global->missing_cb_odb == db;
+}
+
+/*
+ * Give the missing object callback a chance to make the objects
+ * available; returns GIT_ENOTFOUND if it did not run or declined.
+ */
+static int odb_missing(git_odb *db, const git_oid *ids, size_t count)
+{
+	git_global_st *global;
+	git_odb *outer;
+	int error;
+
+	if (!db->missing_cb || odb_in_missing_cb(db))
+		return GIT_ENOTFOUND;
+
+	/*
+	 * Only this thread is in the callback; other threads reading
+	 * missing objects from the same database may run it too.
+	 */
+	global = GIT_GLOBAL;
+	outer = global->missing_cb_odb;
+	global->missing_cb_odb = db;
+	error = db->missing_cb(db, ids, count, db->missing_payload);
+	global->missing_cb_odb = outer;
+
+	if (error == GIT_PASSTHROUGH)
+		return GIT_ENOTFOUND;
+
+	if (error < 0)
+		return git_error_set_after_callback_function(error, "git_odb_missing_cb");
+
+	return git_odb_refresh(db);
+}
+
+int git_odb__fetch_missing(git_odb *db, const git_oid *ids, size_t count)
+{
+	git_array_t(git_oid) missing = GIT_ARRAY_INIT;
+	git_oid *id;
+	size_t i;
+	int error = 0;
+
+	assert(db && (ids || !count));
+
+	if (!db->missing_cb || odb_in_missing_cb(db))
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		if (git_odb_exists(db, &ids[i]))
+			continue;
+
+		id = git_array_alloc(missing);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &ids[i]);
+	}
+
+	if (missing.size &&
+	    (error = odb_missing(db, missing.ptr, missing.size)) == GIT_ENOTFOUND)
+		error = 0;
+
+	git_array_clear(missing);
+	return error;
+}
+
 int git_odb__error_mismatch(const git_oid *expected, const git_oid *actual)
 {
 	char expected_oid[GIT_OID_HEXSZ + 1], actual_oid[GIT_OID_HEXSZ + 1];
@@ -23,6 +23,19 @@
 #define GIT_OBJECT_FILE_MODE 0444
 
 extern bool git_odb__strict_hash_verification;
+extern bool git_odb__loose_object_cache;
+
+/*
+ * The number of objects from which the loose backend writes the objects
+ * of a batch into a packfile rather than moving them into place.
+ */
+extern size_t git_odb__loose_batch_pack_threshold;
+
+/*
+ * The number of threads that inflate the objects which `git_odb_read_many`
+ * reads from packfiles; 0 uses one per CPU.
+ */
+extern unsigned int git_odb__read_many_threads;
 
 /* DO NOT EXPORT */
 typedef struct {
@@ -43,6 +56,9 @@ struct git_odb {
 	git_vector backends;
 	git_cache own_cache;
 	unsigned int do_fsync :1;
+	unsigned int in_batch :1;
+	git_odb_missing_cb missing_cb;
+	void *missing_payload;
 };
 
 typedef enum {
@@ -61,12 +77,26 @@ int git_odb__add_default_backends(
 	git_odb *db, const char *objects_dir,
 	bool as_alternates, int alternate_depth);
 
+/*
+ * Call the missing object callback for the given objects that are not
+ * in the database, so that they can be made available in a single
+ * batch before they are read.  Does nothing without a callback.
+ */
+int git_odb__fetch_missing(git_odb *db, const git_oid *ids, size_t count);
+
 /*
  * Hash a git_rawobj internally.
  * The `git_rawobj` is supposed to be previously initialized
  */
 int git_odb__hashobj(git_oid *id, git_rawobj *obj);
 
+/*
+ * Hash `n` git_rawobjs at once, writing the id of `objs[i]` to `ids[i]`.
+ * This is faster than hashing them one by one when there are many small
+ * objects.
+ */
+int git_odb__hashobj_many(git_oid *ids, git_rawobj *objs, size_t n);
+
 /*
  * Format the object header such as it would appear in the on-disk object
  */
@@ -126,6 +156,13 @@ int git_odb__read_header_or_object(
 	git_odb_object **out, size_t *len_p, git_object_t *type_p,
 	git_odb *db, const git_oid *id);
 
+/*
+ * Write an object whose id has already been computed, like
+ * `git_odb_write` does after hashing it.
+ */
+int git_odb__write_hashed(
+	git_odb *db, const git_oid *oid, const void *data, size_t len, git_object_t type);
+
 /* freshen an entry in the object database */
 int git_odb__freshen(git_odb *db, const git_oid *id);
 
@@ -16,6 +16,8 @@
 #include "delta.h"
 #include "filebuf.h"
 #include "object.h"
+#include "oidarray.h"
+#include "pack.h"
 #include "zstream.h"
 
 #include "git2/odb_backend.h"
@@ -43,6 +45,20 @@ typedef struct {
 	git_zstream zstream;
 } loose_readstream;
 
+/* The cached listing of one of the `objects/xx/` fanout directories */
+typedef struct {
+	git_futils_filestamp stamp;
+	git_array_oid_t ids; /* sorted */
+	bool loaded;
+	bool stale; /* the listing may be missing objects despite its stamp */
+} loose_cache_dir;
+
+/* The objects written since `begin_batch`, which are kept out of place */
+typedef struct {
+	git_buf dir; /* laid out like the objects directory */
+	git_array_oid_t ids;
+} loose_batch;
+
 typedef struct loose_backend {
 	git_odb_backend parent;
 
@@ -51,6 +67,12 @@ typedef struct loose_backend {
 	mode_t object_file_mode;
 	mode_t object_dir_mode;
 
+	git_mutex cache_lock;
+	loose_cache_dir *cache; /* 256 directories, or NULL when disabled */
+
+	git_mutex batch_lock;
+	loose_batch *batch;
+
 	size_t objects_dirlen;
 	char objects_dir[GIT_FLEX_ARRAY];
 } loose_backend;
@@ -75,18 +97,18 @@ typedef struct {
  *
  ***********************************************************/
 
-static int object_file_name(
-	git_buf *name, const loose_backend *be, const git_oid *id)
+static int object_path(
+	git_buf *name, const char *dir, size_t dirlen, const git_oid *id)
 {
 	size_t alloclen;
 
 	/* expand length for object root + 40 hex sha1 chars + 2 * '/' + '\0' */
-	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, be->objects_dirlen, GIT_OID_HEXSZ);
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, dirlen, GIT_OID_HEXSZ);
 	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 3);
 	if (git_buf_grow(name, alloclen) < 0)
 		return -1;
 
-	git_buf_set(name, be->objects_dir, be->objects_dirlen);
+	git_buf_set(name, dir, dirlen);
 	git_path_to_dir(name);
 
 	/* loose object filename: aa/aaa... (41 bytes) */
@@ -97,6 +119,12 @@ static int object_file_name(
 	return 0;
 }
 
+static int object_file_name(
+	git_buf *name, const loose_backend *be, const git_oid *id)
+{
+	return object_path(name, be->objects_dir, be->objects_dirlen, id);
+}
+
 static int object_mkdir(const git_buf *name, const loose_backend *be)
 {
 	return git_futils_mkdir_relative(
@@ -227,7 +255,7 @@ static int read_loose_packlike(git_rawobj *out, git_buf *obj)
 	git_buf body = GIT_BUF_INIT;
 	const unsigned char *obj_data;
 	obj_hdr hdr;
-	size_t obj_len, head_len, alloc_size;
+	size_t obj_len, head_len, alloc_size, in_used;
 	int error;
 
 	obj_data = (unsigned char *)obj->ptr;
@@ -258,8 +286,16 @@ static int read_loose_packlike(git_rawobj *out, git_buf *obj)
 		goto done;
 	}
 
-	if ((error = git_zstream_inflatebuf(&body, obj_data, obj_len)) < 0)
+	error = git_zstream_inflate_oneshot(body.ptr, hdr.size, &in_used, obj_data, obj_len);
+
+	if (error == 0 && in_used == obj_len) {
+		body.size = hdr.size;
+		body.ptr[body.size] = '\0';
+	} else if (error < 0 && error != GIT_PASSTHROUGH) {
 		goto done;
+	} else if ((error = git_zstream_inflatebuf(&body, obj_data, obj_len)) < 0) {
+		goto done;
+	}
 
 	out->len = hdr.size;
 	out->type = hdr.type;
@@ -274,7 +310,7 @@ static int read_loose_standard(git_rawobj *out, git_buf *obj)
 {
 	git_zstream zstream = GIT_ZSTREAM_INIT;
 	unsigned char head[MAX_HEADER_LEN], *body = NULL;
-	size_t decompressed, head_len, body_len, alloc_size;
+	size_t decompressed, head_len, body_len, inflated_len, alloc_size, in_used;
 	obj_hdr hdr;
 	int error;
 
@@ -301,28 +337,39 @@ static int read_loose_standard(git_rawobj *out, git_buf *obj)
 
 	/*
 	 * allocate a buffer and inflate the object data into it
-	 * (including the initial sequence in the head buffer).
+	 * (including the initial sequence in the head buffer).  There is
+	 * room for the header too, in case we can inflate it all at once.
 	 */
-	if (GIT_ADD_SIZET_OVERFLOW(&alloc_size, hdr.size, 1) ||
+	if (GIT_ADD_SIZET_OVERFLOW(&inflated_len, hdr.size, head_len) ||
+		GIT_ADD_SIZET_OVERFLOW(&alloc_size, inflated_len, 1) ||
 		(body = git__malloc(alloc_size)) == NULL) {
 		error = -1;
 		goto done;
 	}
 
-	assert(decompressed >= head_len);
-	body_len = decompressed - head_len;
-
-	if (body_len)
-		memcpy(body, head + head_len, body_len);
+	error = git_zstream_inflate_oneshot(body, inflated_len, &in_used,
+		git_buf_cstr(obj), git_buf_len(obj));
 
-	decompressed = hdr.size - body_len;
-	if ((error = git_zstream_get_output(body + body_len, &decompressed, &zstream)) < 0)
+	if (error == 0 && in_used == git_buf_len(obj)) {
+		memmove(body, body + head_len, hdr.size);
+	} else if (error < 0 && error != GIT_PASSTHROUGH) {
 		goto done;
+	} else {
+		assert(decompressed >= head_len);
+		body_len = decompressed - head_len;
 
-	if (!git_zstream_done(&zstream)) {
-		git_error_set(GIT_ERROR_ZLIB, "failed to finish zlib inflation: stream aborted prematurely");
-		error = -1;
-		goto done;
+		if (body_len)
+			memcpy(body, head + head_len, body_len);
+
+		decompressed = hdr.size - body_len;
+		if ((error = git_zstream_get_output(body + body_len, &decompressed, &zstream)) < 0)
+			goto done;
+
+		if (!git_zstream_done(&zstream)) {
+			git_error_set(GIT_ERROR_ZLIB, "failed to finish zlib inflation: stream aborted prematurely");
+			error = -1;
+			goto done;
+		}
 	}
 
 	body[hdr.size] = '\0';
@@ -443,6 +490,522 @@ done:
 	return error;
 }
 
+/***********************************************************
+ *
+ * FANOUT DIRECTORY CACHE
+ *
+ * With `GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE`, the listing of each
+ * fanout directory is read once and kept in memory, sorted, so that
+ * existence and prefix queries do not need to hit the filesystem.
+ *
+ * Loose objects never change and are only removed by pruning, so an
+ * object that is in a listing is taken to exist.  A listing is only
+ * revalidated, against the stamp of its directory, when it does not
+ * have what we are looking for.
+ *
+ ***********************************************************/
+
+bool git_odb__loose_object_cache = false;
+
+static int loose_cache_collect(void *payload, git_buf *path)
+{
+	git_array_oid_t *ids = payload;
+	const char *name;
+	git_oid *id;
+	char hex[GIT_OID_HEXSZ];
+	size_t i;
+
+	if (path->size < GIT_OID_HEXSZ + 1)
+		return 0;
+
+	/* Build the hex id from the last "xx/xxx..." of the path */
+	name = path->ptr + path->size - (GIT_OID_HEXSZ + 1);
+
+	if (name[2] != '/' || (path->size > GIT_OID_HEXSZ + 1 && name[-1] != '/'))
+		return 0;
+
+	memcpy(hex, name, 2);
+	memcpy(hex + 2, name + 3, GIT_OID_HEXSZ - 2);
+
+	/* Not an object; temporary files and the like */
+	for (i = 0; i < GIT_OID_HEXSZ; i++) {
+		if (git__fromhex(hex[i]) < 0)
+			return 0;
+	}
+
+	id = git_array_alloc(*ids);
+	GIT_ERROR_CHECK_ALLOC(id);
+
+	return git_oid_fromstrn(id, hex, GIT_OID_HEXSZ);
+}
+
+static int loose_cache_oid_cmp(const void *a, const void *b, void *payload)
+{
+	GIT_UNUSED(payload);
+	return git_oid_cmp(a, b);
+}
+
+/* Index of the first id in the listing that is not before `id`'s prefix */
+static size_t loose_cache_search(
+	loose_cache_dir *dir, const git_oid *id, size_t len)
+{
+	size_t lo = 0, hi = git_array_size(dir->ids);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (git_oid_ncmp(git_array_get(dir->ids, mid), id, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Get the listing of the fanout directory of `id`, (re)loading it if it
+ * has never been read or if `validate` is set and it has changed.
+ */
+static int loose_cache_dir_get(
+	loose_cache_dir **out,
+	loose_backend *backend,
+	const git_oid *id,
+	bool validate)
+{
+	loose_cache_dir *dir = &backend->cache[id->id[0]];
+	git_buf path = GIT_BUF_INIT;
+	int changed, error = 0;
+
+	*out = dir;
+
+	if (dir->loaded && !validate)
+		return 0;
+
+	if (git_buf_set(&path, backend->objects_dir, backend->objects_dirlen) < 0 ||
+	    git_buf_printf(&path, "%02x", id->id[0]) < 0)
+		return -1;
+
+	/* Take the stamp first so that later changes invalidate the listing */
+	changed = git_futils_filestamp_check(&dir->stamp, path.ptr);
+
+	if (changed == GIT_ENOTFOUND) {
+		git_futils_filestamp_set(&dir->stamp, NULL);
+		git_array_clear(dir->ids);
+		dir->loaded = true;
+		dir->stale = false;
+		goto done;
+	}
+
+	if (dir->loaded && !dir->stale && !changed)
+		goto done;
+
+	git_array_clear(dir->ids);
+	dir->loaded = false;
+
+	if ((error = git_path_direach(&path, 0, loose_cache_collect, &dir->ids)) < 0) {
+		git_array_clear(dir->ids);
+		git_futils_filestamp_set(&dir->stamp, NULL);
+		goto done;
+	}
+
+	git__qsort_r(dir->ids.ptr, git_array_size(dir->ids),
+		sizeof(git_oid), loose_cache_oid_cmp, NULL);
+
+	dir->loaded = true;
+
+	/*
+	 * An object added within the timestamp granularity of the
+	 * directory would not change its stamp; look again next time.
+	 */
+	dir->stale = (dir->stamp.mtime.tv_sec >= time(NULL));
+
+done:
+	git_buf_dispose(&path);
+	return error;
+}
+
+/*
+ * Find the objects in the cache that start with the `len` first hex
+ * digits of `id`: sets `found` to the number of matches (up to 2) and
+ * `out` to the first.
+ */
+static int loose_cache_find(
+	git_oid *out,
+	int *found,
+	loose_backend *backend,
+	const git_oid *id,
+	size_t len)
+{
+	loose_cache_dir *dir;
+	size_t pos;
+	int validate, error = 0;
+
+	if (git_mutex_lock(&backend->cache_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock loose object cache");
+		return -1;
+	}
+
+	*found = 0;
+
+	/*
+	 * A full id that is already listed needs no validation; anything
+	 * else could have been added since we read the listing.
+	 */
+	for (validate = (len < GIT_OID_HEXSZ); validate < 2; validate++) {
+		if ((error = loose_cache_dir_get(&dir, backend, id, validate)) < 0)
+			break;
+
+		pos = loose_cache_search(dir, id, len);
+
+		while (*found < 2 && pos < git_array_size(dir->ids) &&
+		       !git_oid_ncmp(git_array_get(dir->ids, pos), id, len)) {
+			if (!*found)
+				git_oid_cpy(out, git_array_get(dir->ids, pos));
+			(*found)++;
+			pos++;
+		}
+
+		if (*found)
+			break;
+	}
+
+	git_mutex_unlock(&backend->cache_lock);
+	return error;
+}
+
+/* Make sure that an object we have written is seen by the cache */
+static void loose_cache_invalidate(loose_backend *backend, const git_oid *id)
+{
+	if (!backend->cache || git_mutex_lock(&backend->cache_lock) < 0)
+		return;
+
+	backend->cache[id->id[0]].stale = true;
+	git_mutex_unlock(&backend->cache_lock);
+}
+
+static void loose_cache_free(loose_backend *backend)
+{
+	size_t i;
+
+	if (!backend->cache)
+		return;
+
+	for (i = 0; i < 256; i++)
+		git_array_clear(backend->cache[i].ids);
+
+	git__free(backend->cache);
+	git_mutex_free(&backend->cache_lock);
+}
+
+
+/***********************************************************
+ *
+ * BATCHED WRITES
+ *
+ * Between `begin_batch` and `end_batch`, objects are written to a
+ * quarantine directory that is laid out like the objects directory,
+ * without syncing each of them.  They are moved into place, or into
+ * a new packfile when there are many of them, when the batch ends.
+ *
+ ***********************************************************/
+
+size_t git_odb__loose_batch_pack_threshold = 100;
+
+static int batch_file_name(
+	git_buf *name, const loose_batch *batch, const git_oid *id)
+{
+	return object_path(name, batch->dir.ptr, batch->dir.size, id);
+}
+
+static int batch_lock(loose_backend *backend)
+{
+	if (git_mutex_lock(&backend->batch_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock loose object batch");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Move a written object into the batch, instead of into place */
+static int batch_add(
+	loose_backend *backend, git_filebuf *fbuf, const git_oid *oid)
+{
+	loose_batch *batch = backend->batch;
+	git_buf path = GIT_BUF_INIT;
+	git_oid *id;
+	int error;
+
+	if ((error = batch_file_name(&path, batch, oid)) < 0 ||
+	    (error = git_futils_mkdir_relative(path.ptr + batch->dir.size,
+		batch->dir.ptr, backend->object_dir_mode,
+		GIT_MKDIR_PATH | GIT_MKDIR_SKIP_LAST | GIT_MKDIR_VERIFY_DIR,
+		NULL)) < 0 ||
+	    (error = git_filebuf_commit_at(fbuf, path.ptr)) < 0 ||
+	    (error = batch_lock(backend)) < 0)
+		goto done;
+
+	id = git_array_alloc(batch->ids);
+
+	if (id)
+		git_oid_cpy(id, oid);
+	else
+		error = -1;
+
+	git_mutex_unlock(&backend->batch_lock);
+
+done:
+	git_buf_dispose(&path);
+	return error;
+}
+
+/*
+ * Find the objects in the batch that start with the `len` first hex
+ * digits of `short_oid`, adding their number to `found` like
+ * `loose_cache_find` does.  If `found` is already 1, `out` holds the
+ * object that was found elsewhere.
+ */
+static int batch_find(
+	git_oid *out,
+	int *found,
+	loose_backend *backend,
+	const git_oid *short_oid,
+	size_t len)
+{
+	git_oid *id;
+	size_t i;
+
+	if (batch_lock(backend) < 0)
+		return -1;
+
+	git_array_foreach(backend->batch->ids, i, id) {
+		if (git_oid_ncmp(id, short_oid, len) ||
+		    (*found && git_oid_equal(id, out)))
+			continue;
+
+		if (!*found)
+			git_oid_cpy(out, id);
+
+		if (++(*found) > 1)
+			break;
+	}
+
+	git_mutex_unlock(&backend->batch_lock);
+	return 0;
+}
+
+static int batch_foreach(
+	loose_backend *backend, git_odb_foreach_cb cb, void *payload)
+{
+	git_array_oid_t ids = GIT_ARRAY_INIT;
+	git_oid *id;
+	size_t i;
+	int error;
+
+	/* the callback may write objects itself */
+	if ((error = batch_lock(backend)) < 0)
+		return error;
+
+	git_array_foreach(backend->batch->ids, i, id) {
+		git_oid *copy = git_array_alloc(ids);
+
+		if (!copy) {
+			error = -1;
+			break;
+		}
+
+		git_oid_cpy(copy, id);
+	}
+
+	git_mutex_unlock(&backend->batch_lock);
+
+	git_array_foreach(ids, i, id) {
+		if (error < 0)
+			break;
+
+		error = git_error_set_after_callback_function(
+			cb(id, payload), "git_odb_foreach");
+	}
+
+	git_array_clear(ids);
+	return error;
+}
+
+static int batch_write_pack_data(
+	git_odb_writepack *writepack,
+	git_hash_ctx *ctx,
+	git_indexer_progress *stats,
+	const void *data,
+	size_t len)
+{
+	int error;
+
+	if ((error = git_hash_update(ctx, data, len)) < 0)
+		return error;
+
+	return writepack->append(writepack, data, len, stats);
+}
+
+/*
+ * Stream the objects of the batch, undeltified, into a new packfile
+ * that is indexed by the ODB's pack backend.  The indexer syncs the
+ * pack and its index, so the loose copies never need to be.
+ */
+static int batch_write_pack(loose_backend *backend, loose_batch *batch)
+{
+	git_odb_writepack *writepack = NULL;
+	git_indexer_progress stats = {0};
+	struct git_pack_header hdr;
+	git_buf path = GIT_BUF_INIT, zbuf = GIT_BUF_INIT;
+	unsigned char obj_hdr[10];
+	size_t obj_hdr_len, i;
+	git_hash_ctx ctx;
+	git_rawobj raw;
+	git_oid *id, trailer;
+	int error;
+
+	if (git_array_size(batch->ids) > UINT32_MAX) {
+		git_error_set(GIT_ERROR_ODB, "too many objects to pack");
+		return -1;
+	}
+
+	if ((error = git_hash_ctx_init(&ctx)) < 0)
+		return error;
+
+	if ((error = git_odb_write_pack(&writepack, backend->parent.odb, NULL, NULL)) < 0)
+		goto done;
+
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(2);
+	hdr.hdr_entries = htonl((uint32_t)git_array_size(batch->ids));
+
+	if ((error = batch_write_pack_data(writepack, &ctx, &stats, &hdr, sizeof(hdr))) < 0)
+		goto done;
+
+	git_array_foreach(batch->ids, i, id) {
+		if ((error = batch_file_name(&path, batch, id)) < 0 ||
+		    (error = read_loose(&raw, &path)) < 0)
+			goto done;
+
+		obj_hdr_len = git_packfile__object_header(obj_hdr, raw.len, raw.type);
+		error = git_zstream_deflatebuf(&zbuf, raw.data, raw.len);
+		git__free(raw.data);
+
+		if (error < 0 ||
+		    (error = batch_write_pack_data(writepack, &ctx, &stats, obj_hdr, obj_hdr_len)) < 0 ||
+		    (error = batch_write_pack_data(writepack, &ctx, &stats, zbuf.ptr, zbuf.size)) < 0)
+			goto done;
+
+		git_buf_clear(&zbuf);
+	}
+
+	if ((error = git_hash_final(&trailer, &ctx)) < 0 ||
+	    (error = writepack->append(writepack, trailer.id, GIT_OID_RAWSZ, &stats)) < 0)
+		goto done;
+
+	if ((error = writepack->commit(writepack, &stats)) == 0)
+		error = git_odb_refresh(backend->parent.odb);
+
+done:
+	if (writepack)
+		writepack->free(writepack);
+	git_hash_ctx_cleanup(&ctx);
+	git_buf_dispose(&path);
+	git_buf_dispose(&zbuf);
+	return error;
+}
+
+/*
+ * Make the objects of the batch durable with a single barrier, then
+ * rename them into place and sync the directories that they went to.
+ * An object that cannot be moved does not stop the others from being
+ * moved; it is left in the batch's directory, and the first error is
+ * returned.
+ */
+static int batch_move_objects(loose_backend *backend, loose_batch *batch)
+{
+	git_buf from = GIT_BUF_INIT, to = GIT_BUF_INIT;
+	git_error_state first_error = {0};
+	bool do_fsync = backend->fsync_object_files || git_repository__fsync_gitdir;
+	bool touched[256] = {0};
+	git_oid *id;
+	size_t i;
+	int error = 0, move_error;
+
+	/* without `syncfs`, each object was synced as it was written */
+	if (do_fsync && (error = git_futils_syncfs(batch->dir.ptr)) < 0)
+		goto done;
+
+	git_array_foreach(batch->ids, i, id) {
+		if ((move_error = batch_file_name(&from, batch, id)) == 0 &&
+		    (move_error = object_file_name(&to, backend, id)) == 0 &&
+		    (move_error = object_mkdir(&to, backend)) == 0 &&
+		    (move_error = p_rename(from.ptr, to.ptr)) < 0)
+			git_error_set(GIT_ERROR_OS, "failed to rename '%s' to '%s'", from.ptr, to.ptr);
+
+		if (move_error < 0) {
+			if (!error)
+				error = git_error_state_capture(&first_error, move_error);
+			continue;
+		}
+
+		touched[id->id[0]] = true;
+		loose_cache_invalidate(backend, id);
+	}
+
+	if (!do_fsync)
+		goto done;
+
+	/* sync the objects that were moved, even if some were not */
+	for (i = 0; i < 256; i++) {
+		if (!touched[i])
+			continue;
+
+		git_buf_set(&to, backend->objects_dir, backend->objects_dirlen);
+		git_buf_printf(&to, "%02x", (unsigned int)i);
+
+		if ((move_error = git_buf_oom(&to) ? -1 : git_futils_fsync_dir(to.ptr)) < 0 && !error)
+			error = move_error;
+	}
+
+	/* the fanout directories may be new */
+	if ((move_error = git_futils_fsync_dir(backend->objects_dir)) < 0 && !error)
+		error = move_error;
+
+done:
+	if (first_error.error_code)
+		git_error_state_restore(&first_error);
+
+	git_buf_dispose(&from);
+	git_buf_dispose(&to);
+	return error;
+}
+
+/* Sort the ids of the batch, dropping the objects written twice */
+static void batch_sort(loose_batch *batch)
+{
+	size_t i, j;
+
+	git__qsort_r(batch->ids.ptr, git_array_size(batch->ids),
+		sizeof(git_oid), loose_cache_oid_cmp, NULL);
+
+	for (i = 1, j = 0; i < git_array_size(batch->ids); i++) {
+		if (!git_oid_equal(&batch->ids.ptr[i], &batch->ids.ptr[j]))
+			git_oid_cpy(&batch->ids.ptr[++j], &batch->ids.ptr[i]);
+	}
+
+	batch->ids.size = j + 1;
+}
+
+static void batch_free(loose_batch *batch)
+{
+	git_buf_dispose(&batch->dir);
+	git_array_clear(batch->ids);
+	git__free(batch);
+}
+
+
 static int locate_object(
 	git_buf *object_location,
 	loose_backend *backend,
@@ -450,8 +1013,14 @@ static int locate_object(
 {
 	int error = object_file_name(object_location, backend, oid);
 
-	if (!error && !git_path_exists(object_location->ptr))
-		return GIT_ENOTFOUND;
+	if (!error && !git_path_exists(object_location->ptr)) {
+		if (backend->batch &&
+		    (error = batch_file_name(object_location, backend->batch, oid)) == 0 &&
+		    git_path_exists(object_location->ptr))
+			return 0;
+
+		return error < 0 ? error : GIT_ENOTFOUND;
+	}
 
 	return error;
 }
@@ -498,7 +1067,7 @@ static int locate_object_short_oid(
 	char *objects_dir = backend->objects_dir;
 	size_t dir_len = strlen(objects_dir), alloc_len;
 	loose_locate_object_state state;
-	int error;
+	int found, error;
 
 	/* prealloc memory for OBJ_DIR/xx/xx..38x..xx */
 	GIT_ERROR_CHECK_ALLOC_ADD(&alloc_len, dir_len, GIT_OID_HEXSZ);
@@ -512,27 +1081,41 @@ static int locate_object_short_oid(
 	/* save adjusted position at end of dir so it can be restored later */
 	dir_len = git_buf_len(object_location);
 
-	/* Convert raw oid to hex formatted oid */
-	git_oid_fmt((char *)state.short_oid, short_oid);
+	state.found = 0;
 
-	/* Explore OBJ_DIR/xx/ where xx is the beginning of hex formatted short oid */
-	if (git_buf_put(object_location, (char *)state.short_oid, 3) < 0)
-		return -1;
-	object_location->ptr[object_location->size - 1] = '/';
+	if (backend->cache) {
+		if ((error = loose_cache_find(res_oid, &state.found, backend, short_oid, len)) < 0)
+			return error;
+	} else {
+		/* Convert raw oid to hex formatted oid */
+		git_oid_fmt((char *)state.short_oid, short_oid);
 
-	/* Check that directory exists */
-	if (git_path_isdir(object_location->ptr) == false)
-		return git_odb__error_notfound("no matching loose object for prefix",
-			short_oid, len);
+		/* Explore OBJ_DIR/xx/ where xx is the beginning of hex formatted short oid */
+		if (git_buf_put(object_location, (char *)state.short_oid, 3) < 0)
+			return -1;
+		object_location->ptr[object_location->size - 1] = '/';
 
-	state.dir_len = git_buf_len(object_location);
-	state.short_oid_len = len;
-	state.found = 0;
+		state.dir_len = git_buf_len(object_location);
+		state.short_oid_len = len;
+
+		/* Explore directory to find a unique object matching short_oid */
+		if (git_path_isdir(object_location->ptr)) {
+			error = git_path_direach(
+				object_location, 0, fn_locate_object_short_oid, &state);
+			if (error < 0 && error != GIT_EAMBIGUOUS)
+				return error;
+		}
+
+		/* Convert obtained hex formatted oid to raw */
+		if (state.found == 1 &&
+		    (error = git_oid_fromstr(res_oid, (char *)state.res_oid)) < 0)
+			return error;
+	}
+
+	found = state.found;
 
-	/* Explore directory to find a unique object matching short_oid */
-	error = git_path_direach(
-		object_location, 0, fn_locate_object_short_oid, &state);
-	if (error < 0 && error != GIT_EAMBIGUOUS)
+	if (backend->batch && found < 2 &&
+	    (error = batch_find(res_oid, &state.found, backend, short_oid, len)) < 0)
 		return error;
 
 	if (!state.found)
@@ -542,10 +1125,9 @@ static int locate_object_short_oid(
 	if (state.found > 1)
 		return git_odb__error_ambiguous("multiple matches in loose objects");
 
-	/* Convert obtained hex formatted oid to raw */
-	error = git_oid_fromstr(res_oid, (char *)state.res_oid);
-	if (error)
-		return error;
+	/* The only match is one that has not been moved into place yet */
+	if (!found)
+		return batch_file_name(object_location, backend->batch, res_oid);
 
 	/* Update the location according to the oid obtained */
 	GIT_ERROR_CHECK_ALLOC_ADD(&alloc_len, dir_len, GIT_OID_HEXSZ);
@@ -664,14 +1246,21 @@ static int loose_backend__read_prefix(
 	return error;
 }
 
-static int loose_backend__exists(git_odb_backend *backend, const git_oid *oid)
+static int loose_backend__exists(git_odb_backend *_backend, const git_oid *oid)
 {
+	loose_backend *backend = (loose_backend *)_backend;
 	git_buf object_path = GIT_BUF_INIT;
-	int error;
+	git_oid found_oid;
+	int found, error;
 
 	assert(backend && oid);
 
-	error = locate_object(&object_path, (loose_backend *)backend, oid);
+	if (backend->cache &&
+	    loose_cache_find(&found_oid, &found, backend, oid, GIT_OID_HEXSZ) == 0 &&
+	    (found || !backend->batch))
+		return found;
+
+	error = locate_object(&object_path, backend, oid);
 
 	git_buf_dispose(&object_path);
 
@@ -775,6 +1364,9 @@ static int loose_backend__foreach(git_odb_backend *_backend, git_odb_foreach_cb
 
 	error = git_path_direach(&buf, 0, foreach_cb, &state);
 
+	if (!error && backend->batch)
+		error = batch_foreach(backend, cb, data);
+
 	git_buf_dispose(&buf);
 
 	return error;
@@ -787,13 +1379,16 @@ static int loose_backend__writestream_finalize(git_odb_stream *_stream, const gi
 	git_buf final_path = GIT_BUF_INIT;
 	int error = 0;
 
-	if (object_file_name(&final_path, backend, oid) < 0 ||
+	if (backend->batch)
+		error = batch_add(backend, &stream->fbuf, oid);
+	else if (object_file_name(&final_path, backend, oid) < 0 ||
 		object_mkdir(&final_path, backend) < 0)
 		error = -1;
 	else
 		error = git_filebuf_commit_at(
 			&stream->fbuf, final_path.ptr);
 
+	loose_cache_invalidate(backend, oid);
 	git_buf_dispose(&final_path);
 
 	return error;
@@ -818,8 +1413,13 @@ static int filebuf_flags(loose_backend *backend)
 	int flags = GIT_FILEBUF_TEMPORARY |
 		(backend->object_zlib_level << GIT_FILEBUF_DEFLATE_SHIFT);
 
-	if (backend->fsync_object_files || git_repository__fsync_gitdir)
+	if (backend->fsync_object_files || git_repository__fsync_gitdir) {
+#ifdef GIT_USE_SYNCFS
+		/* the objects of a batch are synced together when it ends */
+		if (!backend->batch)
+#endif
 		flags |= GIT_FILEBUF_FSYNC;
+	}
 
 	return flags;
 }
@@ -1077,11 +1677,15 @@ static int loose_backend__write(git_odb_backend *_backend, const git_oid *oid, c
 	git_filebuf_write(&fbuf, header, header_len);
 	git_filebuf_write(&fbuf, data, len);
 
-	if (object_file_name(&final_path, backend, oid) < 0 ||
+	if (backend->batch)
+		error = batch_add(backend, &fbuf, oid);
+	else if (object_file_name(&final_path, backend, oid) < 0 ||
 		object_mkdir(&final_path, backend) < 0 ||
 		git_filebuf_commit_at(&fbuf, final_path.ptr) < 0)
 		error = -1;
 
+	loose_cache_invalidate(backend, oid);
+
 cleanup:
 	if (error < 0)
 		git_filebuf_cleanup(&fbuf);
@@ -1101,17 +1705,106 @@ static int loose_backend__freshen(
 		return -1;
 
 	error = git_futils_touch(path.ptr, NULL);
+
+	/* the objects of the batch were just written */
+	if (error < 0 && backend->batch &&
+	    batch_file_name(&path, backend->batch, oid) == 0 &&
+	    git_path_exists(path.ptr))
+		error = 0;
+
 	git_buf_dispose(&path);
 
 	return error;
 }
 
+static int loose_backend__begin_batch(git_odb_backend *_backend)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	loose_batch *batch;
+	git_buf path = GIT_BUF_INIT;
+	int fd, error = -1;
+
+	assert(backend && !backend->batch);
+
+	batch = git__calloc(1, sizeof(loose_batch));
+	GIT_ERROR_CHECK_ALLOC(batch);
+
+	/* reserve a unique name for the batch's directory */
+	if (git_buf_joinpath(&path, backend->objects_dir, "tmp_batch") < 0 ||
+	    (fd = git_futils_mktmp(&batch->dir, path.ptr, backend->object_file_mode)) < 0)
+		goto done;
+
+	p_close(fd);
+
+	if (p_unlink(batch->dir.ptr) < 0 ||
+	    p_mkdir(batch->dir.ptr, backend->object_dir_mode) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to create batch directory '%s'", batch->dir.ptr);
+		goto done;
+	}
+
+	if (git_path_to_dir(&batch->dir) < 0)
+		goto done;
+
+	backend->batch = batch;
+	error = 0;
+
+done:
+	if (error < 0)
+		batch_free(batch);
+	git_buf_dispose(&path);
+	return error;
+}
+
+static int loose_backend__end_batch(git_odb_backend *_backend, int success)
+{
+	loose_backend *backend = (loose_backend *)_backend;
+	loose_batch *batch;
+	int error = 0;
+
+	assert(backend && backend->batch);
+
+	batch = backend->batch;
+	backend->batch = NULL;
+
+	if (success && git_array_size(batch->ids) > 0) {
+		batch_sort(batch);
+
+		/*
+		 * Many objects are better off in a pack; if one cannot be
+		 * written, they are still moved into place.
+		 */
+		if (git_array_size(batch->ids) >= git_odb__loose_batch_pack_threshold &&
+		    batch_write_pack(backend, batch) == 0)
+			goto done;
+
+		git_error_clear();
+		error = batch_move_objects(backend, batch);
+	}
+
+done:
+	/*
+	 * Objects that could not be moved into place are kept in the
+	 * batch's directory, rather than lost with it.
+	 */
+	if (git_futils_rmdir_r(batch->dir.ptr, NULL,
+			error < 0 ? GIT_RMDIR_SKIP_NONEMPTY : GIT_RMDIR_REMOVE_FILES) < 0 && !error)
+		error = -1;
+
+	batch_free(batch);
+	return error;
+}
+
 static void loose_backend__free(git_odb_backend *_backend)
 {
 	loose_backend *backend;
 	assert(_backend);
 	backend = (loose_backend *)_backend;
 
+	if (backend->batch)
+		loose_backend__end_batch(_backend, false);
+
+	loose_cache_free(backend);
+	git_mutex_free(&backend->batch_lock);
 	git__free(backend);
 }
 
@@ -1155,6 +1848,24 @@ int git_odb_backend_loose(
 	backend->object_dir_mode = dir_mode;
 	backend->object_file_mode = file_mode;
 
+	if (git_mutex_init(&backend->batch_lock) < 0) {
+		git__free(backend);
+		git_error_set_oom();
+		return -1;
+	}
+
+	if (git_odb__loose_object_cache) {
+		backend->cache = git__calloc(256, sizeof(loose_cache_dir));
+
+		if (!backend->cache || git_mutex_init(&backend->cache_lock) < 0) {
+			git__free(backend->cache);
+			git_mutex_free(&backend->batch_lock);
+			git__free(backend);
+			git_error_set_oom();
+			return -1;
+		}
+	}
+
 	backend->parent.read = &loose_backend__read;
 	backend->parent.write = &loose_backend__write;
 	backend->parent.read_prefix = &loose_backend__read_prefix;
@@ -1165,6 +1876,8 @@ int git_odb_backend_loose(
 	backend->parent.exists_prefix = &loose_backend__exists_prefix;
 	backend->parent.foreach = &loose_backend__foreach;
 	backend->parent.freshen = &loose_backend__freshen;
+	backend->parent.begin_batch = &loose_backend__begin_batch;
+	backend->parent.end_batch = &loose_backend__end_batch;
 	backend->parent.free = &loose_backend__free;
 
 	*backend_out = (git_odb_backend *)backend;
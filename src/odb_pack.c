@@ -18,6 +18,7 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "pack.h"
+#include "array.h"
 
 #include "git2/odb_backend.h"
 
@@ -408,6 +409,252 @@ static int pack_backend__read(
 	return 0;
 }
 
+typedef struct {
+	struct git_pack_file *p;
+	off64_t offset;
+	size_t idx;
+} pack_read_request;
+
+static int pack_read_request_cmp(const void *a_, const void *b_, void *payload)
+{
+	const pack_read_request *a = a_, *b = b_;
+
+	GIT_UNUSED(payload);
+
+	if (a->p != b->p)
+		return git__strcmp(a->p->pack_name, b->p->pack_name);
+
+	return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+unsigned int git_odb__read_many_threads = 1;
+
+#ifdef GIT_THREADS
+
+/* How many objects the threads may inflate ahead of the callback */
+#define READ_MANY_WINDOW 64
+
+typedef struct {
+	git_rawobj raw;
+	git_error_state error;
+	bool ready;
+} pack_read_result;
+
+/*
+ * The threads take the requests in order, so that objects which are
+ * close in the pack are inflated at about the same time and share the
+ * bases in its delta base cache; the callback is still called on the
+ * caller's thread, in that order.
+ */
+typedef struct {
+	pack_read_request *requests;
+	pack_read_result *results;
+	size_t count;
+
+	git_mutex lock;
+	git_cond cond;
+	size_t next;
+	size_t delivered;
+	bool stop;
+} pack_read_pool;
+
+static void *pack_read_worker(void *payload)
+{
+	pack_read_pool *pool = payload;
+	pack_read_result *result;
+	git_rawobj raw;
+	off64_t offset;
+	size_t i;
+	int error;
+
+	git_mutex_lock(&pool->lock);
+
+	while (!pool->stop && pool->next < pool->count) {
+		if (pool->next >= pool->delivered + READ_MANY_WINDOW) {
+			git_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+
+		i = pool->next++;
+		git_mutex_unlock(&pool->lock);
+
+		offset = pool->requests[i].offset;
+		error = git_packfile_unpack(&raw, pool->requests[i].p, &offset);
+
+		git_mutex_lock(&pool->lock);
+
+		result = &pool->results[i];
+		if (error < 0)
+			git_error_state_capture(&result->error, error);
+		else
+			result->raw = raw;
+		result->ready = true;
+
+		git_cond_broadcast(&pool->cond);
+	}
+
+	git_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+static int pack_read_many_threaded(
+	pack_read_request *requests,
+	size_t count,
+	unsigned int nr_threads,
+	git_odb_backend_read_cb cb,
+	void *payload)
+{
+	pack_read_pool pool = {0};
+	git_thread *threads;
+	unsigned int started = 0;
+	size_t i;
+	int error = 0;
+
+	pool.requests = requests;
+	pool.count = count;
+	pool.results = git__calloc(count, sizeof(pack_read_result));
+	threads = git__calloc(nr_threads, sizeof(git_thread));
+
+	if (!pool.results || !threads) {
+		git__free(pool.results);
+		git__free(threads);
+		return -1;
+	}
+
+	git_mutex_init(&pool.lock);
+	git_cond_init(&pool.cond);
+
+	for (started = 0; started < nr_threads; started++) {
+		if (git_thread_create(&threads[started], pack_read_worker, &pool) != 0) {
+			git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+			error = -1;
+			goto done;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		pack_read_result *result = &pool.results[i];
+
+		git_mutex_lock(&pool.lock);
+		while (!result->ready)
+			git_cond_wait(&pool.cond, &pool.lock);
+		git_mutex_unlock(&pool.lock);
+
+		if (result->error.error_code < 0) {
+			error = result->error.error_code;
+			git_error_state_restore(&result->error);
+			break;
+		}
+
+		error = cb(requests[i].idx, result->raw.data, result->raw.len,
+			result->raw.type, payload);
+		result->raw.data = NULL;
+
+		if (error)
+			break;
+
+		git_mutex_lock(&pool.lock);
+		pool.delivered = i + 1;
+		git_cond_broadcast(&pool.cond);
+		git_mutex_unlock(&pool.lock);
+	}
+
+done:
+	git_mutex_lock(&pool.lock);
+	pool.stop = true;
+	git_cond_broadcast(&pool.cond);
+	git_mutex_unlock(&pool.lock);
+
+	while (started > 0)
+		git_thread_join(&threads[--started], NULL);
+
+	/* Drop what was inflated but not handed to the callback */
+	for (i = 0; i < count; i++) {
+		git__free(pool.results[i].raw.data);
+		git_error_state_free(&pool.results[i].error);
+	}
+
+	git_cond_free(&pool.cond);
+	git_mutex_free(&pool.lock);
+	git__free(pool.results);
+	git__free(threads);
+	return error;
+}
+
+#endif
+
+/*
+ * Look all the objects up first and then unpack them in the order they
+ * are stored in each pack.  Deltas usually follow their bases, so bases
+ * that are shared between several requested objects stay in the pack's
+ * delta base cache and are only inflated once.
+ */
+static int pack_backend__read_many(
+	git_odb_backend *backend,
+	const git_oid *ids,
+	size_t count,
+	git_odb_backend_read_cb cb,
+	void *payload)
+{
+	git_array_t(pack_read_request) requests = GIT_ARRAY_INIT;
+	pack_read_request *req;
+	struct git_pack_entry e;
+	git_rawobj raw;
+	off64_t offset;
+	unsigned int nr_threads;
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < count; i++) {
+		if ((error = pack_entry_find(&e, (struct pack_backend *)backend, &ids[i])) < 0) {
+			if (error != GIT_ENOTFOUND)
+				goto done;
+
+			git_error_clear();
+			error = 0;
+			continue;
+		}
+
+		if ((req = git_array_alloc(requests)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		req->p = e.p;
+		req->offset = e.offset;
+		req->idx = i;
+	}
+
+	git__qsort_r(requests.ptr, requests.size, sizeof(pack_read_request),
+		pack_read_request_cmp, NULL);
+
+#ifdef GIT_THREADS
+	if ((nr_threads = git_odb__read_many_threads) == 0)
+		nr_threads = git_online_cpus();
+
+	if (nr_threads > requests.size)
+		nr_threads = (unsigned int)requests.size;
+
+	if (nr_threads > 1) {
+		error = pack_read_many_threaded(requests.ptr, requests.size,
+			nr_threads, cb, payload);
+		goto done;
+	}
+#endif
+
+	git_array_foreach(requests, i, req) {
+		offset = req->offset;
+
+		if ((error = git_packfile_unpack(&raw, req->p, &offset)) < 0 ||
+		    (error = cb(req->idx, raw.data, raw.len, raw.type, payload)) != 0)
+			break;
+	}
+
+done:
+	git_array_clear(requests);
+	return error;
+}
+
 static int pack_backend__read_prefix(
 	git_oid *out_oid,
 	void **buffer_p,
@@ -532,6 +779,11 @@ static int pack_backend__writepack(struct git_odb_writepack **out,
 
 	backend = (struct pack_backend *)_backend;
 
+	if (!backend->pack_folder) {
+		git_error_set(GIT_ERROR_ODB, "cannot write pack - no pack directory");
+		return -1;
+	}
+
 	writepack = git__calloc(1, sizeof(struct pack_writepack));
 	GIT_ERROR_CHECK_ALLOC(writepack);
 
@@ -583,6 +835,7 @@ static int pack_backend__alloc(struct pack_backend **out, size_t initial_size)
 	backend->parent.version = GIT_ODB_BACKEND_VERSION;
 
 	backend->parent.read = &pack_backend__read;
+	backend->parent.read_many = &pack_backend__read_many;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.read_header = &pack_backend__read_header;
 	backend->parent.exists = &pack_backend__exists;
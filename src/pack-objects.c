@@ -17,6 +17,9 @@
 #include "util.h"
 #include "revwalk.h"
 #include "commit_list.h"
+#include "mwindow.h"
+#include "offmap.h"
+#include "path.h"
 
 #include "git2/pack.h"
 #include "git2/commit.h"
@@ -45,6 +48,7 @@ struct walk_object {
 	git_oid id;
 	unsigned int uninteresting:1,
 		seen:1;
+	unsigned int depth; /* shallowest depth a tree was inserted at */
 };
 
 #ifdef GIT_THREADS
@@ -221,6 +225,9 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 	if (git_oidmap_exists(pb->object_ix, oid))
 		return 0;
 
+	if (pb->skip_cb && pb->skip_cb(oid, pb->skip_cb_payload))
+		return 0;
+
 	if (pb->nr_objects >= pb->nr_alloc) {
 		GIT_ERROR_CHECK_ALLOC_ADD(&newsize, pb->nr_alloc, 1024);
 		GIT_ERROR_CHECK_ALLOC_MULTIPLY(&newsize, newsize / 2, 3);
@@ -276,6 +283,42 @@ int git_packbuilder_insert(git_packbuilder *pb, const git_oid *oid,
 	return 0;
 }
 
+/* Read the delta that we reuse from its pack */
+static int get_reused_delta(void **out, git_pobject *po)
+{
+	git_packfile_stream stream;
+	char *delta_buf;
+	size_t len = 0;
+	ssize_t read;
+	int error;
+
+	*out = NULL;
+
+	if ((error = git_packfile_stream_open(&stream, po->reuse_pack, po->reuse_offset)) < 0)
+		return error;
+
+	delta_buf = git__malloc(po->delta_size ? po->delta_size : 1);
+	GIT_ERROR_CHECK_ALLOC(delta_buf);
+
+	while (len < po->delta_size) {
+		if ((read = git_packfile_stream_read(&stream, delta_buf + len, po->delta_size - len)) <= 0)
+			break;
+
+		len += (size_t)read;
+	}
+
+	git_packfile_stream_dispose(&stream);
+
+	if (len != po->delta_size) {
+		git_error_set(GIT_ERROR_ODB, "failed to read the delta of '%s'", po->reuse_pack->pack_name);
+		git__free(delta_buf);
+		return -1;
+	}
+
+	*out = delta_buf;
+	return 0;
+}
+
 static int get_delta(void **out, git_odb *odb, git_pobject *po)
 {
 	git_odb_object *src = NULL, *trg = NULL;
@@ -285,6 +328,9 @@ static int get_delta(void **out, git_odb *odb, git_pobject *po)
 
 	*out = NULL;
 
+	if (po->reuse_pack)
+		return get_reused_delta(out, po);
+
 	if (git_odb_read(&src, odb, &po->delta->id) < 0 ||
 	    git_odb_read(&trg, odb, &po->id) < 0)
 		goto on_error;
@@ -624,6 +670,28 @@ static git_pobject **compute_write_order(git_packbuilder *pb)
 	return wo;
 }
 
+static int write_pack_header(git_packbuilder *pb,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	struct git_pack_header ph;
+	int error;
+
+	if (!git__is_uint32(pb->nr_objects)) {
+		git_error_set(GIT_ERROR_INVALID, "too many objects");
+		return -1;
+	}
+
+	ph.hdr_signature = htonl(PACK_SIGNATURE);
+	ph.hdr_version = htonl(PACK_VERSION);
+	ph.hdr_entries = htonl(pb->nr_objects);
+
+	if ((error = write_cb(&ph, sizeof(ph), cb_data)) < 0)
+		return error;
+
+	return git_hash_update(&pb->ctx, &ph, sizeof(ph));
+}
+
 static int write_pack(git_packbuilder *pb,
 	int (*write_cb)(void *buf, size_t size, void *cb_data),
 	void *cb_data)
@@ -631,7 +699,6 @@ static int write_pack(git_packbuilder *pb,
 	git_pobject **write_order;
 	git_pobject *po;
 	enum write_one_status status;
-	struct git_pack_header ph;
 	git_oid entry_oid;
 	size_t i = 0;
 	int error = 0;
@@ -640,18 +707,7 @@ static int write_pack(git_packbuilder *pb,
 	if (write_order == NULL)
 		return -1;
 
-	if (!git__is_uint32(pb->nr_objects)) {
-		git_error_set(GIT_ERROR_INVALID, "too many objects");
-		return -1;
-	}
-
-	/* Write pack header */
-	ph.hdr_signature = htonl(PACK_SIGNATURE);
-	ph.hdr_version = htonl(PACK_VERSION);
-	ph.hdr_entries = htonl(pb->nr_objects);
-
-	if ((error = write_cb(&ph, sizeof(ph), cb_data)) < 0 ||
-		(error = git_hash_update(&pb->ctx, &ph, sizeof(ph))) < 0)
+	if ((error = write_pack_header(pb, write_cb, cb_data)) < 0)
 		goto done;
 
 	pb->nr_remaining = pb->nr_objects;
@@ -1309,6 +1365,169 @@ static int ll_find_deltas(git_packbuilder *pb, git_pobject **list,
 #define ll_find_deltas(pb, l, ls, w, d) find_deltas(pb, l, &ls, w, d)
 #endif
 
+/*
+ * Whether to search a delta for the object, which is within our size
+ * limits.  The objects of the deltas we reuse are left alone, so that
+ * the deltas we find cannot make a cycle with them.
+ */
+GIT_INLINE(bool) delta_candidate(git_packbuilder *pb, git_pobject *po)
+{
+	return po->size >= 50 && po->size <= pb->big_file_threshold &&
+	       !po->reuse_pack && !po->reused_base;
+}
+
+typedef struct {
+	struct git_pack_file *pack;
+	git_offmap *objects; /* the objects we take from this pack, by offset */
+} reuse_pack;
+
+static int load_reuse_packs(git_vector *out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_vector names = GIT_VECTOR_INIT;
+	reuse_pack *rp;
+	const char *name;
+	size_t i, path_len;
+	int error;
+
+	if ((error = git_repository_item_path(&path, repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&path, path.ptr, "pack/")) < 0)
+		goto done;
+
+	if (!git_path_isdir(path.ptr))
+		goto done;
+
+	path_len = git_buf_len(&path);
+
+	if ((error = git_path_dirload(&names, path.ptr, path_len, 0)) < 0)
+		goto done;
+
+	git_vector_foreach(&names, i, name) {
+		if (git__suffixcmp(name, ".idx") != 0)
+			continue;
+
+		git_buf_truncate(&path, path_len);
+		if ((error = git_buf_puts(&path, name)) < 0)
+			goto done;
+
+		rp = git__calloc(1, sizeof(reuse_pack));
+		GIT_ERROR_CHECK_ALLOC(rp);
+
+		if ((error = git_offmap_new(&rp->objects)) < 0 ||
+		    (error = git_vector_insert(out, rp)) < 0) {
+			git_offmap_free(rp->objects);
+			git__free(rp);
+			goto done;
+		}
+
+		/* A pack which went away is just not reused */
+		if (git_mwindow_get_pack(&rp->pack, path.ptr) < 0)
+			git_error_clear();
+	}
+
+done:
+	git_vector_free_deep(&names);
+	git_buf_dispose(&path);
+	return error;
+}
+
+/*
+ * Reuse the delta of the object if its base is also one of ours.  An
+ * entry we cannot read is simply packed again.
+ */
+static void reuse_delta(git_packbuilder *pb, reuse_pack *rp, git_pobject *po, off64_t offset)
+{
+	git_mwindow *w = NULL;
+	git_object_t type;
+	git_pobject *base;
+	off64_t curpos = offset, base_offset;
+	size_t size;
+
+	if (git_packfile_unpack_header(&size, &type, &rp->pack->mwf, &w, &curpos) < 0 ||
+	    (type != GIT_OBJECT_OFS_DELTA && type != GIT_OBJECT_REF_DELTA) ||
+	    (base_offset = get_delta_base(rp->pack, &w, &curpos, type, offset)) <= 0 ||
+	    (base = git_offmap_get(rp->objects, base_offset)) == NULL ||
+	    base == po)
+		goto done;
+
+	po->delta = base;
+	po->delta_size = size;
+	po->reuse_pack = rp->pack;
+	po->reuse_offset = curpos;
+	base->reused_base = 1;
+	pb->nr_reused++;
+
+done:
+	git_mwindow_close(&w);
+	git_error_clear();
+}
+
+/*
+ * Take every object from the first pack that has it, and reuse the
+ * deltas whose bases we take from the same pack.  The deltas of a pack
+ * cannot make a cycle.
+ */
+static int reuse_deltas(git_packbuilder *pb)
+{
+	struct git_pack_entry e;
+	reuse_pack *rp, **taken = NULL;
+	off64_t *offsets = NULL;
+	size_t i, j;
+	int error;
+
+	if (!pb->reuse_deltas || pb->deltas_reused)
+		return 0;
+
+	pb->deltas_reused = true;
+
+	if ((error = load_reuse_packs(&pb->reuse_packs, pb->repo)) < 0 ||
+	    !pb->reuse_packs.length)
+		return error;
+
+	taken = git__calloc(pb->nr_objects, sizeof(reuse_pack *));
+	offsets = git__calloc(pb->nr_objects, sizeof(off64_t));
+
+	if (!taken || !offsets) {
+		git_error_set_oom();
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		git_pobject *po = pb->object_list + i;
+
+		git_vector_foreach(&pb->reuse_packs, j, rp) {
+			if (!rp->pack || git_pack_entry_find(&e, rp->pack, &po->id, GIT_OID_HEXSZ) < 0)
+				continue;
+
+			if ((error = git_offmap_set(rp->objects, e.offset, po)) < 0)
+				goto done;
+
+			taken[i] = rp;
+			offsets[i] = e.offset;
+			break;
+		}
+	}
+
+	git_error_clear();
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		if (taken[i])
+			reuse_delta(pb, taken[i], pb->object_list + i, offsets[i]);
+	}
+
+done:
+	/* Only the packs are needed from now on */
+	git_vector_foreach(&pb->reuse_packs, j, rp) {
+		git_offmap_free(rp->objects);
+		rp->objects = NULL;
+	}
+
+	git__free(taken);
+	git__free(offsets);
+	return error;
+}
+
 static int prepare_pack(git_packbuilder *pb)
 {
 	git_pobject **delta_list;
@@ -1317,6 +1536,9 @@ static int prepare_pack(git_packbuilder *pb)
 	if (pb->nr_objects == 0 || pb->done)
 		return 0; /* nothing to do */
 
+	if (reuse_deltas(pb) < 0)
+		return -1;
+
 	/*
 	 * Although we do not report progress during deltafication, we
 	 * at least report that we are in the deltafication stage
@@ -1330,8 +1552,7 @@ static int prepare_pack(git_packbuilder *pb)
 	for (i = 0; i < pb->nr_objects; ++i) {
 		git_pobject *po = pb->object_list + i;
 
-		/* Make sure the item is within our size limits */
-		if (po->size < 50 || po->size > pb->big_file_threshold)
+		if (!delta_candidate(pb, po))
 			continue;
 
 		delta_list[n++] = po;
@@ -1354,19 +1575,391 @@ static int prepare_pack(git_packbuilder *pb)
 	return 0;
 }
 
-#define PREPARE_PACK if (prepare_pack(pb) < 0) { return -1; }
+#ifdef GIT_THREADS
+
+/*
+ * With more than one thread, the pack is streamed: the objects which
+ * are no delta candidates are written while the deltas are searched,
+ * and the threads then compress the other objects ahead of the writer,
+ * which writes them in the same order as `write_pack`.
+ */
+
+/* How many objects each thread may compress ahead of the writer */
+#define COMPRESS_AHEAD 8
+
+struct prepare_params {
+	git_thread thread;
+	git_packbuilder *pb;
+
+	int error;
+	git_error_state error_state;
+};
+
+typedef struct {
+	git_buf data;
+	int error;
+	git_error_state error_state;
+	unsigned int ready : 1;
+} compressed_object;
+
+struct compress_params {
+	git_packbuilder *pb;
+
+	git_pobject **objects;
+	compressed_object *compressed;
+	size_t nr_objects;
+
+	git_mutex mutex;
+	git_cond ready_cond; /* signalled when an object is compressed */
+	git_cond space_cond; /* signalled when an object is written */
+
+	/* Protected by the mutex */
+	size_t next;
+	size_t written;
+	size_t ahead;
+	bool stop;
+};
+
+static void *threaded_prepare_pack(void *arg)
+{
+	struct prepare_params *p = arg;
+
+	if ((p->error = prepare_pack(p->pb)) < 0)
+		git_error_state_capture(&p->error_state, p->error);
+
+	return NULL;
+}
+
+/*
+ * Append the entry of the object to the buffer, compressed; this is
+ * what `write_object` writes.
+ */
+static int compress_object(git_buf *out, git_packbuilder *pb, git_pobject *po)
+{
+	git_odb_object *obj = NULL;
+	git_object_t type;
+	unsigned char hdr[10];
+	void *data = NULL;
+	size_t hdr_len, data_len;
+	int error;
+
+	if (po->delta) {
+		if (po->delta_data)
+			data = po->delta_data;
+		else if ((error = get_delta(&data, pb->odb, po)) < 0)
+			goto done;
+
+		data_len = po->delta_size;
+		type = GIT_OBJECT_REF_DELTA;
+	} else {
+		if ((error = git_odb_read(&obj, pb->odb, &po->id)) < 0)
+			goto done;
+
+		data = (void *)git_odb_object_data(obj);
+		data_len = git_odb_object_size(obj);
+		type = git_odb_object_type(obj);
+	}
+
+	hdr_len = git_packfile__object_header(hdr, data_len, type);
+	git_buf_put(out, (char *)hdr, hdr_len);
+
+	if (type == GIT_OBJECT_REF_DELTA)
+		git_buf_put(out, (char *)po->delta->id.id, GIT_OID_RAWSZ);
+
+	if (po->z_delta_size)
+		git_buf_put(out, data, po->z_delta_size);
+	else if ((error = git_zstream_deflatebuf(out, data, data_len)) < 0)
+		goto done;
+
+	error = git_buf_oom(out) ? -1 : 0;
+
+done:
+	if (po->delta) {
+		git__free(data);
+		po->delta_data = NULL;
+	}
+
+	git_odb_object_free(obj);
+	return error;
+}
+
+static void *threaded_compress(void *arg)
+{
+	struct compress_params *p = arg;
+	compressed_object *compressed;
+	git_pobject *po;
+	int error;
+
+	git_mutex_lock(&p->mutex);
+
+	while (!p->stop && p->next < p->nr_objects) {
+		if (p->next >= p->written + p->ahead) {
+			git_cond_wait(&p->space_cond, &p->mutex);
+			continue;
+		}
+
+		compressed = &p->compressed[p->next];
+		po = p->objects[p->next++];
+		git_mutex_unlock(&p->mutex);
+
+		if ((error = compress_object(&compressed->data, p->pb, po)) < 0)
+			git_error_state_capture(&compressed->error_state, error);
+
+		git_mutex_lock(&p->mutex);
+		compressed->error = error;
+		compressed->ready = 1;
+		git_cond_broadcast(&p->ready_cond);
+	}
+
+	git_mutex_unlock(&p->mutex);
+	return NULL;
+}
+
+/* Write the compressed objects in order, as the threads compress them */
+static int write_compressed(
+	struct compress_params *p,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	compressed_object *compressed;
+	size_t i;
+	int error = 0;
+
+	for (i = 0; i < p->nr_objects; i++) {
+		compressed = &p->compressed[i];
+
+		git_mutex_lock(&p->mutex);
+		while (!compressed->ready)
+			git_cond_wait(&p->ready_cond, &p->mutex);
+		git_mutex_unlock(&p->mutex);
+
+		if ((error = compressed->error) < 0) {
+			git_error_state_restore(&compressed->error_state);
+			break;
+		}
+
+		if ((error = write_cb(compressed->data.ptr, compressed->data.size, cb_data)) < 0 ||
+		    (error = git_hash_update(&p->pb->ctx, compressed->data.ptr, compressed->data.size)) < 0)
+			break;
+
+		git_buf_dispose(&compressed->data);
+		p->pb->nr_written++;
+
+		git_mutex_lock(&p->mutex);
+		p->written = i + 1;
+		git_cond_broadcast(&p->space_cond);
+		git_mutex_unlock(&p->mutex);
+	}
+
+	git_mutex_lock(&p->mutex);
+	p->stop = true;
+	git_cond_broadcast(&p->space_cond);
+	git_mutex_unlock(&p->mutex);
+
+	return error;
+}
+
+/* Schedule the object like `write_one` writes it, after its delta base */
+static void schedule_one(
+	enum write_one_status *status,
+	git_pobject **out,
+	size_t *out_len,
+	git_pobject *po)
+{
+	if (po->recursing) {
+		*status = WRITE_ONE_RECURSIVE;
+		return;
+	} else if (po->written) {
+		*status = WRITE_ONE_SKIP;
+		return;
+	}
+
+	if (po->delta) {
+		po->recursing = 1;
+		schedule_one(status, out, out_len, po->delta);
+
+		/* we cannot depend on this one */
+		if (*status == WRITE_ONE_RECURSIVE)
+			po->delta = NULL;
+	}
+
+	*status = WRITE_ONE_WRITTEN;
+	po->written = 1;
+	po->recursing = 0;
+
+	out[(*out_len)++] = po;
+}
+
+static int write_objects_threaded(
+	git_packbuilder *pb,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	struct compress_params p = {0};
+	git_thread *threads = NULL;
+	git_pobject **write_order;
+	enum write_one_status status;
+	size_t i, started = 0;
+	int error = -1;
+
+	if ((write_order = compute_write_order(pb)) == NULL)
+		return -1;
+
+	p.pb = pb;
+	p.ahead = pb->nr_threads * COMPRESS_AHEAD;
+	p.objects = git__mallocarray(pb->nr_objects, sizeof(git_pobject *));
+	p.compressed = git__calloc(pb->nr_objects, sizeof(compressed_object));
+	threads = git__mallocarray(pb->nr_threads, sizeof(git_thread));
+
+	if (!p.objects || !p.compressed || !threads) {
+		git_error_set_oom();
+		goto done;
+	}
+
+	for (i = 0; i < pb->nr_objects; i++)
+		schedule_one(&status, p.objects, &p.nr_objects, write_order[i]);
+
+	if (git_mutex_init(&p.mutex) < 0) {
+		git_error_set(GIT_ERROR_THREAD, "unable to initialize the packbuilder mutex");
+		goto done;
+	}
+
+	git_cond_init(&p.ready_cond);
+	git_cond_init(&p.space_cond);
+
+	for (started = 0; started < pb->nr_threads; started++) {
+		if (git_thread_create(&threads[started], threaded_compress, &p) != 0) {
+			git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+			break;
+		}
+	}
+
+	/* The threads we could start compress every object */
+	error = started ? write_compressed(&p, write_cb, cb_data) : -1;
+
+	if (started < pb->nr_threads) {
+		git_mutex_lock(&p.mutex);
+		p.stop = true;
+		git_cond_broadcast(&p.space_cond);
+		git_mutex_unlock(&p.mutex);
+	}
+
+	for (i = 0; i < started; i++)
+		git_thread_join(&threads[i], NULL);
+
+	git_cond_free(&p.space_cond);
+	git_cond_free(&p.ready_cond);
+	git_mutex_free(&p.mutex);
+
+done:
+	for (i = 0; p.compressed && i < p.nr_objects; i++) {
+		git_buf_dispose(&p.compressed[i].data);
+		git_error_state_free(&p.compressed[i].error_state);
+	}
+
+	git__free(threads);
+	git__free(p.compressed);
+	git__free(p.objects);
+	git__free(write_order);
+	return error;
+}
+
+static int stream_pack(git_packbuilder *pb,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+	struct prepare_params prepare = {0};
+	git_pobject *po;
+	git_oid entry_oid;
+	bool preparing = false;
+	size_t i;
+	int error;
+
+	prepare.pb = pb;
+	pb->nr_written = 0;
+
+	/* The objects we write now must know whether they are deltas */
+	if (!pb->done && (error = reuse_deltas(pb)) < 0)
+		return error;
+
+	if (!pb->done) {
+		if (git_thread_create(&prepare.thread, threaded_prepare_pack, &prepare) != 0) {
+			git_error_set(GIT_ERROR_THREAD, "unable to create thread");
+			return -1;
+		}
+
+		preparing = true;
+	}
+
+	/* The objects without delta do not wait for the delta search */
+	if ((error = write_pack_header(pb, write_cb, cb_data)) < 0)
+		goto done;
+
+	for (i = 0; i < pb->nr_objects; i++) {
+		po = pb->object_list + i;
+
+		if (delta_candidate(pb, po) || po->delta || po->written)
+			continue;
+
+		if ((error = write_object(pb, po, write_cb, cb_data)) < 0)
+			goto done;
+
+		po->written = 1;
+	}
+
+done:
+	if (preparing) {
+		git_thread_join(&prepare.thread, NULL);
+
+		if (!error && (error = prepare.error) < 0)
+			git_error_state_restore(&prepare.error_state);
+
+		git_error_state_free(&prepare.error_state);
+	}
+
+	if (!error && (error = write_objects_threaded(pb, write_cb, cb_data)) == 0 &&
+	    (error = git_hash_final(&entry_oid, &pb->ctx)) == 0)
+		error = write_cb(entry_oid.id, GIT_OID_RAWSZ, cb_data);
+
+	/* if callback cancelled writing, we must still free delta_data */
+	for (i = 0; i < pb->nr_objects; i++) {
+		po = pb->object_list + i;
+		git__free(po->delta_data);
+		po->delta_data = NULL;
+	}
+
+	return error;
+}
+
+#endif
+
+static int build_pack(git_packbuilder *pb,
+	int (*write_cb)(void *buf, size_t size, void *cb_data),
+	void *cb_data)
+{
+#ifdef GIT_THREADS
+	if (!pb->nr_threads)
+		pb->nr_threads = git_online_cpus();
+
+	if (pb->nr_threads > 1)
+		return stream_pack(pb, write_cb, cb_data);
+#endif
+
+	if (prepare_pack(pb) < 0)
+		return -1;
+
+	return write_pack(pb, write_cb, cb_data);
+}
 
 int git_packbuilder_foreach(git_packbuilder *pb, int (*cb)(void *buf, size_t size, void *payload), void *payload)
 {
-	PREPARE_PACK;
-	return write_pack(pb, cb, payload);
+	return build_pack(pb, cb, payload);
 }
 
 int git_packbuilder_write_buf(git_buf *buf, git_packbuilder *pb)
 {
-	PREPARE_PACK;
 	git_buf_sanitize(buf);
-	return write_pack(pb, &write_pack_buf, buf);
+	return build_pack(pb, &write_pack_buf, buf);
 }
 
 static int write_cb(void *buf, size_t len, void *payload)
@@ -1388,8 +1981,6 @@ int git_packbuilder_write(
 	struct pack_write_context ctx;
 	int t;
 
-	PREPARE_PACK;
-
 	opts.progress_cb = progress_cb;
 	opts.progress_cb_payload = progress_cb_payload;
 
@@ -1415,24 +2006,133 @@ int git_packbuilder_write(
 	return 0;
 }
 
-#undef PREPARE_PACK
-
 const git_oid *git_packbuilder_hash(git_packbuilder *pb)
 {
 	return &pb->pack_oid;
 }
 
 
+int git_packbuilder__parse_filter(git_packbuilder_filter *out, const char *spec)
+{
+	int64_t value;
+
+	assert(out && spec);
+
+	memset(out, 0, sizeof(*out));
+
+	if (!strcmp(spec, "blob:none")) {
+		out->type = GIT_PACKBUILDER_FILTER_BLOB_NONE;
+		return 0;
+	}
+
+	if (!git__prefixcmp(spec, "blob:limit=") &&
+	    git_config_parse_int64(&value, spec + strlen("blob:limit=")) == 0 &&
+	    value >= 0) {
+		out->type = GIT_PACKBUILDER_FILTER_BLOB_LIMIT;
+		out->value = (uint64_t)value;
+		return 0;
+	}
+
+	if (!git__prefixcmp(spec, "tree:") &&
+	    git__strntol64(&value, spec + strlen("tree:"), strlen(spec + strlen("tree:")), NULL, 10) == 0 &&
+	    value >= 0) {
+		out->type = GIT_PACKBUILDER_FILTER_TREE_DEPTH;
+		out->value = (uint64_t)value;
+		return 0;
+	}
+
+	git_error_clear();
+	git_error_set(GIT_ERROR_INVALID, "unsupported object filter '%s'", spec);
+	return -1;
+}
+
+void git_packbuilder__set_filter(git_packbuilder *pb, const git_packbuilder_filter *filter)
+{
+	assert(pb);
+
+	if (filter)
+		memcpy(&pb->filter, filter, sizeof(pb->filter));
+	else
+		memset(&pb->filter, 0, sizeof(pb->filter));
+}
+
+void git_packbuilder__set_skip(git_packbuilder *pb, git_packbuilder_skip_cb skip_cb, void *payload)
+{
+	assert(pb);
+
+	pb->skip_cb = skip_cb;
+	pb->skip_cb_payload = payload;
+}
+
+void git_packbuilder__set_reuse_deltas(git_packbuilder *pb, bool reuse)
+{
+	assert(pb);
+
+	pb->reuse_deltas = reuse;
+}
+
+/* Whether the filter omits the trees at the given depth, the root tree being at 0 */
+GIT_INLINE(bool) filter_omits_tree(git_packbuilder *pb, size_t depth)
+{
+	return pb->filter.type == GIT_PACKBUILDER_FILTER_TREE_DEPTH &&
+	       depth >= pb->filter.value;
+}
+
+static int filter_omits_blob(bool *out, git_packbuilder *pb, const git_oid *id, size_t depth)
+{
+	git_object_t type;
+	size_t size;
+	int error;
+
+	switch (pb->filter.type) {
+	case GIT_PACKBUILDER_FILTER_BLOB_NONE:
+		*out = true;
+		return 0;
+	case GIT_PACKBUILDER_FILTER_BLOB_LIMIT:
+		if ((error = git_odb_read_header(&size, &type, pb->odb, id)) < 0)
+			return error;
+
+		*out = (uint64_t)size >= pb->filter.value;
+		return 0;
+	case GIT_PACKBUILDER_FILTER_TREE_DEPTH:
+		*out = depth >= pb->filter.value;
+		return 0;
+	default:
+		*out = false;
+		return 0;
+	}
+}
+
 static int cb_tree_walk(
 	const char *root, const git_tree_entry *entry, void *payload)
 {
 	int error;
 	struct tree_walk_context *ctx = payload;
+	size_t depth = 1;
+	const char *c;
+	bool omit;
 
 	/* A commit inside a tree represents a submodule commit and should be skipped. */
 	if (git_tree_entry_type(entry) == GIT_OBJECT_COMMIT)
 		return 0;
 
+	if (ctx->pb->filter.type != GIT_PACKBUILDER_FILTER_NONE) {
+		for (c = root; *c; c++)
+			depth += (*c == '/');
+
+		if (git_tree_entry_type(entry) == GIT_OBJECT_TREE) {
+			/* Skip the tree along with its entries */
+			if (filter_omits_tree(ctx->pb, depth))
+				return 1;
+		} else {
+			if ((error = filter_omits_blob(&omit, ctx->pb, git_tree_entry_id(entry), depth)) < 0)
+				return error;
+
+			if (omit)
+				return 0;
+		}
+	}
+
 	if (!(error = git_buf_sets(&ctx->buf, root)) &&
 		!(error = git_buf_puts(&ctx->buf, git_tree_entry_name(entry))))
 		error = git_packbuilder_insert(
@@ -1449,7 +2149,8 @@ int git_packbuilder_insert_commit(git_packbuilder *pb, const git_oid *oid)
 		git_packbuilder_insert(pb, oid, NULL) < 0)
 		return -1;
 
-	if (git_packbuilder_insert_tree(pb, git_commit_tree_id(commit)) < 0)
+	if (!filter_omits_tree(pb, 0) &&
+	    git_packbuilder_insert_tree(pb, git_commit_tree_id(commit)) < 0)
 		return -1;
 
 	git_commit_free(commit);
@@ -1632,21 +2333,31 @@ static int mark_edges_uninteresting(git_packbuilder *pb, git_commit_list *commit
 	return 0;
 }
 
-int insert_tree(git_packbuilder *pb, git_tree *tree)
+int insert_tree(git_packbuilder *pb, git_tree *tree, size_t depth)
 {
 	size_t i;
 	int error;
 	git_tree *subtree;
 	struct walk_object *obj;
 	const char *name;
+	bool omit;
 
 	if ((error = retrieve_object(&obj, pb, git_tree_id(tree))) < 0)
 		return error;
 
-	if (obj->seen || obj->uninteresting)
+	if (obj->uninteresting)
+		return 0;
+
+	/*
+	 * With a tree depth filter, a tree that is reached again closer
+	 * to the root may bring in entries that were too deep before.
+	 */
+	if (obj->seen && (pb->filter.type != GIT_PACKBUILDER_FILTER_TREE_DEPTH ||
+			  obj->depth <= depth))
 		return 0;
 
 	obj->seen = 1;
+	obj->depth = (unsigned int)depth;
 
 	if ((error = git_packbuilder_insert(pb, &obj->id, NULL)))
 		return error;
@@ -1656,10 +2367,13 @@ int insert_tree(git_packbuilder *pb, git_tree *tree)
 		const git_oid *entry_id = git_tree_entry_id(entry);
 		switch (git_tree_entry_type(entry)) {
 		case GIT_OBJECT_TREE:
+			if (filter_omits_tree(pb, depth + 1))
+				continue;
+
 			if ((error = git_tree_lookup(&subtree, pb->repo, entry_id)) < 0)
 				return error;
 
-			error = insert_tree(pb, subtree);
+			error = insert_tree(pb, subtree, depth + 1);
 			git_tree_free(subtree);
 
 			if (error < 0)
@@ -1671,6 +2385,12 @@ int insert_tree(git_packbuilder *pb, git_tree *tree)
 				return error;
 			if (obj->uninteresting)
 				continue;
+			if (pb->filter.type != GIT_PACKBUILDER_FILTER_NONE) {
+				if ((error = filter_omits_blob(&omit, pb, entry_id, depth + 1)) < 0)
+					return error;
+				if (omit)
+					continue;
+			}
 			name = git_tree_entry_name(entry);
 			if ((error = git_packbuilder_insert(pb, entry_id, name)) < 0)
 				return error;
@@ -1696,13 +2416,16 @@ int insert_commit(git_packbuilder *pb, struct walk_object *obj)
 	if ((error = git_packbuilder_insert(pb, &obj->id, NULL)) < 0)
 		return error;
 
+	if (filter_omits_tree(pb, 0))
+		return 0;
+
 	if ((error = git_commit_lookup(&commit, pb->repo, &obj->id)) < 0)
 		return error;
 
 	if ((error = git_tree_lookup(&tree, pb->repo, git_commit_tree_id(commit))) < 0)
 		goto cleanup;
 
-	if ((error = insert_tree(pb, tree)) < 0)
+	if ((error = insert_tree(pb, tree, 0)) < 0)
 		goto cleanup;
 
 cleanup:
@@ -1760,6 +2483,9 @@ int git_packbuilder_set_callbacks(git_packbuilder *pb, git_packbuilder_progress
 
 void git_packbuilder_free(git_packbuilder *pb)
 {
+	reuse_pack *rp;
+	size_t i;
+
 	if (pb == NULL)
 		return;
 
@@ -1783,6 +2509,16 @@ void git_packbuilder_free(git_packbuilder *pb)
 	git_oidmap_free(pb->walk_objects);
 	git_pool_clear(&pb->object_pool);
 
+	git_vector_foreach(&pb->reuse_packs, i, rp) {
+		if (rp->pack)
+			git_mwindow_put_pack(rp->pack);
+
+		git_offmap_free(rp->objects);
+		git__free(rp);
+	}
+
+	git_vector_free(&pb->reuse_packs);
+
 	git_hash_ctx_cleanup(&pb->ctx);
 	git_zstream_free(&pb->zstream);
 
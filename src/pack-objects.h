@@ -46,12 +46,40 @@ typedef struct git_pobject {
 	size_t delta_size;
 	size_t z_delta_size;
 
+	/* The pack holding the delta that we reuse, and where its data starts */
+	struct git_pack_file *reuse_pack;
+	off64_t reuse_offset;
+
 	int written:1,
 	    recursing:1,
 	    tagged:1,
-	    filled:1;
+	    filled:1,
+	    reused_base:1;
 } git_pobject;
 
+/*
+ * Object filters of partial clones, as given to git's `--filter`:
+ * "blob:none", "blob:limit=<n>[kmg]" or "tree:<depth>".  Objects that
+ * were asked for explicitly are never filtered out.
+ */
+typedef enum {
+	GIT_PACKBUILDER_FILTER_NONE = 0,
+	GIT_PACKBUILDER_FILTER_BLOB_NONE,
+	GIT_PACKBUILDER_FILTER_BLOB_LIMIT,
+	GIT_PACKBUILDER_FILTER_TREE_DEPTH,
+} git_packbuilder_filter_t;
+
+typedef struct {
+	git_packbuilder_filter_t type;
+	uint64_t value; /* blob size limit or tree depth */
+} git_packbuilder_filter;
+
+/*
+ * Whether to leave an object out of the pack, because the other side
+ * gets it another way.  The objects it refers to are still walked.
+ */
+typedef int GIT_CALLBACK(git_packbuilder_skip_cb)(const git_oid *id, void *payload);
+
 struct git_packbuilder {
 	git_repository *repo; /* associated repository */
 	git_odb *odb; /* associated object database */
@@ -62,7 +90,8 @@ struct git_packbuilder {
 	uint32_t nr_objects,
 		nr_deltified,
 		nr_written,
-		nr_remaining;
+		nr_remaining,
+		nr_reused;
 
 	size_t nr_alloc;
 
@@ -89,6 +118,15 @@ struct git_packbuilder {
 
 	unsigned int nr_threads; /* nr of threads to use */
 
+	git_packbuilder_filter filter;
+
+	git_packbuilder_skip_cb skip_cb;
+	void *skip_cb_payload;
+
+	git_vector reuse_packs; /* the packs whose deltas we reuse */
+	bool reuse_deltas;
+	bool deltas_reused;
+
 	git_packbuilder_progress progress_cb;
 	void *progress_cb_payload;
 	double last_progress_report_time; /* the time progress was last reported */
@@ -98,4 +136,14 @@ struct git_packbuilder {
 
 int git_packbuilder_write_buf(git_buf *buf, git_packbuilder *pb);
 
+int git_packbuilder__parse_filter(git_packbuilder_filter *out, const char *spec);
+void git_packbuilder__set_filter(git_packbuilder *pb, const git_packbuilder_filter *filter);
+void git_packbuilder__set_skip(git_packbuilder *pb, git_packbuilder_skip_cb skip_cb, void *payload);
+
+/*
+ * Reuse the deltas that the packs of the repository hold between the
+ * objects of the pack, rather than searching deltas for them.
+ */
+void git_packbuilder__set_reuse_deltas(git_packbuilder *pb, bool reuse);
+
 #endif
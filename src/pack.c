@@ -825,7 +825,9 @@ static int packfile_unpack_compressed(
 	git_object_t type)
 {
 	git_zstream zstream = GIT_ZSTREAM_INIT;
-	size_t buffer_len, total = 0;
+	size_t buffer_len, total = 0, in_used;
+	unsigned int window_len;
+	unsigned char *in;
 	char *data = NULL;
 	int error;
 
@@ -833,17 +835,31 @@ static int packfile_unpack_compressed(
 	data = git__calloc(1, buffer_len);
 	GIT_ERROR_CHECK_ALLOC(data);
 
+	in = pack_window_open(p, mwindow, *position, &window_len);
+
+	/*
+	 * We know how large the object is, so if its compressed data is all
+	 * in the current window we can inflate it in one go.
+	 */
+	if (in && (error = git_zstream_inflate_oneshot(
+			data, size, &in_used, in, window_len)) != GIT_PASSTHROUGH) {
+		git_mwindow_close(mwindow);
+
+		if (error < 0)
+			goto out;
+
+		*position += in_used;
+		goto done;
+	}
+
 	if ((error = git_zstream_init(&zstream, GIT_ZSTREAM_INFLATE)) < 0) {
+		git_mwindow_close(mwindow);
 		git_error_set(GIT_ERROR_ZLIB, "failed to init zlib stream on unpack");
 		goto out;
 	}
 
-	do {
+	while (1) {
 		size_t bytes = buffer_len - total;
-		unsigned int window_len;
-		unsigned char *in;
-
-		in = pack_window_open(p, mwindow, *position, &window_len);
 
 		if ((error = git_zstream_set_input(&zstream, in, window_len)) < 0 ||
 		    (error = git_zstream_get_output_chunk(data + total, &bytes, &zstream)) < 0) {
@@ -855,7 +871,12 @@ static int packfile_unpack_compressed(
 
 		*position += window_len - zstream.in_len;
 		total += bytes;
-	} while (total < size);
+
+		if (total >= size)
+			break;
+
+		in = pack_window_open(p, mwindow, *position, &window_len);
+	}
 
 	if (total != size || !git_zstream_eos(&zstream)) {
 		git_error_set(GIT_ERROR_ZLIB, "error inflating zlib stream");
@@ -863,6 +884,7 @@ static int packfile_unpack_compressed(
 		goto out;
 	}
 
+done:
 	obj->type = type;
 	obj->len = size;
 	obj->data = data;
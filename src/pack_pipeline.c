@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "pack_pipeline.h"
+
+#include "git2/odb.h"
+
+#include "thread-utils.h"
+
+#ifdef GIT_THREADS
+
+typedef struct pipeline_chunk {
+	struct pipeline_chunk *next;
+	size_t len;
+	char data[GIT_FLEX_ARRAY];
+} pipeline_chunk;
+
+typedef struct {
+	git_odb_writepack parent;
+
+	/* The writepack of the database, used by the indexing thread */
+	git_odb_writepack *writepack;
+
+	git_indexer_progress_cb progress_cb;
+	void *progress_payload;
+
+	git_thread thread;
+	git_mutex lock;
+	git_cond data_cond;  /* signalled when a chunk is queued */
+	git_cond space_cond; /* signalled when a chunk is taken */
+
+	/* Protected by the lock */
+	pipeline_chunk *head, *tail;
+	size_t queued;
+	unsigned int done : 1,
+		cancelled : 1,
+		finished : 1,
+		progressed : 1;
+	int error;
+	git_error_state error_state;
+	git_indexer_progress progress;
+
+	/* Only used by the indexing thread until it finishes */
+	git_indexer_progress stats;
+
+	unsigned int started : 1,
+		on_caller : 1;
+} pack_pipeline;
+
+/* The indexer's counts; the received bytes are counted by the caller */
+static void merge_stats(git_indexer_progress *out, const git_indexer_progress *stats)
+{
+	size_t received_bytes = out->received_bytes;
+
+	memcpy(out, stats, sizeof(git_indexer_progress));
+	out->received_bytes = received_bytes;
+}
+
+static int pipeline_progress(const git_indexer_progress *stats, void *payload)
+{
+	pack_pipeline *p = payload;
+
+	if (p->on_caller)
+		return p->progress_cb ? p->progress_cb(stats, p->progress_payload) : 0;
+
+	git_mutex_lock(&p->lock);
+	memcpy(&p->progress, stats, sizeof(git_indexer_progress));
+	p->progressed = 1;
+	git_mutex_unlock(&p->lock);
+
+	return 0;
+}
+
+static void *pipeline_thread(void *payload)
+{
+	pack_pipeline *p = payload;
+	pipeline_chunk *chunk;
+	int error;
+
+	git_mutex_lock(&p->lock);
+
+	while (1) {
+		while (!p->head && !p->done)
+			git_cond_wait(&p->data_cond, &p->lock);
+
+		if (!p->head || p->cancelled)
+			break;
+
+		chunk = p->head;
+		if ((p->head = chunk->next) == NULL)
+			p->tail = NULL;
+		p->queued -= chunk->len;
+
+		git_cond_signal(&p->space_cond);
+		git_mutex_unlock(&p->lock);
+
+		error = p->writepack->append(p->writepack, chunk->data, chunk->len, &p->stats);
+		git__free(chunk);
+
+		git_mutex_lock(&p->lock);
+
+		if (error < 0) {
+			p->error = error;
+			git_error_state_capture(&p->error_state, error);
+			break;
+		}
+	}
+
+	p->finished = 1;
+	git_cond_broadcast(&p->space_cond);
+	git_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+/* Called with the lock held, once the thread has finished */
+static int pipeline_error(pack_pipeline *p)
+{
+	int error = p->error;
+
+	git_error_state_restore(&p->error_state);
+	return error;
+}
+
+/* Report the indexer's progress from the caller's thread */
+static int pipeline_report(pack_pipeline *p, git_indexer_progress *stats)
+{
+	int progressed;
+
+	git_mutex_lock(&p->lock);
+	if ((progressed = p->progressed) != 0)
+		merge_stats(stats, &p->progress);
+	p->progressed = 0;
+	git_mutex_unlock(&p->lock);
+
+	if (!progressed || !p->progress_cb)
+		return 0;
+
+	return git_error_set_after_callback_function(
+		p->progress_cb(stats, p->progress_payload), "indexer progress");
+}
+
+static int pipeline_append(
+	git_odb_writepack *_writepack,
+	const void *data,
+	size_t size,
+	git_indexer_progress *stats)
+{
+	pack_pipeline *p = (pack_pipeline *)_writepack;
+	pipeline_chunk *chunk;
+	size_t alloclen;
+	int error = 0;
+
+	if (!size)
+		return 0;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(pipeline_chunk), size);
+	chunk = git__malloc(alloclen);
+	GIT_ERROR_CHECK_ALLOC(chunk);
+
+	chunk->next = NULL;
+	chunk->len = size;
+	memcpy(chunk->data, data, size);
+
+	git_mutex_lock(&p->lock);
+
+	while (!p->finished && p->queued >= GIT_PACK_PIPELINE_MAX_QUEUED)
+		git_cond_wait(&p->space_cond, &p->lock);
+
+	if (p->finished) {
+		error = pipeline_error(p);
+		git_mutex_unlock(&p->lock);
+		git__free(chunk);
+		return error;
+	}
+
+	if (p->tail)
+		p->tail->next = chunk;
+	else
+		p->head = chunk;
+
+	p->tail = chunk;
+	p->queued += size;
+
+	git_cond_signal(&p->data_cond);
+	git_mutex_unlock(&p->lock);
+
+	return pipeline_report(p, stats);
+}
+
+/* Let the thread index what is queued, or drop it, and wait for it */
+static void pipeline_stop(pack_pipeline *p, int cancel)
+{
+	if (!p->started)
+		return;
+
+	git_mutex_lock(&p->lock);
+	p->done = 1;
+	p->cancelled = !!cancel;
+	git_cond_signal(&p->data_cond);
+	git_mutex_unlock(&p->lock);
+
+	git_thread_join(&p->thread, NULL);
+	p->started = 0;
+}
+
+static int pipeline_commit(git_odb_writepack *_writepack, git_indexer_progress *stats)
+{
+	pack_pipeline *p = (pack_pipeline *)_writepack;
+	int error;
+
+	pipeline_stop(p, 0);
+
+	if (p->error < 0)
+		return pipeline_error(p);
+
+	if ((error = pipeline_report(p, stats)) < 0)
+		return error;
+
+	/* The thread is gone: the indexer is ours now */
+	merge_stats(stats, &p->stats);
+	p->on_caller = 1;
+
+	return p->writepack->commit(p->writepack, stats);
+}
+
+static void pipeline_free(git_odb_writepack *_writepack)
+{
+	pack_pipeline *p = (pack_pipeline *)_writepack;
+	pipeline_chunk *chunk;
+
+	if (!p)
+		return;
+
+	pipeline_stop(p, 1);
+
+	while ((chunk = p->head) != NULL) {
+		p->head = chunk->next;
+		git__free(chunk);
+	}
+
+	git_error_state_free(&p->error_state);
+	git_cond_free(&p->space_cond);
+	git_cond_free(&p->data_cond);
+	git_mutex_free(&p->lock);
+
+	p->writepack->free(p->writepack);
+	git__free(p);
+}
+
+int git_pack_pipeline_new(
+	git_odb_writepack **out,
+	git_odb *odb,
+	git_indexer_progress_cb progress_cb,
+	void *progress_payload)
+{
+	pack_pipeline *p;
+	int error;
+
+	assert(out && odb);
+
+	p = git__calloc(1, sizeof(pack_pipeline));
+	GIT_ERROR_CHECK_ALLOC(p);
+
+	if ((error = git_odb_write_pack(&p->writepack, odb, pipeline_progress, p)) < 0 ||
+	    !p->writepack) {
+		*out = p->writepack;
+		git__free(p);
+		return error;
+	}
+
+	p->parent.backend = p->writepack->backend;
+	p->parent.append = pipeline_append;
+	p->parent.commit = pipeline_commit;
+	p->parent.free = pipeline_free;
+	p->progress_cb = progress_cb;
+	p->progress_payload = progress_payload;
+
+	if (git_mutex_init(&p->lock) < 0) {
+		git_error_set(GIT_ERROR_THREAD, "unable to initialize the pack pipeline lock");
+		p->writepack->free(p->writepack);
+		git__free(p);
+		return -1;
+	}
+
+	git_cond_init(&p->data_cond);
+	git_cond_init(&p->space_cond);
+
+	if (git_thread_create(&p->thread, pipeline_thread, p) != 0) {
+		git_error_set(GIT_ERROR_THREAD, "unable to create the pack indexing thread");
+		pipeline_free(&p->parent);
+		return -1;
+	}
+
+	p->started = 1;
+
+	*out = &p->parent;
+	return 0;
+}
+
+#else
+
+int git_pack_pipeline_new(
+	git_odb_writepack **out,
+	git_odb *odb,
+	git_indexer_progress_cb progress_cb,
+	void *progress_payload)
+{
+	return git_odb_write_pack(out, odb, progress_cb, progress_payload);
+}
+
+#endif
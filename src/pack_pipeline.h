@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_pack_pipeline_h__
+#define INCLUDE_pack_pipeline_h__
+
+#include "common.h"
+
+#include "git2/indexer.h"
+#include "git2/odb_backend.h"
+
+/* The most pack data waiting to be indexed before `append` blocks */
+#define GIT_PACK_PIPELINE_MAX_QUEUED (8 * 1024 * 1024)
+
+/*
+ * Create a writepack for the object database which indexes the data
+ * given to `append` on a thread of its own, so that the caller can
+ * keep receiving the pack meanwhile.  The progress callback is still
+ * called from the caller's thread, from `append` and `commit`, and the
+ * errors of the indexer are returned by the next call.
+ *
+ * Without thread support, this is the writepack of the database.
+ */
+int git_pack_pipeline_new(
+	git_odb_writepack **out,
+	git_odb *odb,
+	git_indexer_progress_cb progress_cb,
+	void *progress_payload);
+
+#endif
@@ -73,7 +73,8 @@ int git_refdb_set_backend(git_refdb *db, git_refdb_backend *backend)
 	    !backend->has_log || !backend->ensure_log || !backend->free ||
 	    !backend->reflog_read || !backend->reflog_write ||
 	    !backend->reflog_rename || !backend->reflog_delete ||
-	    (backend->lock && !backend->unlock)) {
+	    (backend->lock && !backend->unlock) ||
+	    (backend->begin_batch && !backend->end_batch)) {
 		git_error_set(GIT_ERROR_REFERENCE, "incomplete refdb backend implementation");
 		return GIT_EINVALID;
 	}
@@ -270,3 +271,23 @@ int git_refdb_unlock(git_refdb *db, void *payload, int success, int update_reflo
 
 	return db->backend->unlock(db->backend, payload, success, update_reflog, ref, sig, message);
 }
+
+int git_refdb_begin_batch(int *batched, git_refdb *db)
+{
+	assert(batched && db);
+
+	*batched = 0;
+
+	if (!db->backend->begin_batch)
+		return 0;
+
+	*batched = 1;
+	return db->backend->begin_batch(db->backend);
+}
+
+int git_refdb_end_batch(git_refdb *db, int success)
+{
+	assert(db && db->backend->end_batch);
+
+	return db->backend->end_batch(db->backend, success);
+}
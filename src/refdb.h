@@ -56,4 +56,11 @@ int git_refdb_ensure_log(git_refdb *refdb, const char *refname);
 int git_refdb_lock(void **payload, git_refdb *db, const char *refname);
 int git_refdb_unlock(git_refdb *db, void *payload, int success, int update_reflog, const git_reference *ref, const git_signature *sig, const char *message);
 
+/*
+ * Batch the updates of the following unlock calls, if the backend
+ * supports it; `batched` tells whether the batch needs to be ended.
+ */
+int git_refdb_begin_batch(int *batched, git_refdb *db);
+int git_refdb_end_batch(git_refdb *db, int success);
+
 #endif
@@ -62,12 +62,41 @@ typedef struct refdb_fs_backend {
 	char *commonpath;
 
 	git_sortedcache *refcache;
+
+	/*
+	 * A sorted packed-refs file is mapped and searched directly for
+	 * point lookups, so that they don't require parsing the whole file
+	 * into `refcache`.
+	 */
+	git_mutex prlock; /* protects the packed_refs_* fields */
+	git_map packed_refs_map;
+	size_t packed_refs_offset;
+	git_futils_filestamp packed_refs_stamp;
+
 	int peeling_mode;
 	git_iterator_flag_t iterator_flags;
 	uint32_t direach_flags;
 	int fsync;
+
+	/*
+	 * Updates recorded by `unlock` while a batch is in progress.  The
+	 * batch belongs to the thread that opened it, and only records the
+	 * updates of the locks that carry the token of its transaction.
+	 */
+	git_mutex batch_lock; /* protects the fields below */
+	bool batching;
+	size_t batch_owner;
+	uintptr_t batch_token;
+	uintptr_t next_token;
+	git_vector batch;
 } refdb_fs_backend;
 
+/* The lock of a reference, with the token of the transaction that took it */
+typedef struct {
+	git_filebuf file;
+	uintptr_t token;
+} refdb_fs_lock;
+
 static int refdb_reflog_fs__delete(git_refdb_backend *_backend, const char *name);
 
 static int packref_cmp(const void *a_, const void *b_)
@@ -324,6 +353,310 @@ static int packed_loadloose(refdb_fs_backend *backend)
 	return error;
 }
 
+static void packed_map_free(refdb_fs_backend *backend)
+{
+	if (backend->packed_refs_map.data) {
+#ifdef GIT_WIN32
+		git__free(backend->packed_refs_map.data);
+#else
+		git_futils_mmap_free(&backend->packed_refs_map);
+#endif
+	}
+
+	memset(&backend->packed_refs_map, 0, sizeof(git_map));
+	backend->packed_refs_offset = 0;
+}
+
+static int packed_map_load(refdb_fs_backend *backend)
+{
+	static const char *traits_header = "# pack-refs with: ";
+	const char *path = git_sortedcache_path(backend->refcache);
+	const char *data, *end, *eol;
+	struct stat st;
+	git_file fd;
+	int error = 0;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	if (p_fstat(fd, &st) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to stat '%s'", path);
+		error = -1;
+		goto done;
+	}
+
+	git_futils_filestamp_set_from_stat(&backend->packed_refs_stamp, &st);
+
+	if (st.st_size == 0 || !git__is_sizet(st.st_size))
+		goto done;
+
+#ifdef GIT_WIN32
+	/*
+	 * Keeping the file mapped would prevent it from being replaced,
+	 * so read it into memory instead.
+	 */
+	backend->packed_refs_map.len = (size_t)st.st_size;
+	backend->packed_refs_map.data = git__malloc(backend->packed_refs_map.len);
+	GIT_ERROR_CHECK_ALLOC(backend->packed_refs_map.data);
+
+	if (p_read(fd, backend->packed_refs_map.data,
+			backend->packed_refs_map.len) != (ssize_t)backend->packed_refs_map.len) {
+		git_error_set(GIT_ERROR_OS, "failed to read '%s'", path);
+		error = -1;
+		goto done;
+	}
+#else
+	if ((error = git_futils_mmap_ro(&backend->packed_refs_map, fd, 0, (size_t)st.st_size)) < 0)
+		goto done;
+#endif
+
+	data = backend->packed_refs_map.data;
+	end = data + backend->packed_refs_map.len;
+
+	/* We can only search files that are known to be sorted */
+	if (git__prefixncmp(data, end - data, traits_header) != 0 ||
+	    (eol = memchr(data, '\n', end - data)) == NULL ||
+	    git__memmem(data, eol - data, " sorted ", strlen(" sorted ")) == NULL)
+		goto done;
+
+	while (data < end && *data == '#') {
+		if ((eol = memchr(data, '\n', end - data)) == NULL)
+			goto done;
+		data = eol + 1;
+	}
+
+	backend->packed_refs_offset = data - (const char *)backend->packed_refs_map.data;
+
+done:
+	if (error < 0 || !backend->packed_refs_offset)
+		packed_map_free(backend);
+
+	p_close(fd);
+	return error;
+}
+
+/*
+ * Make sure the mapped packed-refs file is up to date.  The map is left
+ * empty if there is no packed-refs file or if it cannot be searched.
+ */
+static int packed_map_check(refdb_fs_backend *backend)
+{
+	int error;
+
+	if (!backend->gitpath)
+		return 0;
+
+	error = git_futils_filestamp_check(&backend->packed_refs_stamp,
+		git_sortedcache_path(backend->refcache));
+
+	if (error == 0)
+		return 0;
+
+	packed_map_free(backend);
+
+	if (error == GIT_ENOTFOUND) {
+		git_futils_filestamp_set(&backend->packed_refs_stamp, NULL);
+		return 0;
+	}
+
+	if ((error = packed_map_load(backend)) == GIT_ENOTFOUND) {
+		git_futils_filestamp_set(&backend->packed_refs_stamp, NULL);
+		git_error_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+/*
+ * Records in the packed-refs file are a "<OID> <refname>" line,
+ * optionally followed by a "^<OID>" line with the peeled target.
+ */
+static const char *packed_map_record_start(const char *start, const char *p)
+{
+	while (p > start && (p[-1] != '\n' || *p == '^'))
+		p--;
+
+	return p;
+}
+
+static const char *packed_map_record_end(const char *p, const char *end)
+{
+	do {
+		if ((p = memchr(p, '\n', end - p)) == NULL)
+			return end;
+	} while (++p < end && *p == '^');
+
+	return p;
+}
+
+static int packed_map_record_name(
+	const char **out,
+	size_t *out_len,
+	const char *record,
+	const char *end)
+{
+	const char *name = record + GIT_OID_HEXSZ + 1, *eol;
+
+	if (name > end || name[-1] != ' ') {
+		git_error_set(GIT_ERROR_REFERENCE, "corrupted packed references file");
+		return -1;
+	}
+
+	if ((eol = memchr(name, '\n', end - name)) == NULL)
+		eol = end;
+	if (eol > name && eol[-1] == '\r')
+		eol--;
+
+	*out = name;
+	*out_len = eol - name;
+	return 0;
+}
+
+static int packed_map_record_cmp(
+	int *out,
+	const char *record,
+	const char *end,
+	const char *ref_name,
+	size_t ref_name_len)
+{
+	const char *name;
+	size_t name_len;
+
+	if (packed_map_record_name(&name, &name_len, record, end) < 0)
+		return -1;
+
+	if ((*out = memcmp(name, ref_name, min(name_len, ref_name_len))) == 0)
+		*out = (name_len > ref_name_len) - (name_len < ref_name_len);
+
+	return 0;
+}
+
+static int packed_map_record_oids(
+	git_oid *oid,
+	git_oid *peel,
+	bool *has_peel,
+	const char *record,
+	const char *end)
+{
+	const char *peel_line;
+
+	*has_peel = false;
+
+	if (git_oid_fromstrn(oid, record, GIT_OID_HEXSZ) < 0)
+		goto corrupt;
+
+	if ((peel_line = memchr(record, '\n', end - record)) != NULL &&
+	    ++peel_line < end && *peel_line == '^') {
+		if (end - peel_line < GIT_OID_HEXSZ + 1 ||
+		    git_oid_fromstrn(peel, peel_line + 1, GIT_OID_HEXSZ) < 0)
+			goto corrupt;
+
+		*has_peel = true;
+	}
+
+	return 0;
+
+corrupt:
+	git_error_set(GIT_ERROR_REFERENCE, "corrupted packed references file");
+	return -1;
+}
+
+/*
+ * Binary search the mapped packed-refs file for the first record that
+ * sorts at or after the given name.
+ */
+static int packed_map_seek(
+	const char **out,
+	refdb_fs_backend *backend,
+	const char *name,
+	size_t name_len)
+{
+	const char *data = backend->packed_refs_map.data;
+	const char *lo = data + backend->packed_refs_offset;
+	const char *hi = data + backend->packed_refs_map.len;
+	const char *record;
+	int cmp;
+
+	while (lo < hi) {
+		record = packed_map_record_start(lo, lo + (hi - lo) / 2);
+
+		if (packed_map_record_cmp(&cmp, record, hi, name, name_len) < 0)
+			return -1;
+
+		if (cmp < 0)
+			lo = packed_map_record_end(record, hi);
+		else
+			hi = record;
+	}
+
+	*out = lo;
+	return 0;
+}
+
+/*
+ * Binary search the sorted packed-refs file for the given reference.
+ * Returns GIT_PASSTHROUGH if the file cannot be searched, in which case
+ * the caller needs to look the reference up in the fully parsed cache.
+ */
+static int packed_map_lookup(
+	git_reference **out,
+	refdb_fs_backend *backend,
+	const char *ref_name)
+{
+	const char *record, *end;
+	size_t ref_name_len = strlen(ref_name);
+	git_oid oid, peel;
+	bool has_peel;
+	int cmp, error;
+
+	if (git_mutex_lock(&backend->prlock) < 0) {
+		git_error_set(GIT_ERROR_OS, "unable to lock packed references");
+		return -1;
+	}
+
+	if ((error = packed_map_check(backend)) < 0)
+		goto done;
+
+	/*
+	 * Without a map, the file is either missing or empty, or it is
+	 * not sorted and has to be parsed.
+	 */
+	if (!backend->packed_refs_map.data) {
+		error = backend->packed_refs_stamp.size ? GIT_PASSTHROUGH : GIT_ENOTFOUND;
+		goto done;
+	}
+
+	end = (const char *)backend->packed_refs_map.data + backend->packed_refs_map.len;
+
+	if ((error = packed_map_seek(&record, backend, ref_name, ref_name_len)) < 0)
+		goto done;
+
+	if (record == end) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if ((error = packed_map_record_cmp(&cmp, record, end, ref_name, ref_name_len)) < 0)
+		goto done;
+
+	if (cmp != 0) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if (!out ||
+	    (error = packed_map_record_oids(&oid, &peel, &has_peel, record, end)) < 0)
+		goto done;
+
+	if ((*out = git_reference__alloc(ref_name, &oid, has_peel ? &peel : NULL)) == NULL)
+		error = -1;
+
+done:
+	git_mutex_unlock(&backend->prlock);
+	return error;
+}
+
 static int refdb_fs_backend__exists(
 	int *exists,
 	git_refdb_backend *_backend,
@@ -345,6 +678,13 @@ static int refdb_fs_backend__exists(
 		goto out;
 	}
 
+	if ((error = packed_map_lookup(NULL, backend, ref_name)) != GIT_PASSTHROUGH) {
+		*exists = !error;
+		if (error == GIT_ENOTFOUND)
+			error = 0;
+		goto out;
+	}
+
 	if ((error = packed_reload(backend)) < 0)
 		goto out;
 
@@ -446,6 +786,9 @@ static int packed_lookup(
 	int error = 0;
 	struct packref *entry;
 
+	if ((error = packed_map_lookup(out, backend, ref_name)) != GIT_PASSTHROUGH)
+		return error == GIT_ENOTFOUND ? ref_error_notfound(ref_name) : error;
+
 	if ((error = packed_reload(backend)) < 0)
 		return error;
 
@@ -493,11 +836,12 @@ typedef struct {
 	git_reference_iterator parent;
 
 	char *glob;
+	char *prefix;
 
 	git_pool pool;
 	git_vector loose;
+	git_vector packed;
 
-	git_sortedcache *cache;
 	size_t loose_pos;
 	size_t packed_pos;
 } refdb_fs_iter;
@@ -507,8 +851,8 @@ static void refdb_fs_backend__iterator_free(git_reference_iterator *_iter)
 	refdb_fs_iter *iter = GIT_CONTAINER_OF(_iter, refdb_fs_iter, parent);
 
 	git_vector_free(&iter->loose);
+	git_vector_free(&iter->packed);
 	git_pool_clear(&iter->pool);
-	git_sortedcache_free(iter->cache);
 	git__free(iter);
 }
 
@@ -551,6 +895,13 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 		}
 	}
 
+	/*
+	 * Only descend into the entries that can match the literal part of
+	 * the glob that follows the directory we start from.
+	 */
+	if (ref_prefix == iter->glob && iter->prefix[ref_prefix_len] != '\0')
+		fsit_opts.start = fsit_opts.end = iter->prefix + ref_prefix_len;
+
 	if ((error = git_buf_printf(&path, "%s/", backend->commonpath)) < 0 ||
 		(error = git_buf_put(&path, ref_prefix, ref_prefix_len)) < 0) {
 		git_buf_dispose(&path);
@@ -589,6 +940,134 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 	return error;
 }
 
+static int iter_add_packed(
+	refdb_fs_iter *iter,
+	const char *name,
+	size_t name_len,
+	const git_oid *oid,
+	const git_oid *peel,
+	char flags)
+{
+	struct packref *ref;
+	size_t alloclen;
+
+	GIT_ERROR_CHECK_ALLOC_ADD3(&alloclen, sizeof(struct packref), name_len, 1);
+
+	ref = git_pool_mallocz(&iter->pool, alloclen);
+	GIT_ERROR_CHECK_ALLOC(ref);
+
+	memcpy(ref->name, name, name_len);
+	git_oid_cpy(&ref->oid, oid);
+	if (peel)
+		git_oid_cpy(&ref->peel, peel);
+	ref->flags = flags;
+
+	return git_vector_insert(&iter->packed, ref);
+}
+
+/*
+ * Parse the records matching the iterator's prefix straight out of the
+ * mapped packed-refs file.  They form one contiguous range of the file.
+ */
+static int iter_load_packed_map(refdb_fs_backend *backend, refdb_fs_iter *iter)
+{
+	const char *record, *end, *name;
+	size_t name_len, prefix_len = strlen(iter->prefix);
+	git_oid oid, peel;
+	bool has_peel;
+	int error;
+
+	end = (const char *)backend->packed_refs_map.data + backend->packed_refs_map.len;
+
+	if ((error = packed_map_seek(&record, backend, iter->prefix, prefix_len)) < 0)
+		return error;
+
+	for (; record < end; record = packed_map_record_end(record, end)) {
+		if ((error = packed_map_record_name(&name, &name_len, record, end)) < 0)
+			return error;
+
+		if (name_len < prefix_len || memcmp(name, iter->prefix, prefix_len) != 0)
+			break;
+
+		if ((error = packed_map_record_oids(&oid, &peel, &has_peel, record, end)) < 0 ||
+		    (error = iter_add_packed(iter, name, name_len, &oid,
+			    has_peel ? &peel : NULL, has_peel ? PACKREF_HAS_PEEL : 0)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the packed references matching the iterator's prefix out of the
+ * fully parsed cache, for packed-refs files that cannot be searched.
+ */
+static int iter_load_packed_cache(refdb_fs_backend *backend, refdb_fs_iter *iter)
+{
+	struct packref *ref;
+	size_t pos;
+	int error;
+
+	if ((error = packed_reload(backend)) < 0 ||
+	    (error = git_sortedcache_rlock(backend->refcache)) < 0)
+		return error;
+
+	git_sortedcache_lookup_index(&pos, backend->refcache, iter->prefix);
+
+	while ((ref = git_sortedcache_entry(backend->refcache, pos++)) != NULL) {
+		if (git__prefixcmp(ref->name, iter->prefix) != 0)
+			break;
+
+		if ((error = iter_add_packed(iter, ref->name, strlen(ref->name),
+				&ref->oid, &ref->peel, ref->flags & ~PACKREF_SHADOWED)) < 0)
+			break;
+	}
+
+	git_sortedcache_runlock(backend->refcache);
+	return error;
+}
+
+static int iter_load_packed(refdb_fs_backend *backend, refdb_fs_iter *iter)
+{
+	bool searchable = true;
+	int error;
+
+	if (git_mutex_lock(&backend->prlock) < 0) {
+		git_error_set(GIT_ERROR_OS, "unable to lock packed references");
+		return -1;
+	}
+
+	if ((error = packed_map_check(backend)) == 0) {
+		if (backend->packed_refs_map.data)
+			error = iter_load_packed_map(backend, iter);
+		else
+			searchable = !backend->packed_refs_stamp.size;
+	}
+
+	git_mutex_unlock(&backend->prlock);
+
+	if (!error && !searchable)
+		error = iter_load_packed_cache(backend, iter);
+
+	return error;
+}
+
+static int packref_name_cmp(const void *name, const void *ref)
+{
+	return strcmp(name, ((const struct packref *)ref)->name);
+}
+
+static void iter_shadow_packed(refdb_fs_iter *iter, const char *name)
+{
+	struct packref *ref;
+	size_t pos;
+
+	if (git_vector_bsearch2(&pos, &iter->packed, packref_name_cmp, name) == 0) {
+		ref = git_vector_get(&iter->packed, pos);
+		ref->flags |= PACKREF_SHADOWED;
+	}
+}
+
 static int refdb_fs_backend__iterator_next(
 	git_reference **out, git_reference_iterator *_iter)
 {
@@ -601,10 +1080,7 @@ static int refdb_fs_backend__iterator_next(
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
 
 		if (loose_lookup(out, backend, path) == 0) {
-			ref = git_sortedcache_lookup(iter->cache, path);
-			if (ref)
-				ref->flags |= PACKREF_SHADOWED;
-
+			iter_shadow_packed(iter, path);
 			return 0;
 		}
 
@@ -612,10 +1088,8 @@ static int refdb_fs_backend__iterator_next(
 	}
 
 	error = GIT_ITEROVER;
-	while (iter->packed_pos < git_sortedcache_entrycount(iter->cache)) {
-		ref = git_sortedcache_entry(iter->cache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
+	while (iter->packed_pos < iter->packed.length) {
+		ref = git_vector_get(&iter->packed, iter->packed_pos++);
 
 		if (ref->flags & PACKREF_SHADOWED)
 			continue;
@@ -640,13 +1114,9 @@ static int refdb_fs_backend__iterator_next_name(
 
 	while (iter->loose_pos < iter->loose.length) {
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
-		struct packref *ref;
 
 		if (loose_lookup(NULL, backend, path) == 0) {
-			ref = git_sortedcache_lookup(iter->cache, path);
-			if (ref)
-				ref->flags |= PACKREF_SHADOWED;
-
+			iter_shadow_packed(iter, path);
 			*out = path;
 			return 0;
 		}
@@ -655,10 +1125,8 @@ static int refdb_fs_backend__iterator_next_name(
 	}
 
 	error = GIT_ITEROVER;
-	while (iter->packed_pos < git_sortedcache_entrycount(iter->cache)) {
-		ref = git_sortedcache_entry(iter->cache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
+	while (iter->packed_pos < iter->packed.length) {
+		ref = git_vector_get(&iter->packed, iter->packed_pos++);
 
 		if (ref->flags & PACKREF_SHADOWED)
 			continue;
@@ -687,7 +1155,8 @@ static int refdb_fs_backend__iterator(
 
 	git_pool_init(&iter->pool, 1);
 
-	if ((error = git_vector_init(&iter->loose, 8, NULL)) < 0)
+	if ((error = git_vector_init(&iter->loose, 8, NULL)) < 0 ||
+	    (error = git_vector_init(&iter->packed, 8, packref_cmp)) < 0)
 		goto out;
 
 	if (glob != NULL &&
@@ -696,15 +1165,25 @@ static int refdb_fs_backend__iterator(
 		goto out;
 	}
 
-	if ((error = iter_load_loose_paths(backend, iter)) < 0)
+	/*
+	 * Every reference matching the glob starts with the literal part
+	 * before its first wildcard, which lets us skip all others.
+	 */
+	iter->prefix = git_pool_strndup(&iter->pool, glob ? glob : "",
+		glob ? strcspn(glob, "?*[\\") : 0);
+	if (!iter->prefix) {
+		error = -1;
 		goto out;
+	}
 
-	if ((error = packed_reload(backend)) < 0)
+	if ((error = iter_load_loose_paths(backend, iter)) < 0)
 		goto out;
 
-	if ((error = git_sortedcache_copy(&iter->cache, backend->refcache, 1, NULL, NULL)) < 0)
+	if ((error = iter_load_packed(backend, iter)) < 0)
 		goto out;
 
+	git_vector_sort(&iter->packed);
+
 	iter->parent.next = refdb_fs_backend__iterator_next;
 	iter->parent.next_name = refdb_fs_backend__iterator_next_name;
 	iter->parent.free = refdb_fs_backend__iterator_free;
@@ -836,16 +1315,34 @@ static int loose_commit(git_filebuf *file, const git_reference *ref)
 	return git_filebuf_commit(file);
 }
 
-static int refdb_fs_backend__lock(void **out, git_refdb_backend *_backend, const char *refname)
+static int batch_mutex_lock(refdb_fs_backend *backend)
 {
-	int error;
-	git_filebuf *lock;
-	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	if (git_mutex_lock(&backend->batch_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock the reference batch");
+		return -1;
+	}
 
-	lock = git__calloc(1, sizeof(git_filebuf));
+	return 0;
+}
+
+static int refdb_fs_backend__lock(void **out, git_refdb_backend *_backend, const char *refname)
+{
+	int error = 0;
+	refdb_fs_lock *held = *out, *lock;
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+
+	lock = git__calloc(1, sizeof(refdb_fs_lock));
 	GIT_ERROR_CHECK_ALLOC(lock);
 
-	if ((error = loose_lock(lock, backend, refname)) < 0) {
+	/* The locks of a transaction share the token of its first one */
+	if (held) {
+		lock->token = held->token;
+	} else if ((error = batch_mutex_lock(backend)) == 0) {
+		lock->token = ++backend->next_token;
+		git_mutex_unlock(&backend->batch_lock);
+	}
+
+	if (error < 0 || (error = loose_lock(&lock->file, backend, refname)) < 0) {
 		git__free(lock);
 		return error;
 	}
@@ -871,18 +1368,112 @@ static int refdb_fs_backend__delete_tail(
 	const git_oid *old_id,
 	const char *old_target);
 
-static int refdb_fs_backend__unlock(git_refdb_backend *backend, void *payload, int success, int update_reflog,
+/* An update recorded in a batch, with the lock of its reference */
+typedef struct {
+	refdb_fs_lock *lock;
+	git_reference *ref;
+	git_oid old_id;
+	git_signature *sig;
+	char *message;
+	unsigned int update_reflog :1,
+		remove :1,
+		unchanged :1;
+} refdb_fs_update;
+
+static int refdb_fs_update_cmp(const void *a_, const void *b_)
+{
+	const refdb_fs_update *a = a_, *b = b_;
+	return strcmp(a->ref->name, b->ref->name);
+}
+
+static void refdb_fs_update_free(refdb_fs_update *update)
+{
+	if (!update)
+		return;
+
+	if (update->lock) {
+		git_filebuf_cleanup(&update->lock->file);
+		git__free(update->lock);
+	}
+
+	git_reference_free(update->ref);
+	git_signature_free(update->sig);
+	git__free(update->message);
+	git__free(update);
+}
+
+static int batch_add(
+	refdb_fs_backend *backend,
+	refdb_fs_lock *lock,
+	int remove,
+	int update_reflog,
+	const git_reference *ref,
+	const git_signature *sig,
+	const char *message)
+{
+	refdb_fs_update *update;
+
+	if ((update = git__calloc(1, sizeof(refdb_fs_update))) == NULL) {
+		git_filebuf_cleanup(&lock->file);
+		git__free(lock);
+		return -1;
+	}
+
+	update->lock = lock;
+	update->remove = !!remove;
+	update->update_reflog = !!update_reflog;
+
+	if (ref->type == GIT_REFERENCE_SYMBOLIC)
+		update->ref = git_reference__alloc_symbolic(ref->name, ref->target.symbolic);
+	else
+		update->ref = git_reference__alloc(ref->name, &ref->target.oid, NULL);
+
+	if (!update->ref ||
+	    (sig && git_signature_dup(&update->sig, sig) < 0) ||
+	    (message && (update->message = git__strdup(message)) == NULL) ||
+	    git_vector_insert(&backend->batch, update) < 0) {
+		refdb_fs_update_free(update);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int refdb_fs_backend__unlock(git_refdb_backend *_backend, void *payload, int success, int update_reflog,
 				    const git_reference *ref, const git_signature *sig, const char *message)
 {
-	git_filebuf *lock = (git_filebuf *) payload;
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	refdb_fs_lock *lock = (refdb_fs_lock *) payload;
 	int error = 0;
 
+	if (success) {
+		if ((error = batch_mutex_lock(backend)) < 0)
+			goto done;
+
+		/*
+		 * The batch keeps the reference locked until it is written.
+		 * It takes the updates of its own transaction only: the first
+		 * one that is unlocked on its thread gives it its token.
+		 */
+		if (backend->batching &&
+		    backend->batch_owner == git_thread_currentid() &&
+		    (!backend->batch_token || backend->batch_token == lock->token)) {
+			backend->batch_token = lock->token;
+			error = batch_add(backend, lock, success == 2, update_reflog, ref, sig, message);
+			git_mutex_unlock(&backend->batch_lock);
+			return error;
+		}
+
+		git_mutex_unlock(&backend->batch_lock);
+	}
+
 	if (success == 2)
-		error = refdb_fs_backend__delete_tail(backend, lock, ref->name, NULL, NULL);
+		error = refdb_fs_backend__delete_tail(_backend, &lock->file, ref->name, NULL, NULL);
 	else if (success)
-		error = refdb_fs_backend__write_tail(backend, ref, lock, update_reflog, NULL, NULL, sig, message);
-	else
-		git_filebuf_cleanup(lock);
+		error = refdb_fs_backend__write_tail(_backend, ref, &lock->file, update_reflog, NULL, NULL, sig, message);
+
+done:
+	git_filebuf_cleanup(&lock->file);
 
 	git__free(lock);
 	return error;
@@ -1038,44 +1629,67 @@ static int packed_remove_loose(refdb_fs_backend *backend)
 	return 0;
 }
 
-/*
- * Write all the contents in the in-memory packfile to disk.
- */
-static int packed_write(refdb_fs_backend *backend)
+static int packed_open(git_filebuf *pack_file, refdb_fs_backend *backend)
 {
-	git_sortedcache *refcache = backend->refcache;
-	git_filebuf pack_file = GIT_FILEBUF_INIT;
-	int error, open_flags = 0;
-	size_t i;
-
-	/* lock the cache to updates while we do this */
-	if ((error = git_sortedcache_wlock(refcache)) < 0)
-		return error;
+	int open_flags = 0;
 
 	if (backend->fsync)
 		open_flags = GIT_FILEBUF_FSYNC;
 
-	/* Open the file! */
-	if ((error = git_filebuf_open(&pack_file, git_sortedcache_path(refcache), open_flags, GIT_PACKEDREFS_FILE_MODE)) < 0)
-		goto fail;
+	return git_filebuf_open(pack_file, git_sortedcache_path(backend->refcache),
+		open_flags, GIT_PACKEDREFS_FILE_MODE);
+}
+
+/*
+ * Write the in-memory packfile into the locked file; the cache must be
+ * locked for writing.
+ */
+static int packed_write_refs(git_filebuf *pack_file, refdb_fs_backend *backend)
+{
+	git_sortedcache *refcache = backend->refcache;
+	size_t i;
+	int error;
 
 	/* Packfiles have a header... apparently
 	 * This is in fact not required, but we might as well print it
 	 * just for kicks */
-	if ((error = git_filebuf_printf(&pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < 0)
-		goto fail;
+	if ((error = git_filebuf_printf(pack_file, "%s\n", GIT_PACKEDREFS_HEADER)) < 0)
+		return error;
 
 	for (i = 0; i < git_sortedcache_entrycount(refcache); ++i) {
 		struct packref *ref = git_sortedcache_entry(refcache, i);
 		assert(ref);
 
 		if ((error = packed_find_peel(backend, ref)) < 0)
-			goto fail;
+			return error;
 
-		if ((error = packed_write_ref(ref, &pack_file)) < 0)
-			goto fail;
+		if ((error = packed_write_ref(ref, pack_file)) < 0)
+			return error;
 	}
 
+	return 0;
+}
+
+/*
+ * Write all the contents in the in-memory packfile to disk.
+ */
+static int packed_write(refdb_fs_backend *backend)
+{
+	git_sortedcache *refcache = backend->refcache;
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	int error;
+
+	/* lock the cache to updates while we do this */
+	if ((error = git_sortedcache_wlock(refcache)) < 0)
+		return error;
+
+	/* Open the file! */
+	if ((error = packed_open(&pack_file, backend)) < 0)
+		goto fail;
+
+	if ((error = packed_write_refs(&pack_file, backend)) < 0)
+		goto fail;
+
 	/* if we've written all the references properly, we can commit
 	 * the packfile to make the changes effective */
 	if ((error = git_filebuf_commit(&pack_file)) < 0)
@@ -1218,7 +1832,7 @@ out:
  * check with HEAD only which should cover 99% of all usage
  * scenarios (even 100% of the default ones).
  */
-static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref, const git_signature *who, const char *message)
+static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref, const git_oid *old, const git_signature *who, const char *message)
 {
 	int error;
 	git_oid old_id;
@@ -1229,7 +1843,9 @@ static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref
 		return 0;
 
 	/* if we can't resolve, we use {0}*40 as old id */
-	if (git_reference_name_to_id(&old_id, backend->repo, ref->name) < 0)
+	if (old)
+		git_oid_cpy(&old_id, old);
+	else if (git_reference_name_to_id(&old_id, backend->repo, ref->name) < 0)
 		memset(&old_id, 0, sizeof(old_id));
 
 	if ((error = git_reference_lookup(&head, backend->repo, GIT_HEAD_FILE)) < 0)
@@ -1342,7 +1958,7 @@ static int refdb_fs_backend__write_tail(
 		if (should_write) {
 			if ((error = reflog_append(backend, ref, NULL, NULL, who, message)) < 0)
 				goto on_error;
-			if ((error = maybe_append_head(backend, ref, who, message)) < 0)
+			if ((error = maybe_append_head(backend, ref, NULL, who, message)) < 0)
 				goto on_error;
 		}
 	}
@@ -1490,6 +2106,261 @@ cleanup:
 	return error;
 }
 
+/*
+ * Only direct references that are shared between worktrees can be
+ * stored in the packed-refs file.
+ */
+static bool batch_update_is_packed(const refdb_fs_update *update)
+{
+	return update->ref->type == GIT_REFERENCE_DIRECT &&
+		!is_per_worktree_ref(update->ref->name);
+}
+
+/*
+ * Check the updates against the current state of the references before
+ * anything is written, remembering their old values for the reflogs.
+ */
+static int batch_prepare(refdb_fs_backend *backend)
+{
+	refdb_fs_update *update;
+	git_reference *old_ref;
+	size_t i;
+	int error;
+
+	git_vector_foreach(&backend->batch, i, update) {
+		const char *name = update->ref->name;
+
+		if (!batch_update_is_packed(update))
+			continue;
+
+		if ((error = refdb_fs_backend__lookup(&old_ref, &backend->parent, name)) == GIT_ENOTFOUND) {
+			if (update->remove)
+				return error;
+
+			git_error_clear();
+			continue;
+		} else if (error < 0) {
+			return error;
+		}
+
+		if (old_ref->type == GIT_REFERENCE_DIRECT) {
+			git_oid_cpy(&update->old_id, &old_ref->target.oid);
+
+			/* Don't update if we have the same value */
+			if (!update->remove && !git_oid_cmp(&update->old_id, &update->ref->target.oid))
+				update->unchanged = 1;
+		}
+
+		git_reference_free(old_ref);
+	}
+
+	return 0;
+}
+
+/* Append the reflogs of the packed updates, once they are written */
+static int batch_append_reflogs(refdb_fs_backend *backend)
+{
+	refdb_fs_update *update;
+	size_t i;
+	int error, should_write;
+
+	git_vector_foreach(&backend->batch, i, update) {
+		if (!batch_update_is_packed(update) || update->remove ||
+		    update->unchanged || !update->update_reflog)
+			continue;
+
+		if ((error = should_write_reflog(&should_write, backend->repo, update->ref->name)) < 0)
+			return error;
+
+		if (should_write &&
+		    ((error = reflog_append(backend, update->ref, &update->old_id, NULL, update->sig, update->message)) < 0 ||
+		     (error = maybe_append_head(backend, update->ref, &update->old_id, update->sig, update->message)) < 0))
+			return error;
+	}
+
+	return 0;
+}
+
+/* Apply the updates to the packed references and write them out */
+static int batch_write_packed(git_filebuf *pack_file, refdb_fs_backend *backend)
+{
+	git_sortedcache *refcache = backend->refcache;
+	refdb_fs_update *update;
+	struct packref *ref;
+	size_t i, pos;
+	int error;
+
+	if ((error = packed_reload(backend)) < 0 ||
+	    (error = git_sortedcache_wlock(refcache)) < 0)
+		return error;
+
+	git_vector_foreach(&backend->batch, i, update) {
+		const char *name = update->ref->name;
+
+		if (!batch_update_is_packed(update) || update->unchanged)
+			continue;
+
+		if (update->remove) {
+			if (git_sortedcache_lookup_index(&pos, refcache, name) == 0 &&
+			    (error = git_sortedcache_remove(refcache, pos)) < 0)
+				break;
+
+			continue;
+		}
+
+		if ((error = git_sortedcache_upsert((void **)&ref, refcache, name)) < 0)
+			break;
+
+		git_oid_cpy(&ref->oid, &update->ref->target.oid);
+		memset(&ref->peel, 0, sizeof(git_oid));
+		ref->flags = 0;
+	}
+
+	if (!error)
+		error = packed_write_refs(pack_file, backend);
+
+	if (!error)
+		error = git_filebuf_commit(pack_file);
+
+	if (!error) {
+		git_sortedcache_updated(refcache);
+	} else {
+		/* the cache no longer matches the file; have it reloaded */
+		git_sortedcache_clear(refcache, false);
+		git_futils_filestamp_set(&refcache->stamp, NULL);
+	}
+
+	git_sortedcache_wunlock(refcache);
+	return error;
+}
+
+/*
+ * Write all of the updates of a batch.  Their references are locked
+ * already; the packable ones go into a single new packed-refs file,
+ * which replaces the old one atomically while those locks are held.
+ * Nothing is changed until then, so a failure leaves every reference
+ * and reflog as it was.  The loose files, which would shadow the new
+ * values, are removed afterwards, before their locks are released.
+ */
+static int batch_write(refdb_fs_backend *backend)
+{
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	refdb_fs_update *update;
+	size_t i;
+	int error, reflog_error;
+
+	git_vector_sort(&backend->batch);
+
+	/* Lock the packed-refs file before looking at the current values */
+	if ((error = packed_open(&pack_file, backend)) < 0)
+		return error;
+
+	if ((error = batch_prepare(backend)) < 0 ||
+	    (error = batch_write_packed(&pack_file, backend)) < 0)
+		goto done;
+
+	git_vector_foreach(&backend->batch, i, update) {
+		if (!batch_update_is_packed(update) || update->unchanged)
+			continue;
+
+		/*
+		 * If we fail to remove a loose file, write the new value
+		 * into it instead, so that the reference does not keep its
+		 * old one.  A reference that we fail to delete is reported.
+		 */
+		if (p_unlink(update->lock->file.path_original) < 0 && errno != ENOENT) {
+			if (!update->remove && loose_commit(&update->lock->file, update->ref) == 0)
+				continue;
+
+			if (!error) {
+				git_error_set(GIT_ERROR_OS, "failed to remove loose reference '%s'", update->ref->name);
+				error = -1;
+			}
+		}
+
+		/* the lock may have created directories that are now empty */
+		git_filebuf_cleanup(&update->lock->file);
+		refdb_fs_backend__prune_refs(backend, update->ref->name, "");
+	}
+
+	/* The remaining references cannot be packed; write them as loose files */
+	git_vector_foreach(&backend->batch, i, update) {
+		int write_error;
+
+		if (batch_update_is_packed(update))
+			continue;
+
+		if (update->remove)
+			write_error = refdb_fs_backend__delete_tail(&backend->parent,
+				&update->lock->file, update->ref->name, NULL, NULL);
+		else
+			write_error = refdb_fs_backend__write_tail(&backend->parent,
+				update->ref, &update->lock->file, update->update_reflog,
+				NULL, NULL, update->sig, update->message);
+
+		if (write_error < 0 && !error)
+			error = write_error;
+	}
+
+	/* The packed-refs file has the new values, whatever failed since */
+	if ((reflog_error = batch_append_reflogs(backend)) < 0 && !error)
+		error = reflog_error;
+
+done:
+	git_filebuf_cleanup(&pack_file);
+	return error;
+}
+
+static int refdb_fs_backend__begin_batch(git_refdb_backend *_backend)
+{
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	int error = 0;
+
+	if (batch_mutex_lock(backend) < 0)
+		return -1;
+
+	if (backend->batching) {
+		git_error_set(GIT_ERROR_REFERENCE, "a batch of reference updates is already in progress");
+		error = GIT_ELOCKED;
+	} else {
+		backend->batching = true;
+		backend->batch_owner = git_thread_currentid();
+		backend->batch_token = 0;
+	}
+
+	git_mutex_unlock(&backend->batch_lock);
+	return error;
+}
+
+static int refdb_fs_backend__end_batch(git_refdb_backend *_backend, int success)
+{
+	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	refdb_fs_update *update;
+	size_t i;
+	int error = 0;
+
+	/*
+	 * Only the owner records updates into the batch, so it is written
+	 * without the lock; the batch stays open until then, so that no
+	 * other one can be started meanwhile.
+	 */
+	if (success && backend->batch.length)
+		error = batch_write(backend);
+
+	git_vector_foreach(&backend->batch, i, update)
+		refdb_fs_update_free(update);
+
+	git_vector_clear(&backend->batch);
+
+	if (batch_mutex_lock(backend) < 0)
+		return -1;
+
+	backend->batching = false;
+	git_mutex_unlock(&backend->batch_lock);
+
+	return error;
+}
+
 static int refdb_reflog_fs__rename(git_refdb_backend *_backend, const char *old_name, const char *new_name);
 
 static int refdb_fs_backend__rename(
@@ -1572,10 +2443,19 @@ static int refdb_fs_backend__compress(git_refdb_backend *_backend)
 static void refdb_fs_backend__free(git_refdb_backend *_backend)
 {
 	refdb_fs_backend *backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+	refdb_fs_update *update;
+	size_t i;
 
 	assert(backend);
 
+	git_vector_foreach(&backend->batch, i, update)
+		refdb_fs_update_free(update);
+
+	git_vector_free(&backend->batch);
 	git_sortedcache_free(backend->refcache);
+	packed_map_free(backend);
+	git_mutex_free(&backend->batch_lock);
+	git_mutex_free(&backend->prlock);
 	git__free(backend->gitpath);
 	git__free(backend->commonpath);
 	git__free(backend);
@@ -1650,6 +2530,60 @@ static int reflog_alloc(git_reflog **reflog, const char *name)
 	return 0;
 }
 
+/*
+ * Parse the reflog entry on the parser's current line.  Lines that are
+ * not valid entries are skipped by returning a NULL entry.
+ */
+static int reflog_parse_entry(git_reflog_entry **out, git_parse_ctx *parser)
+{
+	git_reflog_entry *entry;
+	const char *sig;
+	char c;
+
+	*out = NULL;
+
+	entry = git__calloc(1, sizeof(*entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	if ((entry->committer = git__calloc(1, sizeof(*entry->committer))) == NULL)
+		goto fail;
+
+	if (git_parse_advance_oid(&entry->oid_old, parser) < 0 ||
+	    git_parse_advance_expected(parser, " ", 1) < 0 ||
+	    git_parse_advance_oid(&entry->oid_cur, parser) < 0)
+		goto skip;
+
+	sig = parser->line;
+	while (git_parse_peek(&c, parser, 0) == 0 && c != '\t' && c != '\n')
+		git_parse_advance_chars(parser, 1);
+
+	if (git_signature__parse(entry->committer, &sig, parser->line, NULL, 0) < 0)
+		goto skip;
+
+	if (c == '\t') {
+		size_t len;
+		git_parse_advance_chars(parser, 1);
+
+		len = parser->line_len;
+		if (len && parser->line[len - 1] == '\n')
+			len--;
+
+		if ((entry->msg = git__strndup(parser->line, len)) == NULL)
+			goto fail;
+	}
+
+	*out = entry;
+	return 0;
+
+skip:
+	git_reflog_entry__free(entry);
+	return 0;
+
+fail:
+	git_reflog_entry__free(entry);
+	return -1;
+}
+
 static int reflog_parse(git_reflog *log, const char *buf, size_t buf_size)
 {
 	git_parse_ctx parser = GIT_PARSE_CTX_INIT;
@@ -1659,52 +2593,224 @@ static int reflog_parse(git_reflog *log, const char *buf, size_t buf_size)
 
 	for (; parser.remain_len; git_parse_advance_line(&parser)) {
 		git_reflog_entry *entry;
-		const char *sig;
-		char c;
 
-		entry = git__calloc(1, sizeof(*entry));
-		GIT_ERROR_CHECK_ALLOC(entry);
-		entry->committer = git__calloc(1, sizeof(*entry->committer));
-		GIT_ERROR_CHECK_ALLOC(entry->committer);
+		if (reflog_parse_entry(&entry, &parser) < 0)
+			return -1;
 
-		if (git_parse_advance_oid(&entry->oid_old, &parser) < 0 ||
-		    git_parse_advance_expected(&parser, " ", 1) < 0 ||
-		    git_parse_advance_oid(&entry->oid_cur, &parser) < 0)
-			goto next;
+		if (entry && git_vector_insert(&log->entries, entry) < 0) {
+			git_reflog_entry__free(entry);
+			return -1;
+		}
+	}
 
-		sig = parser.line;
-		while (git_parse_peek(&c, &parser, 0) == 0 && c != '\t' && c != '\n')
-			git_parse_advance_chars(&parser, 1);
+	return 0;
+}
 
-		if (git_signature__parse(entry->committer, &sig, parser.line, NULL, 0) < 0)
-			goto next;
+#define REFLOG_TAIL_CHUNK_SIZE 8192
 
-		if (c == '\t') {
-			size_t len;
-			git_parse_advance_chars(&parser, 1);
+/*
+ * Reads the lines of a reflog backwards, starting at its end, so that
+ * the newest entries can be looked at without reading the whole file.
+ * `buf` holds the file contents starting at `offset`, of which only the
+ * first `end` bytes have not been returned yet.
+ */
+typedef struct {
+	git_file fd;
+	git_off_t offset;
+	git_buf buf;
+	size_t end;
+} reflog_tail;
 
-			len = parser.line_len;
-			if (parser.line[len - 1] == '\n')
-				len--;
+static int reflog_tail_open(reflog_tail *tail, const char *path)
+{
+	struct stat st;
 
-			entry->msg = git__strndup(parser.line, len);
-			GIT_ERROR_CHECK_ALLOC(entry->msg);
-		}
+	memset(tail, 0, sizeof(reflog_tail));
+	git_buf_init(&tail->buf, 0);
 
-		if ((git_vector_insert(&log->entries, entry)) < 0) {
-			git_reflog_entry__free(entry);
-			return -1;
-		}
+	if ((tail->fd = git_futils_open_ro(path)) < 0)
+		return tail->fd;
 
-		continue;
+	if (p_fstat(tail->fd, &st) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to stat '%s'", path);
+		p_close(tail->fd);
+		tail->fd = -1;
+		return -1;
+	}
 
-next:
-		git_reflog_entry__free(entry);
+	tail->offset = st.st_size;
+	return 0;
+}
+
+static void reflog_tail_close(reflog_tail *tail)
+{
+	if (tail->fd >= 0)
+		p_close(tail->fd);
+
+	git_buf_dispose(&tail->buf);
+}
+
+/* Prepend the chunk of the file that precedes the buffered data */
+static int reflog_tail_read_chunk(reflog_tail *tail)
+{
+	git_buf chunk = GIT_BUF_INIT;
+	size_t len = REFLOG_TAIL_CHUNK_SIZE;
+	int error;
+
+	if (tail->offset < (git_off_t)len)
+		len = (size_t)tail->offset;
+
+	if ((error = git_buf_grow(&chunk, len + tail->end + 1)) < 0)
+		return error;
+
+	if (p_lseek(tail->fd, tail->offset - len, SEEK_SET) < 0 ||
+	    p_read(tail->fd, chunk.ptr, len) != (ssize_t)len) {
+		git_error_set(GIT_ERROR_OS, "failed to read reflog");
+		git_buf_dispose(&chunk);
+		return -1;
+	}
+
+	chunk.size = len;
+	git_buf_put(&chunk, tail->buf.ptr, tail->end);
+
+	git_buf_swap(&chunk, &tail->buf);
+	git_buf_dispose(&chunk);
+
+	tail->offset -= len;
+	tail->end = tail->buf.size;
+
+	return git_buf_oom(&tail->buf) ? -1 : 0;
+}
+
+/*
+ * Return the line before the ones returned so far, without its line
+ * ending, and the offset in the file at which it starts.
+ */
+static int reflog_tail_prev(
+	const char **out,
+	size_t *out_len,
+	git_off_t *out_offset,
+	reflog_tail *tail)
+{
+	size_t start, end;
+	int error;
+
+	while (true) {
+		end = tail->end;
+
+		if (end && tail->buf.ptr[end - 1] == '\n')
+			end--;
+
+		for (start = end; start && tail->buf.ptr[start - 1] != '\n'; start--)
+			/* find the start of the line */;
+
+		if (start || !tail->offset)
+			break;
+
+		if ((error = reflog_tail_read_chunk(tail)) < 0)
+			return error;
+	}
+
+	if (!tail->end)
+		return GIT_ITEROVER;
+
+	*out = tail->buf.ptr + start;
+	*out_len = end - start;
+	*out_offset = tail->offset + start;
+
+	tail->end = start;
+	return 0;
+}
+
+/* Parse the entry before the ones returned so far, skipping invalid lines */
+static int reflog_tail_prev_entry(
+	git_reflog_entry **out,
+	git_off_t *out_offset,
+	reflog_tail *tail)
+{
+	git_parse_ctx parser = GIT_PARSE_CTX_INIT;
+	const char *line;
+	size_t line_len;
+	int error;
+
+	do {
+		if ((error = reflog_tail_prev(&line, &line_len, out_offset, tail)) < 0)
+			return error;
+
+		if (!line_len)
+			continue;
+
+		if ((error = git_parse_ctx_init(&parser, line, line_len)) < 0 ||
+		    (error = reflog_parse_entry(out, &parser)) < 0)
+			return error;
+	} while (!*out);
+
+	return 0;
+}
+
+/* Copy the contents of the file from `offset` to its end into `file` */
+static int reflog_tail_copy(git_filebuf *file, reflog_tail *tail, git_off_t offset)
+{
+	char buffer[REFLOG_TAIL_CHUNK_SIZE];
+	ssize_t read_bytes;
+	int error = 0;
+
+	if (p_lseek(tail->fd, offset, SEEK_SET) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to seek in reflog");
+		return -1;
+	}
+
+	while ((read_bytes = p_read(tail->fd, buffer, sizeof(buffer))) > 0)
+		if ((error = git_filebuf_write(file, buffer, read_bytes)) < 0)
+			return error;
+
+	if (read_bytes < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to read reflog");
+		return -1;
+	}
+
+	return 0;
+}
+
+typedef struct {
+	git_reflog_iterator parent;
+	reflog_tail tail;
+	git_reflog_entry *entry;
+} refdb_fs_reflog_iter;
+
+static int refdb_reflog_fs__iterator_next(
+	const git_reflog_entry **out, git_reflog_iterator *_iter)
+{
+	refdb_fs_reflog_iter *iter = GIT_CONTAINER_OF(_iter, refdb_fs_reflog_iter, parent);
+	git_off_t offset;
+	int error;
+
+	if (iter->entry) {
+		git_reflog_entry__free(iter->entry);
+		iter->entry = NULL;
 	}
 
+	if (iter->tail.fd < 0)
+		return GIT_ITEROVER;
+
+	if ((error = reflog_tail_prev_entry(&iter->entry, &offset, &iter->tail)) < 0)
+		return error;
+
+	*out = iter->entry;
 	return 0;
 }
 
+static void refdb_reflog_fs__iterator_free(git_reflog_iterator *_iter)
+{
+	refdb_fs_reflog_iter *iter = GIT_CONTAINER_OF(_iter, refdb_fs_reflog_iter, parent);
+
+	if (iter->entry)
+		git_reflog_entry__free(iter->entry);
+
+	reflog_tail_close(&iter->tail);
+	git__free(iter);
+}
+
 static int create_new_reflog_file(const char *filepath)
 {
 	int fd, error;
@@ -1927,6 +3033,113 @@ success:
 	return error;
 }
 
+static int refdb_reflog_fs__iterator(
+	git_reflog_iterator **out,
+	git_refdb_backend *_backend,
+	const char *name)
+{
+	refdb_fs_backend *backend;
+	refdb_fs_reflog_iter *iter;
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	assert(out && _backend && name);
+
+	backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+
+	iter = git__calloc(1, sizeof(refdb_fs_reflog_iter));
+	GIT_ERROR_CHECK_ALLOC(iter);
+
+	iter->parent.next = refdb_reflog_fs__iterator_next;
+	iter->parent.free = refdb_reflog_fs__iterator_free;
+	iter->tail.fd = -1;
+
+	if ((error = retrieve_reflog_path(&path, backend->repo, name)) < 0)
+		goto out;
+
+	/* A missing reflog simply has no entries */
+	if ((error = reflog_tail_open(&iter->tail, git_buf_cstr(&path))) == GIT_ENOTFOUND) {
+		git_error_clear();
+		error = 0;
+	}
+
+out:
+	git_buf_dispose(&path);
+
+	if (error < 0)
+		refdb_reflog_fs__iterator_free(&iter->parent);
+	else
+		*out = &iter->parent;
+
+	return error;
+}
+
+/*
+ * Entries are appended to the end of a reflog, so the ones to keep are
+ * a contiguous tail of the file: find where it starts by reading the
+ * file backwards and copy it over without parsing or re-serializing
+ * the rest of the log.
+ */
+static int refdb_reflog_fs__truncate(
+	git_refdb_backend *_backend,
+	const char *name,
+	size_t keep)
+{
+	refdb_fs_backend *backend;
+	git_filebuf fbuf = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_reflog_entry *entry;
+	reflog_tail tail;
+	git_off_t cut;
+	size_t i;
+	int error;
+
+	assert(_backend && name);
+
+	backend = GIT_CONTAINER_OF(_backend, refdb_fs_backend, parent);
+
+	if (!has_reflog(backend->repo, name))
+		return 0;
+
+	memset(&tail, 0, sizeof(reflog_tail));
+	tail.fd = -1;
+
+	if ((error = retrieve_reflog_path(&path, backend->repo, name)) < 0 ||
+	    (error = lock_reflog(&fbuf, backend, name)) < 0 ||
+	    (error = reflog_tail_open(&tail, git_buf_cstr(&path))) < 0)
+		goto cleanup;
+
+	cut = tail.offset;
+
+	for (i = 0; i < keep; i++) {
+		if ((error = reflog_tail_prev_entry(&entry, &cut, &tail)) < 0)
+			break;
+
+		git_reflog_entry__free(entry);
+	}
+
+	/* There are no more than `keep` entries; leave the log alone */
+	if (error == GIT_ITEROVER) {
+		error = 0;
+		goto cleanup;
+	}
+
+	if (error < 0 || cut == 0)
+		goto cleanup;
+
+	if ((error = reflog_tail_copy(&fbuf, &tail, cut)) < 0)
+		goto cleanup;
+
+	error = git_filebuf_commit(&fbuf);
+
+cleanup:
+	git_filebuf_cleanup(&fbuf);
+	reflog_tail_close(&tail);
+	git_buf_dispose(&path);
+
+	return error;
+}
+
 /* Append to the reflog, must be called under reference lock */
 static int reflog_append(refdb_fs_backend *backend, const git_reference *ref, const git_oid *old, const git_oid *new, const git_signature *who, const char *message)
 {
@@ -2131,6 +3344,17 @@ int git_refdb_backend_fs(
 
 	backend->repo = repository;
 
+	if (git_mutex_init(&backend->prlock) < 0) {
+		git__free(backend);
+		return -1;
+	}
+
+	if (git_mutex_init(&backend->batch_lock) < 0) {
+		git_mutex_free(&backend->prlock);
+		git__free(backend);
+		return -1;
+	}
+
 	if (repository->gitdir) {
 		backend->gitpath = setup_namespace(repository, repository->gitdir);
 
@@ -2148,7 +3372,8 @@ int git_refdb_backend_fs(
 	if (git_buf_joinpath(&gitpath, backend->commonpath, GIT_PACKEDREFS_FILE) < 0 ||
 		git_sortedcache_new(
 			&backend->refcache, offsetof(struct packref, name),
-			NULL, NULL, packref_cmp, git_buf_cstr(&gitpath)) < 0)
+			NULL, NULL, packref_cmp, git_buf_cstr(&gitpath)) < 0 ||
+		git_vector_init(&backend->batch, 0, refdb_fs_update_cmp) < 0)
 		goto fail;
 
 	git_buf_dispose(&gitpath);
@@ -2175,6 +3400,8 @@ int git_refdb_backend_fs(
 	backend->parent.compress = &refdb_fs_backend__compress;
 	backend->parent.lock = &refdb_fs_backend__lock;
 	backend->parent.unlock = &refdb_fs_backend__unlock;
+	backend->parent.begin_batch = &refdb_fs_backend__begin_batch;
+	backend->parent.end_batch = &refdb_fs_backend__end_batch;
 	backend->parent.has_log = &refdb_reflog_fs__has_log;
 	backend->parent.ensure_log = &refdb_reflog_fs__ensure_log;
 	backend->parent.free = &refdb_fs_backend__free;
@@ -2182,11 +3409,16 @@ int git_refdb_backend_fs(
 	backend->parent.reflog_write = &refdb_reflog_fs__write;
 	backend->parent.reflog_rename = &refdb_reflog_fs__rename;
 	backend->parent.reflog_delete = &refdb_reflog_fs__delete;
+	backend->parent.reflog_iterator = &refdb_reflog_fs__iterator;
+	backend->parent.reflog_truncate = &refdb_reflog_fs__truncate;
 
 	*backend_out = (git_refdb_backend *)backend;
 	return 0;
 
 fail:
+	git_sortedcache_free(backend->refcache);
+	git_mutex_free(&backend->batch_lock);
+	git_mutex_free(&backend->prlock);
 	git_buf_dispose(&gitpath);
 	git__free(backend->gitpath);
 	git__free(backend->commonpath);
@@ -0,0 +1,2047 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+
+#include "refs.h"
+#include "repository.h"
+#include "futils.h"
+#include "filebuf.h"
+#include "pool.h"
+#include "reflog.h"
+#include "refdb.h"
+#include "reftable.h"
+#include "wildmatch.h"
+
+#include <git2/refdb.h>
+#include <git2/sys/refdb_backend.h>
+#include <git2/sys/refs.h>
+#include <git2/sys/reflog.h>
+
+/*
+ * References are stored in a stack of reftables, listed oldest first in
+ * `tables.list`.  Every update writes a new table on top of the stack;
+ * newer tables shadow the records of older ones, and deletions are
+ * recorded as tombstones until the whole stack is compacted.
+ */
+
+#define STACK_READ_RETRIES 5
+
+/*
+ * Reflogs that exist but have no entries are recorded by a log entry
+ * with null ids and an empty signature and message.
+ */
+#define LOG_IS_MARKER(log) \
+	(git_oid_is_zero(&(log)->old_id) && git_oid_is_zero(&(log)->new_id) && \
+	 !*(log)->name && !*(log)->email && !*(log)->message)
+
+typedef struct {
+	git_refcount rc;
+	git_vector names;
+	git_vector tables;
+	uint64_t max_update_index;
+} reftable_stack;
+
+typedef struct {
+	git_pool pool;
+	git_vector refs;
+	git_vector logs;
+} reftable_batch;
+
+typedef struct {
+	git_refdb_backend parent;
+
+	git_repository *repo;
+	char *dir;
+	char *list_path;
+	int fsync;
+
+	git_mutex lock; /* protects `stack` and `stamp` */
+	reftable_stack *stack;
+	git_futils_filestamp stamp;
+
+	/*
+	 * While `tables.list` is locked, updates are queued in `batch` and
+	 * written as a single table when the last lock is released.  The
+	 * batch belongs to the thread that opened it; locks that are taken
+	 * with its token join it.
+	 */
+	git_mutex batch_lock; /* protects the fields below */
+	git_filebuf lockfile;
+	size_t lock_count;
+	bool failed;
+	size_t owner;
+	uintptr_t token;
+	reftable_batch batch;
+} refdb_reftable;
+
+/* Whether an update may be part of a batch that is open already */
+typedef enum {
+	BATCH_EXCLUSIVE,   /* never */
+	BATCH_JOIN_TOKEN,  /* with the token of a lock that its caller holds */
+	BATCH_JOIN_THREAD, /* from the thread that opened the batch */
+} batch_join_t;
+
+static int ref_cmp(const void *a_, const void *b_)
+{
+	const git_reftable_ref *a = a_, *b = b_;
+	return strcmp(a->name, b->name);
+}
+
+static int log_cmp(const void *a_, const void *b_)
+{
+	const git_reftable_log *a = a_, *b = b_;
+	int cmp = strcmp(a->refname, b->refname);
+
+	if (cmp)
+		return cmp;
+
+	/* newest entries first */
+	return (a->update_index < b->update_index) - (a->update_index > b->update_index);
+}
+
+static int ref_error_notfound(const char *name)
+{
+	git_error_set(GIT_ERROR_REFERENCE, "reference '%s' not found", name);
+	return GIT_ENOTFOUND;
+}
+
+/*
+ * Stack handling
+ */
+
+static void stack_free(reftable_stack *stack)
+{
+	git_reftable *table;
+	size_t i;
+
+	if (!stack)
+		return;
+
+	git_vector_foreach(&stack->tables, i, table)
+		git_reftable_free(table);
+
+	git_vector_free(&stack->tables);
+	git_vector_free_deep(&stack->names);
+	git__free(stack);
+}
+
+static void stack_decref(reftable_stack *stack)
+{
+	if (stack)
+		GIT_REFCOUNT_DEC(stack, stack_free);
+}
+
+static int stack_read(reftable_stack **out, refdb_reftable *backend)
+{
+	reftable_stack *stack;
+	git_buf contents = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_reftable *table;
+	char *line, *next, *name;
+	int error;
+
+	stack = git__calloc(1, sizeof(reftable_stack));
+	GIT_ERROR_CHECK_ALLOC(stack);
+	GIT_REFCOUNT_INC(stack);
+
+	if ((error = git_vector_init(&stack->names, 0, NULL)) < 0 ||
+	    (error = git_vector_init(&stack->tables, 0, NULL)) < 0)
+		goto done;
+
+	if ((error = git_futils_readbuffer(&contents, backend->list_path)) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	for (line = contents.ptr; *line; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if (!*line)
+			continue;
+
+		if ((name = git__strdup(line)) == NULL ||
+		    git_vector_insert(&stack->names, name) < 0) {
+			git__free(name);
+			error = -1;
+			goto done;
+		}
+
+		/* a missing table means the stack was compacted underneath us */
+		if ((error = git_buf_joinpath(&path, backend->dir, name)) < 0 ||
+		    (error = git_reftable_open(&table, path.ptr)) < 0)
+			goto done;
+
+		if ((error = git_vector_insert(&stack->tables, table)) < 0) {
+			git_reftable_free(table);
+			goto done;
+		}
+
+		stack->max_update_index = git_reftable_max_update_index(table);
+	}
+
+done:
+	if (error < 0)
+		stack_free(stack);
+	else
+		*out = stack;
+
+	git_buf_dispose(&contents);
+	git_buf_dispose(&path);
+	return error;
+}
+
+/* Get the current stack, reloading it if `tables.list` has changed */
+static int stack_get(reftable_stack **out, refdb_reftable *backend)
+{
+	reftable_stack *stack = NULL;
+	int changed, retries = 0, error = 0;
+
+	if (git_mutex_lock(&backend->lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "unable to lock reftable stack");
+		return -1;
+	}
+
+	changed = git_futils_filestamp_check(&backend->stamp, backend->list_path);
+
+	if (changed == GIT_ENOTFOUND) {
+		changed = !backend->stack || backend->stack->tables.length > 0;
+		git_futils_filestamp_set(&backend->stamp, NULL);
+	}
+
+	if (changed) {
+		do {
+			error = stack_read(&stack, backend);
+		} while (error == GIT_ENOTFOUND && ++retries < STACK_READ_RETRIES);
+
+		if (error < 0) {
+			git_futils_filestamp_set(&backend->stamp, NULL);
+			goto done;
+		}
+
+		stack_decref(backend->stack);
+		backend->stack = stack;
+	}
+
+	GIT_REFCOUNT_INC(backend->stack);
+	*out = backend->stack;
+
+done:
+	git_mutex_unlock(&backend->lock);
+	return error;
+}
+
+/*
+ * Forget the stamp of `tables.list` after we've written it ourselves,
+ * so that a rewrite within the stamp's resolution is not missed.
+ */
+static void stack_invalidate(refdb_reftable *backend)
+{
+	if (git_mutex_lock(&backend->lock) < 0)
+		return;
+
+	git_futils_filestamp_set(&backend->stamp, NULL);
+	git_mutex_unlock(&backend->lock);
+}
+
+static int ref_from_record(git_reference **out, const git_reftable_ref *rec)
+{
+	if (rec->type == GIT_REFTABLE_REF_DELETION)
+		return GIT_ENOTFOUND;
+
+	if (!out)
+		return 0;
+
+	if (rec->type == GIT_REFTABLE_REF_SYMBOLIC)
+		*out = git_reference__alloc_symbolic(rec->name, rec->target);
+	else
+		*out = git_reference__alloc(rec->name, &rec->id,
+			rec->type == GIT_REFTABLE_REF_PEELED ? &rec->peel : NULL);
+
+	GIT_ERROR_CHECK_ALLOC(*out);
+	return 0;
+}
+
+/* Find the newest record of `name`; `out` may be NULL */
+static int stack_read_ref(git_reference **out, reftable_stack *stack, const char *name)
+{
+	git_reftable_iter *iter = NULL;
+	git_reftable_ref rec;
+	size_t i = stack->tables.length;
+	int error = GIT_ENOTFOUND;
+
+	while (i-- > 0) {
+		if ((error = git_reftable_iter_new(&iter, git_vector_get(&stack->tables, i))) < 0 ||
+		    (error = git_reftable_iter_seek_ref(iter, name)) < 0)
+			break;
+
+		error = git_reftable_iter_next_ref(&rec, iter);
+
+		if (error == 0 && !strcmp(rec.name, name)) {
+			error = ref_from_record(out, &rec);
+			break;
+		}
+
+		git_reftable_iter_free(iter);
+		iter = NULL;
+
+		if (error < 0 && error != GIT_ITEROVER)
+			return error;
+
+		error = GIT_ENOTFOUND;
+	}
+
+	git_reftable_iter_free(iter);
+	return error;
+}
+
+/*
+ * Merged iteration over a range of the stack.  Records are returned in
+ * key order; of records with the same key, only the one in the newest
+ * table is returned.
+ */
+
+typedef struct {
+	git_reftable_iter *iter;
+	git_reftable_ref ref;
+	git_reftable_log log;
+	bool valid;
+} merged_sub;
+
+typedef struct {
+	bool logs;
+	bool keep_deletions;
+	merged_sub *subs;
+	size_t count;
+	size_t current;
+} merged_iter;
+
+static void merged_iter_dispose(merged_iter *it)
+{
+	size_t i;
+
+	for (i = 0; i < it->count; i++)
+		git_reftable_iter_free(it->subs[i].iter);
+
+	git__free(it->subs);
+	memset(it, 0, sizeof(*it));
+}
+
+static int merged_iter_init(
+	merged_iter *it,
+	reftable_stack *stack,
+	size_t start,
+	bool logs,
+	bool keep_deletions)
+{
+	size_t i;
+
+	memset(it, 0, sizeof(*it));
+	it->logs = logs;
+	it->keep_deletions = keep_deletions;
+
+	if (start >= stack->tables.length)
+		return 0;
+
+	it->subs = git__calloc(stack->tables.length - start, sizeof(merged_sub));
+	GIT_ERROR_CHECK_ALLOC(it->subs);
+
+	for (i = start; i < stack->tables.length; i++) {
+		if (git_reftable_iter_new(&it->subs[it->count].iter,
+				git_vector_get(&stack->tables, i)) < 0) {
+			merged_iter_dispose(it);
+			return -1;
+		}
+
+		it->count++;
+	}
+
+	it->current = it->count;
+	return 0;
+}
+
+static int merged_sub_advance(merged_iter *it, merged_sub *sub)
+{
+	int error;
+
+	if (it->logs)
+		error = git_reftable_iter_next_log(&sub->log, sub->iter);
+	else
+		error = git_reftable_iter_next_ref(&sub->ref, sub->iter);
+
+	sub->valid = (error == 0);
+	return (error == GIT_ITEROVER) ? 0 : error;
+}
+
+static int merged_sub_cmp(merged_iter *it, merged_sub *a, merged_sub *b)
+{
+	return it->logs ? log_cmp(&a->log, &b->log) : ref_cmp(&a->ref, &b->ref);
+}
+
+static int merged_iter_seek(merged_iter *it, const char *key)
+{
+	size_t i;
+	int error;
+
+	for (i = 0; i < it->count; i++) {
+		if (it->logs)
+			error = git_reftable_iter_seek_log(it->subs[i].iter, key);
+		else
+			error = git_reftable_iter_seek_ref(it->subs[i].iter, key);
+
+		if (error < 0 || (error = merged_sub_advance(it, &it->subs[i])) < 0)
+			return error;
+	}
+
+	it->current = it->count;
+	return 0;
+}
+
+static int merged_iter_next(merged_sub **out, merged_iter *it)
+{
+	merged_sub *sub;
+	size_t i, best;
+	int error;
+
+	for (;;) {
+		if (it->current < it->count &&
+		    (error = merged_sub_advance(it, &it->subs[it->current])) < 0)
+			return error;
+
+		/* Of equal keys, the one from the newest table wins */
+		for (best = it->count, i = it->count; i-- > 0; ) {
+			if (it->subs[i].valid && (best == it->count ||
+			    merged_sub_cmp(it, &it->subs[i], &it->subs[best]) < 0))
+				best = i;
+		}
+
+		if ((it->current = best) == it->count)
+			return GIT_ITEROVER;
+
+		sub = &it->subs[best];
+
+		for (i = 0; i < best; i++) {
+			if (it->subs[i].valid &&
+			    !merged_sub_cmp(it, &it->subs[i], sub) &&
+			    (error = merged_sub_advance(it, &it->subs[i])) < 0)
+				return error;
+		}
+
+		if (!it->keep_deletions &&
+		    (it->logs ? sub->log.deletion :
+				sub->ref.type == GIT_REFTABLE_REF_DELETION))
+			continue;
+
+		*out = sub;
+		return 0;
+	}
+}
+
+static int merged_iter_next_ref(git_reftable_ref **out, merged_iter *it)
+{
+	merged_sub *sub;
+	int error;
+
+	if ((error = merged_iter_next(&sub, it)) == 0)
+		*out = &sub->ref;
+
+	return error;
+}
+
+static int merged_iter_next_log(git_reftable_log **out, merged_iter *it)
+{
+	merged_sub *sub;
+	int error;
+
+	if ((error = merged_iter_next(&sub, it)) == 0)
+		*out = &sub->log;
+
+	return error;
+}
+
+static int stack_has_log(reftable_stack *stack, const char *refname)
+{
+	merged_iter it;
+	git_reftable_log *log;
+	int error;
+
+	if ((error = merged_iter_init(&it, stack, 0, true, false)) < 0)
+		return error;
+
+	if ((error = merged_iter_seek(&it, refname)) == 0 &&
+	    (error = merged_iter_next_log(&log, &it)) == 0)
+		error = !strcmp(log->refname, refname);
+	else if (error == GIT_ITEROVER)
+		error = 0;
+
+	merged_iter_dispose(&it);
+	return error;
+}
+
+static git_reftable_log *log_dup(git_pool *pool, const git_reftable_log *src, const char *refname)
+{
+	git_reftable_log *log;
+
+	if ((log = git_pool_mallocz(pool, sizeof(git_reftable_log))) == NULL)
+		return NULL;
+
+	*log = *src;
+
+	if ((log->refname = git_pool_strdup(pool, refname)) == NULL)
+		return NULL;
+
+	if (!src->deletion &&
+	    ((log->name = git_pool_strdup(pool, src->name)) == NULL ||
+	     (log->email = git_pool_strdup(pool, src->email)) == NULL ||
+	     (log->message = git_pool_strdup(pool, src->message)) == NULL))
+		return NULL;
+
+	return log;
+}
+
+/* Collect the live log entries of `refname`, newest first */
+static int stack_read_logs(
+	git_vector *out,
+	git_pool *pool,
+	reftable_stack *stack,
+	const char *refname)
+{
+	merged_iter it;
+	git_reftable_log *log, *dup;
+	int error;
+
+	if ((error = merged_iter_init(&it, stack, 0, true, false)) < 0)
+		return error;
+
+	if ((error = merged_iter_seek(&it, refname)) < 0)
+		goto done;
+
+	while ((error = merged_iter_next_log(&log, &it)) == 0 &&
+	       !strcmp(log->refname, refname)) {
+		if ((dup = log_dup(pool, log, refname)) == NULL ||
+		    git_vector_insert(out, dup) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+done:
+	merged_iter_dispose(&it);
+	return error;
+}
+
+/*
+ * Writing
+ */
+
+static int write_table(
+	git_buf *name_out,
+	refdb_reftable *backend,
+	uint64_t min_update_index,
+	uint64_t max_update_index,
+	git_vector *refs,
+	git_vector *logs)
+{
+	git_reftable_ref *ref_array = NULL, *ref;
+	git_reftable_log *log_array = NULL, *log;
+	git_buf data = GIT_BUF_INIT, tmp_name = GIT_BUF_INIT,
+		tmp_path = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	size_t i;
+	int fd = -1, error = -1;
+
+	if (refs->length &&
+	    (ref_array = git__calloc(refs->length, sizeof(git_reftable_ref))) == NULL)
+		goto done;
+
+	if (logs->length &&
+	    (log_array = git__calloc(logs->length, sizeof(git_reftable_log))) == NULL)
+		goto done;
+
+	git_vector_foreach(refs, i, ref)
+		ref_array[i] = *ref;
+	git_vector_foreach(logs, i, log)
+		log_array[i] = *log;
+
+	if ((error = git_reftable_write(&data, GIT_REFTABLE_BLOCK_SIZE,
+			min_update_index, max_update_index,
+			ref_array, refs->length, log_array, logs->length)) < 0)
+		goto done;
+
+	if ((error = git_futils_mkdir(backend->dir, 0777, GIT_MKDIR_PATH)) < 0 ||
+	    (error = git_buf_joinpath(&tmp_name, backend->dir, "tmp_table")) < 0 ||
+	    (error = fd = git_futils_mktmp(&tmp_path, tmp_name.ptr, GIT_REFS_FILE_MODE)) < 0)
+		goto done;
+
+	if (p_write(fd, data.ptr, data.size) < 0 ||
+	    (backend->fsync && p_fsync(fd) < 0)) {
+		git_error_set(GIT_ERROR_OS, "failed to write reftable '%s'", tmp_path.ptr);
+		error = -1;
+		goto done;
+	}
+
+	p_close(fd);
+	fd = -1;
+
+	git_buf_clear(name_out);
+	git_buf_printf(name_out, "0x%012" PRIx64 "-0x%012" PRIx64 "-%s.ref",
+		min_update_index, max_update_index,
+		tmp_path.ptr + tmp_path.size - 6);
+
+	if ((error = git_buf_joinpath(&path, backend->dir, name_out->ptr)) < 0)
+		goto done;
+
+	if (p_rename(tmp_path.ptr, path.ptr) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to rename reftable '%s'", tmp_path.ptr);
+		error = -1;
+	}
+
+done:
+	if (fd >= 0)
+		p_close(fd);
+
+	if (error < 0 && tmp_path.size)
+		p_unlink(tmp_path.ptr);
+
+	git__free(ref_array);
+	git__free(log_array);
+	git_buf_dispose(&data);
+	git_buf_dispose(&tmp_name);
+	git_buf_dispose(&tmp_path);
+	git_buf_dispose(&path);
+	return error;
+}
+
+/*
+ * Replace the tables `[start, end)` of `stack` with `name` in the locked
+ * `tables.list` and commit it.
+ */
+static int write_list(
+	refdb_reftable *backend,
+	reftable_stack *stack,
+	size_t start,
+	size_t end,
+	const char *name)
+{
+	const char *table;
+	size_t i;
+	int error;
+
+	git_vector_foreach(&stack->names, i, table) {
+		if (i == start)
+			git_filebuf_printf(&backend->lockfile, "%s\n", name);
+		if (i < start || i >= end)
+			git_filebuf_printf(&backend->lockfile, "%s\n", table);
+	}
+
+	if (start == stack->names.length)
+		git_filebuf_printf(&backend->lockfile, "%s\n", name);
+
+	error = git_filebuf_commit(&backend->lockfile);
+	stack_invalidate(backend);
+
+	return error;
+}
+
+static void remove_table(refdb_reftable *backend, const char *name)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	/* readers may still have the table open, so this may fail */
+	if (git_buf_joinpath(&path, backend->dir, name) == 0)
+		p_unlink(path.ptr);
+
+	git_buf_dispose(&path);
+}
+
+/*
+ * Merge the tables `[start, end)` of the stack into a new table.  Unless
+ * the whole stack is merged, deletions must be kept to shadow the
+ * records of older tables.
+ */
+static int stack_merge(git_buf *name_out, refdb_reftable *backend, reftable_stack *stack, size_t start)
+{
+	git_pool pool;
+	git_vector refs = GIT_VECTOR_INIT, logs = GIT_VECTOR_INIT;
+	merged_iter it;
+	git_reftable_ref *ref, *ref_dup;
+	git_reftable_log *log, *log_dup_;
+	bool keep_deletions = start > 0;
+	int error;
+
+	git_pool_init(&pool, 1);
+
+	if ((error = merged_iter_init(&it, stack, start, false, keep_deletions)) < 0)
+		goto done;
+
+	if ((error = merged_iter_seek(&it, "")) < 0)
+		goto done;
+
+	while ((error = merged_iter_next_ref(&ref, &it)) == 0) {
+		if ((ref_dup = git_pool_malloc(&pool, sizeof(git_reftable_ref))) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		*ref_dup = *ref;
+
+		if ((ref_dup->name = git_pool_strdup(&pool, ref->name)) == NULL ||
+		    (ref->target &&
+		     (ref_dup->target = git_pool_strdup(&pool, ref->target)) == NULL) ||
+		    git_vector_insert(&refs, ref_dup) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	merged_iter_dispose(&it);
+
+	if ((error = merged_iter_init(&it, stack, start, true, keep_deletions)) < 0 ||
+	    (error = merged_iter_seek(&it, "")) < 0)
+		goto done;
+
+	while ((error = merged_iter_next_log(&log, &it)) == 0) {
+		if ((log_dup_ = log_dup(&pool, log, log->refname)) == NULL ||
+		    git_vector_insert(&logs, log_dup_) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	error = write_table(name_out, backend,
+		git_reftable_min_update_index(git_vector_get(&stack->tables, start)),
+		stack->max_update_index, &refs, &logs);
+
+done:
+	merged_iter_dispose(&it);
+	git_vector_free(&refs);
+	git_vector_free(&logs);
+	git_pool_clear(&pool);
+	return error;
+}
+
+/*
+ * Find the tables to compact so that, from the top of the stack down,
+ * every table is at least twice the size of all the tables above it.
+ */
+static size_t stack_compaction_start(reftable_stack *stack)
+{
+	size_t i, start = stack->tables.length;
+	size_t sum = 0;
+
+	for (i = stack->tables.length; i-- > 0; ) {
+		size_t size = git_reftable_size(git_vector_get(&stack->tables, i));
+
+		if (sum && size >= 2 * sum)
+			break;
+
+		sum += size;
+		start = i;
+	}
+
+	return start;
+}
+
+static int stack_compact(refdb_reftable *backend, bool full)
+{
+	reftable_stack *stack = NULL;
+	git_buf name = GIT_BUF_INIT;
+	git_vector obsolete = GIT_VECTOR_INIT;
+	size_t start, i;
+	int flags = 0, error;
+
+	if (backend->fsync)
+		flags |= GIT_FILEBUF_FSYNC;
+
+	if ((error = git_filebuf_open(&backend->lockfile, backend->list_path,
+			flags, GIT_REFS_FILE_MODE)) < 0)
+		return error;
+
+	stack_invalidate(backend);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		goto done;
+
+	start = full ? 0 : stack_compaction_start(stack);
+
+	/*
+	 * Merging a single table only makes sense for a full compaction,
+	 * which drops its deletions.
+	 */
+	if (stack->tables.length - start < (full ? 1 : 2))
+		goto done;
+
+	if ((error = stack_merge(&name, backend, stack, start)) < 0)
+		goto done;
+
+	for (i = start; i < stack->names.length; i++) {
+		if ((error = git_vector_insert(&obsolete, git_vector_get(&stack->names, i))) < 0)
+			goto done;
+	}
+
+	if ((error = write_list(backend, stack, start, stack->names.length, name.ptr)) < 0) {
+		remove_table(backend, name.ptr);
+		goto done;
+	}
+
+	for (i = 0; i < obsolete.length; i++)
+		remove_table(backend, git_vector_get(&obsolete, i));
+
+done:
+	git_filebuf_cleanup(&backend->lockfile);
+	git_vector_free(&obsolete);
+	git_buf_dispose(&name);
+	stack_decref(stack);
+	return error;
+}
+
+/* Write the queued updates as a new table on top of the stack */
+static int stack_add(refdb_reftable *backend, reftable_batch *batch)
+{
+	reftable_stack *stack = NULL;
+	git_reftable_ref *ref;
+	git_reftable_log *log;
+	git_buf name = GIT_BUF_INIT;
+	uint64_t min, max;
+	size_t i;
+	int error;
+
+	if (!batch->refs.length && !batch->logs.length) {
+		git_filebuf_cleanup(&backend->lockfile);
+		return 0;
+	}
+
+	stack_invalidate(backend);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		goto done;
+
+	min = max = stack->max_update_index + 1;
+
+	git_vector_foreach(&batch->refs, i, ref)
+		ref->update_index = min;
+
+	/* new log entries get consecutive indices, in the order they were added */
+	git_vector_foreach(&batch->logs, i, log) {
+		if (!log->deletion)
+			log->update_index = max++;
+	}
+
+	if (max > min)
+		max--;
+
+	/* of several updates to a reference, the last one wins */
+	git_vector_uniq(&batch->refs, NULL);
+	git_vector_uniq(&batch->logs, NULL);
+
+	if ((error = write_table(&name, backend, min, max, &batch->refs, &batch->logs)) < 0)
+		goto done;
+
+	if ((error = write_list(backend, stack, stack->names.length,
+			stack->names.length, name.ptr)) < 0) {
+		remove_table(backend, name.ptr);
+		goto done;
+	}
+
+	/* Compaction is opportunistic, we don't fight other writers for it */
+	if ((error = stack_compact(backend, false)) == GIT_ELOCKED) {
+		git_error_clear();
+		error = 0;
+	}
+
+done:
+	git_filebuf_cleanup(&backend->lockfile);
+	git_buf_dispose(&name);
+	stack_decref(stack);
+	return error;
+}
+
+/*
+ * Lock the stack for an update.  Transactions hold the lock from the
+ * first reference they lock until the last one is unlocked; only the
+ * operations they perform themselves may `join` their batch.
+ */
+static int batch_begin(refdb_reftable *backend, batch_join_t join, uintptr_t token)
+{
+	int flags = GIT_FILEBUF_CREATE_LEADING_DIRS, error = 0;
+
+	if (git_mutex_lock(&backend->batch_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock the reftable batch");
+		return -1;
+	}
+
+	if (backend->lock_count > 0) {
+		if ((join == BATCH_JOIN_TOKEN && token == backend->token) ||
+		    (join == BATCH_JOIN_THREAD && backend->owner == git_thread_currentid())) {
+			backend->lock_count++;
+		} else {
+			git_error_set(GIT_ERROR_REFERENCE,
+				"the reference database is locked by a transaction");
+			error = GIT_ELOCKED;
+		}
+
+		goto done;
+	}
+
+	if (backend->fsync)
+		flags |= GIT_FILEBUF_FSYNC;
+
+	if ((error = git_filebuf_open(&backend->lockfile, backend->list_path,
+			flags, GIT_REFS_FILE_MODE)) < 0)
+		goto done;
+
+	git_pool_init(&backend->batch.pool, 1);
+	backend->failed = false;
+
+	if (git_vector_init(&backend->batch.refs, 0, ref_cmp) < 0 ||
+	    git_vector_init(&backend->batch.logs, 0, log_cmp) < 0) {
+		git_filebuf_cleanup(&backend->lockfile);
+		git_vector_free(&backend->batch.refs);
+		git_pool_clear(&backend->batch.pool);
+		error = -1;
+		goto done;
+	}
+
+	backend->lock_count = 1;
+	backend->owner = git_thread_currentid();
+	backend->token++;
+
+done:
+	git_mutex_unlock(&backend->batch_lock);
+	return error;
+}
+
+/*
+ * Release a lock taken by `batch_begin`.  When the last one is released
+ * the queued updates are written, unless any of them failed.
+ */
+static int batch_end(refdb_reftable *backend, int error)
+{
+	if (git_mutex_lock(&backend->batch_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to lock the reftable batch");
+		return -1;
+	}
+
+	if (error < 0)
+		backend->failed = true;
+
+	if (--backend->lock_count > 0)
+		goto done;
+
+	if (backend->failed)
+		git_filebuf_cleanup(&backend->lockfile);
+	else
+		error = stack_add(backend, &backend->batch);
+
+	git_vector_free(&backend->batch.refs);
+	git_vector_free(&backend->batch.logs);
+	git_pool_clear(&backend->batch.pool);
+
+done:
+	git_mutex_unlock(&backend->batch_lock);
+	return error;
+}
+
+static int batch_add_ref(refdb_reftable *backend, const char *name, const git_reference *ref)
+{
+	reftable_batch *batch = &backend->batch;
+	git_reftable_ref *rec;
+
+	rec = git_pool_mallocz(&batch->pool, sizeof(git_reftable_ref));
+	GIT_ERROR_CHECK_ALLOC(rec);
+
+	if ((rec->name = git_pool_strdup(&batch->pool, name)) == NULL)
+		return -1;
+
+	if (!ref) {
+		rec->type = GIT_REFTABLE_REF_DELETION;
+	} else if (ref->type == GIT_REFERENCE_SYMBOLIC) {
+		rec->type = GIT_REFTABLE_REF_SYMBOLIC;
+
+		if ((rec->target = git_pool_strdup(&batch->pool, ref->target.symbolic)) == NULL)
+			return -1;
+	} else {
+		rec->type = GIT_REFTABLE_REF_DIRECT;
+		git_oid_cpy(&rec->id, &ref->target.oid);
+
+		if (!git_oid_is_zero(&ref->peel)) {
+			rec->type = GIT_REFTABLE_REF_PEELED;
+			git_oid_cpy(&rec->peel, &ref->peel);
+		}
+	}
+
+	return git_vector_insert(&batch->refs, rec);
+}
+
+static int batch_add_log(
+	refdb_reftable *backend,
+	const char *refname,
+	const git_oid *old_id,
+	const git_oid *new_id,
+	const git_signature *who,
+	const char *message)
+{
+	reftable_batch *batch = &backend->batch;
+	git_reftable_log *log;
+	char *msg, *p;
+	size_t len;
+
+	log = git_pool_mallocz(&batch->pool, sizeof(git_reftable_log));
+	GIT_ERROR_CHECK_ALLOC(log);
+
+	git_oid_cpy(&log->old_id, old_id);
+	git_oid_cpy(&log->new_id, new_id);
+
+	if ((log->refname = git_pool_strdup(&batch->pool, refname)) == NULL ||
+	    (log->name = git_pool_strdup(&batch->pool, who ? who->name : "")) == NULL ||
+	    (log->email = git_pool_strdup(&batch->pool, who ? who->email : "")) == NULL ||
+	    (log->message = msg = git_pool_strdup(&batch->pool, message ? message : "")) == NULL)
+		return -1;
+
+	if (who) {
+		log->time = (uint64_t)who->when.time;
+		log->tz_offset = (int16_t)who->when.offset;
+	}
+
+	/* messages are a single line, as in the files backend */
+	for (p = msg; *p; p++)
+		if (*p == '\n')
+			*p = ' ';
+
+	for (len = strlen(msg); len && git__isspace(msg[len - 1]); len--)
+		msg[len - 1] = '\0';
+
+	return git_vector_insert(&batch->logs, log);
+}
+
+static int batch_add_log_marker(refdb_reftable *backend, const char *refname)
+{
+	git_oid zero = {{0}};
+	return batch_add_log(backend, refname, &zero, &zero, NULL, NULL);
+}
+
+static int log_is_pending(const git_vector *v, size_t idx, void *refname)
+{
+	git_reftable_log *log = git_vector_get(v, idx);
+	return !log->deletion && !strcmp(log->refname, refname);
+}
+
+/* Remove all log entries of `refname`, the queued ones as well */
+static int batch_clear_logs(refdb_reftable *backend, const char *refname)
+{
+	reftable_stack *stack;
+	git_vector logs = GIT_VECTOR_INIT;
+	git_reftable_log *log;
+	size_t i;
+	int error;
+
+	git_vector_remove_matching(&backend->batch.logs, log_is_pending, (void *)refname);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	if ((error = stack_read_logs(&logs, &backend->batch.pool, stack, refname)) < 0)
+		goto done;
+
+	git_vector_foreach(&logs, i, log) {
+		log->deletion = true;
+
+		if ((error = git_vector_insert(&backend->batch.logs, log)) < 0)
+			goto done;
+	}
+
+done:
+	git_vector_free(&logs);
+	stack_decref(stack);
+	return error;
+}
+
+/*
+ * Backend implementation
+ */
+
+static int backend_read_ref(git_reference **out, refdb_reftable *backend, const char *name)
+{
+	reftable_stack *stack;
+	int error;
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	error = stack_read_ref(out, stack, name);
+
+	stack_decref(stack);
+	return error;
+}
+
+static int refdb_reftable__exists(
+	int *exists,
+	git_refdb_backend *_backend,
+	const char *ref_name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(exists && backend && ref_name);
+
+	*exists = 0;
+
+	if ((error = backend_read_ref(NULL, backend, ref_name)) == 0)
+		*exists = 1;
+	else if (error == GIT_ENOTFOUND)
+		error = 0;
+
+	return error;
+}
+
+static int refdb_reftable__lookup(
+	git_reference **out,
+	git_refdb_backend *_backend,
+	const char *ref_name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(backend);
+
+	if ((error = backend_read_ref(out, backend, ref_name)) == GIT_ENOTFOUND)
+		error = ref_error_notfound(ref_name);
+
+	return error;
+}
+
+typedef struct {
+	git_reference_iterator parent;
+
+	reftable_stack *stack;
+	merged_iter it;
+	char *glob;
+	git_buf prefix;
+	bool done;
+} refdb_reftable_iter;
+
+static void refdb_reftable__iterator_free(git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = GIT_CONTAINER_OF(_iter, refdb_reftable_iter, parent);
+
+	merged_iter_dispose(&iter->it);
+	stack_decref(iter->stack);
+	git_buf_dispose(&iter->prefix);
+	git__free(iter->glob);
+	git__free(iter);
+}
+
+static int iterator_next_record(git_reftable_ref **out, refdb_reftable_iter *iter)
+{
+	int error;
+
+	if (iter->done)
+		return GIT_ITEROVER;
+
+	while ((error = merged_iter_next_ref(out, &iter->it)) == 0) {
+		/* records are sorted, so we're past the matching ones */
+		if (git__prefixcmp((*out)->name, iter->prefix.ptr)) {
+			error = GIT_ITEROVER;
+			break;
+		}
+
+		if (!iter->glob || wildmatch(iter->glob, (*out)->name, 0) == 0)
+			return 0;
+	}
+
+	iter->done = true;
+	return error;
+}
+
+static int refdb_reftable__iterator_next(
+	git_reference **out, git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = GIT_CONTAINER_OF(_iter, refdb_reftable_iter, parent);
+	git_reftable_ref *rec;
+	int error;
+
+	if ((error = iterator_next_record(&rec, iter)) < 0)
+		return error;
+
+	return ref_from_record(out, rec);
+}
+
+static int refdb_reftable__iterator_next_name(
+	const char **out, git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = GIT_CONTAINER_OF(_iter, refdb_reftable_iter, parent);
+	git_reftable_ref *rec;
+	int error;
+
+	if ((error = iterator_next_record(&rec, iter)) < 0)
+		return error;
+
+	*out = rec->name;
+	return 0;
+}
+
+static int refdb_reftable__iterator(
+	git_reference_iterator **out, git_refdb_backend *_backend, const char *glob)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	refdb_reftable_iter *iter;
+	size_t literal_len = 0;
+	int error = 0;
+
+	assert(backend);
+
+	iter = git__calloc(1, sizeof(refdb_reftable_iter));
+	GIT_ERROR_CHECK_ALLOC(iter);
+
+	if (glob) {
+		if ((iter->glob = git__strdup(glob)) == NULL) {
+			error = -1;
+			goto out;
+		}
+
+		literal_len = strcspn(glob, "?*[\\");
+	}
+
+	/*
+	 * As with the files backend, only references below "refs/" are
+	 * iterated over.  Only seek to the part of the glob that has no
+	 * wildcards.
+	 */
+	if (literal_len >= strlen(GIT_REFS_DIR) && !git__prefixcmp(glob, GIT_REFS_DIR))
+		error = git_buf_put(&iter->prefix, glob, literal_len);
+	else if (!strncmp(GIT_REFS_DIR, glob ? glob : "", literal_len))
+		error = git_buf_puts(&iter->prefix, GIT_REFS_DIR);
+	else
+		iter->done = true;
+
+	if (error < 0 ||
+	    (error = stack_get(&iter->stack, backend)) < 0 ||
+	    (error = merged_iter_init(&iter->it, iter->stack, 0, false, false)) < 0 ||
+	    (!iter->done && (error = merged_iter_seek(&iter->it, iter->prefix.ptr)) < 0))
+		goto out;
+
+	iter->parent.next = refdb_reftable__iterator_next;
+	iter->parent.next_name = refdb_reftable__iterator_next_name;
+	iter->parent.free = refdb_reftable__iterator_free;
+
+	*out = (git_reference_iterator *)iter;
+
+out:
+	if (error < 0)
+		refdb_reftable__iterator_free((git_reference_iterator *)iter);
+	return error;
+}
+
+static int reference_path_available(
+	refdb_reftable *backend,
+	const char *new_ref,
+	const char *old_ref,
+	int force)
+{
+	reftable_stack *stack;
+	merged_iter it = {0};
+	git_reftable_ref *rec;
+	git_buf path = GIT_BUF_INIT;
+	const char *slash;
+	bool collides = false;
+	int error;
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	if (!force) {
+		if ((error = stack_read_ref(NULL, stack, new_ref)) == 0) {
+			git_error_set(GIT_ERROR_REFERENCE,
+				"failed to write reference '%s': a reference with "
+				"that name already exists.", new_ref);
+			error = GIT_EEXISTS;
+			goto done;
+		} else if (error != GIT_ENOTFOUND) {
+			goto done;
+		}
+	}
+
+	/* None of the leading directories may be a reference */
+	for (slash = strchr(new_ref, '/'); slash && !collides; slash = strchr(slash + 1, '/')) {
+		if ((error = git_buf_set(&path, new_ref, slash - new_ref)) < 0)
+			goto done;
+
+		if (old_ref && !strcmp(path.ptr, old_ref))
+			continue;
+
+		if ((error = stack_read_ref(NULL, stack, path.ptr)) == 0)
+			collides = true;
+		else if (error != GIT_ENOTFOUND)
+			goto done;
+	}
+
+	/* and there may be no references below it */
+	if (!collides) {
+		if ((error = git_buf_sets(&path, new_ref)) < 0 ||
+		    (error = git_buf_putc(&path, '/')) < 0 ||
+		    (error = merged_iter_init(&it, stack, 0, false, false)) < 0 ||
+		    (error = merged_iter_seek(&it, path.ptr)) < 0)
+			goto done;
+
+		while ((error = merged_iter_next_ref(&rec, &it)) == 0 &&
+		       !git__prefixcmp(rec->name, path.ptr)) {
+			if (!old_ref || strcmp(rec->name, old_ref)) {
+				collides = true;
+				break;
+			}
+		}
+
+		if (error < 0 && error != GIT_ITEROVER)
+			goto done;
+	}
+
+	error = 0;
+
+	if (collides) {
+		git_error_set(GIT_ERROR_REFERENCE,
+			"path to reference '%s' collides with existing one", new_ref);
+		error = -1;
+	}
+
+done:
+	merged_iter_dispose(&it);
+	git_buf_dispose(&path);
+	stack_decref(stack);
+	return error;
+}
+
+static int has_reflog(refdb_reftable *backend, const char *name)
+{
+	reftable_stack *stack;
+	int error;
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	error = stack_has_log(stack, name);
+
+	stack_decref(stack);
+	return error;
+}
+
+static int should_write_reflog(int *write, refdb_reftable *backend, const char *name)
+{
+	git_repository *repo = backend->repo;
+	int error, logall;
+
+	error = git_repository__configmap_lookup(&logall, repo, GIT_CONFIGMAP_LOGALLREFUPDATES);
+	if (error < 0)
+		return error;
+
+	/* Defaults to the opposite of the repo being bare */
+	if (logall == GIT_LOGALLREFUPDATES_UNSET)
+		logall = !git_repository_is_bare(repo);
+
+	*write = 0;
+	switch (logall) {
+	case GIT_LOGALLREFUPDATES_FALSE:
+		*write = 0;
+		break;
+
+	case GIT_LOGALLREFUPDATES_TRUE:
+		/* Only write if it already has a log,
+		 * or if it's under heads/, remotes/ or notes/
+		 */
+		*write = has_reflog(backend, name) > 0 ||
+			!git__prefixcmp(name, GIT_REFS_HEADS_DIR) ||
+			!git__strcmp(name, GIT_HEAD_FILE) ||
+			!git__prefixcmp(name, GIT_REFS_REMOTES_DIR) ||
+			!git__prefixcmp(name, GIT_REFS_NOTES_DIR);
+		break;
+
+	case GIT_LOGALLREFUPDATES_ALWAYS:
+		*write = 1;
+		break;
+	}
+
+	return 0;
+}
+
+static int cmp_old_ref(int *cmp, refdb_reftable *backend, const char *name,
+	const git_oid *old_id, const char *old_target)
+{
+	int error = 0;
+	git_reference *old_ref = NULL;
+
+	*cmp = 0;
+	/* It "matches" if there is no old value to compare against */
+	if (!old_id && !old_target)
+		return 0;
+
+	if ((error = refdb_reftable__lookup(&old_ref, &backend->parent, name)) < 0)
+		goto out;
+
+	/* If the types don't match, there's no way the values do */
+	if (old_id && old_ref->type != GIT_REFERENCE_DIRECT) {
+		*cmp = -1;
+		goto out;
+	}
+	if (old_target && old_ref->type != GIT_REFERENCE_SYMBOLIC) {
+		*cmp = 1;
+		goto out;
+	}
+
+	if (old_id && old_ref->type == GIT_REFERENCE_DIRECT)
+		*cmp = git_oid_cmp(old_id, &old_ref->target.oid);
+
+	if (old_target && old_ref->type == GIT_REFERENCE_SYMBOLIC)
+		*cmp = git__strcmp(old_target, old_ref->target.symbolic);
+
+out:
+	git_reference_free(old_ref);
+
+	return error;
+}
+
+/* Queue a reflog entry, with the same rules as the files backend */
+static int reflog_append(
+	refdb_reftable *backend,
+	const git_reference *ref,
+	const git_oid *old,
+	const git_oid *new,
+	const git_signature *who,
+	const char *message)
+{
+	int error, is_symbolic;
+	git_oid old_id = {{0}}, new_id = {{0}};
+	git_repository *repo = backend->repo;
+
+	is_symbolic = ref->type == GIT_REFERENCE_SYMBOLIC;
+
+	/* "normal" symbolic updates do not write */
+	if (is_symbolic &&
+	    strcmp(ref->name, GIT_HEAD_FILE) &&
+	    !(old && new))
+		return 0;
+
+	/* From here on is_symbolic also means that it's HEAD */
+
+	if (old) {
+		git_oid_cpy(&old_id, old);
+	} else {
+		error = git_reference_name_to_id(&old_id, repo, ref->name);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+	}
+
+	if (new) {
+		git_oid_cpy(&new_id, new);
+	} else {
+		if (!is_symbolic) {
+			git_oid_cpy(&new_id, git_reference_target(ref));
+		} else {
+			error = git_reference_name_to_id(&new_id, repo, git_reference_symbolic_target(ref));
+			if (error < 0 && error != GIT_ENOTFOUND)
+				return error;
+			/* detaching HEAD does not create an entry */
+			if (error == GIT_ENOTFOUND)
+				return 0;
+		}
+	}
+
+	git_error_clear();
+
+	return batch_add_log(backend, ref->name, &old_id, &new_id, who, message);
+}
+
+/*
+ * As in the files backend: if a branch is updated directly while
+ * HEAD points to it, the update is logged for HEAD as well.
+ */
+static int maybe_append_head(refdb_reftable *backend, const git_reference *ref, const git_signature *who, const char *message)
+{
+	int error;
+	git_oid old_id;
+	git_reference *tmp = NULL, *head = NULL, *peeled = NULL;
+	const char *name;
+
+	if (ref->type == GIT_REFERENCE_SYMBOLIC)
+		return 0;
+
+	/* if we can't resolve, we use {0}*40 as old id */
+	if (git_reference_name_to_id(&old_id, backend->repo, ref->name) < 0)
+		memset(&old_id, 0, sizeof(old_id));
+
+	/* unlike in the files backend, a new stack may not have a HEAD yet */
+	if ((error = git_reference_lookup(&head, backend->repo, GIT_HEAD_FILE)) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		return error;
+	}
+
+	if (git_reference_type(head) == GIT_REFERENCE_DIRECT)
+		goto cleanup;
+
+	if ((error = git_reference_lookup(&tmp, backend->repo, GIT_HEAD_FILE)) < 0)
+		goto cleanup;
+
+	/* Go down the symref chain until we find the branch */
+	while (git_reference_type(tmp) == GIT_REFERENCE_SYMBOLIC) {
+		error = git_reference_lookup(&peeled, backend->repo, git_reference_symbolic_target(tmp));
+		if (error < 0)
+			break;
+
+		git_reference_free(tmp);
+		tmp = peeled;
+	}
+
+	if (error == GIT_ENOTFOUND) {
+		error = 0;
+		name = git_reference_symbolic_target(tmp);
+	} else if (error < 0) {
+		goto cleanup;
+	} else {
+		name = git_reference_name(tmp);
+	}
+
+	if (strcmp(name, ref->name))
+		goto cleanup;
+
+	error = reflog_append(backend, head, &old_id, git_reference_target(ref), who, message);
+
+cleanup:
+	git_reference_free(tmp);
+	git_reference_free(head);
+	return error;
+}
+
+static int write_tail(
+	refdb_reftable *backend,
+	const git_reference *ref,
+	int update_reflog,
+	const git_oid *old_id,
+	const char *old_target,
+	const git_signature *who,
+	const char *message)
+{
+	int error = 0, cmp = 0, should_write;
+	const char *new_target = NULL;
+	const git_oid *new_id = NULL;
+
+	if ((error = cmp_old_ref(&cmp, backend, ref->name, old_id, old_target)) < 0)
+		return error;
+
+	if (cmp) {
+		git_error_set(GIT_ERROR_REFERENCE, "old reference value does not match");
+		return GIT_EMODIFIED;
+	}
+
+	if (ref->type == GIT_REFERENCE_SYMBOLIC)
+		new_target = ref->target.symbolic;
+	else
+		new_id = &ref->target.oid;
+
+	error = cmp_old_ref(&cmp, backend, ref->name, new_id, new_target);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	/* Don't update if we have the same value */
+	if (!error && !cmp)
+		return 0;
+
+	if (update_reflog) {
+		if ((error = should_write_reflog(&should_write, backend, ref->name)) < 0)
+			return error;
+
+		if (should_write &&
+		    ((error = reflog_append(backend, ref, NULL, NULL, who, message)) < 0 ||
+		     (error = maybe_append_head(backend, ref, who, message)) < 0))
+			return error;
+	}
+
+	return batch_add_ref(backend, ref->name, ref);
+}
+
+static int delete_tail(
+	refdb_reftable *backend,
+	const char *ref_name,
+	const git_oid *old_id,
+	const char *old_target)
+{
+	int error, cmp = 0;
+
+	if ((error = cmp_old_ref(&cmp, backend, ref_name, old_id, old_target)) < 0)
+		return error;
+
+	if (cmp) {
+		git_error_set(GIT_ERROR_REFERENCE, "old reference value does not match");
+		return GIT_EMODIFIED;
+	}
+
+	if ((error = backend_read_ref(NULL, backend, ref_name)) < 0)
+		return (error == GIT_ENOTFOUND) ? ref_error_notfound(ref_name) : error;
+
+	return batch_add_ref(backend, ref_name, NULL);
+}
+
+static int refdb_reftable__write(
+	git_refdb_backend *_backend,
+	const git_reference *ref,
+	int force,
+	const git_signature *who,
+	const char *message,
+	const git_oid *old_id,
+	const char *old_target)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(backend);
+
+	/* Checks and the reflog append happen under the lock of the stack */
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) < 0)
+		return error;
+
+	if ((error = reference_path_available(backend, ref->name, NULL, force)) == 0)
+		error = write_tail(backend, ref, true, old_id, old_target, who, message);
+
+	return batch_end(backend, error);
+}
+
+static int refdb_reftable__delete(
+	git_refdb_backend *_backend,
+	const char *ref_name,
+	const git_oid *old_id, const char *old_target)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(backend && ref_name);
+
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) < 0)
+		return error;
+
+	if ((error = delete_tail(backend, ref_name, old_id, old_target)) == 0)
+		error = batch_clear_logs(backend, ref_name);
+
+	return batch_end(backend, error);
+}
+
+/* Move the log entries of `old_name` to `new_name` */
+static int logs_move(refdb_reftable *backend, const char *old_name, const char *new_name)
+{
+	reftable_stack *stack;
+	git_vector logs = GIT_VECTOR_INIT;
+	git_reftable_log *log;
+	size_t i;
+	int error;
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	if ((error = stack_read_logs(&logs, &backend->batch.pool, stack, old_name)) < 0)
+		goto done;
+
+	if (!logs.length) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if ((error = batch_clear_logs(backend, new_name)) < 0 ||
+	    (error = batch_clear_logs(backend, old_name)) < 0)
+		goto done;
+
+	/* re-add the entries oldest first, so that they keep their order */
+	for (i = logs.length; i-- > 0; ) {
+		log = git_vector_get(&logs, i);
+
+		if ((log = log_dup(&backend->batch.pool, log, new_name)) == NULL ||
+		    (error = git_vector_insert(&backend->batch.logs, log)) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+done:
+	git_vector_free(&logs);
+	stack_decref(stack);
+	return error;
+}
+
+static int refdb_reftable__rename(
+	git_reference **out,
+	git_refdb_backend *_backend,
+	const char *old_name,
+	const char *new_name,
+	int force,
+	const git_signature *who,
+	const char *message)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	git_reference *old = NULL, *new = NULL;
+	int error;
+
+	assert(backend);
+
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) < 0)
+		return error;
+
+	if ((error = reference_path_available(backend, new_name, old_name, force)) < 0 ||
+	    (error = refdb_reftable__lookup(&old, _backend, old_name)) < 0)
+		goto done;
+
+	/* Try to rename the reflog; it's ok if the old doesn't exist */
+	if ((error = logs_move(backend, old_name, new_name)) < 0 && error != GIT_ENOTFOUND)
+		goto done;
+
+	if ((new = git_reference__realloc(&old, new_name)) == NULL) {
+		error = -1;
+		goto done;
+	}
+
+	if ((error = batch_add_ref(backend, old_name, NULL)) < 0 ||
+	    (error = batch_add_ref(backend, new_name, new)) < 0 ||
+	    (error = reflog_append(backend, new, git_reference_target(new), NULL, who, message)) < 0)
+		goto done;
+
+done:
+	git_reference_free(old);
+
+	if ((error = batch_end(backend, error)) < 0 || out == NULL) {
+		git_reference_free(new);
+		return error;
+	}
+
+	*out = new;
+	return 0;
+}
+
+static int refdb_reftable__lock(void **out, git_refdb_backend *_backend, const char *refname)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	GIT_UNUSED(refname);
+
+	/*
+	 * All references share the lock of the stack.  A caller that holds
+	 * a lock already passes its payload in, which is the batch's token.
+	 */
+	if ((error = batch_begin(backend, BATCH_JOIN_TOKEN, (uintptr_t)*out)) < 0)
+		return error;
+
+	*out = (void *)backend->token;
+	return 0;
+}
+
+static int refdb_reftable__unlock(git_refdb_backend *_backend, void *payload, int success, int update_reflog,
+				  const git_reference *ref, const git_signature *sig, const char *message)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error = 0;
+
+	GIT_UNUSED(payload);
+
+	if (success == 2)
+		error = delete_tail(backend, ref->name, NULL, NULL);
+	else if (success)
+		error = write_tail(backend, ref, update_reflog, NULL, NULL, sig, message);
+
+	return batch_end(backend, error);
+}
+
+static int refdb_reftable__compress(git_refdb_backend *_backend)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+
+	assert(backend);
+
+	return stack_compact(backend, true);
+}
+
+static void refdb_reftable__free(git_refdb_backend *_backend)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+
+	assert(backend);
+
+	if (backend->lock_count) {
+		git_filebuf_cleanup(&backend->lockfile);
+		git_vector_free(&backend->batch.refs);
+		git_vector_free(&backend->batch.logs);
+		git_pool_clear(&backend->batch.pool);
+	}
+
+	stack_decref(backend->stack);
+	git_mutex_free(&backend->batch_lock);
+	git_mutex_free(&backend->lock);
+	git__free(backend->dir);
+	git__free(backend->list_path);
+	git__free(backend);
+}
+
+static int refdb_reftable__has_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+
+	assert(backend && name);
+
+	return has_reflog(backend, name);
+}
+
+static int refdb_reftable__ensure_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(backend && name);
+
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) < 0)
+		return error;
+
+	if ((error = has_reflog(backend, name)) == 0)
+		error = batch_add_log_marker(backend, name);
+
+	return batch_end(backend, error < 0 ? error : 0);
+}
+
+static int reflog_alloc(git_reflog **reflog, const char *name)
+{
+	git_reflog *log;
+
+	*reflog = NULL;
+
+	log = git__calloc(1, sizeof(git_reflog));
+	GIT_ERROR_CHECK_ALLOC(log);
+
+	log->ref_name = git__strdup(name);
+	GIT_ERROR_CHECK_ALLOC(log->ref_name);
+
+	if (git_vector_init(&log->entries, 0, NULL) < 0) {
+		git__free(log->ref_name);
+		git__free(log);
+		return -1;
+	}
+
+	*reflog = log;
+
+	return 0;
+}
+
+static int reflog_entry_from_record(git_reflog_entry **out, const git_reftable_log *log)
+{
+	git_reflog_entry *entry;
+
+	entry = git__calloc(1, sizeof(git_reflog_entry));
+	GIT_ERROR_CHECK_ALLOC(entry);
+
+	git_oid_cpy(&entry->oid_old, &log->old_id);
+	git_oid_cpy(&entry->oid_cur, &log->new_id);
+
+	if ((entry->committer = git__calloc(1, sizeof(git_signature))) == NULL ||
+	    (entry->committer->name = git__strdup(log->name)) == NULL ||
+	    (entry->committer->email = git__strdup(log->email)) == NULL ||
+	    (*log->message && (entry->msg = git__strdup(log->message)) == NULL)) {
+		git_reflog_entry__free(entry);
+		return -1;
+	}
+
+	entry->committer->when.time = (git_time_t)log->time;
+	entry->committer->when.offset = log->tz_offset;
+	entry->committer->when.sign = (log->tz_offset < 0) ? '-' : '+';
+
+	*out = entry;
+	return 0;
+}
+
+static int refdb_reftable__reflog_read(git_reflog **out, git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	reftable_stack *stack = NULL;
+	git_reflog *reflog = NULL;
+	git_reflog_entry *entry;
+	git_vector logs = GIT_VECTOR_INIT;
+	git_reftable_log *log;
+	git_pool pool;
+	size_t i;
+	int error;
+
+	assert(out && backend && name);
+
+	git_pool_init(&pool, 1);
+
+	if ((error = reflog_alloc(&reflog, name)) < 0 ||
+	    (error = stack_get(&stack, backend)) < 0 ||
+	    (error = stack_read_logs(&logs, &pool, stack, name)) < 0)
+		goto done;
+
+	/* the reflog is ordered oldest first */
+	for (i = logs.length; i-- > 0; ) {
+		log = git_vector_get(&logs, i);
+
+		if (LOG_IS_MARKER(log))
+			continue;
+
+		if ((error = reflog_entry_from_record(&entry, log)) < 0)
+			goto done;
+
+		if ((error = git_vector_insert(&reflog->entries, entry)) < 0) {
+			git_reflog_entry__free(entry);
+			goto done;
+		}
+	}
+
+	*out = reflog;
+
+done:
+	if (error < 0)
+		git_reflog_free(reflog);
+
+	git_vector_free(&logs);
+	git_pool_clear(&pool);
+	stack_decref(stack);
+	return error;
+}
+
+static int refdb_reftable__reflog_write(git_refdb_backend *_backend, git_reflog *reflog)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	git_reflog_entry *entry;
+	size_t i;
+	int error;
+
+	assert(backend && reflog);
+
+	/* A transaction writes the reflogs of the references it locked */
+	if ((error = batch_begin(backend, BATCH_JOIN_THREAD, 0)) < 0)
+		return error;
+
+	if ((error = batch_clear_logs(backend, reflog->ref_name)) < 0 ||
+	    (error = batch_add_log_marker(backend, reflog->ref_name)) < 0)
+		goto done;
+
+	git_vector_foreach(&reflog->entries, i, entry) {
+		if ((error = batch_add_log(backend, reflog->ref_name,
+				&entry->oid_old, &entry->oid_cur,
+				entry->committer, entry->msg)) < 0)
+			goto done;
+	}
+
+done:
+	return batch_end(backend, error);
+}
+
+static int refdb_reftable__reflog_rename(git_refdb_backend *_backend, const char *old_name, const char *new_name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	git_buf normalized = GIT_BUF_INIT;
+	int error;
+
+	assert(backend && old_name && new_name);
+
+	if ((error = git_reference__normalize_name(
+		&normalized, new_name, GIT_REFERENCE_FORMAT_ALLOW_ONELEVEL)) < 0)
+			return error;
+
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) == 0)
+		error = batch_end(backend, logs_move(backend, old_name, normalized.ptr));
+
+	git_buf_dispose(&normalized);
+	return error;
+}
+
+static int refdb_reftable__reflog_delete(git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable *backend = GIT_CONTAINER_OF(_backend, refdb_reftable, parent);
+	int error;
+
+	assert(backend && name);
+
+	if ((error = batch_begin(backend, BATCH_EXCLUSIVE, 0)) < 0)
+		return error;
+
+	return batch_end(backend, batch_clear_logs(backend, name));
+}
+
+int git_refdb_backend_reftable(
+	git_refdb_backend **backend_out,
+	git_repository *repository)
+{
+	int t = 0;
+	git_buf path = GIT_BUF_INIT;
+	refdb_reftable *backend;
+
+	assert(backend_out && repository);
+
+	backend = git__calloc(1, sizeof(refdb_reftable));
+	GIT_ERROR_CHECK_ALLOC(backend);
+
+	backend->repo = repository;
+
+	if (git_mutex_init(&backend->lock) < 0) {
+		git__free(backend);
+		return -1;
+	}
+
+	if (git_mutex_init(&backend->batch_lock) < 0) {
+		git_mutex_free(&backend->lock);
+		git__free(backend);
+		return -1;
+	}
+
+	if (git_buf_joinpath(&path, repository->commondir, GIT_REFTABLE_DIR) < 0 ||
+	    (backend->dir = git_buf_detach(&path)) == NULL ||
+	    git_buf_joinpath(&path, backend->dir, GIT_REFTABLE_LIST_FILE) < 0 ||
+	    (backend->list_path = git_buf_detach(&path)) == NULL)
+		goto fail;
+
+	if ((!git_repository__configmap_lookup(&t, backend->repo, GIT_CONFIGMAP_FSYNCOBJECTFILES) && t) ||
+		git_repository__fsync_gitdir)
+		backend->fsync = 1;
+
+	backend->parent.version = GIT_REFDB_BACKEND_VERSION;
+	backend->parent.exists = &refdb_reftable__exists;
+	backend->parent.lookup = &refdb_reftable__lookup;
+	backend->parent.iterator = &refdb_reftable__iterator;
+	backend->parent.write = &refdb_reftable__write;
+	backend->parent.del = &refdb_reftable__delete;
+	backend->parent.rename = &refdb_reftable__rename;
+	backend->parent.compress = &refdb_reftable__compress;
+	backend->parent.lock = &refdb_reftable__lock;
+	backend->parent.unlock = &refdb_reftable__unlock;
+	backend->parent.has_log = &refdb_reftable__has_log;
+	backend->parent.ensure_log = &refdb_reftable__ensure_log;
+	backend->parent.free = &refdb_reftable__free;
+	backend->parent.reflog_read = &refdb_reftable__reflog_read;
+	backend->parent.reflog_write = &refdb_reftable__reflog_write;
+	backend->parent.reflog_rename = &refdb_reftable__reflog_rename;
+	backend->parent.reflog_delete = &refdb_reftable__reflog_delete;
+
+	*backend_out = (git_refdb_backend *)backend;
+	return 0;
+
+fail:
+	git_mutex_free(&backend->batch_lock);
+	git_mutex_free(&backend->lock);
+	git_buf_dispose(&path);
+	git__free(backend->dir);
+	git__free(backend->list_path);
+	git__free(backend);
+	return -1;
+}
@@ -62,6 +62,76 @@ int git_reflog_read(git_reflog **reflog, git_repository *repo,  const char *name
 	return git_refdb_reflog_read(reflog, refdb, name);
 }
 
+/* Iterates over a fully read reflog, for backends that cannot do better */
+typedef struct {
+	git_reflog_iterator parent;
+	git_reflog *reflog;
+	size_t idx;
+} reflog_read_iterator;
+
+static int reflog_read_iterator_next(
+	const git_reflog_entry **out, git_reflog_iterator *_iter)
+{
+	reflog_read_iterator *iter = GIT_CONTAINER_OF(_iter, reflog_read_iterator, parent);
+
+	if ((*out = git_reflog_entry_byindex(iter->reflog, iter->idx)) == NULL)
+		return GIT_ITEROVER;
+
+	iter->idx++;
+	return 0;
+}
+
+static void reflog_read_iterator_free(git_reflog_iterator *_iter)
+{
+	reflog_read_iterator *iter = GIT_CONTAINER_OF(_iter, reflog_read_iterator, parent);
+
+	git_reflog_free(iter->reflog);
+	git__free(iter);
+}
+
+int git_reflog_iterator_new(git_reflog_iterator **out, git_repository *repo, const char *name)
+{
+	reflog_read_iterator *iter;
+	git_refdb *refdb;
+	int error;
+
+	assert(out && repo && name);
+
+	if ((error = git_repository_refdb__weakptr(&refdb, repo)) < 0)
+		return error;
+
+	if (refdb->backend->reflog_iterator)
+		return refdb->backend->reflog_iterator(out, refdb->backend, name);
+
+	iter = git__calloc(1, sizeof(reflog_read_iterator));
+	GIT_ERROR_CHECK_ALLOC(iter);
+
+	if ((error = git_refdb_reflog_read(&iter->reflog, refdb, name)) < 0) {
+		git__free(iter);
+		return error;
+	}
+
+	iter->parent.next = reflog_read_iterator_next;
+	iter->parent.free = reflog_read_iterator_free;
+
+	*out = &iter->parent;
+	return 0;
+}
+
+int git_reflog_next(const git_reflog_entry **out, git_reflog_iterator *iter)
+{
+	assert(out && iter);
+	return iter->next(out, iter);
+}
+
+void git_reflog_iterator_free(git_reflog_iterator *iter)
+{
+	if (iter == NULL)
+		return;
+
+	iter->free(iter);
+}
+
 int git_reflog_write(git_reflog *reflog)
 {
 	git_refdb *db;
@@ -141,6 +211,40 @@ int git_reflog_delete(git_repository *repo, const char *name)
 	return refdb->backend->reflog_delete(refdb->backend, name);
 }
 
+int git_reflog_truncate(git_repository *repo, const char *name, size_t keep)
+{
+	git_reflog *reflog;
+	git_refdb *refdb;
+	size_t i, count;
+	int error;
+
+	assert(repo && name);
+
+	if ((error = git_repository_refdb__weakptr(&refdb, repo)) < 0)
+		return error;
+
+	if (refdb->backend->reflog_truncate)
+		return refdb->backend->reflog_truncate(refdb->backend, name, keep);
+
+	if (!refdb->backend->has_log(refdb->backend, name))
+		return 0;
+
+	if ((error = git_refdb_reflog_read(&reflog, refdb, name)) < 0)
+		return error;
+
+	/* the oldest entries are at the start of the vector */
+	if ((count = reflog->entries.length) > keep) {
+		for (i = 0; i < count - keep; i++)
+			git_reflog_entry__free(git_vector_get(&reflog->entries, i));
+
+		if ((error = git_vector_remove_range(&reflog->entries, 0, count - keep)) == 0)
+			error = git_reflog_write(reflog);
+	}
+
+	git_reflog_free(reflog);
+	return error;
+}
+
 size_t git_reflog_entrycount(git_reflog *reflog)
 {
 	assert(reflog);
@@ -0,0 +1,1172 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "reftable.h"
+
+#include <zlib.h>
+
+#include "array.h"
+#include "futils.h"
+#include "map.h"
+#include "varint.h"
+
+#define REFTABLE_MAGIC "REFT"
+#define REFTABLE_VERSION 1
+#define REFTABLE_HEADER_SIZE 24
+#define REFTABLE_FOOTER_SIZE 68
+#define REFTABLE_BLOCK_HEADER_SIZE 4
+#define REFTABLE_RESTART_INTERVAL 16
+#define REFTABLE_MAX_BLOCK_SIZE ((1 << 24) - 1)
+
+#define BLOCK_TYPE_REF 'r'
+#define BLOCK_TYPE_LOG 'g'
+#define BLOCK_TYPE_INDEX 'i'
+
+struct git_reftable {
+	git_map map;
+	const unsigned char *data;
+	size_t size;
+	size_t end; /* start of the footer */
+
+	uint32_t block_size;
+	uint64_t min_update_index;
+	uint64_t max_update_index;
+
+	uint64_t ref_index_pos;
+	uint64_t log_pos;
+	uint64_t log_index_pos;
+};
+
+typedef struct {
+	char type;
+	const unsigned char *data; /* restart offsets are relative to this */
+	size_t len;
+	size_t records;
+	size_t restarts;
+	size_t restart_count;
+	size_t next; /* position of the following block in the file */
+	git_buf inflated;
+} reftable_block;
+
+struct git_reftable_iter {
+	git_reftable *table;
+	char type;
+	reftable_block block;
+	size_t off;
+	bool done;
+
+	git_buf key;
+	git_buf seek;
+	bool seeking;
+
+	git_buf name;
+	git_buf email;
+	git_buf message;
+};
+
+static int reftable_error_corrupt(void)
+{
+	git_error_set(GIT_ERROR_REFERENCE, "corrupted reftable");
+	return -1;
+}
+
+GIT_INLINE(void) put_be(unsigned char *out, uint64_t val, size_t len)
+{
+	while (len--) {
+		out[len] = val & 0xff;
+		val >>= 8;
+	}
+}
+
+GIT_INLINE(uint64_t) get_be(const unsigned char *in, size_t len)
+{
+	uint64_t val = 0;
+
+	while (len--)
+		val = (val << 8) | *in++;
+
+	return val;
+}
+
+static int get_varint(uint64_t *out, const unsigned char **p, const unsigned char *end)
+{
+	const unsigned char *ptr = *p;
+	uint64_t val;
+	unsigned char c;
+
+	if (ptr >= end)
+		return -1;
+
+	c = *ptr++;
+	val = c & 127;
+
+	while (c & 128) {
+		val += 1;
+
+		if (!val || (val >> 57) || ptr >= end)
+			return -1;
+
+		c = *ptr++;
+		val = (val << 7) + (c & 127);
+	}
+
+	*out = val;
+	*p = ptr;
+	return 0;
+}
+
+static int put_varint(git_buf *buf, uint64_t val)
+{
+	unsigned char varint[16];
+	int len = git_encode_varint(varint, sizeof(varint), val);
+
+	return git_buf_put(buf, (const char *)varint, len);
+}
+
+static int put_be_buf(git_buf *buf, uint64_t val, size_t len)
+{
+	unsigned char out[8];
+
+	put_be(out, val, len);
+	return git_buf_put(buf, (const char *)out, len);
+}
+
+static int key_cmp(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	int cmp = memcmp(a, b, min(a_len, b_len));
+	return cmp ? cmp : (a_len > b_len) - (a_len < b_len);
+}
+
+static int log_key(git_buf *out, const char *refname, uint64_t update_index)
+{
+	git_buf_clear(out);
+	git_buf_puts(out, refname);
+	git_buf_putc(out, '\0');
+	return put_be_buf(out, UINT64_MAX - update_index, 8);
+}
+
+/*
+ * Writing
+ */
+
+typedef struct {
+	size_t key_off;
+	size_t key_len;
+	size_t pos;
+} index_entry;
+
+typedef git_array_t(index_entry) index_entries;
+
+typedef struct {
+	git_buf *out;
+	uint32_t block_size;
+	char type;
+
+	size_t header_pos;
+	size_t base;
+	git_buf block;
+	git_array_t(uint32_t) restarts;
+	size_t entries;
+	git_buf last_key;
+
+	/* the last key and position of each block that was written */
+	git_buf index_keys;
+	index_entries index;
+} block_writer;
+
+static void block_writer_init(block_writer *w, git_buf *out, uint32_t block_size, char type)
+{
+	memset(w, 0, sizeof(*w));
+	w->out = out;
+	w->block_size = block_size;
+	w->type = type;
+}
+
+static void block_writer_dispose(block_writer *w)
+{
+	git_buf_dispose(&w->block);
+	git_buf_dispose(&w->last_key);
+	git_buf_dispose(&w->index_keys);
+	git_array_clear(w->restarts);
+	git_array_clear(w->index);
+}
+
+/* The size of the block if a record of `len` bytes is added to it */
+static size_t block_writer_len(block_writer *w, size_t len, bool restart)
+{
+	return (w->header_pos - w->base) + REFTABLE_BLOCK_HEADER_SIZE +
+		w->block.size + len +
+		3 * (w->restarts.size + (restart ? 1 : 0)) + 2;
+}
+
+static int block_writer_flush(block_writer *w)
+{
+	unsigned char header[REFTABLE_BLOCK_HEADER_SIZE];
+	uint32_t *restart;
+	index_entry *entry;
+	size_t i, block_len;
+
+	if (!w->entries)
+		return 0;
+
+	git_array_foreach(w->restarts, i, restart)
+		put_be_buf(&w->block, *restart, 3);
+	put_be_buf(&w->block, w->restarts.size, 2);
+
+	if (git_buf_oom(&w->block))
+		return -1;
+
+	block_len = (w->header_pos - w->base) + REFTABLE_BLOCK_HEADER_SIZE + w->block.size;
+
+	if (block_len > REFTABLE_MAX_BLOCK_SIZE) {
+		git_error_set(GIT_ERROR_REFERENCE, "reftable record is too large");
+		return -1;
+	}
+
+	header[0] = w->type;
+	put_be(header + 1, block_len, 3);
+	git_buf_put(w->out, (const char *)header, sizeof(header));
+
+	if (w->type == BLOCK_TYPE_LOG) {
+		uLongf compressed_len = compressBound((uLong)w->block.size);
+
+		if (git_buf_grow_by(w->out, compressed_len) < 0)
+			return -1;
+
+		if (compress2((Bytef *)w->out->ptr + w->out->size, &compressed_len,
+				(const Bytef *)w->block.ptr, (uLong)w->block.size,
+				Z_DEFAULT_COMPRESSION) != Z_OK) {
+			git_error_set(GIT_ERROR_ZLIB, "failed to compress reftable log block");
+			return -1;
+		}
+
+		w->out->size += compressed_len;
+		w->out->ptr[w->out->size] = '\0';
+	} else {
+		git_buf_put(w->out, w->block.ptr, w->block.size);
+
+		while (w->out->size < w->base + w->block_size)
+			git_buf_putc(w->out, '\0');
+	}
+
+	if ((entry = git_array_alloc(w->index)) == NULL)
+		return -1;
+
+	entry->key_off = w->index_keys.size;
+	entry->key_len = w->last_key.size;
+	entry->pos = w->header_pos;
+	git_buf_put(&w->index_keys, w->last_key.ptr, w->last_key.size);
+
+	git_buf_clear(&w->block);
+	git_buf_clear(&w->last_key);
+	git_array_clear(w->restarts);
+	w->entries = 0;
+
+	return git_buf_oom(w->out) || git_buf_oom(&w->index_keys) ? -1 : 0;
+}
+
+static int block_writer_add(
+	block_writer *w,
+	const char *key,
+	size_t key_len,
+	uint8_t extra,
+	const char *value,
+	size_t value_len)
+{
+	git_buf record = GIT_BUF_INIT;
+	uint32_t *restart;
+	size_t prefix = 0;
+	bool is_restart;
+	int error = 0;
+
+	if (w->entries && key_cmp(w->last_key.ptr, w->last_key.size, key, key_len) >= 0) {
+		git_error_set(GIT_ERROR_REFERENCE, "reftable records are not sorted");
+		return -1;
+	}
+
+	if (!w->entries) {
+		w->header_pos = w->out->size;
+		w->base = (w->header_pos == REFTABLE_HEADER_SIZE) ? 0 : w->header_pos;
+	}
+
+	for (;;) {
+		is_restart = (w->entries % REFTABLE_RESTART_INTERVAL) == 0;
+		prefix = 0;
+
+		if (!is_restart)
+			while (prefix < key_len && prefix < w->last_key.size &&
+			       key[prefix] == w->last_key.ptr[prefix])
+				prefix++;
+
+		git_buf_clear(&record);
+		put_varint(&record, prefix);
+		put_varint(&record, ((uint64_t)(key_len - prefix) << 3) | extra);
+		git_buf_put(&record, key + prefix, key_len - prefix);
+		git_buf_put(&record, value, value_len);
+
+		if (git_buf_oom(&record)) {
+			error = -1;
+			goto done;
+		}
+
+		if (!w->entries ||
+		    block_writer_len(w, record.size, is_restart) <= w->block_size)
+			break;
+
+		/* The record doesn't fit, start a new block */
+		if ((error = block_writer_flush(w)) < 0)
+			goto done;
+
+		w->header_pos = w->out->size;
+		w->base = w->header_pos;
+	}
+
+	if (is_restart) {
+		if ((restart = git_array_alloc(w->restarts)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		*restart = (uint32_t)((w->header_pos - w->base) +
+			REFTABLE_BLOCK_HEADER_SIZE + w->block.size);
+	}
+
+	git_buf_put(&w->block, record.ptr, record.size);
+	git_buf_truncate(&w->last_key, prefix);
+	git_buf_put(&w->last_key, key + prefix, key_len - prefix);
+	w->entries++;
+
+	if (git_buf_oom(&w->block) || git_buf_oom(&w->last_key))
+		error = -1;
+
+done:
+	git_buf_dispose(&record);
+	return error;
+}
+
+/*
+ * Write index blocks pointing at the blocks that `section` has written,
+ * adding further levels until a single block remains.  Sections that fit
+ * into a single block don't need an index.
+ */
+static int write_index(uint64_t *out, block_writer *section)
+{
+	block_writer level, next;
+	git_buf value = GIT_BUF_INIT;
+	index_entry *entry;
+	size_t i;
+	int error = 0;
+
+	*out = 0;
+
+	if (section->index.size <= 1)
+		return 0;
+
+	block_writer_init(&level, section->out, section->block_size, BLOCK_TYPE_INDEX);
+	git_buf_swap(&level.index_keys, &section->index_keys);
+	level.index = section->index;
+	git_array_init(section->index);
+
+	while (level.index.size > 1) {
+		block_writer_init(&next, level.out, level.block_size, BLOCK_TYPE_INDEX);
+
+		git_array_foreach(level.index, i, entry) {
+			git_buf_clear(&value);
+
+			if ((error = put_varint(&value, entry->pos)) < 0 ||
+			    (error = block_writer_add(&next,
+					level.index_keys.ptr + entry->key_off, entry->key_len,
+					0, value.ptr, value.size)) < 0)
+				break;
+		}
+
+		if (!error)
+			error = block_writer_flush(&next);
+
+		block_writer_dispose(&level);
+		level = next;
+
+		if (error)
+			goto done;
+	}
+
+	*out = git_array_get(level.index, 0)->pos;
+
+done:
+	block_writer_dispose(&level);
+	git_buf_dispose(&value);
+	return error;
+}
+
+static int write_header(git_buf *out, uint32_t block_size, uint64_t min, uint64_t max)
+{
+	git_buf_put(out, REFTABLE_MAGIC, 4);
+	git_buf_putc(out, REFTABLE_VERSION);
+	put_be_buf(out, block_size, 3);
+	put_be_buf(out, min, 8);
+	return put_be_buf(out, max, 8);
+}
+
+static int write_refs(
+	uint64_t *index_pos,
+	git_buf *out,
+	uint32_t block_size,
+	uint64_t min_update_index,
+	const git_reftable_ref *refs,
+	size_t refs_len)
+{
+	block_writer w;
+	git_buf value = GIT_BUF_INIT;
+	size_t i;
+	int error = 0;
+
+	block_writer_init(&w, out, block_size, BLOCK_TYPE_REF);
+
+	for (i = 0; i < refs_len; i++) {
+		const git_reftable_ref *ref = &refs[i];
+
+		git_buf_clear(&value);
+		put_varint(&value, ref->update_index - min_update_index);
+
+		switch (ref->type) {
+		case GIT_REFTABLE_REF_DELETION:
+			break;
+		case GIT_REFTABLE_REF_PEELED:
+			git_buf_put(&value, (const char *)ref->id.id, GIT_OID_RAWSZ);
+			git_buf_put(&value, (const char *)ref->peel.id, GIT_OID_RAWSZ);
+			break;
+		case GIT_REFTABLE_REF_DIRECT:
+			git_buf_put(&value, (const char *)ref->id.id, GIT_OID_RAWSZ);
+			break;
+		case GIT_REFTABLE_REF_SYMBOLIC:
+			put_varint(&value, strlen(ref->target));
+			git_buf_puts(&value, ref->target);
+			break;
+		default:
+			git_error_set(GIT_ERROR_REFERENCE, "invalid reftable record type");
+			error = -1;
+			goto done;
+		}
+
+		if (git_buf_oom(&value)) {
+			error = -1;
+			goto done;
+		}
+
+		if ((error = block_writer_add(&w, ref->name, strlen(ref->name),
+				ref->type, value.ptr, value.size)) < 0)
+			goto done;
+	}
+
+	if ((error = block_writer_flush(&w)) < 0 ||
+	    (error = write_index(index_pos, &w)) < 0)
+		goto done;
+
+done:
+	block_writer_dispose(&w);
+	git_buf_dispose(&value);
+	return error;
+}
+
+static int put_string(git_buf *buf, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	put_varint(buf, len);
+	return git_buf_put(buf, str ? str : "", len);
+}
+
+static int write_logs(
+	uint64_t *index_pos,
+	git_buf *out,
+	uint32_t block_size,
+	const git_reftable_log *logs,
+	size_t logs_len)
+{
+	block_writer w;
+	git_buf key = GIT_BUF_INIT, value = GIT_BUF_INIT;
+	size_t i;
+	int error = 0;
+
+	block_writer_init(&w, out, block_size, BLOCK_TYPE_LOG);
+
+	for (i = 0; i < logs_len; i++) {
+		const git_reftable_log *log = &logs[i];
+
+		git_buf_clear(&value);
+
+		if (!log->deletion) {
+			git_buf_put(&value, (const char *)log->old_id.id, GIT_OID_RAWSZ);
+			git_buf_put(&value, (const char *)log->new_id.id, GIT_OID_RAWSZ);
+			put_string(&value, log->name);
+			put_string(&value, log->email);
+			put_varint(&value, log->time);
+			put_be_buf(&value, (uint16_t)log->tz_offset, 2);
+			put_string(&value, log->message);
+		}
+
+		if ((error = log_key(&key, log->refname, log->update_index)) < 0 ||
+		    git_buf_oom(&value)) {
+			error = -1;
+			goto done;
+		}
+
+		if ((error = block_writer_add(&w, key.ptr, key.size,
+				log->deletion ? 0 : 1, value.ptr, value.size)) < 0)
+			goto done;
+	}
+
+	if ((error = block_writer_flush(&w)) < 0 ||
+	    (error = write_index(index_pos, &w)) < 0)
+		goto done;
+
+done:
+	block_writer_dispose(&w);
+	git_buf_dispose(&key);
+	git_buf_dispose(&value);
+	return error;
+}
+
+int git_reftable_write(
+	git_buf *out,
+	uint32_t block_size,
+	uint64_t min_update_index,
+	uint64_t max_update_index,
+	const git_reftable_ref *refs,
+	size_t refs_len,
+	const git_reftable_log *logs,
+	size_t logs_len)
+{
+	uint64_t ref_index_pos = 0, log_pos = 0, log_index_pos = 0;
+	size_t footer_pos;
+	int error;
+
+	assert(out && (refs || !refs_len) && (logs || !logs_len));
+
+	if (block_size < 256 || block_size > REFTABLE_MAX_BLOCK_SIZE) {
+		git_error_set(GIT_ERROR_INVALID, "invalid reftable block size");
+		return -1;
+	}
+
+	git_buf_clear(out);
+
+	if ((error = write_header(out, block_size, min_update_index, max_update_index)) < 0 ||
+	    (error = write_refs(&ref_index_pos, out, block_size,
+			min_update_index, refs, refs_len)) < 0)
+		return error;
+
+	if (logs_len) {
+		log_pos = out->size;
+
+		if ((error = write_logs(&log_index_pos, out, block_size, logs, logs_len)) < 0)
+			return error;
+	}
+
+	footer_pos = out->size;
+
+	write_header(out, block_size, min_update_index, max_update_index);
+	put_be_buf(out, ref_index_pos, 8);
+	put_be_buf(out, 0, 8); /* no object blocks */
+	put_be_buf(out, 0, 8);
+	put_be_buf(out, log_pos, 8);
+	put_be_buf(out, log_index_pos, 8);
+
+	if (git_buf_oom(out))
+		return -1;
+
+	return put_be_buf(out,
+		crc32(0L, (const Bytef *)out->ptr + footer_pos,
+			REFTABLE_FOOTER_SIZE - 4), 4);
+}
+
+/*
+ * Reading
+ */
+
+int git_reftable_open(git_reftable **out, const char *path)
+{
+	git_reftable *table;
+	const unsigned char *footer;
+	struct stat st;
+	git_file fd;
+	int error = -1;
+
+	*out = NULL;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	table = git__calloc(1, sizeof(git_reftable));
+	GIT_ERROR_CHECK_ALLOC(table);
+
+	if (p_fstat(fd, &st) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to stat '%s'", path);
+		goto done;
+	}
+
+	if (!git__is_sizet(st.st_size) ||
+	    (size_t)st.st_size < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE) {
+		error = reftable_error_corrupt();
+		goto done;
+	}
+
+	if ((error = git_futils_mmap_ro(&table->map, fd, 0, (size_t)st.st_size)) < 0)
+		goto done;
+
+	table->data = table->map.data;
+	table->size = table->map.len;
+	table->end = table->size - REFTABLE_FOOTER_SIZE;
+	footer = table->data + table->end;
+
+	if (memcmp(table->data, REFTABLE_MAGIC, 4) != 0 ||
+	    table->data[4] != REFTABLE_VERSION ||
+	    memcmp(table->data, footer, REFTABLE_HEADER_SIZE) != 0 ||
+	    get_be(footer + REFTABLE_FOOTER_SIZE - 4, 4) !=
+		crc32(0L, footer, REFTABLE_FOOTER_SIZE - 4)) {
+		error = reftable_error_corrupt();
+		goto done;
+	}
+
+	table->block_size = (uint32_t)get_be(table->data + 5, 3);
+	table->min_update_index = get_be(table->data + 8, 8);
+	table->max_update_index = get_be(table->data + 16, 8);
+
+	table->ref_index_pos = get_be(footer + 24, 8);
+	table->log_pos = get_be(footer + 48, 8);
+	table->log_index_pos = get_be(footer + 56, 8);
+
+	if (table->ref_index_pos >= table->end ||
+	    table->log_pos >= table->end ||
+	    table->log_index_pos >= table->end) {
+		error = reftable_error_corrupt();
+		goto done;
+	}
+
+	*out = table;
+	error = 0;
+
+done:
+	if (error < 0)
+		git_reftable_free(table);
+
+	p_close(fd);
+	return error;
+}
+
+void git_reftable_free(git_reftable *table)
+{
+	if (!table)
+		return;
+
+	if (table->map.data)
+		git_futils_mmap_free(&table->map);
+
+	git__free(table);
+}
+
+uint64_t git_reftable_min_update_index(const git_reftable *table)
+{
+	return table->min_update_index;
+}
+
+uint64_t git_reftable_max_update_index(const git_reftable *table)
+{
+	return table->max_update_index;
+}
+
+size_t git_reftable_size(const git_reftable *table)
+{
+	return table->size;
+}
+
+static int block_inflate(
+	reftable_block *block,
+	const git_reftable *table,
+	size_t pos,
+	size_t base,
+	size_t block_len)
+{
+	size_t header_len = pos - base + REFTABLE_BLOCK_HEADER_SIZE;
+	z_stream zs;
+	int zerr;
+
+	git_buf_clear(&block->inflated);
+
+	if (git_buf_grow(&block->inflated, block_len + 1) < 0)
+		return -1;
+
+	memcpy(block->inflated.ptr, table->data + base, header_len);
+
+	memset(&zs, 0, sizeof(zs));
+
+	if (inflateInit(&zs) != Z_OK) {
+		git_error_set(GIT_ERROR_ZLIB, "failed to initialize inflate");
+		return -1;
+	}
+
+	zs.next_in = (Bytef *)table->data + pos + REFTABLE_BLOCK_HEADER_SIZE;
+	zs.avail_in = (uInt)(table->end - pos - REFTABLE_BLOCK_HEADER_SIZE);
+	zs.next_out = (Bytef *)block->inflated.ptr + header_len;
+	zs.avail_out = (uInt)(block_len - header_len);
+
+	zerr = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+
+	if (zerr != Z_STREAM_END || zs.avail_out != 0)
+		return reftable_error_corrupt();
+
+	block->inflated.size = block_len;
+	block->data = (const unsigned char *)block->inflated.ptr;
+	block->next = pos + REFTABLE_BLOCK_HEADER_SIZE + zs.total_in;
+
+	return 0;
+}
+
+static int block_load(reftable_block *block, const git_reftable *table, size_t pos)
+{
+	size_t base = (pos == REFTABLE_HEADER_SIZE) ? 0 : pos;
+	size_t block_len, header_len = pos - base + REFTABLE_BLOCK_HEADER_SIZE;
+
+	if (pos < REFTABLE_HEADER_SIZE || pos + REFTABLE_BLOCK_HEADER_SIZE > table->end)
+		return reftable_error_corrupt();
+
+	block->type = table->data[pos];
+	block_len = (size_t)get_be(table->data + pos + 1, 3);
+
+	if (block_len < header_len + 2)
+		return reftable_error_corrupt();
+
+	if (block->type == BLOCK_TYPE_LOG) {
+		if (block_inflate(block, table, pos, base, block_len) < 0)
+			return -1;
+	} else {
+		if (block_len > table->end - base)
+			return reftable_error_corrupt();
+
+		block->data = table->data + base;
+		block->next = base + block_len;
+	}
+
+	block->len = block_len;
+	block->records = header_len;
+	block->restart_count = (size_t)get_be(block->data + block_len - 2, 2);
+
+	if (!block->restart_count ||
+	    block->restart_count * 3 > block_len - header_len - 2)
+		return reftable_error_corrupt();
+
+	block->restarts = block_len - 2 - block->restart_count * 3;
+
+	/* Skip over any padding */
+	while (block->next < table->end && table->data[block->next] == '\0')
+		block->next++;
+
+	return 0;
+}
+
+static int block_decode_key(
+	git_buf *key,
+	uint8_t *extra,
+	const unsigned char **p,
+	const unsigned char *end)
+{
+	uint64_t prefix, suffix;
+
+	if (get_varint(&prefix, p, end) < 0 ||
+	    get_varint(&suffix, p, end) < 0)
+		return reftable_error_corrupt();
+
+	*extra = suffix & 7;
+	suffix >>= 3;
+
+	if (prefix > key->size || suffix > (uint64_t)(end - *p))
+		return reftable_error_corrupt();
+
+	git_buf_truncate(key, (size_t)prefix);
+	git_buf_put(key, (const char *)*p, (size_t)suffix);
+	*p += suffix;
+
+	return git_buf_oom(key) ? -1 : 0;
+}
+
+/*
+ * Find the restart point to start a linear scan for `target` from: the
+ * last one whose key is not greater than the target.
+ */
+static int block_seek(
+	size_t *out,
+	reftable_block *block,
+	git_buf *scratch,
+	const char *target,
+	size_t target_len)
+{
+	size_t lo = 0, hi = block->restart_count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		size_t off = (size_t)get_be(block->data + block->restarts + mid * 3, 3);
+		const unsigned char *p = block->data + off;
+		uint8_t extra;
+
+		if (off < block->records || off >= block->restarts)
+			return reftable_error_corrupt();
+
+		git_buf_clear(scratch);
+
+		if (block_decode_key(scratch, &extra, &p, block->data + block->restarts) < 0)
+			return -1;
+
+		if (key_cmp(scratch->ptr, scratch->size, target, target_len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*out = lo ? (size_t)get_be(block->data + block->restarts + (lo - 1) * 3, 3) :
+		block->records;
+	return 0;
+}
+
+int git_reftable_iter_new(git_reftable_iter **out, git_reftable *table)
+{
+	git_reftable_iter *iter;
+
+	iter = git__calloc(1, sizeof(git_reftable_iter));
+	GIT_ERROR_CHECK_ALLOC(iter);
+
+	iter->table = table;
+	iter->done = true;
+
+	*out = iter;
+	return 0;
+}
+
+void git_reftable_iter_free(git_reftable_iter *iter)
+{
+	if (!iter)
+		return;
+
+	git_buf_dispose(&iter->block.inflated);
+	git_buf_dispose(&iter->key);
+	git_buf_dispose(&iter->seek);
+	git_buf_dispose(&iter->name);
+	git_buf_dispose(&iter->email);
+	git_buf_dispose(&iter->message);
+	git__free(iter);
+}
+
+/* Follow the index down to the block that may contain `target` */
+static int iter_seek_index(
+	size_t *out,
+	git_reftable_iter *iter,
+	size_t pos,
+	const char *target,
+	size_t target_len)
+{
+	const git_reftable *table = iter->table;
+	reftable_block *block = &iter->block;
+	const unsigned char *p, *end;
+	uint64_t value;
+	uint8_t extra;
+	size_t off;
+
+	while (table->data[pos] == BLOCK_TYPE_INDEX) {
+		if (block_load(block, table, pos) < 0 ||
+		    block_seek(&off, block, &iter->key, target, target_len) < 0)
+			return -1;
+
+		p = block->data + off;
+		end = block->data + block->restarts;
+		git_buf_clear(&iter->key);
+
+		for (;;) {
+			if (p >= end)
+				return GIT_ITEROVER;
+
+			if (block_decode_key(&iter->key, &extra, &p, end) < 0 ||
+			    get_varint(&value, &p, end) < 0)
+				return reftable_error_corrupt();
+
+			if (key_cmp(iter->key.ptr, iter->key.size, target, target_len) >= 0)
+				break;
+		}
+
+		if (value < REFTABLE_HEADER_SIZE || value >= table->end)
+			return reftable_error_corrupt();
+
+		pos = (size_t)value;
+	}
+
+	*out = pos;
+	return 0;
+}
+
+static int iter_seek(
+	git_reftable_iter *iter,
+	char type,
+	size_t section,
+	size_t index,
+	const char *target,
+	size_t target_len)
+{
+	const git_reftable *table = iter->table;
+	reftable_block next = {0};
+	size_t pos = section, off;
+	uint8_t extra;
+	int error = 0;
+
+	iter->type = type;
+	iter->done = true;
+	iter->seeking = false;
+
+	if (!section || section >= table->end || table->data[section] != type)
+		return 0;
+
+	if (index) {
+		if ((error = iter_seek_index(&pos, iter, index, target, target_len)) < 0)
+			return error == GIT_ITEROVER ? 0 : error;
+
+		if ((error = block_load(&iter->block, table, pos)) < 0)
+			return error;
+	} else {
+		if ((error = block_load(&iter->block, table, pos)) < 0)
+			return error;
+
+		/* Without an index, walk the blocks until the next one starts after the target */
+		while (iter->block.next < table->end &&
+		       table->data[iter->block.next] == type) {
+			const unsigned char *p;
+
+			if ((error = block_load(&next, table, iter->block.next)) < 0)
+				goto done;
+
+			p = next.data + next.records;
+			git_buf_clear(&iter->key);
+
+			if ((error = block_decode_key(&iter->key, &extra, &p,
+					next.data + next.restarts)) < 0)
+				goto done;
+
+			if (key_cmp(iter->key.ptr, iter->key.size, target, target_len) > 0)
+				break;
+
+			if ((error = block_load(&iter->block, table, iter->block.next)) < 0)
+				goto done;
+		}
+	}
+
+	if (iter->block.type != type) {
+		error = reftable_error_corrupt();
+		goto done;
+	}
+
+	if ((error = block_seek(&off, &iter->block, &iter->key, target, target_len)) < 0)
+		goto done;
+
+	git_buf_clear(&iter->key);
+	git_buf_set(&iter->seek, target, target_len);
+
+	iter->off = off;
+	iter->seeking = true;
+	iter->done = false;
+
+	if (git_buf_oom(&iter->seek))
+		error = -1;
+
+done:
+	git_buf_dispose(&next.inflated);
+	return error;
+}
+
+int git_reftable_iter_seek_ref(git_reftable_iter *iter, const char *name)
+{
+	return iter_seek(iter, BLOCK_TYPE_REF, REFTABLE_HEADER_SIZE,
+		(size_t)iter->table->ref_index_pos, name, strlen(name));
+}
+
+int git_reftable_iter_seek_log(git_reftable_iter *iter, const char *refname)
+{
+	/* The key of a reference's newest entry immediately follows "refname\0" */
+	return iter_seek(iter, BLOCK_TYPE_LOG, (size_t)iter->table->log_pos,
+		(size_t)iter->table->log_index_pos, refname,
+		*refname ? strlen(refname) + 1 : 0);
+}
+
+/* Make sure the current block has records left to read */
+static int iter_prepare(git_reftable_iter *iter)
+{
+	const git_reftable *table = iter->table;
+
+	if (iter->done)
+		return GIT_ITEROVER;
+
+	if (iter->off < iter->block.restarts)
+		return 0;
+
+	if (iter->block.next >= table->end ||
+	    table->data[iter->block.next] != iter->type) {
+		iter->done = true;
+		return GIT_ITEROVER;
+	}
+
+	if (block_load(&iter->block, table, iter->block.next) < 0)
+		return -1;
+
+	if (iter->block.type != iter->type)
+		return reftable_error_corrupt();
+
+	iter->off = iter->block.records;
+	git_buf_clear(&iter->key);
+
+	return 0;
+}
+
+/* Whether the record that was just decoded is before the seek target */
+static bool iter_skip(git_reftable_iter *iter)
+{
+	if (!iter->seeking)
+		return false;
+
+	if (key_cmp(iter->key.ptr, iter->key.size, iter->seek.ptr, iter->seek.size) < 0)
+		return true;
+
+	iter->seeking = false;
+	return false;
+}
+
+int git_reftable_iter_next_ref(git_reftable_ref *out, git_reftable_iter *iter)
+{
+	const unsigned char *p, *end;
+	uint64_t delta, len;
+	uint8_t extra;
+	int error;
+
+	do {
+		if ((error = iter_prepare(iter)) != 0)
+			return error;
+
+		p = iter->block.data + iter->off;
+		end = iter->block.data + iter->block.restarts;
+
+		if (block_decode_key(&iter->key, &extra, &p, end) < 0 ||
+		    get_varint(&delta, &p, end) < 0)
+			return reftable_error_corrupt();
+
+		memset(out, 0, sizeof(*out));
+
+		switch (extra) {
+		case GIT_REFTABLE_REF_DELETION:
+			break;
+		case GIT_REFTABLE_REF_DIRECT:
+		case GIT_REFTABLE_REF_PEELED:
+			if ((size_t)(end - p) < GIT_OID_RAWSZ * extra)
+				return reftable_error_corrupt();
+
+			git_oid_fromraw(&out->id, p);
+			p += GIT_OID_RAWSZ;
+
+			if (extra == GIT_REFTABLE_REF_PEELED) {
+				git_oid_fromraw(&out->peel, p);
+				p += GIT_OID_RAWSZ;
+			}
+			break;
+		case GIT_REFTABLE_REF_SYMBOLIC:
+			if (get_varint(&len, &p, end) < 0 || len > (uint64_t)(end - p))
+				return reftable_error_corrupt();
+
+			git_buf_set(&iter->name, p, (size_t)len);
+			p += len;
+
+			if (git_buf_oom(&iter->name))
+				return -1;
+
+			out->target = iter->name.ptr;
+			break;
+		default:
+			return reftable_error_corrupt();
+		}
+
+		iter->off = p - iter->block.data;
+	} while (iter_skip(iter));
+
+	out->name = iter->key.ptr;
+	out->type = extra;
+	out->update_index = iter->table->min_update_index + delta;
+
+	return 0;
+}
+
+static int get_string(git_buf *out, const unsigned char **p, const unsigned char *end)
+{
+	uint64_t len;
+
+	if (get_varint(&len, p, end) < 0 || len > (uint64_t)(end - *p))
+		return reftable_error_corrupt();
+
+	git_buf_set(out, *p, (size_t)len);
+	*p += len;
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+int git_reftable_iter_next_log(git_reftable_log *out, git_reftable_iter *iter)
+{
+	const unsigned char *p, *end;
+	uint8_t extra;
+	int error;
+
+	do {
+		if ((error = iter_prepare(iter)) != 0)
+			return error;
+
+		p = iter->block.data + iter->off;
+		end = iter->block.data + iter->block.restarts;
+
+		if (block_decode_key(&iter->key, &extra, &p, end) < 0)
+			return -1;
+
+		if (iter->key.size < 9 || iter->key.ptr[iter->key.size - 9] != '\0' ||
+		    extra > 1)
+			return reftable_error_corrupt();
+
+		memset(out, 0, sizeof(*out));
+		out->deletion = (extra == 0);
+
+		if (!out->deletion) {
+			if ((size_t)(end - p) < GIT_OID_RAWSZ * 2)
+				return reftable_error_corrupt();
+
+			git_oid_fromraw(&out->old_id, p);
+			git_oid_fromraw(&out->new_id, p + GIT_OID_RAWSZ);
+			p += GIT_OID_RAWSZ * 2;
+
+			if (get_string(&iter->name, &p, end) < 0 ||
+			    get_string(&iter->email, &p, end) < 0 ||
+			    get_varint(&out->time, &p, end) < 0 ||
+			    end - p < 2)
+				return reftable_error_corrupt();
+
+			out->tz_offset = (int16_t)get_be(p, 2);
+			p += 2;
+
+			if (get_string(&iter->message, &p, end) < 0)
+				return -1;
+
+			out->name = iter->name.ptr;
+			out->email = iter->email.ptr;
+			out->message = iter->message.ptr;
+		}
+
+		iter->off = p - iter->block.data;
+	} while (iter_skip(iter));
+
+	out->refname = iter->key.ptr;
+	out->update_index = UINT64_MAX -
+		get_be((const unsigned char *)iter->key.ptr + iter->key.size - 8, 8);
+
+	return 0;
+}
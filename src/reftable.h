@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_reftable_h__
+#define INCLUDE_reftable_h__
+
+#include "common.h"
+
+#include "git2/oid.h"
+#include "buffer.h"
+
+/*
+ * Reading and writing of single tables in the reftable format: a sorted,
+ * block-based file of prefix-compressed reference and log records, with
+ * restart points in each block and optional index blocks on top.
+ */
+
+#define GIT_REFTABLE_DIR "reftable"
+#define GIT_REFTABLE_LIST_FILE "tables.list"
+#define GIT_REFTABLE_BLOCK_SIZE 4096
+
+typedef enum {
+	GIT_REFTABLE_REF_DELETION = 0,
+	GIT_REFTABLE_REF_DIRECT = 1,
+	GIT_REFTABLE_REF_PEELED = 2,
+	GIT_REFTABLE_REF_SYMBOLIC = 3,
+} git_reftable_ref_t;
+
+typedef struct {
+	const char *name;
+	uint64_t update_index;
+	git_reftable_ref_t type;
+	git_oid id;
+	git_oid peel;
+	const char *target;
+} git_reftable_ref;
+
+typedef struct {
+	const char *refname;
+	uint64_t update_index;
+	bool deletion;
+	git_oid old_id;
+	git_oid new_id;
+	const char *name;
+	const char *email;
+	uint64_t time;
+	int16_t tz_offset;
+	const char *message;
+} git_reftable_log;
+
+typedef struct git_reftable git_reftable;
+typedef struct git_reftable_iter git_reftable_iter;
+
+/**
+ * Serialize a table into `out`.  `refs` must be sorted by name and
+ * `logs` by reference name and then by descending update index.
+ */
+extern int git_reftable_write(
+	git_buf *out,
+	uint32_t block_size,
+	uint64_t min_update_index,
+	uint64_t max_update_index,
+	const git_reftable_ref *refs,
+	size_t refs_len,
+	const git_reftable_log *logs,
+	size_t logs_len);
+
+extern int git_reftable_open(git_reftable **out, const char *path);
+extern void git_reftable_free(git_reftable *table);
+
+extern uint64_t git_reftable_min_update_index(const git_reftable *table);
+extern uint64_t git_reftable_max_update_index(const git_reftable *table);
+extern size_t git_reftable_size(const git_reftable *table);
+
+extern int git_reftable_iter_new(git_reftable_iter **out, git_reftable *table);
+extern void git_reftable_iter_free(git_reftable_iter *iter);
+
+/**
+ * Position the iterator on the first reference whose name sorts at or
+ * after `name`.
+ */
+extern int git_reftable_iter_seek_ref(git_reftable_iter *iter, const char *name);
+
+/**
+ * Position the iterator on the newest log record of `refname`, or of
+ * the first reference that sorts after it if there is none.
+ */
+extern int git_reftable_iter_seek_log(git_reftable_iter *iter, const char *refname);
+
+/**
+ * Read the next record.  The strings in the returned record point into
+ * the iterator and remain valid until it is advanced or freed.  Returns
+ * GIT_ITEROVER at the end of the section.
+ */
+extern int git_reftable_iter_next_ref(git_reftable_ref *out, git_reftable_iter *iter);
+extern int git_reftable_iter_next_log(git_reftable_log *out, git_reftable_iter *iter);
+
+#endif
@@ -725,6 +725,9 @@ int git_remote__connect(git_remote *remote, git_direction direction, const git_r
 	if (conn->proxy)
 		GIT_ERROR_CHECK_VERSION(conn->proxy, GIT_PROXY_OPTIONS_VERSION, "git_proxy_options");
 
+	/* Unless a fetch tells us otherwise, list all references */
+	git_vector_free_deep(&remote->ref_prefixes);
+
 	t = remote->transport;
 
 	if ((error = git_remote__urlfordirection(&url, remote, direction, callbacks)) < 0)
@@ -915,6 +918,74 @@ static int ls_to_vector(git_vector *out, git_remote *remote)
 	return 0;
 }
 
+static int add_ref_prefix(git_vector *prefixes, const char *fmt, const char *src, size_t len)
+{
+	git_buf prefix = GIT_BUF_INIT;
+	int error;
+
+	if ((error = git_buf_printf(&prefix, fmt, (int)len, src)) < 0 ||
+	    (error = git_vector_insert(prefixes, prefix.ptr)) < 0) {
+		git_buf_dispose(&prefix);
+		return error;
+	}
+
+	return 0;
+}
+
+/*
+ * Remember the prefixes of the references that a fetch with the given
+ * refspecs may need, so that a transport which can filter the refs it
+ * lists does not have to list all of them.
+ */
+static int set_ref_prefixes(git_remote *remote, git_vector *refspecs, git_remote_autotag_option_t tagopt)
+{
+	const char *formatters[] = {
+		"%.*s",
+		GIT_REFS_DIR "%.*s",
+		GIT_REFS_TAGS_DIR "%.*s",
+		GIT_REFS_HEADS_DIR "%.*s",
+		NULL
+	};
+	git_refspec *spec;
+	size_t i, j, len;
+	int error = 0;
+
+	git_vector_free_deep(&remote->ref_prefixes);
+
+	git_vector_foreach(refspecs, i, spec) {
+		if (spec->push)
+			continue;
+
+		len = spec->pattern ? strcspn(spec->src, "*") : strlen(spec->src);
+
+		/* This refspec may match any reference */
+		if (!len) {
+			git_vector_free_deep(&remote->ref_prefixes);
+			return 0;
+		}
+
+		if (spec->pattern || !git__prefixcmp(spec->src, GIT_REFS_DIR)) {
+			error = add_ref_prefix(&remote->ref_prefixes, "%.*s", spec->src, len);
+		} else {
+			/* Shorthands are expanded like when they are matched */
+			for (j = 0; formatters[j] && !error; j++)
+				error = add_ref_prefix(&remote->ref_prefixes, formatters[j], spec->src, len);
+		}
+
+		if (error < 0)
+			return error;
+	}
+
+	/* The remote's HEAD is used when there is nothing else to fetch */
+	if (!error)
+		error = add_ref_prefix(&remote->ref_prefixes, "%.*s", GIT_HEAD_FILE, strlen(GIT_HEAD_FILE));
+
+	if (!error && tagopt != GIT_REMOTE_DOWNLOAD_TAGS_NONE)
+		error = add_ref_prefix(&remote->ref_prefixes, "%.*s", GIT_REFS_TAGS_DIR, strlen(GIT_REFS_TAGS_DIR));
+
+	return error;
+}
+
 int git_remote_download(git_remote *remote, const git_strarray *refspecs, const git_fetch_options *opts)
 {
 	int error = -1;
@@ -923,9 +994,12 @@ int git_remote_download(git_remote *remote, const git_strarray *refspecs, const
 	const git_remote_callbacks *cbs = NULL;
 	const git_strarray *custom_headers = NULL;
 	const git_proxy_options *proxy = NULL;
+	git_remote_autotag_option_t tagopt;
 
 	assert(remote);
 
+	tagopt = remote->download_tags;
+
 	if (!remote->repo) {
 		git_error_set(GIT_ERROR_INVALID, "cannot download detached remote");
 		return -1;
@@ -937,15 +1011,15 @@ int git_remote_download(git_remote *remote, const git_strarray *refspecs, const
 		custom_headers = &opts->custom_headers;
 		GIT_ERROR_CHECK_VERSION(&opts->proxy_opts, GIT_PROXY_OPTIONS_VERSION, "git_proxy_options");
 		proxy = &opts->proxy_opts;
+
+		if (opts->download_tags != GIT_REMOTE_DOWNLOAD_TAGS_UNSPECIFIED)
+			tagopt = opts->download_tags;
 	}
 
 	if (!git_remote_connected(remote) &&
 	    (error = git_remote_connect(remote, GIT_DIRECTION_FETCH, cbs, proxy, custom_headers)) < 0)
 		goto on_error;
 
-	if (ls_to_vector(&refs, remote) < 0)
-		return -1;
-
 	if ((git_vector_init(&specs, 0, NULL)) < 0)
 		goto on_error;
 
@@ -962,6 +1036,10 @@ int git_remote_download(git_remote *remote, const git_strarray *refspecs, const
 		remote->passed_refspecs = 1;
 	}
 
+	if ((error = set_ref_prefixes(remote, to_active, tagopt)) < 0 ||
+	    (error = ls_to_vector(&refs, remote)) < 0)
+		goto on_error;
+
 	free_refspecs(&remote->passive_refspecs);
 	if ((error = dwim_refspecs(&remote->passive_refspecs, &remote->refspecs, &refs)) < 0)
 		goto on_error;
@@ -981,10 +1059,21 @@ int git_remote_download(git_remote *remote, const git_strarray *refspecs, const
 		remote->push = NULL;
 	}
 
-	if ((error = git_fetch_negotiate(remote, opts)) < 0)
-		return error;
+	if ((error = git_fetch__set_filter(remote, opts ? opts->filter : NULL)) == 0 &&
+	    (error = git_fetch__set_shallow(remote, opts)) == 0 &&
+	    (error = git_fetch__set_negotiation(remote, opts)) == 0 &&
+	    (error = git_fetch_negotiate(remote, opts)) == 0 &&
+	    (error = git_fetch_download_pack(remote, cbs)) == 0 &&
+	    (error = git_fetch__update_shallow(remote)) == 0 &&
+	    opts && opts->filter)
+		error = git_fetch__record_promisor(remote);
 
-	return git_fetch_download_pack(remote, cbs);
+	git__free(remote->filter);
+	remote->filter = NULL;
+	git_fetch__clear_shallow(remote);
+	git_fetch__clear_negotiation(remote);
+
+	return error;
 
 on_error:
 	git_vector_free(&refs);
@@ -1058,6 +1147,80 @@ int git_remote_fetch(
 	return error;
 }
 
+int git_remote_fetch_objects(
+		git_remote *remote,
+		const git_oid *ids,
+		size_t count,
+		const git_fetch_options *opts)
+{
+	git_remote_connection_opts conn = GIT_REMOTE_CONNECTION_OPTIONS_INIT;
+	const git_remote_callbacks *cbs = NULL;
+	git_indexer_progress_cb progress = NULL;
+	void *payload = NULL;
+	const char *filter = "blob:none";
+	git_remote_head *heads = NULL;
+	const git_remote_head **wants = NULL;
+	git_transport *t;
+	size_t i;
+	int error;
+
+	assert(remote && (ids || !count));
+
+	if (!remote->repo) {
+		git_error_set(GIT_ERROR_INVALID, "cannot download detached remote");
+		return -1;
+	}
+
+	if (!count)
+		return 0;
+
+	if (opts) {
+		GIT_ERROR_CHECK_VERSION(&opts->callbacks, GIT_REMOTE_CALLBACKS_VERSION, "git_remote_callbacks");
+		cbs = &opts->callbacks;
+		progress = cbs->transfer_progress;
+		payload = cbs->payload;
+		conn.custom_headers = &opts->custom_headers;
+		GIT_ERROR_CHECK_VERSION(&opts->proxy_opts, GIT_PROXY_OPTIONS_VERSION, "git_proxy_options");
+		conn.proxy = &opts->proxy_opts;
+
+		if (opts->filter)
+			filter = opts->filter;
+	}
+
+	heads = git__calloc(count, sizeof(git_remote_head));
+	GIT_ERROR_CHECK_ALLOC(heads);
+	wants = git__calloc(count, sizeof(git_remote_head *));
+	if (!wants) {
+		error = -1;
+		goto done;
+	}
+
+	for (i = 0; i < count; i++) {
+		git_oid_cpy(&heads[i].oid, &ids[i]);
+		wants[i] = &heads[i];
+	}
+
+	if ((error = git_fetch__set_filter(remote, filter)) < 0 ||
+	    (error = git_remote__connect(remote, GIT_DIRECTION_FETCH, cbs, &conn)) < 0)
+		goto done;
+
+	t = remote->transport;
+	remote->lazy_fetch = 1;
+
+	if ((error = t->negotiate_fetch(t, remote->repo, wants, count)) == 0)
+		error = t->download_pack(t, remote->repo, &remote->stats, progress, payload);
+
+	remote->lazy_fetch = 0;
+	git_remote_disconnect(remote);
+
+done:
+	git__free(remote->filter);
+	remote->filter = NULL;
+	git__free(wants);
+	git__free(heads);
+	return error;
+}
+
 static int remote_head_for_fetchspec_src(git_remote_head **out, git_vector *update_heads, const char *fetchspec_src)
 {
 	unsigned int i;
@@ -1719,6 +1882,11 @@ void git_remote_free(git_remote *remote)
 	free_refspecs(&remote->passive_refspecs);
 	git_vector_free(&remote->passive_refspecs);
 
+	git_vector_free_deep(&remote->ref_prefixes);
+	git__free(remote->filter);
+	git_fetch__clear_shallow(remote);
+	git_fetch__clear_negotiation(remote);
+
 	git_push_free(remote->push);
 	git__free(remote->url);
 	git__free(remote->pushurl);
@@ -15,6 +15,7 @@
 
 #include "refspec.h"
 #include "vector.h"
+#include "shallow.h"
 
 #define GIT_REMOTE_ORIGIN "origin"
 
@@ -26,6 +27,8 @@ struct git_remote {
 	git_vector refspecs;
 	git_vector active_refspecs;
 	git_vector passive_refspecs;
+	git_vector ref_prefixes;
+	char *filter; /* object filter of the fetch in progress */
 	git_transport *transport;
 	git_repository *repo;
 	git_push *push;
@@ -34,6 +37,13 @@ struct git_remote {
 	git_remote_autotag_option_t download_tags;
 	int prune_refs;
 	int passed_refspecs;
+	int lazy_fetch; /* fetching objects by id, without negotiation */
+	git_shallow_deepen deepen; /* history depth of the fetch in progress */
+	git_array_oid_t shallow_roots; /* our shallow roots, sent to the remote */
+	git_array_oid_t shallow_added; /* new roots reported by the remote */
+	git_array_oid_t shallow_removed; /* roots whose parents it sends */
+	git_fetch_negotiation_t negotiation; /* of the fetch in progress */
+	git_vector negotiation_tips; /* globs of the references to negotiate from */
 };
 
 typedef struct git_remote_connection_opts {
@@ -26,6 +26,8 @@
 #include "odb.h"
 #include "refdb.h"
 #include "remote.h"
+#include "fetch.h"
+#include "shallow.h"
 #include "merge.h"
 #include "diff_driver.h"
 #include "annotated_commit.h"
@@ -62,7 +64,7 @@ static const struct {
 	{ GIT_REPOSITORY_ITEM_COMMONDIR, GIT_REPOSITORY_ITEM_GITDIR, "worktrees", true }
 };
 
-static int check_repositoryformatversion(git_config *config);
+static int check_repositoryformatversion(int *out, git_config *config);
 
 #define GIT_COMMONDIR_FILE "commondir"
 #define GIT_GITDIR_FILE "gitdir"
@@ -72,6 +74,13 @@ static int check_repositoryformatversion(git_config *config);
 #define GIT_BRANCH_MASTER "master"
 
 #define GIT_REPO_VERSION 0
+#define GIT_REPO_MAX_VERSION 1
+
+/* The extensions that repositories of format version 1 may use */
+static const char *git_repository__extensions[] = {
+	"noop",
+	"partialclone",
+};
 
 git_buf git_repository__reserved_names_win32[] = {
 	{ DOT_GIT, 0, CONST_STRLEN(DOT_GIT) },
@@ -845,7 +854,7 @@ int git_repository_open_ext(
 	if (error < 0 && error != GIT_ENOTFOUND)
 		goto cleanup;
 
-	if (config && (error = check_repositoryformatversion(config)) < 0)
+	if (config && (error = check_repositoryformatversion(NULL, config)) < 0)
 		goto cleanup;
 
 	if ((flags & GIT_REPOSITORY_OPEN_BARE) != 0)
@@ -1097,7 +1106,8 @@ int git_repository_odb__weakptr(git_odb **out, git_repository *repo)
 		GIT_REFCOUNT_OWN(odb, repo);
 
 		if ((error = git_odb__set_caps(odb, GIT_ODB_CAP_FROM_OWNER)) < 0 ||
-			(error = git_odb__add_default_backends(odb, odb_path.ptr, 0, 0)) < 0) {
+			(error = git_odb__add_default_backends(odb, odb_path.ptr, 0, 0)) < 0 ||
+			(error = git_fetch__set_promisor_callback(repo, odb)) < 0) {
 			git_odb_free(odb);
 			return error;
 		}
@@ -1341,25 +1351,69 @@ bool git_repository__reserved_names(
 }
 #endif
 
-static int check_repositoryformatversion(git_config *config)
+static int check_extensions(git_config *config)
+{
+	git_config_iterator *iter;
+	git_config_entry *entry;
+	const char *name;
+	size_t i;
+	int error;
+
+	if ((error = git_config_iterator_glob_new(&iter, config, "^extensions\\.")) < 0)
+		return error;
+
+	while ((error = git_config_next(&entry, iter)) == 0) {
+		name = entry->name + strlen("extensions.");
+
+		for (i = 0; i < ARRAY_SIZE(git_repository__extensions); i++) {
+			if (!strcmp(name, git_repository__extensions[i]))
+				break;
+		}
+
+		if (i == ARRAY_SIZE(git_repository__extensions)) {
+			git_error_set(GIT_ERROR_REPOSITORY,
+				"unsupported repository extension '%s'", name);
+			error = -1;
+			break;
+		}
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	git_config_iterator_free(iter);
+	return error;
+}
+
+/* Check that we support the repository's format, which goes in `out` if given */
+static int check_repositoryformatversion(int *out, git_config *config)
 {
-	int version, error;
+	int version = GIT_REPO_VERSION, error;
 
 	error = git_config_get_int32(&version, config, "core.repositoryformatversion");
 	/* git ignores this if the config variable isn't there */
-	if (error == GIT_ENOTFOUND)
-		return 0;
+	if (error == GIT_ENOTFOUND) {
+		version = GIT_REPO_VERSION;
+		error = 0;
+	}
 
 	if (error < 0)
 		return -1;
 
-	if (GIT_REPO_VERSION < version) {
+	if (out)
+		*out = version;
+
+	if (GIT_REPO_MAX_VERSION < version) {
 		git_error_set(GIT_ERROR_REPOSITORY,
 			"unsupported repository version %d. Only versions up to %d are supported.",
-			version, GIT_REPO_VERSION);
+			version, GIT_REPO_MAX_VERSION);
 		return -1;
 	}
 
+	/* Extensions are only meaningful from version 1 on */
+	if (version >= 1)
+		return check_extensions(config);
+
 	return 0;
 }
 
@@ -1574,11 +1628,12 @@ static int repo_init_config(
 	git_config *config = NULL;
 	bool is_bare = ((flags & GIT_REPOSITORY_INIT_BARE) != 0);
 	bool is_reinit = ((flags & GIT_REPOSITORY_INIT__IS_REINIT) != 0);
+	int version = GIT_REPO_VERSION;
 
 	if ((error = repo_local_config(&config, &cfg_path, NULL, repo_dir)) < 0)
 		goto cleanup;
 
-	if (is_reinit && (error = check_repositoryformatversion(config)) < 0)
+	if (is_reinit && (error = check_repositoryformatversion(&version, config)) < 0)
 		goto cleanup;
 
 #define SET_REPO_CONFIG(TYPE, NAME, VAL) do { \
@@ -1586,7 +1641,8 @@ static int repo_init_config(
 		goto cleanup; } while (0)
 
 	SET_REPO_CONFIG(bool, "core.bare", is_bare);
-	SET_REPO_CONFIG(int32, "core.repositoryformatversion", GIT_REPO_VERSION);
+	/* Don't downgrade a repository that uses extensions */
+	SET_REPO_CONFIG(int32, "core.repositoryformatversion", max(version, GIT_REPO_VERSION));
 
 	if ((error = repo_init_fs_configs(
 			config, cfg_path.ptr, repo_dir, work_dir, !is_reinit)) < 0)
@@ -2861,7 +2917,7 @@ int git_repository_is_shallow(git_repository *repo)
 	struct stat st;
 	int error;
 
-	if ((error = git_buf_joinpath(&path, repo->gitdir, "shallow")) < 0)
+	if ((error = git_buf_joinpath(&path, repo->commondir, GIT_SHALLOW_FILE)) < 0)
 		return error;
 
 	error = git_path_lstat(path.ptr, &st);
@@ -139,10 +139,10 @@ static int try_parse_numeric(int *n, const char *curly_braces_content)
 static int retrieve_previously_checked_out_branch_or_revision(git_object **out, git_reference **base_ref, git_repository *repo, const char *identifier, size_t position)
 {
 	git_reference *ref = NULL;
-	git_reflog *reflog = NULL;
+	git_reflog_iterator *iter = NULL;
 	git_regexp preg;
 	int error = -1;
-	size_t i, numentries, cur;
+	size_t cur;
 	const git_reflog_entry *entry;
 	const char *msg;
 	git_buf buf = GIT_BUF_INIT;
@@ -158,15 +158,12 @@ static int retrieve_previously_checked_out_branch_or_revision(git_object **out,
 	if (git_reference_lookup(&ref, repo, GIT_HEAD_FILE) < 0)
 		goto cleanup;
 
-	if (git_reflog_read(&reflog, repo, GIT_HEAD_FILE) < 0)
+	if (git_reflog_iterator_new(&iter, repo, GIT_HEAD_FILE) < 0)
 		goto cleanup;
 
-	numentries  = git_reflog_entrycount(reflog);
-
-	for (i = 0; i < numentries; i++) {
+	while ((error = git_reflog_next(&entry, iter)) == 0) {
 		git_regmatch regexmatches[2];
 
-		entry = git_reflog_entry_byindex(reflog, i);
 		msg = git_reflog_entry_message(entry);
 		if (!msg)
 			continue;
@@ -179,7 +176,7 @@ static int retrieve_previously_checked_out_branch_or_revision(git_object **out,
 		if (cur > 0)
 			continue;
 
-		if ((git_buf_put(&buf, msg+regexmatches[1].start, regexmatches[1].end - regexmatches[1].start)) < 0)
+		if ((error = git_buf_put(&buf, msg+regexmatches[1].start, regexmatches[1].end - regexmatches[1].start)) < 0)
 			goto cleanup;
 
 		if ((error = git_reference_dwim(base_ref, repo, git_buf_cstr(&buf))) == 0)
@@ -193,64 +190,56 @@ static int retrieve_previously_checked_out_branch_or_revision(git_object **out,
 		goto cleanup;
 	}
 
-	error = GIT_ENOTFOUND;
+	if (error == GIT_ITEROVER)
+		error = GIT_ENOTFOUND;
 
 cleanup:
 	git_reference_free(ref);
 	git_buf_dispose(&buf);
 	git_regexp_dispose(&preg);
-	git_reflog_free(reflog);
+	git_reflog_iterator_free(iter);
 	return error;
 }
 
 static int retrieve_oid_from_reflog(git_oid *oid, git_reference *ref, size_t identifier)
 {
-	git_reflog *reflog;
-	size_t numentries;
+	git_reflog_iterator *iter;
+	size_t numentries = 0;
 	const git_reflog_entry *entry;
 	bool search_by_pos = (identifier <= 100000000);
+	int error;
 
-	if (git_reflog_read(&reflog, git_reference_owner(ref), git_reference_name(ref)) < 0)
+	if (git_reflog_iterator_new(&iter, git_reference_owner(ref), git_reference_name(ref)) < 0)
 		return -1;
 
-	numentries = git_reflog_entrycount(reflog);
-
-	if (search_by_pos) {
-		if (numentries < identifier + 1)
-			goto notfound;
-
-		entry = git_reflog_entry_byindex(reflog, identifier);
-		git_oid_cpy(oid, git_reflog_entry_id_new(entry));
-	} else {
-		size_t i;
-		git_time commit_time;
-
-		for (i = 0; i < numentries; i++) {
-			entry = git_reflog_entry_byindex(reflog, i);
-			commit_time = git_reflog_entry_committer(entry)->when;
+	/* The newest entries come first, so stop as soon as we have a match */
+	while ((error = git_reflog_next(&entry, iter)) == 0) {
+		bool found;
 
-			if (commit_time.time > (git_time_t)identifier)
-				continue;
+		if (search_by_pos)
+			found = (numentries == identifier);
+		else
+			found = (git_reflog_entry_committer(entry)->when.time <= (git_time_t)identifier);
 
+		if (found) {
 			git_oid_cpy(oid, git_reflog_entry_id_new(entry));
 			break;
 		}
 
-		if (i == numentries)
-			goto notfound;
+		numentries++;
 	}
 
-	git_reflog_free(reflog);
-	return 0;
+	git_reflog_iterator_free(iter);
 
-notfound:
-	git_error_set(
-		GIT_ERROR_REFERENCE,
-		"reflog for '%s' has only %"PRIuZ" entries, asked for %"PRIuZ,
-		git_reference_name(ref), numentries, identifier);
+	if (error == GIT_ITEROVER) {
+		git_error_set(
+			GIT_ERROR_REFERENCE,
+			"reflog for '%s' has only %"PRIuZ" entries, asked for %"PRIuZ,
+			git_reference_name(ref), numentries, identifier);
+		return GIT_ENOTFOUND;
+	}
 
-	git_reflog_free(reflog);
-	return GIT_ENOTFOUND;
+	return error;
 }
 
 static int retrieve_revobject_from_reflog(git_object **out, git_reference **base_ref, git_repository *repo, const char *identifier, size_t position)
@@ -10,6 +10,7 @@
 #include "commit.h"
 #include "odb.h"
 #include "pool.h"
+#include "shallow.h"
 
 #include "git2/revparse.h"
 #include "merge.h"
@@ -671,7 +672,8 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 
 	walk->repo = repo;
 
-	if (git_repository_odb(&walk->odb, repo) < 0) {
+	if (git_repository_odb(&walk->odb, repo) < 0 ||
+	    git_shallow__read(&walk->shallow, repo) < 0) {
 		git_revwalk_free(walk);
 		return -1;
 	}
@@ -691,9 +693,36 @@ void git_revwalk_free(git_revwalk *walk)
 	git_oidmap_free(walk->commits);
 	git_pool_clear(&walk->commit_pool);
 	git_pqueue_free(&walk->iterator_time);
+	git_array_clear(walk->shallow);
 	git__free(walk);
 }
 
+int git_revwalk__add_shallow(git_revwalk *walk, const git_oid *ids, size_t count)
+{
+	git_oid *id;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		id = git_array_alloc(walk->shallow);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &ids[i]);
+	}
+
+	git_shallow__sort(&walk->shallow);
+	return 0;
+}
+
+static int shallow_search_cmp(const void *key, const void *entry)
+{
+	return git_oid__cmp(key, entry);
+}
+
+bool git_revwalk__is_shallow(git_revwalk *walk, const git_oid *id)
+{
+	return git_array_size(walk->shallow) > 0 &&
+		git_array_search(NULL, walk->shallow, shallow_search_cmp, id) == 0;
+}
+
 git_repository *git_revwalk_repository(git_revwalk *walk)
 {
 	assert(walk);
@@ -15,6 +15,7 @@
 #include "pqueue.h"
 #include "pool.h"
 #include "vector.h"
+#include "oidarray.h"
 
 #include "oidmap.h"
 
@@ -46,10 +47,22 @@ struct git_revwalk {
 	/* hide callback */
 	git_revwalk_hide_cb hide_cb;
 	void *hide_cb_payload;
+
+	/* commits walked as roots, sorted; the repository's shallow roots */
+	git_array_oid_t shallow;
 };
 
 git_commit_list_node *git_revwalk__commit_lookup(git_revwalk *walk, const git_oid *oid);
 
+/*
+ * Walk the given commits as if they had no parents, like the shallow
+ * roots of the repository.  This only applies to the commits that the
+ * walk has not parsed yet.
+ */
+int git_revwalk__add_shallow(git_revwalk *walk, const git_oid *ids, size_t count);
+
+bool git_revwalk__is_shallow(git_revwalk *walk, const git_oid *id);
+
 typedef struct {
 	int uninteresting;
 	int from_glob;
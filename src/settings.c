@@ -24,6 +24,8 @@
 #include "odb.h"
 #include "refs.h"
 #include "index.h"
+#include "tree.h"
+#include "zstream.h"
 #include "transports/smart.h"
 #include "transports/http.h"
 #include "streams/openssl.h"
@@ -291,6 +293,36 @@ int git_libgit2_opts(int key, ...)
 		git_http__expect_continue = (va_arg(ap, int) != 0);
 		break;
 
+	case GIT_OPT_ENABLE_STRICT_TREE_PARSING:
+		git_tree__strict_parsing = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_ENABLE_LIBDEFLATE:
+		git_zstream__use_libdeflate = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE:
+		git_odb__loose_object_cache = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_ENABLE_PROTOCOL_V2:
+		git_smart__protocol_v2_enabled = (va_arg(ap, int) != 0);
+		break;
+
+	case GIT_OPT_SET_HTTP_POOL_MAX_IDLE:
+		git_http__pool_max_idle = va_arg(ap, size_t);
+		git_http_client_pool_trim();
+		break;
+
+	case GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT:
+		git_http__pool_idle_timeout = va_arg(ap, int);
+		git_http_client_pool_trim();
+		break;
+
+	case GIT_OPT_SET_ODB_READ_MANY_THREADS:
+		git_odb__read_many_threads = va_arg(ap, unsigned int);
+		break;
+
 	default:
 		git_error_set(GIT_ERROR_INVALID, "invalid option key");
 		error = -1;
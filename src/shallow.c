@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "shallow.h"
+
+#include "git2/object.h"
+#include "git2/revwalk.h"
+
+#include "repository.h"
+#include "futils.h"
+#include "filebuf.h"
+#include "revwalk.h"
+#include "commit_list.h"
+#include "refs.h"
+
+typedef git_array_t(git_commit_list_node *) shallow_node_array;
+
+static int shallow_oid_cmp(const void *a, const void *b, void *payload)
+{
+	GIT_UNUSED(payload);
+	return git_oid__cmp(a, b);
+}
+
+void git_shallow__sort(git_array_oid_t *roots)
+{
+	size_t i, j;
+
+	if (git_array_size(*roots) < 2)
+		return;
+
+	git__qsort_r(roots->ptr, git_array_size(*roots),
+		sizeof(git_oid), shallow_oid_cmp, NULL);
+
+	for (i = 1, j = 0; i < git_array_size(*roots); i++) {
+		if (!git_oid_equal(&roots->ptr[i], &roots->ptr[j]))
+			git_oid_cpy(&roots->ptr[++j], &roots->ptr[i]);
+	}
+
+	roots->size = j + 1;
+}
+
+static int shallow_path(git_buf *out, git_repository *repo)
+{
+	return git_buf_joinpath(out, repo->commondir, GIT_SHALLOW_FILE);
+}
+
+int git_shallow__read(git_array_oid_t *out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	const char *line, *eol;
+	size_t remaining, len;
+	git_oid *id;
+	int error;
+
+	git_array_clear(*out);
+
+	if ((error = shallow_path(&path, repo)) < 0)
+		return error;
+
+	if ((error = git_futils_readbuffer(&contents, path.ptr)) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	line = contents.ptr;
+	remaining = contents.size;
+
+	while (remaining) {
+		eol = memchr(line, '\n', remaining);
+		len = eol ? (size_t)(eol - line) : remaining;
+
+		if (len != GIT_OID_HEXSZ) {
+			git_error_set(GIT_ERROR_REPOSITORY, "invalid shallow file '%s'", path.ptr);
+			error = -1;
+			goto done;
+		}
+
+		id = git_array_alloc(*out);
+		GIT_ERROR_CHECK_ALLOC(id);
+
+		if ((error = git_oid_fromstrn(id, line, GIT_OID_HEXSZ)) < 0)
+			goto done;
+
+		len += eol ? 1 : 0;
+		line += len;
+		remaining -= len;
+	}
+
+	git_shallow__sort(out);
+
+done:
+	if (error < 0)
+		git_array_clear(*out);
+
+	git_buf_dispose(&contents);
+	git_buf_dispose(&path);
+	return error;
+}
+
+int git_shallow__write(git_repository *repo, git_array_oid_t *roots)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	char hex[GIT_OID_HEXSZ + 1];
+	git_oid *id;
+	size_t i;
+	int error;
+
+	if ((error = shallow_path(&path, repo)) < 0)
+		return error;
+
+	if (!git_array_size(*roots)) {
+		if ((error = p_unlink(path.ptr)) < 0 && errno == ENOENT)
+			error = 0;
+		else if (error < 0)
+			git_error_set(GIT_ERROR_OS, "failed to remove '%s'", path.ptr);
+
+		goto done;
+	}
+
+	git_shallow__sort(roots);
+
+	if ((error = git_filebuf_open(&file, path.ptr, 0, GIT_REFS_FILE_MODE)) < 0)
+		goto done;
+
+	git_array_foreach(*roots, i, id) {
+		git_oid_tostr(hex, sizeof(hex), id);
+		git_filebuf_printf(&file, "%s\n", hex);
+	}
+
+	error = git_filebuf_commit(&file);
+
+done:
+	git_filebuf_cleanup(&file);
+	git_buf_dispose(&path);
+	return error;
+}
+
+static int lookup_parsed(
+	git_commit_list_node **out,
+	git_revwalk *walk,
+	const git_oid *id)
+{
+	git_commit_list_node *node;
+
+	if ((node = git_revwalk__commit_lookup(walk, id)) == NULL)
+		return -1;
+
+	*out = node;
+	return git_commit_list_parse(walk, node);
+}
+
+/* Add the commits that the wants peel to, ignoring the other objects */
+static int push_wants(
+	shallow_node_array *out,
+	git_revwalk *walk,
+	const git_oid *wants,
+	size_t count)
+{
+	git_commit_list_node *node, **slot;
+	git_object *obj, *commit;
+	size_t i;
+	int error;
+
+	for (i = 0; i < count; i++) {
+		if ((error = git_object_lookup(&obj, walk->repo, &wants[i], GIT_OBJECT_ANY)) < 0)
+			return error;
+
+		error = git_object_peel(&commit, obj, GIT_OBJECT_COMMIT);
+		git_object_free(obj);
+
+		if (error == GIT_EPEEL || error == GIT_EINVALIDSPEC) {
+			git_error_clear();
+			continue;
+		} else if (error < 0) {
+			return error;
+		}
+
+		error = lookup_parsed(&node, walk, git_object_id(commit));
+		git_object_free(commit);
+
+		if (error < 0)
+			return error;
+
+		slot = git_array_alloc(*out);
+		GIT_ERROR_CHECK_ALLOC(slot);
+		*slot = node;
+	}
+
+	return 0;
+}
+
+/*
+ * Walk the history breadth first, so that every commit is reached at
+ * its lowest depth.  The commits at the given depth are the new roots;
+ * the ones above it have their parents sent and are marked `added`.
+ * The shallow roots of the repository itself stay roots.
+ */
+static int deepen_by_depth(
+	git_array_oid_t *shallow,
+	git_revwalk *walk,
+	shallow_node_array *level,
+	int depth)
+{
+	shallow_node_array next = GIT_ARRAY_INIT, tmp;
+	git_commit_list_node *node, **slot;
+	git_oid *id;
+	size_t i, j;
+	int current, error = 0;
+
+	for (current = 1; git_array_size(*level); current++) {
+		git_array_foreach(*level, i, slot) {
+			node = *slot;
+
+			if (current >= depth || git_revwalk__is_shallow(walk, &node->oid)) {
+				if (!node->out_degree && !git_revwalk__is_shallow(walk, &node->oid))
+					continue;
+
+				id = git_array_alloc(*shallow);
+				GIT_ERROR_CHECK_ALLOC(id);
+				git_oid_cpy(id, &node->oid);
+				continue;
+			}
+
+			node->added = 1;
+
+			for (j = 0; j < node->out_degree; j++) {
+				git_commit_list_node *parent = node->parents[j];
+
+				if (parent->seen)
+					continue;
+
+				if ((error = git_commit_list_parse(walk, parent)) < 0)
+					goto done;
+
+				parent->seen = 1;
+
+				slot = git_array_alloc(next);
+				GIT_ERROR_CHECK_ALLOC(slot);
+				*slot = parent;
+			}
+		}
+
+		tmp = *level;
+		*level = next;
+		next = tmp;
+		git_array_clear(next);
+	}
+
+done:
+	git_array_clear(next);
+	return error;
+}
+
+/*
+ * The commits made after the given time are sent; the ones among them
+ * with an older parent are the new roots.
+ */
+static int deepen_by_date(
+	git_array_oid_t *shallow,
+	git_revwalk *walk,
+	shallow_node_array *stack,
+	git_time_t since)
+{
+	shallow_node_array selected = GIT_ARRAY_INIT;
+	git_commit_list_node *node, *parent, **slot;
+	git_oid *id;
+	size_t i, j;
+	int error = 0;
+
+	while ((slot = git_array_pop(*stack)) != NULL) {
+		node = *slot;
+
+		if (node->time < since)
+			continue;
+
+		slot = git_array_alloc(selected);
+		GIT_ERROR_CHECK_ALLOC(slot);
+		*slot = node;
+		node->added = 1;
+
+		for (i = 0; i < node->out_degree; i++) {
+			parent = node->parents[i];
+
+			if (parent->seen)
+				continue;
+
+			if ((error = git_commit_list_parse(walk, parent)) < 0)
+				goto done;
+
+			parent->seen = 1;
+
+			slot = git_array_alloc(*stack);
+			GIT_ERROR_CHECK_ALLOC(slot);
+			*slot = parent;
+		}
+	}
+
+	if (!git_array_size(selected)) {
+		git_error_set(GIT_ERROR_INVALID, "no commits were made after the given date");
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	git_array_foreach(selected, i, slot) {
+		node = *slot;
+
+		for (j = 0; j < node->out_degree; j++) {
+			if (!node->parents[j]->added)
+				break;
+		}
+
+		if (j == node->out_degree && !git_revwalk__is_shallow(walk, &node->oid))
+			continue;
+
+		id = git_array_alloc(*shallow);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &node->oid);
+	}
+
+	/* The parents of the new roots are not sent */
+	git_array_foreach(*shallow, i, id)
+		git_revwalk__commit_lookup(walk, id)->added = 0;
+
+done:
+	git_array_clear(selected);
+	return error;
+}
+
+int git_shallow__deepen(
+	git_array_oid_t *shallow,
+	git_array_oid_t *unshallow,
+	git_repository *repo,
+	const git_oid *wants,
+	size_t count,
+	const git_array_oid_t *client_roots,
+	const git_shallow_deepen *deepen)
+{
+	shallow_node_array start = GIT_ARRAY_INIT;
+	git_commit_list_node *node, **slot;
+	git_revwalk *walk = NULL;
+	const git_oid *root;
+	git_oid *id;
+	size_t i;
+	int error;
+
+	assert(shallow && unshallow && repo && client_roots && deepen);
+
+	git_array_clear(*shallow);
+	git_array_clear(*unshallow);
+
+	if (!git_shallow_deepening(deepen))
+		return 0;
+
+	/* The whole history is sent: no roots are left */
+	if (deepen->depth == GIT_SHALLOW_DEPTH_INFINITE) {
+		git_array_foreach(*client_roots, i, root) {
+			id = git_array_alloc(*unshallow);
+			GIT_ERROR_CHECK_ALLOC(id);
+			git_oid_cpy(id, root);
+		}
+
+		return 0;
+	}
+
+	if ((error = git_revwalk_new(&walk, repo)) < 0)
+		return error;
+
+	if (deepen->relative) {
+		git_array_foreach(*client_roots, i, root) {
+			if ((error = lookup_parsed(&node, walk, root)) == GIT_ENOTFOUND) {
+				git_error_clear();
+				continue;
+			} else if (error < 0) {
+				goto done;
+			}
+
+			slot = git_array_alloc(start);
+			GIT_ERROR_CHECK_ALLOC(slot);
+			*slot = node;
+		}
+	} else if ((error = push_wants(&start, walk, wants, count)) < 0) {
+		goto done;
+	}
+
+	git_array_foreach(start, i, slot)
+		(*slot)->seen = 1;
+
+	if (deepen->since)
+		error = deepen_by_date(shallow, walk, &start, deepen->since);
+	else
+		error = deepen_by_depth(shallow, walk, &start,
+			deepen->relative ? deepen->depth + 1 : deepen->depth);
+
+	if (error < 0)
+		goto done;
+
+	/* The client's roots whose parents are sent */
+	git_array_foreach(*client_roots, i, root) {
+		node = git_oidmap_get(walk->commits, root);
+
+		if (!node || !node->added)
+			continue;
+
+		id = git_array_alloc(*unshallow);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, root);
+	}
+
+	git_shallow__sort(shallow);
+
+done:
+	git_array_clear(start);
+	git_revwalk_free(walk);
+
+	if (error < 0) {
+		git_array_clear(*shallow);
+		git_array_clear(*unshallow);
+	}
+
+	return error;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_shallow_h__
+#define INCLUDE_shallow_h__
+
+#include "common.h"
+
+#include "git2/types.h"
+#include "oidarray.h"
+
+#define GIT_SHALLOW_FILE "shallow"
+
+/* A depth that reaches the first commits of any history */
+#define GIT_SHALLOW_DEPTH_INFINITE 0x7fffffff
+
+/* How far a fetch deepens the history of the wanted commits */
+typedef struct {
+	int depth;        /* commits from the wants, or 0 for no limit */
+	int relative;     /* the depth counts from the current shallow roots */
+	git_time_t since; /* only the commits after this time, if not 0 */
+} git_shallow_deepen;
+
+GIT_INLINE(bool) git_shallow_deepening(const git_shallow_deepen *deepen)
+{
+	return deepen->depth > 0 || deepen->since != 0;
+}
+
+/*
+ * Read the shallow roots of the repository, the commits whose parents
+ * it does not have, in sorted order.
+ */
+int git_shallow__read(git_array_oid_t *out, git_repository *repo);
+
+/*
+ * Replace the shallow roots of the repository, making it complete if
+ * there are none left.
+ */
+int git_shallow__write(git_repository *repo, git_array_oid_t *roots);
+
+/* Sort shallow roots and drop the duplicates */
+void git_shallow__sort(git_array_oid_t *roots);
+
+/*
+ * Find how sending the commits of `wants` deepened as asked changes
+ * the shallow roots of a client which has the given ones: `shallow`
+ * gets the roots of the history that is sent and `unshallow` the
+ * client's roots whose parents are sent along.
+ */
+int git_shallow__deepen(
+	git_array_oid_t *shallow,
+	git_array_oid_t *unshallow,
+	git_repository *repo,
+	const git_oid *wants,
+	size_t count,
+	const git_array_oid_t *client_roots,
+	const git_shallow_deepen *deepen);
+
+#endif
@@ -273,6 +273,45 @@ int git_signature__parse(git_signature *sig, const char **buffer_out,
 	return 0;
 }
 
+/*
+ * Check a signature line the way `git_signature__parse` does, without
+ * allocating it, and move `buffer_out` past it.
+ */
+int git_signature__validate(const char **buffer_out,
+		const char *buffer_end, const char *header, char ender)
+{
+	const char *buffer = *buffer_out;
+	const char *email_start, *email_end, *time_end;
+	int64_t time;
+
+	if (ender &&
+		(buffer_end = memchr(buffer, ender, buffer_end - buffer)) == NULL)
+		return signature_error("no newline given");
+
+	if (header) {
+		const size_t header_len = strlen(header);
+
+		if (buffer + header_len >= buffer_end || memcmp(buffer, header, header_len) != 0)
+			return signature_error("expected prefix doesn't match actual");
+
+		buffer += header_len;
+	}
+
+	email_start = git__memrchr(buffer, '<', buffer_end - buffer);
+	email_end = git__memrchr(buffer, '>', buffer_end - buffer);
+
+	if (!email_start || !email_end || email_end <= email_start)
+		return signature_error("malformed e-mail");
+
+	if (email_end + 2 < buffer_end &&
+	    git__strntol64(&time, email_end + 2,
+			   buffer_end - email_end - 2, &time_end, 10) < 0)
+		return signature_error("invalid Unix timestamp");
+
+	*buffer_out = buffer_end + 1;
+	return 0;
+}
+
 int git_signature_from_buffer(git_signature **out, const char *buf)
 {
 	git_signature *sig;
@@ -28,6 +28,16 @@
 #	endif
 #endif
 
+/*
+ * Writing to a connection the server closed must fail rather than
+ * raise SIGPIPE; kept-alive connections can be closed at any time.
+ */
+#ifdef MSG_NOSIGNAL
+# define GIT_SOCKET_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define GIT_SOCKET_SEND_FLAGS 0
+#endif
+
 #ifdef GIT_WIN32
 static void net_set_error(const char *str)
 {
@@ -110,6 +120,13 @@ static int socket_connect(git_stream *stream)
 		if (s == INVALID_SOCKET)
 			continue;
 
+#ifdef SO_NOSIGPIPE
+		{
+			int nosigpipe = 1;
+			setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe));
+		}
+#endif
+
 		if (connect(s, p->ai_addr, (socklen_t)p->ai_addrlen) == 0)
 			break;
 
@@ -137,7 +154,7 @@ static ssize_t socket_write(git_stream *stream, const char *data, size_t len, in
 
 	errno = 0;
 
-	if ((written = p_send(st->s, data, len, flags)) < 0) {
+	if ((written = p_send(st->s, data, len, flags | GIT_SOCKET_SEND_FLAGS)) < 0) {
 		net_set_error("error sending data");
 		return -1;
 	}
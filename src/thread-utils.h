@@ -140,6 +140,7 @@ GIT_INLINE(int64_t) git_atomic64_add(git_atomic64 *a, int64_t addend)
 #define git_thread unsigned int
 #define git_thread_create(thread, start_routine, arg) 0
 #define git_thread_join(id, status) (void)0
+#define git_thread_currentid() ((size_t)(1))
 
 /* Pthreads Mutex */
 #define git_mutex unsigned int
@@ -49,8 +49,10 @@ struct git_transaction {
 	git_repository *repo;
 	git_refdb *db;
 	git_config *cfg;
+	unsigned int flags;
 
 	git_strmap *locks;
+	void *lock_payload; /* of the last lock, to join it */
 	git_pool pool;
 };
 
@@ -68,7 +70,17 @@ int git_transaction_config_new(git_transaction **out, git_config *cfg)
 	return 0;
 }
 
-int git_transaction_new(git_transaction **out, git_repository *repo)
+int git_transaction_options_init(git_transaction_options *opts, unsigned int version)
+{
+	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
+		opts, version, git_transaction_options, GIT_TRANSACTION_OPTIONS_INIT);
+	return 0;
+}
+
+int git_transaction_new_ext(
+	git_transaction **out,
+	git_repository *repo,
+	const git_transaction_options *opts)
 {
 	int error;
 	git_pool pool;
@@ -76,6 +88,8 @@ int git_transaction_new(git_transaction **out, git_repository *repo)
 
 	assert(out && repo);
 
+	GIT_ERROR_CHECK_VERSION(opts, GIT_TRANSACTION_OPTIONS_VERSION, "git_transaction_options");
+
 	git_pool_init(&pool, 1);
 
 	tx = git_pool_mallocz(&pool, sizeof(git_transaction));
@@ -93,6 +107,7 @@ int git_transaction_new(git_transaction **out, git_repository *repo)
 		goto on_error;
 
 	tx->type = TRANSACTION_REFS;
+	tx->flags = opts ? opts->flags : 0;
 	memcpy(&tx->pool, &pool, sizeof(git_pool));
 	tx->repo = repo;
 	*out = tx;
@@ -103,6 +118,11 @@ on_error:
 	return error;
 }
 
+int git_transaction_new(git_transaction **out, git_repository *repo)
+{
+	return git_transaction_new_ext(out, repo, NULL);
+}
+
 int git_transaction_lock_ref(git_transaction *tx, const char *refname)
 {
 	int error;
@@ -116,9 +136,13 @@ int git_transaction_lock_ref(git_transaction *tx, const char *refname)
 	node->name = git_pool_strdup(&tx->pool, refname);
 	GIT_ERROR_CHECK_ALLOC(node->name);
 
+	node->payload = tx->lock_payload;
+
 	if ((error = git_refdb_lock(&node->payload, tx->db, refname)) < 0)
 		return error;
 
+	tx->lock_payload = node->payload;
+
 	if ((error = git_strmap_set(tx->locks, node->name, node)) < 0)
 		goto cleanup;
 
@@ -317,7 +341,7 @@ static int update_target(git_refdb *db, transaction_node *node)
 int git_transaction_commit(git_transaction *tx)
 {
 	transaction_node *node;
-	int error = 0;
+	int error = 0, batched = 0;
 
 	assert(tx);
 
@@ -328,25 +352,41 @@ int git_transaction_commit(git_transaction *tx)
 		return error;
 	}
 
+	/*
+	 * In a batch, the backend only records the updates as the refs
+	 * are unlocked and writes all of them when the batch is ended.
+	 */
+	if ((tx->flags & GIT_TRANSACTION_PACKED) &&
+	    (error = git_refdb_begin_batch(&batched, tx->db)) < 0)
+		return error;
+
 	git_strmap_foreach_value(tx->locks, node, {
 		if (node->reflog) {
 			if ((error = tx->db->backend->reflog_write(tx->db->backend, node->reflog)) < 0)
-				return error;
+				goto done;
 		}
 
 		if (node->ref_type == GIT_REFERENCE_INVALID) {
 			/* ref was locked but not modified */
 			if ((error = git_refdb_unlock(tx->db, node->payload, false, false, NULL, NULL, NULL)) < 0) {
-				return error;
+				goto done;
 			}
 			node->committed = true;
 		} else {
 			if ((error = update_target(tx->db, node)) < 0)
-				return error;
+				goto done;
 		}
 	});
 
-	return 0;
+done:
+	if (batched) {
+		int end_error = git_refdb_end_batch(tx->db, !error);
+
+		if (!error)
+			error = end_error;
+	}
+
+	return error;
 }
 
 void git_transaction_free(git_transaction *tx)
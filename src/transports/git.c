@@ -13,6 +13,7 @@
 #include "git2/sys/transport.h"
 #include "stream.h"
 #include "streams/socket.h"
+#include "smart.h"
 
 #define OWNING_SUBTRANSPORT(s) ((git_subtransport *)(s)->parent.subtransport)
 
@@ -25,7 +26,8 @@ typedef struct {
 	git_stream *io;
 	const char *cmd;
 	char *url;
-	unsigned sent_command : 1;
+	unsigned sent_command : 1,
+		request_v2 : 1;
 } git_proto_stream;
 
 typedef struct {
@@ -35,14 +37,16 @@ typedef struct {
 } git_subtransport;
 
 /*
- * Create a git protocol request.
+ * Create a git protocol request, with the protocol version as an extra
+ * parameter if we ask for v2.
  *
  * For example: 0035git-upload-pack /libgit2/libgit2\0host=github.com\0
  */
-static int gen_proto(git_buf *request, const char *cmd, const char *url)
+static int gen_proto(git_buf *request, const char *cmd, const char *url, bool request_v2)
 {
 	char *delim, *repo;
 	char host[] = "host=";
+	char version[] = "version=2";
 	size_t len;
 
 	delim = strchr(url, '/');
@@ -61,12 +65,20 @@ static int gen_proto(git_buf *request, const char *cmd, const char *url)
 
 	len = 4 + strlen(cmd) + 1 + strlen(repo) + 1 + strlen(host) + (delim - url) + 1;
 
+	if (request_v2)
+		len += 1 + strlen(version) + 1;
+
 	git_buf_grow(request, len);
 	git_buf_printf(request, "%04x%s %s%c%s",
 		(unsigned int)(len & 0x0FFFF), cmd, repo, 0, host);
 	git_buf_put(request, url, delim - url);
 	git_buf_putc(request, '\0');
 
+	if (request_v2) {
+		git_buf_putc(request, '\0');
+		git_buf_put(request, version, strlen(version) + 1);
+	}
+
 	if (git_buf_oom(request))
 		return -1;
 
@@ -78,7 +90,7 @@ static int send_command(git_proto_stream *s)
 	git_buf request = GIT_BUF_INIT;
 	int error;
 
-	if ((error = gen_proto(&request, s->cmd, s->url)) < 0)
+	if ((error = gen_proto(&request, s->cmd, s->url, s->request_v2)) < 0)
 		goto cleanup;
 
 	if ((error = git_stream__write_full(s->io, request.ptr, request.size, 0)) < 0)
@@ -219,6 +231,8 @@ static int _git_uploadpack_ls(
 	}
 
 	s = (git_proto_stream *) *stream;
+	s->request_v2 = ((transport_smart *)t->owner)->request_v2;
+
 	if ((error = git_stream_connect(s->io)) < 0) {
 		git_proto_stream_free(*stream);
 		return error;
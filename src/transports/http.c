@@ -347,6 +347,9 @@ static int generate_request(
 	request->proxy = use_proxy ? &transport->proxy.url : NULL;
 	request->proxy_credentials = transport->proxy.cred;
 
+	if (transport->owner->request_v2)
+		request->git_protocol = "version=2";
+
 	if (stream->service->method == GIT_HTTP_METHOD_POST) {
 		request->chunked = stream->service->chunked;
 		request->content_length = stream->service->chunked ? 0 : len;
@@ -692,6 +695,9 @@ static int http_close(git_smart_subtransport *t)
 {
 	http_subtransport *transport = GIT_CONTAINER_OF(t, http_subtransport, parent);
 
+	if (transport->http_client)
+		git_http_client_release(transport->http_client);
+
 	free_cred(&transport->server.cred);
 	free_cred(&transport->proxy.cred);
 
@@ -708,9 +714,9 @@ static void http_free(git_smart_subtransport *t)
 {
 	http_subtransport *transport = GIT_CONTAINER_OF(t, http_subtransport, parent);
 
-	git_http_client_free(transport->http_client);
-
 	http_close(t);
+
+	git_http_client_free(transport->http_client);
 	git__free(transport);
 }
 
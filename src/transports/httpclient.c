@@ -31,14 +31,30 @@ static git_http_auth_scheme auth_schemes[] = {
 
 #define GIT_READ_BUFFER_SIZE 8192
 
+size_t git_http__pool_max_idle = GIT_HTTP_POOL_MAX_IDLE;
+int git_http__pool_idle_timeout = GIT_HTTP_POOL_IDLE_TIMEOUT;
+
 typedef struct {
 	git_net_url url;
 	git_stream *stream;
 
 	git_vector auth_challenges;
 	git_http_auth_context *auth_context;
+
+	unsigned cert_valid : 1;
 } git_http_server;
 
+/* An idle connection, kept open to be reused for the same server */
+typedef struct {
+	char *key;
+	git_stream *stream;
+	double idle_since;
+	unsigned cert_valid : 1;
+} http_pooled_connection;
+
+static git_mutex pool_lock;
+static git_vector pool = GIT_VECTOR_INIT; /* oldest first */
+
 typedef enum {
 	PROXY = 1,
 	SERVER
@@ -107,12 +123,17 @@ struct git_http_client {
 	unsigned connected : 1,
 	         proxy_connected : 1,
 	         keepalive : 1,
-	         request_chunked : 1;
+	         request_chunked : 1,
+	         reused : 1,       /* the connection served a request before */
+	         replayable : 1;   /* the request can be sent again */
 
 	/* Temporary buffers to avoid extra mallocs */
 	git_buf request_msg;
 	git_buf read_buf;
 
+	/* The body of a request sent on a reused connection */
+	git_buf replay_body;
+
 	/* A subset of information from the request */
 	size_t request_body_len,
 	       request_body_remain;
@@ -701,6 +722,9 @@ static int generate_request(
 	if (request->expect_continue)
 		git_buf_printf(buf, "Expect: 100-continue\r\n");
 
+	if (request->git_protocol)
+		git_buf_printf(buf, "Git-Protocol: %s\r\n", request->git_protocol);
+
 	if ((error = apply_server_credentials(buf, client, request)) < 0 ||
 	    (error = apply_proxy_credentials(buf, client, request)) < 0)
 		return error;
@@ -766,6 +790,8 @@ static int server_connect_stream(
 	if (error && error != GIT_ECERTIFICATE)
 		return error;
 
+	server->cert_valid = !error;
+
 	if (git_stream_is_encrypted(server->stream) && cert_cb != NULL)
 		error = check_certificate(server->stream, &server->url, !error,
 		                          cert_cb, cb_payload);
@@ -968,6 +994,195 @@ GIT_INLINE(void) close_stream(git_http_server *server)
 	}
 }
 
+static int pool_key(git_buf *out, git_net_url *url)
+{
+	git_buf_clear(out);
+	git_buf_printf(out, "%s://%s:%s", url->scheme, url->host, url->port);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static void pool_connection_free(http_pooled_connection *conn)
+{
+	git_stream_close(conn->stream);
+	git_stream_free(conn->stream);
+	git__free(conn->key);
+	git__free(conn);
+}
+
+/* Close the connections idle for too long; called with the lock held */
+static void pool_expire(double now)
+{
+	http_pooled_connection *conn;
+
+	while (pool.length) {
+		conn = git_vector_get(&pool, 0);
+
+		if (pool.length <= git_http__pool_max_idle &&
+		    now - conn->idle_since < git_http__pool_idle_timeout)
+			break;
+
+		git_vector_remove(&pool, 0);
+		pool_connection_free(conn);
+	}
+}
+
+/*
+ * Keep the connection of the server open for the next client of the
+ * same server, rather than closing it.  Returns true if it was kept.
+ */
+static bool pool_put(git_http_server *server)
+{
+	http_pooled_connection *conn = NULL;
+	git_buf key = GIT_BUF_INIT;
+	double now = git__timer();
+	bool kept = false;
+
+	if (!git_http__pool_max_idle || git_http__pool_idle_timeout <= 0 ||
+	    pool_key(&key, &server->url) < 0)
+		goto done;
+
+	if ((conn = git__calloc(1, sizeof(http_pooled_connection))) == NULL)
+		goto done;
+
+	conn->key = git_buf_detach(&key);
+	conn->stream = server->stream;
+	conn->cert_valid = server->cert_valid;
+	conn->idle_since = now;
+
+	if (git_mutex_lock(&pool_lock) < 0)
+		goto done;
+
+	if (git_vector_insert(&pool, conn) == 0) {
+		server->stream = NULL;
+		kept = true;
+	}
+
+	pool_expire(now);
+	git_mutex_unlock(&pool_lock);
+
+	if (kept)
+		git_trace(GIT_TRACE_DEBUG, "Keeping connection to %s:%s",
+		          server->url.host, server->url.port);
+
+done:
+	if (!kept && conn) {
+		git__free(conn->key);
+		git__free(conn);
+	}
+
+	git_buf_dispose(&key);
+	return kept;
+}
+
+/* Take the most recent idle connection to the server, if any */
+static bool pool_take(git_http_server *server)
+{
+	http_pooled_connection *conn = NULL;
+	git_buf key = GIT_BUF_INIT;
+	size_t i;
+
+	if (pool_key(&key, &server->url) < 0 || git_mutex_lock(&pool_lock) < 0) {
+		git_error_clear();
+		git_buf_dispose(&key);
+		return false;
+	}
+
+	pool_expire(git__timer());
+
+	for (i = pool.length; i > 0; i--) {
+		conn = git_vector_get(&pool, i - 1);
+
+		if (strcmp(conn->key, key.ptr) == 0) {
+			git_vector_remove(&pool, i - 1);
+			break;
+		}
+
+		conn = NULL;
+	}
+
+	git_mutex_unlock(&pool_lock);
+	git_buf_dispose(&key);
+
+	if (!conn)
+		return false;
+
+	server->stream = conn->stream;
+	server->cert_valid = conn->cert_valid;
+
+	git__free(conn->key);
+	git__free(conn);
+	return true;
+}
+
+static void pool_clear(void)
+{
+	http_pooled_connection *conn;
+	size_t i;
+
+	if (git_mutex_lock(&pool_lock) < 0)
+		return;
+
+	git_vector_foreach(&pool, i, conn)
+		pool_connection_free(conn);
+
+	git_vector_clear(&pool);
+	git_mutex_unlock(&pool_lock);
+}
+
+static void http_client_global_shutdown(void)
+{
+	pool_clear();
+	git_vector_free(&pool);
+	git_mutex_free(&pool_lock);
+}
+
+int git_http_client_global_init(void)
+{
+	if (git_mutex_init(&pool_lock) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to initialize http connection pool lock");
+		return -1;
+	}
+
+	git__on_shutdown(http_client_global_shutdown);
+	return 0;
+}
+
+void git_http_client_pool_trim(void)
+{
+	if (git_mutex_lock(&pool_lock) < 0)
+		return;
+
+	pool_expire(git__timer());
+	git_mutex_unlock(&pool_lock);
+}
+
+/* Check the certificate of a connection taken from the pool again */
+static int pooled_connect(git_http_client *client)
+{
+	git_http_server *server = &client->server;
+	git_transport_certificate_check_cb cert_cb;
+	int error = 0;
+
+	client->current_server = SERVER;
+	cert_cb = client->opts.server_certificate_check_cb;
+
+	if (git_stream_is_encrypted(server->stream) && cert_cb != NULL) {
+		if (!server->cert_valid)
+			git_error_set(GIT_ERROR_SSL, "the SSL certificate is invalid");
+
+		error = check_certificate(server->stream, &server->url,
+			server->cert_valid, cert_cb,
+			client->opts.server_certificate_check_payload);
+	}
+
+	if (error == 0)
+		git_trace(GIT_TRACE_DEBUG, "Reusing connection to %s:%s",
+		          server->url.host, server->url.port);
+
+	return error;
+}
+
 static int http_client_connect(
 	git_http_client *client,
 	git_http_request *request)
@@ -980,10 +1195,13 @@ static int http_client_connect(
 
 	/* We're connected to our destination server; no need to reconnect */
 	if (client->connected && client->keepalive &&
-	    (client->state == NONE || client->state == DONE))
+	    (client->state == NONE || client->state == DONE)) {
+		client->reused = 1;
 		return 0;
+	}
 
 	client->connected = 0;
+	client->reused = 0;
 	client->request_count = 0;
 
 	close_stream(&client->server);
@@ -995,6 +1213,20 @@ static int http_client_connect(
 	use_proxy = client->proxy.url.host &&
 	            !strcmp(client->server.url.scheme, "https");
 
+	/*
+	 * Reuse an idle connection of another client to this server,
+	 * unless the request could not be sent again if it was closed.
+	 */
+	if (!client->proxy.url.host && !request->chunked &&
+	    !request->expect_continue && pool_take(&client->server)) {
+		if ((error = pooled_connect(client)) < 0)
+			goto on_error;
+
+		client->connected = 1;
+		client->reused = 1;
+		return 0;
+	}
+
 	if (use_proxy) {
 		if (!client->proxy_connected || !client->keepalive ||
 		    (client->state != NONE && client->state != DONE)) {
@@ -1050,6 +1282,10 @@ GIT_INLINE(int) client_read(git_http_client *client)
 
 	read_len = git_stream_read(stream, buf, max_len);
 
+	/* Once the server answered, the request cannot be sent again */
+	if (read_len > 0)
+		client->replayable = 0;
+
 	if (read_len >= 0) {
 		client->read_buf.size += read_len;
 
@@ -1196,6 +1432,55 @@ static void complete_response_body(git_http_client *client)
 	}
 }
 
+/*
+ * A server may close a kept-alive connection at any time, so it may be
+ * gone when we reuse it.  If it did not answer, send the request again
+ * on a new connection.
+ */
+static int replay_request(git_http_client *client)
+{
+	int error;
+
+	git_trace(GIT_TRACE_DEBUG,
+	          "Connection to %s:%s was closed, sending the request again",
+	          client->server.url.host, client->server.url.port);
+
+	git_error_clear();
+
+	client->replayable = 0;
+	client->reused = 0;
+	client->connected = 0;
+
+	close_stream(&client->server);
+	git_buf_clear(&client->read_buf);
+	reset_parser(client);
+
+	if ((error = server_connect(client)) < 0)
+		return error;
+
+	client->connected = 1;
+
+	if ((error = client_write_request(client)) < 0)
+		return error;
+
+	if (client->replay_body.size)
+		error = stream_write(&client->server,
+			client->replay_body.ptr, client->replay_body.size);
+
+	return error;
+}
+
+GIT_INLINE(bool) can_replay(git_http_client *client, git_http_request *request)
+{
+	git_http_auth_context *auth = client->server.auth_context;
+
+	return client->reused &&
+	       !request->chunked &&
+	       !request->expect_continue &&
+	       !client->proxy.url.host &&
+	       !(auth && auth->connection_affinity);
+}
+
 int git_http_client_send_request(
 	git_http_client *client,
 	git_http_request *request)
@@ -1223,8 +1508,14 @@ int git_http_client_send_request(
 	}
 
 	if ((error = http_client_connect(client, request)) < 0 ||
-	    (error = generate_request(client, request)) < 0 ||
-	    (error = client_write_request(client)) < 0)
+	    (error = generate_request(client, request)) < 0)
+		goto done;
+
+	client->replayable = can_replay(client, request);
+	git_buf_clear(&client->replay_body);
+
+	if ((error = client_write_request(client)) < 0 &&
+	    (!client->replayable || (error = replay_request(client)) < 0))
 		goto done;
 
 	client->state = SENT_REQUEST;
@@ -1293,7 +1584,12 @@ int git_http_client_send_body(
 	if (client->request_body_len) {
 		assert(buffer_len <= client->request_body_remain);
 
-		if ((error = stream_write(server, buffer, buffer_len)) < 0)
+		if (client->replayable &&
+		    (error = git_buf_put(&client->replay_body, buffer, buffer_len)) < 0)
+			goto done;
+
+		if ((error = stream_write(server, buffer, buffer_len)) < 0 &&
+		    (!client->replayable || (error = replay_request(client)) < 0))
 			goto done;
 
 		client->request_body_remain -= buffer_len;
@@ -1367,10 +1663,14 @@ int git_http_client_read_response(
 	parser_context.response = response;
 
 	while (client->state == READING_RESPONSE) {
-		if ((error = client_read_and_parse(client)) < 0)
+		if ((error = client_read_and_parse(client)) < 0 &&
+		    (!client->replayable || (error = replay_request(client)) < 0))
 			goto done;
 	}
 
+	client->replayable = 0;
+	git_buf_dispose(&client->replay_body);
+
 	assert(client->state == READING_BODY || client->state == DONE);
 
 done:
@@ -1502,12 +1802,49 @@ GIT_INLINE(void) http_server_close(git_http_server *server)
 	free_auth_context(server);
 }
 
+void git_http_client_release(git_http_client *client)
+{
+	git_http_auth_context *auth;
+	git_error_state error_state;
+
+	assert(client);
+
+	/*
+	 * A failure to keep the connection is not reported; keep the
+	 * error of the caller, who may release the client because of it.
+	 */
+	git_error_state_capture(&error_state, -1);
+
+	/* Read the end of a body the caller did not need */
+	if (client->connected && client->state == READING_BODY)
+		complete_response_body(client);
+
+	auth = client->server.auth_context;
+
+	if (client->connected && client->keepalive &&
+	    (client->state == NONE || client->state == DONE) &&
+	    !client->proxy.url.host && !client->read_buf.size &&
+	    !(auth && auth->connection_affinity))
+		pool_put(&client->server);
+
+	client->connected = 0;
+	client->reused = 0;
+
+	close_stream(&client->server);
+	reset_auth_connection(&client->server);
+
+	git_error_state_restore(&error_state);
+}
+
 static void http_client_close(git_http_client *client)
 {
+	git_http_client_release(client);
+
 	http_server_close(&client->server);
 	http_server_close(&client->proxy);
 
 	git_buf_dispose(&client->request_msg);
+	git_buf_dispose(&client->replay_body);
 
 	client->state = 0;
 	client->request_count = 0;
@@ -21,6 +21,13 @@
 #define GIT_HTTP_STATUS_UNAUTHORIZED                  401
 #define GIT_HTTP_STATUS_PROXY_AUTHENTICATION_REQUIRED 407
 
+/* Defaults for the pool of idle connections shared by the clients */
+#define GIT_HTTP_POOL_MAX_IDLE     8
+#define GIT_HTTP_POOL_IDLE_TIMEOUT 15
+
+extern size_t git_http__pool_max_idle;
+extern int git_http__pool_idle_timeout;
+
 typedef struct git_http_client git_http_client;
 
 /** Method for the HTTP request */
@@ -42,6 +49,7 @@ typedef struct {
 	git_credential *credentials;       /**< Credentials to authenticate with */
 	git_credential *proxy_credentials; /**< Credentials for proxy */
 	git_strarray *custom_headers;      /**< Additional headers to deliver */
+	const char *git_protocol;          /**< Git-Protocol header */
 
 	/* To POST a payload, either set content_length OR set chunked. */
 	size_t content_length;             /**< Length of the POST body */
@@ -180,11 +188,31 @@ extern bool git_http_response_is_redirect(git_http_response *response);
 extern void git_http_response_dispose(git_http_response *response);
 
 /**
- * Frees any memory associated with the client.  If any sockets are open,
- * they will be closed.
+ * Gives up the connection of the client.  If it can be reused, it is
+ * kept open in a pool shared by all the clients of the process, and
+ * the next client to connect to the same server will use it; otherwise
+ * it is closed.  Connections through a proxy and connections that were
+ * authenticated with a connection-based mechanism (NTLM, Negotiate)
+ * are never shared.
+ *
+ * @param client the client whose connection to release
+ */
+extern void git_http_client_release(git_http_client *client);
+
+/**
+ * Frees any memory associated with the client.  Its connection is
+ * released like with git_http_client_release.
  *
  * @param client the client to free
  */
 extern void git_http_client_free(git_http_client *client);
 
+/*
+ * Closes the idle connections of the pool beyond the current limits,
+ * after they were lowered.
+ */
+extern void git_http_client_pool_trim(void);
+
+extern int git_http_client_global_init(void);
+
 #endif
@@ -29,6 +29,15 @@
 #include "push.h"
 #include "remote.h"
 #include "proxy.h"
+#include "array.h"
+#include "revwalk.h"
+#include "shallow.h"
+#include "pack.h"
+#include "mwindow.h"
+#include "futils.h"
+#include "filebuf.h"
+#include "oidmap.h"
+#include "pool.h"
 
 typedef struct {
 	git_transport parent;
@@ -42,6 +51,7 @@ typedef struct {
 	git_transport_message_cb error_cb;
 	void *message_cb_payload;
 	git_vector refs;
+	git_array_t(git_oid) wants; /* objects fetched by id */
 	unsigned connected : 1,
 		have_refs : 1;
 } transport_local;
@@ -273,10 +283,23 @@ static int local_negotiate_fetch(
 {
 	transport_local *t = (transport_local*)transport;
 	git_remote_head *rhead;
+	git_oid *id;
 	unsigned int i;
 
-	GIT_UNUSED(refs);
-	GIT_UNUSED(count);
+	git_array_clear(t->wants);
+
+	/*
+	 * Objects fetched by id are sent on their own, and shallow fetches
+	 * only send the history of what was asked for.
+	 */
+	for (i = 0; i < count; i++) {
+		id = git_array_alloc(t->wants);
+		GIT_ERROR_CHECK_ALLOC(id);
+		git_oid_cpy(id, &refs[i]->oid);
+	}
+
+	if (t->owner && t->owner->lazy_fetch)
+		return 0;
 
 	/* Fill in the loids */
 	git_vector_foreach(&t->refs, i, rhead) {
@@ -510,6 +533,7 @@ static int local_counting(int stage, unsigned int current, unsigned int total, v
 static int foreach_reference_cb(git_reference *reference, void *payload)
 {
 	git_revwalk *walk = (git_revwalk *)payload;
+	git_revwalk__push_options opts = GIT_REVWALK__PUSH_OPTIONS_INIT;
 	int error;
 
 	if (git_reference_type(reference) != GIT_REFERENCE_DIRECT) {
@@ -517,10 +541,13 @@ static int foreach_reference_cb(git_reference *reference, void *payload)
 		return 0;
 	}
 
-	error = git_revwalk_hide(walk, git_reference_target(reference));
 	/* The reference is in the local repository, so the target may not
 	 * exist on the remote.  It also may not be a commit. */
-	if (error == GIT_ENOTFOUND || error == GIT_ERROR_INVALID) {
+	opts.uninteresting = 1;
+	opts.from_glob = 1;
+
+	error = git_revwalk__push_commit(walk, git_reference_target(reference), &opts);
+	if (error == GIT_ENOTFOUND) {
 		git_error_clear();
 		error = 0;
 	}
@@ -530,6 +557,353 @@ static int foreach_reference_cb(git_reference *reference, void *payload)
 	return error;
 }
 
+/*
+ * Stop the walk at the shallow roots of the client and at the roots of
+ * the history deepened as it asked, which we report to it.  Like
+ * upload-pack, send the parents of the client's roots that are not
+ * roots anymore.
+ */
+static int local_shallow(transport_local *t, git_revwalk *walk)
+{
+	git_remote *remote = t->owner;
+	git_commit *commit;
+	git_oid *id;
+	size_t i, j;
+	int error;
+
+	if ((error = git_shallow__deepen(&remote->shallow_added,
+			&remote->shallow_removed, t->repo, t->wants.ptr,
+			git_array_size(t->wants), &remote->shallow_roots,
+			&remote->deepen)) < 0 ||
+	    (error = git_revwalk__add_shallow(walk, remote->shallow_roots.ptr,
+			git_array_size(remote->shallow_roots))) < 0 ||
+	    (error = git_revwalk__add_shallow(walk, remote->shallow_added.ptr,
+			git_array_size(remote->shallow_added))) < 0)
+		return error;
+
+	git_array_foreach(remote->shallow_removed, i, id) {
+		if ((error = git_commit_lookup(&commit, t->repo, id)) < 0)
+			return error;
+
+		for (j = 0; j < git_commit_parentcount(commit) && !error; j++)
+			error = git_revwalk_push(walk, git_commit_parent_id(commit, j));
+
+		git_commit_free(commit);
+
+		if (error < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+static int local_want(
+	git_packbuilder *pack,
+	git_revwalk *walk,
+	const git_oid *id,
+	const char *name)
+{
+	git_object *obj;
+	int error;
+
+	if ((error = git_object_lookup(&obj, walk->repo, id, GIT_OBJECT_ANY)) < 0)
+		return error;
+
+	if (git_object_type(obj) == GIT_OBJECT_COMMIT) {
+		/* Revwalker includes only wanted commits */
+		error = git_revwalk_push(walk, id);
+	} else {
+		/* Tag or some other wanted object. Add it on its own */
+		error = git_packbuilder_insert_recur(pack, id, name);
+	}
+
+	git_object_free(obj);
+	return error;
+}
+
+/*
+ * A pack of the remote which the client may get as it is, instead of
+ * the wanted objects it holds being packed again.
+ */
+typedef struct {
+	struct git_pack_file *pack;
+	size_t wanted;
+	unsigned copy : 1;
+} local_pack;
+
+typedef struct {
+	git_vector packs;
+	git_oidmap *skipped; /* wanted objects left out, to their pack */
+	git_pool ids;
+} local_packs;
+
+static void local_packs_free(local_packs *packs)
+{
+	local_pack *lp;
+	size_t i;
+
+	git_vector_foreach(&packs->packs, i, lp) {
+		git_mwindow_put_pack(lp->pack);
+		git__free(lp);
+	}
+
+	git_vector_free(&packs->packs);
+	git_oidmap_free(packs->skipped);
+	git_pool_clear(&packs->ids);
+}
+
+static int local_packs_dir(git_buf *out, git_repository *repo)
+{
+	if (git_repository_item_path(out, repo, GIT_REPOSITORY_ITEM_OBJECTS) < 0 ||
+	    git_buf_joinpath(out, out->ptr, "pack") < 0 ||
+	    git_path_to_dir(out) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* Open the packs of the remote, leaving out those the client has */
+static int local_packs_load(local_packs *packs, transport_local *t, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT, dest = GIT_BUF_INIT;
+	git_vector names = GIT_VECTOR_INIT;
+	local_pack *lp;
+	const char *name;
+	size_t i, path_len, dest_len;
+	int error;
+
+	git_pool_init(&packs->ids, sizeof(git_oid));
+
+	if ((error = git_oidmap_new(&packs->skipped)) < 0 ||
+	    (error = local_packs_dir(&path, t->repo)) < 0 ||
+	    (error = local_packs_dir(&dest, repo)) < 0)
+		goto done;
+
+	if (!git_path_isdir(path.ptr))
+		goto done;
+
+	path_len = git_buf_len(&path);
+	dest_len = git_buf_len(&dest);
+
+	if ((error = git_path_dirload(&names, path.ptr, path_len, 0)) < 0)
+		goto done;
+
+	git_vector_foreach(&names, i, name) {
+		if (git__suffixcmp(name, ".idx") != 0)
+			continue;
+
+		git_buf_truncate(&dest, dest_len);
+		if ((error = git_buf_puts(&dest, name)) < 0)
+			goto done;
+
+		if (git_path_exists(dest.ptr))
+			continue;
+
+		git_buf_truncate(&path, path_len);
+		if ((error = git_buf_puts(&path, name)) < 0)
+			goto done;
+
+		lp = git__calloc(1, sizeof(local_pack));
+		GIT_ERROR_CHECK_ALLOC(lp);
+
+		if ((error = git_mwindow_get_pack(&lp->pack, path.ptr)) < 0 ||
+		    (error = git_vector_insert(&packs->packs, lp)) < 0) {
+			if (lp->pack)
+				git_mwindow_put_pack(lp->pack);
+			git__free(lp);
+			goto done;
+		}
+	}
+
+done:
+	git_vector_free_deep(&names);
+	git_buf_dispose(&dest);
+	git_buf_dispose(&path);
+	return error;
+}
+
+/* Leave the objects found in one of the packs out of the new pack */
+static int local_packs_skip(const git_oid *id, void *payload)
+{
+	local_packs *packs = payload;
+	struct git_pack_entry e;
+	local_pack *lp;
+	git_oid *skipped;
+	size_t i;
+
+	/* The packbuilder asks again for the objects it has not taken */
+	if (git_oidmap_exists(packs->skipped, id))
+		return 1;
+
+	git_vector_foreach(&packs->packs, i, lp) {
+		if (git_pack_entry_find(&e, lp->pack, id, GIT_OID_HEXSZ) < 0) {
+			git_error_clear();
+			continue;
+		}
+
+		/* On allocation failure, just pack it */
+		if ((skipped = git_pool_malloc(&packs->ids, 1)) == NULL)
+			return 0;
+
+		git_oid_cpy(skipped, id);
+
+		if (git_oidmap_set(packs->skipped, skipped, lp) < 0)
+			return 0;
+
+		lp->wanted++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Link or copy a file into place.  When the git directory is to be kept
+ * durable, the file and the directory are flushed to disk before this
+ * returns, so that the pack is never made visible by its index first.
+ */
+static int local_copy_file(const char *from, const char *to)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	char buffer[FILEIO_BUFSIZE];
+	ssize_t len;
+	int fd, error;
+
+	if (p_link(from, to) == 0) {
+		if (!git_repository__fsync_gitdir)
+			return 0;
+
+		if ((fd = git_futils_open_ro(to)) < 0)
+			return fd;
+
+		if ((error = p_fsync(fd)) < 0)
+			git_error_set(GIT_ERROR_OS, "failed to fsync '%s'", to);
+
+		p_close(fd);
+
+		if (error < 0 || (error = git_futils_fsync_parent(to)) < 0)
+			p_unlink(to);
+
+		return error;
+	}
+
+	if ((fd = git_futils_open_ro(from)) < 0)
+		return fd;
+
+	if ((error = git_filebuf_open(&file, to,
+			git_repository__fsync_gitdir ? GIT_FILEBUF_FSYNC : 0,
+			GIT_PACK_FILE_MODE)) < 0)
+		goto done;
+
+	while ((len = p_read(fd, buffer, sizeof(buffer))) > 0) {
+		if ((error = git_filebuf_write(&file, buffer, len)) < 0)
+			goto done;
+	}
+
+	if (len < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to read '%s'", from);
+		error = -1;
+		goto done;
+	}
+
+	error = git_filebuf_commit(&file);
+
+done:
+	git_filebuf_cleanup(&file);
+	p_close(fd);
+	return error;
+}
+
+/* Link or copy the pack and then its index, so that it is only seen when complete */
+static int local_pack_copy(local_pack *lp, git_buf *dest, size_t dest_len)
+{
+	git_buf from = GIT_BUF_INIT;
+	const char *name;
+	size_t name_len;
+	int error;
+
+	name = strrchr(lp->pack->pack_name, '/');
+	name = name ? name + 1 : lp->pack->pack_name;
+	name_len = strlen(name) - strlen(".pack");
+
+	git_buf_truncate(dest, dest_len);
+	git_buf_puts(dest, name);
+
+	if ((error = git_buf_oom(dest) ? -1 : 0) < 0 ||
+	    (error = local_copy_file(lp->pack->pack_name, dest->ptr)) < 0)
+		goto done;
+
+	git_buf_truncate(dest, dest_len + name_len);
+	git_buf_puts(dest, ".idx");
+
+	git_buf_put(&from, lp->pack->pack_name, strlen(lp->pack->pack_name) - strlen(".pack"));
+	git_buf_puts(&from, ".idx");
+
+	if (git_buf_oom(dest) || git_buf_oom(&from)) {
+		error = -1;
+		goto done;
+	}
+
+	error = local_copy_file(from.ptr, dest->ptr);
+
+done:
+	git_buf_dispose(&from);
+	return error;
+}
+
+/*
+ * Give the client the packs which hold mostly objects it wants as
+ * they are.  The wanted objects of the other packs are packed again,
+ * with those which are loose.
+ */
+static int local_packs_copy(
+	size_t *copied,
+	local_packs *packs,
+	git_packbuilder *pack,
+	git_repository *repo)
+{
+	git_buf dest = GIT_BUF_INIT;
+	local_pack *lp;
+	const git_oid *id;
+	git_odb *odb;
+	size_t i, dest_len;
+	int error;
+
+	*copied = 0;
+	git_packbuilder__set_skip(pack, NULL, NULL);
+
+	if ((error = local_packs_dir(&dest, repo)) < 0)
+		goto done;
+
+	dest_len = git_buf_len(&dest);
+
+	git_vector_foreach(&packs->packs, i, lp) {
+		if (lp->wanted * 2 < lp->pack->num_objects)
+			continue;
+
+		if ((error = local_pack_copy(lp, &dest, dest_len)) < 0)
+			goto done;
+
+		lp->copy = 1;
+		*copied += lp->pack->num_objects;
+	}
+
+	i = 0;
+	while (git_oidmap_iterate((void **) &lp, packs->skipped, &i, &id) == 0) {
+		if (!lp->copy && (error = git_packbuilder_insert(pack, id, NULL)) < 0)
+			goto done;
+	}
+
+	if (*copied &&
+	    ((error = git_repository_odb__weakptr(&odb, repo)) < 0 ||
+	     (error = git_odb_refresh(odb)) < 0))
+		goto done;
+
+done:
+	git_buf_dispose(&dest);
+	return error;
+}
+
 static int local_download_pack(
 		git_transport *transport,
 		git_repository *repo,
@@ -540,8 +914,11 @@ static int local_download_pack(
 	transport_local *t = (transport_local*)transport;
 	git_revwalk *walk = NULL;
 	git_remote_head *rhead;
-	unsigned int i;
-	int error = -1;
+	git_packbuilder_filter filter;
+	local_packs packs = { GIT_VECTOR_INIT };
+	git_oid *id;
+	size_t i, copied = 0;
+	int shallow, error = -1;
 	git_packbuilder *pack = NULL;
 	git_odb_writepack *writepack = NULL;
 	git_odb *odb = NULL;
@@ -561,29 +938,62 @@ static int local_download_pack(
 	stats->received_objects = 0;
 	stats->received_bytes = 0;
 
-	git_vector_foreach(&t->refs, i, rhead) {
-		git_object *obj;
-		if ((error = git_object_lookup(&obj, t->repo, &rhead->oid, GIT_OBJECT_ANY)) < 0)
+	if (t->owner && t->owner->filter) {
+		if ((error = git_packbuilder__parse_filter(&filter, t->owner->filter)) < 0)
 			goto cleanup;
 
-		if (git_object_type(obj) == GIT_OBJECT_COMMIT) {
-			/* Revwalker includes only wanted commits */
-			error = git_revwalk_push(walk, &rhead->oid);
-		} else {
-			/* Tag or some other wanted object. Add it on its own */
-			error = git_packbuilder_insert_recur(pack, &rhead->oid, rhead->name);
+		git_packbuilder__set_filter(pack, &filter);
+	}
+
+	if (t->owner && t->owner->lazy_fetch) {
+		git_array_foreach(t->wants, i, id) {
+			if ((error = git_packbuilder_insert_recur(pack, id, NULL)) < 0)
+				goto cleanup;
 		}
-		git_object_free(obj);
-		if (error < 0)
+
+		goto counted;
+	}
+
+	shallow = t->owner && (git_shallow_deepening(&t->owner->deepen) ||
+	                       git_array_size(t->owner->shallow_roots));
+
+	/*
+	 * Whole packs may hold objects beyond the depth or the filter,
+	 * so only a full fetch can be given the packs of the remote.
+	 */
+	if (!shallow && !(t->owner && t->owner->filter)) {
+		if ((error = local_packs_load(&packs, t, repo)) < 0)
 			goto cleanup;
+
+		if (packs.packs.length)
+			git_packbuilder__set_skip(pack, local_packs_skip, &packs);
+	}
+
+	if (shallow) {
+		git_array_foreach(t->wants, i, id) {
+			if ((error = local_want(pack, walk, id, NULL)) < 0)
+				goto cleanup;
+		}
+	} else {
+		git_vector_foreach(&t->refs, i, rhead) {
+			if ((error = local_want(pack, walk, &rhead->oid, rhead->name)) < 0)
+				goto cleanup;
+		}
 	}
 
 	if ((error = git_reference_foreach(repo, foreach_reference_cb, walk)))
 		goto cleanup;
 
+	if (shallow && (error = local_shallow(t, walk)) < 0)
+		goto cleanup;
+
 	if ((error = git_packbuilder_insert_walk(pack, walk)))
 		goto cleanup;
 
+	if (packs.packs.length && (error = local_packs_copy(&copied, &packs, pack, repo)) < 0)
+		goto cleanup;
+
+counted:
 	if ((error = git_buf_printf(&progress_info, counting_objects_fmt, git_packbuilder_object_count(pack))) < 0)
 		goto cleanup;
 
@@ -605,6 +1015,12 @@ static int local_download_pack(
 	    (error = t->progress_cb(git_buf_cstr(&progress_info), (int)git_buf_len(&progress_info), t->message_cb_payload)) < 0)
 		goto cleanup;
 
+	/* Everything was in the packs */
+	if (copied && !git_packbuilder_object_count(pack)) {
+		error = 0;
+		goto copied;
+	}
+
 	if ((error = git_odb_write_pack(&writepack, odb, progress_cb, progress_payload)) != 0)
 		goto cleanup;
 
@@ -623,10 +1039,23 @@ static int local_download_pack(
 			goto cleanup;
 	}
 
-	error = writepack->commit(writepack, stats);
+	if ((error = writepack->commit(writepack, stats)) < 0)
+		goto cleanup;
+
+copied:
+	if (copied) {
+		stats->total_objects += (unsigned int)copied;
+		stats->received_objects += (unsigned int)copied;
+		stats->indexed_objects += (unsigned int)copied;
+
+		if (progress_cb)
+			error = git_error_set_after_callback_function(
+				progress_cb(stats, progress_payload), "indexer progress");
+	}
 
 cleanup:
 	if (writepack) writepack->free(writepack);
+	local_packs_free(&packs);
 	git_buf_dispose(&progress_info);
 	git_packbuilder_free(pack);
 	git_revwalk_free(walk);
@@ -698,6 +1127,7 @@ static void local_free(git_transport *transport)
 	transport_local *t = (transport_local *)transport;
 
 	free_heads(&t->refs);
+	git_array_clear(t->wants);
 
 	/* Close the transport, if it's still open. */
 	local_close(transport);
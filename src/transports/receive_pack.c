@@ -0,0 +1,981 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "server.h"
+
+#include "git2/config.h"
+#include "git2/graph.h"
+#include "git2/indexer.h"
+#include "git2/odb.h"
+#include "git2/refs.h"
+#include "git2/revwalk.h"
+#include "git2/transaction.h"
+#include "git2/sys/repository.h"
+
+#include "smart.h"
+#include "futils.h"
+#include "indexer.h"
+#include "odb.h"
+#include "pack-objects.h"
+#include "path.h"
+#include "refs.h"
+#include "repository.h"
+
+typedef struct {
+	char *name;
+	git_oid id;
+} receive_ref;
+
+typedef struct {
+	git_receive_pack_command cmd;
+
+	/* Why the update was declined, or NULL */
+	char *error;
+} receive_command;
+
+typedef struct {
+	git_repository *repo;
+	git_server server;
+	git_receive_pack_options opts;
+
+	/* Our references, which the client updates */
+	git_vector refs;
+
+	unsigned deny_deletes : 1,
+		deny_non_fast_forwards : 1,
+		deny_current_branch : 1,
+		fsck_objects : 1;
+
+	git_vector commands;
+
+	unsigned report_status : 1,
+		atomic : 1;
+
+	/* The directory of the objects that are not checked yet */
+	git_buf quarantine;
+
+	/* Why the pack could not be received, or NULL */
+	char *unpack_error;
+} receive_pack;
+
+static void free_ref(receive_ref *ref)
+{
+	if (!ref)
+		return;
+
+	git__free(ref->name);
+	git__free(ref);
+}
+
+static void free_command(receive_command *cmd)
+{
+	if (!cmd)
+		return;
+
+	git__free((char *)cmd->cmd.refname);
+	git__free(cmd->error);
+	git__free(cmd);
+}
+
+static int load_refs(receive_pack *rp)
+{
+	git_strarray names = {0};
+	receive_ref *ref = NULL;
+	size_t i;
+	int error;
+
+	if ((error = git_reference_list(&names, rp->repo)) < 0)
+		return error;
+
+	git__tsort((void **)names.strings, names.count, &git__strcmp_cb);
+
+	for (i = 0; i < names.count; i++) {
+		ref = git__calloc(1, sizeof(receive_ref));
+		GIT_ERROR_CHECK_ALLOC(ref);
+
+		if ((error = git_reference_name_to_id(&ref->id, rp->repo, names.strings[i])) < 0) {
+			/* A broken reference is not advertised */
+			if (error != GIT_ENOTFOUND)
+				goto done;
+
+			git_error_clear();
+			git__free(ref);
+			continue;
+		}
+
+		ref->name = git__strdup(names.strings[i]);
+		GIT_ERROR_CHECK_ALLOC(ref->name);
+
+		if ((error = git_vector_insert(&rp->refs, ref)) < 0)
+			goto done;
+	}
+
+	ref = NULL;
+
+done:
+	free_ref(ref);
+	git_strarray_free(&names);
+	return error;
+}
+
+static int config_bool(bool *out, git_config *config, const char *name, bool dflt)
+{
+	int value, error;
+
+	if ((error = git_config_get_bool(&value, config, name)) == GIT_ENOTFOUND) {
+		git_error_clear();
+		value = dflt;
+		error = 0;
+	}
+
+	*out = (value != 0);
+	return error;
+}
+
+/* Like git, the current branch of a repository with a worktree is refused unless told otherwise */
+static int config_deny_current_branch(bool *out, git_config *config)
+{
+	git_config_entry *entry;
+	int value, error;
+
+	*out = true;
+
+	if ((error = git_config_get_entry(&entry, config, "receive.denyCurrentBranch")) < 0) {
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		return error;
+	}
+
+	if (!strcasecmp(entry->value, "ignore") || !strcasecmp(entry->value, "warn") ||
+	    (git_config_parse_bool(&value, entry->value) == 0 && !value))
+		*out = false;
+
+	git_error_clear();
+	git_config_entry_free(entry);
+	return 0;
+}
+
+static int load_config(receive_pack *rp)
+{
+	git_config *config;
+	bool deletes, non_ff, current = false, fsck;
+	int error;
+
+	if ((error = git_repository_config_snapshot(&config, rp->repo)) < 0)
+		return error;
+
+	if ((error = config_bool(&deletes, config, "receive.denyDeletes", false)) < 0 ||
+	    (error = config_bool(&non_ff, config, "receive.denyNonFastForwards", false)) < 0 ||
+	    (error = config_bool(&fsck, config, "receive.fsckObjects", false)) < 0 ||
+	    (!git_repository_is_bare(rp->repo) &&
+	     (error = config_deny_current_branch(&current, config)) < 0))
+		goto done;
+
+	rp->deny_deletes = deletes;
+	rp->deny_non_fast_forwards = non_ff;
+	rp->deny_current_branch = current;
+	rp->fsck_objects = fsck;
+
+done:
+	git_config_free(config);
+	return error;
+}
+
+static int advertise(receive_pack *rp)
+{
+	const char *caps = GIT_CAP_REPORT_STATUS " " GIT_CAP_DELETE_REFS " "
+		GIT_CAP_SIDE_BAND_64K " quiet atomic " GIT_CAP_OFS_DELTA " " GIT_SERVER_AGENT;
+	git_buf line = GIT_BUF_INIT;
+	receive_ref *ref;
+	size_t i;
+	int error;
+
+	/* The capabilities follow the first reference, after a NUL */
+	ref = git_vector_get(&rp->refs, 0);
+
+	if (ref)
+		git_buf_printf(&line, "%s %s", git_oid_tostr_s(&ref->id), ref->name);
+	else
+		git_buf_printf(&line, "%040d capabilities^{}", 0);
+
+	git_buf_putc(&line, '\0');
+	git_buf_puts(&line, caps);
+
+	if (git_buf_oom(&line) ||
+	    (error = git_buf_printf(&rp->server.out, "%04x", (unsigned int)(line.size + 5))) < 0 ||
+	    (error = git_buf_put(&rp->server.out, line.ptr, line.size)) < 0 ||
+	    (error = git_buf_putc(&rp->server.out, '\n')) < 0) {
+		error = -1;
+		goto done;
+	}
+
+	git_vector_foreach(&rp->refs, i, ref) {
+		if (i > 0 && (error = git_server__line(&rp->server, "%s %s",
+				git_oid_tostr_s(&ref->id), ref->name)) < 0)
+			goto done;
+	}
+
+	error = git_server__flush(&rp->server);
+
+done:
+	git_buf_dispose(&line);
+	return error;
+}
+
+/* Whether a space-separated list of capabilities has the given one */
+static bool has_cap(const char *list, const char *cap)
+{
+	size_t len = strlen(cap);
+	const char *p;
+
+	for (p = list; (p = strstr(p, cap)) != NULL; p += len) {
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+static int parse_command(receive_pack *rp)
+{
+	const char *line = rp->server.line;
+	size_t len = strlen(line);
+	receive_command *cmd;
+
+	if (len < GIT_OID_HEXSZ * 2 + 3 ||
+	    line[GIT_OID_HEXSZ] != ' ' || line[GIT_OID_HEXSZ * 2 + 1] != ' ') {
+		git_error_set(GIT_ERROR_NET, "protocol error: expected a command, got '%s'", line);
+		return -1;
+	}
+
+	/* The capabilities follow the first command, after a NUL */
+	if (!rp->commands.length && len < rp->server.line_len) {
+		const char *caps = line + len + 1;
+
+		rp->report_status = has_cap(caps, GIT_CAP_REPORT_STATUS);
+		rp->atomic = has_cap(caps, "atomic");
+
+		if (has_cap(caps, GIT_CAP_SIDE_BAND_64K))
+			rp->server.side_band = GIT_SERVER_MAX_PKT;
+		else if (has_cap(caps, GIT_CAP_SIDE_BAND))
+			rp->server.side_band = GIT_SERVER_SIDE_BAND_MAX;
+	}
+
+	cmd = git__calloc(1, sizeof(receive_command));
+	GIT_ERROR_CHECK_ALLOC(cmd);
+
+	if (git_oid_fromstrn(&cmd->cmd.old_id, line, GIT_OID_HEXSZ) < 0 ||
+	    git_oid_fromstrn(&cmd->cmd.new_id, line + GIT_OID_HEXSZ + 1, GIT_OID_HEXSZ) < 0) {
+		git_error_set(GIT_ERROR_NET, "protocol error: invalid command '%s'", line);
+		git__free(cmd);
+		return -1;
+	}
+
+	cmd->cmd.refname = git__strdup(line + GIT_OID_HEXSZ * 2 + 2);
+
+	if (!cmd->cmd.refname || git_vector_insert(&rp->commands, cmd) < 0) {
+		free_command(cmd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Read the commands of the client, up to the flush */
+static int read_commands(receive_pack *rp)
+{
+	int error;
+
+	while ((error = git_server__read(&rp->server)) == 0) {
+		if (rp->server.type == GIT_SERVER_PKT_FLUSH ||
+		    (rp->server.type == GIT_SERVER_PKT_EOF && !rp->commands.length))
+			return 0;
+
+		if (rp->server.type != GIT_SERVER_PKT_LINE) {
+			git_error_set(GIT_ERROR_NET, "protocol error: expected a command");
+			return -1;
+		}
+
+		if (!git__prefixcmp(rp->server.line, "shallow ")) {
+			git_error_set(GIT_ERROR_NET, "pushing from a shallow repository is not supported");
+			return -1;
+		}
+
+		if ((error = parse_command(rp)) < 0)
+			return error;
+	}
+
+	return error;
+}
+
+static int decline(receive_command *cmd, const char *reason)
+{
+	if (cmd->error)
+		return 0;
+
+	cmd->error = git__strdup(reason);
+	GIT_ERROR_CHECK_ALLOC(cmd->error);
+
+	return 0;
+}
+
+static int decline_all(receive_pack *rp, const char *reason)
+{
+	receive_command *cmd;
+	size_t i;
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if (decline(cmd, reason) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Receive the pack into the quarantine directory, in the object
+ * directory so that its files can be renamed into it.
+ */
+static int create_quarantine(receive_pack *rp, git_buf *pack_dir)
+{
+	git_buf objects = GIT_BUF_INIT;
+	int fd, error;
+
+	if ((error = git_repository_item_path(&objects, rp->repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&objects, objects.ptr, "incoming")) < 0)
+		goto done;
+
+	/* Reserve a unique name */
+	if ((fd = git_futils_mktmp(&rp->quarantine, objects.ptr, 0666)) < 0) {
+		error = -1;
+		goto done;
+	}
+
+	p_close(fd);
+	p_unlink(rp->quarantine.ptr);
+
+	if ((error = git_buf_joinpath(pack_dir, rp->quarantine.ptr, "pack")) < 0)
+		goto done;
+
+	if (p_mkdir(rp->quarantine.ptr, GIT_OBJECT_DIR_MODE) < 0 ||
+	    p_mkdir(pack_dir->ptr, GIT_OBJECT_DIR_MODE) < 0) {
+		git_error_set(GIT_ERROR_OS, "failed to create quarantine directory '%s'", pack_dir->ptr);
+		error = -1;
+	}
+
+done:
+	git_buf_dispose(&objects);
+	return error;
+}
+
+/*
+ * Index the pack as we receive it.  The client sends nothing after
+ * the pack until it gets the report, so the pack ends the stream
+ * only when the client does not want one.
+ */
+static int receive_objects(receive_pack *rp)
+{
+	git_indexer_options opts = GIT_INDEXER_OPTIONS_INIT;
+	git_indexer_progress stats = {0};
+	git_indexer *indexer = NULL;
+	git_buf pack_dir = GIT_BUF_INIT;
+	git_odb *odb;
+	char *buffer = NULL;
+	size_t bytes_read;
+	int error;
+
+	opts.verify = rp->fsck_objects;
+
+	if ((error = create_quarantine(rp, &pack_dir)) < 0 ||
+	    (error = git_repository_odb__weakptr(&odb, rp->repo)) < 0 ||
+	    (error = git_indexer_new(&indexer, pack_dir.ptr, 0, odb, &opts)) < 0)
+		goto done;
+
+	buffer = git__malloc(GIT_SERVER_MAX_PKT);
+	GIT_ERROR_CHECK_ALLOC(buffer);
+
+	while (!git_indexer__complete(indexer, &stats)) {
+		if ((error = git_server__read_data(&rp->server, buffer, GIT_SERVER_MAX_PKT, &bytes_read)) < 0)
+			goto done;
+
+		if (!bytes_read) {
+			git_error_set(GIT_ERROR_NET, "early EOF");
+			error = GIT_EEOF;
+			goto done;
+		}
+
+		if ((error = git_indexer_append(indexer, buffer, bytes_read, &stats)) < 0)
+			goto done;
+	}
+
+	/* An empty pack has nothing to keep */
+	if (stats.total_objects)
+		error = git_indexer_commit(indexer, &stats);
+
+done:
+	git__free(buffer);
+	git_indexer_free(indexer);
+	git_buf_dispose(&pack_dir);
+	return error;
+}
+
+/* Open the repository again, with the objects in quarantine as an alternate */
+static int quarantine_open(git_repository **out, receive_pack *rp)
+{
+	git_repository *repo = NULL;
+	git_buf objects = GIT_BUF_INIT;
+	git_odb *odb = NULL;
+	int error;
+
+	if ((error = git_repository_item_path(&objects, rp->repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_odb_open(&odb, objects.ptr)) < 0 ||
+	    (rp->quarantine.size &&
+	     (error = git_odb_add_disk_alternate(odb, rp->quarantine.ptr)) < 0) ||
+	    (error = git_repository_open_ext(&repo, git_repository_path(rp->repo),
+			GIT_REPOSITORY_OPEN_NO_SEARCH, NULL)) < 0 ||
+	    (error = git_repository_set_odb(repo, odb)) < 0)
+		goto done;
+
+	*out = repo;
+	repo = NULL;
+
+done:
+	git_repository_free(repo);
+	git_odb_free(odb);
+	git_buf_dispose(&objects);
+	return error;
+}
+
+static bool is_ref(receive_pack *rp, const git_oid *id)
+{
+	receive_ref *ref;
+	size_t i;
+
+	git_vector_foreach(&rp->refs, i, ref) {
+		if (git_oid_equal(&ref->id, id))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Make sure that we have the objects of the new values of the
+ * references, walking them down to what our references have.
+ */
+static int check_connected(git_repository *quarantine, receive_pack *rp, receive_command *only)
+{
+	git_packbuilder *pb = NULL;
+	git_revwalk *walk = NULL;
+	receive_command *cmd;
+	receive_ref *ref;
+	git_object_t type;
+	git_odb *odb;
+	size_t i, len;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, quarantine)) < 0 ||
+	    (error = git_packbuilder_new(&pb, quarantine)) < 0 ||
+	    (error = git_revwalk_new(&walk, quarantine)) < 0)
+		goto done;
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if ((only && cmd != only) || cmd->error ||
+		    git_oid_is_zero(&cmd->cmd.new_id) || is_ref(rp, &cmd->cmd.new_id))
+			continue;
+
+		if ((error = git_odb_read_header(&len, &type, odb, &cmd->cmd.new_id)) < 0)
+			goto done;
+
+		if (type == GIT_OBJECT_COMMIT)
+			error = git_revwalk_push(walk, &cmd->cmd.new_id);
+		else
+			error = git_packbuilder_insert_recur(pb, &cmd->cmd.new_id, NULL);
+
+		if (error < 0)
+			goto done;
+	}
+
+	git_vector_foreach(&rp->refs, i, ref) {
+		if ((error = git_odb_read_header(&len, &type, odb, &ref->id)) < 0)
+			goto done;
+
+		if (type == GIT_OBJECT_COMMIT && (error = git_revwalk_hide(walk, &ref->id)) < 0)
+			goto done;
+	}
+
+	error = git_packbuilder_insert_walk(pb, walk);
+
+done:
+	git_revwalk_free(walk);
+	git_packbuilder_free(pb);
+	return error;
+}
+
+static int check_connectivity(git_repository *quarantine, receive_pack *rp)
+{
+	receive_command *cmd;
+	size_t i;
+	int error;
+
+	if (check_connected(quarantine, rp, NULL) == 0)
+		return 0;
+
+	/* Find the updates that miss objects */
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if (cmd->error || git_oid_is_zero(&cmd->cmd.new_id) ||
+		    check_connected(quarantine, rp, cmd) == 0)
+			continue;
+
+		if ((error = decline(cmd, "missing necessary objects")) < 0)
+			return error;
+	}
+
+	git_error_clear();
+	return 0;
+}
+
+/* The branch that the worktree has checked out, if we refuse to update it */
+static int current_branch(git_buf *out, receive_pack *rp)
+{
+	git_reference *head;
+	int error;
+
+	if (!rp->deny_current_branch)
+		return 0;
+
+	if ((error = git_reference_lookup(&head, rp->repo, GIT_HEAD_FILE)) < 0)
+		return error == GIT_ENOTFOUND ? 0 : error;
+
+	if (git_reference_type(head) == GIT_REFERENCE_SYMBOLIC)
+		error = git_buf_sets(out, git_reference_symbolic_target(head));
+
+	git_reference_free(head);
+	return error;
+}
+
+/* Decline the updates that the configuration does not allow */
+static int check_config(git_repository *quarantine, receive_pack *rp)
+{
+	git_buf head = GIT_BUF_INIT;
+	receive_command *cmd;
+	size_t i;
+	int error;
+
+	if ((error = current_branch(&head, rp)) < 0)
+		return error;
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		const char *refname = cmd->cmd.refname;
+		bool deleting = git_oid_is_zero(&cmd->cmd.new_id);
+
+		if (git__prefixcmp(refname, GIT_REFS_DIR) || !git_reference_is_valid_name(refname))
+			error = decline(cmd, "funny refname");
+		else if (head.size && !strcmp(refname, head.ptr))
+			error = decline(cmd, deleting ?
+				"deletion of the current branch prohibited" :
+				"branch is currently checked out");
+		else if (deleting && rp->deny_deletes)
+			error = decline(cmd, "deletion prohibited");
+		else if (!deleting && rp->deny_non_fast_forwards && !git_oid_is_zero(&cmd->cmd.old_id)) {
+			int ff = git_graph_descendant_of(quarantine, &cmd->cmd.new_id, &cmd->cmd.old_id);
+
+			git_error_clear();
+
+			if (ff != 1)
+				error = decline(cmd, "non-fast-forward");
+		}
+
+		if (error < 0)
+			break;
+	}
+
+	git_buf_dispose(&head);
+	return error;
+}
+
+static int check_policy(git_repository *quarantine, receive_pack *rp)
+{
+	receive_command *cmd;
+	const git_error *e;
+	size_t i;
+	int error;
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if (cmd->error)
+			continue;
+
+		git_error_clear();
+
+		if ((error = rp->opts.update_cb(quarantine, &cmd->cmd, rp->opts.payload)) == 0)
+			continue;
+
+		e = git_error_last();
+
+		if (error > 0) {
+			if ((error = decline(cmd, e ? e->message : "hook declined")) < 0)
+				return error;
+
+			continue;
+		}
+
+		if (decline_all(rp, e ? e->message : "hook declined") < 0)
+			return -1;
+
+		return git_error_set_after_callback(error);
+	}
+
+	return 0;
+}
+
+/* Check the updates with the objects in quarantine */
+static int check_commands(receive_pack *rp)
+{
+	git_repository *quarantine;
+	receive_command *cmd;
+	bool declined = false;
+	size_t i;
+	int error;
+
+	if ((error = quarantine_open(&quarantine, rp)) < 0)
+		return error;
+
+	if ((error = check_config(quarantine, rp)) < 0 ||
+	    (error = check_connectivity(quarantine, rp)) < 0 ||
+	    (rp->opts.update_cb && (error = check_policy(quarantine, rp)) < 0))
+		goto done;
+
+	git_vector_foreach(&rp->commands, i, cmd)
+		declined |= (cmd->error != NULL);
+
+	if (rp->atomic && declined)
+		error = decline_all(rp, "atomic push failure");
+
+done:
+	git_repository_free(quarantine);
+	return error;
+}
+
+static int move_pack_file(const git_buf *path, const char *ext, const char *pack_dir)
+{
+	git_buf dest = GIT_BUF_INIT;
+	int error;
+
+	if (git__suffixcmp(path->ptr, ext))
+		return 0;
+
+	if ((error = git_buf_joinpath(&dest, pack_dir,
+			path->ptr + git_path_basename_offset((git_buf *)path))) < 0)
+		return error;
+
+	if ((error = p_rename(path->ptr, dest.ptr)) < 0)
+		git_error_set(GIT_ERROR_OS, "failed to move '%s' to '%s'", path->ptr, dest.ptr);
+
+	git_buf_dispose(&dest);
+	return error;
+}
+
+static int move_pack(void *payload, git_buf *path)
+{
+	return move_pack_file(path, ".pack", payload);
+}
+
+static int move_index(void *payload, git_buf *path)
+{
+	return move_pack_file(path, ".idx", payload);
+}
+
+/*
+ * Move the packs out of quarantine by renaming them, their indexes
+ * last so that we never see a pack that is not all there.
+ */
+static int migrate(receive_pack *rp)
+{
+	git_buf from = GIT_BUF_INIT, to = GIT_BUF_INIT;
+	git_odb *odb;
+	int error;
+
+	if ((error = git_repository_item_path(&to, rp->repo, GIT_REPOSITORY_ITEM_OBJECTS)) < 0 ||
+	    (error = git_buf_joinpath(&to, to.ptr, "pack")) < 0 ||
+	    (error = git_buf_joinpath(&from, rp->quarantine.ptr, "pack")) < 0 ||
+	    (error = git_futils_mkdir(to.ptr, GIT_OBJECT_DIR_MODE, GIT_MKDIR_PATH)) < 0 ||
+	    (error = git_path_direach(&from, 0, move_pack, to.ptr)) < 0 ||
+	    (error = git_path_direach(&from, 0, move_index, to.ptr)) < 0 ||
+	    (error = git_repository_odb__weakptr(&odb, rp->repo)) < 0)
+		goto done;
+
+	error = git_odb_refresh(odb);
+
+done:
+	git_buf_dispose(&from);
+	git_buf_dispose(&to);
+	return error;
+}
+
+/* Lock the reference and make sure that it is where the client saw it */
+static int prepare_update(git_transaction *tx, receive_pack *rp, receive_command *cmd)
+{
+	git_oid current;
+	int error;
+
+	if ((error = git_transaction_lock_ref(tx, cmd->cmd.refname)) < 0)
+		return error;
+
+	if ((error = git_reference_name_to_id(&current, rp->repo, cmd->cmd.refname)) == GIT_ENOTFOUND) {
+		memset(&current, 0, sizeof(current));
+		error = 0;
+	}
+
+	if (error < 0)
+		return error;
+
+	if (!git_oid_equal(&current, &cmd->cmd.old_id)) {
+		git_error_set(GIT_ERROR_REFERENCE, "cannot lock ref '%s': is at %s but expected %s",
+			cmd->cmd.refname, git_oid_tostr_s(&current), git_oid_tostr_s(&cmd->cmd.old_id));
+		return GIT_EMODIFIED;
+	}
+
+	if (git_oid_is_zero(&cmd->cmd.new_id))
+		return git_transaction_remove(tx, cmd->cmd.refname);
+
+	return git_transaction_set_target(tx, cmd->cmd.refname, &cmd->cmd.new_id, NULL, "push");
+}
+
+/*
+ * Update the references, each in its own transaction or all of them
+ * in one for an atomic push.
+ */
+static int update_refs(receive_pack *rp)
+{
+	git_transaction_options opts = GIT_TRANSACTION_OPTIONS_INIT;
+	git_transaction *tx = NULL;
+	receive_command *cmd;
+	size_t i;
+	int error = 0;
+
+	if (rp->atomic) {
+		/* Then all of them are declined */
+		git_vector_foreach(&rp->commands, i, cmd) {
+			if (cmd->error)
+				return 0;
+		}
+
+		opts.flags = GIT_TRANSACTION_PACKED;
+
+		if ((error = git_transaction_new_ext(&tx, rp->repo, &opts)) < 0)
+			return error;
+
+		git_vector_foreach(&rp->commands, i, cmd) {
+			if ((error = prepare_update(tx, rp, cmd)) < 0)
+				break;
+		}
+
+		if (error < 0 || (error = git_transaction_commit(tx)) < 0)
+			error = decline_all(rp, "atomic transaction failed");
+
+		git_transaction_free(tx);
+		return error;
+	}
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if (cmd->error)
+			continue;
+
+		if ((error = git_transaction_new(&tx, rp->repo)) < 0)
+			return error;
+
+		if ((error = prepare_update(tx, rp, cmd)) < 0 ||
+		    (error = git_transaction_commit(tx)) < 0)
+			error = decline(cmd, "failed to update ref");
+
+		git_transaction_free(tx);
+
+		if (error < 0)
+			return error;
+	}
+
+	git_error_clear();
+	return 0;
+}
+
+/*
+ * Tell the client how the unpacking and each update went, on the
+ * side-band if it asked for one.
+ */
+static int report(receive_pack *rp)
+{
+	git_buf status = GIT_BUF_INIT;
+	receive_command *cmd;
+	size_t i;
+	int error;
+
+	if (!rp->report_status)
+		return 0;
+
+	if ((error = git_server__line(&rp->server, "unpack %s",
+			rp->unpack_error ? rp->unpack_error : "ok")) < 0)
+		goto done;
+
+	git_vector_foreach(&rp->commands, i, cmd) {
+		if (cmd->error)
+			error = git_server__line(&rp->server, "ng %s %s", cmd->cmd.refname, cmd->error);
+		else
+			error = git_server__line(&rp->server, "ok %s", cmd->cmd.refname);
+
+		if (error < 0)
+			goto done;
+	}
+
+	if ((error = git_server__flush(&rp->server)) < 0)
+		goto done;
+
+	if (rp->server.side_band) {
+		git_buf_swap(&status, &rp->server.out);
+
+		if ((error = git_server__send_band(&rp->server, 1, status.ptr, status.size)) < 0 ||
+		    (error = git_server__flush(&rp->server)) < 0)
+			goto done;
+	}
+
+	error = git_server__send(&rp->server);
+
+done:
+	git_buf_dispose(&status);
+	return error;
+}
+
+/* Receive the objects and update the references, or tell why not */
+static int receive(receive_pack *rp)
+{
+	receive_command *cmd;
+	bool need_pack = false, accepted = false;
+	size_t i;
+	int error;
+
+	git_vector_foreach(&rp->commands, i, cmd)
+		need_pack |= !git_oid_is_zero(&cmd->cmd.new_id);
+
+	if (need_pack && (error = receive_objects(rp)) < 0) {
+		const git_error *e = git_error_last();
+
+		rp->unpack_error = git__strdup(e ? e->message : "unknown error");
+		GIT_ERROR_CHECK_ALLOC(rp->unpack_error);
+
+		/* The client waits for the report unless it hung up */
+		if (error != GIT_EEOF && decline_all(rp, "unpacker error") == 0)
+			report(rp);
+
+		return error;
+	}
+
+	if ((error = check_commands(rp)) < 0) {
+		report(rp);
+		return error;
+	}
+
+	/* The objects of declined updates stay in quarantine */
+	git_vector_foreach(&rp->commands, i, cmd)
+		accepted |= (cmd->error == NULL);
+
+	if (need_pack && accepted && (error = migrate(rp)) < 0) {
+		git_vector_foreach(&rp->commands, i, cmd)
+			decline(cmd, "failed to move the objects out of quarantine");
+
+		report(rp);
+		return error;
+	}
+
+	if ((error = update_refs(rp)) < 0)
+		return error;
+
+	return report(rp);
+}
+
+int git_receive_pack_options_init(git_receive_pack_options *opts, unsigned int version)
+{
+	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
+		opts, version, git_receive_pack_options, GIT_RECEIVE_PACK_OPTIONS_INIT);
+	return 0;
+}
+
+int git_receive_pack(
+	git_repository *repo,
+	git_server_stream *stream,
+	const git_receive_pack_options *opts)
+{
+	receive_pack *rp;
+	receive_command *cmd;
+	receive_ref *ref;
+	size_t i;
+	int error;
+
+	assert(repo && stream);
+
+	GIT_ERROR_CHECK_VERSION(opts, GIT_RECEIVE_PACK_OPTIONS_VERSION, "git_receive_pack_options");
+
+	if (!git_repository_path(repo)) {
+		git_error_set(GIT_ERROR_INVALID, "cannot receive a push into a repository that is not on disk");
+		return -1;
+	}
+
+	rp = git__calloc(1, sizeof(receive_pack));
+	GIT_ERROR_CHECK_ALLOC(rp);
+
+	rp->repo = repo;
+
+	if (opts)
+		memcpy(&rp->opts, opts, sizeof(rp->opts));
+	else
+		git_receive_pack_options_init(&rp->opts, GIT_RECEIVE_PACK_OPTIONS_VERSION);
+
+	git_server__init(&rp->server, stream);
+
+	if ((error = load_config(rp)) < 0 ||
+	    (error = load_refs(rp)) < 0)
+		goto on_error;
+
+	if (!rp->opts.stateless_rpc || rp->opts.advertise_refs) {
+		if ((error = advertise(rp)) < 0 ||
+		    (error = git_server__send(&rp->server)) < 0)
+			goto on_error;
+	}
+
+	if (rp->opts.advertise_refs)
+		goto done;
+
+	if ((error = read_commands(rp)) < 0)
+		goto on_error;
+
+	if (rp->commands.length)
+		error = receive(rp);
+
+	goto done;
+
+on_error:
+	git_server__send_error(&rp->server, false);
+
+done:
+	if (rp->quarantine.size)
+		git_futils_rmdir_r(rp->quarantine.ptr, NULL, GIT_RMDIR_REMOVE_FILES);
+
+	git_vector_foreach(&rp->refs, i, ref)
+		free_ref(ref);
+
+	git_vector_foreach(&rp->commands, i, cmd)
+		free_command(cmd);
+
+	git_vector_free(&rp->refs);
+	git_vector_free(&rp->commands);
+	git_buf_dispose(&rp->quarantine);
+	git__free(rp->unpack_error);
+	git_server__dispose(&rp->server);
+	git__free(rp);
+	return error;
+}
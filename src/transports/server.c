@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "server.h"
+
+#include "smart.h"
+
+#define PKT_LEN_SIZE 4
+
+/* Send our responses in chunks of about this size */
+#define SEND_THRESHOLD (64 * 1024)
+
+void git_server__init(git_server *server, git_server_stream *stream)
+{
+	memset(server, 0, sizeof(*server));
+	server->stream = stream;
+	git_buf_init(&server->out, 0);
+}
+
+void git_server__dispose(git_server *server)
+{
+	git_buf_dispose(&server->out);
+}
+
+/* Make sure that the first `len` bytes of the buffer are read */
+static int fill(git_server *server, size_t len, bool *eof)
+{
+	size_t bytes_read;
+	int error;
+
+	*eof = false;
+
+	if (server->offset + len > sizeof(server->data)) {
+		memmove(server->data, server->data + server->offset, server->len - server->offset);
+		server->len -= server->offset;
+		server->offset = 0;
+	}
+
+	while (server->len - server->offset < len) {
+		if ((error = server->stream->read(server->stream,
+				server->data + server->len,
+				sizeof(server->data) - server->len,
+				&bytes_read)) < 0)
+			return error;
+
+		if (bytes_read == 0) {
+			*eof = true;
+			return 0;
+		}
+
+		server->len += bytes_read;
+	}
+
+	return 0;
+}
+
+static int parse_len(size_t *out, const char *line)
+{
+	int32_t len;
+
+	if (git__strntol32(&len, line, PKT_LEN_SIZE, NULL, 16) < 0 || len < 0) {
+		git_error_set(GIT_ERROR_NET, "invalid pkt-line length");
+		return -1;
+	}
+
+	*out = (size_t)len;
+	return 0;
+}
+
+int git_server__read(git_server *server)
+{
+	const char *line;
+	size_t len;
+	bool eof;
+	int error;
+
+	if ((error = fill(server, PKT_LEN_SIZE, &eof)) < 0)
+		return error;
+
+	if (eof && server->len == server->offset) {
+		server->type = GIT_SERVER_PKT_EOF;
+		return 0;
+	} else if (eof) {
+		goto early_eof;
+	}
+
+	line = server->data + server->offset;
+
+	if ((error = parse_len(&len, line)) < 0)
+		return error;
+
+	if (len <= GIT_SERVER_PKT_RESPONSE_END - GIT_SERVER_PKT_FLUSH) {
+		server->type = GIT_SERVER_PKT_FLUSH + (git_server_pkt_t)len;
+		server->offset += PKT_LEN_SIZE;
+		server->line_len = 0;
+		server->line[0] = '\0';
+		return 0;
+	}
+
+	if (len < PKT_LEN_SIZE || len > GIT_SERVER_MAX_PKT) {
+		git_error_set(GIT_ERROR_NET, "invalid pkt-line length %" PRIuZ, len);
+		return -1;
+	}
+
+	if ((error = fill(server, len, &eof)) < 0)
+		return error;
+
+	if (eof)
+		goto early_eof;
+
+	server->type = GIT_SERVER_PKT_LINE;
+	server->line_len = len - PKT_LEN_SIZE;
+	memcpy(server->line, server->data + server->offset + PKT_LEN_SIZE, server->line_len);
+	server->offset += len;
+
+	if (server->line_len && server->line[server->line_len - 1] == '\n')
+		server->line_len--;
+
+	server->line[server->line_len] = '\0';
+	return 0;
+
+early_eof:
+	git_error_set(GIT_ERROR_NET, "early EOF");
+	return GIT_EEOF;
+}
+
+int git_server__read_data(git_server *server, char *buffer, size_t len, size_t *bytes_read)
+{
+	/* What we read ahead of the last line comes first */
+	if (server->offset < server->len) {
+		*bytes_read = min(len, server->len - server->offset);
+		memcpy(buffer, server->data + server->offset, *bytes_read);
+		server->offset += *bytes_read;
+		return 0;
+	}
+
+	return server->stream->read(server->stream, buffer, len, bytes_read);
+}
+
+static int write_stream(git_server *server, const char *data, size_t len)
+{
+	int error;
+
+	if ((error = server->stream->write(server->stream, data, len)) < 0)
+		return error;
+
+	server->sent += len;
+	return 0;
+}
+
+int git_server__line(git_server *server, const char *fmt, ...)
+{
+	va_list ap;
+	int error;
+
+	va_start(ap, fmt);
+	error = git_pkt_buffer_vline(&server->out, fmt, ap);
+	va_end(ap);
+
+	return error;
+}
+
+int git_server__flush(git_server *server)
+{
+	return git_buf_puts(&server->out, "0000");
+}
+
+int git_server__delim(git_server *server)
+{
+	return git_buf_puts(&server->out, "0001");
+}
+
+int git_server__send(git_server *server)
+{
+	int error;
+
+	if (!server->out.size)
+		return 0;
+
+	error = write_stream(server, server->out.ptr, server->out.size);
+	git_buf_clear(&server->out);
+
+	return error;
+}
+
+int git_server__send_band(git_server *server, int band, const char *data, size_t len)
+{
+	size_t chunk;
+	int error;
+
+	if (!server->side_band) {
+		if (band != 1)
+			return 0;
+
+		if ((error = git_buf_put(&server->out, data, len)) < 0)
+			return error;
+
+		return server->out.size >= SEND_THRESHOLD ? git_server__send(server) : 0;
+	}
+
+	if (band == 2 && !server->progress)
+		return 0;
+
+	while (len > 0) {
+		chunk = min(len, server->side_band - PKT_LEN_SIZE - 1);
+
+		if ((error = git_buf_printf(&server->out, "%04x%c",
+				(unsigned int)(chunk + PKT_LEN_SIZE + 1), band)) < 0 ||
+		    (error = git_buf_put(&server->out, data, chunk)) < 0)
+			return error;
+
+		data += chunk;
+		len -= chunk;
+	}
+
+	/* The client shows the progress as we make it */
+	if (band != 1 || server->out.size >= SEND_THRESHOLD)
+		return git_server__send(server);
+
+	return 0;
+}
+
+void git_server__send_error(git_server *server, bool multiplexed)
+{
+	const git_error *e = git_error_last();
+	git_buf msg = GIT_BUF_INIT;
+
+	git_buf_clear(&server->out);
+
+	if (multiplexed && server->side_band) {
+		git_buf_printf(&msg, "error: %s\n", e ? e->message : "unknown error");
+
+		if (!git_buf_oom(&msg))
+			git_server__send_band(server, 3, msg.ptr, msg.size);
+	} else {
+		git_server__line(server, "ERR %s", e ? e->message : "unknown error");
+		git_server__send(server);
+	}
+
+	git_buf_dispose(&msg);
+}
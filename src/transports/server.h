@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_transports_server_h__
+#define INCLUDE_transports_server_h__
+
+#include "common.h"
+
+#include "git2/sys/server.h"
+#include "buffer.h"
+
+#define GIT_SERVER_AGENT "agent=libgit2/" LIBGIT2_VERSION
+
+/* The largest pkt-line, and the data that a side-band packet holds */
+#define GIT_SERVER_MAX_PKT 65520
+#define GIT_SERVER_SIDE_BAND_MAX 1000
+
+typedef enum {
+	GIT_SERVER_PKT_LINE,
+	GIT_SERVER_PKT_FLUSH,
+	GIT_SERVER_PKT_DELIM,
+	GIT_SERVER_PKT_RESPONSE_END,
+	GIT_SERVER_PKT_EOF, /* the client closed the stream */
+} git_server_pkt_t;
+
+/*
+ * The pkt-lines of a connection to a client: we read its requests
+ * one line at a time and buffer our responses until we send them.
+ */
+typedef struct {
+	git_server_stream *stream;
+
+	char data[GIT_SERVER_MAX_PKT];
+	size_t offset, len;
+
+	/* The last line we read, without its LF */
+	git_server_pkt_t type;
+	char line[GIT_SERVER_MAX_PKT + 1];
+	size_t line_len;
+
+	git_buf out;
+
+	/* Multiplex what we send, with packets of at most this size */
+	size_t side_band;
+	unsigned progress : 1;
+
+	size_t sent;
+} git_server;
+
+void git_server__init(git_server *server, git_server_stream *stream);
+void git_server__dispose(git_server *server);
+
+/*
+ * Read the next pkt-line, which is a GIT_SERVER_PKT_EOF if the client
+ * closed the stream between two lines.
+ */
+int git_server__read(git_server *server);
+
+/* Whether the line we read starts with the prefix, skipping it */
+GIT_INLINE(bool) git_server__skip(const char **out, git_server *server, const char *prefix)
+{
+	size_t len = strlen(prefix);
+
+	if (server->type != GIT_SERVER_PKT_LINE || strncmp(server->line, prefix, len))
+		return false;
+
+	*out = server->line + len;
+	return true;
+}
+
+/* Read data that is not in pkt-lines, like the pack that follows a push */
+int git_server__read_data(git_server *server, char *buffer, size_t len, size_t *bytes_read);
+
+/* Buffer a line, a flush or a delimiter, or the raw data */
+int git_server__line(git_server *server, const char *fmt, ...) GIT_FORMAT_PRINTF(2, 3);
+int git_server__flush(git_server *server);
+int git_server__delim(git_server *server);
+
+/* Send what we buffered */
+int git_server__send(git_server *server);
+
+/*
+ * Send data on a band of the side-band, or as it is if it is not
+ * multiplexed.  Progress is dropped if the client does not want it.
+ */
+int git_server__send_band(git_server *server, int band, const char *data, size_t len);
+
+/*
+ * Tell the client about the last error, on the error band once the
+ * side-band started or in an ERR line.
+ */
+void git_server__send_error(git_server *server, bool multiplexed);
+
+#endif
@@ -109,6 +109,7 @@ static char *forbidden_custom_headers[] = {
 	"Content-Type",
 	"Transfer-Encoding",
 	"Content-Length",
+	"Git-Protocol",
 };
 
 static bool is_forbidden_custom_header(const char *custom_header)
@@ -234,6 +235,14 @@ static int git_smart__connect(
 	t->cred_acquire_cb = cred_acquire_cb;
 	t->cred_acquire_payload = cred_acquire_payload;
 
+	/*
+	 * Ask for protocol v2 when fetching; servers that do not know it
+	 * ignore the request and answer with their v0 advertisement.
+	 */
+	t->request_v2 = (GIT_DIRECTION_FETCH == t->direction && git_smart__protocol_v2_enabled);
+	t->protocol_v2 = 0;
+	t->have_refs = 0;
+
 	if (GIT_DIRECTION_FETCH == t->direction)
 		service = GIT_SERVICE_UPLOADPACK_LS;
 	else if (GIT_DIRECTION_PUSH == t->direction)
@@ -255,8 +264,8 @@ static int git_smart__connect(
 	if ((error = git_smart__store_refs(t, t->rpc ? 2 : 1)) < 0)
 		return error;
 
-	/* Strip the comment packet for RPC */
-	if (t->rpc) {
+	/* Strip the comment packet for RPC; protocol v2 responses have none */
+	if (t->rpc && !t->protocol_v2) {
 		pkt = (git_pkt *)git_vector_get(&t->refs, 0);
 
 		if (!pkt || GIT_PKT_COMMENT != pkt->type) {
@@ -269,10 +278,39 @@ static int git_smart__connect(
 		}
 	}
 
+	pkt = (git_pkt *)git_vector_get(&t->refs, 0);
+
+	/*
+	 * With protocol v2, the server only advertised its capabilities;
+	 * the refs are listed on demand.
+	 */
+	if (t->protocol_v2) {
+		if ((error = git_smart__detect_v2_caps(t)) < 0)
+			return error;
+
+		if (t->rpc && (error = git_smart__reset_stream(t, false)) < 0)
+			return error;
+
+		t->connected = 1;
+		return 0;
+	}
+
+	/* A server asked for protocol v1 announces it before the refs */
+	if (pkt && GIT_PKT_VERSION == pkt->type) {
+		if (((git_pkt_version *)pkt)->version != 1) {
+			git_error_set(GIT_ERROR_NET, "unsupported protocol version %d",
+				((git_pkt_version *)pkt)->version);
+			return -1;
+		}
+
+		git_vector_remove(&t->refs, 0);
+		git_pkt_free(pkt);
+		pkt = (git_pkt *)git_vector_get(&t->refs, 0);
+	}
+
 	/* We now have loaded the refs. */
 	t->have_refs = 1;
 
-	pkt = (git_pkt *)git_vector_get(&t->refs, 0);
 	if (pkt && GIT_PKT_REF != pkt->type) {
 		git_error_set(GIT_ERROR_NET, "invalid response");
 		return -1;
@@ -316,6 +354,11 @@ cleanup:
 static int git_smart__ls(const git_remote_head ***out, size_t *size, git_transport *transport)
 {
 	transport_smart *t = GIT_CONTAINER_OF(transport, transport_smart, parent);
+	int error;
+
+	if (!t->have_refs && t->protocol_v2 && t->connected &&
+	    (error = git_smart__ls_refs(t)) < 0)
+		return error;
 
 	if (!t->have_refs) {
 		git_error_set(GIT_ERROR_NET, "the transport has not yet loaded the refs");
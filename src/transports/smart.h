@@ -30,8 +30,17 @@
 #define GIT_CAP_REPORT_STATUS "report-status"
 #define GIT_CAP_THIN_PACK "thin-pack"
 #define GIT_CAP_SYMREF "symref"
+#define GIT_CAP_FILTER "filter"
+#define GIT_CAP_SHALLOW "shallow"
+#define GIT_CAP_DEEPEN_SINCE "deepen-since"
+#define GIT_CAP_DEEPEN_RELATIVE "deepen-relative"
+
+#define GIT_CAP_V2_LS_REFS "ls-refs"
+#define GIT_CAP_V2_FETCH "fetch"
+#define GIT_CAP_V2_OBJECT_FORMAT "object-format"
 
 extern bool git_smart__ofs_delta_enabled;
+extern bool git_smart__protocol_v2_enabled;
 
 typedef enum {
 	GIT_PKT_CMD,
@@ -47,6 +56,12 @@ typedef enum {
 	GIT_PKT_OK,
 	GIT_PKT_NG,
 	GIT_PKT_UNPACK,
+	GIT_PKT_VERSION,
+	GIT_PKT_DELIM,
+	GIT_PKT_RESPONSE_END,
+	GIT_PKT_TEXT,
+	GIT_PKT_SHALLOW,
+	GIT_PKT_UNSHALLOW,
 } git_pkt_type;
 
 /* Used for multi_ack and multi_ack_detailed */
@@ -69,7 +84,10 @@ struct git_pkt_cmd {
 	char *host;
 };
 
-/* This is a pkt-line with some info in it */
+/*
+ * This is a pkt-line with some info in it; for protocol v2, the
+ * capabilities are the attributes that follow the reference name.
+ */
 typedef struct {
 	git_pkt_type type;
 	git_remote_head head;
@@ -118,6 +136,24 @@ typedef struct {
 	int unpack_ok;
 } git_pkt_unpack;
 
+typedef struct {
+	git_pkt_type type;
+	int version;
+} git_pkt_version;
+
+/* A protocol v2 line without a more specific meaning */
+typedef struct {
+	git_pkt_type type;
+	size_t len;
+	char text[GIT_FLEX_ARRAY];
+} git_pkt_text;
+
+/* A new shallow root, or one that is not a root anymore */
+typedef struct {
+	git_pkt_type type;
+	git_oid oid;
+} git_pkt_shallow;
+
 typedef struct transport_smart_caps {
 	int common:1,
 		ofs_delta:1,
@@ -128,9 +164,22 @@ typedef struct transport_smart_caps {
 		include_tag:1,
 		delete_refs:1,
 		report_status:1,
-		thin_pack:1;
+		thin_pack:1,
+		ls_refs:1,
+		fetch:1,
+		filter:1,
+		shallow:1,
+		deepen_since:1,
+		deepen_relative:1;
 } transport_smart_caps;
 
+/* What a fetch request asks for besides the wanted objects */
+typedef struct {
+	const char *filter;
+	const git_array_oid_t *shallow_roots;
+	const git_shallow_deepen *deepen;
+} git_pkt_fetch_args;
+
 typedef int (*packetsize_cb)(size_t received, void *payload);
 
 typedef struct {
@@ -158,7 +207,9 @@ typedef struct {
 	void *packetsize_payload;
 	unsigned rpc : 1,
 		have_refs : 1,
-		connected : 1;
+		connected : 1,
+		request_v2 : 1,
+		protocol_v2 : 1;
 	gitno_buffer buffer;
 	char buffer_data[65536];
 } transport_smart;
@@ -166,6 +217,8 @@ typedef struct {
 /* smart_protocol.c */
 int git_smart__store_refs(transport_smart *t, int flushes);
 int git_smart__detect_caps(git_pkt_ref *pkt, transport_smart_caps *caps, git_vector *symrefs);
+int git_smart__detect_v2_caps(transport_smart *t);
+int git_smart__ls_refs(transport_smart *t);
 int git_smart__push(git_transport *transport, git_push *push, const git_remote_callbacks *cbs);
 
 int git_smart__negotiate_fetch(
@@ -189,10 +242,15 @@ int git_smart__update_heads(transport_smart *t, git_vector *symrefs);
 
 /* smart_pkt.c */
 int git_pkt_parse_line(git_pkt **head, const char **endptr, const char *line, size_t linelen);
+int git_pkt_parse_v2_line(git_pkt **head, const char **endptr, const char *line, size_t linelen);
 int git_pkt_buffer_flush(git_buf *buf);
+int git_pkt_buffer_delim(git_buf *buf);
+int git_pkt_buffer_line(git_buf *buf, const char *fmt, ...) GIT_FORMAT_PRINTF(2, 3);
+int git_pkt_buffer_vline(git_buf *buf, const char *fmt, va_list ap);
 int git_pkt_send_flush(GIT_SOCKET s);
 int git_pkt_buffer_done(git_buf *buf);
-int git_pkt_buffer_wants(const git_remote_head * const *refs, size_t count, transport_smart_caps *caps, git_buf *buf);
+int git_pkt_buffer_wants(const git_remote_head * const *refs, size_t count, transport_smart_caps *caps, const git_pkt_fetch_args *args, git_buf *buf);
+int git_pkt_buffer_shallow(git_buf *buf, const git_pkt_fetch_args *args);
 int git_pkt_buffer_have(git_oid *oid, git_buf *buf);
 void git_pkt_free(git_pkt *pkt);
 
@@ -21,24 +21,31 @@
 #include <ctype.h>
 
 #define PKT_LEN_SIZE 4
+#define PKT_MAX_LEN 65520 /* the longest line that git accepts */
 static const char pkt_done_str[] = "0009done\n";
 static const char pkt_flush_str[] = "0000";
+static const char pkt_delim_str[] = "0001";
 static const char pkt_have_prefix[] = "0032have ";
 static const char pkt_want_prefix[] = "0032want ";
 
-static int flush_pkt(git_pkt **out)
+static int special_pkt(git_pkt **out, git_pkt_type type)
 {
 	git_pkt *pkt;
 
 	pkt = git__malloc(sizeof(git_pkt));
 	GIT_ERROR_CHECK_ALLOC(pkt);
 
-	pkt->type = GIT_PKT_FLUSH;
+	pkt->type = type;
 	*out = pkt;
 
 	return 0;
 }
 
+static int flush_pkt(git_pkt **out)
+{
+	return special_pkt(out, GIT_PKT_FLUSH);
+}
+
 /* the rest of the line will be useful for multi_ack and multi_ack_detailed */
 static int ack_pkt(git_pkt **out, const char *line, size_t len)
 {
@@ -363,6 +370,148 @@ static int unpack_pkt(git_pkt **out, const char *line, size_t len)
 	return 0;
 }
 
+static int version_pkt(git_pkt **out, const char *line, size_t len)
+{
+	git_pkt_version *pkt;
+	const char *end;
+	int32_t version;
+
+	line += strlen("version ");
+	len -= strlen("version ");
+
+	if (len && line[len - 1] == '\n')
+		--len;
+
+	if (!len || git__strntol32(&version, line, len, &end, 10) < 0 ||
+	    end != line + len || version < 0) {
+		git_error_set(GIT_ERROR_NET, "error parsing version pkt-line");
+		return -1;
+	}
+
+	pkt = git__malloc(sizeof(*pkt));
+	GIT_ERROR_CHECK_ALLOC(pkt);
+
+	pkt->type = GIT_PKT_VERSION;
+	pkt->version = version;
+
+	*out = (git_pkt *)pkt;
+	return 0;
+}
+
+static int text_pkt(git_pkt **out, const char *line, size_t len)
+{
+	git_pkt_text *pkt;
+	size_t alloclen;
+
+	if (len && line[len - 1] == '\n')
+		--len;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, sizeof(git_pkt_text), len);
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, alloclen, 1);
+	pkt = git__malloc(alloclen);
+	GIT_ERROR_CHECK_ALLOC(pkt);
+
+	pkt->type = GIT_PKT_TEXT;
+	pkt->len = len;
+	memcpy(pkt->text, line, len);
+	pkt->text[len] = '\0';
+
+	*out = (git_pkt *)pkt;
+	return 0;
+}
+
+static int shallow_pkt(git_pkt **out, git_pkt_type type, const char *line, size_t len)
+{
+	git_pkt_shallow *pkt;
+	size_t prefix_len = (type == GIT_PKT_SHALLOW) ? strlen("shallow ") : strlen("unshallow ");
+
+	if (len && line[len - 1] == '\n')
+		--len;
+
+	if (len != prefix_len + GIT_OID_HEXSZ) {
+		git_error_set(GIT_ERROR_NET, "invalid shallow line");
+		return -1;
+	}
+
+	pkt = git__calloc(1, sizeof(git_pkt_shallow));
+	GIT_ERROR_CHECK_ALLOC(pkt);
+	pkt->type = type;
+
+	if (git_oid_fromstrn(&pkt->oid, line + prefix_len, GIT_OID_HEXSZ) < 0) {
+		git__free(pkt);
+		git_error_set(GIT_ERROR_NET, "invalid shallow line");
+		return -1;
+	}
+
+	*out = (git_pkt *)pkt;
+	return 0;
+}
+
+/*
+ * Parse a reference line of a protocol v2 ls-refs response, where the
+ * name is followed by space-separated attributes rather than by a NUL
+ * and the capabilities.
+ */
+static int ls_ref_pkt(git_pkt **out, const char *line, size_t len)
+{
+	git_pkt_ref *pkt;
+	char *attrs;
+	size_t alloclen;
+
+	pkt = git__calloc(1, sizeof(git_pkt_ref));
+	GIT_ERROR_CHECK_ALLOC(pkt);
+	pkt->type = GIT_PKT_REF;
+
+	if (len < GIT_OID_HEXSZ + 2 ||
+	    git_oid_fromstrn(&pkt->head.oid, line, GIT_OID_HEXSZ) < 0 ||
+	    line[GIT_OID_HEXSZ] != ' ')
+		goto out_err;
+	line += GIT_OID_HEXSZ + 1;
+	len -= GIT_OID_HEXSZ + 1;
+
+	if (line[len - 1] == '\n')
+		--len;
+
+	if (!len || *line == ' ')
+		goto out_err;
+
+	GIT_ERROR_CHECK_ALLOC_ADD(&alloclen, len, 1);
+	pkt->head.name = git__malloc(alloclen);
+	GIT_ERROR_CHECK_ALLOC(pkt->head.name);
+
+	memcpy(pkt->head.name, line, len);
+	pkt->head.name[len] = '\0';
+
+	if ((attrs = strchr(pkt->head.name, ' ')) != NULL) {
+		*attrs++ = '\0';
+		pkt->capabilities = attrs;
+	}
+
+	*out = (git_pkt *)pkt;
+	return 0;
+
+out_err:
+	git_error_set(GIT_ERROR_NET, "error parsing REF pkt-line");
+	git__free(pkt->head.name);
+	git__free(pkt);
+	return -1;
+}
+
+static bool is_ref_line(const char *line, size_t len)
+{
+	size_t i;
+
+	if (len <= GIT_OID_HEXSZ || line[GIT_OID_HEXSZ] != ' ')
+		return false;
+
+	for (i = 0; i < GIT_OID_HEXSZ; i++) {
+		if (!isxdigit(line[i]))
+			return false;
+	}
+
+	return true;
+}
+
 static int parse_len(size_t *out, const char *line, size_t linelen)
 {
 	char num[PKT_LEN_SIZE + 1];
@@ -411,11 +560,12 @@ static int parse_len(size_t *out, const char *line, size_t linelen)
  * flush-pkt	= "0000"
  *
  * Which means that the first four bytes are the length of the line,
- * in ASCII hexadecimal (including itself)
+ * in ASCII hexadecimal (including itself).  Protocol v2 adds the
+ * delim-pkt "0001" and the response-end-pkt "0002".
  */
 
-int git_pkt_parse_line(
-	git_pkt **pkt, const char **endptr, const char *line, size_t linelen)
+static int parse_line(
+	git_pkt **pkt, const char **endptr, const char *line, size_t linelen, bool v2)
 {
 	int error;
 	size_t len;
@@ -443,6 +593,11 @@ int git_pkt_parse_line(
 	if (linelen < len)
 		return GIT_EBUFS;
 
+	if (v2 && (len == 1 || len == 2)) {
+		*endptr = line + PKT_LEN_SIZE;
+		return special_pkt(pkt, len == 1 ? GIT_PKT_DELIM : GIT_PKT_RESPONSE_END);
+	}
+
 	/*
 	 * The length has to be exactly 0 in case of a flush
 	 * packet or greater than PKT_LEN_SIZE, as the decoded
@@ -481,6 +636,16 @@ int git_pkt_parse_line(
 		error = nak_pkt(pkt);
 	else if (!git__prefixncmp(line, len, "ERR"))
 		error = err_pkt(pkt, line, len);
+	else if (!git__prefixncmp(line, len, "shallow "))
+		error = shallow_pkt(pkt, GIT_PKT_SHALLOW, line, len);
+	else if (!git__prefixncmp(line, len, "unshallow "))
+		error = shallow_pkt(pkt, GIT_PKT_UNSHALLOW, line, len);
+	else if (v2 && is_ref_line(line, len))
+		error = ls_ref_pkt(pkt, line, len);
+	else if (v2)
+		error = text_pkt(pkt, line, len);
+	else if (!git__prefixncmp(line, len, "version "))
+		error = version_pkt(pkt, line, len);
 	else if (*line == '#')
 		error = comment_pkt(pkt, line, len);
 	else if (!git__prefixncmp(line, len, "ok"))
@@ -497,6 +662,24 @@ int git_pkt_parse_line(
 	return error;
 }
 
+int git_pkt_parse_line(
+	git_pkt **pkt, const char **endptr, const char *line, size_t linelen)
+{
+	return parse_line(pkt, endptr, line, linelen, false);
+}
+
+/*
+ * Parse a pkt-line of protocol v2, after the version line.  Besides
+ * the sideband, ACK, NAK and ERR lines, reference lines of ls-refs
+ * responses are parsed as refs and anything else (capabilities,
+ * section headers) is returned as text.
+ */
+int git_pkt_parse_v2_line(
+	git_pkt **pkt, const char **endptr, const char *line, size_t linelen)
+{
+	return parse_line(pkt, endptr, line, linelen, true);
+}
+
 void git_pkt_free(git_pkt *pkt)
 {
 	if (pkt == NULL) {
@@ -527,8 +710,52 @@ int git_pkt_buffer_flush(git_buf *buf)
 	return git_buf_put(buf, pkt_flush_str, strlen(pkt_flush_str));
 }
 
-static int buffer_want_with_caps(const git_remote_head *head, transport_smart_caps *caps, git_buf *buf)
+int git_pkt_buffer_delim(git_buf *buf)
+{
+	return git_buf_put(buf, pkt_delim_str, strlen(pkt_delim_str));
+}
+
+/* Append a newline-terminated pkt-line with the formatted payload */
+int git_pkt_buffer_vline(git_buf *buf, const char *fmt, va_list ap)
+{
+	git_buf line = GIT_BUF_INIT;
+	size_t len;
+	int error;
+
+	if ((error = git_buf_vprintf(&line, fmt, ap)) < 0)
+		goto done;
+
+	len = PKT_LEN_SIZE + git_buf_len(&line) + 1 /* LF */;
+
+	if (len > PKT_MAX_LEN) {
+		git_error_set(GIT_ERROR_NET,
+			"tried to produce packet with invalid length %" PRIuZ, len);
+		error = -1;
+		goto done;
+	}
+
+	error = git_buf_printf(buf, "%04x%s\n", (unsigned int)len, git_buf_cstr(&line));
+
+done:
+	git_buf_dispose(&line);
+	return error;
+}
+
+int git_pkt_buffer_line(git_buf *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int error;
+
+	va_start(ap, fmt);
+	error = git_pkt_buffer_vline(buf, fmt, ap);
+	va_end(ap);
+
+	return error;
+}
+
+static int buffer_want_with_caps(const git_remote_head *head, transport_smart_caps *caps, const git_pkt_fetch_args *args, git_buf *buf)
 {
+	const char *filter = args ? args->filter : NULL;
 	git_buf str = GIT_BUF_INIT;
 	char oid[GIT_OID_HEXSZ +1] = {0};
 	size_t len;
@@ -548,12 +775,22 @@ static int buffer_want_with_caps(const git_remote_head *head, transport_smart_ca
 	if (caps->include_tag)
 		git_buf_puts(&str, GIT_CAP_INCLUDE_TAG " ");
 
-	if (caps->thin_pack)
+	/*
+	 * The bases of a thin pack may be objects that a filter left out
+	 * of an earlier fetch.
+	 */
+	if (caps->thin_pack && !filter)
 		git_buf_puts(&str, GIT_CAP_THIN_PACK " ");
 
 	if (caps->ofs_delta)
 		git_buf_puts(&str, GIT_CAP_OFS_DELTA " ");
 
+	if (filter)
+		git_buf_puts(&str, GIT_CAP_FILTER " ");
+
+	if (args && args->deepen && args->deepen->relative)
+		git_buf_puts(&str, GIT_CAP_DEEPEN_RELATIVE " ");
+
 	if (git_buf_oom(&str))
 		return -1;
 
@@ -586,6 +823,7 @@ int git_pkt_buffer_wants(
 	const git_remote_head * const *refs,
 	size_t count,
 	transport_smart_caps *caps,
+	const git_pkt_fetch_args *args,
 	git_buf *buf)
 {
 	size_t i = 0;
@@ -598,7 +836,7 @@ int git_pkt_buffer_wants(
 				break;
 		}
 
-		if (buffer_want_with_caps(refs[i], caps, buf) < 0)
+		if (buffer_want_with_caps(refs[i], caps, args, buf) < 0)
 			return -1;
 
 		i++;
@@ -619,9 +857,50 @@ int git_pkt_buffer_wants(
 			return -1;
 	}
 
+	if (args && git_pkt_buffer_shallow(buf, args) < 0)
+		return -1;
+
+	if (args && args->filter &&
+	    git_pkt_buffer_line(buf, "filter %s", args->filter) < 0)
+		return -1;
+
 	return git_pkt_buffer_flush(buf);
 }
 
+/*
+ * Append our shallow roots, which the remote must not send the parents
+ * of, and how far to deepen the history.  Deepening relative to the
+ * roots is a capability in protocol v0 and an argument in v2.
+ */
+int git_pkt_buffer_shallow(git_buf *buf, const git_pkt_fetch_args *args)
+{
+	char oid[GIT_OID_HEXSZ + 1];
+	const git_oid *root;
+	size_t i;
+
+	if (args->shallow_roots) {
+		git_array_foreach(*args->shallow_roots, i, root) {
+			git_oid_tostr(oid, sizeof(oid), root);
+
+			if (git_pkt_buffer_line(buf, "shallow %s", oid) < 0)
+				return -1;
+		}
+	}
+
+	if (!args->deepen)
+		return 0;
+
+	if (args->deepen->depth > 0 &&
+	    git_pkt_buffer_line(buf, "deepen %d", args->deepen->depth) < 0)
+		return -1;
+
+	if (args->deepen->since &&
+	    git_pkt_buffer_line(buf, "deepen-since %" PRId64, (int64_t)args->deepen->since) < 0)
+		return -1;
+
+	return 0;
+}
+
 int git_pkt_buffer_have(git_oid *oid, git_buf *buf)
 {
 	char oidhex[GIT_OID_HEXSZ + 1];
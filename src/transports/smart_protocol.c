@@ -15,15 +15,17 @@
 #include "repository.h"
 #include "push.h"
 #include "pack-objects.h"
+#include "pack_pipeline.h"
 #include "remote.h"
+#include "fetch.h"
 #include "util.h"
-#include "revwalk.h"
 
 #define NETWORK_XFER_THRESHOLD (100*1024)
 /* The minimal interval between progress updates (in seconds). */
 #define MIN_PROGRESS_UPDATE_INTERVAL 0.5
 
 bool git_smart__ofs_delta_enabled = true;
+bool git_smart__protocol_v2_enabled = true;
 
 int git_smart__store_refs(transport_smart *t, int flushes)
 {
@@ -44,7 +46,9 @@ int git_smart__store_refs(transport_smart *t, int flushes)
 	pkt = NULL;
 
 	do {
-		if (buf->offset > 0)
+		if (buf->offset > 0 && t->protocol_v2)
+			error = git_pkt_parse_v2_line(&pkt, &line_end, buf->data, buf->offset);
+		else if (buf->offset > 0)
 			error = git_pkt_parse_line(&pkt, &line_end, buf->data, buf->offset);
 		else
 			error = GIT_EBUFS;
@@ -71,6 +75,18 @@ int git_smart__store_refs(transport_smart *t, int flushes)
 			return -1;
 		}
 
+		/*
+		 * The capabilities of protocol v2 follow its version line,
+		 * which smart HTTP servers send without a service comment.
+		 */
+		if (pkt->type == GIT_PKT_VERSION &&
+		    ((git_pkt_version *)pkt)->version == 2) {
+			t->protocol_v2 = 1;
+
+			if (!refs->length)
+				flushes = 1;
+		}
+
 		if (pkt->type != GIT_PKT_FLUSH && git_vector_insert(refs, pkt) < 0)
 			return -1;
 
@@ -194,6 +210,30 @@ int git_smart__detect_caps(git_pkt_ref *pkt, transport_smart_caps *caps, git_vec
 			continue;
 		}
 
+		if (!git__prefixcmp(ptr, GIT_CAP_FILTER)) {
+			caps->common = caps->filter = 1;
+			ptr += strlen(GIT_CAP_FILTER);
+			continue;
+		}
+
+		if (!git__prefixcmp(ptr, GIT_CAP_SHALLOW)) {
+			caps->common = caps->shallow = 1;
+			ptr += strlen(GIT_CAP_SHALLOW);
+			continue;
+		}
+
+		if (!git__prefixcmp(ptr, GIT_CAP_DEEPEN_SINCE)) {
+			caps->common = caps->deepen_since = 1;
+			ptr += strlen(GIT_CAP_DEEPEN_SINCE);
+			continue;
+		}
+
+		if (!git__prefixcmp(ptr, GIT_CAP_DEEPEN_RELATIVE)) {
+			caps->common = caps->deepen_relative = 1;
+			ptr += strlen(GIT_CAP_DEEPEN_RELATIVE);
+			continue;
+		}
+
 		if (!git__prefixcmp(ptr, GIT_CAP_SYMREF)) {
 			int error;
 
@@ -210,14 +250,99 @@ int git_smart__detect_caps(git_pkt_ref *pkt, transport_smart_caps *caps, git_vec
 	return 0;
 }
 
-static int recv_pkt(git_pkt **out_pkt, git_pkt_type *out_type, gitno_buffer *buf)
+/* Return the value of a protocol v2 capability, or NULL if it is another one */
+static const char *v2_capability(const char *line, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (strncmp(line, name, len))
+		return NULL;
+
+	if (line[len] == '=')
+		return line + len + 1;
+
+	return line[len] == '\0' ? line + len : NULL;
+}
+
+/* Whether a space-separated list of features has the given one */
+static bool has_word(const char *list, const char *word)
+{
+	size_t len = strlen(word);
+	const char *p;
+
+	for (p = list; (p = strstr(p, word)) != NULL; p += len) {
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+int git_smart__detect_v2_caps(transport_smart *t)
+{
+	const char *value;
+	git_pkt *pkt;
+	size_t i;
+	int error = 0;
+
+	memset(&t->caps, 0, sizeof(t->caps));
+
+	git_vector_foreach(&t->refs, i, pkt) {
+		git_pkt_text *line = (git_pkt_text *)pkt;
+
+		/* Smart HTTP servers may still send a service comment */
+		if (error < 0 || pkt->type == GIT_PKT_VERSION ||
+		    pkt->type == GIT_PKT_COMMENT)
+			continue;
+
+		if (pkt->type != GIT_PKT_TEXT) {
+			git_error_set(GIT_ERROR_NET, "invalid response");
+			error = -1;
+		} else if (v2_capability(line->text, GIT_CAP_V2_LS_REFS)) {
+			t->caps.ls_refs = 1;
+		} else if ((value = v2_capability(line->text, GIT_CAP_V2_FETCH)) != NULL) {
+			t->caps.fetch = 1;
+			t->caps.filter = has_word(value, GIT_CAP_FILTER);
+
+			/* The shallow feature covers all ways of deepening */
+			t->caps.shallow = t->caps.deepen_since = t->caps.deepen_relative =
+				has_word(value, GIT_CAP_SHALLOW);
+		} else if ((value = v2_capability(line->text, GIT_CAP_V2_OBJECT_FORMAT)) != NULL &&
+		           strcmp(value, "sha1")) {
+			git_error_set(GIT_ERROR_NET, "remote uses unsupported object format '%s'", value);
+			error = -1;
+		}
+	}
+
+	git_vector_foreach(&t->refs, i, pkt)
+		git_pkt_free(pkt);
+	git_vector_clear(&t->refs);
+
+	/*
+	 * These are arguments to the fetch command rather than
+	 * capabilities in protocol v2, and the packfile is always
+	 * multiplexed.
+	 */
+	t->caps.common = 1;
+	t->caps.ofs_delta = git_smart__ofs_delta_enabled;
+	t->caps.include_tag = 1;
+	t->caps.thin_pack = 1;
+	t->caps.side_band_64k = 1;
+
+	return error;
+}
+
+static int recv_line(
+	git_pkt **out_pkt, git_pkt_type *out_type, gitno_buffer *buf, bool v2)
 {
 	const char *ptr = buf->data, *line_end = ptr;
 	git_pkt *pkt = NULL;
 	int error = 0, ret;
 
 	do {
-		if (buf->offset > 0)
+		if (buf->offset > 0 && v2)
+			error = git_pkt_parse_v2_line(&pkt, &line_end, ptr, buf->offset);
+		else if (buf->offset > 0)
 			error = git_pkt_parse_line(&pkt, &line_end, ptr, buf->offset);
 		else
 			error = GIT_EBUFS;
@@ -242,11 +367,162 @@ static int recv_pkt(git_pkt **out_pkt, git_pkt_type *out_type, gitno_buffer *buf
 	if (out_pkt != NULL)
 		*out_pkt = pkt;
 	else
-		git__free(pkt);
+		git_pkt_free(pkt);
 
 	return error;
 }
 
+static int recv_pkt(git_pkt **out_pkt, git_pkt_type *out_type, gitno_buffer *buf)
+{
+	return recv_line(out_pkt, out_type, buf, false);
+}
+
+static int recv_v2_pkt(git_pkt **out_pkt, gitno_buffer *buf)
+{
+	int error;
+
+	if ((error = recv_line(out_pkt, NULL, buf, true)) < 0)
+		return error;
+
+	if ((*out_pkt)->type == GIT_PKT_ERR) {
+		git_error_set(GIT_ERROR_NET, "remote error: %s",
+			((git_pkt_err *)*out_pkt)->error);
+		git_pkt_free(*out_pkt);
+		*out_pkt = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+GIT_INLINE(bool) is_text_pkt(git_pkt *pkt, const char *text)
+{
+	return pkt->type == GIT_PKT_TEXT &&
+	       !strcmp(((git_pkt_text *)pkt)->text, text);
+}
+
+/*
+ * Add a reference of an ls-refs response, taking its symref target
+ * from its attributes and adding its peeled value as a separate
+ * "<name>^{}" reference like in the advertisement of protocol v0.
+ */
+static int add_ls_ref(transport_smart *t, git_pkt_ref *ref)
+{
+	git_pkt_ref *peeled = NULL;
+	git_buf name = GIT_BUF_INIT;
+	char *attr = ref->capabilities, *next;
+	int error = 0;
+
+	ref->capabilities = NULL;
+
+	for (; attr && *attr; attr = next) {
+		if ((next = strchr(attr, ' ')) != NULL)
+			*next++ = '\0';
+
+		if (!git__prefixcmp(attr, "symref-target:")) {
+			git__free(ref->head.symref_target);
+
+			if ((ref->head.symref_target = git__strdup(attr + strlen("symref-target:"))) == NULL) {
+				error = -1;
+				goto done;
+			}
+		} else if (!git__prefixcmp(attr, "peeled:") && !peeled) {
+			if ((peeled = git__calloc(1, sizeof(git_pkt_ref))) == NULL) {
+				error = -1;
+				goto done;
+			}
+
+			peeled->type = GIT_PKT_REF;
+
+			if (git_oid_fromstr(&peeled->head.oid, attr + strlen("peeled:")) < 0) {
+				git_error_set(GIT_ERROR_NET, "remote sent invalid peeled value");
+				error = -1;
+				goto done;
+			}
+
+			if ((error = git_buf_printf(&name, "%s^{}", ref->head.name)) < 0)
+				goto done;
+
+			peeled->head.name = git_buf_detach(&name);
+		}
+	}
+
+	if ((error = git_vector_insert(&t->refs, ref)) < 0)
+		goto done;
+
+	ref = NULL;
+
+	if (peeled && (error = git_vector_insert(&t->refs, peeled)) == 0)
+		peeled = NULL;
+
+done:
+	git_pkt_free((git_pkt *)ref);
+	git_pkt_free((git_pkt *)peeled);
+	git_buf_dispose(&name);
+	return error;
+}
+
+int git_smart__ls_refs(transport_smart *t)
+{
+	git_vector *prefixes = t->owner ? &t->owner->ref_prefixes : NULL;
+	git_buf request = GIT_BUF_INIT;
+	git_pkt *pkt = NULL;
+	const char *prefix;
+	size_t i;
+	int error;
+
+	if (!t->caps.ls_refs) {
+		git_error_set(GIT_ERROR_NET, "the remote does not support listing references");
+		return -1;
+	}
+
+	git_vector_foreach(&t->refs, i, pkt)
+		git_pkt_free(pkt);
+	git_vector_clear(&t->refs);
+	git_vector_clear(&t->heads);
+
+	if ((error = git_pkt_buffer_line(&request, "command=ls-refs")) < 0 ||
+	    (error = git_pkt_buffer_delim(&request)) < 0 ||
+	    (error = git_pkt_buffer_line(&request, "peel")) < 0 ||
+	    (error = git_pkt_buffer_line(&request, "symrefs")) < 0)
+		goto done;
+
+	if (prefixes) {
+		git_vector_foreach(prefixes, i, prefix) {
+			if ((error = git_pkt_buffer_line(&request, "ref-prefix %s", prefix)) < 0)
+				goto done;
+		}
+	}
+
+	if ((error = git_pkt_buffer_flush(&request)) < 0 ||
+	    (error = git_smart__negotiation_step(&t->parent, request.ptr, request.size)) < 0)
+		goto done;
+
+	while ((error = recv_v2_pkt(&pkt, &t->buffer)) == 0) {
+		if (pkt->type == GIT_PKT_FLUSH || pkt->type == GIT_PKT_RESPONSE_END) {
+			git_pkt_free(pkt);
+			break;
+		}
+
+		if (pkt->type != GIT_PKT_REF) {
+			git_error_set(GIT_ERROR_NET, "invalid response");
+			git_pkt_free(pkt);
+			error = -1;
+			break;
+		}
+
+		if ((error = add_ls_ref(t, (git_pkt_ref *)pkt)) < 0)
+			break;
+	}
+
+	if (!error && (error = git_smart__update_heads(t, NULL)) == 0)
+		t->have_refs = 1;
+
+done:
+	git_buf_dispose(&request);
+	return error;
+}
+
 static int store_common(transport_smart *t)
 {
 	git_pkt *pkt = NULL;
@@ -301,26 +577,360 @@ static int wait_while_ack(gitno_buffer *buf)
 	return 0;
 }
 
+/* The arguments of our fetch requests besides the wants */
+static void fetch_args(git_pkt_fetch_args *args, transport_smart *t)
+{
+	memset(args, 0, sizeof(*args));
+
+	if (!t->owner)
+		return;
+
+	/* The object filter is only sent if the remote supports filtering */
+	if (t->caps.filter)
+		args->filter = t->owner->filter;
+
+	if (git_array_size(t->owner->shallow_roots))
+		args->shallow_roots = &t->owner->shallow_roots;
+
+	if (git_shallow_deepening(&t->owner->deepen))
+		args->deepen = &t->owner->deepen;
+}
+
+static int check_shallow_caps(transport_smart *t, const git_pkt_fetch_args *args)
+{
+	if ((args->shallow_roots || args->deepen) && !t->caps.shallow) {
+		git_error_set(GIT_ERROR_NET, "the remote does not support shallow fetches");
+		return -1;
+	}
+
+	if (args->deepen && args->deepen->since && !t->caps.deepen_since) {
+		git_error_set(GIT_ERROR_NET, "the remote does not support fetching the history since a date");
+		return -1;
+	}
+
+	if (args->deepen && args->deepen->relative && !t->caps.deepen_relative) {
+		git_error_set(GIT_ERROR_NET, "the remote does not support deepening the history");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int record_shallow(transport_smart *t, git_pkt_shallow *pkt)
+{
+	git_array_oid_t *roots = (pkt->type == GIT_PKT_SHALLOW) ?
+		&t->owner->shallow_added : &t->owner->shallow_removed;
+	git_oid *id;
+
+	id = git_array_alloc(*roots);
+	GIT_ERROR_CHECK_ALLOC(id);
+	git_oid_cpy(id, &pkt->oid);
+
+	return 0;
+}
+
+/*
+ * Read the shallow roots of the history that the remote is going to
+ * send, which it lists before acknowledging our haves when we deepen.
+ */
+static int recv_shallow_list(transport_smart *t)
+{
+	git_pkt *pkt = NULL;
+	int error;
+
+	git_array_clear(t->owner->shallow_added);
+	git_array_clear(t->owner->shallow_removed);
+
+	while ((error = recv_pkt(&pkt, NULL, &t->buffer)) == 0) {
+		if (pkt->type == GIT_PKT_FLUSH)
+			break;
+
+		if (pkt->type == GIT_PKT_SHALLOW || pkt->type == GIT_PKT_UNSHALLOW) {
+			error = record_shallow(t, (git_pkt_shallow *)pkt);
+		} else if (pkt->type == GIT_PKT_ERR) {
+			git_error_set(GIT_ERROR_NET, "remote error: %s", ((git_pkt_err *)pkt)->error);
+			error = -1;
+		} else {
+			git_error_set(GIT_ERROR_NET, "expected the list of shallow roots");
+			error = -1;
+		}
+
+		git_pkt_free(pkt);
+		pkt = NULL;
+
+		if (error < 0)
+			break;
+	}
+
+	git_pkt_free(pkt);
+	return error;
+}
+
+/*
+ * Send a protocol v0 request.  When we deepen, the remote answers the
+ * first one with the new shallow roots, and every one if the transport
+ * is stateless.
+ */
+static int negotiation_step(
+	transport_smart *t,
+	const git_pkt_fetch_args *args,
+	git_buf *data,
+	bool *first)
+{
+	int error;
+
+	if ((error = git_smart__negotiation_step(&t->parent, data->ptr, data->size)) < 0)
+		return error;
+
+	if (args->deepen && (*first || t->rpc))
+		error = recv_shallow_list(t);
+
+	*first = false;
+	return error;
+}
+
+/* Whether to fetch the wanted objects without sending any have */
+GIT_INLINE(bool) skip_haves(transport_smart *t)
+{
+	return t->owner && t->owner->lazy_fetch;
+}
+
+/*
+ * Like git, we end a round of haves when we have sent twice as many as
+ * at the end of the previous one (16, 32, 64...), and give up finding
+ * a common commit after sending 256 of them.
+ */
+#define NEGOTIATION_FIRST_ROUND 16
+#define NEGOTIATION_MAX_HAVES   256
+
+GIT_INLINE(bool) end_of_round(unsigned int *round_end, unsigned int sent)
+{
+	if (sent < *round_end)
+		return false;
+
+	*round_end += sent;
+	return true;
+}
+
+/*
+ * Protocol v2 is stateless: every fetch request carries the wants and
+ * the common commits found so far, along with the new haves.
+ */
+static int buffer_fetch_request(
+	git_buf *buf,
+	transport_smart *t,
+	const git_remote_head * const *wants,
+	size_t count,
+	git_buf *haves,
+	bool done)
+{
+	git_pkt_fetch_args args;
+	char oid[GIT_OID_HEXSZ + 1];
+	git_pkt_ack *ack;
+	size_t i;
+
+	fetch_args(&args, t);
+
+	git_pkt_buffer_line(buf, "command=fetch");
+	git_pkt_buffer_delim(buf);
+
+	/* Thin packs may be based on objects that were filtered out */
+	if (t->caps.thin_pack && !args.filter)
+		git_pkt_buffer_line(buf, GIT_CAP_THIN_PACK);
+
+	if (t->caps.ofs_delta)
+		git_pkt_buffer_line(buf, GIT_CAP_OFS_DELTA);
+
+	if (t->caps.include_tag)
+		git_pkt_buffer_line(buf, GIT_CAP_INCLUDE_TAG);
+
+	for (i = 0; i < count; i++) {
+		if (wants[i]->local)
+			continue;
+
+		git_oid_tostr(oid, sizeof(oid), &wants[i]->oid);
+		git_pkt_buffer_line(buf, "want %s", oid);
+	}
+
+	git_pkt_buffer_shallow(buf, &args);
+
+	if (args.deepen && args.deepen->relative)
+		git_pkt_buffer_line(buf, GIT_CAP_DEEPEN_RELATIVE);
+
+	if (args.filter)
+		git_pkt_buffer_line(buf, "filter %s", args.filter);
+
+	git_vector_foreach(&t->common, i, ack)
+		git_pkt_buffer_have(&ack->oid, buf);
+
+	git_buf_put(buf, haves->ptr, haves->size);
+
+	if (done)
+		git_pkt_buffer_done(buf);
+
+	git_pkt_buffer_flush(buf);
+
+	return git_buf_oom(buf) ? -1 : 0;
+}
+
+/*
+ * Read the acknowledgments section of a fetch response.  If the server
+ * is ready to send the pack, the packfile section follows it.
+ */
+static int recv_acknowledgments(bool *ready, transport_smart *t)
+{
+	git_pkt *pkt = NULL;
+	int error;
+
+	*ready = false;
+
+	if ((error = recv_v2_pkt(&pkt, &t->buffer)) < 0)
+		return error;
+
+	if (!is_text_pkt(pkt, "acknowledgments"))
+		goto unexpected;
+
+	while (1) {
+		git_pkt_free(pkt);
+
+		if ((error = recv_v2_pkt(&pkt, &t->buffer)) < 0)
+			return error;
+
+		if (pkt->type == GIT_PKT_ACK) {
+			if ((error = git_vector_insert(&t->common, pkt)) < 0)
+				break;
+
+			pkt = NULL;
+			continue;
+		}
+
+		if (pkt->type == GIT_PKT_NAK)
+			continue;
+
+		if (is_text_pkt(pkt, "ready"))
+			*ready = true;
+		else if (pkt->type == GIT_PKT_DELIM && *ready)
+			break;
+		else if (pkt->type == GIT_PKT_FLUSH && !*ready)
+			break;
+		else
+			goto unexpected;
+	}
+
+	git_pkt_free(pkt);
+	return error;
+
+unexpected:
+	git_error_set(GIT_ERROR_NET, "unexpected pkt type");
+	git_pkt_free(pkt);
+	return -1;
+}
+
+static int negotiate_fetch_v2(transport_smart *t, git_repository *repo, const git_remote_head * const *wants, size_t count)
+{
+	git_buf request = GIT_BUF_INIT, haves = GIT_BUF_INIT;
+	git_pkt_fetch_args args;
+	git_negotiator *negotiator = NULL;
+	bool ready = false;
+	unsigned int i, round_end = NEGOTIATION_FIRST_ROUND;
+	git_oid oid;
+	int error;
+
+	if (!t->caps.fetch) {
+		git_error_set(GIT_ERROR_NET, "the remote does not support fetching");
+		return -1;
+	}
+
+	fetch_args(&args, t);
+
+	if ((error = check_shallow_caps(t, &args)) < 0)
+		return error;
+
+	if (!skip_haves(t) &&
+	    (error = git_fetch__negotiator_new(&negotiator, repo, t->owner)) < 0)
+		goto done;
+
+	/*
+	 * Like for protocol v0, send our haves in rounds until the server
+	 * acknowledges a common commit or we have sent enough of them.
+	 */
+	for (i = 0; negotiator && i < NEGOTIATION_MAX_HAVES; ) {
+		if ((error = git_negotiator_next(&oid, negotiator)) < 0) {
+			if (error == GIT_ITEROVER)
+				break;
+
+			goto done;
+		}
+
+		if ((error = git_pkt_buffer_have(&oid, &haves)) < 0)
+			goto done;
+
+		if (!end_of_round(&round_end, ++i))
+			continue;
+
+		if (t->cancelled.val) {
+			git_error_set(GIT_ERROR_NET, "The fetch was cancelled by the user");
+			error = GIT_EUSER;
+			goto done;
+		}
+
+		if ((error = buffer_fetch_request(&request, t, wants, count, &haves, false)) < 0 ||
+		    (error = git_smart__negotiation_step(&t->parent, request.ptr, request.size)) < 0 ||
+		    (error = recv_acknowledgments(&ready, t)) < 0)
+			goto done;
+
+		git_buf_clear(&request);
+		git_buf_clear(&haves);
+
+		if (ready || t->common.length > 0)
+			break;
+	}
+
+	/* The packfile section follows the acknowledgments if the server is ready */
+	if (ready)
+		goto done;
+
+	if (t->cancelled.val) {
+		git_error_set(GIT_ERROR_NET, "The fetch was cancelled by the user");
+		error = GIT_EUSER;
+		goto done;
+	}
+
+	if ((error = buffer_fetch_request(&request, t, wants, count, &haves, true)) < 0 ||
+	    (error = git_smart__negotiation_step(&t->parent, request.ptr, request.size)) < 0)
+		goto done;
+
+done:
+	git_negotiator_free(negotiator);
+	git_buf_dispose(&request);
+	git_buf_dispose(&haves);
+	return error;
+}
+
 int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, const git_remote_head * const *wants, size_t count)
 {
 	transport_smart *t = (transport_smart *)transport;
-	git_revwalk__push_options opts = GIT_REVWALK__PUSH_OPTIONS_INIT;
 	gitno_buffer *buf = &t->buffer;
 	git_buf data = GIT_BUF_INIT;
-	git_revwalk *walk = NULL;
+	git_pkt_fetch_args args;
+	git_negotiator *negotiator = NULL;
+	bool first = true, flushed;
 	int error = -1;
 	git_pkt_type pkt_type;
-	unsigned int i;
+	unsigned int i, round_end = NEGOTIATION_FIRST_ROUND;
 	git_oid oid;
 
-	if ((error = git_pkt_buffer_wants(wants, count, &t->caps, &data)) < 0)
-		return error;
+	if (t->protocol_v2)
+		return negotiate_fetch_v2(t, repo, wants, count);
 
-	if ((error = git_revwalk_new(&walk, repo)) < 0)
-		goto on_error;
+	fetch_args(&args, t);
+
+	if ((error = check_shallow_caps(t, &args)) < 0 ||
+	    (error = git_pkt_buffer_wants(wants, count, &t->caps, &args, &data)) < 0)
+		return error;
 
-	opts.insert_by_date = 1;
-	if ((error = git_revwalk__push_glob(walk, "refs/*", &opts)) < 0)
+	if (!skip_haves(t) &&
+	    (error = git_fetch__negotiator_new(&negotiator, repo, t->owner)) < 0)
 		goto on_error;
 
 	/*
@@ -330,8 +940,8 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 	 * first 256 we send.
 	 */
 	i = 0;
-	while (i < 256) {
-		error = git_revwalk_next(&oid, walk);
+	while (negotiator && i < NEGOTIATION_MAX_HAVES) {
+		error = git_negotiator_next(&oid, negotiator);
 
 		if (error < 0) {
 			if (GIT_ITEROVER == error)
@@ -342,7 +952,7 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 
 		git_pkt_buffer_have(&oid, &data);
 		i++;
-		if (i % 20 == 0) {
+		if ((flushed = end_of_round(&round_end, i))) {
 			if (t->cancelled.val) {
 				git_error_set(GIT_ERROR_NET, "The fetch was cancelled by the user");
 				error = GIT_EUSER;
@@ -355,7 +965,7 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 				goto on_error;
 			}
 
-			if ((error = git_smart__negotiation_step(&t->parent, data.ptr, data.size)) < 0)
+			if ((error = negotiation_step(t, &args, &data, &first)) < 0)
 				goto on_error;
 
 			git_buf_clear(&data);
@@ -381,11 +991,11 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 		if (t->common.length > 0)
 			break;
 
-		if (i % 20 == 0 && t->rpc) {
+		if (flushed && t->rpc) {
 			git_pkt_ack *pkt;
 			unsigned int j;
 
-			if ((error = git_pkt_buffer_wants(wants, count, &t->caps, &data)) < 0)
+			if ((error = git_pkt_buffer_wants(wants, count, &t->caps, &args, &data)) < 0)
 				goto on_error;
 
 			git_vector_foreach(&t->common, j, pkt) {
@@ -405,7 +1015,7 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 		git_pkt_ack *pkt;
 		unsigned int j;
 
-		if ((error = git_pkt_buffer_wants(wants, count, &t->caps, &data)) < 0)
+		if ((error = git_pkt_buffer_wants(wants, count, &t->caps, &args, &data)) < 0)
 			goto on_error;
 
 		git_vector_foreach(&t->common, j, pkt) {
@@ -427,11 +1037,11 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 		error = GIT_EUSER;
 		goto on_error;
 	}
-	if ((error = git_smart__negotiation_step(&t->parent, data.ptr, data.size)) < 0)
+	if ((error = negotiation_step(t, &args, &data, &first)) < 0)
 		goto on_error;
 
 	git_buf_dispose(&data);
-	git_revwalk_free(walk);
+	git_negotiator_free(negotiator);
 
 	/* Now let's eat up whatever the server gives us */
 	if (!t->caps.multi_ack && !t->caps.multi_ack_detailed) {
@@ -449,7 +1059,7 @@ int git_smart__negotiate_fetch(git_transport *transport, git_repository *repo, c
 	return error;
 
 on_error:
-	git_revwalk_free(walk);
+	git_negotiator_free(negotiator);
 	git_buf_dispose(&data);
 	return error;
 }
@@ -505,6 +1115,35 @@ static int network_packetsize(size_t received, void *payload)
 	return 0;
 }
 
+/*
+ * Skip the sections of a protocol v2 fetch response up to the packfile,
+ * keeping the shallow roots of its shallow-info section.
+ */
+static int recv_packfile_section(transport_smart *t)
+{
+	git_pkt *pkt = NULL;
+	int error;
+
+	while ((error = recv_v2_pkt(&pkt, &t->buffer)) == 0) {
+		bool packfile = is_text_pkt(pkt, "packfile");
+
+		if (pkt->type == GIT_PKT_FLUSH || pkt->type == GIT_PKT_RESPONSE_END) {
+			git_error_set(GIT_ERROR_NET, "the remote did not send a packfile");
+			error = -1;
+		} else if ((pkt->type == GIT_PKT_SHALLOW || pkt->type == GIT_PKT_UNSHALLOW) &&
+		           t->owner) {
+			error = record_shallow(t, (git_pkt_shallow *)pkt);
+		}
+
+		git_pkt_free(pkt);
+
+		if (packfile || error < 0)
+			break;
+	}
+
+	return error;
+}
+
 int git_smart__download_pack(
 	git_transport *transport,
 	git_repository *repo,
@@ -535,7 +1174,10 @@ int git_smart__download_pack(
 	}
 
 	if ((error = git_repository_odb__weakptr(&odb, repo)) < 0 ||
-		((error = git_odb_write_pack(&writepack, odb, progress_cb, progress_payload)) != 0))
+		((error = git_pack_pipeline_new(&writepack, odb, progress_cb, progress_payload)) != 0))
+		goto done;
+
+	if (t->protocol_v2 && (error = recv_packfile_section(t)) < 0)
 		goto done;
 
 	/*
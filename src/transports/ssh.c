@@ -668,6 +668,13 @@ post_extract:
 
 	libssh2_channel_set_blocking(channel, 1);
 
+	/*
+	 * Ask for protocol v2; most servers only accept some environment
+	 * variables and fall back to v0 if they drop this one.
+	 */
+	if (t->owner->request_v2)
+		libssh2_channel_setenv(channel, "GIT_PROTOCOL", "version=2");
+
 	s->session = session;
 	s->channel = channel;
 
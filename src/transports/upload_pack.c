@@ -0,0 +1,1491 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "server.h"
+
+#include "git2/config.h"
+#include "git2/refs.h"
+#include "git2/revwalk.h"
+#include "git2/tag.h"
+
+#include "smart.h"
+#include "commit_list.h"
+#include "oidmap.h"
+#include "pack-objects.h"
+#include "refs.h"
+#include "repository.h"
+#include "revwalk.h"
+#include "shallow.h"
+
+/* The flags of the commits we negotiate about */
+#define THEY_HAVE    (1 << 0) /* the client has it */
+#define COMMON_KNOWN (1 << 1) /* a want that the client has an ancestor of */
+#define REACH_SEEN   (1 << 2) /* seen by the walk of `reachable` */
+
+typedef struct {
+	char *name;
+	char *symref_target;
+	git_oid id;
+	git_oid peeled;
+	unsigned has_peeled : 1;
+} upload_ref;
+
+typedef struct {
+	git_repository *repo;
+	git_server server;
+	git_upload_pack_options opts;
+	git_upload_pack_stats *stats;
+
+	/* The references we advertise, HEAD first, and their objects */
+	git_vector refs;
+	git_oidmap *tips;
+
+	unsigned allow_any_want : 1,
+		allow_reachable_want : 1,
+		allow_filter : 1;
+
+	/* What the client asks for */
+	git_array_oid_t wants;
+	git_array_oid_t client_shallow;
+	git_shallow_deepen deepen;
+	char *filter;
+
+	unsigned multi_ack : 1,
+		multi_ack_detailed : 1,
+		no_done : 1,
+		include_tag : 1,
+		done : 1;
+
+	/* The shallow roots of what we send, and the client's that are not anymore */
+	git_array_oid_t shallow;
+	git_array_oid_t unshallow;
+
+	/* The negotiation: our commits that the client has */
+	git_revwalk *walk;
+	git_array_oid_t common;
+	git_oidmap *common_objects; /* the ones that are not commits */
+	int64_t oldest_have;
+
+	/* The pack data that we did not send yet */
+	git_buf pack;
+} upload_pack;
+
+/* What the negotiation of protocol v0 ends with */
+enum {
+	SEND_PACK = 0,
+	WAIT_FOR_CLIENT = 1,
+};
+
+static void free_ref(upload_ref *ref)
+{
+	if (!ref)
+		return;
+
+	git__free(ref->name);
+	git__free(ref->symref_target);
+	git__free(ref);
+}
+
+/* Add an id to a set, which owns its keys; returns 1 if it was not in it */
+static int oidset_add(git_oidmap *set, const git_oid *id)
+{
+	git_oid *key;
+	int error;
+
+	if (git_oidmap_exists(set, id))
+		return 0;
+
+	key = git__malloc(sizeof(git_oid));
+	GIT_ERROR_CHECK_ALLOC(key);
+	git_oid_cpy(key, id);
+
+	if ((error = git_oidmap_set(set, key, key)) < 0) {
+		git__free(key);
+		return error;
+	}
+
+	return 1;
+}
+
+static void oidset_clear(git_oidmap *set)
+{
+	const git_oid *key;
+	size_t i = 0;
+
+	if (!set)
+		return;
+
+	while (git_oidmap_iterate(NULL, set, &i, &key) == 0)
+		git__free((git_oid *)key);
+
+	git_oidmap_clear(set);
+}
+
+static int add_tip(upload_pack *up, const git_oid *id)
+{
+	int error = oidset_add(up->tips, id);
+	return error < 0 ? error : 0;
+}
+
+static int add_ref(upload_pack *up, const char *name)
+{
+	git_reference *ref = NULL, *resolved = NULL;
+	git_object *obj = NULL, *peeled = NULL;
+	upload_ref *uref = NULL;
+	int error;
+
+	if ((error = git_reference_lookup(&ref, up->repo, name)) < 0 ||
+	    (error = git_reference_resolve(&resolved, ref)) < 0) {
+		/* Like an unborn HEAD, a broken reference is not advertised */
+		if (error == GIT_ENOTFOUND) {
+			git_error_clear();
+			error = 0;
+		}
+
+		goto done;
+	}
+
+	uref = git__calloc(1, sizeof(upload_ref));
+	GIT_ERROR_CHECK_ALLOC(uref);
+
+	uref->name = git__strdup(name);
+	GIT_ERROR_CHECK_ALLOC(uref->name);
+	git_oid_cpy(&uref->id, git_reference_target(resolved));
+
+	if (git_reference_type(ref) == GIT_REFERENCE_SYMBOLIC) {
+		uref->symref_target = git__strdup(git_reference_name(resolved));
+		GIT_ERROR_CHECK_ALLOC(uref->symref_target);
+	}
+
+	if ((error = git_object_lookup(&obj, up->repo, &uref->id, GIT_OBJECT_ANY)) < 0)
+		goto done;
+
+	if (git_object_type(obj) == GIT_OBJECT_TAG) {
+		if ((error = git_tag_peel(&peeled, (git_tag *)obj)) < 0)
+			goto done;
+
+		git_oid_cpy(&uref->peeled, git_object_id(peeled));
+		uref->has_peeled = 1;
+
+		if ((error = add_tip(up, &uref->peeled)) < 0)
+			goto done;
+	}
+
+	if ((error = add_tip(up, &uref->id)) < 0 ||
+	    (error = git_vector_insert(&up->refs, uref)) < 0)
+		goto done;
+
+	uref = NULL;
+
+done:
+	free_ref(uref);
+	git_object_free(peeled);
+	git_object_free(obj);
+	git_reference_free(resolved);
+	git_reference_free(ref);
+	return error;
+}
+
+static int load_refs(upload_pack *up)
+{
+	git_strarray names = {0};
+	size_t i;
+	int error;
+
+	if ((error = git_reference_list(&names, up->repo)) < 0)
+		return error;
+
+	git__tsort((void **)names.strings, names.count, &git__strcmp_cb);
+
+	if ((error = add_ref(up, GIT_HEAD_FILE)) < 0)
+		goto done;
+
+	for (i = 0; i < names.count; i++) {
+		if ((error = add_ref(up, names.strings[i])) < 0)
+			goto done;
+	}
+
+done:
+	git_strarray_free(&names);
+	return error;
+}
+
+static int config_bool(bool *out, git_config *config, const char *name)
+{
+	int value, error;
+
+	if ((error = git_config_get_bool(&value, config, name)) == GIT_ENOTFOUND) {
+		git_error_clear();
+		value = 0;
+		error = 0;
+	}
+
+	*out = (value != 0);
+	return error;
+}
+
+static int load_config(upload_pack *up)
+{
+	git_config *config;
+	bool any, reachable, filter;
+	int error;
+
+	if ((error = git_repository_config_snapshot(&config, up->repo)) < 0)
+		return error;
+
+	if ((error = config_bool(&any, config, "uploadpack.allowAnySHA1InWant")) < 0 ||
+	    (error = config_bool(&reachable, config, "uploadpack.allowReachableSHA1InWant")) < 0 ||
+	    (error = config_bool(&filter, config, "uploadpack.allowFilter")) < 0)
+		goto done;
+
+	up->allow_any_want = any;
+	up->allow_reachable_want = reachable || any;
+	up->allow_filter = filter;
+
+done:
+	git_config_free(config);
+	return error;
+}
+
+static int advertise_v0(upload_pack *up)
+{
+	git_buf caps = GIT_BUF_INIT, line = GIT_BUF_INIT;
+	char id[GIT_OID_HEXSZ + 1];
+	upload_ref *ref;
+	size_t i;
+	int error;
+
+	git_buf_puts(&caps, GIT_CAP_MULTI_ACK " " GIT_CAP_MULTI_ACK_DETAILED
+		" no-done " GIT_CAP_SIDE_BAND " " GIT_CAP_SIDE_BAND_64K
+		" no-progress " GIT_CAP_INCLUDE_TAG " " GIT_CAP_SHALLOW
+		" " GIT_CAP_DEEPEN_SINCE " " GIT_CAP_DEEPEN_RELATIVE);
+
+	if (up->allow_filter)
+		git_buf_puts(&caps, " " GIT_CAP_FILTER);
+
+	if (up->allow_reachable_want)
+		git_buf_puts(&caps, " allow-tip-sha1-in-want allow-reachable-sha1-in-want");
+
+	ref = git_vector_get(&up->refs, 0);
+
+	if (ref && !strcmp(ref->name, GIT_HEAD_FILE) && ref->symref_target)
+		git_buf_printf(&caps, " " GIT_CAP_SYMREF "=HEAD:%s", ref->symref_target);
+
+	git_buf_puts(&caps, " " GIT_SERVER_AGENT);
+
+	if (git_buf_oom(&caps)) {
+		error = -1;
+		goto done;
+	}
+
+	if (up->opts.protocol_version == 1 &&
+	    (error = git_server__line(&up->server, "version 1")) < 0)
+		goto done;
+
+	/* The capabilities follow the first reference, after a NUL */
+	if (ref)
+		git_oid_tostr(id, sizeof(id), &ref->id);
+	else
+		memset(id, '0', GIT_OID_HEXSZ), id[GIT_OID_HEXSZ] = '\0';
+
+	git_buf_printf(&line, "%s %s", id, ref ? ref->name : "capabilities^{}");
+	git_buf_putc(&line, '\0');
+	git_buf_puts(&line, caps.ptr);
+
+	if (git_buf_oom(&line) ||
+	    (error = git_buf_printf(&up->server.out, "%04x", (unsigned int)(line.size + 5))) < 0 ||
+	    (error = git_buf_put(&up->server.out, line.ptr, line.size)) < 0 ||
+	    (error = git_buf_putc(&up->server.out, '\n')) < 0) {
+		error = -1;
+		goto done;
+	}
+
+	git_vector_foreach(&up->refs, i, ref) {
+		if (i > 0 && (error = git_server__line(&up->server, "%s %s",
+				git_oid_tostr_s(&ref->id), ref->name)) < 0)
+			goto done;
+
+		if (ref->has_peeled && (error = git_server__line(&up->server, "%s %s^{}",
+				git_oid_tostr_s(&ref->peeled), ref->name)) < 0)
+			goto done;
+	}
+
+	error = git_server__flush(&up->server);
+
+done:
+	git_buf_dispose(&caps);
+	git_buf_dispose(&line);
+	return error;
+}
+
+static int advertise_v2(upload_pack *up)
+{
+	int error;
+
+	if ((error = git_server__line(&up->server, "version 2")) < 0 ||
+	    (error = git_server__line(&up->server, GIT_SERVER_AGENT)) < 0 ||
+	    (error = git_server__line(&up->server, GIT_CAP_V2_LS_REFS)) < 0 ||
+	    (error = git_server__line(&up->server, GIT_CAP_V2_FETCH "=" GIT_CAP_SHALLOW "%s",
+			up->allow_filter ? " " GIT_CAP_FILTER : "")) < 0 ||
+	    (error = git_server__line(&up->server, GIT_CAP_V2_OBJECT_FORMAT "=sha1")) < 0)
+		return error;
+
+	return git_server__flush(&up->server);
+}
+
+static int parse_id(git_oid *out, const char *hex)
+{
+	if (strlen(hex) < GIT_OID_HEXSZ ||
+	    (hex[GIT_OID_HEXSZ] != '\0' && hex[GIT_OID_HEXSZ] != ' ') ||
+	    git_oid_fromstrn(out, hex, GIT_OID_HEXSZ) < 0) {
+		git_error_set(GIT_ERROR_NET, "invalid object id '%s'", hex);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int add_id(git_array_oid_t *ids, const char *hex)
+{
+	git_oid *id = git_array_alloc(*ids);
+	GIT_ERROR_CHECK_ALLOC(id);
+
+	return parse_id(id, hex);
+}
+
+/* Whether a space-separated list of capabilities has the given one */
+static bool has_cap(const char *list, const char *cap)
+{
+	size_t len = strlen(cap);
+	const char *p;
+
+	for (p = list; (p = strstr(p, cap)) != NULL; p += len) {
+		if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+/* The side-band packets to multiplex what we send, if the client wants it */
+static void set_side_band(upload_pack *up, const char *caps)
+{
+	if (has_cap(caps, GIT_CAP_SIDE_BAND_64K))
+		up->server.side_band = GIT_SERVER_MAX_PKT;
+	else if (has_cap(caps, GIT_CAP_SIDE_BAND))
+		up->server.side_band = GIT_SERVER_SIDE_BAND_MAX;
+
+	up->server.progress = !has_cap(caps, "no-progress");
+}
+
+static int parse_depth(upload_pack *up, const char *value)
+{
+	int32_t depth;
+
+	if (git__strntol32(&depth, value, strlen(value), NULL, 10) < 0 || depth <= 0) {
+		git_error_set(GIT_ERROR_NET, "invalid depth '%s'", value);
+		return -1;
+	}
+
+	up->deepen.depth = depth;
+	return 0;
+}
+
+static int parse_since(upload_pack *up, const char *value)
+{
+	int64_t since;
+
+	if (git__strntol64(&since, value, strlen(value), NULL, 10) < 0 || since <= 0) {
+		git_error_set(GIT_ERROR_NET, "invalid deepen-since '%s'", value);
+		return -1;
+	}
+
+	up->deepen.since = (git_time_t)since;
+	return 0;
+}
+
+static int parse_filter(upload_pack *up, const char *value)
+{
+	if (!up->allow_filter) {
+		git_error_set(GIT_ERROR_NET, "filtering is not allowed");
+		return -1;
+	}
+
+	git__free(up->filter);
+	up->filter = git__strdup(value);
+	GIT_ERROR_CHECK_ALLOC(up->filter);
+
+	return 0;
+}
+
+/*
+ * Parse an argument that the fetch requests of both versions share,
+ * returning GIT_ENOTFOUND for another one.
+ */
+static int parse_fetch_arg(upload_pack *up)
+{
+	const char *value;
+
+	if (git_server__skip(&value, &up->server, "shallow "))
+		return add_id(&up->client_shallow, value);
+	else if (git_server__skip(&value, &up->server, "deepen-since "))
+		return parse_since(up, value);
+	else if (git_server__skip(&value, &up->server, "deepen-not "))
+		git_error_set(GIT_ERROR_NET, "deepen-not is not supported");
+	else if (git_server__skip(&value, &up->server, "deepen "))
+		return parse_depth(up, value);
+	else if (git_server__skip(&value, &up->server, "filter "))
+		return parse_filter(up, value);
+	else
+		return GIT_ENOTFOUND;
+
+	return -1;
+}
+
+/* Read the wants of a protocol v0 request, up to the flush */
+static int read_wants(upload_pack *up)
+{
+	const char *value;
+	int error;
+
+	while ((error = git_server__read(&up->server)) == 0) {
+		if (up->server.type == GIT_SERVER_PKT_FLUSH ||
+		    (up->server.type == GIT_SERVER_PKT_EOF && !git_array_size(up->wants)))
+			return 0;
+
+		if (git_server__skip(&value, &up->server, "want ")) {
+			/* The capabilities follow the first want */
+			if (!git_array_size(up->wants) && strlen(value) > GIT_OID_HEXSZ) {
+				const char *caps = value + GIT_OID_HEXSZ;
+
+				up->multi_ack_detailed = has_cap(caps, GIT_CAP_MULTI_ACK_DETAILED);
+				up->multi_ack = up->multi_ack_detailed || has_cap(caps, GIT_CAP_MULTI_ACK);
+				up->no_done = has_cap(caps, "no-done");
+				up->include_tag = has_cap(caps, GIT_CAP_INCLUDE_TAG);
+				up->deepen.relative = has_cap(caps, GIT_CAP_DEEPEN_RELATIVE);
+				set_side_band(up, caps);
+			}
+
+			if ((error = add_id(&up->wants, value)) < 0)
+				return error;
+
+			continue;
+		}
+
+		if ((error = parse_fetch_arg(up)) == GIT_ENOTFOUND) {
+			git_error_set(GIT_ERROR_NET, "protocol error: expected a want, got '%s'", up->server.line);
+			error = -1;
+		}
+
+		if (error < 0)
+			return error;
+	}
+
+	return error;
+}
+
+/*
+ * Remove the commits that are ancestors of one of the refs from
+ * `pending`, with a single walk that stops once all of them were found.
+ */
+static int remove_reachable(upload_pack *up, git_oidmap *pending)
+{
+	git_revwalk *walk;
+	upload_ref *ref;
+	git_oid next;
+	size_t i;
+	int error;
+
+	if ((error = git_revwalk_new(&walk, up->repo)) < 0)
+		return error;
+
+	git_vector_foreach(&up->refs, i, ref) {
+		const git_oid *tip = ref->has_peeled ? &ref->peeled : &ref->id;
+
+		if (git_revwalk_push(walk, tip) < 0)
+			git_error_clear();
+	}
+
+	while (git_oidmap_size(pending) &&
+	       (error = git_revwalk_next(&next, walk)) == 0) {
+		if (git_oidmap_exists(pending, &next))
+			git_oidmap_delete(pending, &next);
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+	git_revwalk_free(walk);
+	return error;
+}
+
+/*
+ * Make sure that the client may have the objects it wants.  The commits
+ * that are not tips are looked up in the history of the refs together.
+ */
+static int check_wants(upload_pack *up)
+{
+	git_oidmap *pending = NULL;
+	git_odb *odb;
+	git_object_t type;
+	const git_oid *id;
+	size_t i, len;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, up->repo)) < 0 ||
+	    (error = git_oidmap_new(&pending)) < 0)
+		return error;
+
+	git_array_foreach(up->wants, i, id) {
+		if (git_oidmap_exists(up->tips, id))
+			continue;
+
+		if (!up->allow_reachable_want ||
+		    git_odb_read_header(&len, &type, odb, id) < 0 ||
+		    (!up->allow_any_want && type != GIT_OBJECT_COMMIT))
+			goto not_ours;
+
+		if (!up->allow_any_want &&
+		    (error = git_oidmap_set(pending, id, (void *)id)) < 0)
+			goto done;
+	}
+
+	if (git_oidmap_size(pending) &&
+	    (error = remove_reachable(up, pending)) < 0)
+		goto done;
+
+	git_array_foreach(up->wants, i, id) {
+		if (git_oidmap_exists(pending, id))
+			goto not_ours;
+	}
+
+	git_error_clear();
+	goto done;
+
+not_ours:
+	git_error_set(GIT_ERROR_NET, "upload-pack: not our ref %s", git_oid_tostr_s(id));
+	error = -1;
+
+done:
+	git_oidmap_free(pending);
+	return error;
+}
+
+/*
+ * Find the shallow roots of what we send when the client deepens its
+ * history, and tell them to it.
+ */
+static int send_shallow(upload_pack *up, bool v2)
+{
+	const git_oid *id;
+	size_t i;
+	int error;
+
+	if (!git_shallow_deepening(&up->deepen))
+		return 0;
+
+	if ((error = git_shallow__deepen(&up->shallow, &up->unshallow, up->repo,
+			up->wants.ptr, git_array_size(up->wants),
+			&up->client_shallow, &up->deepen)) < 0)
+		return error;
+
+	if (v2 && (error = git_server__line(&up->server, "shallow-info")) < 0)
+		return error;
+
+	git_array_foreach(up->shallow, i, id) {
+		if ((error = git_server__line(&up->server, "shallow %s", git_oid_tostr_s(id))) < 0)
+			return error;
+	}
+
+	git_array_foreach(up->unshallow, i, id) {
+		if ((error = git_server__line(&up->server, "unshallow %s", git_oid_tostr_s(id))) < 0)
+			return error;
+	}
+
+	return v2 ? git_server__delim(&up->server) : git_server__flush(&up->server);
+}
+
+static int negotiation_start(upload_pack *up)
+{
+	git_revwalk_free(up->walk);
+	git_array_clear(up->common);
+	oidset_clear(up->common_objects);
+	up->oldest_have = INT64_MAX;
+
+	return git_revwalk_new(&up->walk, up->repo);
+}
+
+/*
+ * Record that the client has the object, returning 1 if we have it
+ * and did not know, 0 if we knew and GIT_ENOTFOUND if we do not have
+ * it.  Like git, the parents of a commit the client has are known to
+ * be in common too.
+ */
+static int got_have(upload_pack *up, const git_oid *id)
+{
+	git_commit_list_node *node;
+	git_object_t type;
+	git_odb *odb;
+	git_oid *common;
+	size_t len;
+	uint16_t i;
+	int error;
+
+	if ((error = git_repository_odb__weakptr(&odb, up->repo)) < 0)
+		return error;
+
+	if (git_odb_read_header(&len, &type, odb, id) < 0) {
+		git_error_clear();
+		return GIT_ENOTFOUND;
+	}
+
+	if (type == GIT_OBJECT_COMMIT) {
+		if ((node = git_revwalk__commit_lookup(up->walk, id)) == NULL ||
+		    (error = git_commit_list_parse(up->walk, node)) < 0)
+			return -1;
+
+		if (node->flags & THEY_HAVE)
+			return 0;
+
+		node->flags |= THEY_HAVE;
+
+		for (i = 0; i < node->out_degree; i++)
+			node->parents[i]->flags |= THEY_HAVE;
+
+		if (node->time < up->oldest_have)
+			up->oldest_have = node->time;
+	} else if ((error = oidset_add(up->common_objects, id)) <= 0) {
+		/* Other objects are only in common once */
+		return error;
+	}
+
+	common = git_array_alloc(up->common);
+	GIT_ERROR_CHECK_ALLOC(common);
+	git_oid_cpy(common, id);
+
+	return 1;
+}
+
+/* Whether the client has an ancestor of the commit, walking no older than its haves */
+static int reachable(bool *out, upload_pack *up, git_commit_list_node *want)
+{
+	git_array_t(git_commit_list_node *) stack = GIT_ARRAY_INIT, seen = GIT_ARRAY_INIT;
+	git_commit_list_node *node, **slot;
+	uint16_t i;
+	size_t j;
+	int error = 0;
+
+	*out = false;
+
+	slot = git_array_alloc(stack);
+	GIT_ERROR_CHECK_ALLOC(slot);
+	*slot = want;
+
+	while ((slot = git_array_pop(stack)) != NULL) {
+		node = *slot;
+
+		if ((error = git_commit_list_parse(up->walk, node)) < 0)
+			goto done;
+
+		if (node->flags & THEY_HAVE) {
+			*out = true;
+			break;
+		}
+
+		if (node->time < up->oldest_have)
+			continue;
+
+		for (i = 0; i < node->out_degree; i++) {
+			git_commit_list_node *parent = node->parents[i];
+
+			if (parent->flags & REACH_SEEN)
+				continue;
+
+			parent->flags |= REACH_SEEN;
+
+			if ((slot = git_array_alloc(seen)) == NULL ||
+			    (*slot = parent, (slot = git_array_alloc(stack)) == NULL)) {
+				git_error_set_oom();
+				error = -1;
+				goto done;
+			}
+
+			*slot = parent;
+		}
+	}
+
+done:
+	git_array_foreach(seen, j, slot)
+		(*slot)->flags &= ~REACH_SEEN;
+
+	git_array_clear(stack);
+	git_array_clear(seen);
+	return error;
+}
+
+/*
+ * Whether the client has an ancestor of each of the commits that it
+ * wants, so that it may stop telling us what it has.
+ */
+static int ok_to_give_up(bool *out, upload_pack *up)
+{
+	git_commit_list_node *node;
+	git_object_t type;
+	git_odb *odb;
+	const git_oid *id;
+	size_t i, len;
+	bool found;
+	int error;
+
+	*out = false;
+
+	if (!git_array_size(up->common))
+		return 0;
+
+	if ((error = git_repository_odb__weakptr(&odb, up->repo)) < 0)
+		return error;
+
+	git_array_foreach(up->wants, i, id) {
+		/* We cannot tell for what is not a commit */
+		if ((error = git_odb_read_header(&len, &type, odb, id)) < 0)
+			return error;
+
+		if (type != GIT_OBJECT_COMMIT)
+			continue;
+
+		if ((node = git_revwalk__commit_lookup(up->walk, id)) == NULL)
+			return -1;
+
+		if (node->flags & COMMON_KNOWN)
+			continue;
+
+		if ((error = reachable(&found, up, node)) < 0)
+			return error;
+
+		if (!found)
+			return 0;
+
+		node->flags |= COMMON_KNOWN;
+	}
+
+	*out = true;
+	return 0;
+}
+
+/*
+ * Acknowledge the haves of the client, with the ACK extensions of
+ * protocol v0 that it asked for.
+ */
+static int negotiate_v0(upload_pack *up)
+{
+	git_oid id, last;
+	const char *value;
+	bool got_common = false, got_other = false, sent_ready = false, ready;
+	int error;
+
+	if ((error = negotiation_start(up)) < 0)
+		return error;
+
+	while ((error = git_server__read(&up->server)) == 0) {
+		if (up->server.type == GIT_SERVER_PKT_FLUSH) {
+			if (up->multi_ack_detailed && got_common && !got_other) {
+				if ((error = ok_to_give_up(&ready, up)) < 0)
+					return error;
+
+				if (ready) {
+					sent_ready = true;
+
+					if ((error = git_server__line(&up->server, "ACK %s ready", git_oid_tostr_s(&last))) < 0)
+						return error;
+				}
+			}
+
+			if ((!git_array_size(up->common) || up->multi_ack) &&
+			    (error = git_server__line(&up->server, "NAK")) < 0)
+				return error;
+
+			if (up->no_done && sent_ready) {
+				if ((error = git_server__line(&up->server, "ACK %s", git_oid_tostr_s(&last))) < 0)
+					return error;
+
+				return SEND_PACK;
+			}
+
+			if ((error = git_server__send(&up->server)) < 0)
+				return error;
+
+			if (up->opts.stateless_rpc)
+				return WAIT_FOR_CLIENT;
+
+			got_common = got_other = false;
+			continue;
+		}
+
+		if (git_server__skip(&value, &up->server, "have ")) {
+			if ((error = parse_id(&id, value)) < 0)
+				return error;
+
+			if ((error = got_have(up, &id)) == GIT_ENOTFOUND) {
+				got_other = true;
+
+				if (!up->multi_ack || (error = ok_to_give_up(&ready, up)) < 0 || !ready)
+					continue;
+
+				error = git_server__line(&up->server, "ACK %s %s", value,
+					up->multi_ack_detailed ? "ready" : "continue");
+			} else if (error >= 0) {
+				got_common = true;
+				git_oid_cpy(&last, &id);
+
+				if (up->multi_ack_detailed)
+					error = git_server__line(&up->server, "ACK %s common", value);
+				else if (up->multi_ack)
+					error = git_server__line(&up->server, "ACK %s continue", value);
+				else if (git_array_size(up->common) == 1 && error == 1)
+					error = git_server__line(&up->server, "ACK %s", value);
+			}
+
+			if (error < 0)
+				return error;
+
+			continue;
+		}
+
+		if (up->server.type == GIT_SERVER_PKT_LINE && !strcmp(up->server.line, "done")) {
+			if (!git_array_size(up->common))
+				return git_server__line(&up->server, "NAK");
+
+			if (up->multi_ack)
+				return git_server__line(&up->server, "ACK %s", git_oid_tostr_s(&last));
+
+			return SEND_PACK;
+		}
+
+		if (up->server.type == GIT_SERVER_PKT_EOF) {
+			git_error_set(GIT_ERROR_NET, "early EOF");
+			return GIT_EEOF;
+		}
+
+		git_error_set(GIT_ERROR_NET, "protocol error: expected have or done, got '%s'", up->server.line);
+		return -1;
+	}
+
+	return error;
+}
+
+/* Add the wanted object, whose history the walk finds if it is a commit */
+static int want_object(git_packbuilder *pb, git_revwalk *walk, const git_oid *id)
+{
+	git_object *obj;
+	int error;
+
+	if ((error = git_object_lookup(&obj, walk->repo, id, GIT_OBJECT_ANY)) < 0)
+		return error;
+
+	if (git_object_type(obj) == GIT_OBJECT_COMMIT)
+		error = git_revwalk_push(walk, id);
+	else
+		error = git_packbuilder_insert_recur(pb, id, NULL);
+
+	git_object_free(obj);
+	return error;
+}
+
+/*
+ * Stop the walk at the shallow roots of the client and at those of
+ * the history we send, and walk from the parents of the client's
+ * roots that are not roots anymore.
+ */
+static int walk_shallow(upload_pack *up, git_revwalk *walk)
+{
+	git_commit *commit;
+	const git_oid *id;
+	size_t i, j;
+	int error;
+
+	if ((error = git_revwalk__add_shallow(walk, up->client_shallow.ptr,
+			git_array_size(up->client_shallow))) < 0 ||
+	    (error = git_revwalk__add_shallow(walk, up->shallow.ptr,
+			git_array_size(up->shallow))) < 0)
+		return error;
+
+	git_array_foreach(up->unshallow, i, id) {
+		if ((error = git_commit_lookup(&commit, up->repo, id)) < 0)
+			return error;
+
+		for (j = 0; j < git_commit_parentcount(commit) && !error; j++)
+			error = git_revwalk_push(walk, git_commit_parent_id(commit, j));
+
+		git_commit_free(commit);
+
+		if (error < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+/* Send the annotated tags of the objects that we send */
+static int include_tags(upload_pack *up, git_packbuilder *pb)
+{
+	upload_ref *ref;
+	git_object *obj;
+	git_oid id;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(&up->refs, i, ref) {
+		if (!ref->has_peeled || git__prefixcmp(ref->name, GIT_REFS_TAGS_DIR) ||
+		    !git_oidmap_exists(pb->object_ix, &ref->peeled))
+			continue;
+
+		/* Tags may point to other tags */
+		git_oid_cpy(&id, &ref->id);
+
+		while (!git_oidmap_exists(pb->object_ix, &id)) {
+			if ((error = git_object_lookup(&obj, up->repo, &id, GIT_OBJECT_TAG)) < 0)
+				return error;
+
+			if ((error = git_packbuilder_insert(pb, &id, ref->name)) == 0)
+				git_oid_cpy(&id, git_tag_target_id((git_tag *)obj));
+
+			git_object_free(obj);
+
+			if (error < 0)
+				return error;
+		}
+	}
+
+	return error;
+}
+
+static int count_objects(upload_pack *up, git_packbuilder *pb)
+{
+	git_revwalk *walk = NULL;
+	git_packbuilder_filter filter;
+	git_object_t type;
+	git_odb *odb;
+	const git_oid *id;
+	size_t i, len;
+	int error;
+
+	if (up->filter) {
+		if ((error = git_packbuilder__parse_filter(&filter, up->filter)) < 0)
+			return error;
+
+		git_packbuilder__set_filter(pb, &filter);
+	}
+
+	if ((error = git_repository_odb__weakptr(&odb, up->repo)) < 0 ||
+	    (error = git_revwalk_new(&walk, up->repo)) < 0)
+		goto done;
+
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
+
+	git_array_foreach(up->wants, i, id) {
+		if ((error = want_object(pb, walk, id)) < 0)
+			goto done;
+	}
+
+	/* The client has the history of its commits */
+	git_array_foreach(up->common, i, id) {
+		if ((error = git_odb_read_header(&len, &type, odb, id)) < 0)
+			goto done;
+
+		if (type == GIT_OBJECT_COMMIT && (error = git_revwalk_hide(walk, id)) < 0)
+			goto done;
+	}
+
+	if ((git_shallow_deepening(&up->deepen) || git_array_size(up->client_shallow)) &&
+	    (error = walk_shallow(up, walk)) < 0)
+		goto done;
+
+	if ((error = git_packbuilder_insert_walk(pb, walk)) < 0)
+		goto done;
+
+	if (up->include_tag)
+		error = include_tags(up, pb);
+
+done:
+	git_revwalk_free(walk);
+	return error;
+}
+
+static int progress(upload_pack *up, const char *fmt, ...) GIT_FORMAT_PRINTF(2, 3);
+
+static int progress(upload_pack *up, const char *fmt, ...)
+{
+	git_buf msg = GIT_BUF_INIT;
+	va_list ap;
+	int error;
+
+	if (!up->server.side_band || !up->server.progress)
+		return 0;
+
+	va_start(ap, fmt);
+	error = git_buf_vprintf(&msg, fmt, ap);
+	va_end(ap);
+
+	if (!error)
+		error = git_server__send_band(&up->server, 2, msg.ptr, msg.size);
+
+	git_buf_dispose(&msg);
+	return error;
+}
+
+/* Send the pack data in packets as large as the side-band allows */
+static int send_pack_data(upload_pack *up)
+{
+	int error;
+
+	error = git_server__send_band(&up->server, 1, up->pack.ptr, up->pack.size);
+	git_buf_clear(&up->pack);
+
+	return error;
+}
+
+static int pack_data_cb(void *buf, size_t size, void *payload)
+{
+	upload_pack *up = payload;
+	size_t max = up->server.side_band ? up->server.side_band - 5 : GIT_SERVER_MAX_PKT;
+	int error;
+
+	if ((error = git_buf_put(&up->pack, buf, size)) < 0)
+		return error;
+
+	up->stats->sent_bytes += size;
+
+	return up->pack.size >= max ? send_pack_data(up) : 0;
+}
+
+static int send_pack(upload_pack *up)
+{
+	git_packbuilder *pb = NULL;
+	double start = git__timer(), counted;
+	int error;
+
+	if ((error = git_packbuilder_new(&pb, up->repo)) < 0)
+		goto done;
+
+	git_packbuilder_set_threads(pb, up->opts.pack_threads);
+	git_packbuilder__set_reuse_deltas(pb, true);
+
+	if ((error = count_objects(up, pb)) < 0 ||
+	    (error = progress(up, "Counting objects: %" PRIuZ ", done.\n",
+			git_packbuilder_object_count(pb))) < 0)
+		goto done;
+
+	counted = git__timer();
+	up->stats->count_time += counted - start;
+
+	if ((error = git_packbuilder_foreach(pb, pack_data_cb, up)) < 0 ||
+	    (error = send_pack_data(up)) < 0 ||
+	    (error = progress(up, "Total %" PRIuZ " (reused %u deltas)\n",
+			git_packbuilder_object_count(pb), pb->nr_reused)) < 0)
+		goto done;
+
+	if (up->server.side_band)
+		error = git_server__flush(&up->server);
+
+	if (!error)
+		error = git_server__send(&up->server);
+
+	up->stats->pack_time += git__timer() - counted;
+	up->stats->sent_objects += git_packbuilder_object_count(pb);
+	up->stats->reused_deltas += pb->nr_reused;
+
+done:
+	git_packbuilder_free(pb);
+	return error;
+}
+
+/* Forget the previous request of the connection */
+static void request_clear(upload_pack *up)
+{
+	git_array_clear(up->wants);
+	git_array_clear(up->client_shallow);
+	git_array_clear(up->shallow);
+	git_array_clear(up->unshallow);
+	memset(&up->deepen, 0, sizeof(up->deepen));
+
+	git__free(up->filter);
+	up->filter = NULL;
+
+	up->multi_ack = up->multi_ack_detailed = up->no_done = 0;
+	up->include_tag = up->done = 0;
+	up->server.side_band = 0;
+	up->server.progress = 0;
+}
+
+static int serve_v0(upload_pack *up)
+{
+	double start = git__timer();
+	int error;
+
+	if (!up->opts.stateless_rpc || up->opts.advertise_refs) {
+		if ((error = advertise_v0(up)) < 0 ||
+		    (error = git_server__send(&up->server)) < 0)
+			return error;
+
+		up->stats->advertise_time += git__timer() - start;
+		start = git__timer();
+	}
+
+	if (up->opts.advertise_refs)
+		return 0;
+
+	/* A client that has everything hangs up */
+	if ((error = read_wants(up)) < 0 || !git_array_size(up->wants))
+		return error;
+
+	if ((error = check_wants(up)) < 0 ||
+	    (error = send_shallow(up, false)) < 0 ||
+	    (error = git_server__send(&up->server)) < 0 ||
+	    (error = negotiate_v0(up)) < 0)
+		return error;
+
+	up->stats->negotiate_time += git__timer() - start;
+
+	if (error == WAIT_FOR_CLIENT)
+		return 0;
+
+	if ((error = git_server__send(&up->server)) < 0 ||
+	    (error = send_pack(up)) < 0)
+		git_server__send_error(&up->server, true);
+
+	return error;
+}
+
+/*
+ * List the references for protocol v2.  The arguments, up to the flush,
+ * are optional; without them, every reference is listed, not peeled.
+ */
+static int ls_refs(upload_pack *up, bool has_args)
+{
+	git_vector prefixes = GIT_VECTOR_INIT;
+	bool symrefs = false, peel = false, match;
+	git_buf line = GIT_BUF_INIT;
+	const char *value, *prefix;
+	upload_ref *ref;
+	size_t i, j;
+	int error = 0;
+
+	while (has_args && (error = git_server__read(&up->server)) == 0 &&
+	       up->server.type == GIT_SERVER_PKT_LINE) {
+		if (!strcmp(up->server.line, "symrefs")) {
+			symrefs = true;
+		} else if (!strcmp(up->server.line, "peel")) {
+			peel = true;
+		} else if (git_server__skip(&value, &up->server, "ref-prefix ")) {
+			char *dup = git__strdup(value);
+			GIT_ERROR_CHECK_ALLOC(dup);
+
+			if ((error = git_vector_insert(&prefixes, dup)) < 0) {
+				git__free(dup);
+				goto done;
+			}
+		}
+	}
+
+	if (error < 0)
+		goto done;
+
+	if (up->server.type != GIT_SERVER_PKT_FLUSH) {
+		git_error_set(GIT_ERROR_NET, "protocol error: expected a flush");
+		error = -1;
+		goto done;
+	}
+
+	git_vector_foreach(&up->refs, i, ref) {
+		match = !prefixes.length;
+
+		git_vector_foreach(&prefixes, j, prefix) {
+			if ((match = !git__prefixcmp(ref->name, prefix)))
+				break;
+		}
+
+		if (!match)
+			continue;
+
+		git_buf_clear(&line);
+		git_buf_printf(&line, "%s %s", git_oid_tostr_s(&ref->id), ref->name);
+
+		if (symrefs && ref->symref_target)
+			git_buf_printf(&line, " symref-target:%s", ref->symref_target);
+
+		if (peel && ref->has_peeled)
+			git_buf_printf(&line, " peeled:%s", git_oid_tostr_s(&ref->peeled));
+
+		if (git_buf_oom(&line) ||
+		    (error = git_server__line(&up->server, "%s", line.ptr)) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+	error = git_server__flush(&up->server);
+
+done:
+	git_vector_free_deep(&prefixes);
+	git_buf_dispose(&line);
+	return error;
+}
+
+static int read_fetch_args(upload_pack *up, git_array_oid_t *haves)
+{
+	const char *value;
+	int error;
+
+	while ((error = git_server__read(&up->server)) == 0 &&
+	       up->server.type == GIT_SERVER_PKT_LINE) {
+		const char *line = up->server.line;
+
+		if (git_server__skip(&value, &up->server, "want "))
+			error = add_id(&up->wants, value);
+		else if (git_server__skip(&value, &up->server, "have "))
+			error = add_id(haves, value);
+		else if (!strcmp(line, "done"))
+			up->done = 1;
+		else if (!strcmp(line, GIT_CAP_INCLUDE_TAG))
+			up->include_tag = 1;
+		else if (!strcmp(line, "no-progress"))
+			up->server.progress = 0;
+		else if (!strcmp(line, GIT_CAP_DEEPEN_RELATIVE))
+			up->deepen.relative = 1;
+		else if (git_server__skip(&value, &up->server, "want-ref ")) {
+			git_error_set(GIT_ERROR_NET, "want-ref is not supported");
+			error = -1;
+		} else if ((error = parse_fetch_arg(up)) == GIT_ENOTFOUND)
+			error = 0; /* like thin-pack and ofs-delta, which we do without */
+
+		if (error < 0)
+			return error;
+	}
+
+	if (!error && up->server.type != GIT_SERVER_PKT_FLUSH) {
+		git_error_set(GIT_ERROR_NET, "protocol error: expected a flush");
+		error = -1;
+	}
+
+	return error;
+}
+
+/*
+ * Serve a fetch command, which tells the common commits found so far
+ * along with new haves: acknowledge them until we are ready to send
+ * the pack or the client is done.
+ */
+static int fetch(upload_pack *up)
+{
+	git_array_oid_t haves = GIT_ARRAY_INIT;
+	double start = git__timer();
+	const git_oid *id;
+	bool ready = false;
+	size_t i;
+	int error;
+
+	request_clear(up);
+	up->server.side_band = GIT_SERVER_MAX_PKT;
+	up->server.progress = 1;
+
+	if ((error = read_fetch_args(up, &haves)) < 0 ||
+	    (error = check_wants(up)) < 0 ||
+	    (error = negotiation_start(up)) < 0)
+		goto done;
+
+	if (!up->done &&
+	    (error = git_server__line(&up->server, "acknowledgments")) < 0)
+		goto done;
+
+	git_array_foreach(haves, i, id) {
+		if ((error = got_have(up, id)) == GIT_ENOTFOUND) {
+			error = 0;
+			continue;
+		}
+
+		if (error < 0 ||
+		    (!up->done && (error = git_server__line(&up->server, "ACK %s", git_oid_tostr_s(id))) < 0))
+			goto done;
+	}
+
+	if (!up->done) {
+		if ((!git_array_size(up->common) &&
+		     (error = git_server__line(&up->server, "NAK")) < 0) ||
+		    (error = ok_to_give_up(&ready, up)) < 0)
+			goto done;
+
+		if (!ready) {
+			error = git_server__flush(&up->server);
+			up->stats->negotiate_time += git__timer() - start;
+			goto done;
+		}
+
+		if ((error = git_server__line(&up->server, "ready")) < 0 ||
+		    (error = git_server__delim(&up->server)) < 0)
+			goto done;
+	}
+
+	if ((error = send_shallow(up, true)) < 0 ||
+	    (error = git_server__line(&up->server, "packfile")) < 0 ||
+	    (error = git_server__send(&up->server)) < 0)
+		goto done;
+
+	up->stats->negotiate_time += git__timer() - start;
+
+	if ((error = send_pack(up)) < 0)
+		git_server__send_error(&up->server, true);
+
+done:
+	git_array_clear(haves);
+	return error;
+}
+
+static int serve_v2(upload_pack *up)
+{
+	double start = git__timer();
+	char *command = NULL;
+	int error;
+
+	if (!up->opts.stateless_rpc || up->opts.advertise_refs) {
+		if ((error = advertise_v2(up)) < 0 ||
+		    (error = git_server__send(&up->server)) < 0)
+			return error;
+
+		up->stats->advertise_time += git__timer() - start;
+	}
+
+	if (up->opts.advertise_refs)
+		return 0;
+
+	do {
+		const char *value;
+
+		/* The client is done when it hangs up or flushes */
+		if ((error = git_server__read(&up->server)) < 0 ||
+		    up->server.type == GIT_SERVER_PKT_EOF ||
+		    up->server.type == GIT_SERVER_PKT_FLUSH)
+			break;
+
+		if (!git_server__skip(&value, &up->server, "command=")) {
+			git_error_set(GIT_ERROR_NET, "protocol error: expected a command, got '%s'", up->server.line);
+			error = -1;
+			break;
+		}
+
+		git__free(command);
+		command = git__strdup(value);
+		GIT_ERROR_CHECK_ALLOC(command);
+
+		/* Skip the capabilities that the client tells us */
+		while ((error = git_server__read(&up->server)) == 0 &&
+		       up->server.type == GIT_SERVER_PKT_LINE)
+			;
+
+		if (error < 0)
+			break;
+
+		if (up->server.type != GIT_SERVER_PKT_DELIM &&
+		    up->server.type != GIT_SERVER_PKT_FLUSH) {
+			git_error_set(GIT_ERROR_NET, "protocol error: expected the arguments of '%s'", command);
+			error = -1;
+			break;
+		}
+
+		if (!strcmp(command, GIT_CAP_V2_LS_REFS)) {
+			start = git__timer();
+
+			error = ls_refs(up, up->server.type == GIT_SERVER_PKT_DELIM);
+
+			up->stats->advertise_time += git__timer() - start;
+		} else if (!strcmp(command, GIT_CAP_V2_FETCH) &&
+		           up->server.type == GIT_SERVER_PKT_DELIM) {
+			error = fetch(up);
+		} else {
+			git_error_set(GIT_ERROR_NET, "unknown command '%s'", command);
+			error = -1;
+		}
+
+		if (!error)
+			error = git_server__send(&up->server);
+	} while (!error && !up->opts.stateless_rpc);
+
+	git__free(command);
+	return error;
+}
+
+int git_upload_pack_options_init(git_upload_pack_options *opts, unsigned int version)
+{
+	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
+		opts, version, git_upload_pack_options, GIT_UPLOAD_PACK_OPTIONS_INIT);
+	return 0;
+}
+
+int git_upload_pack(
+	git_repository *repo,
+	git_server_stream *stream,
+	const git_upload_pack_options *opts,
+	git_upload_pack_stats *stats)
+{
+	git_upload_pack_stats unused;
+	upload_pack *up;
+	upload_ref *ref;
+	size_t i;
+	int error;
+
+	assert(repo && stream);
+
+	GIT_ERROR_CHECK_VERSION(opts, GIT_UPLOAD_PACK_OPTIONS_VERSION, "git_upload_pack_options");
+
+	up = git__calloc(1, sizeof(upload_pack));
+	GIT_ERROR_CHECK_ALLOC(up);
+
+	up->repo = repo;
+	up->stats = stats ? stats : &unused;
+	memset(up->stats, 0, sizeof(*up->stats));
+
+	if (opts)
+		memcpy(&up->opts, opts, sizeof(up->opts));
+	else
+		git_upload_pack_options_init(&up->opts, GIT_UPLOAD_PACK_OPTIONS_VERSION);
+
+	git_server__init(&up->server, stream);
+
+	if ((error = git_oidmap_new(&up->tips)) < 0 ||
+	    (error = git_oidmap_new(&up->common_objects)) < 0 ||
+	    (error = load_config(up)) < 0 ||
+	    (error = load_refs(up)) < 0) {
+		git_server__send_error(&up->server, false);
+		goto done;
+	}
+
+	if (up->opts.protocol_version == 2)
+		error = serve_v2(up);
+	else
+		error = serve_v0(up);
+
+	/* Errors of the pack were sent on its side-band */
+	if (error < 0 && !up->server.sent)
+		git_server__send_error(&up->server, false);
+
+done:
+	git_vector_foreach(&up->refs, i, ref)
+		free_ref(ref);
+
+	oidset_clear(up->tips);
+	oidset_clear(up->common_objects);
+
+	git_vector_free(&up->refs);
+	git_oidmap_free(up->tips);
+	git_oidmap_free(up->common_objects);
+	request_clear(up);
+	git_revwalk_free(up->walk);
+	git_array_clear(up->common);
+	git_buf_dispose(&up->pack);
+	git_server__dispose(&up->server);
+	git__free(up);
+	return error;
+}
@@ -546,6 +546,13 @@ static int winhttp_stream_connect(winhttp_stream *s)
 		}
 	}
 
+	if (t->owner->request_v2 &&
+	    !WinHttpAddRequestHeaders(s->request, L"Git-Protocol: version=2", (ULONG)-1L,
+			WINHTTP_ADDREQ_FLAG_ADD | WINHTTP_ADDREQ_FLAG_REPLACE)) {
+		git_error_set(GIT_ERROR_OS, "failed to add a header to the request");
+		goto on_error;
+	}
+
 	for (i = 0; i < t->owner->custom_headers.count; i++) {
 		if (t->owner->custom_headers.strings[i]) {
 			git_buf_clear(&buf);
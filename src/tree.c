@@ -17,6 +17,8 @@
 #define DEFAULT_TREE_SIZE 16
 #define MAX_FILEMODE_BYTES 6
 
+bool git_tree__strict_parsing = true;
+
 #define TREE_ENTRY_CHECK_NAMELEN(n) \
 	if (n > UINT16_MAX) { git_error_set(GIT_ERROR_INVALID, "tree entry path too long"); }
 
@@ -154,7 +156,7 @@ static int homing_search_cmp(const void *key, const void *array_member)
  */
 static int tree_key_search(
 	size_t *at_pos,
-	const git_tree *tree,
+	const git_tree_entries *entries,
 	const char *filename,
 	size_t filename_len)
 {
@@ -171,13 +173,13 @@ static int tree_key_search(
 	 * the same prefix as the filename we're looking for */
 
 	if (git_array_search(&homing,
-		tree->entries, &homing_search_cmp, &ksearch) < 0)
+		*entries, &homing_search_cmp, &ksearch) < 0)
 		return GIT_ENOTFOUND; /* just a signal error; not passed back to user */
 
 	/* We found a common prefix. Look forward as long as
 	 * there are entries that share the common prefix */
-	for (i = homing; i < tree->entries.size; ++i) {
-		entry = git_array_get(tree->entries, i);
+	for (i = homing; i < entries->size; ++i) {
+		entry = git_array_get(*entries, i);
 
 		if (homing_search_cmp(&ksearch, entry) < 0)
 			break;
@@ -197,7 +199,7 @@ static int tree_key_search(
 		i = homing - 1;
 
 		do {
-			entry = git_array_get(tree->entries, i);
+			entry = git_array_get(*entries, i);
 
 			if (homing_search_cmp(&ksearch, entry) > 0)
 				break;
@@ -245,7 +247,12 @@ void git_tree__free(void *_tree)
 	git_tree *tree = _tree;
 
 	git_odb_object_free(tree->odb_obj);
-	git_array_clear(tree->entries);
+
+	if (tree->entries) {
+		git_array_clear(*tree->entries);
+		git__free(tree->entries);
+	}
+
 	git__free(tree);
 }
 
@@ -295,12 +302,14 @@ int git_tree_entry_to_object(
 static const git_tree_entry *entry_fromname(
 	const git_tree *tree, const char *name, size_t name_len)
 {
+	git_tree_entries *entries;
 	size_t idx;
 
-	if (tree_key_search(&idx, tree, name, name_len) < 0)
+	if ((entries = git_tree__entries(tree)) == NULL ||
+	    tree_key_search(&idx, entries, name, name_len) < 0)
 		return NULL;
 
-	return git_array_get(tree->entries, idx);
+	return git_array_get(*entries, idx);
 }
 
 const git_tree_entry *git_tree_entry_byname(
@@ -314,19 +323,29 @@ const git_tree_entry *git_tree_entry_byname(
 const git_tree_entry *git_tree_entry_byindex(
 	const git_tree *tree, size_t idx)
 {
+	git_tree_entries *entries;
+
 	assert(tree);
-	return git_array_get(tree->entries, idx);
+
+	if ((entries = git_tree__entries(tree)) == NULL)
+		return NULL;
+
+	return git_array_get(*entries, idx);
 }
 
 const git_tree_entry *git_tree_entry_byid(
 	const git_tree *tree, const git_oid *id)
 {
+	git_tree_entries *entries;
 	size_t i;
 	const git_tree_entry *e;
 
 	assert(tree);
 
-	git_array_foreach(tree->entries, i, e) {
+	if ((entries = git_tree__entries(tree)) == NULL)
+		return NULL;
+
+	git_array_foreach(*entries, i, e) {
 		if (memcmp(&e->oid->id, &id->id, sizeof(id->id)) == 0)
 			return e;
 	}
@@ -336,8 +355,14 @@ const git_tree_entry *git_tree_entry_byid(
 
 size_t git_tree_entrycount(const git_tree *tree)
 {
+	git_tree_entries *entries;
+
 	assert(tree);
-	return tree->entries.size;
+
+	if ((entries = git_tree__entries(tree)) == NULL)
+		return 0;
+
+	return entries->size;
 }
 
 size_t git_treebuilder_entrycount(git_treebuilder *bld)
@@ -375,65 +400,174 @@ static int parse_mode(uint16_t *mode_out, const char *buffer, size_t buffer_len,
 	return 0;
 }
 
-int git_tree__parse_raw(void *_tree, const char *data, size_t size)
+int git_tree__parse_entry(
+	git_tree_entry *out, const char **buffer_out, const char *buffer_end)
 {
-	git_tree *tree = _tree;
-	const char *buffer;
-	const char *buffer_end;
+	const char *buffer = *buffer_out;
+	size_t filename_len;
+	const char *nul;
+	uint16_t attr;
 
-	buffer = data;
-	buffer_end = buffer + size;
+	if (parse_mode(&attr, buffer, buffer_end - buffer, &buffer) < 0 || !buffer)
+		return tree_error("failed to parse tree: can't parse filemode", NULL);
 
-	tree->odb_obj = NULL;
-	git_array_init_to_size(tree->entries, DEFAULT_TREE_SIZE);
-	GIT_ERROR_CHECK_ARRAY(tree->entries);
+	if (buffer >= buffer_end || (*buffer++) != ' ')
+		return tree_error("failed to parse tree: missing space after filemode", NULL);
+
+	if ((nul = memchr(buffer, 0, buffer_end - buffer)) == NULL)
+		return tree_error("failed to parse tree: object is corrupted", NULL);
+
+	if ((filename_len = nul - buffer) == 0 || filename_len > UINT16_MAX)
+		return tree_error("failed to parse tree: can't parse filename", NULL);
+
+	if ((buffer_end - (nul + 1)) < GIT_OID_RAWSZ)
+		return tree_error("failed to parse tree: can't parse OID", NULL);
+
+	out->attr = attr;
+	out->filename_len = (uint16_t)filename_len;
+	out->filename = buffer;
+	out->oid = (git_oid *) ((char *) buffer + filename_len + 1);
+
+	*buffer_out = buffer + filename_len + 1 + GIT_OID_RAWSZ;
+	return 0;
+}
+
+static int validate_entries(const char *data, size_t size)
+{
+	const char *buffer = data, *buffer_end = data + size;
+	git_tree_entry entry;
 
 	while (buffer < buffer_end) {
-		git_tree_entry *entry;
-		size_t filename_len;
-		const char *nul;
-		uint16_t attr;
+		if (git_tree__parse_entry(&entry, &buffer, buffer_end) < 0)
+			return -1;
+	}
 
-		if (parse_mode(&attr, buffer, buffer_end - buffer, &buffer) < 0 || !buffer)
-			return tree_error("failed to parse tree: can't parse filemode", NULL);
+	return 0;
+}
 
-		if (buffer >= buffer_end || (*buffer++) != ' ')
-			return tree_error("failed to parse tree: missing space after filemode", NULL);
+static int parse_entries(git_tree_entries *entries, const git_tree *tree)
+{
+	const char *buffer = tree->data, *buffer_end = tree->data + tree->size;
 
-		if ((nul = memchr(buffer, 0, buffer_end - buffer)) == NULL)
-			return tree_error("failed to parse tree: object is corrupted", NULL);
+	git_array_init_to_size(*entries, DEFAULT_TREE_SIZE);
+	GIT_ERROR_CHECK_ARRAY(*entries);
 
-		if ((filename_len = nul - buffer) == 0 || filename_len > UINT16_MAX)
-			return tree_error("failed to parse tree: can't parse filename", NULL);
+	while (buffer < buffer_end) {
+		git_tree_entry *entry = git_array_alloc(*entries);
+		GIT_ERROR_CHECK_ALLOC(entry);
 
-		if ((buffer_end - (nul + 1)) < GIT_OID_RAWSZ)
-			return tree_error("failed to parse tree: can't parse OID", NULL);
+		/*
+		 * The data was validated when the tree was parsed, unless
+		 * strict parsing was disabled; in that case, keep the
+		 * entries before the first malformed one.
+		 */
+		if (git_tree__parse_entry(entry, &buffer, buffer_end) < 0) {
+			entries->size--;
+			git_error_clear();
+			break;
+		}
+	}
 
-		/* Allocate the entry */
-		{
-			entry = git_array_alloc(tree->entries);
-			GIT_ERROR_CHECK_ALLOC(entry);
+	return 0;
+}
+
+git_tree_entries *git_tree__entries(const git_tree *_tree)
+{
+	git_tree *tree = (git_tree *)_tree;
+	git_tree_entries *entries;
 
-			entry->attr = attr;
-			entry->filename_len = (uint16_t)filename_len;
-			entry->filename = buffer;
-			entry->oid = (git_oid *) ((char *) buffer + filename_len + 1);
+	if (tree->entries != NULL)
+		return tree->entries;
+
+	entries = git__calloc(1, sizeof(git_tree_entries));
+	if (!entries)
+		return NULL;
+
+	if (parse_entries(entries, tree) < 0) {
+		git_array_clear(*entries);
+		git__free(entries);
+		return NULL;
+	}
+
+	/* another thread may have indexed the tree concurrently */
+	entries = git__compare_and_swap(&tree->entries, NULL, entries);
+
+	if (entries != NULL) {
+		git_array_clear(*entries);
+		git__free(entries);
+	}
+
+	return tree->entries;
+}
+
+int git_tree__entry_byname(
+	git_tree_entry *out,
+	const git_tree *tree,
+	const char *filename,
+	size_t filename_len)
+{
+	const git_tree_entry *found;
+	const char *buffer, *buffer_end;
+	git_tree_entry entry;
+	int cmp;
+
+	if (tree->entries) {
+		if ((found = entry_fromname(tree, filename, filename_len)) == NULL)
+			return GIT_ENOTFOUND;
+
+		memcpy(out, found, sizeof(git_tree_entry));
+		return 0;
+	}
+
+	buffer = tree->data;
+	buffer_end = tree->data + tree->size;
+
+	while (buffer < buffer_end) {
+		if (git_tree__parse_entry(&entry, &buffer, buffer_end) < 0) {
+			git_error_clear();
+			break;
 		}
 
-		buffer += filename_len + 1;
-		buffer += GIT_OID_RAWSZ;
+		cmp = memcmp(entry.filename, filename,
+			min(entry.filename_len, filename_len));
+
+		if (cmp == 0 && entry.filename_len == filename_len) {
+			memcpy(out, &entry, sizeof(git_tree_entry));
+			return 0;
+		}
+
+		/*
+		 * Entries are sorted by name, with trees sorting as if
+		 * they had a trailing slash; once a name is greater than
+		 * ours in their common prefix, no later entry can match.
+		 */
+		if (cmp > 0)
+			break;
 	}
 
-	return 0;
+	return GIT_ENOTFOUND;
+}
+
+int git_tree__parse_raw(void *_tree, const char *data, size_t size)
+{
+	git_tree *tree = _tree;
+
+	tree->odb_obj = NULL;
+	tree->data = data;
+	tree->size = size;
+
+	return validate_entries(data, size);
 }
 
 int git_tree__parse(void *_tree, git_odb_object *odb_obj)
 {
 	git_tree *tree = _tree;
 
-	if ((git_tree__parse_raw(tree,
-	    git_odb_object_data(odb_obj),
-	    git_odb_object_size(odb_obj))) < 0)
+	tree->data = git_odb_object_data(odb_obj);
+	tree->size = git_odb_object_size(odb_obj);
+
+	if (git_tree__strict_parsing &&
+	    validate_entries(tree->data, tree->size) < 0)
 		return -1;
 
 	if (git_odb_object_dup(&tree->odb_obj, odb_obj) < 0)
@@ -693,9 +827,13 @@ int git_treebuilder_new(
 	}
 
 	if (source != NULL) {
+		git_tree_entries *entries;
 		git_tree_entry *entry_src;
 
-		git_array_foreach(source->entries, i, entry_src) {
+		if ((entries = git_tree__entries(source)) == NULL)
+			goto on_error;
+
+		git_array_foreach(*entries, i, entry_src) {
 			if (append_entry(
 				bld, entry_src->filename,
 				entry_src->oid,
@@ -892,7 +1030,7 @@ int git_tree_entry_bypath(
 {
 	int error = 0;
 	git_tree *subtree;
-	const git_tree_entry *entry;
+	git_tree_entry entry;
 	size_t filename_len;
 
 	/* Find how long is the current path component (i.e.
@@ -904,9 +1042,7 @@ int git_tree_entry_bypath(
 		return GIT_ENOTFOUND;
 	}
 
-	entry = entry_fromname(root, path, filename_len);
-
-	if (entry == NULL) {
+	if (git_tree__entry_byname(&entry, root, path, filename_len) < 0) {
 		git_error_set(GIT_ERROR_TREE,
 			   "the path '%.*s' does not exist in the given tree", (int) filename_len, path);
 		return GIT_ENOTFOUND;
@@ -916,7 +1052,7 @@ int git_tree_entry_bypath(
 	case '/':
 		/* If there are more components in the path...
 		 * then this entry *must* be a tree */
-		if (!git_tree_entry__is_tree(entry)) {
+		if (!git_tree_entry__is_tree(&entry)) {
 			git_error_set(GIT_ERROR_TREE,
 				   "the path '%.*s' exists but is not a tree", (int) filename_len, path);
 			return GIT_ENOTFOUND;
@@ -931,10 +1067,10 @@ int git_tree_entry_bypath(
 	case '\0':
 		/* If there are no more components in the path, return
 		 * this entry */
-		return git_tree_entry_dup(entry_out, entry);
+		return git_tree_entry_dup(entry_out, &entry);
 	}
 
-	if (git_tree_lookup(&subtree, root->object.repo, entry->oid) < 0)
+	if (git_tree_lookup(&subtree, root->object.repo, entry.oid) < 0)
 		return -1;
 
 	error = git_tree_entry_bypath(
@@ -954,11 +1090,15 @@ static int tree_walk(
 	void *payload,
 	bool preorder)
 {
+	git_tree_entries *entries;
 	int error = 0;
 	size_t i;
 	const git_tree_entry *entry;
 
-	git_array_foreach(tree->entries, i, entry) {
+	if ((entries = git_tree__entries(tree)) == NULL)
+		return -1;
+
+	git_array_foreach(*entries, i, entry) {
 		if (preorder) {
 			error = callback(path->ptr, entry, payload);
 			if (error < 0) { /* negative value stops iteration */
@@ -23,12 +23,22 @@ struct git_tree_entry {
 	const char *filename;
 };
 
+typedef git_array_t(git_tree_entry) git_tree_entries;
+
 struct git_tree {
 	git_object object;
 	git_odb_object *odb_obj;
-	git_array_t(git_tree_entry) entries;
+
+	/* raw tree data, owned by `odb_obj` or by the caller */
+	const char *data;
+	size_t size;
+
+	/* parsed entries; built on first use by `git_tree__entries` */
+	git_tree_entries *entries;
 };
 
+extern bool git_tree__strict_parsing;
+
 struct git_treebuilder {
 	git_repository *repo;
 	git_strmap *map;
@@ -43,6 +53,33 @@ void git_tree__free(void *tree);
 int git_tree__parse(void *tree, git_odb_object *obj);
 int git_tree__parse_raw(void *_tree, const char *data, size_t size);
 
+/**
+ * Parse a single entry from a raw tree buffer, advancing `buffer` past
+ * it.  The entry's filename and id point into the buffer itself, so no
+ * memory is allocated.
+ */
+int git_tree__parse_entry(
+	git_tree_entry *out, const char **buffer, const char *buffer_end);
+
+/**
+ * Get the parsed entries of a tree, indexing them on first use.  This
+ * is safe to call on a tree that is shared between threads.  Returns
+ * NULL if the entries could not be allocated.
+ */
+git_tree_entries *git_tree__entries(const git_tree *tree);
+
+/**
+ * Look up a single entry by name.  If the tree has not been indexed yet
+ * this scans the raw tree data, stopping early thanks to the tree sort
+ * order, without indexing the whole tree.  The entry points into the
+ * tree's data and is only valid as long as the tree is.
+ */
+int git_tree__entry_byname(
+	git_tree_entry *out,
+	const git_tree *tree,
+	const char *filename,
+	size_t filename_len);
+
 /**
  * Write a tree to the given repository
  */
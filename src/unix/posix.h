@@ -52,6 +52,14 @@ GIT_INLINE(int) p_fsync(int fd)
 	return fsync(fd);
 }
 
+#ifdef GIT_USE_SYNCFS
+GIT_INLINE(int) p_syncfs(int fd)
+{
+	p_fsync__cnt++;
+	return syncfs(fd);
+}
+#endif
+
 #define p_recv(s,b,l,f) recv(s,b,l,f)
 #define p_send(s,b,l,f) send(s,b,l,f)
 #define p_inet_pton(a, b, c) inet_pton(a, b, c)
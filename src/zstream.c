@@ -9,7 +9,14 @@
 
 #include <zlib.h>
 
+#ifdef GIT_LIBDEFLATE
+# include <libdeflate.h>
+#endif
+
 #include "buffer.h"
+#include "global.h"
+
+bool git_zstream__use_libdeflate = true;
 
 #define ZSTREAM_BUFFER_SIZE (1024 * 1024)
 #define ZSTREAM_BUFFER_MIN_EXTRA 8
@@ -208,3 +215,54 @@ int git_zstream_inflatebuf(git_buf *out, const void *in, size_t in_len)
 {
 	return zstream_buf(out, in, in_len, GIT_ZSTREAM_INFLATE);
 }
+
+int git_zstream_inflate_oneshot(
+	void *out, size_t out_len, size_t *in_used, const void *in, size_t in_len)
+{
+#ifdef GIT_LIBDEFLATE
+	struct libdeflate_decompressor *decompressor;
+	enum libdeflate_result result;
+	size_t out_used;
+
+	git_global_st *global;
+
+	if (!git_zstream__use_libdeflate)
+		return GIT_PASSTHROUGH;
+
+	if ((global = GIT_GLOBAL) == NULL)
+		return GIT_PASSTHROUGH;
+
+	if ((decompressor = global->decompressor) == NULL &&
+	    (decompressor = global->decompressor = libdeflate_alloc_decompressor()) == NULL) {
+		git_error_set_oom();
+		return -1;
+	}
+
+	result = libdeflate_zlib_decompress_ex(decompressor,
+		in, in_len, out, out_len, in_used, &out_used);
+
+	/* Let zlib deal with (and report) anything unexpected */
+	if (result != LIBDEFLATE_SUCCESS || out_used != out_len)
+		return GIT_PASSTHROUGH;
+
+	return 0;
+#else
+	GIT_UNUSED(out);
+	GIT_UNUSED(out_len);
+	GIT_UNUSED(in_used);
+	GIT_UNUSED(in);
+	GIT_UNUSED(in_len);
+
+	return GIT_PASSTHROUGH;
+#endif
+}
+
+void git_zstream__free_decompressor(void *decompressor)
+{
+#ifdef GIT_LIBDEFLATE
+	if (decompressor)
+		libdeflate_free_decompressor(decompressor);
+#else
+	GIT_UNUSED(decompressor);
+#endif
+}
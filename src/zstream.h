@@ -51,4 +51,21 @@ void git_zstream_reset(git_zstream *zstream);
 int git_zstream_deflatebuf(git_buf *out, const void *in, size_t in_len);
 int git_zstream_inflatebuf(git_buf *out, const void *in, size_t in_len);
 
+/*
+ * Inflate the zlib stream at the start of `in` into `out`, which must be
+ * exactly as large as the inflated data, in one go.  `in_used` is set to
+ * the length of the compressed stream.
+ *
+ * Returns GIT_PASSTHROUGH when that is not possible, because there is no
+ * one-shot inflater or because the stream does not end within `in`; the
+ * caller should then inflate it with a `git_zstream`.
+ */
+int git_zstream_inflate_oneshot(
+	void *out, size_t out_len, size_t *in_used, const void *in, size_t in_len);
+
+extern bool git_zstream__use_libdeflate;
+
+/* Free the one-shot inflater that a thread kept in its global state */
+void git_zstream__free_decompressor(void *decompressor);
+
 #endif
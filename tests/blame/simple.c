@@ -342,3 +342,104 @@ void test_blame_simple__can_restrict_to_first_parent_commits(void)
 	check_blame_hunk_index(g_repo, g_blame, 2,  6, 5, 0, "63d671eb", "b.txt");
 	check_blame_hunk_index(g_repo, g_blame, 3, 11, 5, 0, "bc7c5ac2", "b.txt");
 }
+
+typedef struct {
+	size_t lines;
+	size_t hunks;
+	int64_t last_time;
+	size_t cancel_after;
+	int cancel_with;
+} progressive_data;
+
+static int progressive_cb(const git_blame_hunk *hunk, void *payload)
+{
+	progressive_data *data = payload;
+	git_commit *commit;
+	int64_t time;
+
+	cl_git_pass(git_commit_lookup(&commit, g_repo, &hunk->final_commit_id));
+	time = git_commit_time(commit);
+	git_commit_free(commit);
+
+	/* Hunks are reported most recent commit first */
+	if (data->hunks)
+		cl_assert(time <= data->last_time);
+
+	data->last_time = time;
+	data->lines += hunk->lines_in_hunk;
+
+	if (++data->hunks == data->cancel_after)
+		return data->cancel_with ? data->cancel_with : -42;
+
+	return 0;
+}
+
+void test_blame_simple__reports_hunks_progressively(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	progressive_data data = {0};
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("blametest.git")));
+
+	opts.hunk_cb = progressive_cb;
+	opts.hunk_cb_payload = &data;
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "b.txt", &opts));
+	cl_assert_equal_i(15, data.lines);
+	cl_assert_equal_i(4, data.hunks);
+
+	cl_assert_equal_i(4, git_blame_get_hunk_count(g_blame));
+	check_blame_hunk_index(g_repo, g_blame, 0,  1, 4, 0, "da237394", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 1,  5, 1, 1, "b99f7ac0", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 2,  6, 5, 0, "63d671eb", "b.txt");
+	check_blame_hunk_index(g_repo, g_blame, 3, 11, 5, 0, "aa06ecca", "b.txt");
+}
+
+void test_blame_simple__reports_restricted_lines_progressively(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	progressive_data data = {0};
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("blametest.git")));
+
+	opts.min_line = 8;
+	opts.hunk_cb = progressive_cb;
+	opts.hunk_cb_payload = &data;
+
+	cl_git_pass(git_blame_file(&g_blame, g_repo, "b.txt", &opts));
+	cl_assert_equal_i(8, data.lines);
+	cl_assert_equal_i(2, data.hunks);
+}
+
+void test_blame_simple__can_cancel_progressive_blame(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	progressive_data data = {0};
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("blametest.git")));
+
+	data.cancel_after = 1;
+	opts.hunk_cb = progressive_cb;
+	opts.hunk_cb_payload = &data;
+
+	cl_git_fail_with(-42, git_blame_file(&g_blame, g_repo, "b.txt", &opts));
+	cl_assert_equal_i(1, data.hunks);
+	cl_assert_equal_i(5, data.lines);
+}
+
+void test_blame_simple__can_cancel_progressive_blame_with_a_positive_value(void)
+{
+	git_blame_options opts = GIT_BLAME_OPTIONS_INIT;
+	progressive_data data = {0};
+
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("blametest.git")));
+
+	data.cancel_after = 2;
+	data.cancel_with = 7;
+	opts.hunk_cb = progressive_cb;
+	opts.hunk_cb_payload = &data;
+
+	cl_git_fail_with(7, git_blame_file(&g_blame, g_repo, "b.txt", &opts));
+	cl_assert(g_blame == NULL);
+	cl_assert_equal_i(2, data.hunks);
+}
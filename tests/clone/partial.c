@@ -0,0 +1,209 @@
+#include "clar_libgit2.h"
+
+#include "git2/clone.h"
+#include "buffer.h"
+#include "path.h"
+#include "futils.h"
+
+static git_clone_options g_options;
+static git_repository *g_repo;
+
+/* Blobs of the tree of testrepo's master, with their sizes */
+#define README_ID "a8233120f6ad708f843d861ce2b7228ec4e3dec6"    /* 10 bytes */
+#define BRANCH_FILE_ID "3697d64be941a53d4ae8f6a271e4e3fa56b022cc" /* 8 bytes */
+#define NEW_TXT_ID "a71586c1dfe8a71c6cbf6c129f404c5642ff31bd"   /* 12 bytes */
+#define MASTER_TREE_ID "944c0f6e4dfa41595e6eb3ceecdb14f50fe18162"
+
+void test_clone_partial__initialize(void)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+
+	memcpy(&g_options, &opts, sizeof(git_clone_options));
+	g_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+	g_repo = NULL;
+}
+
+void test_clone_partial__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	cl_fixture_cleanup("./partial");
+}
+
+static void clone_with_filter(const char *filter, bool bare)
+{
+	g_options.fetch_opts.filter = filter;
+	g_options.bare = bare;
+
+	cl_git_pass(git_clone(&g_repo,
+		cl_git_path_url(cl_fixture("testrepo.git")), "./partial", &g_options));
+}
+
+static bool has_object(const char *sha)
+{
+	git_odb *odb;
+	git_oid id;
+	bool exists;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	exists = git_odb_exists(odb, &id);
+	git_odb_free(odb);
+
+	return exists;
+}
+
+static int count_pack(void *payload, git_buf *path)
+{
+	size_t *count = payload;
+
+	if (!git__suffixcmp(path->ptr, ".pack"))
+		(*count)++;
+
+	return 0;
+}
+
+static size_t count_packs(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	size_t count = 0;
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_path(g_repo), "objects/pack"));
+	cl_git_pass(git_path_direach(&path, 0, count_pack, &count));
+	git_buf_dispose(&path);
+
+	return count;
+}
+
+void test_clone_partial__records_the_promisor_remote(void)
+{
+	git_config *cfg;
+	git_buf buf = GIT_BUF_INIT;
+	int value;
+
+	clone_with_filter("blob:none", true);
+
+	cl_git_pass(git_repository_config_snapshot(&cfg, g_repo));
+
+	cl_git_pass(git_config_get_bool(&value, cfg, "remote.origin.promisor"));
+	cl_assert(value);
+	cl_git_pass(git_config_get_string_buf(&buf, cfg, "remote.origin.partialclonefilter"));
+	cl_assert_equal_s("blob:none", buf.ptr);
+	git_buf_clear(&buf);
+	cl_git_pass(git_config_get_string_buf(&buf, cfg, "extensions.partialclone"));
+	cl_assert_equal_s("origin", buf.ptr);
+	cl_git_pass(git_config_get_int32(&value, cfg, "core.repositoryformatversion"));
+	cl_assert_equal_i(1, value);
+
+	git_buf_dispose(&buf);
+	git_config_free(cfg);
+
+	/* The repository can be opened again */
+	git_repository_free(g_repo);
+	cl_git_pass(git_repository_open(&g_repo, "./partial"));
+}
+
+void test_clone_partial__blob_none_fetches_blobs_lazily(void)
+{
+	git_blob *blob;
+	git_oid id;
+
+	clone_with_filter("blob:none", true);
+
+	cl_assert(has_object(MASTER_TREE_ID));
+	cl_assert(!has_object(README_ID));
+	cl_assert(!has_object(NEW_TXT_ID));
+	cl_assert_equal_sz(1, count_packs());
+
+	cl_git_pass(git_oid_fromstr(&id, README_ID));
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &id));
+	cl_assert_equal_sz(10, git_blob_rawsize(blob));
+	git_blob_free(blob);
+
+	cl_assert(has_object(README_ID));
+	cl_assert(!has_object(NEW_TXT_ID));
+	cl_assert_equal_sz(2, count_packs());
+}
+
+void test_clone_partial__lazy_fetch_survives_reopening(void)
+{
+	git_blob *blob;
+	git_oid id;
+
+	clone_with_filter("blob:none", true);
+
+	git_repository_free(g_repo);
+	cl_git_pass(git_repository_open(&g_repo, "./partial"));
+
+	cl_git_pass(git_oid_fromstr(&id, NEW_TXT_ID));
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &id));
+	git_blob_free(blob);
+}
+
+void test_clone_partial__blob_limit(void)
+{
+	clone_with_filter("blob:limit=10", true);
+
+	cl_assert(has_object(BRANCH_FILE_ID));
+	cl_assert(!has_object(README_ID));
+	cl_assert(!has_object(NEW_TXT_ID));
+}
+
+void test_clone_partial__tree_depth(void)
+{
+	git_tree *tree;
+	git_oid id;
+
+	clone_with_filter("tree:0", true);
+
+	cl_assert(!has_object(MASTER_TREE_ID));
+	cl_assert(!has_object(README_ID));
+
+	/* Fetching a tree does not bring in its blobs */
+	cl_git_pass(git_oid_fromstr(&id, MASTER_TREE_ID));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+	git_tree_free(tree);
+
+	cl_assert(!has_object(README_ID));
+}
+
+void test_clone_partial__checkout_fetches_missing_blobs_at_once(void)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_buf contents = GIT_BUF_INIT;
+
+	clone_with_filter("blob:none", false);
+
+	cl_assert(has_object(README_ID));
+	cl_assert(has_object(NEW_TXT_ID));
+	cl_assert(has_object(BRANCH_FILE_ID));
+	cl_assert_equal_sz(2, count_packs());
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_workdir(g_repo), "new.txt"));
+	cl_git_pass(git_futils_readbuffer(&contents, path.ptr));
+	cl_assert_equal_s("my new file\n", contents.ptr);
+
+	git_buf_dispose(&contents);
+	git_buf_dispose(&path);
+}
+
+void test_clone_partial__later_fetches_use_the_promisor_filter(void)
+{
+	git_remote *remote;
+
+	clone_with_filter("blob:none", true);
+
+	cl_git_pass(git_remote_lookup(&remote, g_repo, "origin"));
+	cl_git_pass(git_remote_fetch(remote, NULL, NULL, NULL));
+	git_remote_free(remote);
+
+	cl_assert(!has_object(README_ID));
+}
+
+void test_clone_partial__invalid_filter(void)
+{
+	g_options.fetch_opts.filter = "sparse:oid=master";
+
+	cl_git_fail(git_clone(&g_repo,
+		cl_git_path_url(cl_fixture("testrepo.git")), "./partial", &g_options));
+}
@@ -0,0 +1,188 @@
+#include "clar_libgit2.h"
+
+#include "git2/clone.h"
+#include "buffer.h"
+#include "futils.h"
+
+static git_clone_options g_options;
+static git_repository *g_repo;
+
+/*
+ * The history of testrepo's master: a65fedf merges 9fd738e and
+ * c47800c, which both descend from 5b5b025.
+ */
+#define A65FEDF_ID "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"
+#define BE3563A_ID "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"
+#define BE3563A_TIME 1274813907
+#define C47800C_ID "c47800c7266a2be04c571c04d5a6614691ea99bd"
+#define NINEFD738_ID "9fd738e8f7967c078dceed8190330fc8648ee56a"
+
+/* Only fetch master, so that the other branches do not add roots */
+static int master_remote_create(
+	git_remote **out,
+	git_repository *repo,
+	const char *name,
+	const char *url,
+	void *payload)
+{
+	GIT_UNUSED(payload);
+
+	return git_remote_create_with_fetchspec(out, repo, name, url,
+		"+refs/heads/master:refs/remotes/origin/master");
+}
+
+void test_clone_shallow__initialize(void)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+
+	memcpy(&g_options, &opts, sizeof(git_clone_options));
+	g_options.bare = true;
+	g_options.remote_cb = master_remote_create;
+	g_repo = NULL;
+}
+
+void test_clone_shallow__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+	cl_fixture_cleanup("./shallow");
+}
+
+static void clone_repo(void)
+{
+	cl_git_pass(git_clone(&g_repo,
+		cl_git_path_url(cl_fixture("testrepo.git")), "./shallow", &g_options));
+}
+
+static void fetch(const git_fetch_options *opts)
+{
+	git_remote *remote;
+
+	cl_git_pass(git_remote_lookup(&remote, g_repo, "origin"));
+	cl_git_pass(git_remote_fetch(remote, NULL, opts, NULL));
+	git_remote_free(remote);
+}
+
+static size_t count_commits(void)
+{
+	git_revwalk *walk;
+	git_oid id;
+	size_t count = 0;
+	int error;
+
+	cl_git_pass(git_revwalk_new(&walk, g_repo));
+	cl_git_pass(git_revwalk_push_head(walk));
+
+	while ((error = git_revwalk_next(&id, walk)) == 0)
+		count++;
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	git_revwalk_free(walk);
+
+	return count;
+}
+
+static void assert_shallow_file(const char *expected)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_path(g_repo), "shallow"));
+
+	if (expected) {
+		cl_git_pass(git_futils_readbuffer(&contents, path.ptr));
+		cl_assert_equal_s(expected, contents.ptr);
+	} else {
+		cl_assert(!git_path_exists(path.ptr));
+	}
+
+	git_buf_dispose(&contents);
+	git_buf_dispose(&path);
+}
+
+void test_clone_shallow__depth(void)
+{
+	g_options.fetch_opts.depth = 2;
+	clone_repo();
+
+	cl_assert_equal_i(1, git_repository_is_shallow(g_repo));
+	assert_shallow_file(BE3563A_ID "\n");
+	cl_assert_equal_sz(2, count_commits());
+}
+
+void test_clone_shallow__depth_of_one(void)
+{
+	g_options.fetch_opts.depth = 1;
+	clone_repo();
+
+	assert_shallow_file(A65FEDF_ID "\n");
+	cl_assert_equal_sz(1, count_commits());
+}
+
+void test_clone_shallow__deeper_than_the_history(void)
+{
+	g_options.fetch_opts.depth = 100;
+	clone_repo();
+
+	cl_assert_equal_i(0, git_repository_is_shallow(g_repo));
+	cl_assert_equal_sz(7, count_commits());
+}
+
+void test_clone_shallow__since(void)
+{
+	g_options.fetch_opts.shallow_since = BE3563A_TIME;
+	clone_repo();
+
+	assert_shallow_file(BE3563A_ID "\n");
+	cl_assert_equal_sz(2, count_commits());
+}
+
+void test_clone_shallow__deepen(void)
+{
+	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+
+	g_options.fetch_opts.depth = 2;
+	clone_repo();
+
+	opts.deepen = 1;
+	fetch(&opts);
+
+	assert_shallow_file(NINEFD738_ID "\n" C47800C_ID "\n");
+	cl_assert_equal_sz(4, count_commits());
+}
+
+void test_clone_shallow__unshallow(void)
+{
+	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+
+	g_options.fetch_opts.depth = 1;
+	clone_repo();
+
+	opts.depth = GIT_FETCH_DEPTH_UNSHALLOW;
+	fetch(&opts);
+
+	cl_assert_equal_i(0, git_repository_is_shallow(g_repo));
+	assert_shallow_file(NULL);
+	cl_assert_equal_sz(7, count_commits());
+}
+
+void test_clone_shallow__fetch_keeps_the_shallow_roots(void)
+{
+	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+
+	g_options.fetch_opts.depth = 2;
+	clone_repo();
+
+	fetch(&opts);
+
+	assert_shallow_file(BE3563A_ID "\n");
+	cl_assert_equal_sz(2, count_commits());
+}
+
+void test_clone_shallow__conflicting_options(void)
+{
+	g_options.fetch_opts.depth = 1;
+	g_options.fetch_opts.deepen = 1;
+
+	cl_git_fail(git_clone(&g_repo,
+		cl_git_path_url(cl_fixture("testrepo.git")), "./shallow", &g_options));
+}
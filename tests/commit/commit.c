@@ -116,8 +116,9 @@ void assert_commit_summary(const char *expected, const char *given)
 	git_commit *dummy;
 
 	cl_assert(dummy = git__calloc(1, sizeof(struct git_commit)));
+	cl_assert(dummy->details = git__calloc(1, sizeof(git_commit_details)));
 
-	dummy->raw_message = git__strdup(given);
+	dummy->details->raw_message = git__strdup(given);
 	cl_assert_equal_s(expected, git_commit_summary(dummy));
 
 	git_commit__free(dummy);
@@ -128,8 +129,9 @@ void assert_commit_body(const char *expected, const char *given)
 	git_commit *dummy;
 
 	cl_assert(dummy = git__calloc(1, sizeof(struct git_commit)));
+	cl_assert(dummy->details = git__calloc(1, sizeof(git_commit_details)));
 
-	dummy->raw_message = git__strdup(given);
+	dummy->details->raw_message = git__strdup(given);
 	cl_assert_equal_s(expected, git_commit_body(dummy));
 
 	git_commit__free(dummy);
@@ -274,18 +274,23 @@ a simple commit which works",
 static int parse_commit(git_commit **out, const char *buffer)
 {
 	git_commit *commit;
-	git_odb_object fake_odb_object;
+	git_odb_object *fake_odb_object;
 	int error;
 
 	commit = (git_commit*)git__malloc(sizeof(git_commit));
 	memset(commit, 0x0, sizeof(git_commit));
 	commit->object.repo = g_repo;
 
-	memset(&fake_odb_object, 0x0, sizeof(git_odb_object));
-	fake_odb_object.buffer = (char *)buffer;
-	fake_odb_object.cached.size = strlen(fake_odb_object.buffer);
+	/* the commit may keep the object to parse its details later */
+	fake_odb_object = git__calloc(1, sizeof(git_odb_object));
+	cl_assert(fake_odb_object);
+	fake_odb_object->buffer = git__strdup(buffer);
+	fake_odb_object->cached.size = strlen(fake_odb_object->buffer);
+	fake_odb_object->cached.flags = GIT_CACHE_STORE_RAW;
+	fake_odb_object->cached.refcount.val = 1;
 
-	error = git_commit__parse(commit, &fake_odb_object);
+	error = git_commit__parse(commit, fake_odb_object);
+	git_odb_object_free(fake_odb_object);
 
 	*out = commit;
 	return error;
@@ -375,6 +380,92 @@ void test_commit_parse__details0(void) {
 	}
 }
 
+void test_commit_parse__details_are_parsed_lazily(void)
+{
+	git_oid id;
+	git_commit *commit;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	cl_git_pass(git_commit_lookup(&commit, g_repo, &id));
+
+	cl_assert(commit->details == NULL);
+	cl_assert_equal_i(1, git_commit_parentcount(commit));
+	cl_assert(commit->details == NULL);
+
+	cl_assert_equal_s("Scott Chacon", git_commit_author(commit)->name);
+	cl_assert(commit->details != NULL);
+	cl_assert(git_commit_time(commit) > 0);
+	cl_assert(git_commit_message(commit) != NULL);
+
+	git_commit_free(commit);
+}
+
+static int lookup_written_commit(git_commit **out, const char *buffer)
+{
+	git_odb *odb;
+	git_oid id;
+	int error;
+
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_odb_write(&id, odb, buffer, strlen(buffer), GIT_OBJECT_COMMIT));
+	error = git_commit_lookup(out, g_repo, &id);
+	git_odb_free(odb);
+
+	return error;
+}
+
+void test_commit_parse__lookup_fails_on_malformed_details(void)
+{
+	const char *broken[] = {
+"tree 1810dff58d8a660512d4832e740f692884338ccd\n\
+author Vicent Marti tanoku@gmail.com\n\
+committer Vicent Marti <tanoku@gmail.com> 1273848544 +0200\n\
+\n\
+a commit with a broken author\n",
+"tree 1810dff58d8a660512d4832e740f692884338ccd\n\
+author Vicent Marti <tanoku@gmail.com> 1273848544 +0200\n\
+author Helpful Coworker helpful@coworker 1273848544 +0200\n\
+committer Vicent Marti <tanoku@gmail.com> 1273848544 +0200\n\
+\n\
+a commit with a broken extra author\n",
+"tree 1810dff58d8a660512d4832e740f692884338ccd\n\
+author Vicent Marti <tanoku@gmail.com> 1273848544 +0200\n\
+committer Vicent Marti <tanoku@gmail.com> 99999999999999999999 +0200\n\
+\n\
+a commit with a broken commit time\n",
+	};
+	git_commit *commit;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(broken); i++)
+		cl_git_fail(lookup_written_commit(&commit, broken[i]));
+}
+
+void test_commit_parse__lazy_details_of_looked_up_commits(void)
+{
+	git_commit *commit;
+	git_buf buf = GIT_BUF_INIT;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(passing_commit_cases); i++) {
+		cl_git_pass(lookup_written_commit(&commit, passing_commit_cases[i]));
+		cl_assert(commit->details == NULL);
+
+		cl_assert(git_commit_author(commit) != NULL);
+		cl_assert(git_commit_committer(commit) != NULL);
+		cl_assert(git_commit_raw_header(commit) != NULL);
+		cl_assert(git_commit_message(commit) != NULL);
+		cl_assert(git_commit_summary(commit) != NULL);
+		cl_assert(git_commit_time(commit) > 0);
+		cl_git_pass(git_commit_header_field(&buf, commit, "tree"));
+
+		git_buf_clear(&buf);
+		git_commit_free(commit);
+	}
+
+	git_buf_dispose(&buf);
+}
+
 void test_commit_parse__leading_lf(void)
 {
 	git_commit *commit;
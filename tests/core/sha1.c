@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "hash.h"
+#include "futils.h"
 
 #define FIXTURE_DIR "sha1"
 
@@ -10,6 +11,9 @@ void test_core_sha1__initialize(void)
 
 void test_core_sha1__cleanup(void)
 {
+#ifdef GIT_SHA1_COLLISIONDETECT
+	cl_git_pass(git_hash_sha1_global_init());
+#endif
 	cl_fixture_cleanup(FIXTURE_DIR);
 }
 
@@ -62,3 +66,189 @@ void test_core_sha1__detect_collision_attack(void)
 #endif
 }
 
+
+static unsigned char *sha1_test_data(size_t len)
+{
+	unsigned char *data = git__malloc(len);
+	size_t i;
+
+	cl_assert(data);
+
+	for (i = 0; i < len; i++)
+		data[i] = (unsigned char)((i * 7) + (i >> 8));
+
+	return data;
+}
+
+static void assert_sha1_chunked(const char *expected_str, const unsigned char *data, size_t len, size_t chunk)
+{
+	git_hash_ctx ctx;
+	git_oid oid, expected;
+	size_t i;
+
+	cl_git_pass(git_oid_fromstr(&expected, expected_str));
+	cl_git_pass(git_hash_ctx_init(&ctx));
+
+	for (i = 0; i < len; i += chunk)
+		cl_git_pass(git_hash_update(&ctx, data + i, min(chunk, len - i)));
+
+	cl_git_pass(git_hash_final(&oid, &ctx));
+	cl_assert_equal_oid(&expected, &oid);
+
+	git_hash_ctx_cleanup(&ctx);
+}
+
+void test_core_sha1__sum_lengths(void)
+{
+	static const struct {
+		size_t len;
+		const char *sha1;
+	} expected[] = {
+		{ 0, "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+		{ 55, "aecd1643c9903b9bae8cb94f53c50f8a4e18605b" },
+		{ 56, "f5d65c621c02cc8e785159feff8088e3072da1bc" },
+		{ 63, "4952f0fe097e4d6410ae9eab4855aa836caf3bff" },
+		{ 64, "1e17ae1fc093e5daca033553c97a5192ca164486" },
+		{ 65, "ac44f5dbe3e9b5d2733fc9537fcad715c3c20bc3" },
+		{ 119, "b4a4e69060d0b1e7e8ebbf7041a4211c63438b57" },
+		{ 120, "b651390c2996406336a3f6647e4b590c18cdd6f8" },
+		{ 128, "516846cd40bd1fe431119c3b0a0f362957992ee8" },
+	};
+	unsigned char *data = sha1_test_data(128);
+	git_oid oid, sha1;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++) {
+		cl_git_pass(git_oid_fromstr(&sha1, expected[i].sha1));
+		cl_git_pass(git_hash_buf(&oid, data, expected[i].len));
+		cl_assert_equal_oid(&sha1, &oid);
+	}
+
+	git__free(data);
+}
+
+void test_core_sha1__sum_in_chunks(void)
+{
+	const char *expected = "557878b8118e7a9bdc75bcfc419f9b082ce073e6";
+	size_t chunks[] = { 1, 13, 63, 64, 65, 1000, 4096, 100000 };
+	unsigned char *data = sha1_test_data(100000);
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(chunks); i++)
+		assert_sha1_chunked(expected, data, 100000, chunks[i]);
+
+	git__free(data);
+}
+
+void test_core_sha1__sum_many(void)
+{
+	size_t n = 37, i;
+	unsigned char *data = sha1_test_data(4096);
+	git_buf_vec *vecs = git__calloc(n * 2, sizeof(git_buf_vec));
+	git_hash_input *in = git__calloc(n, sizeof(git_hash_input));
+	git_oid *oids = git__calloc(n, sizeof(git_oid)), expected;
+
+	cl_assert(vecs && in && oids);
+
+	for (i = 0; i < n; i++) {
+		vecs[i * 2].data = data + i;
+		vecs[i * 2].len = i % 11;
+		vecs[i * 2 + 1].data = data + 64 + i;
+		vecs[i * 2 + 1].len = (i * 97) % 1500;
+
+		in[i].vec = &vecs[i * 2];
+		in[i].len = 2;
+	}
+
+	cl_git_pass(git_hash_many(oids, in, n));
+
+	for (i = 0; i < n; i++) {
+		cl_git_pass(git_hash_vec(&expected, in[i].vec, in[i].len));
+		cl_assert_equal_oid(&expected, &oids[i]);
+	}
+
+	git__free(oids);
+	git__free(in);
+	git__free(vecs);
+	git__free(data);
+}
+
+void test_core_sha1__detect_collision_attack_many(void)
+{
+	git_buf contents = GIT_BUF_INIT;
+	git_buf_vec vecs[4];
+	git_hash_input in[4];
+	git_oid oids[4], expected;
+	size_t i;
+
+	cl_git_pass(git_futils_readbuffer(&contents, FIXTURE_DIR "/shattered-1.pdf"));
+
+	for (i = 0; i < 4; i++) {
+		vecs[i].data = contents.ptr;
+		vecs[i].len = (i == 2) ? contents.size : 1000;
+		in[i].vec = &vecs[i];
+		in[i].len = 1;
+	}
+
+#ifdef GIT_SHA1_COLLISIONDETECT
+	GIT_UNUSED(expected);
+	cl_git_fail(git_hash_many(oids, in, 4));
+	cl_assert_equal_s("SHA1 collision attack detected", git_error_last()->message);
+#else
+	cl_git_pass(git_hash_many(oids, in, 4));
+	git_oid_fromstr(&expected, "38762cf7f55934b34d179ae6a4c80cadccbb7f0a");
+	cl_assert_equal_oid(&expected, &oids[2]);
+#endif
+
+	git_buf_dispose(&contents);
+}
+
+void test_core_sha1__sum_many_on_lanes_like_sha1dc(void)
+{
+#ifdef GIT_SHA1_COLLISIONDETECT
+	size_t n = 53, i;
+	unsigned char *data;
+	git_buf_vec *vecs;
+	git_hash_input *in;
+	git_oid *oids, expected;
+
+	if (git_hash_sha1__set_kernels(false, true) == GIT_ENOTFOUND)
+		cl_skip();
+
+	data = sha1_test_data(8192);
+	vecs = git__calloc(n * 3, sizeof(git_buf_vec));
+	in = git__calloc(n, sizeof(git_hash_input));
+	oids = git__calloc(n, sizeof(git_oid));
+	cl_assert(vecs && in && oids);
+
+	/* Lengths around the block size and its padding, and larger ones */
+	for (i = 0; i < n; i++) {
+		vecs[i * 3].data = data + i;
+		vecs[i * 3].len = i % 3;
+		vecs[i * 3 + 1].data = data + 128 + i;
+		vecs[i * 3 + 1].len = (i < 30) ? 40 + i : (i * 131) % 4000;
+		vecs[i * 3 + 2].data = data + 4096 + i;
+		vecs[i * 3 + 2].len = i % 5;
+
+		in[i].vec = &vecs[i * 3];
+		in[i].len = 3;
+	}
+
+	cl_git_pass(git_hash_many(oids, in, n));
+
+	/* And again with sha1dc alone */
+	cl_git_pass(git_hash_sha1__set_kernels(false, false));
+
+	for (i = 0; i < n; i++) {
+		cl_git_pass(git_hash_vec(&expected, in[i].vec, in[i].len));
+		cl_assert_equal_oid(&expected, &oids[i]);
+	}
+
+	git__free(oids);
+	git__free(in);
+	git__free(vecs);
+	git__free(data);
+#else
+	cl_skip();
+#endif
+}
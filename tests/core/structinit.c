@@ -3,6 +3,7 @@
 #include <git2/sys/filter.h>
 #include <git2/sys/odb_backend.h>
 #include <git2/sys/refdb_backend.h>
+#include <git2/sys/server.h>
 #include <git2/sys/transport.h>
 
 #define STRINGIFY(s) #s
@@ -185,4 +186,19 @@ void test_core_structinit__compare(void)
 	CHECK_MACRO_FUNC_INIT_EQUAL( \
 		git_diff_patchid_options, GIT_DIFF_PATCHID_OPTIONS_VERSION, \
 		GIT_DIFF_PATCHID_OPTIONS_INIT, git_diff_patchid_options_init);
+
+	/* transaction */
+	CHECK_MACRO_FUNC_INIT_EQUAL( \
+		git_transaction_options, GIT_TRANSACTION_OPTIONS_VERSION, \
+		GIT_TRANSACTION_OPTIONS_INIT, git_transaction_options_init);
+
+	/* upload-pack */
+	CHECK_MACRO_FUNC_INIT_EQUAL( \
+		git_upload_pack_options, GIT_UPLOAD_PACK_OPTIONS_VERSION, \
+		GIT_UPLOAD_PACK_OPTIONS_INIT, git_upload_pack_options_init);
+
+	/* receive-pack */
+	CHECK_MACRO_FUNC_INIT_EQUAL( \
+		git_receive_pack_options, GIT_RECEIVE_PACK_OPTIONS_VERSION, \
+		GIT_RECEIVE_PACK_OPTIONS_INIT, git_receive_pack_options_init);
 }
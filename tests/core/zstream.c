@@ -166,3 +166,36 @@ void test_core_zstream__big_data(void)
 
 	git_buf_dispose(&in);
 }
+
+void test_core_zstream__inflate_oneshot(void)
+{
+	git_buf z = GIT_BUF_INIT;
+	size_t len = strlen(data), in_used;
+	char out[64];
+	int error;
+
+	cl_git_pass(git_zstream_deflatebuf(&z, data, len));
+	cl_git_pass(git_buf_puts(&z, "trailing data"));
+
+	error = git_zstream_inflate_oneshot(out, len, &in_used, z.ptr, z.size);
+
+#ifdef GIT_LIBDEFLATE
+	cl_git_pass(error);
+	cl_assert_equal_i(z.size - strlen("trailing data"), in_used);
+	cl_assert(memcmp(out, data, len) == 0);
+
+	/* The stream must end within the input, at the given length */
+	cl_assert_equal_i(GIT_PASSTHROUGH,
+		git_zstream_inflate_oneshot(out, len, &in_used, z.ptr, in_used - 1));
+	cl_assert_equal_i(GIT_PASSTHROUGH,
+		git_zstream_inflate_oneshot(out, len - 1, &in_used, z.ptr, z.size));
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LIBDEFLATE, 0));
+	error = git_zstream_inflate_oneshot(out, len, &in_used, z.ptr, z.size);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LIBDEFLATE, 1));
+#endif
+
+	cl_assert_equal_i(GIT_PASSTHROUGH, error);
+
+	git_buf_dispose(&z);
+}
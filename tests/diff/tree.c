@@ -524,3 +524,98 @@ void test_diff_tree__diff_configs(void)
 	cl_assert_equal_i(7, expect.line_adds);
 	cl_assert_equal_i(15, expect.line_dels);
 }
+
+static void assert_diff_trees_matches(git_tree *old_tree, git_tree *new_tree)
+{
+	const char **names;
+	int *statuses;
+	size_t i, count;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+
+	count = git_diff_num_deltas(diff);
+	names = git__calloc(count + 1, sizeof(char *));
+	statuses = git__calloc(count + 1, sizeof(int));
+	cl_assert(names && statuses);
+
+	for (i = 0; i < count; i++) {
+		const git_diff_delta *delta = git_diff_get_delta(diff, i);
+		names[i] = delta->old_file.path;
+		statuses[i] = delta->status;
+	}
+
+	memset(&expect, 0, sizeof(expect));
+	expect.names = names;
+	expect.statuses = statuses;
+
+	cl_git_pass(git_diff_trees(g_repo, old_tree, new_tree, diff_file_cb, &expect));
+	cl_assert_equal_i(count, expect.files);
+
+	git__free(names);
+	git__free(statuses);
+	git_diff_free(diff);
+	diff = NULL;
+}
+
+void test_diff_tree__trees_matches_tree_to_tree(void)
+{
+	const char *commits[] = {
+		"6bab5c79cd5140d0", "605812ab7fe421fdd", "370fe9ec22",
+		"f5b0af1fb4f5c", "a97cc019851"
+	};
+	git_tree *trees[ARRAY_SIZE(commits)];
+	size_t i, j;
+
+	g_repo = cl_git_sandbox_init("attr");
+
+	for (i = 0; i < ARRAY_SIZE(commits); i++)
+		cl_assert((trees[i] = resolve_commit_oid_to_tree(g_repo, commits[i])) != NULL);
+
+	for (i = 0; i < ARRAY_SIZE(commits); i++) {
+		assert_diff_trees_matches(NULL, trees[i]);
+		assert_diff_trees_matches(trees[i], NULL);
+
+		for (j = 0; j < ARRAY_SIZE(commits); j++)
+			assert_diff_trees_matches(trees[i], trees[j]);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(commits); i++)
+		git_tree_free(trees[i]);
+}
+
+void test_diff_tree__trees_recurses_into_changed_subtrees(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "a65fedf")) != NULL);
+	cl_assert((b = resolve_commit_oid_to_tree(g_repo, "763d71a")) != NULL);
+
+	assert_diff_trees_matches(a, b);
+	cl_assert_equal_i(7, expect.files);
+	cl_assert_equal_i(4, expect.file_status[GIT_DELTA_ADDED]);
+	cl_assert_equal_i(3, expect.file_status[GIT_DELTA_MODIFIED]);
+
+	assert_diff_trees_matches(b, a);
+	cl_assert_equal_i(7, expect.files);
+	cl_assert_equal_i(4, expect.file_status[GIT_DELTA_DELETED]);
+	cl_assert_equal_i(3, expect.file_status[GIT_DELTA_MODIFIED]);
+}
+
+static int abort_diff_trees_cb(
+	const git_diff_delta *delta, float progress, void *payload)
+{
+	GIT_UNUSED(delta);
+	GIT_UNUSED(progress);
+	GIT_UNUSED(payload);
+	return 42;
+}
+
+void test_diff_tree__trees_can_be_aborted(void)
+{
+	g_repo = cl_git_sandbox_init("attr");
+
+	cl_assert((a = resolve_commit_oid_to_tree(g_repo, "605812a")) != NULL);
+	cl_assert((b = resolve_commit_oid_to_tree(g_repo, "370fe9ec22")) != NULL);
+
+	cl_git_fail_with(42, git_diff_trees(g_repo, a, b, abort_diff_trees_cb, NULL));
+}
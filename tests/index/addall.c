@@ -496,3 +496,61 @@ void test_index_addall__removes_deleted_conflicted_files(void)
 	git_reference_free(ref);
 	git_index_free(index);
 }
+
+void test_index_addall__many_files(void)
+{
+	git_index *index;
+	git_odb *odb;
+	const git_index_entry *entry;
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	git_oid expected;
+	size_t i;
+
+	g_repo = cl_git_sandbox_init_new(TEST_DIR);
+
+	cl_git_mkfile(TEST_DIR "/.gitattributes", "*.txt text eol=lf\n");
+	cl_git_mkfile(TEST_DIR "/crlf.txt", "one\r\ntwo\r\n");
+
+	for (i = 0; i < 100; i++) {
+		git_buf_clear(&path);
+		git_buf_clear(&contents);
+		cl_git_pass(git_buf_printf(&path, TEST_DIR "/file%03d", (int)i));
+		cl_git_pass(git_buf_printf(&contents, "file %d\n", (int)i));
+		cl_git_pass(git_buf_puts(&contents, "some more content\n"));
+		cl_git_rewritefile(path.ptr, contents.ptr);
+	}
+
+	git_buf_clear(&contents);
+	for (i = 0; i < 100000; i++)
+		cl_git_pass(git_buf_putc(&contents, 'a' + (i % 26)));
+	cl_git_rewritefile(TEST_DIR "/large", contents.ptr);
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_git_pass(git_index_write(index));
+
+	cl_assert_equal_i(103, git_index_entrycount(index));
+	check_status(g_repo, 103, 0, 0, 0, 0, 0, 0, 0);
+
+	for (i = 0; i < 100; i++) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "file%03d", (int)i));
+		cl_assert((entry = git_index_get_bypath(index, path.ptr, 0)) != NULL);
+
+		cl_git_pass(git_buf_joinpath(&path, TEST_DIR, entry->path));
+		cl_git_pass(git_odb_hashfile(&expected, path.ptr, GIT_OBJECT_BLOB));
+		cl_assert_equal_oid(&expected, &entry->id);
+		cl_assert(git_odb_exists(odb, &entry->id));
+		check_stat_data(index, path.ptr, true);
+	}
+
+	cl_assert((entry = git_index_get_bypath(index, "crlf.txt", 0)) != NULL);
+	cl_git_pass(git_odb_hash(&expected, "one\ntwo\n", 8, GIT_OBJECT_BLOB));
+	cl_assert_equal_oid(&expected, &entry->id);
+
+	git_buf_dispose(&contents);
+	git_buf_dispose(&path);
+	git_odb_free(odb);
+	git_index_free(index);
+}
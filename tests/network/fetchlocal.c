@@ -510,3 +510,156 @@ void test_network_fetchlocal__prune_load_fetch_prune_config(void)
 	git_remote_free(origin);
 	git_repository_free(repo);
 }
+
+static bool pack_exists(git_repository *repo, const char *name)
+{
+	git_buf path = GIT_BUF_INIT;
+	bool exists;
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_path(repo), "objects/pack"));
+	cl_git_pass(git_buf_joinpath(&path, path.ptr, name));
+	exists = git_path_exists(path.ptr);
+
+	git_buf_dispose(&path);
+	return exists;
+}
+
+static void assert_object_exists(git_repository *repo, const char *id)
+{
+	git_object *obj;
+
+	cl_git_pass(git_revparse_single(&obj, repo, id));
+	git_object_free(obj);
+}
+
+void test_network_fetchlocal__copies_the_wanted_packs(void)
+{
+	git_repository *repo;
+	git_remote *remote;
+	const git_indexer_progress *stats;
+	char *allrefs = "+refs/*:refs/*";
+	git_strarray refspecs = {
+		&allrefs,
+		1,
+	};
+
+	cl_git_pass(git_repository_init(&repo, "./foo.git", true));
+	cl_set_cleanup(cleanup_local_repo, "foo.git");
+
+	cl_git_pass(git_remote_create_anonymous(&remote, repo, cl_git_fixture_url("testrepo.git")));
+	cl_git_pass(git_remote_fetch(remote, &refspecs, NULL, NULL));
+
+	/* Everything in these two is wanted, nothing in the first one */
+	cl_assert(pack_exists(repo, "pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5.idx"));
+	cl_assert(pack_exists(repo, "pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5.pack"));
+	cl_assert(pack_exists(repo, "pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a.idx"));
+	cl_assert(!pack_exists(repo, "pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx"));
+
+	stats = git_remote_stats(remote);
+	cl_assert_equal_i(stats->total_objects, stats->received_objects);
+	cl_assert_equal_i(stats->total_objects, stats->indexed_objects);
+	cl_assert(stats->total_objects > 12);
+
+	/* Objects of the copied packs, and loose ones packed again */
+	assert_object_exists(repo, "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9");
+	assert_object_exists(repo, "e90810b8df3e80c413d903f631643c716887138d");
+	assert_object_exists(repo, "refs/heads/master^{tree}");
+	assert_object_exists(repo, "refs/tags/test");
+
+	git_remote_free(remote);
+	git_repository_free(repo);
+}
+
+void test_network_fetchlocal__packs_the_wanted_objects_of_other_packs(void)
+{
+	git_repository *remote_repo = cl_git_sandbox_init("testrepo.git");
+	git_repository *repo;
+	git_remote *remote;
+	git_packbuilder *pb;
+	git_revwalk *walk;
+	git_signature *sig;
+	git_commit *head;
+	git_tree *tree;
+	git_oid id;
+	git_buf path = GIT_BUF_INIT, name = GIT_BUF_INIT;
+
+	cl_git_pass(git_repository_init(&repo, "./foo.git", true));
+	cl_set_cleanup(cleanup_local_repo, "foo.git");
+
+	cl_git_pass(git_remote_create(&remote, repo, GIT_REMOTE_ORIGIN,
+		cl_git_path_url(git_repository_path(remote_repo))));
+	cl_git_pass(git_remote_fetch(remote, NULL, NULL, NULL));
+
+	/* A new commit, and a pack of all the history of the remote */
+	cl_git_pass(git_revparse_single((git_object **)&head, remote_repo, "master"));
+	cl_git_pass(git_commit_tree(&tree, head));
+	cl_git_pass(git_signature_new(&sig, tagger_name, tagger_email, 1234567890, 0));
+	cl_git_pass(git_commit_create_v(&id, remote_repo, "refs/heads/master", sig, sig,
+		NULL, "new commit\n", tree, 1, head));
+
+	cl_git_pass(git_packbuilder_new(&pb, remote_repo));
+	cl_git_pass(git_revwalk_new(&walk, remote_repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "*"));
+	cl_git_pass(git_packbuilder_insert_walk(pb, walk));
+	cl_git_pass(git_buf_joinpath(&path, git_repository_path(remote_repo), "objects/pack"));
+	cl_git_pass(git_packbuilder_write(pb, path.ptr, 0, NULL, NULL));
+	cl_git_pass(git_buf_printf(&name, "pack-%s.idx", git_oid_tostr_s(git_packbuilder_hash(pb))));
+
+	/* Only the commit is wanted from it, so it is not copied */
+	cl_git_pass(git_remote_fetch(remote, NULL, NULL, NULL));
+
+	cl_assert(!pack_exists(repo, name.ptr));
+	assert_object_exists(repo, git_oid_tostr_s(&id));
+	assert_object_exists(repo, "refs/remotes/origin/master^{tree}");
+
+	git_buf_dispose(&name);
+	git_buf_dispose(&path);
+	git_revwalk_free(walk);
+	git_packbuilder_free(pb);
+	git_tree_free(tree);
+	git_commit_free(head);
+	git_signature_free(sig);
+	git_remote_free(remote);
+	git_repository_free(repo);
+}
+
+static void fetch_all_refs(const char *path)
+{
+	git_repository *repo;
+	git_remote *remote;
+	char *allrefs = "+refs/*:refs/*";
+	git_strarray refspecs = {
+		&allrefs,
+		1,
+	};
+
+	cl_git_pass(git_repository_init(&repo, path, true));
+	cl_git_pass(git_remote_create_anonymous(&remote, repo, cl_git_fixture_url("testrepo.git")));
+	cl_git_pass(git_remote_fetch(remote, &refspecs, NULL, NULL));
+	cl_assert(pack_exists(repo, "pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5.pack"));
+
+	git_remote_free(remote);
+	git_repository_free(repo);
+}
+
+static void cleanup_fsync(void *path)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 0));
+	cl_fixture_cleanup((char *)path);
+}
+
+void test_network_fetchlocal__copied_packs_obey_fsync_setting(void)
+{
+	cl_set_cleanup(cleanup_fsync, "foo.git");
+
+	p_fsync__cnt = 0;
+	fetch_all_refs("./foo.git");
+	cl_assert_equal_sz(0, p_fsync__cnt);
+
+	cl_fixture_cleanup("foo.git");
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 1));
+
+	p_fsync__cnt = 0;
+	fetch_all_refs("./foo.git");
+	cl_assert(p_fsync__cnt > 0);
+}
@@ -0,0 +1,212 @@
+#include "clar_libgit2.h"
+
+#include "negotiator.h"
+#include "fetch.h"
+#include "remote.h"
+
+static git_repository *_repo;
+static git_oid _history[50];
+
+/* Commit a linear history on the branch, one commit a minute */
+static void commit_history(git_oid *ids, size_t count, const char *refname, git_time_t time)
+{
+	git_treebuilder *builder;
+	git_signature *sig;
+	git_commit *parent = NULL;
+	git_tree *tree;
+	git_oid tree_id;
+	size_t i;
+
+	cl_git_pass(git_treebuilder_new(&builder, _repo, NULL));
+	cl_git_pass(git_treebuilder_write(&tree_id, builder));
+	cl_git_pass(git_tree_lookup(&tree, _repo, &tree_id));
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_signature_new(&sig, "me", "me@example.com", time + i * 60, 0));
+		cl_git_pass(git_commit_create(&ids[i], _repo, NULL, sig, sig, NULL, "commit\n",
+			tree, parent ? 1 : 0, (const git_commit **)&parent));
+
+		git_commit_free(parent);
+		git_signature_free(sig);
+		cl_git_pass(git_commit_lookup(&parent, _repo, &ids[i]));
+	}
+
+	cl_git_pass(git_reference_create(NULL, _repo, refname, &ids[count - 1], 1, NULL));
+
+	git_commit_free(parent);
+	git_tree_free(tree);
+	git_treebuilder_free(builder);
+}
+
+void test_network_negotiator__initialize(void)
+{
+	_repo = cl_git_sandbox_init("empty_bare.git");
+	commit_history(_history, ARRAY_SIZE(_history), "refs/heads/main", 1600000000);
+}
+
+void test_network_negotiator__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static size_t negotiate(git_oid *out, size_t max, git_negotiator *negotiator)
+{
+	size_t count = 0;
+	git_oid id;
+	int error;
+
+	while ((error = git_negotiator_next(&id, negotiator)) == 0) {
+		cl_assert(count < max);
+		git_oid_cpy(&out[count++], &id);
+	}
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	return count;
+}
+
+void test_network_negotiator__consecutive_sends_every_commit(void)
+{
+	git_negotiator *negotiator;
+	git_oid haves[50];
+	size_t i;
+
+	cl_git_pass(git_negotiator_new(&negotiator, _repo, GIT_FETCH_NEGOTIATION_CONSECUTIVE));
+	cl_git_pass(git_negotiator_add_tips(negotiator, "refs/*"));
+
+	cl_assert_equal_sz(50, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+
+	for (i = 0; i < 50; i++)
+		cl_assert_equal_oid(&_history[49 - i], &haves[i]);
+
+	git_negotiator_free(negotiator);
+}
+
+void test_network_negotiator__skipping_skips_more_and_more_commits(void)
+{
+	git_negotiator *negotiator;
+	git_oid haves[50];
+	size_t expected[] = { 49, 47, 44, 39, 31, 19, 1 };
+	size_t i;
+
+	cl_git_pass(git_negotiator_new(&negotiator, _repo, GIT_FETCH_NEGOTIATION_SKIPPING));
+	cl_git_pass(git_negotiator_add_tips(negotiator, "refs/*"));
+
+	cl_assert_equal_sz(ARRAY_SIZE(expected), negotiate(haves, ARRAY_SIZE(haves), negotiator));
+
+	for (i = 0; i < ARRAY_SIZE(expected); i++)
+		cl_assert_equal_oid(&_history[expected[i]], &haves[i]);
+
+	git_negotiator_free(negotiator);
+}
+
+void test_network_negotiator__sends_every_tip(void)
+{
+	git_negotiator *negotiator;
+	git_oid other[3], haves[50];
+	size_t count;
+
+	commit_history(other, ARRAY_SIZE(other), "refs/heads/other", 1700000000);
+
+	cl_git_pass(git_negotiator_new(&negotiator, _repo, GIT_FETCH_NEGOTIATION_SKIPPING));
+	cl_git_pass(git_negotiator_add_tips(negotiator, "refs/heads/*"));
+
+	count = negotiate(haves, ARRAY_SIZE(haves), negotiator);
+
+	/* The newest commits come first, whatever is skipped */
+	cl_assert(count > 2);
+	cl_assert_equal_oid(&other[2], &haves[0]);
+	cl_assert_equal_oid(&other[0], &haves[1]);
+	cl_assert_equal_oid(&_history[49], &haves[2]);
+
+	git_negotiator_free(negotiator);
+}
+
+void test_network_negotiator__only_walks_from_the_matching_references(void)
+{
+	git_negotiator *negotiator;
+	git_oid other[3], haves[50];
+
+	commit_history(other, ARRAY_SIZE(other), "refs/heads/other", 1700000000);
+
+	cl_git_pass(git_negotiator_new(&negotiator, _repo, GIT_FETCH_NEGOTIATION_CONSECUTIVE));
+	cl_git_pass(git_negotiator_add_tips(negotiator, "refs/heads/oth*"));
+
+	cl_assert_equal_sz(3, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+	cl_assert_equal_oid(&other[2], &haves[0]);
+
+	git_negotiator_free(negotiator);
+}
+
+void test_network_negotiator__ignores_references_to_other_objects(void)
+{
+	git_negotiator *negotiator;
+	git_oid blob, haves[50];
+
+	cl_git_pass(git_blob_create_from_buffer(&blob, _repo, "hi\n", 3));
+	cl_git_pass(git_reference_create(NULL, _repo, "refs/tags/blob", &blob, 0, NULL));
+
+	cl_git_pass(git_negotiator_new(&negotiator, _repo, GIT_FETCH_NEGOTIATION_CONSECUTIVE));
+	cl_git_pass(git_negotiator_add_tips(negotiator, "refs/*"));
+
+	cl_assert_equal_sz(50, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+
+	git_negotiator_free(negotiator);
+}
+
+void test_network_negotiator__uses_the_configured_algorithm(void)
+{
+	git_negotiator *negotiator;
+	git_remote *remote;
+	git_oid haves[50];
+
+	cl_repo_set_string(_repo, "fetch.negotiationAlgorithm", "skipping");
+	cl_git_pass(git_remote_create(&remote, _repo, "origin", "https://example.com/repo.git"));
+
+	cl_git_pass(git_fetch__set_negotiation(remote, NULL));
+	cl_assert_equal_i(GIT_FETCH_NEGOTIATION_SKIPPING, remote->negotiation);
+
+	cl_git_pass(git_fetch__negotiator_new(&negotiator, _repo, remote));
+	cl_assert_equal_sz(7, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+
+	git_negotiator_free(negotiator);
+	git_remote_free(remote);
+}
+
+void test_network_negotiator__can_negotiate_from_the_fetched_references(void)
+{
+	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+	git_negotiator *negotiator;
+	git_remote *remote;
+	git_oid tracking[2], haves[50];
+	git_refspec *spec;
+
+	commit_history(tracking, ARRAY_SIZE(tracking), "refs/remotes/origin/main", 1700000000);
+
+	cl_git_pass(git_remote_create(&remote, _repo, "origin", "https://example.com/repo.git"));
+
+	spec = git__calloc(1, sizeof(git_refspec));
+	cl_assert(spec);
+	cl_git_pass(git_refspec__parse(spec, "+refs/heads/*:refs/remotes/origin/*", true));
+	cl_git_pass(git_vector_insert(&remote->active_refspecs, spec));
+
+	opts.negotiate_fetched_refs = 1;
+	cl_git_pass(git_fetch__set_negotiation(remote, &opts));
+
+	cl_git_pass(git_fetch__negotiator_new(&negotiator, _repo, remote));
+	cl_assert_equal_sz(2, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+	cl_assert_equal_oid(&tracking[1], &haves[0]);
+	git_negotiator_free(negotiator);
+
+	/* With no fetched reference, there is nothing to tell */
+	git_vector_clear(&remote->active_refspecs);
+	git_refspec__dispose(spec);
+	git__free(spec);
+	cl_git_pass(git_fetch__set_negotiation(remote, &opts));
+	cl_assert_equal_i(GIT_FETCH_NEGOTIATION_NOOP, remote->negotiation);
+
+	cl_git_pass(git_fetch__negotiator_new(&negotiator, _repo, remote));
+	cl_assert_equal_sz(0, negotiate(haves, ARRAY_SIZE(haves), negotiator));
+	git_negotiator_free(negotiator);
+
+	git_remote_free(remote);
+}
@@ -19,35 +19,35 @@ static void assert_commit_parses(const char *data, size_t datalen,
 	if (expected_author) {
 		git_signature *author;
 		cl_git_pass(git_signature_from_buffer(&author, expected_author));
-		cl_assert(git_signature__equal(author, commit->author));
-		cl_assert_equal_s(author->name, commit->author->name);
-		cl_assert_equal_s(author->email, commit->author->email);
-		cl_assert_equal_i(author->when.time, commit->author->when.time);
-		cl_assert_equal_i(author->when.offset, commit->author->when.offset);
-		cl_assert_equal_i(author->when.sign, commit->author->when.sign);
+		cl_assert(git_signature__equal(author, commit->details->author));
+		cl_assert_equal_s(author->name, commit->details->author->name);
+		cl_assert_equal_s(author->email, commit->details->author->email);
+		cl_assert_equal_i(author->when.time, commit->details->author->when.time);
+		cl_assert_equal_i(author->when.offset, commit->details->author->when.offset);
+		cl_assert_equal_i(author->when.sign, commit->details->author->when.sign);
 		git_signature_free(author);
 	}
 
 	if (expected_committer) {
 		git_signature *committer;
 		cl_git_pass(git_signature_from_buffer(&committer, expected_committer));
-		cl_assert_equal_s(committer->name, commit->committer->name);
-		cl_assert_equal_s(committer->email, commit->committer->email);
-		cl_assert_equal_i(committer->when.time, commit->committer->when.time);
-		cl_assert_equal_i(committer->when.offset, commit->committer->when.offset);
-		cl_assert_equal_i(committer->when.sign, commit->committer->when.sign);
+		cl_assert_equal_s(committer->name, commit->details->committer->name);
+		cl_assert_equal_s(committer->email, commit->details->committer->email);
+		cl_assert_equal_i(committer->when.time, commit->details->committer->when.time);
+		cl_assert_equal_i(committer->when.offset, commit->details->committer->when.offset);
+		cl_assert_equal_i(committer->when.sign, commit->details->committer->when.sign);
 		git_signature_free(committer);
 	}
 
 	if (expected_encoding)
-		cl_assert_equal_s(commit->message_encoding, expected_encoding);
+		cl_assert_equal_s(commit->details->message_encoding, expected_encoding);
 	else
-		cl_assert_equal_p(commit->message_encoding, NULL);
+		cl_assert_equal_p(commit->details->message_encoding, NULL);
 
 	if (expected_message)
-		cl_assert_equal_s(commit->raw_message, expected_message);
+		cl_assert_equal_s(commit->details->raw_message, expected_message);
 	else
-		cl_assert_equal_p(commit->message_encoding, NULL);
+		cl_assert_equal_p(commit->details->message_encoding, NULL);
 
 	if (expected_treeid) {
 		git_oid tree_oid;
@@ -14,6 +14,7 @@ void test_object_tree_read__initialize(void)
 
 void test_object_tree_read__cleanup(void)
 {
+   cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_STRICT_TREE_PARSING, 1));
    cl_git_sandbox_cleanup();
 }
 
@@ -117,3 +118,57 @@ void test_object_tree_read__largefile(void)
 	git_commit_free(commit);
 	git__free(buf);
 }
+
+void test_object_tree_read__bypath_does_not_index_tree(void)
+{
+	git_oid id;
+	git_tree *tree;
+	git_tree_entry *entry;
+
+	git_oid_fromstr(&id, tree_oid);
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "README"));
+	cl_assert_equal_s("README", git_tree_entry_name(entry));
+	git_tree_entry_free(entry);
+
+	cl_git_fail_with(GIT_ENOTFOUND, git_tree_entry_bypath(&entry, tree, "NOTEXISTS"));
+	cl_assert(tree->entries == NULL);
+
+	cl_assert_equal_i(3, git_tree_entrycount(tree));
+	cl_assert(tree->entries != NULL);
+
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "new.txt"));
+	cl_assert_equal_s("new.txt", git_tree_entry_name(entry));
+	git_tree_entry_free(entry);
+
+	git_tree_free(tree);
+}
+
+void test_object_tree_read__without_strict_parsing(void)
+{
+	git_object *commit;
+	git_tree *tree;
+	git_tree_entry *entry;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_STRICT_TREE_PARSING, 0));
+
+	cl_git_pass(git_revparse_single(&commit, g_repo, "763d71a"));
+	cl_git_pass(git_commit_tree(&tree, (git_commit *)commit));
+
+	cl_git_pass(git_tree_entry_bypath(&entry, tree, "ab/de/fgh/1.txt"));
+	cl_assert_equal_s("1.txt", git_tree_entry_name(entry));
+	cl_assert_equal_i(GIT_OBJECT_BLOB, git_tree_entry_type(entry));
+	git_tree_entry_free(entry);
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_tree_entry_bypath(&entry, tree, "ab/de/fgh/2.txt"));
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_tree_entry_bypath(&entry, tree, "ab/4.txt/x"));
+
+	cl_assert(git_tree_entry_byname(tree, "ab") != NULL);
+	cl_assert(git_tree_entry_byname(tree, "README") != NULL);
+
+	git_tree_free(tree);
+	git_object_free(commit);
+}
@@ -121,6 +121,7 @@ void test_odb_loose__initialize(void)
 void test_odb_loose__cleanup(void)
 {
 	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 0));
 	cl_fixture_cleanup("test-objects");
 }
 
@@ -149,6 +150,44 @@ void test_odb_loose__exists(void)
 	git_odb_free(odb);
 }
 
+void test_odb_loose__exists_with_object_cache(void)
+{
+	git_oid id, id2;
+	git_odb *odb;
+
+	write_object_files(&one);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 1));
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+
+	cl_git_pass(git_oid_fromstr(&id, one.id));
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_git_pass(git_oid_fromstrp(&id, "8b137891"));
+	cl_git_pass(git_odb_exists_prefix(&id2, odb, &id, 8));
+	cl_assert_equal_i(0, git_oid_streq(&id2, one.id));
+
+	cl_git_pass(git_oid_fromstr(&id, "8b137891791fe96927ad78e64b0aad7bded08baa"));
+	cl_assert(!git_odb_exists(odb, &id));
+
+	/* Objects written behind the odb's back are still found */
+	cl_git_pass(git_oid_fromstr(&id, commit.id));
+	cl_assert(!git_odb_exists(odb, &id));
+	write_object_files(&commit);
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_git_pass(git_oid_fromstrp(&id, "3d7f8a6a"));
+	cl_git_pass(git_odb_exists_prefix(&id2, odb, &id, 8));
+	cl_assert_equal_i(0, git_oid_streq(&id2, commit.id));
+
+	/* And so are the ones written through it */
+	cl_git_pass(git_oid_fromstr(&id, two.id));
+	cl_assert(!git_odb_exists(odb, &id));
+	cl_git_pass(git_odb_write(&id2, odb, two.data, two.dlen, git_object_string2type(two.type)));
+	cl_assert(git_odb_exists(odb, &id));
+
+	git_odb_free(odb);
+}
+
 void test_odb_loose__simple_reads(void)
 {
 	test_read_object(&commit);
@@ -289,3 +328,188 @@ void test_odb_loose__fsync_obeys_repo_setting(void)
 	cl_assert(p_fsync__cnt > 0);
 	git_repository_free(repo);
 }
+
+static void write_object_data(git_odb *odb, object_data *d)
+{
+	git_oid id;
+
+	cl_git_pass(git_odb_write(&id, odb, d->data, d->dlen,
+		git_object_string2type(d->type)));
+	cl_assert_equal_i(0, git_oid_streq(&id, d->id));
+}
+
+static void read_object_data(git_odb *odb, object_data *d)
+{
+	git_odb_object *obj;
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, d->id));
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert_equal_i(git_object_string2type(d->type), git_odb_object_type(obj));
+	cl_assert_equal_sz(d->dlen, git_odb_object_size(obj));
+	cl_assert(memcmp(git_odb_object_data(obj), d->data, d->dlen) == 0);
+	git_odb_object_free(obj);
+}
+
+static int count_entries(void *payload, git_buf *path)
+{
+	GIT_UNUSED(path);
+	(*(size_t *)payload)++;
+	return 0;
+}
+
+static size_t dir_entries(const char *path)
+{
+	git_buf buf = GIT_BUF_INIT;
+	size_t count = 0;
+
+	cl_git_pass(git_buf_sets(&buf, path));
+	cl_git_pass(git_path_direach(&buf, 0, count_entries, &count));
+	git_buf_dispose(&buf);
+
+	return count;
+}
+
+void test_odb_loose__batch_is_moved_into_place(void)
+{
+	git_odb *odb;
+	git_oid id, found;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_FSYNC_GITDIR, 1));
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+	cl_git_pass(git_odb_begin_batch(odb));
+	cl_git_fail(git_odb_begin_batch(odb));
+
+	write_object_data(odb, &one);
+	write_object_data(odb, &two);
+	write_object_data(odb, &commit);
+	write_object_data(odb, &one);
+
+#ifdef GIT_USE_SYNCFS
+	cl_assert_equal_sz(0, p_fsync__cnt);
+#endif
+
+	/* The objects are readable before they are in place */
+	cl_assert(!git_path_exists(one.file));
+	read_object_data(odb, &one);
+	read_object_data(odb, &commit);
+
+	cl_git_pass(git_oid_fromstrp(&id, "7898192"));
+	cl_git_pass(git_odb_exists_prefix(&found, odb, &id, 7));
+	cl_assert_equal_i(0, git_oid_streq(&found, two.id));
+
+	p_fsync__cnt = 0;
+	cl_git_pass(git_odb_end_batch(odb, true));
+
+#ifdef GIT_USE_SYNCFS
+	/* A single barrier, then the three fanout directories and their parent */
+	cl_assert_equal_sz(5, p_fsync__cnt);
+#endif
+
+	cl_assert(git_path_exists(one.file));
+	cl_assert(git_path_exists(two.file));
+	cl_assert(git_path_exists(commit.file));
+	cl_assert_equal_sz(3, dir_entries("test-objects"));
+
+	read_object_data(odb, &two);
+	cl_git_fail(git_odb_end_batch(odb, true));
+
+	git_odb_free(odb);
+}
+
+void test_odb_loose__batch_can_be_discarded(void)
+{
+	git_odb *odb;
+	git_oid id;
+
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+	cl_git_pass(git_odb_begin_batch(odb));
+
+	write_object_data(odb, &one);
+	cl_git_pass(git_oid_fromstr(&id, one.id));
+	cl_assert(git_odb_exists(odb, &id));
+
+	cl_git_pass(git_odb_end_batch(odb, false));
+
+	cl_assert(!git_odb_exists(odb, &id));
+	cl_assert(git_path_is_empty_dir("test-objects"));
+
+	/* An unfinished batch is discarded with the odb */
+	cl_git_pass(git_odb_begin_batch(odb));
+	write_object_data(odb, &one);
+	git_odb_free(odb);
+
+	cl_assert(git_path_is_empty_dir("test-objects"));
+}
+
+static int find_batch_dir(void *payload, git_buf *path)
+{
+	if (strstr(path->ptr, "/tmp_batch"))
+		cl_git_pass(git_buf_sets(payload, path->ptr));
+	return 0;
+}
+
+void test_odb_loose__batch_keeps_the_objects_it_cannot_move(void)
+{
+	git_buf dir = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_odb *odb;
+
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+	cl_git_pass(git_odb_begin_batch(odb));
+
+	write_object_data(odb, &one);
+	write_object_data(odb, &two);
+	write_object_data(odb, &commit);
+
+	/* A file where the fanout directory of the second object goes */
+	cl_git_mkfile("test-objects/78", "blocked");
+	cl_git_fail(git_odb_end_batch(odb, true));
+
+	/* The objects before and after it were still moved into place */
+	cl_assert(git_path_exists(one.file));
+	cl_assert(git_path_exists(commit.file));
+	cl_assert(!git_path_exists(two.file));
+
+	/* And the one that was not is still in the batch's directory */
+	cl_git_pass(git_buf_sets(&path, "test-objects"));
+	cl_git_pass(git_path_direach(&path, 0, find_batch_dir, &dir));
+	cl_assert(dir.size > 0);
+	cl_assert_equal_sz(1, dir_entries(dir.ptr));
+
+	cl_git_pass(git_buf_joinpath(&path, dir.ptr, "78/981922613b2afb6025042ff6bd878ac1994e85"));
+	cl_assert(git_path_exists(path.ptr));
+
+	git_buf_dispose(&path);
+	git_buf_dispose(&dir);
+	git_odb_free(odb);
+}
+
+void test_odb_loose__large_batch_is_packed(void)
+{
+	size_t threshold = git_odb__loose_batch_pack_threshold;
+	git_odb *odb;
+
+	cl_must_pass(p_mkdir("test-objects/pack", GIT_OBJECT_DIR_MODE));
+	cl_git_pass(git_odb_open(&odb, "test-objects"));
+	cl_git_pass(git_odb_begin_batch(odb));
+
+	write_object_data(odb, &one);
+	write_object_data(odb, &two);
+	write_object_data(odb, &commit);
+	write_object_data(odb, &tree);
+
+	git_odb__loose_batch_pack_threshold = 4;
+	cl_git_pass(git_odb_end_batch(odb, true));
+	git_odb__loose_batch_pack_threshold = threshold;
+
+	/* The objects went into a pack and its index */
+	cl_assert_equal_sz(1, dir_entries("test-objects"));
+	cl_assert_equal_sz(2, dir_entries("test-objects/pack"));
+
+	read_object_data(odb, &one);
+	read_object_data(odb, &two);
+	read_object_data(odb, &commit);
+	read_object_data(odb, &tree);
+
+	git_odb_free(odb);
+}
@@ -0,0 +1,246 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+
+static git_repository *repo;
+static git_odb *odb;
+
+#define MISSING_ONE "missing object one\n"
+#define MISSING_TWO "missing object two\n"
+#define EXISTING_ID "a8233120f6ad708f843d861ce2b7228ec4e3dec6"
+
+typedef struct {
+	size_t calls;
+	size_t objects;
+	int error;
+} missing_data;
+
+void test_odb_missing__initialize(void)
+{
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_repository_odb(&odb, repo));
+}
+
+void test_odb_missing__cleanup(void)
+{
+	git_odb_free(odb);
+	cl_git_sandbox_cleanup();
+}
+
+static const char *contents_of(const git_oid *id)
+{
+	static const char *contents[] = { MISSING_ONE, MISSING_TWO };
+	git_oid expected;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(contents); i++) {
+		cl_git_pass(git_odb_hash(&expected, contents[i], strlen(contents[i]), GIT_OBJECT_BLOB));
+
+		if (git_oid_equal(id, &expected))
+			return contents[i];
+	}
+
+	return NULL;
+}
+
+/* Writes the objects it is asked for, like a fetch would */
+static int write_missing(git_odb *db, const git_oid *ids, size_t count, void *payload)
+{
+	missing_data *data = payload;
+	const char *contents;
+	git_oid written;
+	size_t i;
+
+	data->calls++;
+	data->objects += count;
+
+	if (data->error)
+		return data->error;
+
+	for (i = 0; i < count; i++) {
+		cl_assert((contents = contents_of(&ids[i])) != NULL);
+		cl_git_pass(git_odb_write(&written, db, contents, strlen(contents), GIT_OBJECT_BLOB));
+	}
+
+	return 0;
+}
+
+void test_odb_missing__read_calls_the_callback(void)
+{
+	missing_data data = {0};
+	git_odb_object *obj;
+	git_oid id;
+
+	cl_git_pass(git_odb_hash(&id, MISSING_ONE, strlen(MISSING_ONE), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing, &data));
+
+	cl_assert(!git_odb_exists(odb, &id));
+	cl_assert_equal_sz(0, data.calls);
+
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert_equal_s(MISSING_ONE, git_odb_object_data(obj));
+	cl_assert_equal_sz(1, data.calls);
+	git_odb_object_free(obj);
+
+	cl_git_pass(git_odb_read(&obj, odb, &id));
+	cl_assert_equal_sz(1, data.calls);
+	git_odb_object_free(obj);
+}
+
+void test_odb_missing__read_header_calls_the_callback(void)
+{
+	missing_data data = {0};
+	git_object_t type;
+	size_t len;
+	git_oid id;
+
+	cl_git_pass(git_odb_hash(&id, MISSING_TWO, strlen(MISSING_TWO), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing, &data));
+
+	cl_git_pass(git_odb_read_header(&len, &type, odb, &id));
+	cl_assert_equal_sz(strlen(MISSING_TWO), len);
+	cl_assert_equal_i(GIT_OBJECT_BLOB, type);
+	cl_assert_equal_sz(1, data.calls);
+}
+
+void test_odb_missing__read_many_fetches_in_one_batch(void)
+{
+	missing_data data = {0};
+	git_odb_object *objs[3];
+	git_oid ids[3];
+
+	cl_git_pass(git_odb_hash(&ids[0], MISSING_ONE, strlen(MISSING_ONE), GIT_OBJECT_BLOB));
+	cl_git_pass(git_oid_fromstr(&ids[1], EXISTING_ID));
+	cl_git_pass(git_odb_hash(&ids[2], MISSING_TWO, strlen(MISSING_TWO), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing, &data));
+
+	cl_git_pass(git_odb_read_many_array(objs, odb, ids, 3));
+	cl_assert_equal_sz(1, data.calls);
+	cl_assert_equal_sz(2, data.objects);
+
+	cl_assert_equal_s(MISSING_ONE, git_odb_object_data(objs[0]));
+	cl_assert_equal_s(MISSING_TWO, git_odb_object_data(objs[2]));
+
+	git_odb_object_free(objs[0]);
+	git_odb_object_free(objs[1]);
+	git_odb_object_free(objs[2]);
+}
+
+void test_odb_missing__passthrough_leaves_objects_missing(void)
+{
+	missing_data data = {0};
+	git_odb_object *obj;
+	git_oid id;
+
+	data.error = GIT_PASSTHROUGH;
+
+	cl_git_pass(git_odb_hash(&id, MISSING_ONE, strlen(MISSING_ONE), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing, &data));
+
+	cl_assert_equal_i(GIT_ENOTFOUND, git_odb_read(&obj, odb, &id));
+	cl_assert_equal_sz(1, data.calls);
+}
+
+void test_odb_missing__errors_are_returned(void)
+{
+	missing_data data = {0};
+	git_odb_object *obj;
+	git_oid id;
+
+	data.error = -42;
+
+	cl_git_pass(git_odb_hash(&id, MISSING_ONE, strlen(MISSING_ONE), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing, &data));
+
+	cl_assert_equal_i(-42, git_odb_read(&obj, odb, &id));
+}
+
+#ifdef GIT_THREADS
+
+typedef struct {
+	git_mutex lock;
+	git_cond cond;
+	bool first_inside;
+	bool second_done;
+	git_oid first_id;
+	int first_error;
+} concurrent_data;
+
+/* The first reader waits in the callback until the second one is done */
+static int write_missing_concurrently(git_odb *db, const git_oid *ids, size_t count, void *payload)
+{
+	concurrent_data *data = payload;
+	const char *contents = contents_of(&ids[0]);
+	git_oid written;
+
+	GIT_UNUSED(count);
+
+	if (git_oid_equal(&ids[0], &data->first_id)) {
+		git_mutex_lock(&data->lock);
+		data->first_inside = true;
+		git_cond_broadcast(&data->cond);
+
+		while (!data->second_done)
+			git_cond_wait(&data->cond, &data->lock);
+
+		git_mutex_unlock(&data->lock);
+	}
+
+	return git_odb_write(&written, db, contents, strlen(contents), GIT_OBJECT_BLOB);
+}
+
+static void *read_first(void *payload)
+{
+	concurrent_data *data = payload;
+	git_odb_object *obj;
+
+	if ((data->first_error = git_odb_read(&obj, odb, &data->first_id)) == 0)
+		git_odb_object_free(obj);
+
+	return NULL;
+}
+
+#endif
+
+void test_odb_missing__callback_runs_on_concurrent_threads(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	concurrent_data data;
+	git_odb_object *obj = NULL;
+	git_thread thread;
+	git_oid id;
+	int error;
+
+	memset(&data, 0, sizeof(data));
+	cl_git_pass(git_mutex_init(&data.lock));
+	cl_git_pass(git_cond_init(&data.cond));
+	cl_git_pass(git_odb_hash(&data.first_id, MISSING_ONE, strlen(MISSING_ONE), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_hash(&id, MISSING_TWO, strlen(MISSING_TWO), GIT_OBJECT_BLOB));
+	cl_git_pass(git_odb_set_missing_callback(odb, write_missing_concurrently, &data));
+
+	cl_git_pass(git_thread_create(&thread, read_first, &data));
+
+	git_mutex_lock(&data.lock);
+	while (!data.first_inside)
+		git_cond_wait(&data.cond, &data.lock);
+	git_mutex_unlock(&data.lock);
+
+	/* Another thread is in the callback, which must run for us too */
+	error = git_odb_read(&obj, odb, &id);
+
+	git_mutex_lock(&data.lock);
+	data.second_done = true;
+	git_cond_broadcast(&data.cond);
+	git_mutex_unlock(&data.lock);
+
+	cl_git_pass(git_thread_join(&thread, NULL));
+	git_cond_free(&data.cond);
+	git_mutex_free(&data.lock);
+
+	cl_git_pass(error);
+	cl_assert_equal_s(MISSING_TWO, git_odb_object_data(obj));
+	git_odb_object_free(obj);
+	cl_git_pass(data.first_error);
+#endif
+}
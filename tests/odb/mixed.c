@@ -284,3 +284,24 @@ void test_odb_mixed__expand_ids_cached(void)
 	assert_found_objects(ids);
 	git__free(ids);
 }
+
+static void reopen_with_loose_object_cache(void)
+{
+	git_odb_free(_odb);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 1));
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("duplicate.git/objects")));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_ENABLE_LOOSE_OBJECT_CACHE, 0));
+}
+
+void test_odb_mixed__dup_oid_prefix_0_with_loose_object_cache(void)
+{
+	reopen_with_loose_object_cache();
+	test_odb_mixed__dup_oid_prefix_0();
+}
+
+void test_odb_mixed__expand_ids_with_loose_object_cache(void)
+{
+	reopen_with_loose_object_cache();
+	test_odb_mixed__expand_ids();
+}
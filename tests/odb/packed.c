@@ -13,6 +13,8 @@ void test_odb_packed__cleanup(void)
 {
 	git_odb_free(_odb);
 	_odb = NULL;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_ODB_READ_MANY_THREADS, 1));
 }
 
 void test_odb_packed__mass_read(void)
@@ -77,3 +79,165 @@ void test_odb_packed__read_header_1(void)
 	}
 }
 
+
+static void read_ids(git_oid **out, size_t *count)
+{
+	size_t i, npacked = ARRAY_SIZE(packed_objects);
+
+	*count = npacked + ARRAY_SIZE(loose_objects);
+	*out = git__calloc(*count, sizeof(git_oid));
+	cl_assert(*out);
+
+	for (i = 0; i < npacked; i++)
+		cl_git_pass(git_oid_fromstr(&(*out)[i], packed_objects[i]));
+	for (i = npacked; i < *count; i++)
+		cl_git_pass(git_oid_fromstr(&(*out)[i], loose_objects[i - npacked]));
+}
+
+typedef struct {
+	const git_oid *ids;
+	size_t *seen;
+	size_t calls;
+	size_t stop_after;
+} read_many_data;
+
+static int read_many_cb(git_odb_object *obj, size_t idx, void *payload)
+{
+	read_many_data *data = payload;
+	git_odb_object *expected;
+
+	cl_assert_equal_oid(&data->ids[idx], git_odb_object_id(obj));
+
+	cl_git_pass(git_odb_read(&expected, _odb, &data->ids[idx]));
+	cl_assert_equal_i(git_odb_object_size(expected), git_odb_object_size(obj));
+	cl_assert_equal_i(git_odb_object_type(expected), git_odb_object_type(obj));
+	cl_assert(memcmp(git_odb_object_data(expected), git_odb_object_data(obj),
+		git_odb_object_size(obj)) == 0);
+	git_odb_object_free(expected);
+
+	data->seen[idx]++;
+
+	if (++data->calls == data->stop_after)
+		return -42;
+
+	return 0;
+}
+
+void test_odb_packed__read_many(void)
+{
+	read_many_data data = {0};
+	git_oid *ids;
+	size_t i, count;
+
+	read_ids(&ids, &count);
+	data.ids = ids;
+	data.seen = git__calloc(count, sizeof(size_t));
+
+	cl_git_pass(git_odb_read_many(_odb, ids, count, read_many_cb, &data));
+
+	cl_assert_equal_i(count, data.calls);
+	for (i = 0; i < count; i++)
+		cl_assert_equal_i(1, data.seen[i]);
+
+	git__free(data.seen);
+	git__free(ids);
+}
+
+void test_odb_packed__read_many_can_be_stopped(void)
+{
+	read_many_data data = {0};
+	git_oid *ids;
+	size_t count;
+
+	read_ids(&ids, &count);
+	data.ids = ids;
+	data.seen = git__calloc(count, sizeof(size_t));
+	data.stop_after = 3;
+
+	cl_assert_equal_i(-42,
+		git_odb_read_many(_odb, ids, count, read_many_cb, &data));
+	cl_assert_equal_i(3, data.calls);
+
+	git__free(data.seen);
+	git__free(ids);
+}
+
+void test_odb_packed__read_many_on_threads(void)
+{
+	read_many_data data = {0};
+	git_oid *ids;
+	size_t i, count;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_ODB_READ_MANY_THREADS, 4));
+
+	read_ids(&ids, &count);
+	data.ids = ids;
+	data.seen = git__calloc(count, sizeof(size_t));
+
+	cl_git_pass(git_odb_read_many(_odb, ids, count, read_many_cb, &data));
+
+	cl_assert_equal_i(count, data.calls);
+	for (i = 0; i < count; i++)
+		cl_assert_equal_i(1, data.seen[i]);
+
+	git__free(data.seen);
+	git__free(ids);
+}
+
+void test_odb_packed__read_many_on_threads_can_be_stopped(void)
+{
+	read_many_data data = {0};
+	git_oid *ids;
+	size_t count;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_ODB_READ_MANY_THREADS, 0));
+
+	read_ids(&ids, &count);
+	data.ids = ids;
+	data.seen = git__calloc(count, sizeof(size_t));
+	data.stop_after = 3;
+
+	cl_assert_equal_i(-42,
+		git_odb_read_many(_odb, ids, count, read_many_cb, &data));
+	cl_assert_equal_i(3, data.calls);
+
+	git__free(data.seen);
+	git__free(ids);
+}
+
+void test_odb_packed__read_many_array(void)
+{
+	git_odb_object **objs;
+	git_oid *ids;
+	size_t i, count;
+
+	read_ids(&ids, &count);
+	objs = git__calloc(count, sizeof(git_odb_object *));
+
+	cl_git_pass(git_odb_read_many_array(objs, _odb, ids, count));
+
+	for (i = 0; i < count; i++) {
+		cl_assert_equal_oid(&ids[i], git_odb_object_id(objs[i]));
+		git_odb_object_free(objs[i]);
+	}
+
+	git__free(objs);
+	git__free(ids);
+}
+
+void test_odb_packed__read_many_fails_on_missing_object(void)
+{
+	git_odb_object *objs[3];
+	git_oid ids[3];
+
+	cl_git_pass(git_oid_fromstr(&ids[0], packed_objects[0]));
+	cl_git_pass(git_oid_fromstr(&ids[1], "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	cl_git_pass(git_oid_fromstr(&ids[2], loose_objects[0]));
+
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_odb_read_many_array(objs, _odb, ids, 3));
+
+	cl_assert_equal_p(NULL, objs[0]);
+	cl_assert_equal_p(NULL, objs[1]);
+	cl_assert_equal_p(NULL, objs[2]);
+}
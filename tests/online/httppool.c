@@ -0,0 +1,120 @@
+#include "clar_libgit2.h"
+
+#include "git2/clone.h"
+#include "transports/httpclient.h"
+
+static char *_remote_url;
+static git_repository *_repo;
+static size_t _connects, _reuses;
+
+static void trace_cb(git_trace_level_t level, const char *msg)
+{
+	GIT_UNUSED(level);
+
+	if (!git__prefixcmp(msg, "Connecting to remote"))
+		_connects++;
+	else if (!git__prefixcmp(msg, "Reusing connection"))
+		_reuses++;
+}
+
+void test_online_httppool__initialize(void)
+{
+	_remote_url = cl_getenv("GITTEST_REMOTE_URL");
+
+	if (!_remote_url || git__prefixcmp(_remote_url, "http"))
+		cl_skip();
+
+#ifndef GIT_TRACE
+	cl_skip();
+#endif
+
+	cl_git_pass(git_repository_init(&_repo, "./httppool", true));
+	cl_git_pass(git_trace_set(GIT_TRACE_DEBUG, trace_cb));
+
+	/* Start without the connections of earlier tests */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)GIT_HTTP_POOL_MAX_IDLE));
+
+	_connects = _reuses = 0;
+}
+
+void test_online_httppool__cleanup(void)
+{
+	git_trace_set(GIT_TRACE_NONE, NULL);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)GIT_HTTP_POOL_MAX_IDLE));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT, GIT_HTTP_POOL_IDLE_TIMEOUT));
+
+	git_repository_free(_repo);
+	_repo = NULL;
+
+	cl_fixture_cleanup("./httppool");
+
+	git__free(_remote_url);
+	_remote_url = NULL;
+}
+
+static void ls_remote(void)
+{
+	git_remote *remote;
+	const git_remote_head **heads;
+	size_t heads_len;
+
+	cl_git_pass(git_remote_create_anonymous(&remote, _repo, _remote_url));
+	cl_git_pass(git_remote_connect(remote, GIT_DIRECTION_FETCH, NULL, NULL, NULL));
+	cl_git_pass(git_remote_ls(&heads, &heads_len, remote));
+	cl_assert(heads_len > 0);
+
+	git_remote_disconnect(remote);
+	git_remote_free(remote);
+}
+
+static void fetch(void)
+{
+	git_remote *remote;
+
+	cl_git_pass(git_remote_create_anonymous(&remote, _repo, _remote_url));
+	cl_git_pass(git_remote_fetch(remote, NULL, NULL, NULL));
+	git_remote_free(remote);
+}
+
+void test_online_httppool__remotes_share_connections(void)
+{
+	ls_remote();
+	ls_remote();
+
+	cl_assert_equal_sz(1, _connects);
+	cl_assert_equal_sz(1, _reuses);
+}
+
+void test_online_httppool__fetches_share_connections(void)
+{
+	fetch();
+	fetch();
+
+	cl_assert_equal_sz(1, _connects);
+	cl_assert(_reuses > 0);
+}
+
+void test_online_httppool__can_be_disabled(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)0));
+
+	ls_remote();
+	ls_remote();
+
+	cl_assert_equal_sz(2, _connects);
+	cl_assert_equal_sz(0, _reuses);
+}
+
+void test_online_httppool__closes_idle_connections(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT, 1));
+
+	ls_remote();
+	cl_msleep(2000);
+	ls_remote();
+
+	cl_assert_equal_sz(2, _connects);
+	cl_assert_equal_sz(0, _reuses);
+}
@@ -319,3 +319,35 @@ void test_pack_indexer__no_tmp_files(void)
 	cl_assert(git_buf_len(&first_tmp_file) == 0);
 	git_buf_dispose(&first_tmp_file);
 }
+
+void test_pack_indexer__resolves_deltas_while_receiving(void)
+{
+	git_indexer *idx = NULL;
+	git_indexer_progress stats = { 0 };
+	git_buf pack = GIT_BUF_INIT;
+	size_t offset, chunk;
+
+	cl_git_pass(git_futils_readbuffer(&pack,
+		cl_fixture("testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack")));
+
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, NULL));
+
+	for (offset = 0; offset < pack.size; offset += chunk) {
+		chunk = min(pack.size - offset, 4096);
+		cl_git_pass(git_indexer_append(idx, pack.ptr + offset, chunk, &stats));
+	}
+
+	/* The bases of these deltas were all sent before them */
+	cl_assert(stats.total_deltas > 0);
+	cl_assert_equal_i(stats.total_deltas, stats.indexed_deltas);
+	cl_assert_equal_i(stats.total_objects, stats.indexed_objects);
+
+	cl_git_pass(git_indexer_commit(idx, &stats));
+
+	cl_assert_equal_i(stats.total_objects, stats.received_objects);
+	cl_assert_equal_i(stats.total_objects, stats.indexed_objects);
+	cl_assert_equal_i(stats.total_deltas, stats.indexed_deltas);
+
+	git_indexer_free(idx);
+	git_buf_dispose(&pack);
+}
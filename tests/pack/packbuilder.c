@@ -5,6 +5,7 @@
 #include "iterator.h"
 #include "vector.h"
 #include "posix.h"
+#include "pack-objects.h"
 
 static git_repository *_repo;
 static git_revwalk *_revwalker;
@@ -151,6 +152,99 @@ void test_pack_packbuilder__get_hash(void)
 	cl_assert_equal_s(hex, "7f5fa362c664d68ba7221259be1cbd187434b2f0");
 }
 
+void test_pack_packbuilder__create_pack_with_threads(void)
+{
+	seed_packbuilder();
+	git_packbuilder_set_threads(_packbuilder, 4);
+
+	/* The order and the deltas may differ, but not the objects */
+	cl_git_pass(git_indexer_new(&_indexer, ".", 0, NULL, NULL));
+	cl_git_pass(git_packbuilder_foreach(_packbuilder, feed_indexer, &_stats));
+	cl_git_pass(git_indexer_commit(_indexer, &_stats));
+
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), _stats.indexed_objects);
+	cl_assert_equal_i(git_packbuilder_object_count(_packbuilder), git_packbuilder_written(_packbuilder));
+}
+
+/* Pack versions of a blob, which are deltas of one another */
+static void pack_blob_versions(git_oid *ids, size_t count)
+{
+	git_packbuilder *pb;
+	git_buf content = GIT_BUF_INIT;
+	size_t i, j;
+
+	cl_git_pass(git_packbuilder_new(&pb, _repo));
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < 100; j++)
+			git_buf_printf(&content, "line %" PRIuZ " of version %" PRIuZ "\n", j, j == i ? i : 0);
+
+		cl_git_pass(git_blob_create_from_buffer(&ids[i], _repo, content.ptr, content.size));
+		cl_git_pass(git_packbuilder_insert(pb, &ids[i], NULL));
+		git_buf_clear(&content);
+	}
+
+	cl_git_pass(git_packbuilder_write(pb, "objects/pack", 0, NULL, NULL));
+
+	git_packbuilder_free(pb);
+	git_buf_dispose(&content);
+}
+
+static size_t write_reusing_deltas(const git_oid *ids, size_t count, unsigned int threads)
+{
+	size_t i, reused = 0;
+
+	git_packbuilder_set_threads(_packbuilder, threads);
+	git_packbuilder__set_reuse_deltas(_packbuilder, true);
+
+	for (i = 0; i < count; i++)
+		cl_git_pass(git_packbuilder_insert(_packbuilder, &ids[i], NULL));
+
+	cl_git_pass(git_indexer_new(&_indexer, ".", 0, NULL, NULL));
+	cl_git_pass(git_packbuilder_foreach(_packbuilder, feed_indexer, &_stats));
+	cl_git_pass(git_indexer_commit(_indexer, &_stats));
+
+	cl_assert_equal_i(count, _stats.indexed_objects);
+
+	for (i = 0; i < count; i++) {
+		if (_packbuilder->object_list[i].reuse_pack)
+			reused++;
+	}
+
+	return reused;
+}
+
+void test_pack_packbuilder__reuses_deltas(void)
+{
+	git_oid ids[10];
+
+	pack_blob_versions(ids, ARRAY_SIZE(ids));
+
+	/* One version is whole, the others are deltas */
+	cl_assert_equal_sz(ARRAY_SIZE(ids) - 1, write_reusing_deltas(ids, ARRAY_SIZE(ids), 1));
+	cl_assert_equal_i(ARRAY_SIZE(ids) - 1, _stats.total_deltas);
+}
+
+void test_pack_packbuilder__reuses_deltas_with_threads(void)
+{
+	git_oid ids[10];
+
+	pack_blob_versions(ids, ARRAY_SIZE(ids));
+
+	cl_assert_equal_sz(ARRAY_SIZE(ids) - 1, write_reusing_deltas(ids, ARRAY_SIZE(ids), 4));
+	cl_assert_equal_i(ARRAY_SIZE(ids) - 1, _stats.total_deltas);
+}
+
+void test_pack_packbuilder__reuses_deltas_of_objects_in_the_pack(void)
+{
+	git_oid ids[10];
+
+	pack_blob_versions(ids, ARRAY_SIZE(ids));
+
+	/* The bases of some of the deltas are left out */
+	cl_assert(write_reusing_deltas(ids + 5, 5, 1) < 5);
+}
+
 static void test_write_pack_permission(mode_t given, mode_t expected)
 {
 	struct stat statbuf;
@@ -270,3 +364,16 @@ void test_pack_packbuilder__keep_file_check(void)
 	cl_git_pass(git_libgit2_opts(GIT_OPT_DISABLE_PACK_KEEP_FILE_CHECKS, true));
 	assert(git_disable_pack_keep_file_checks);
 }
+
+void test_pack_packbuilder__foreach_with_threads_and_cancel(void)
+{
+	git_indexer *idx;
+
+	seed_packbuilder();
+	git_packbuilder_set_threads(_packbuilder, 4);
+
+	cl_git_pass(git_indexer_new(&idx, ".", 0, NULL, NULL));
+	cl_git_fail_with(
+		git_packbuilder_foreach(_packbuilder, foreach_cancel_cb, idx), -1111);
+	git_indexer_free(idx);
+}
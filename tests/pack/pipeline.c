@@ -0,0 +1,127 @@
+#include "clar_libgit2.h"
+#include "futils.h"
+#include "pack_pipeline.h"
+
+#define TESTREPO_PACK "testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.pack"
+
+static git_repository *_repo;
+static git_odb *_odb;
+static git_buf _pack;
+
+typedef struct {
+	size_t calls;
+	int error;
+	git_indexer_progress last;
+} progress_data;
+
+void test_pack_pipeline__initialize(void)
+{
+	cl_git_pass(git_repository_init(&_repo, "pipeline.git", true));
+	cl_git_pass(git_repository_odb(&_odb, _repo));
+	cl_git_pass(git_futils_readbuffer(&_pack, cl_fixture(TESTREPO_PACK)));
+}
+
+void test_pack_pipeline__cleanup(void)
+{
+	git_buf_dispose(&_pack);
+	git_odb_free(_odb);
+	git_repository_free(_repo);
+	cl_fixture_cleanup("pipeline.git");
+}
+
+static int progress_cb(const git_indexer_progress *stats, void *payload)
+{
+	progress_data *data = payload;
+
+	data->calls++;
+	memcpy(&data->last, stats, sizeof(git_indexer_progress));
+
+	return data->error;
+}
+
+static int append_all(git_odb_writepack *writepack, git_indexer_progress *stats)
+{
+	size_t offset, chunk;
+	int error;
+
+	for (offset = 0; offset < _pack.size; offset += chunk) {
+		chunk = min(_pack.size - offset, 1024);
+
+		if ((error = writepack->append(writepack, _pack.ptr + offset, chunk, stats)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+void test_pack_pipeline__indexes_the_pack(void)
+{
+	git_odb_writepack *writepack;
+	git_indexer_progress stats = {0};
+	progress_data data = {0};
+	git_oid id;
+
+	cl_git_pass(git_pack_pipeline_new(&writepack, _odb, progress_cb, &data));
+	cl_git_pass(append_all(writepack, &stats));
+	cl_git_pass(writepack->commit(writepack, &stats));
+	writepack->free(writepack);
+
+	cl_assert(data.calls > 0);
+	cl_assert(stats.total_objects > 0);
+	cl_assert_equal_i(stats.total_objects, stats.received_objects);
+	cl_assert_equal_i(stats.total_objects, stats.indexed_objects);
+	cl_assert_equal_i(stats.total_deltas, stats.indexed_deltas);
+	cl_assert_equal_i(stats.total_objects, data.last.indexed_objects);
+
+	cl_git_pass(git_oid_fromstr(&id, "fb20a5a4b6185d9188d82c874db3d9729ef31f3b"));
+	cl_assert(git_odb_exists(_odb, &id));
+}
+
+void test_pack_pipeline__returns_the_indexer_errors(void)
+{
+	git_odb_writepack *writepack;
+	git_indexer_progress stats = {0};
+	int error;
+
+	/* Break the signature */
+	_pack.ptr[0] = 'X';
+
+	cl_git_pass(git_pack_pipeline_new(&writepack, _odb, NULL, NULL));
+
+	if ((error = append_all(writepack, &stats)) == 0)
+		error = writepack->commit(writepack, &stats);
+
+	cl_git_fail(error);
+	cl_assert_equal_i(GIT_ERROR_INDEXER, git_error_last()->klass);
+	cl_assert_equal_s("wrong pack signature", git_error_last()->message);
+
+	writepack->free(writepack);
+}
+
+void test_pack_pipeline__callback_can_cancel(void)
+{
+	git_odb_writepack *writepack;
+	git_indexer_progress stats = {0};
+	progress_data data = {0};
+	int error;
+
+	data.error = -42;
+
+	cl_git_pass(git_pack_pipeline_new(&writepack, _odb, progress_cb, &data));
+
+	if ((error = append_all(writepack, &stats)) == 0)
+		error = writepack->commit(writepack, &stats);
+
+	cl_assert_equal_i(-42, error);
+	writepack->free(writepack);
+}
+
+void test_pack_pipeline__can_be_freed_before_commit(void)
+{
+	git_odb_writepack *writepack;
+	git_indexer_progress stats = {0};
+
+	cl_git_pass(git_pack_pipeline_new(&writepack, _odb, NULL, NULL));
+	cl_git_pass(writepack->append(writepack, _pack.ptr, _pack.size / 2, &stats));
+	writepack->free(writepack);
+}
@@ -4,6 +4,7 @@
 #include "git2/reflog.h"
 #include "git2/refdb.h"
 #include "reflog.h"
+#include "refdb.h"
 #include "refs.h"
 #include "ref_helpers.h"
 
@@ -103,3 +104,179 @@ void test_refs_pack__symbolic(void)
 
 	packall();
 }
+
+void test_refs_pack__lookup_after_packing(void)
+{
+	git_strarray names;
+	git_oid *targets;
+	git_reference *ref;
+	size_t i;
+
+	cl_git_pass(git_reference_list(&names, g_repo));
+	targets = git__calloc(names.count, sizeof(git_oid));
+
+	for (i = 0; i < names.count; i++)
+		cl_git_pass(git_reference_name_to_id(&targets[i], g_repo, names.strings[i]));
+
+	packall();
+
+	for (i = 0; i < names.count; i++) {
+		git_oid id;
+
+		cl_git_pass(git_reference_name_to_id(&id, g_repo, names.strings[i]));
+		cl_assert_equal_oid(&targets[i], &id);
+	}
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/heads/does-not-exist"));
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/aaa"));
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/zzz"));
+
+	git__free(targets);
+	git_strarray_free(&names);
+}
+
+static void assert_packed_ref(
+	const char *name, const char *target, const char *peel)
+{
+	git_reference *ref;
+	git_oid id;
+	int exists;
+	git_refdb *refdb;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_exists(&exists, refdb, name));
+	git_refdb_free(refdb);
+
+	if (!target) {
+		cl_assert(!exists);
+		cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, name));
+		return;
+	}
+
+	cl_assert(exists);
+	cl_git_pass(git_reference_lookup(&ref, g_repo, name));
+	cl_assert(reference_is_packed(ref));
+
+	cl_git_pass(git_oid_fromstr(&id, target));
+	cl_assert_equal_oid(&id, git_reference_target(ref));
+
+	if (peel) {
+		cl_git_pass(git_oid_fromstr(&id, peel));
+		cl_assert_equal_oid(&id, git_reference_target_peel(ref));
+	} else {
+		cl_assert_equal_p(NULL, git_reference_target_peel(ref));
+	}
+
+	git_reference_free(ref);
+}
+
+void test_refs_pack__lookup_in_sorted_file(void)
+{
+	cl_git_rewritefile("testrepo/.git/packed-refs",
+		"# pack-refs with: peeled fully-peeled sorted \n"
+		"# another comment\n"
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/a\n"
+		"e90810b8df3e80c413d903f631643c716887138d refs/heads/a-b\r\n"
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644 refs/heads/a/b\n"
+		"b25fa35b38051e4ae45d4222e795f9df2e43f1d1 refs/tags/annotated\n"
+		"^e90810b8df3e80c413d903f631643c716887138d\n"
+		"41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9 refs/tags/last");
+
+	assert_packed_ref("refs/heads/a",
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750", NULL);
+	assert_packed_ref("refs/heads/a-b",
+		"e90810b8df3e80c413d903f631643c716887138d", NULL);
+	assert_packed_ref("refs/heads/a/b",
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644", NULL);
+	assert_packed_ref("refs/tags/annotated",
+		"b25fa35b38051e4ae45d4222e795f9df2e43f1d1",
+		"e90810b8df3e80c413d903f631643c716887138d");
+	assert_packed_ref("refs/tags/last",
+		"41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9", NULL);
+
+	assert_packed_ref("refs/heads/0", NULL, NULL);
+	assert_packed_ref("refs/heads/a-", NULL, NULL);
+	assert_packed_ref("refs/heads/a/b/c", NULL, NULL);
+	assert_packed_ref("refs/tags/lastly", NULL, NULL);
+
+	/* a rewritten file is picked up */
+	cl_git_rewritefile("testrepo/.git/packed-refs",
+		"# pack-refs with: peeled fully-peeled sorted \n"
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644 refs/heads/b\n");
+
+	assert_packed_ref("refs/heads/a", NULL, NULL);
+	assert_packed_ref("refs/heads/b",
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644", NULL);
+
+	/* as is a deleted one */
+	cl_must_pass(p_unlink("testrepo/.git/packed-refs"));
+	assert_packed_ref("refs/heads/b", NULL, NULL);
+}
+
+static void assert_glob_names(const char *glob, const char **expected)
+{
+	git_reference_iterator *iter;
+	const char *name;
+	size_t i = 0;
+	int error;
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, glob));
+
+	while ((error = git_reference_next_name(&name, iter)) == 0) {
+		cl_assert(expected[i] != NULL);
+		cl_assert_equal_s(expected[i++], name);
+	}
+
+	cl_assert_equal_i(GIT_ITEROVER, error);
+	cl_assert_equal_p(NULL, expected[i]);
+
+	git_reference_iterator_free(iter);
+}
+
+void test_refs_pack__iterate_glob_in_sorted_file(void)
+{
+	const char *a_refs[] = { "refs/heads/a", "refs/heads/a-b", "refs/heads/a/b", NULL };
+	const char *a_dir_refs[] = { "refs/heads/a/b", NULL };
+	const char *br_refs[] = { "refs/heads/br2", "refs/heads/br3", NULL };
+	const char *no_refs[] = { NULL };
+	git_reference_iterator *iter;
+	git_reference *ref;
+
+	cl_git_rewritefile("testrepo/.git/packed-refs",
+		"# pack-refs with: peeled fully-peeled sorted \n"
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/a\n"
+		"e90810b8df3e80c413d903f631643c716887138d refs/heads/a-b\r\n"
+		"5b5b025afb0b4c913b4c338a42934a3863bf3644 refs/heads/a/b\n"
+		"41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9 refs/heads/br2\n"
+		"41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9 refs/heads/br3\n"
+		"b25fa35b38051e4ae45d4222e795f9df2e43f1d1 refs/tags/annotated\n"
+		"^e90810b8df3e80c413d903f631643c716887138d\n");
+
+	assert_glob_names("refs/heads/a*", a_refs);
+	assert_glob_names("refs/heads/a/*", a_dir_refs);
+	assert_glob_names("refs/heads/a-b/*", no_refs);
+	assert_glob_names("refs/heads/zz*", no_refs);
+
+	/* the loose refs/heads/br2 takes precedence over the packed one */
+	assert_glob_names("refs/heads/br*", br_refs);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "refs/heads/br2"));
+	cl_git_pass(git_reference_next(&ref, iter));
+	cl_assert_equal_s("a4a7dce85cf63874e984719f4fdd239f5145052f",
+		git_oid_tostr_s(git_reference_target(ref)));
+	git_reference_free(ref);
+	cl_assert_equal_i(GIT_ITEROVER, git_reference_next(&ref, iter));
+	git_reference_iterator_free(iter);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "refs/tags/ann*"));
+	cl_git_pass(git_reference_next(&ref, iter));
+	cl_assert_equal_s("refs/tags/annotated", git_reference_name(ref));
+	cl_assert_equal_s("e90810b8df3e80c413d903f631643c716887138d",
+		git_oid_tostr_s(git_reference_target_peel(ref)));
+	git_reference_free(ref);
+	cl_assert_equal_i(GIT_ITEROVER, git_reference_next(&ref, iter));
+	git_reference_iterator_free(iter);
+}
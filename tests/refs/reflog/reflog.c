@@ -467,3 +467,153 @@ void test_refs_reflog_reflog__logallrefupdates_nonbare_set_false(void)
 
 	assert_no_reflog_update();
 }
+
+static void assert_iterator_matches_read(const char *refname)
+{
+	git_reflog *reflog;
+	git_reflog_iterator *iter;
+	const git_reflog_entry *expected, *actual;
+	size_t i;
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, refname));
+	cl_git_pass(git_reflog_iterator_new(&iter, g_repo, refname));
+
+	for (i = 0; i < git_reflog_entrycount(reflog); i++) {
+		expected = git_reflog_entry_byindex(reflog, i);
+		cl_git_pass(git_reflog_next(&actual, iter));
+
+		cl_assert_equal_oid(&expected->oid_old, &actual->oid_old);
+		cl_assert_equal_oid(&expected->oid_cur, &actual->oid_cur);
+		assert_signature(expected->committer, actual->committer);
+		cl_assert_equal_s(expected->msg, actual->msg);
+	}
+
+	cl_git_fail_with(GIT_ITEROVER, git_reflog_next(&actual, iter));
+
+	git_reflog_iterator_free(iter);
+	git_reflog_free(reflog);
+}
+
+static void append_entries(const char *refname, size_t count)
+{
+	git_reflog *reflog;
+	git_signature *sig;
+	git_oid id;
+	git_buf msg = GIT_BUF_INIT;
+	size_t i;
+
+	cl_git_pass(git_oid_fromstr(&id, current_master_tip));
+	cl_git_pass(git_reflog_read(&reflog, g_repo, refname));
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_signature_new(&sig, "foo", "foo@bar", 1500000000 + i, 60));
+
+		git_buf_clear(&msg);
+		cl_git_pass(git_buf_printf(&msg, "entry %"PRIuZ": %s", i,
+			"a message long enough to spread the log over several chunks"));
+
+		cl_git_pass(git_reflog_append(reflog, &id, sig, git_buf_cstr(&msg)));
+		git_signature_free(sig);
+	}
+
+	cl_git_pass(git_reflog_write(reflog));
+
+	git_reflog_free(reflog);
+	git_buf_dispose(&msg);
+}
+
+void test_refs_reflog_reflog__iterator_returns_newest_entries_first(void)
+{
+	assert_iterator_matches_read("HEAD");
+	assert_iterator_matches_read("refs/heads/master");
+}
+
+void test_refs_reflog_reflog__iterator_reads_across_chunks(void)
+{
+	append_entries("refs/heads/master", 500);
+	assert_iterator_matches_read("refs/heads/master");
+}
+
+void test_refs_reflog_reflog__iterator_skips_invalid_entries(void)
+{
+	git_buf logpath = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_join_n(&logpath, '/', 3, git_repository_path(g_repo), GIT_REFLOG_DIR, "refs/heads/master"));
+	cl_git_append2file(git_buf_cstr(&logpath), "\nthis is not a reflog entry\n\n");
+
+	assert_iterator_matches_read("refs/heads/master");
+
+	git_buf_dispose(&logpath);
+}
+
+void test_refs_reflog_reflog__iterating_a_missing_reflog_returns_nothing(void)
+{
+	git_reflog_iterator *iter;
+	const git_reflog_entry *entry;
+
+	cl_git_pass(git_reflog_iterator_new(&iter, g_repo, "refs/heads/subtrees"));
+	cl_git_fail_with(GIT_ITEROVER, git_reflog_next(&entry, iter));
+	git_reflog_iterator_free(iter);
+}
+
+void test_refs_reflog_reflog__truncate_keeps_newest_entries(void)
+{
+	git_reflog *before, *after;
+	size_t i, count;
+
+	append_entries("refs/heads/master", 500);
+
+	cl_git_pass(git_reflog_read(&before, g_repo, "refs/heads/master"));
+	cl_git_pass(git_reflog_truncate(g_repo, "refs/heads/master", 320));
+	cl_git_pass(git_reflog_read(&after, g_repo, "refs/heads/master"));
+
+	count = git_reflog_entrycount(after);
+	cl_assert_equal_sz(320, count);
+
+	for (i = 0; i < count; i++) {
+		const git_reflog_entry *expected = git_reflog_entry_byindex(before, i);
+		const git_reflog_entry *actual = git_reflog_entry_byindex(after, i);
+
+		cl_assert_equal_oid(&expected->oid_cur, &actual->oid_cur);
+		assert_signature(expected->committer, actual->committer);
+		cl_assert_equal_s(expected->msg, actual->msg);
+	}
+
+	git_reflog_free(before);
+	git_reflog_free(after);
+}
+
+void test_refs_reflog_reflog__truncate_with_fewer_entries_does_nothing(void)
+{
+	git_reflog *reflog;
+	size_t count;
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	count = git_reflog_entrycount(reflog);
+	git_reflog_free(reflog);
+
+	cl_git_pass(git_reflog_truncate(g_repo, "refs/heads/master", count));
+	cl_git_pass(git_reflog_truncate(g_repo, "refs/heads/master", count + 10));
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	cl_assert_equal_sz(count, git_reflog_entrycount(reflog));
+	git_reflog_free(reflog);
+}
+
+void test_refs_reflog_reflog__truncate_to_zero_empties_the_reflog(void)
+{
+	git_reflog *reflog;
+
+	cl_git_pass(git_reflog_truncate(g_repo, "refs/heads/master", 0));
+
+	assert_has_reflog(true, "refs/heads/master");
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	cl_assert_equal_sz(0, git_reflog_entrycount(reflog));
+	git_reflog_free(reflog);
+}
+
+void test_refs_reflog_reflog__truncate_a_missing_reflog(void)
+{
+	cl_git_pass(git_reflog_truncate(g_repo, "refs/heads/subtrees", 0));
+	assert_has_reflog(false, "refs/heads/subtrees");
+}
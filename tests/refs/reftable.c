@@ -0,0 +1,525 @@
+#include "clar_libgit2.h"
+#include "futils.h"
+#include "reftable.h"
+#include "git2/transaction.h"
+#include "git2/sys/refdb_backend.h"
+
+static git_repository *g_repo;
+
+static const char *g_ids[] = {
+	"a65fedf39aefe402d3bb6e24df4d4f5fe4547750",
+	"e90810b8df3e80c413d903f631643c716887138d",
+	"763d71aadf09a7951596c9746c024e7eece7c7af",
+};
+
+void test_refs_reftable__initialize(void)
+{
+	git_refdb *refdb;
+	git_refdb_backend *backend;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_backend_reftable(&backend, g_repo));
+	cl_git_pass(git_refdb_set_backend(refdb, backend));
+	git_refdb_free(refdb);
+}
+
+void test_refs_reftable__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static size_t count_tables(void)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	size_t i, count = 0;
+
+	cl_git_pass(git_buf_joinpath(&path, git_repository_commondir(g_repo), "reftable/tables.list"));
+	cl_git_pass(git_futils_readbuffer(&contents, path.ptr));
+
+	for (i = 0; i < contents.size; i++)
+		if (contents.ptr[i] == '\n')
+			count++;
+
+	git_buf_dispose(&path);
+	git_buf_dispose(&contents);
+	return count;
+}
+
+static void create_ref(const char *name, const char *id_str)
+{
+	git_reference *ref;
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, id_str));
+	cl_git_pass(git_reference_create(&ref, g_repo, name, &id, 1, NULL));
+	git_reference_free(ref);
+}
+
+static void assert_ref(const char *name, const char *id_str)
+{
+	git_reference *ref;
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, id_str));
+	cl_git_pass(git_reference_lookup(&ref, g_repo, name));
+	cl_assert_equal_oid(&id, git_reference_target(ref));
+	git_reference_free(ref);
+}
+
+void test_refs_reftable__write_and_read_table(void)
+{
+	git_buf buf = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	git_reftable_ref *refs, ref;
+	git_reftable_log logs[3], log;
+	git_reftable *table;
+	git_reftable_iter *iter;
+	char **names;
+	size_t i, count = 5000;
+
+	names = git__calloc(count, sizeof(char *));
+	refs = git__calloc(count, sizeof(git_reftable_ref));
+	cl_assert(names && refs);
+
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_buf_printf(&buf, "refs/tags/v%05d", (int)i));
+		names[i] = git_buf_detach(&buf);
+
+		refs[i].name = names[i];
+		refs[i].update_index = 1 + (i % 3);
+		refs[i].type = (i % 7) ? GIT_REFTABLE_REF_DIRECT : GIT_REFTABLE_REF_SYMBOLIC;
+		refs[i].target = "refs/heads/master";
+		cl_git_pass(git_oid_fromstr(&refs[i].id, g_ids[i % 3]));
+	}
+
+	memset(logs, 0, sizeof(logs));
+	for (i = 0; i < 3; i++) {
+		logs[i].refname = "refs/heads/master";
+		logs[i].update_index = 3 - i;
+		logs[i].name = "Some One";
+		logs[i].email = "some@one.org";
+		logs[i].time = 1234567890 + i;
+		logs[i].tz_offset = -60;
+		logs[i].message = "commit: something";
+		cl_git_pass(git_oid_fromstr(&logs[i].new_id, g_ids[i]));
+	}
+
+	cl_git_pass(git_reftable_write(&buf, 256, 1, 3, refs, count, logs, 3));
+	cl_git_pass(git_buf_joinpath(&path, clar_sandbox_path(), "test.ref"));
+	cl_git_pass(git_futils_writebuffer(&buf, path.ptr, O_CREAT | O_TRUNC | O_WRONLY, 0666));
+
+	cl_git_pass(git_reftable_open(&table, path.ptr));
+	cl_assert_equal_i(1, git_reftable_min_update_index(table));
+	cl_assert_equal_i(3, git_reftable_max_update_index(table));
+	cl_git_pass(git_reftable_iter_new(&iter, table));
+
+	/* a full scan returns everything in order */
+	cl_git_pass(git_reftable_iter_seek_ref(iter, ""));
+	for (i = 0; i < count; i++) {
+		cl_git_pass(git_reftable_iter_next_ref(&ref, iter));
+		cl_assert_equal_s(names[i], ref.name);
+		cl_assert_equal_i(refs[i].type, ref.type);
+		cl_assert_equal_i(refs[i].update_index, ref.update_index);
+
+		if (ref.type == GIT_REFTABLE_REF_SYMBOLIC)
+			cl_assert_equal_s("refs/heads/master", ref.target);
+		else
+			cl_assert_equal_oid(&refs[i].id, &ref.id);
+	}
+	cl_git_fail_with(GIT_ITEROVER, git_reftable_iter_next_ref(&ref, iter));
+
+	/* seeking lands on the first record at or after the name */
+	for (i = 0; i < count; i += 97) {
+		cl_git_pass(git_reftable_iter_seek_ref(iter, names[i]));
+		cl_git_pass(git_reftable_iter_next_ref(&ref, iter));
+		cl_assert_equal_s(names[i], ref.name);
+	}
+
+	cl_git_pass(git_reftable_iter_seek_ref(iter, "refs/tags/v01234x"));
+	cl_git_pass(git_reftable_iter_next_ref(&ref, iter));
+	cl_assert_equal_s("refs/tags/v01235", ref.name);
+
+	cl_git_pass(git_reftable_iter_seek_ref(iter, "refs/tags/w"));
+	cl_git_fail_with(GIT_ITEROVER, git_reftable_iter_next_ref(&ref, iter));
+
+	/* logs come newest first */
+	cl_git_pass(git_reftable_iter_seek_log(iter, "refs/heads/master"));
+	for (i = 0; i < 3; i++) {
+		cl_git_pass(git_reftable_iter_next_log(&log, iter));
+		cl_assert_equal_s("refs/heads/master", log.refname);
+		cl_assert_equal_i(3 - i, log.update_index);
+		cl_assert_equal_s("some@one.org", log.email);
+		cl_assert_equal_i(-60, log.tz_offset);
+		cl_assert_equal_i(1234567890 + i, log.time);
+		cl_assert_equal_oid(&logs[i].new_id, &log.new_id);
+	}
+	cl_git_fail_with(GIT_ITEROVER, git_reftable_iter_next_log(&log, iter));
+
+	cl_git_pass(git_reftable_iter_seek_log(iter, "refs/heads/other"));
+	cl_git_fail_with(GIT_ITEROVER, git_reftable_iter_next_log(&log, iter));
+
+	git_reftable_iter_free(iter);
+	git_reftable_free(table);
+
+	/* unsorted input is refused */
+	refs[0].name = "refs/z";
+	cl_git_fail(git_reftable_write(&buf, 256, 1, 3, refs, count, NULL, 0));
+
+	for (i = 0; i < count; i++)
+		git__free(names[i]);
+	git__free(names);
+	git__free(refs);
+	git_buf_dispose(&buf);
+	git_buf_dispose(&path);
+}
+
+void test_refs_reftable__create_lookup_and_delete(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+
+	create_ref("refs/heads/master", g_ids[0]);
+	cl_git_pass(git_reference_symbolic_create(&ref, g_repo, "HEAD", "refs/heads/master", 1, NULL));
+	git_reference_free(ref);
+
+	assert_ref("refs/heads/master", g_ids[0]);
+	cl_git_pass(git_reference_name_to_id(&id, g_repo, "HEAD"));
+	cl_assert_equal_s(g_ids[0], git_oid_tostr_s(&id));
+
+	create_ref("refs/heads/master", g_ids[1]);
+	assert_ref("refs/heads/master", g_ids[1]);
+
+	/* creating without force fails if the reference exists */
+	cl_git_pass(git_oid_fromstr(&id, g_ids[2]));
+	cl_git_fail_with(GIT_EEXISTS, git_reference_create(&ref, g_repo, "refs/heads/master", &id, 0, NULL));
+
+	/* as does creating one that would be a directory of another or vice versa */
+	cl_git_fail(git_reference_create(&ref, g_repo, "refs/heads/master/sub", &id, 1, NULL));
+	create_ref("refs/heads/dir/sub", g_ids[2]);
+	cl_git_fail(git_reference_create(&ref, g_repo, "refs/heads/dir", &id, 1, NULL));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+	cl_git_pass(git_reference_delete(ref));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+	assert_ref("refs/heads/dir/sub", g_ids[2]);
+}
+
+void test_refs_reftable__iterate(void)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	git_strarray names;
+	const char *name;
+	size_t count = 0;
+
+	create_ref("refs/heads/a", g_ids[0]);
+	create_ref("refs/heads/b/c", g_ids[1]);
+	create_ref("refs/tags/t", g_ids[2]);
+	create_ref("refs/heads/gone", g_ids[2]);
+	cl_git_pass(git_reference_remove(g_repo, "refs/heads/gone"));
+	cl_git_pass(git_reference_symbolic_create(&ref, g_repo, "HEAD", "refs/heads/a", 1, NULL));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_list(&names, g_repo));
+	cl_assert_equal_i(3, names.count);
+	cl_assert_equal_s("refs/heads/a", names.strings[0]);
+	cl_assert_equal_s("refs/heads/b/c", names.strings[1]);
+	cl_assert_equal_s("refs/tags/t", names.strings[2]);
+	git_strarray_free(&names);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "refs/heads/*"));
+	while (git_reference_next_name(&name, iter) == 0) {
+		cl_assert(!git__prefixcmp(name, "refs/heads/"));
+		count++;
+	}
+	cl_assert_equal_i(2, count);
+	git_reference_iterator_free(iter);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "*/t"));
+	cl_git_pass(git_reference_next(&ref, iter));
+	cl_assert_equal_s("refs/tags/t", git_reference_name(ref));
+	git_reference_free(ref);
+	cl_git_fail_with(GIT_ITEROVER, git_reference_next(&ref, iter));
+	git_reference_iterator_free(iter);
+}
+
+void test_refs_reftable__transaction_is_atomic(void)
+{
+	git_transaction *tx;
+	git_reference *ref;
+	git_oid id;
+	size_t tables;
+
+	create_ref("refs/heads/one", g_ids[0]);
+	tables = count_tables();
+
+	cl_git_pass(git_oid_fromstr(&id, g_ids[1]));
+
+	cl_git_pass(git_transaction_new(&tx, g_repo));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/one"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/two"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/one", &id, NULL, NULL));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/two", &id, NULL, NULL));
+
+	/* other writers are locked out until the transaction is done */
+	cl_git_fail_with(GIT_ELOCKED, git_reference_create(&ref, g_repo, "refs/heads/three", &id, 1, NULL));
+
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	assert_ref("refs/heads/one", g_ids[1]);
+	assert_ref("refs/heads/two", g_ids[1]);
+	cl_assert(count_tables() <= tables + 1);
+
+	/* if any update fails, none are written */
+	cl_git_pass(git_oid_fromstr(&id, g_ids[2]));
+
+	cl_git_pass(git_transaction_new(&tx, g_repo));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/one"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/missing"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/one", &id, NULL, NULL));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/missing"));
+	cl_git_fail(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	assert_ref("refs/heads/one", g_ids[1]);
+}
+
+void test_refs_reftable__transactions_do_not_share_locks(void)
+{
+	git_transaction *tx, *other;
+	git_oid id;
+
+	cl_git_pass(git_oid_fromstr(&id, g_ids[0]));
+
+	cl_git_pass(git_transaction_new(&tx, g_repo));
+	cl_git_pass(git_transaction_new(&other, g_repo));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/one"));
+
+	/* another transaction may not join the batch of the first one */
+	cl_git_fail_with(GIT_ELOCKED, git_transaction_lock_ref(other, "refs/heads/two"));
+
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/two"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/one", &id, NULL, NULL));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/two", &id, NULL, NULL));
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	/* once it is done, the other one can go ahead */
+	cl_git_pass(git_oid_fromstr(&id, g_ids[1]));
+	cl_git_pass(git_transaction_lock_ref(other, "refs/heads/two"));
+	cl_git_pass(git_transaction_set_target(other, "refs/heads/two", &id, NULL, NULL));
+	cl_git_pass(git_transaction_commit(other));
+	git_transaction_free(other);
+
+	assert_ref("refs/heads/one", g_ids[0]);
+	assert_ref("refs/heads/two", g_ids[1]);
+}
+
+#ifdef GIT_THREADS
+
+#define WRITER_THREADS 4
+#define WRITER_REFS 16
+
+static void *write_refs(void *payload)
+{
+	size_t thread = *(size_t *)payload, i;
+	git_buf name = GIT_BUF_INIT;
+	git_transaction *tx;
+	git_oid id;
+	int error;
+
+	cl_git_pass(git_oid_fromstr(&id, g_ids[thread % 3]));
+
+	for (i = 0; i < WRITER_REFS; i++) {
+		git_buf_clear(&name);
+		cl_git_pass(git_buf_printf(&name, "refs/heads/t%d-%d", (int)thread, (int)i));
+
+		/* wait for the other writers to be done with the stack */
+		do {
+			cl_git_pass(git_transaction_new(&tx, g_repo));
+
+			if ((error = git_transaction_lock_ref(tx, name.ptr)) == 0 &&
+			    (error = git_transaction_set_target(tx, name.ptr, &id, NULL, NULL)) == 0)
+				error = git_transaction_commit(tx);
+
+			git_transaction_free(tx);
+		} while (error == GIT_ELOCKED);
+
+		cl_git_pass(error);
+	}
+
+	git_buf_dispose(&name);
+	return NULL;
+}
+
+#endif
+
+void test_refs_reftable__concurrent_transactions(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	git_thread threads[WRITER_THREADS];
+	size_t ids[WRITER_THREADS], i, j;
+	git_buf name = GIT_BUF_INIT;
+
+	for (i = 0; i < WRITER_THREADS; i++) {
+		ids[i] = i;
+		cl_git_pass(git_thread_create(&threads[i], write_refs, &ids[i]));
+	}
+
+	for (i = 0; i < WRITER_THREADS; i++)
+		cl_git_pass(git_thread_join(&threads[i], NULL));
+
+	for (i = 0; i < WRITER_THREADS; i++) {
+		for (j = 0; j < WRITER_REFS; j++) {
+			git_buf_clear(&name);
+			cl_git_pass(git_buf_printf(&name, "refs/heads/t%d-%d", (int)i, (int)j));
+			assert_ref(name.ptr, g_ids[i % 3]);
+		}
+	}
+
+	git_buf_dispose(&name);
+#endif
+}
+
+void test_refs_reftable__reflog(void)
+{
+	git_reference *ref, *renamed;
+	git_reflog *reflog;
+	const git_reflog_entry *entry;
+	git_signature *sig;
+	git_oid id;
+
+	cl_git_pass(git_signature_new(&sig, "Some One", "some@one.org", 1234567890, 120));
+
+	cl_git_pass(git_reference_symbolic_create(&ref, g_repo, "HEAD", "refs/heads/master", 1, NULL));
+	git_reference_free(ref);
+	create_ref("refs/heads/master", g_ids[0]);
+	create_ref("refs/heads/master", g_ids[1]);
+
+	cl_assert(git_reference_has_log(g_repo, "refs/heads/master"));
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	cl_assert_equal_i(2, git_reflog_entrycount(reflog));
+	entry = git_reflog_entry_byindex(reflog, 0);
+	cl_git_pass(git_oid_fromstr(&id, g_ids[1]));
+	cl_assert_equal_oid(&id, git_reflog_entry_id_new(entry));
+	git_reflog_free(reflog);
+
+	/* the update of the branch HEAD points to is logged for HEAD too */
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "HEAD"));
+	cl_assert_equal_i(2, git_reflog_entrycount(reflog));
+	git_reflog_free(reflog);
+
+	/* appending and writing back */
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	cl_git_pass(git_reflog_append(reflog, &id, sig, "a\nmultiline message\n"));
+	cl_git_pass(git_reflog_drop(reflog, 2, 1));
+	cl_git_pass(git_reflog_write(reflog));
+	git_reflog_free(reflog);
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	cl_assert_equal_i(2, git_reflog_entrycount(reflog));
+	entry = git_reflog_entry_byindex(reflog, 0);
+	cl_assert_equal_s("a multiline message", git_reflog_entry_message(entry));
+	cl_assert_equal_s("Some One", git_reflog_entry_committer(entry)->name);
+	cl_assert_equal_i(1234567890, git_reflog_entry_committer(entry)->when.time);
+	cl_assert_equal_i(120, git_reflog_entry_committer(entry)->when.offset);
+	git_reflog_free(reflog);
+
+	/* renaming moves the reflog and logs the rename */
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/master"));
+	cl_git_pass(git_reference_rename(&renamed, ref, "refs/heads/moved", 0, "moved"));
+	git_reference_free(ref);
+	git_reference_free(renamed);
+
+	cl_assert(!git_reference_has_log(g_repo, "refs/heads/master"));
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/moved"));
+	cl_assert_equal_i(3, git_reflog_entrycount(reflog));
+	cl_assert_equal_s("moved", git_reflog_entry_message(git_reflog_entry_byindex(reflog, 0)));
+	git_reflog_free(reflog);
+
+	/* deleting the reference deletes its reflog */
+	cl_git_pass(git_reference_remove(g_repo, "refs/heads/moved"));
+	cl_assert(!git_reference_has_log(g_repo, "refs/heads/moved"));
+
+	/* a reflog can exist without entries */
+	cl_git_pass(git_reference_ensure_log(g_repo, "refs/tags/empty"));
+	cl_assert(git_reference_has_log(g_repo, "refs/tags/empty"));
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/tags/empty"));
+	cl_assert_equal_i(0, git_reflog_entrycount(reflog));
+	git_reflog_free(reflog);
+
+	git_signature_free(sig);
+}
+
+void test_refs_reftable__compaction(void)
+{
+	git_buf name = GIT_BUF_INIT;
+	git_refdb *refdb;
+	git_reference *ref;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		git_buf_clear(&name);
+		cl_git_pass(git_buf_printf(&name, "refs/heads/branch-%02d", i));
+		create_ref(name.ptr, g_ids[i % 3]);
+
+		if (i % 2)
+			cl_git_pass(git_reference_remove(g_repo, name.ptr));
+	}
+
+	/* the stack stays logarithmic in the number of updates */
+	cl_assert(count_tables() <= 12);
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_compress(refdb));
+	git_refdb_free(refdb);
+
+	cl_assert_equal_i(1, count_tables());
+
+	for (i = 0; i < 64; i++) {
+		git_buf_clear(&name);
+		cl_git_pass(git_buf_printf(&name, "refs/heads/branch-%02d", i));
+
+		if (i % 2)
+			cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, name.ptr));
+		else
+			assert_ref(name.ptr, g_ids[i % 3]);
+	}
+
+	git_buf_dispose(&name);
+}
+
+void test_refs_reftable__reopen(void)
+{
+	git_repository *repo;
+	git_refdb *refdb;
+	git_refdb_backend *backend;
+	git_reference *ref;
+
+	create_ref("refs/heads/master", g_ids[0]);
+	create_ref("refs/tags/v1", g_ids[1]);
+
+	cl_git_pass(git_repository_open(&repo, git_repository_path(g_repo)));
+	cl_git_pass(git_repository_refdb(&refdb, repo));
+	cl_git_pass(git_refdb_backend_reftable(&backend, repo));
+	cl_git_pass(git_refdb_set_backend(refdb, backend));
+
+	cl_git_pass(git_reference_lookup(&ref, repo, "refs/tags/v1"));
+	git_reference_free(ref);
+
+	/* changes made through one instance are seen by the other */
+	create_ref("refs/tags/v2", g_ids[2]);
+	cl_git_pass(git_reference_lookup(&ref, repo, "refs/tags/v2"));
+	git_reference_free(ref);
+
+	git_refdb_free(refdb);
+	git_repository_free(repo);
+}
@@ -1,5 +1,7 @@
 #include "clar_libgit2.h"
 #include "git2/transaction.h"
+#include "futils.h"
+#include "refdb.h"
 
 static git_repository *g_repo;
 static git_transaction *g_tx;
@@ -155,3 +157,353 @@ void test_refs_transactions__free_unlocks_unmodified_ref(void)
 	/* a transaction must now be able to get the lock */
 	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
 }
+
+static git_transaction *new_packed_transaction(void)
+{
+	git_transaction_options opts = GIT_TRANSACTION_OPTIONS_INIT;
+	git_transaction *tx;
+
+	opts.flags = GIT_TRANSACTION_PACKED;
+	cl_git_pass(git_transaction_new_ext(&tx, g_repo, &opts));
+
+	return tx;
+}
+
+static void assert_ref_target(const char *name, const char *expected)
+{
+	git_reference *ref;
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, name));
+	cl_assert_equal_s(expected, git_oid_tostr_s(git_reference_target(ref)));
+	git_reference_free(ref);
+}
+
+void test_refs_transactions__packed_writes_one_packed_file(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	git_buf name = GIT_BUF_INIT, packed = GIT_BUF_INIT;
+	git_reflog *reflog;
+	git_reference *ref;
+	git_oid id;
+	size_t i;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	for (i = 0; i < 100; i++) {
+		cl_git_pass(git_buf_printf(&name, "refs/heads/batch/%03d", (int)i));
+		cl_git_pass(git_transaction_lock_ref(tx, name.ptr));
+		cl_git_pass(git_transaction_set_target(tx, name.ptr, &id, NULL, "batch"));
+		git_buf_clear(&name);
+	}
+
+	/* update a loose and delete a loose and a packed reference */
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, NULL, "batch"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/packed"));
+
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	assert_ref_target("refs/heads/batch/000", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	assert_ref_target("refs/heads/batch/099", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	assert_ref_target("refs/heads/master", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/br2"));
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/packed"));
+
+	/* everything went into packed-refs, without any loose files */
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/batch"));
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/master"));
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/br2"));
+	cl_assert(!git_path_exists("testrepo/.git/packed-refs.lock"));
+
+	cl_git_pass(git_futils_readbuffer(&packed, "testrepo/.git/packed-refs"));
+	cl_assert(strstr(packed.ptr, " refs/heads/batch/050\n") != NULL);
+	cl_assert(strstr(packed.ptr, " refs/heads/master\n") != NULL);
+	cl_assert(strstr(packed.ptr, " refs/heads/packed\n") == NULL);
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/batch/042"));
+	cl_assert_equal_i(1, git_reflog_entrycount(reflog));
+	cl_assert_equal_s("batch", git_reflog_entry_message(git_reflog_entry_byindex(reflog, 0)));
+	git_reflog_free(reflog);
+
+	git_buf_dispose(&packed);
+	git_buf_dispose(&name);
+}
+
+void test_refs_transactions__packed_writes_symbolic_refs(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	git_reference *ref;
+	git_oid id;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/foo"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/foo", &id, NULL, NULL));
+	cl_git_pass(git_transaction_lock_ref(tx, "HEAD"));
+	cl_git_pass(git_transaction_set_symbolic_target(tx, "HEAD", "refs/heads/foo", NULL, NULL));
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "HEAD"));
+	cl_assert_equal_s("refs/heads/foo", git_reference_symbolic_target(ref));
+	git_reference_free(ref);
+
+	assert_ref_target("refs/heads/foo", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/foo"));
+}
+
+void test_refs_transactions__packed_is_atomic(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	git_reference *ref;
+	git_oid id;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/new-branch"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/new-branch", &id, NULL, NULL));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/missing"));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/missing"));
+
+	cl_git_fail_with(GIT_ENOTFOUND, git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	/* nothing was written, and all locks were released */
+	assert_ref_target("refs/heads/master", "099fabac3a9ea935598528c27f866e34089c2eff");
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/new-branch"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/new-branch"));
+}
+
+void test_refs_transactions__packed_respects_packed_refs_lock(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	git_oid id;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, NULL, NULL));
+
+	/* somebody else is rewriting the packed-refs file */
+	cl_git_mkfile("testrepo/.git/packed-refs.lock", "");
+
+	cl_git_fail_with(GIT_ELOCKED, git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	assert_ref_target("refs/heads/master", "099fabac3a9ea935598528c27f866e34089c2eff");
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+}
+
+static size_t reflog_entrycount(const char *name)
+{
+	git_reflog *reflog;
+	size_t count;
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, name));
+	count = git_reflog_entrycount(reflog);
+	git_reflog_free(reflog);
+
+	return count;
+}
+
+void test_refs_transactions__packed_failure_while_writing_changes_nothing(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	git_buf packed = GIT_BUF_INIT, before = GIT_BUF_INIT;
+	git_reference *ref;
+	size_t master_entries, head_entries;
+	git_oid id, missing;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	git_oid_fromstr(&missing, "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef");
+
+	cl_git_pass(git_futils_readbuffer(&before, "testrepo/.git/packed-refs"));
+	master_entries = reflog_entrycount("refs/heads/master");
+	head_entries = reflog_entrycount("HEAD");
+
+	/*
+	 * The updates are all valid, but the object of one of them is
+	 * missing, which makes writing the packed-refs file fail after the
+	 * other updates were applied to it in memory.
+	 */
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/a-first"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/a-first", &id, NULL, "batch"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/m-missing"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/m-missing", &missing, NULL, "batch"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, NULL, "batch"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/packed"));
+
+	cl_git_fail(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	/* no reference, reflog or file has changed */
+	assert_ref_target("refs/heads/master", "099fabac3a9ea935598528c27f866e34089c2eff");
+	assert_ref_target("refs/heads/packed", "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9");
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/a-first"));
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/m-missing"));
+
+	cl_assert_equal_sz(master_entries, reflog_entrycount("refs/heads/master"));
+	cl_assert_equal_sz(head_entries, reflog_entrycount("HEAD"));
+	cl_assert(!git_path_exists("testrepo/.git/logs/refs/heads/a-first"));
+
+	cl_assert(git_path_exists("testrepo/.git/refs/heads/master"));
+	cl_assert(!git_path_exists("testrepo/.git/packed-refs.lock"));
+	cl_git_pass(git_futils_readbuffer(&packed, "testrepo/.git/packed-refs"));
+	cl_assert_equal_s(before.ptr, packed.ptr);
+
+	/* and every lock was released */
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/a-first"));
+
+	git_buf_dispose(&packed);
+	git_buf_dispose(&before);
+}
+
+void test_refs_transactions__packed_reflogs_record_the_old_values(void)
+{
+	git_transaction *tx = new_packed_transaction();
+	const git_reflog_entry *entry;
+	git_reflog *reflog;
+	git_oid id;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, NULL, "batch"));
+	cl_git_pass(git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	/* the branch and HEAD, which points to it */
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "refs/heads/master"));
+	entry = git_reflog_entry_byindex(reflog, 0);
+	cl_assert_equal_s("099fabac3a9ea935598528c27f866e34089c2eff", git_oid_tostr_s(git_reflog_entry_id_old(entry)));
+	cl_assert_equal_s("a65fedf39aefe402d3bb6e24df4d4f5fe4547750", git_oid_tostr_s(git_reflog_entry_id_new(entry)));
+	git_reflog_free(reflog);
+
+	cl_git_pass(git_reflog_read(&reflog, g_repo, "HEAD"));
+	entry = git_reflog_entry_byindex(reflog, 0);
+	cl_assert_equal_s("099fabac3a9ea935598528c27f866e34089c2eff", git_oid_tostr_s(git_reflog_entry_id_old(entry)));
+	cl_assert_equal_s("batch", git_reflog_entry_message(entry));
+	git_reflog_free(reflog);
+}
+
+#ifdef GIT_THREADS
+
+static void *commit_transaction(void *payload)
+{
+	cl_git_pass(git_transaction_commit(payload));
+	return NULL;
+}
+
+#define PACKED_THREADS 2
+#define PACKED_ROUNDS 8
+#define PACKED_REFS 4
+
+static void *write_packed_refs(void *payload)
+{
+	size_t thread = *(size_t *)payload, i, j;
+	git_buf name = GIT_BUF_INIT;
+	git_transaction *tx;
+	git_oid id;
+	int error;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	for (i = 0; i < PACKED_ROUNDS; i++) {
+		/* wait for the other writer to be done with its batch */
+		do {
+			tx = new_packed_transaction();
+
+			for (j = 0, error = 0; j < PACKED_REFS && !error; j++) {
+				git_buf_clear(&name);
+				cl_git_pass(git_buf_printf(&name, "refs/heads/t%d/%d-%d", (int)thread, (int)i, (int)j));
+
+				if ((error = git_transaction_lock_ref(tx, name.ptr)) == 0)
+					error = git_transaction_set_target(tx, name.ptr, &id, NULL, NULL);
+			}
+
+			if (!error)
+				error = git_transaction_commit(tx);
+
+			git_transaction_free(tx);
+		} while (error == GIT_ELOCKED);
+
+		cl_git_pass(error);
+	}
+
+	git_buf_dispose(&name);
+	return NULL;
+}
+
+#endif
+
+void test_refs_transactions__packed_batch_ignores_other_threads(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	git_refdb *refdb;
+	git_thread thread;
+	git_oid id;
+	int batched;
+
+	git_oid_fromstr(&id, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+
+	/* A batch of ours is open while another thread commits */
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_begin_batch(&batched, refdb));
+	cl_assert(batched);
+
+	cl_git_pass(git_thread_create(&thread, commit_transaction, g_tx));
+	cl_git_pass(git_thread_join(&thread, NULL));
+
+	/* Its update was written, instead of being discarded with our batch */
+	cl_git_pass(git_refdb_end_batch(refdb, false));
+	assert_ref_target("refs/heads/master", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	git_refdb_free(refdb);
+#endif
+}
+
+void test_refs_transactions__packed_concurrent_transactions(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	git_thread threads[PACKED_THREADS];
+	size_t ids[PACKED_THREADS], i, j, k;
+	git_buf name = GIT_BUF_INIT;
+
+	for (i = 0; i < PACKED_THREADS; i++) {
+		ids[i] = i;
+		cl_git_pass(git_thread_create(&threads[i], write_packed_refs, &ids[i]));
+	}
+
+	for (i = 0; i < PACKED_THREADS; i++)
+		cl_git_pass(git_thread_join(&threads[i], NULL));
+
+	for (i = 0; i < PACKED_THREADS; i++) {
+		for (j = 0; j < PACKED_ROUNDS; j++) {
+			for (k = 0; k < PACKED_REFS; k++) {
+				git_buf_clear(&name);
+				cl_git_pass(git_buf_printf(&name, "refs/heads/t%d/%d-%d", (int)i, (int)j, (int)k));
+				assert_ref_target(name.ptr, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+			}
+		}
+	}
+
+	git_buf_dispose(&name);
+#endif
+}
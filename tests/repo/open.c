@@ -33,6 +33,51 @@ void test_repo_open__format_version_1(void)
 
 	cl_git_pass(git_config_set_int32(config, "core.repositoryformatversion", 1));
 
+	git_config_free(config);
+	git_repository_free(repo);
+	cl_git_pass(git_repository_open(&repo, "empty_bare.git"));
+	git_repository_free(repo);
+}
+
+void test_repo_open__format_version_1_extensions(void)
+{
+	git_repository *repo;
+	git_config *config;
+
+	repo = cl_git_sandbox_init("empty_bare.git");
+
+	cl_git_pass(git_repository_open(&repo, "empty_bare.git"));
+	cl_git_pass(git_repository_config(&config, repo));
+
+	cl_git_pass(git_config_set_int32(config, "core.repositoryformatversion", 1));
+	cl_git_pass(git_config_set_string(config, "extensions.partialClone", "origin"));
+	git_repository_free(repo);
+	cl_git_pass(git_repository_open(&repo, "empty_bare.git"));
+	git_repository_free(repo);
+
+	cl_git_pass(git_config_set_bool(config, "extensions.unknown", true));
+	cl_git_fail(git_repository_open(&repo, "empty_bare.git"));
+
+	/* Extensions are ignored with version 0 */
+	cl_git_pass(git_config_set_int32(config, "core.repositoryformatversion", 0));
+	cl_git_pass(git_repository_open(&repo, "empty_bare.git"));
+	git_repository_free(repo);
+
+	git_config_free(config);
+}
+
+void test_repo_open__format_version_2(void)
+{
+	git_repository *repo;
+	git_config *config;
+
+	repo = cl_git_sandbox_init("empty_bare.git");
+
+	cl_git_pass(git_repository_open(&repo, "empty_bare.git"));
+	cl_git_pass(git_repository_config(&config, repo));
+
+	cl_git_pass(git_config_set_int32(config, "core.repositoryformatversion", 2));
+
 	git_config_free(config);
 	git_repository_free(repo);
 	cl_git_fail(git_repository_open(&repo, "empty_bare.git"));
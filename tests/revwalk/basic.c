@@ -625,3 +625,20 @@ void test_revwalk_basic__newer_hidden_commit_hides_old_commits(void)
 
 	cl_git_fail_with(GIT_ITEROVER, git_revwalk_next(&oid, _walk));
 }
+
+void test_revwalk_basic__stops_at_shallow_roots(void)
+{
+	git_oid oid;
+
+	revwalk_basic_setup_walk("shallow.git");
+
+	cl_git_pass(git_revwalk_push_head(_walk));
+	git_revwalk_sorting(_walk, GIT_SORT_TOPOLOGICAL);
+
+	cl_git_pass(git_revwalk_next(&oid, _walk));
+	cl_assert(!git_oid_streq(&oid, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_git_pass(git_revwalk_next(&oid, _walk));
+	cl_assert(!git_oid_streq(&oid, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+
+	cl_git_fail_with(GIT_ITEROVER, git_revwalk_next(&oid, _walk));
+}
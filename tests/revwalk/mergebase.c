@@ -512,3 +512,26 @@ void test_revwalk_mergebase__remove_redundant(void)
 	git_oidarray_free(&result);
 	git_repository_free(repo);
 }
+
+void test_revwalk_mergebase__shallow_roots_have_no_parents(void)
+{
+	git_repository *repo;
+	git_oid result, one, two;
+	size_t ahead, behind;
+
+	repo = cl_git_sandbox_init("testrepo.git");
+	cl_git_mkfile("testrepo.git/shallow",
+		"9fd738e8f7967c078dceed8190330fc8648ee56a\n"
+		"c47800c7266a2be04c571c04d5a6614691ea99bd\n");
+
+	cl_git_pass(git_oid_fromstr(&one, "c47800c7266a2be04c571c04d5a6614691ea99bd"));
+	cl_git_pass(git_oid_fromstr(&two, "9fd738e8f7967c078dceed8190330fc8648ee56a"));
+
+	cl_assert_equal_i(GIT_ENOTFOUND, git_merge_base(&result, repo, &one, &two));
+
+	cl_git_pass(git_graph_ahead_behind(&ahead, &behind, repo, &one, &two));
+	cl_assert_equal_sz(1, ahead);
+	cl_assert_equal_sz(1, behind);
+
+	cl_git_sandbox_cleanup();
+}
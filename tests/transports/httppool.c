@@ -0,0 +1,285 @@
+#include "clar_libgit2.h"
+
+#include "net.h"
+#include "transports/httpclient.h"
+
+#if defined(GIT_THREADS) && !defined(GIT_WIN32)
+# define LOOPBACK_SERVER
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <arpa/inet.h>
+#endif
+
+#ifdef LOOPBACK_SERVER
+
+/*
+ * A server on the loopback interface that answers each GET with a small
+ * body, serving one connection at a time.  It keeps each connection
+ * alive, unless told to close it after every response without saying
+ * so, like a server whose idle timeout is shorter than ours.
+ */
+static struct {
+	int fd;
+	unsigned short port;
+	git_thread thread;
+
+	bool close_after_response;
+	volatile bool stopping;
+
+	size_t connections;
+	size_t requests;
+} _server;
+
+static bool read_request(int fd)
+{
+	char buf[1024];
+	size_t len = 0;
+	ssize_t ret;
+
+	while (len < sizeof(buf) - 1) {
+		ret = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+
+		/*
+		 * Wake up now and then, so that a connection left open by a
+		 * failed test does not keep the server from stopping.
+		 */
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+		    !_server.stopping)
+			continue;
+
+		if (ret <= 0)
+			return false;
+
+		len += ret;
+		buf[len] = '\0';
+
+		if (strstr(buf, "\r\n\r\n"))
+			return true;
+	}
+
+	return false;
+}
+
+static void *serve(void *payload)
+{
+	const char *response = "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello";
+	struct timeval timeout = { 0, 100000 };
+	int fd;
+
+	GIT_UNUSED(payload);
+
+	while ((fd = accept(_server.fd, NULL, NULL)) >= 0) {
+		if (_server.stopping) {
+			close(fd);
+			break;
+		}
+
+		_server.connections++;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		while (read_request(fd)) {
+			_server.requests++;
+
+			if (send(fd, response, strlen(response), 0) < 0 ||
+			    _server.close_after_response)
+				break;
+		}
+
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void connect_to_server(void)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	cl_assert((fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(_server.port);
+
+	cl_must_pass(connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+	close(fd);
+}
+
+#endif
+
+void test_transports_httppool__initialize(void)
+{
+#ifndef LOOPBACK_SERVER
+	cl_skip();
+#else
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+
+	memset(&_server, 0, sizeof(_server));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	cl_assert((_server.fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+	cl_must_pass(bind(_server.fd, (struct sockaddr *)&addr, sizeof(addr)));
+	cl_must_pass(listen(_server.fd, 4));
+	cl_must_pass(getsockname(_server.fd, (struct sockaddr *)&addr, &addr_len));
+	_server.port = ntohs(addr.sin_port);
+
+	cl_git_pass(git_thread_create(&_server.thread, serve, NULL));
+
+	/* Start without the connections of earlier tests */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)GIT_HTTP_POOL_MAX_IDLE));
+#endif
+}
+
+void test_transports_httppool__cleanup(void)
+{
+#ifdef LOOPBACK_SERVER
+	/* Close the pooled connections, so that the server is back in accept */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)GIT_HTTP_POOL_MAX_IDLE));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT, GIT_HTTP_POOL_IDLE_TIMEOUT));
+
+	_server.stopping = true;
+	connect_to_server();
+
+	git_thread_join(&_server.thread, NULL);
+	close(_server.fd);
+#endif
+}
+
+#ifdef LOOPBACK_SERVER
+
+/*
+ * Get the body of the server with a new client, which is released with
+ * `error` set if there is one, then freed.
+ */
+static void get_failing_with(const char *error)
+{
+	git_http_client *client;
+	git_http_request request = {0};
+	git_http_response response = {0};
+	git_buf url_str = GIT_BUF_INIT, body = GIT_BUF_INIT;
+	git_net_url url = GIT_NET_URL_INIT;
+	char buf[64];
+	int len;
+
+	cl_git_pass(git_buf_printf(&url_str, "http://127.0.0.1:%d/", (int)_server.port));
+	cl_git_pass(git_net_url_parse(&url, url_str.ptr));
+
+	request.method = GIT_HTTP_METHOD_GET;
+	request.url = &url;
+
+	cl_git_pass(git_http_client_new(&client, NULL));
+	cl_git_pass(git_http_client_send_request(client, &request));
+	cl_must_pass(git_http_client_read_response(&response, client));
+	cl_assert_equal_i(200, response.status);
+
+	while ((len = git_http_client_read_body(client, buf, sizeof(buf))) > 0)
+		cl_git_pass(git_buf_put(&body, buf, len));
+
+	cl_git_pass(len);
+	cl_assert_equal_s("hello", body.ptr);
+
+	if (error) {
+		git_error_set(GIT_ERROR_NET, "%s", error);
+		git_http_client_release(client);
+		cl_assert(git_error_last() != NULL);
+		cl_assert_equal_s(error, git_error_last()->message);
+		git_error_clear();
+	}
+
+	git_http_client_free(client);
+	git_http_response_dispose(&response);
+	git_net_url_dispose(&url);
+	git_buf_dispose(&url_str);
+	git_buf_dispose(&body);
+}
+
+static void get(void)
+{
+	get_failing_with(NULL);
+}
+
+#endif
+
+void test_transports_httppool__reuses_the_connection_of_another_client(void)
+{
+#ifdef LOOPBACK_SERVER
+	get();
+	get();
+	get();
+
+	cl_assert_equal_sz(1, _server.connections);
+	cl_assert_equal_sz(3, _server.requests);
+#endif
+}
+
+void test_transports_httppool__replays_a_request_on_a_closed_connection(void)
+{
+#ifdef LOOPBACK_SERVER
+	_server.close_after_response = true;
+
+	/*
+	 * The pooled connection is closed by the server by the time that
+	 * the second client sends its request on it; that request is sent
+	 * again on a new connection.
+	 */
+	get();
+	get();
+
+	cl_assert_equal_sz(2, _server.connections);
+	cl_assert_equal_sz(2, _server.requests);
+#endif
+}
+
+void test_transports_httppool__evicts_expired_connections(void)
+{
+#ifdef LOOPBACK_SERVER
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_IDLE_TIMEOUT, 1));
+
+	get();
+	cl_msleep(1100);
+
+	/*
+	 * The first connection expired and is closed, which lets the server
+	 * accept the second one.
+	 */
+	get();
+
+	cl_assert_equal_sz(2, _server.connections);
+	cl_assert_equal_sz(2, _server.requests);
+#endif
+}
+
+void test_transports_httppool__evicts_connections_beyond_the_limit(void)
+{
+#ifdef LOOPBACK_SERVER
+	get();
+
+	/* Lowering the limit closes the idle connection right away */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_HTTP_POOL_MAX_IDLE, (size_t)0));
+	get();
+
+	cl_assert_equal_sz(2, _server.connections);
+	cl_assert_equal_sz(2, _server.requests);
+#endif
+}
+
+void test_transports_httppool__keeps_the_error_of_the_caller(void)
+{
+#ifdef LOOPBACK_SERVER
+	/* Like a fetch that fails and disconnects, the connection is kept */
+	get_failing_with("the fetch failed");
+	get();
+
+	cl_assert_equal_sz(1, _server.connections);
+	cl_assert_equal_sz(2, _server.requests);
+#endif
+}
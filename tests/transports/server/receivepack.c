@@ -0,0 +1,342 @@
+#include "clar_libgit2.h"
+#include "server_util.h"
+
+#include "futils.h"
+#include "path.h"
+
+static git_repository *_client;
+static git_buf _statuses;
+
+void test_transports_server_receivepack__initialize(void)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+
+	server_reset(cl_git_sandbox_init("testrepo.git"));
+
+	opts.bare = 1;
+	opts.fetch_opts.callbacks.transport = server_stateless_transport;
+	cl_git_pass(git_clone(&_client, "server://testrepo.git", "client", &opts));
+
+	git_buf_init(&_statuses, 0);
+}
+
+void test_transports_server_receivepack__cleanup(void)
+{
+	git_buf_dispose(&_statuses);
+	git_repository_free(_client);
+	_client = NULL;
+
+	cl_fixture_cleanup("client");
+	cl_git_sandbox_cleanup();
+}
+
+/* Commit a new file on top of `parent` in the client, at `refname` */
+static void commit_in_client(git_oid *out, const char *refname, const char *parent_hex)
+{
+	git_treebuilder *builder;
+	git_signature *sig;
+	git_commit *parent;
+	git_tree *tree;
+	git_oid id, blob_id, tree_id;
+
+	cl_git_pass(git_oid_fromstr(&id, parent_hex));
+	cl_git_pass(git_commit_lookup(&parent, _client, &id));
+	cl_git_pass(git_commit_tree(&tree, parent));
+
+	cl_git_pass(git_blob_create_from_buffer(&blob_id, _client, refname, strlen(refname)));
+	cl_git_pass(git_treebuilder_new(&builder, _client, tree));
+	cl_git_pass(git_treebuilder_insert(NULL, builder, "pushed.txt", &blob_id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&tree_id, builder));
+	git_tree_free(tree);
+	cl_git_pass(git_tree_lookup(&tree, _client, &tree_id));
+
+	cl_git_pass(git_signature_new(&sig, "me", "me@example.com", 1600000000, 0));
+	cl_git_pass(git_commit_create(out, _client, refname, sig, sig,
+		NULL, "pushed\n", tree, 1, (const git_commit **)&parent));
+
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_treebuilder_free(builder);
+	git_commit_free(parent);
+}
+
+static int record_status(const char *refname, const char *status, void *data)
+{
+	GIT_UNUSED(data);
+	return git_buf_printf(&_statuses, "%s %s\n", refname, status ? status : "ok");
+}
+
+static void push_with(git_transport_cb transport, const char *refspec, ...)
+{
+	git_push_options opts = GIT_PUSH_OPTIONS_INIT;
+	const char *specs[4];
+	git_strarray refspecs = { (char **)specs, 0 };
+	git_remote *remote;
+	va_list ap;
+
+	va_start(ap, refspec);
+	for (; refspec && refspecs.count < ARRAY_SIZE(specs); refspec = va_arg(ap, const char *))
+		specs[refspecs.count++] = refspec;
+	va_end(ap);
+
+	opts.callbacks.transport = transport;
+	opts.callbacks.push_update_reference = record_status;
+
+	cl_git_pass(git_remote_lookup(&remote, _client, "origin"));
+	cl_git_pass(git_remote_push(remote, &refspecs, &opts));
+	cl_assert_equal_i(0, server_error);
+
+	git_remote_free(remote);
+}
+
+static void assert_ref(const char *refname, const git_oid *expected)
+{
+	git_oid id;
+
+	cl_git_pass(git_reference_name_to_id(&id, server_repo, refname));
+	cl_assert_equal_oid(expected, &id);
+}
+
+static bool has_object(const git_oid *id)
+{
+	git_odb *odb;
+	bool found;
+
+	cl_git_pass(git_repository_odb(&odb, server_repo));
+	found = git_odb_exists(odb, id);
+	git_odb_free(odb);
+
+	return found;
+}
+
+static int find_incoming(void *payload, git_buf *path)
+{
+	GIT_UNUSED(payload);
+	return git__prefixcmp(path->ptr + git_path_basename_offset(path), "incoming") ? 0 : 1;
+}
+
+static void assert_no_quarantine(void)
+{
+	git_buf objects = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_joinpath(&objects, git_repository_path(server_repo), "objects"));
+	cl_assert_equal_i(0, git_path_direach(&objects, 0, find_incoming, NULL));
+
+	git_buf_dispose(&objects);
+}
+
+static void push_a_new_branch(git_transport_cb transport)
+{
+	git_oid id;
+
+	commit_in_client(&id, "refs/heads/topic", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	push_with(transport, "refs/heads/topic:refs/heads/topic", NULL);
+
+	cl_assert_equal_s("refs/heads/topic ok\n", _statuses.ptr);
+	assert_ref("refs/heads/topic", &id);
+	cl_assert(has_object(&id));
+	assert_no_quarantine();
+}
+
+void test_transports_server_receivepack__push_stateless(void)
+{
+	push_a_new_branch(server_stateless_transport);
+}
+
+void test_transports_server_receivepack__push_stateful(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	push_a_new_branch(server_stateful_transport);
+#endif
+}
+
+void test_transports_server_receivepack__fast_forwards_and_deletes(void)
+{
+	git_oid id;
+
+	cl_repo_set_bool(server_repo, "receive.denyNonFastForwards", true);
+
+	commit_in_client(&id, "refs/heads/master", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	push_with(server_stateless_transport,
+		"refs/heads/master:refs/heads/master", ":refs/heads/br2", NULL);
+
+	cl_assert_equal_s(
+		"refs/heads/br2 ok\n"
+		"refs/heads/master ok\n", _statuses.ptr);
+	assert_ref("refs/heads/master", &id);
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/br2"));
+}
+
+void test_transports_server_receivepack__follows_the_configuration(void)
+{
+	git_oid id, master;
+
+	cl_repo_set_bool(server_repo, "receive.denyNonFastForwards", true);
+	cl_repo_set_bool(server_repo, "receive.denyDeletes", true);
+
+	/* br2 is not an ancestor of master */
+	commit_in_client(&id, "refs/heads/master", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	push_with(server_stateless_transport,
+		"+refs/heads/master:refs/heads/br2", ":refs/heads/test", NULL);
+
+	cl_assert_equal_s(
+		"refs/heads/br2 non-fast-forward\n"
+		"refs/heads/test deletion prohibited\n", _statuses.ptr);
+
+	cl_git_pass(git_oid_fromstr(&master, "a4a7dce85cf63874e984719f4fdd239f5145052f"));
+	assert_ref("refs/heads/br2", &master);
+	cl_git_pass(git_reference_name_to_id(&id, server_repo, "refs/heads/test"));
+
+	/* The objects of a declined push are not kept */
+	cl_git_pass(git_reference_name_to_id(&id, _client, "refs/heads/master"));
+	cl_assert(!has_object(&id));
+	assert_no_quarantine();
+}
+
+static int decline_forbidden(git_repository *quarantine, const git_receive_pack_command *command, void *payload)
+{
+	git_commit *commit;
+
+	/* The pushed objects can be looked at */
+	if (!git_oid_is_zero(&command->new_id)) {
+		cl_git_pass(git_commit_lookup(&commit, quarantine, &command->new_id));
+		git_commit_free(commit);
+	}
+
+	(*(int *)payload)++;
+
+	if (strstr(command->refname, "forbidden")) {
+		git_error_set_str(GIT_ERROR_INVALID, "no forbidden refs");
+		return 1;
+	}
+
+	return 0;
+}
+
+void test_transports_server_receivepack__asks_the_callback(void)
+{
+	git_oid id;
+	int calls = 0;
+
+	server_receive_opts.update_cb = decline_forbidden;
+	server_receive_opts.payload = &calls;
+
+	commit_in_client(&id, "refs/heads/master", "a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	push_with(server_stateless_transport,
+		"refs/heads/master:refs/heads/allowed",
+		"refs/heads/master:refs/heads/forbidden", NULL);
+
+	cl_assert_equal_i(2, calls);
+	cl_assert_equal_s(
+		"refs/heads/allowed ok\n"
+		"refs/heads/forbidden no forbidden refs\n", _statuses.ptr);
+	assert_ref("refs/heads/allowed", &id);
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/forbidden"));
+}
+
+static void pkt_line(git_buf *buf, const char *line)
+{
+	cl_git_pass(git_buf_printf(buf, "%04x%s", (unsigned int)strlen(line) + 4, line));
+}
+
+/* An empty pack, which the client sends when the server has the objects */
+static void empty_pack(git_buf *buf)
+{
+	git_packbuilder *pb;
+
+	cl_git_pass(git_packbuilder_new(&pb, _client));
+	cl_git_pass(git_packbuilder_write_buf(buf, pb));
+	git_packbuilder_free(pb);
+}
+
+static void serve_push(git_buf *response, const char *first, const char *second)
+{
+	git_buf request = GIT_BUF_INIT, line = GIT_BUF_INIT;
+
+	/* The capabilities are after a NUL, which git_buf_printf would stop at */
+	cl_git_pass(git_buf_printf(&line, "%s", first));
+	cl_git_pass(git_buf_putc(&line, '\0'));
+	cl_git_pass(git_buf_puts(&line, "report-status atomic\n"));
+	cl_git_pass(git_buf_printf(&request, "%04x", (unsigned int)line.size + 4));
+	cl_git_pass(git_buf_put(&request, line.ptr, line.size));
+
+	if (second)
+		pkt_line(&request, second);
+
+	cl_git_pass(git_buf_puts(&request, "0000"));
+	empty_pack(&request);
+
+	server_receive_opts.stateless_rpc = 1;
+	cl_git_pass(server_receive(response, &request, &server_receive_opts));
+
+	git_buf_dispose(&line);
+	git_buf_dispose(&request);
+}
+
+void test_transports_server_receivepack__refuses_missing_objects(void)
+{
+	git_buf out = GIT_BUF_INIT;
+	git_oid id;
+
+	serve_push(&out,
+		"0000000000000000000000000000000000000000 "
+		"deadbeefdeadbeefdeadbeefdeadbeefdeadbeef refs/heads/missing", NULL);
+
+	cl_assert_equal_s(
+		"000eunpack ok\n"
+		"0034ng refs/heads/missing missing necessary objects\n"
+		"0000", out.ptr);
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/missing"));
+
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_receivepack__updates_all_or_nothing_when_atomic(void)
+{
+	git_buf out = GIT_BUF_INIT;
+	git_oid id;
+	int calls = 0;
+
+	server_receive_opts.update_cb = decline_forbidden;
+	server_receive_opts.payload = &calls;
+
+	serve_push(&out,
+		"0000000000000000000000000000000000000000 "
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/allowed",
+		"0000000000000000000000000000000000000000 "
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/forbidden\n");
+
+	cl_assert_equal_s(
+		"000eunpack ok\n"
+		"002eng refs/heads/allowed atomic push failure\n"
+		"002eng refs/heads/forbidden no forbidden refs\n"
+		"0000", out.ptr);
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/allowed"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/forbidden"));
+
+	/* Without the forbidden one, both are created in one transaction */
+	git_buf_clear(&out);
+	serve_push(&out,
+		"0000000000000000000000000000000000000000 "
+		"a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/allowed",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f "
+		"0000000000000000000000000000000000000000 refs/heads/br2\n");
+
+	cl_assert_equal_s(
+		"000eunpack ok\n"
+		"001aok refs/heads/allowed\n"
+		"0016ok refs/heads/br2\n"
+		"0000", out.ptr);
+	cl_git_pass(git_reference_name_to_id(&id, server_repo, "refs/heads/allowed"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, server_repo, "refs/heads/br2"));
+
+	git_buf_dispose(&out);
+}
@@ -0,0 +1,416 @@
+#include "clar_libgit2.h"
+#include "server_util.h"
+
+#include "transports/smart.h"
+
+git_repository *server_repo;
+git_upload_pack_stats server_stats;
+int server_error;
+git_receive_pack_options server_receive_opts;
+
+void server_reset(git_repository *repo)
+{
+	server_repo = repo;
+	memset(&server_stats, 0, sizeof(server_stats));
+	server_error = 0;
+	git_receive_pack_options_init(&server_receive_opts, GIT_RECEIVE_PACK_OPTIONS_VERSION);
+}
+
+typedef struct {
+	git_server_stream parent;
+	git_buf *in;
+	size_t offset;
+	git_buf *out;
+} buffer_stream;
+
+static int buffer_read(git_server_stream *stream, char *buffer, size_t len, size_t *bytes_read)
+{
+	buffer_stream *s = (buffer_stream *)stream;
+
+	*bytes_read = min(len, s->in->size - s->offset);
+	memcpy(buffer, s->in->ptr + s->offset, *bytes_read);
+	s->offset += *bytes_read;
+
+	return 0;
+}
+
+static int buffer_write(git_server_stream *stream, const char *buffer, size_t len)
+{
+	buffer_stream *s = (buffer_stream *)stream;
+	return git_buf_put(s->out, buffer, len);
+}
+
+static void add_stats(const git_upload_pack_stats *stats)
+{
+	server_stats.advertise_time += stats->advertise_time;
+	server_stats.negotiate_time += stats->negotiate_time;
+	server_stats.count_time += stats->count_time;
+	server_stats.pack_time += stats->pack_time;
+	server_stats.sent_objects += stats->sent_objects;
+	server_stats.reused_deltas += stats->reused_deltas;
+	server_stats.sent_bytes += stats->sent_bytes;
+}
+
+int server_upload(git_buf *response, git_buf *request, git_upload_pack_options *opts)
+{
+	buffer_stream stream = { { buffer_read, buffer_write } };
+	git_upload_pack_stats stats;
+	int error;
+
+	stream.in = request;
+	stream.out = response;
+
+	memset(&stats, 0, sizeof(stats));
+	error = git_upload_pack(server_repo, &stream.parent, opts, &stats);
+	add_stats(&stats);
+
+	if (error < 0)
+		server_error = error;
+
+	return error;
+}
+
+int server_receive(git_buf *response, git_buf *request, git_receive_pack_options *opts)
+{
+	buffer_stream stream = { { buffer_read, buffer_write } };
+	int error;
+
+	stream.in = request;
+	stream.out = response;
+
+	if ((error = git_receive_pack(server_repo, &stream.parent, opts)) < 0)
+		server_error = error;
+
+	return error;
+}
+
+typedef struct {
+	git_smart_subtransport parent;
+	git_transport *owner;
+	git_smart_subtransport_stream *current;
+} server_subtransport;
+
+/* The options of the server that a request of the client goes to */
+typedef struct {
+	bool receive;
+	git_upload_pack_options upload;
+	git_receive_pack_options receive_opts;
+} server_options;
+
+static void options_for(server_options *opts, server_subtransport *t, git_smart_service_t action)
+{
+	opts->receive = (action == GIT_SERVICE_RECEIVEPACK_LS ||
+		action == GIT_SERVICE_RECEIVEPACK);
+
+	git_upload_pack_options_init(&opts->upload, GIT_UPLOAD_PACK_OPTIONS_VERSION);
+	opts->upload.protocol_version = ((transport_smart *)t->owner)->request_v2 ? 2 : 0;
+	opts->upload.advertise_refs = (action == GIT_SERVICE_UPLOADPACK_LS);
+	opts->upload.pack_threads = 2;
+
+	memcpy(&opts->receive_opts, &server_receive_opts, sizeof(server_receive_opts));
+	opts->receive_opts.advertise_refs = (action == GIT_SERVICE_RECEIVEPACK_LS);
+}
+
+static int serve(git_buf *response, git_buf *request, server_options *opts)
+{
+	if (opts->receive)
+		return server_receive(response, request, &opts->receive_opts);
+
+	return server_upload(response, request, &opts->upload);
+}
+
+typedef struct {
+	git_smart_subtransport_stream parent;
+	server_options opts;
+	git_buf request, response;
+	size_t offset;
+	bool served;
+} rpc_stream;
+
+static int rpc_read(git_smart_subtransport_stream *stream, char *buffer, size_t len, size_t *bytes_read)
+{
+	rpc_stream *s = (rpc_stream *)stream;
+
+	/*
+	 * Like an HTTP server, announce the service before the references
+	 * of protocol v0.  The server errors are in the response.
+	 */
+	if (!s->served) {
+		if (s->opts.receive && s->opts.receive_opts.advertise_refs)
+			git_buf_puts(&s->response, "001f# service=git-receive-pack\n0000");
+		else if (!s->opts.receive && s->opts.upload.advertise_refs &&
+			 s->opts.upload.protocol_version != 2)
+			git_buf_puts(&s->response, "001e# service=git-upload-pack\n0000");
+
+		serve(&s->response, &s->request, &s->opts);
+		s->served = true;
+	}
+
+	*bytes_read = min(len, s->response.size - s->offset);
+	memcpy(buffer, s->response.ptr + s->offset, *bytes_read);
+	s->offset += *bytes_read;
+
+	return 0;
+}
+
+static int rpc_write(git_smart_subtransport_stream *stream, const char *buffer, size_t len)
+{
+	rpc_stream *s = (rpc_stream *)stream;
+	return git_buf_put(&s->request, buffer, len);
+}
+
+static void rpc_free(git_smart_subtransport_stream *stream)
+{
+	rpc_stream *s = (rpc_stream *)stream;
+
+	git_buf_dispose(&s->request);
+	git_buf_dispose(&s->response);
+	git__free(s);
+}
+
+static int rpc_action(
+	git_smart_subtransport_stream **out,
+	git_smart_subtransport *subtransport,
+	const char *url,
+	git_smart_service_t action)
+{
+	server_subtransport *t = (server_subtransport *)subtransport;
+	rpc_stream *s;
+
+	GIT_UNUSED(url);
+
+	s = git__calloc(1, sizeof(rpc_stream));
+	GIT_ERROR_CHECK_ALLOC(s);
+
+	s->parent.subtransport = subtransport;
+	s->parent.read = rpc_read;
+	s->parent.write = rpc_write;
+	s->parent.free = rpc_free;
+
+	options_for(&s->opts, t, action);
+	s->opts.upload.stateless_rpc = 1;
+	s->opts.receive_opts.stateless_rpc = 1;
+
+	*out = &s->parent;
+	return 0;
+}
+
+#ifdef GIT_THREADS
+
+typedef struct {
+	git_mutex lock;
+	git_cond cond;
+	git_buf data;
+	size_t offset;
+	bool closed;
+} pipe_buf;
+
+static void pipe_init(pipe_buf *p)
+{
+	memset(p, 0, sizeof(*p));
+	cl_git_pass(git_mutex_init(&p->lock));
+	cl_git_pass(git_cond_init(&p->cond));
+}
+
+static void pipe_dispose(pipe_buf *p)
+{
+	git_buf_dispose(&p->data);
+	git_cond_free(&p->cond);
+	git_mutex_free(&p->lock);
+}
+
+static int pipe_read(pipe_buf *p, char *buffer, size_t len, size_t *bytes_read)
+{
+	git_mutex_lock(&p->lock);
+
+	while (p->offset == p->data.size && !p->closed)
+		git_cond_wait(&p->cond, &p->lock);
+
+	*bytes_read = min(len, p->data.size - p->offset);
+	memcpy(buffer, p->data.ptr + p->offset, *bytes_read);
+	p->offset += *bytes_read;
+
+	git_mutex_unlock(&p->lock);
+	return 0;
+}
+
+static int pipe_write(pipe_buf *p, const char *buffer, size_t len)
+{
+	int error;
+
+	git_mutex_lock(&p->lock);
+	error = git_buf_put(&p->data, buffer, len);
+	git_cond_broadcast(&p->cond);
+	git_mutex_unlock(&p->lock);
+
+	return error;
+}
+
+static void pipe_close(pipe_buf *p)
+{
+	git_mutex_lock(&p->lock);
+	p->closed = true;
+	git_cond_broadcast(&p->cond);
+	git_mutex_unlock(&p->lock);
+}
+
+typedef struct piped_stream piped_stream;
+
+/* The end of the pipes of the server */
+typedef struct {
+	git_server_stream parent;
+	piped_stream *pipes;
+} server_end;
+
+struct piped_stream {
+	git_smart_subtransport_stream parent;
+	server_end server;
+	server_options opts;
+	pipe_buf to_server, to_client;
+	git_thread thread;
+};
+
+static int piped_server_read(git_server_stream *stream, char *buffer, size_t len, size_t *bytes_read)
+{
+	piped_stream *s = ((server_end *)stream)->pipes;
+	return pipe_read(&s->to_server, buffer, len, bytes_read);
+}
+
+static int piped_server_write(git_server_stream *stream, const char *buffer, size_t len)
+{
+	piped_stream *s = ((server_end *)stream)->pipes;
+	return pipe_write(&s->to_client, buffer, len);
+}
+
+static void *run_server(void *payload)
+{
+	piped_stream *s = payload;
+	git_upload_pack_stats stats;
+	int error;
+
+	if (s->opts.receive) {
+		error = git_receive_pack(server_repo, &s->server.parent, &s->opts.receive_opts);
+	} else {
+		memset(&stats, 0, sizeof(stats));
+		error = git_upload_pack(server_repo, &s->server.parent, &s->opts.upload, &stats);
+		add_stats(&stats);
+	}
+
+	if (error < 0)
+		server_error = error;
+
+	pipe_close(&s->to_client);
+	return NULL;
+}
+
+static int piped_read(git_smart_subtransport_stream *stream, char *buffer, size_t len, size_t *bytes_read)
+{
+	piped_stream *s = (piped_stream *)stream;
+	return pipe_read(&s->to_client, buffer, len, bytes_read);
+}
+
+static int piped_write(git_smart_subtransport_stream *stream, const char *buffer, size_t len)
+{
+	piped_stream *s = (piped_stream *)stream;
+	return pipe_write(&s->to_server, buffer, len);
+}
+
+static void piped_free(git_smart_subtransport_stream *stream)
+{
+	piped_stream *s = (piped_stream *)stream;
+	server_subtransport *t = (server_subtransport *)stream->subtransport;
+
+	/* The server stops when we hang up */
+	pipe_close(&s->to_server);
+	git_thread_join(&s->thread, NULL);
+
+	pipe_dispose(&s->to_server);
+	pipe_dispose(&s->to_client);
+	t->current = NULL;
+	git__free(s);
+}
+
+static int piped_action(
+	git_smart_subtransport_stream **out,
+	git_smart_subtransport *subtransport,
+	const char *url,
+	git_smart_service_t action)
+{
+	server_subtransport *t = (server_subtransport *)subtransport;
+	piped_stream *s;
+
+	GIT_UNUSED(url);
+
+	if (t->current) {
+		*out = t->current;
+		return 0;
+	}
+
+	s = git__calloc(1, sizeof(piped_stream));
+	GIT_ERROR_CHECK_ALLOC(s);
+
+	s->parent.subtransport = subtransport;
+	s->parent.read = piped_read;
+	s->parent.write = piped_write;
+	s->parent.free = piped_free;
+	s->server.parent.read = piped_server_read;
+	s->server.parent.write = piped_server_write;
+	s->server.pipes = s;
+
+	options_for(&s->opts, t, action);
+	s->opts.upload.advertise_refs = 0;
+	s->opts.receive_opts.advertise_refs = 0;
+
+	pipe_init(&s->to_server);
+	pipe_init(&s->to_client);
+	cl_git_pass(git_thread_create(&s->thread, run_server, s));
+
+	*out = t->current = &s->parent;
+	return 0;
+}
+
+#endif
+
+static int subtransport_close(git_smart_subtransport *subtransport)
+{
+	GIT_UNUSED(subtransport);
+	return 0;
+}
+
+static void subtransport_free(git_smart_subtransport *subtransport)
+{
+	git__free(subtransport);
+}
+
+static int subtransport_new(git_smart_subtransport **out, git_transport *owner, void *param)
+{
+	server_subtransport *t = git__calloc(1, sizeof(server_subtransport));
+	GIT_ERROR_CHECK_ALLOC(t);
+
+	t->owner = owner;
+#ifdef GIT_THREADS
+	t->parent.action = param ? piped_action : rpc_action;
+#else
+	GIT_UNUSED(param);
+	t->parent.action = rpc_action;
+#endif
+	t->parent.close = subtransport_close;
+	t->parent.free = subtransport_free;
+
+	*out = &t->parent;
+	return 0;
+}
+
+int server_stateless_transport(git_transport **out, git_remote *owner, void *param)
+{
+	git_smart_subtransport_definition def = { subtransport_new, 1, NULL };
+	GIT_UNUSED(param);
+	return git_transport_smart(out, owner, &def);
+}
+
+int server_stateful_transport(git_transport **out, git_remote *owner, void *param)
+{
+	git_smart_subtransport_definition def = { subtransport_new, 0, (void *)1 };
+	GIT_UNUSED(param);
+	return git_transport_smart(out, owner, &def);
+}
@@ -0,0 +1,37 @@
+#ifndef INCLUDE_cl_server_util_h__
+#define INCLUDE_cl_server_util_h__
+
+#include "git2/sys/server.h"
+#include "git2/sys/transport.h"
+
+/*
+ * A subtransport that serves the client with `git_upload_pack` or
+ * `git_receive_pack`: the stateless one runs a request when the client
+ * reads its response, the stateful one runs the server on its own
+ * thread, with pipes.
+ */
+
+/* The repository that is served */
+extern git_repository *server_repo;
+
+/* What `git_upload_pack` did, added up over the requests */
+extern git_upload_pack_stats server_stats;
+
+/* The last error of the server */
+extern int server_error;
+
+/* The callback and its payload for `git_receive_pack` */
+extern git_receive_pack_options server_receive_opts;
+
+/* Serve `repo` from now on, forgetting what was served before */
+void server_reset(git_repository *repo);
+
+/* Run the servers on a request, like the subtransport does */
+int server_upload(git_buf *response, git_buf *request, git_upload_pack_options *opts);
+int server_receive(git_buf *response, git_buf *request, git_receive_pack_options *opts);
+
+/* The transports for `callbacks.transport` */
+int server_stateless_transport(git_transport **out, git_remote *owner, void *param);
+int server_stateful_transport(git_transport **out, git_remote *owner, void *param);
+
+#endif
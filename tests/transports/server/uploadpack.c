@@ -0,0 +1,393 @@
+#include "clar_libgit2.h"
+#include "server_util.h"
+
+#include "transports/smart.h"
+
+static bool _v2_enabled;
+
+void test_transports_server_uploadpack__initialize(void)
+{
+	server_reset(cl_git_sandbox_init("testrepo.git"));
+	_v2_enabled = git_smart__protocol_v2_enabled;
+}
+
+void test_transports_server_uploadpack__cleanup(void)
+{
+	git_smart__protocol_v2_enabled = _v2_enabled;
+	cl_fixture_cleanup("client");
+	cl_git_sandbox_cleanup();
+}
+
+static git_repository *clone_with(git_transport_cb transport, bool v2, git_clone_options *given)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+	git_repository *repo;
+
+	if (given)
+		memcpy(&opts, given, sizeof(opts));
+
+	git_smart__protocol_v2_enabled = v2;
+	opts.fetch_opts.callbacks.transport = transport;
+
+	cl_git_pass(git_clone(&repo, "server://testrepo.git", "client", &opts));
+	cl_assert_equal_i(0, server_error);
+
+	return repo;
+}
+
+static bool has_object(git_repository *repo, const char *hex)
+{
+	git_odb *odb;
+	git_oid id;
+	bool found;
+
+	cl_git_pass(git_oid_fromstr(&id, hex));
+	cl_git_pass(git_repository_odb(&odb, repo));
+	found = git_odb_exists(odb, &id);
+	git_odb_free(odb);
+
+	return found;
+}
+
+static void assert_cloned(git_repository *repo)
+{
+	git_oid id;
+
+	cl_git_pass(git_reference_name_to_id(&id, repo, "refs/remotes/origin/master"));
+	cl_assert_equal_s("a65fedf39aefe402d3bb6e24df4d4f5fe4547750", git_oid_tostr_s(&id));
+
+	/* With the history, the annotated tags and what they point to */
+	cl_assert(has_object(repo, "8496071c1b46c854b31185ea97743be6a8774479"));
+	cl_assert(has_object(repo, "7b4384978d2493e851f9cca7858815fac9b10980"));
+	cl_assert(has_object(repo, "1385f264afb75a56a5bec74243be9b367ba4ca08"));
+
+	cl_assert(server_stats.sent_objects > 0);
+	cl_assert(server_stats.sent_bytes > 0);
+}
+
+void test_transports_server_uploadpack__clone_stateless_v0(void)
+{
+	git_repository *repo = clone_with(server_stateless_transport, false, NULL);
+	assert_cloned(repo);
+	git_repository_free(repo);
+}
+
+void test_transports_server_uploadpack__clone_stateless_v2(void)
+{
+	git_repository *repo = clone_with(server_stateless_transport, true, NULL);
+	assert_cloned(repo);
+	git_repository_free(repo);
+}
+
+void test_transports_server_uploadpack__clone_stateful_v0(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	git_repository *repo = clone_with(server_stateful_transport, false, NULL);
+	assert_cloned(repo);
+	git_repository_free(repo);
+#endif
+}
+
+void test_transports_server_uploadpack__clone_stateful_v2(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	git_repository *repo = clone_with(server_stateful_transport, true, NULL);
+	assert_cloned(repo);
+	git_repository_free(repo);
+#endif
+}
+
+/* Commit on top of the server's master */
+static void commit_on_server(git_oid *out)
+{
+	git_signature *sig;
+	git_commit *parent;
+	git_tree *tree;
+	git_oid id;
+
+	cl_git_pass(git_reference_name_to_id(&id, server_repo, "refs/heads/master"));
+	cl_git_pass(git_commit_lookup(&parent, server_repo, &id));
+	cl_git_pass(git_commit_tree(&tree, parent));
+	cl_git_pass(git_signature_new(&sig, "me", "me@example.com", 1600000000, 0));
+
+	cl_git_pass(git_commit_create(out, server_repo, "refs/heads/master", sig, sig,
+		NULL, "on top\n", tree, 1, (const git_commit **)&parent));
+
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_commit_free(parent);
+}
+
+static void fetch_only_the_new_commit(git_transport_cb transport, bool v2)
+{
+	git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+	git_repository *repo = clone_with(transport, v2, NULL);
+	git_remote *remote;
+	git_oid id, fetched;
+
+	commit_on_server(&id);
+	memset(&server_stats, 0, sizeof(server_stats));
+
+	opts.callbacks.transport = transport;
+	cl_git_pass(git_remote_lookup(&remote, repo, "origin"));
+	cl_git_pass(git_remote_fetch(remote, NULL, &opts, NULL));
+	cl_assert_equal_i(0, server_error);
+
+	cl_git_pass(git_reference_name_to_id(&fetched, repo, "refs/remotes/origin/master"));
+	cl_assert_equal_oid(&id, &fetched);
+
+	/* The client has the tree already */
+	cl_assert_equal_sz(1, server_stats.sent_objects);
+
+	git_remote_free(remote);
+	git_repository_free(repo);
+}
+
+void test_transports_server_uploadpack__fetch_stateless_v0(void)
+{
+	fetch_only_the_new_commit(server_stateless_transport, false);
+}
+
+void test_transports_server_uploadpack__fetch_stateless_v2(void)
+{
+	fetch_only_the_new_commit(server_stateless_transport, true);
+}
+
+void test_transports_server_uploadpack__fetch_stateful_v0(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	fetch_only_the_new_commit(server_stateful_transport, false);
+#endif
+}
+
+void test_transports_server_uploadpack__fetch_stateful_v2(void)
+{
+#ifndef GIT_THREADS
+	cl_skip();
+#else
+	fetch_only_the_new_commit(server_stateful_transport, true);
+#endif
+}
+
+static void shallow_clone(git_transport_cb transport, bool v2)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+	git_repository *repo;
+
+	opts.fetch_opts.depth = 1;
+	repo = clone_with(transport, v2, &opts);
+
+	/* The tip of master is there, but not its parent */
+	cl_assert(git_repository_is_shallow(repo));
+	cl_assert(has_object(repo, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"));
+	cl_assert(!has_object(repo, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+
+	git_repository_free(repo);
+}
+
+void test_transports_server_uploadpack__shallow_clone_v0(void)
+{
+	shallow_clone(server_stateless_transport, false);
+}
+
+void test_transports_server_uploadpack__shallow_clone_v2(void)
+{
+	shallow_clone(server_stateless_transport, true);
+}
+
+static void partial_clone(bool v2)
+{
+	git_clone_options opts = GIT_CLONE_OPTIONS_INIT;
+	git_repository *repo;
+
+	cl_repo_set_bool(server_repo, "uploadpack.allowFilter", true);
+
+	opts.bare = 1;
+	opts.fetch_opts.filter = "blob:none";
+	repo = clone_with(server_stateless_transport, v2, &opts);
+
+	/* The tree of master is there, but not its blobs */
+	cl_assert(has_object(repo, "944c0f6e4dfa41595e6eb3ceecdb14f50fe18162"));
+	cl_assert(!has_object(repo, "a8233120f6ad708f843d861ce2b7228ec4e3dec6"));
+
+	git_repository_free(repo);
+}
+
+void test_transports_server_uploadpack__partial_clone_v0(void)
+{
+	partial_clone(false);
+}
+
+void test_transports_server_uploadpack__partial_clone_v2(void)
+{
+	partial_clone(true);
+}
+
+static int serve_request(git_buf *response, const char *request, int version)
+{
+	git_upload_pack_options opts = GIT_UPLOAD_PACK_OPTIONS_INIT;
+	git_buf in = GIT_BUF_INIT;
+	int error;
+
+	opts.protocol_version = version;
+	opts.stateless_rpc = 1;
+
+	cl_git_pass(git_buf_sets(&in, request));
+	error = server_upload(response, &in, &opts);
+	git_buf_dispose(&in);
+
+	return error;
+}
+
+void test_transports_server_uploadpack__advertises_the_references(void)
+{
+	git_upload_pack_options opts = GIT_UPLOAD_PACK_OPTIONS_INIT;
+	git_buf in = GIT_BUF_INIT, out = GIT_BUF_INIT;
+	const char *caps;
+
+	opts.advertise_refs = 1;
+	cl_git_pass(server_upload(&out, &in, &opts));
+
+	/* The first reference, then the capabilities after a NUL */
+	cl_assert(!git__prefixcmp(out.ptr + 4, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750 HEAD"));
+	caps = out.ptr + strlen(out.ptr) + 1;
+	cl_assert(strstr(caps, " symref=HEAD:refs/heads/master "));
+
+	cl_assert(strstr(caps, "7b4384978d2493e851f9cca7858815fac9b10980 refs/tags/e90810b\n"));
+	cl_assert(strstr(caps, "e90810b8df3e80c413d903f631643c716887138d refs/tags/e90810b^{}\n"));
+	cl_assert(!memcmp(out.ptr + out.size - 4, "0000", 4));
+
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_uploadpack__lists_the_references_with_v2(void)
+{
+	git_buf out = GIT_BUF_INIT;
+
+	cl_git_pass(serve_request(&out,
+		"0014command=ls-refs\n0001"
+		"0009peel\n000csymrefs\n001dref-prefix refs/heads/ma\n0000", 2));
+
+	cl_assert_equal_s(
+		"003fa65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/master\n"
+		"0000", out.ptr);
+
+	git_buf_clear(&out);
+	cl_git_pass(serve_request(&out,
+		"0014command=ls-refs\n0001"
+		"0009peel\n000csymrefs\n0014ref-prefix HEAD\n0000", 2));
+
+	cl_assert_equal_s(
+		"0052a65fedf39aefe402d3bb6e24df4d4f5fe4547750 HEAD symref-target:refs/heads/master\n"
+		"0000", out.ptr);
+
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_uploadpack__lists_all_the_references_without_arguments_with_v2(void)
+{
+	git_buf out = GIT_BUF_INIT;
+
+	cl_git_pass(serve_request(&out, "0014command=ls-refs\n0000", 2));
+
+	/* Every reference, neither peeled nor with its target */
+	cl_assert(!git__prefixcmp(out.ptr, "0032a65fedf39aefe402d3bb6e24df4d4f5fe4547750 HEAD\n"));
+	cl_assert(strstr(out.ptr, "a65fedf39aefe402d3bb6e24df4d4f5fe4547750 refs/heads/master\n"));
+	cl_assert(strstr(out.ptr, "7b4384978d2493e851f9cca7858815fac9b10980 refs/tags/e90810b\n"));
+	cl_assert(!strstr(out.ptr, "symref-target:"));
+	cl_assert(!strstr(out.ptr, "peeled:"));
+	cl_assert(!memcmp(out.ptr + out.size - 4, "0000", 4));
+
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_uploadpack__refuses_objects_that_are_not_advertised(void)
+{
+	git_buf out = GIT_BUF_INIT;
+
+	/* An ancestor of master */
+	cl_git_fail(serve_request(&out,
+		"0032want c47800c7266a2be04c571c04d5a6614691ea99bd\n00000009done\n", 0));
+	cl_assert(!git__prefixcmp(out.ptr + 4, "ERR upload-pack: not our ref"));
+
+	/* Unless they are reachable and that is allowed */
+	cl_repo_set_bool(server_repo, "uploadpack.allowReachableSHA1InWant", true);
+	git_buf_clear(&out);
+	cl_git_pass(serve_request(&out,
+		"0032want c47800c7266a2be04c571c04d5a6614691ea99bd\n00000009done\n", 0));
+	cl_assert(!git__prefixcmp(out.ptr, "0008NAK\n"));
+	cl_assert_equal_sz(9, server_stats.sent_objects);
+
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_uploadpack__checks_all_the_wants_that_are_not_tips(void)
+{
+	git_buf out = GIT_BUF_INIT, request = GIT_BUF_INIT;
+	git_signature *sig;
+	git_commit *parent;
+	git_tree *tree;
+	git_oid id, dangling;
+
+	cl_repo_set_bool(server_repo, "uploadpack.allowReachableSHA1InWant", true);
+
+	/* Two ancestors of master */
+	cl_git_pass(serve_request(&out,
+		"0032want c47800c7266a2be04c571c04d5a6614691ea99bd\n"
+		"0032want 9fd738e8f7967c078dceed8190330fc8648ee56a\n"
+		"00000009done\n", 0));
+	cl_assert(!git__prefixcmp(out.ptr, "0008NAK\n"));
+
+	/* A commit that no ref leads to */
+	cl_git_pass(git_oid_fromstr(&id, "c47800c7266a2be04c571c04d5a6614691ea99bd"));
+	cl_git_pass(git_commit_lookup(&parent, server_repo, &id));
+	cl_git_pass(git_commit_tree(&tree, parent));
+	cl_git_pass(git_signature_new(&sig, "me", "me@example.com", 1600000000, 0));
+	cl_git_pass(git_commit_create(&dangling, server_repo, NULL, sig, sig,
+		NULL, "dangling\n", tree, 1, (const git_commit **)&parent));
+
+	cl_git_pass(git_buf_printf(&request,
+		"0032want c47800c7266a2be04c571c04d5a6614691ea99bd\n"
+		"0032want %s\n"
+		"00000009done\n", git_oid_tostr_s(&dangling)));
+
+	git_buf_clear(&out);
+	cl_git_fail(serve_request(&out, request.ptr, 0));
+	cl_assert(!git__prefixcmp(out.ptr + 4, "ERR upload-pack: not our ref "));
+	cl_assert(strstr(out.ptr, git_oid_tostr_s(&dangling)));
+
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_commit_free(parent);
+	git_buf_dispose(&request);
+	git_buf_dispose(&out);
+}
+
+void test_transports_server_uploadpack__reports_the_time_of_each_phase(void)
+{
+	git_buf out = GIT_BUF_INIT;
+
+	cl_git_pass(serve_request(&out,
+		"0040want a65fedf39aefe402d3bb6e24df4d4f5fe4547750 side-band-64k\n"
+		"00000009done\n", 0));
+
+	cl_assert(server_stats.negotiate_time >= 0.0);
+	cl_assert(server_stats.count_time >= 0.0);
+	cl_assert(server_stats.pack_time > 0.0);
+	cl_assert_equal_sz(20, server_stats.sent_objects);
+	cl_assert(server_stats.sent_bytes > 0);
+
+	/* The pack and the progress are multiplexed */
+	cl_assert(!git__prefixcmp(out.ptr, "0008NAK\n"));
+	cl_assert(strstr(out.ptr, "\2Counting objects: 20, done.\n"));
+	cl_assert(strstr(out.ptr, "\1PACK"));
+	cl_assert(!memcmp(out.ptr + out.size - 4, "0000", 4));
+
+	git_buf_dispose(&out);
+}
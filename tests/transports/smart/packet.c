@@ -338,3 +338,142 @@ void test_transports_smart_packet__ref_pkt(void)
 		"00360000000000000000000000000000000000000000 HEAD HEAD",
 		"0000000000000000000000000000000000000000", "HEAD HEAD", NULL);
 }
+
+static void assert_v2_special_parses(const char *line, git_pkt_type expected_type)
+{
+	size_t linelen = strlen(line) + 1;
+	const char *endptr;
+	git_pkt *pkt;
+
+	cl_git_pass(git_pkt_parse_v2_line(&pkt, &endptr, line, linelen));
+	cl_assert_equal_i(pkt->type, expected_type);
+	cl_assert_equal_strn(endptr, line + 4, linelen - 4);
+
+	git_pkt_free(pkt);
+}
+
+static void assert_v2_text_parses(const char *line, const char *expected_text)
+{
+	size_t linelen = strlen(line) + 1;
+	const char *endptr;
+	git_pkt_text *pkt;
+
+	cl_git_pass(git_pkt_parse_v2_line((git_pkt **) &pkt, &endptr, line, linelen));
+	cl_assert_equal_i(pkt->type, GIT_PKT_TEXT);
+	cl_assert_equal_i(pkt->len, strlen(expected_text));
+	cl_assert_equal_s(pkt->text, expected_text);
+
+	git_pkt_free((git_pkt *) pkt);
+}
+
+static void assert_v2_ref_parses(const char *line, const char *expected_oid,
+	const char *expected_ref, const char *expected_attributes)
+{
+	size_t linelen = strlen(line) + 1;
+	const char *endptr;
+	git_pkt_ref *pkt;
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, expected_oid));
+
+	cl_git_pass(git_pkt_parse_v2_line((git_pkt **) &pkt, &endptr, line, linelen));
+	cl_assert_equal_i(pkt->type, GIT_PKT_REF);
+	cl_assert_equal_oid(&pkt->head.oid, &oid);
+	cl_assert_equal_s(pkt->head.name, expected_ref);
+	cl_assert_equal_s(pkt->capabilities, expected_attributes);
+
+	git_pkt_free((git_pkt *) pkt);
+}
+
+static void assert_v2_pkt_fails(const char *line)
+{
+	const char *endptr;
+	git_pkt *pkt;
+	cl_git_fail(git_pkt_parse_v2_line(&pkt, &endptr, line, strlen(line) + 1));
+}
+
+void test_transports_smart_packet__version_pkt(void)
+{
+	const char *endptr;
+	const char line[] = "000eversion 2\n";
+	git_pkt_version *pkt;
+
+	cl_git_pass(git_pkt_parse_line((git_pkt **) &pkt, &endptr, line, sizeof(line)));
+	cl_assert_equal_i(pkt->type, GIT_PKT_VERSION);
+	cl_assert_equal_i(pkt->version, 2);
+	git_pkt_free((git_pkt *) pkt);
+
+	assert_pkt_fails("000dversion \n");
+	assert_pkt_fails("000eversion x\n");
+}
+
+void test_transports_smart_packet__v2_special_pkts(void)
+{
+	assert_v2_special_parses("0000", GIT_PKT_FLUSH);
+	assert_v2_special_parses("0001", GIT_PKT_DELIM);
+	assert_v2_special_parses("0001foobar", GIT_PKT_DELIM);
+	assert_v2_special_parses("0002", GIT_PKT_RESPONSE_END);
+	assert_v2_pkt_fails("0003");
+	assert_v2_pkt_fails("0004");
+}
+
+void test_transports_smart_packet__v2_text_pkt(void)
+{
+	assert_v2_text_parses("0013ls-refs=unborn\n", "ls-refs=unborn");
+	assert_v2_text_parses("0020fetch=shallow wait-for-done\n", "fetch=shallow wait-for-done");
+	assert_v2_text_parses("000dpackfile\n", "packfile");
+	assert_v2_text_parses("0009ready", "ready");
+}
+
+void test_transports_smart_packet__v2_ack_nak_err_pkts(void)
+{
+	const char *endptr;
+	git_pkt *pkt;
+
+	cl_git_pass(git_pkt_parse_v2_line(&pkt, &endptr,
+		"0031ACK 1111111111111111111111111111111111111111\n", 50));
+	cl_assert_equal_i(pkt->type, GIT_PKT_ACK);
+	cl_assert_equal_i(((git_pkt_ack *) pkt)->status, GIT_ACK_NONE);
+	git_pkt_free(pkt);
+
+	cl_git_pass(git_pkt_parse_v2_line(&pkt, &endptr, "0008NAK\n", 9));
+	cl_assert_equal_i(pkt->type, GIT_PKT_NAK);
+	git_pkt_free(pkt);
+
+	cl_git_pass(git_pkt_parse_v2_line(&pkt, &endptr, "000cERR oops", 13));
+	cl_assert_equal_i(pkt->type, GIT_PKT_ERR);
+	git_pkt_free(pkt);
+
+	cl_git_pass(git_pkt_parse_v2_line(&pkt, &endptr, "0007\1ab", 8));
+	cl_assert_equal_i(pkt->type, GIT_PKT_DATA);
+	git_pkt_free(pkt);
+}
+
+void test_transports_smart_packet__v2_ref_pkt(void)
+{
+	assert_v2_ref_parses(
+		"0052" "1111111111111111111111111111111111111111 HEAD symref-target:refs/heads/master\n",
+		"1111111111111111111111111111111111111111", "HEAD", "symref-target:refs/heads/master");
+	assert_v2_ref_parses(
+		"006a" "2222222222222222222222222222222222222222 refs/tags/v1 peeled:3333333333333333333333333333333333333333\n",
+		"2222222222222222222222222222222222222222", "refs/tags/v1", "peeled:3333333333333333333333333333333333333333");
+
+	/* References without attributes have no capabilities */
+	{
+		const char line[] = "003f" "1111111111111111111111111111111111111111 refs/heads/master\n";
+		const char *endptr;
+		git_pkt_ref *pkt;
+
+		cl_git_pass(git_pkt_parse_v2_line((git_pkt **) &pkt, &endptr, line, sizeof(line)));
+		cl_assert_equal_i(pkt->type, GIT_PKT_REF);
+		cl_assert_equal_s(pkt->head.name, "refs/heads/master");
+		cl_assert_equal_p(pkt->capabilities, NULL);
+		git_pkt_free((git_pkt *) pkt);
+	}
+
+	/* Anything else that does not start with an object id is text */
+	assert_v2_text_parses(
+		"003f" "111111111111111111111111111111111111111x refs/heads/master\n",
+		"111111111111111111111111111111111111111x refs/heads/master");
+	assert_v2_pkt_fails("002e" "1111111111111111111111111111111111111111 \n");
+}